@@ -14,6 +14,8 @@ local srcFiles = {
 local excludeSrcFiles = {
 	"src/lib/**",
 	"src/include/**",
+	"src/bench/**",
+	"src/microbench/**",
 }
 
 project(projectName)
@@ -26,4 +28,28 @@ location("src/")
 files(srcFiles)
 removefiles({ excludeSrcFiles })
 includedirs({ includePath })
-links({ "pq" })
+links({ "pq", "pthread", "z", "ssl", "crypto" })
+
+-- Generates synthetic FK schemas and times the subsetter against them.
+project(projectName .. "_bench")
+kind(projectKind)
+language(lang)
+cppdialect(standard)
+targetdir("bin/%{cfg.buildcfg}")
+location("src/bench/")
+
+files({ "src/bench/**" })
+includedirs({ includePath })
+links({ "pq", "pthread" })
+
+-- Times the hot paths of pgfe and struct_mapping on fixed in-memory data.
+project(projectName .. "_microbench")
+kind(projectKind)
+language(lang)
+cppdialect(standard)
+targetdir("bin/%{cfg.buildcfg}")
+location("src/microbench/")
+
+files({ "src/microbench/**" })
+includedirs({ includePath })
+links({ "pq", "pthread" })
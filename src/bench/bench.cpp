@@ -0,0 +1,208 @@
+// Generates a synthetic FK schema in the scratch database, runs the
+// subsetter against it end to end and records its timings.
+//
+//   cpp_schema_bench [--shape chain|fanout|diamond|cycle] [--tables N]
+//       [--rows M] [--runs K] [--subsetter PATH] [--results FILE]
+//       [--keep] [-- subsetter options...]
+//
+// Every table is bench_t<i> with an id and a text payload; the shape decides
+// which bench_t<j>.id its p<j> columns reference. Row r of a child
+// references row 1 + (r - 1) % M of each parent, so the subset of row 1 of
+// bench_t0 is every row in the fan-in of that row. The results file gets one
+// JSON object per run, so runs of different builds can be compared.
+
+#include "../include/src/pgfe/pgfe.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pgfe = dmitigr::pgfe;
+
+namespace {
+
+struct BenchOptions {
+    std::string shape = "chain";
+    std::size_t tables = 8;
+    std::size_t rows = 100000;
+    std::size_t runs = 3;
+    std::string subsetter = "bin/Debug/cpp_schema";
+    std::string results = "bench_results.jsonl";
+    bool keep = false;
+    std::vector<std::string> passThrough;
+};
+
+BenchOptions parseBenchOptions(int argc, char** argv) {
+    BenchOptions options;
+    for(int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if(arg == "--") {
+            for(i++; i < argc; i++) options.passThrough.emplace_back(argv[i]);
+            break;
+        }
+        if(arg == "--keep") {
+            options.keep = true;
+            continue;
+        }
+        if(i + 1 >= argc) throw std::invalid_argument{"missing value for " + arg};
+        const std::string value = argv[++i];
+        if(arg == "--shape") options.shape = value;
+        else if(arg == "--tables") options.tables = std::stoul(value);
+        else if(arg == "--rows") options.rows = std::stoul(value);
+        else if(arg == "--runs") options.runs = std::stoul(value);
+        else if(arg == "--subsetter") options.subsetter = value;
+        else if(arg == "--results") options.results = value;
+        else throw std::invalid_argument{"unknown option " + arg};
+    }
+    if(options.shape != "chain" && options.shape != "fanout" && options.shape != "diamond" && options.shape != "cycle")
+        throw std::invalid_argument{"invalid --shape: " + options.shape};
+    if(options.tables < 2 || options.rows < 1 || options.runs < 1)
+        throw std::invalid_argument{"need at least 2 tables, 1 row and 1 run"};
+    return options;
+}
+
+std::string tableName(std::size_t i) {
+    return "bench_t" + std::to_string(i);
+}
+
+// The parents of table i. A cycle closes the chain with a link from the
+// first table to the last.
+std::vector<std::size_t> parentsOf(const BenchOptions& options, std::size_t i) {
+    if(options.shape == "fanout") return i == 0 ? std::vector<std::size_t>{} : std::vector<std::size_t>{0};
+    if(options.shape == "diamond") {
+        if(i == 0) return {};
+        if(i == 1) return {0};
+        return {i - 1, i - 2};
+    }
+    if(options.shape == "cycle" && i == 0) return {options.tables - 1};
+    return i == 0 ? std::vector<std::size_t>{} : std::vector<std::size_t>{i - 1};
+}
+
+void dropSchema(pgfe::Connection& conn, const BenchOptions& options) {
+    for(std::size_t i = 0; i < options.tables; i++) conn.execute("DROP TABLE IF EXISTS " + tableName(i) + " CASCADE");
+}
+
+// The rows are generated on the server; a cycle gets its closing link once
+// every table is filled.
+void createSchema(pgfe::Connection& conn, const BenchOptions& options) {
+    dropSchema(conn, options);
+    const std::string rows = std::to_string(options.rows);
+    for(std::size_t i = 0; i < options.tables; i++) {
+        const bool closing = options.shape == "cycle" && i == 0;
+        std::string columns = "id bigint PRIMARY KEY, payload text NOT NULL";
+        std::string values = "r, md5(r::text)";
+        for(const std::size_t p : parentsOf(options, i)) {
+            columns += ", p" + std::to_string(p) + " bigint";
+            if(!closing) columns += " REFERENCES " + tableName(p) + " (id)";
+            values += closing ? ", NULL" : ", 1 + (r - 1) % " + rows;
+        }
+        conn.execute("CREATE TABLE " + tableName(i) + " (" + columns + ")");
+        conn.execute("INSERT INTO " + tableName(i) + " SELECT " + values + " FROM generate_series(1, " + rows + ") AS r");
+    }
+    if(options.shape == "cycle") {
+        const std::string last = std::to_string(options.tables - 1);
+        conn.execute("UPDATE " + tableName(0) + " SET p" + last + " = id");
+        conn.execute("ALTER TABLE " + tableName(0) + " ADD FOREIGN KEY (p" + last + ") REFERENCES " +
+            tableName(options.tables - 1) + " (id) DEFERRABLE");
+    }
+    for(std::size_t i = 0; i < options.tables; i++) conn.execute("ANALYZE " + tableName(i));
+}
+
+// The phases of the subsetter's --metrics output, which is flat enough to
+// be picked apart without a JSON parser, followed by the load time summed
+// over the tables.
+std::vector<std::pair<std::string, double>> readPhases(const std::filesystem::path& path) {
+    std::ifstream in{path};
+    const std::string json{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+    std::vector<std::pair<std::string, double>> phases;
+    const std::string nameKey = "{\"name\":\"";
+    const std::string secondsKey = "\"seconds\":";
+    for(std::size_t at = json.find(nameKey); at != std::string::npos; at = json.find(nameKey, at)) {
+        at += nameKey.size();
+        const std::size_t end = json.find('"', at);
+        const std::size_t seconds = json.find(secondsKey, end);
+        if(end == std::string::npos || seconds == std::string::npos) break;
+        phases.emplace_back(json.substr(at, end - at), std::stod(json.substr(seconds + secondsKey.size())));
+        at = seconds;
+    }
+    const std::string loadKey = "\"load_seconds\":";
+    double load = 0;
+    for(std::size_t at = json.find(loadKey); at != std::string::npos; at = json.find(loadKey, at)) {
+        at += loadKey.size();
+        load += std::stod(json.substr(at));
+    }
+    phases.emplace_back("load", load);
+    return phases;
+}
+
+std::string shellQuote(const std::string& s) {
+    std::string quoted = "'";
+    for(const char c : s) {
+        if(c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted += '\'';
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const BenchOptions options = parseBenchOptions(argc, argv);
+        // The same database the subsetter connects to.
+        pgfe::Connection conn{pgfe::Connection_options{}
+            .set(pgfe::Communication_mode::net)
+            .set_hostname("localhost")
+            .set_database("db_name")
+            .set_username("postgres")
+            .set_password("postgres")
+            .set_ssl_enabled(false)};
+        conn.connect();
+
+        const auto generateStart = std::chrono::steady_clock::now();
+        createSchema(conn, options);
+        const std::chrono::duration<double> generate = std::chrono::steady_clock::now() - generateStart;
+        std::printf("generated %zu x %zu rows (%s) in %.3f s\n", options.tables, options.rows, options.shape.c_str(), generate.count());
+
+        const auto scratch = std::filesystem::temp_directory_path() / "cpp_schema_bench";
+        std::filesystem::create_directories(scratch);
+        std::ofstream results{options.results, std::ios::app};
+        for(std::size_t run = 0; run < options.runs; run++) {
+            const auto metrics = scratch / "metrics.json";
+            std::filesystem::remove(metrics);
+            std::string command = shellQuote(options.subsetter) + " " + tableName(0) + " 1 --output-dir " +
+                shellQuote((scratch / "out").string()) + " --metrics " + shellQuote(metrics.string());
+            for(const auto& arg : options.passThrough) command += " " + shellQuote(arg);
+            command += " > /dev/null";
+
+            const auto start = std::chrono::steady_clock::now();
+            if(std::system(command.c_str()) != 0) throw std::runtime_error{"subsetter failed: " + command};
+            const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+
+            std::ostringstream line;
+            line << "{\"shape\":\"" << options.shape << "\",\"tables\":" << options.tables << ",\"rows\":" << options.rows
+                 << ",\"run\":" << run << ",\"wall_seconds\":" << wall.count();
+            std::printf("run %zu: %.3f s", run, wall.count());
+            for(const auto& [name, seconds] : readPhases(metrics)) {
+                line << ",\"" << name << "\":" << seconds;
+                std::printf(", %s %.3f s", name.c_str(), seconds);
+            }
+            std::printf("\n");
+            results << line.str() << "}\n";
+        }
+
+        if(!options.keep) dropSchema(conn, options);
+    } catch(const std::exception& e) {
+        std::fprintf(stderr, "bench: %s\n", e.what());
+        return 1;
+    }
+}
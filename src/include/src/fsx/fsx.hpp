@@ -18,6 +18,8 @@
 #define DMITIGR_FSX_FSX_HPP
 
 #include "filesystem.hpp"
+#include "mapped_file.hpp"
 #include "misc.hpp"
+#include "output_directory.hpp"
 
 #endif  // DMITIGR_FSX_FSX_HPP
@@ -0,0 +1,184 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_FSX_MAPPED_FILE_HPP
+#define DMITIGR_FSX_MAPPED_FILE_HPP
+
+#include "../os/exceptions.hpp"
+#include "filesystem.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#include "../os/windows.hpp"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dmitigr::fsx {
+
+/**
+ * @brief A file mapped into memory for reading.
+ *
+ * @details The contents are read by the pages on demand, and the system is
+ * hinted that they are read sequentially, so the file is neither copied into
+ * a buffer nor passed through iostreams.
+ */
+class Mapped_file final {
+public:
+  /// The destructor.
+  ~Mapped_file()
+  {
+    if (data_) {
+#ifdef _WIN32
+      UnmapViewOfFile(data_);
+#else
+      ::munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+  }
+
+  /// Constructs the mapping of an empty file.
+  Mapped_file() noexcept = default;
+
+  /**
+   * @brief Maps the file into memory.
+   *
+   * @param path The path to the file to map.
+   *
+   * @par Exception safety guarantee
+   * Strong.
+   */
+  explicit Mapped_file(const std::filesystem::path& path)
+  {
+    const auto error = [&path]
+    {
+      return os::Sys_exception{"cannot map file \""+path.generic_string()+"\""};
+    };
+#ifdef _WIN32
+    const os::windows::Handle_guard file{CreateFileW(path.c_str(), GENERIC_READ,
+        FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr)};
+    if (file.handle() == INVALID_HANDLE_VALUE)
+      throw error();
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file.handle(), &size))
+      throw error();
+    if (!size.QuadPart)
+      return;
+    const HANDLE mapping_handle{CreateFileMappingW(file.handle(), nullptr,
+        PAGE_READONLY, 0, 0, nullptr)};
+    if (!mapping_handle)
+      throw error();
+    const os::windows::Handle_guard mapping{mapping_handle};
+    const auto* const data = static_cast<const char*>(
+      MapViewOfFile(mapping.handle(), FILE_MAP_READ, 0, 0, 0));
+    if (!data)
+      throw error();
+    data_ = data;
+    size_ = static_cast<std::size_t>(size.QuadPart);
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw error();
+    struct stat st;
+    void* data{MAP_FAILED};
+    if (!::fstat(fd, &st)) {
+      if (st.st_size <= 0) {
+        ::close(fd);
+        return;
+      }
+      data = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ,
+        MAP_PRIVATE, fd, 0);
+    }
+    if (data == MAP_FAILED) {
+      const auto result = error();
+      ::close(fd);
+      throw result;
+    }
+    ::close(fd);
+    data_ = static_cast<const char*>(data);
+    size_ = static_cast<std::size_t>(st.st_size);
+    ::madvise(data, size_, MADV_SEQUENTIAL);
+#endif
+  }
+
+  /// Non copy-constructible.
+  Mapped_file(const Mapped_file&) = delete;
+
+  /// Non copy-assignable.
+  Mapped_file& operator=(const Mapped_file&) = delete;
+
+  /// Move-constructible.
+  Mapped_file(Mapped_file&& rhs) noexcept
+  {
+    swap(rhs);
+  }
+
+  /// Move-assignable.
+  Mapped_file& operator=(Mapped_file&& rhs) noexcept
+  {
+    Mapped_file tmp{std::move(rhs)};
+    swap(tmp);
+    return *this;
+  }
+
+  /// Swaps this instance with `rhs`.
+  void swap(Mapped_file& rhs) noexcept
+  {
+    using std::swap;
+    swap(data_, rhs.data_);
+    swap(size_, rhs.size_);
+  }
+
+  /// @returns The contents of the file.
+  std::string_view view() const noexcept
+  {
+    return {data_, size_};
+  }
+
+  /// @returns The pointer to the contents of the file.
+  const char* data() const noexcept
+  {
+    return data_;
+  }
+
+  /// @returns The size of the file.
+  std::size_t size() const noexcept
+  {
+    return size_;
+  }
+
+  /// @returns `true` if the file is empty.
+  bool is_empty() const noexcept
+  {
+    return !size_;
+  }
+
+private:
+  const char* data_{};
+  std::size_t size_{};
+};
+
+} // namespace dmitigr::fsx
+
+#endif  // DMITIGR_FSX_MAPPED_FILE_HPP
@@ -0,0 +1,278 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_FSX_OUTPUT_DIRECTORY_HPP
+#define DMITIGR_FSX_OUTPUT_DIRECTORY_HPP
+
+#include "../os/exceptions.hpp"
+#include "../util/thread_pool.hpp"
+#include "filesystem.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include "../os/windows.hpp"
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dmitigr::fsx {
+
+/**
+ * @brief A directory of output files which are written side by side.
+ *
+ * @details Every file is created with the space of its estimated size
+ * allocated at once, so the file system can lay it out contiguously instead
+ * of growing it write by write. The writer must not truncate the file when it
+ * opens it, and must cut it to the size written when done. A finished file is
+ * synced to the disk on a pool of threads while the other files are still
+ * written, so there's no long sync of them all at the end. Closing the
+ * directory writes the manifest: the name and the size of every finished
+ * file, one per line separated by a tab, followed by the checksum and the
+ * number of rows of the files finished with them.
+ */
+class Output_directory final {
+public:
+  /// The destructor. Waits for the pending syncs.
+  ~Output_directory()
+  {
+    wait();
+  }
+
+  /**
+   * @brief The constructor.
+   *
+   * @param root The directory, which is created if it doesn't exist.
+   * @param sync_threads The number of threads syncing the finished files, or
+   * zero to not sync them.
+   */
+  explicit Output_directory(std::filesystem::path root,
+    const std::size_t sync_threads = 0)
+    : root_{std::move(root)}
+  {
+    std::filesystem::create_directories(root_);
+    if (sync_threads)
+      pool_.emplace(sync_threads);
+  }
+
+  /// Non copy-constructible.
+  Output_directory(const Output_directory&) = delete;
+
+  /// Non copy-assignable.
+  Output_directory& operator=(const Output_directory&) = delete;
+
+  /// @returns The directory.
+  const std::filesystem::path& root() const noexcept
+  {
+    return root_;
+  }
+
+  /**
+   * @brief Creates the empty file `name` with `estimated_size` bytes
+   * allocated.
+   *
+   * @details The allocation is best effort: it's skipped where the file
+   * system doesn't support it. Until the writer cuts the file, the
+   * allocated space reads as zeros.
+   *
+   * @returns The path to the file.
+   */
+  std::filesystem::path create(const std::filesystem::path& name,
+    const std::uint64_t estimated_size)
+  {
+    auto result = root_ / name;
+#ifdef _WIN32
+    const os::windows::Handle_guard file{CreateFileW(result.c_str(),
+        GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+        nullptr)};
+    if (file.handle() == INVALID_HANDLE_VALUE)
+      throw os::Sys_exception{"cannot create file \""+result.generic_string()+"\""};
+    FILE_ALLOCATION_INFO info{};
+    info.AllocationSize.QuadPart = static_cast<LONGLONG>(estimated_size);
+    if (estimated_size)
+      SetFileInformationByHandle(file.handle(), FileAllocationInfo, &info,
+        sizeof(info));
+#else
+    const int fd = ::open(result.c_str(), O_WRONLY | O_CREAT | O_TRUNC |
+      O_CLOEXEC, 0644);
+    if (fd < 0)
+      throw os::Sys_exception{"cannot create file \""+result.generic_string()+"\""};
+    if (estimated_size) {
+      /*
+       * Unlike posix_fallocate(), fallocate() fails instead of writing the
+       * zeros where the file system can't allocate the space by extents.
+       */
+#ifdef __linux__
+      ::fallocate(fd, 0, 0, static_cast<off_t>(estimated_size));
+#else
+      ::posix_fallocate(fd, 0, static_cast<off_t>(estimated_size));
+#endif
+    }
+    ::close(fd);
+#endif
+    return result;
+  }
+
+  /**
+   * @brief Records the file `name` in the manifest, and syncs it in the
+   * background if the sync threads are given.
+   *
+   * @remarks An error of the sync is thrown by close().
+   */
+  void finish(const std::filesystem::path& name)
+  {
+    finish__(name, {});
+  }
+
+  /**
+   * @brief Records the file `name` like finish(name), along with the CRC-32C
+   * `checksum` of its content and the number of `rows` in it, taken as it
+   * was written, so the file can be verified without reading it twice.
+   */
+  void finish(const std::filesystem::path& name, const std::uint32_t checksum,
+    const std::uint64_t rows)
+  {
+    char hex[9];
+    std::snprintf(hex, sizeof(hex), "%08x", static_cast<unsigned>(checksum));
+    finish__(name, std::string{"\tcrc32c:"}.append(hex).append(1, '\t')
+      .append(std::to_string(rows)));
+  }
+
+  /**
+   * @brief Waits for the syncs of the finished files and writes the
+   * manifest `name`, which is synced along with the directory as well.
+   *
+   * @par Exception safety guarantee
+   * Basic.
+   */
+  void close(const std::filesystem::path& name = "MANIFEST")
+  {
+    if (const auto error = wait())
+      std::rethrow_exception(error);
+
+    std::string content;
+    {
+      const std::lock_guard lock{mutex_};
+      for (const auto& [file, entry] : files_)
+        content.append(file).append(1, '\t')
+          .append(std::to_string(entry.first)).append(entry.second)
+          .append(1, '\n');
+    }
+
+    const auto path = root_ / name;
+    auto tmp = path;
+    tmp += ".tmp";
+    write_file(tmp, content);
+    std::filesystem::rename(tmp, path);
+#ifndef _WIN32
+    sync(root_);
+#endif
+  }
+
+private:
+  std::filesystem::path root_;
+  std::optional<util::Thread_pool> pool_;
+  std::mutex mutex_;
+  std::map<std::string, std::pair<std::uint64_t, std::string>> files_;
+  std::vector<std::future<void>> syncs_;
+
+  /// Records the file `name` with the `extra` fields of its manifest line.
+  void finish__(const std::filesystem::path& name, std::string extra)
+  {
+    const auto path = root_ / name;
+    const auto size = static_cast<std::uint64_t>(std::filesystem::file_size(path));
+    const std::lock_guard lock{mutex_};
+    files_[name.generic_string()] = {size, std::move(extra)};
+    if (pool_)
+      syncs_.push_back(pool_->submit([path]{ sync(path); }));
+  }
+
+  /// @returns The first error of the syncs waited for.
+  std::exception_ptr wait() noexcept
+  {
+    std::vector<std::future<void>> syncs;
+    {
+      const std::lock_guard lock{mutex_};
+      syncs.swap(syncs_);
+    }
+    std::exception_ptr result;
+    for (auto& sync : syncs) {
+      try {
+        sync.get();
+      } catch (...) {
+        if (!result)
+          result = std::current_exception();
+      }
+    }
+    return result;
+  }
+
+  /// Syncs the file or directory `path` to the disk.
+  static void sync(const std::filesystem::path& path)
+  {
+    const auto error = [&path]
+    {
+      return os::Sys_exception{"cannot sync \""+path.generic_string()+"\""};
+    };
+#ifdef _WIN32
+    const os::windows::Handle_guard file{CreateFileW(path.c_str(),
+        GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr)};
+    if (file.handle() == INVALID_HANDLE_VALUE || !FlushFileBuffers(file.handle()))
+      throw error();
+#else
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      throw error();
+    if (::fsync(fd)) {
+      const auto result = error();
+      ::close(fd);
+      throw result;
+    }
+    ::close(fd);
+#endif
+  }
+
+  /// Writes `content` to the file `path` and syncs it.
+  static void write_file(const std::filesystem::path& path,
+    const std::string& content)
+  {
+    {
+      std::ofstream file{path, std::ios_base::binary | std::ios_base::trunc};
+      file.write(content.data(), static_cast<std::streamsize>(content.size()));
+      if (!file.flush())
+        throw os::Exception{"cannot write file \""+path.generic_string()+"\""};
+    }
+    sync(path);
+  }
+};
+
+} // namespace dmitigr::fsx
+
+#endif  // DMITIGR_FSX_OUTPUT_DIRECTORY_HPP
@@ -23,7 +23,9 @@
 #include "exceptions.hpp"
 #include "socket.hpp"
 
+#include <chrono>
 #include <memory>
+#include <optional>
 #include <utility>
 
 namespace dmitigr::net {
@@ -53,22 +55,52 @@ public:
     return endpoint_;
   }
 
+  /**
+   * @brief Sets the maximum time to connect within.
+   *
+   * @param value The timeout, or `std::nullopt` to wait for as long as the
+   * system does.
+   *
+   * @par Requires
+   * `(!value || *value >= 0)`.
+   */
+  Client_options& set_connect_timeout(
+    const std::optional<std::chrono::milliseconds> value)
+  {
+    if (value && !(*value >= std::chrono::milliseconds::zero()))
+      throw Exception{"invalid connect timeout for network client options"};
+    connect_timeout_ = value;
+    return *this;
+  }
+
+  /// @returns The maximum time to connect within.
+  const std::optional<std::chrono::milliseconds>& connect_timeout() const noexcept
+  {
+    return connect_timeout_;
+  }
+
 private:
   Endpoint endpoint_;
+  std::optional<std::chrono::milliseconds> connect_timeout_;
 };
 
 /**
  * @returns A newly created descriptor connected over TCP (or Named Pipe)
  * to `remote` endpoint.
+ *
+ * @remarks Exception is thrown if the connect timeout of `opts` elapses.
  */
 inline std::unique_ptr<Descriptor> make_tcp_connection(const Client_options& opts)
 {
   using Sockdesc = detail::socket_Descriptor;
 
-  static const auto make_tcp_connection = [](const Socket_address& addr)
+  const auto make_tcp_connection = [&opts](const Socket_address& addr)
   {
     auto result = make_tcp_socket(addr.family());
-    connect_socket(result, addr);
+    if (const auto& timeout = opts.connect_timeout())
+      connect_socket(result, addr, *timeout);
+    else
+      connect_socket(result, addr);
     return result;
   };
 
@@ -21,14 +21,27 @@
 #include "../os/exceptions.hpp"
 #include "socket.hpp"
 
+#include "../fsx/filesystem.hpp"
+
 #include <algorithm>
 #include <array>
+#include <cstdint>
 #include <cstdio>
+#include <fstream>
 #include <ios> // std::streamsize
+#include <span>
+#include <string_view>
 #include <utility> // std::move()
 
 #ifdef _WIN32
 #include "../os/windows.hpp"
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #endif
 
 namespace dmitigr::net {
@@ -59,6 +72,32 @@ public:
    */
   virtual std::streamsize write(const char* buf, std::streamsize len) = 0;
 
+  /**
+   * @brief Reads from this descriptor into the buffers `bufs` in turn
+   * synchronously, by one system call where possible.
+   *
+   * @returns Number of bytes read, which may be less than the buffers hold.
+   */
+  virtual std::streamsize read(std::span<const std::span<char>> bufs) = 0;
+
+  /**
+   * @brief Writes the buffers `bufs` in turn to this descriptor
+   * synchronously, by one system call where possible.
+   *
+   * @returns Number of bytes written, which may be less than the buffers hold.
+   */
+  virtual std::streamsize write(std::span<const std::string_view> bufs) = 0;
+
+  /**
+   * @brief Writes the contents of the file `path` from `offset` to the end
+   * to this descriptor synchronously, without copying it through the user
+   * space where possible.
+   *
+   * @returns Number of bytes written.
+   */
+  virtual std::uint64_t send_file(const std::filesystem::path& path,
+    std::uint64_t offset = 0) = 0;
+
   /// Closes the descriptor.
   virtual void close() = 0;
 
@@ -71,6 +110,12 @@ namespace detail {
 /// The base implementation of Descriptor.
 class iDescriptor : public Descriptor {
 public:
+  using Descriptor::read;
+  using Descriptor::write;
+
+  /// The maximum number of buffers read or written by one call.
+  static constexpr std::size_t max_buffer_count{64};
+
   std::streamsize max_read_size() const override
   {
     return 2147479552; // as on Linux
@@ -80,6 +125,55 @@ public:
   {
     return 2147479552; // as on Linux
   }
+
+  /// Reads into the first non-empty buffer only, so as not to block once read.
+  std::streamsize read(const std::span<const std::span<char>> bufs) override
+  {
+    for (const auto buf : bufs) {
+      if (!buf.empty())
+        return read(buf.data(), static_cast<std::streamsize>(buf.size()));
+    }
+    return 0;
+  }
+
+  std::streamsize write(const std::span<const std::string_view> bufs) override
+  {
+    std::streamsize result{};
+    for (const auto buf : bufs) {
+      if (buf.empty())
+        continue;
+      const auto len = static_cast<std::streamsize>(buf.size());
+      const auto n = write(buf.data(), len);
+      result += n;
+      if (n < len)
+        break;
+    }
+    return result;
+  }
+
+  /// Reads the file by the chunks of 64 KiB.
+  std::uint64_t send_file(const std::filesystem::path& path,
+    const std::uint64_t offset = 0) override
+  {
+    std::ifstream file{path, std::ios_base::in | std::ios_base::binary};
+    if (!file || !file.seekg(static_cast<std::streamoff>(offset)))
+      throw Exception{"cannot open file \""+path.generic_string()+"\" to send"};
+
+    std::uint64_t result{};
+    std::array<char, 65536> chunk;
+    while (file) {
+      file.read(chunk.data(), chunk.size());
+      for (std::string_view data{chunk.data(),
+             static_cast<std::size_t>(file.gcount())}; !data.empty();) {
+        const auto n = write(data.data(), static_cast<std::streamsize>(data.size()));
+        data.remove_prefix(static_cast<std::size_t>(n));
+        result += static_cast<std::uint64_t>(n);
+      }
+    }
+    if (file.bad())
+      throw Exception{"cannot read file \""+path.generic_string()+"\" to send"};
+    return result;
+  }
 };
 
 /// The implementation of Descriptor based on sockets.
@@ -146,6 +240,96 @@ public:
     return static_cast<std::streamsize>(result);
   }
 
+  std::streamsize read(const std::span<const std::span<char>> bufs) override
+  {
+    const auto count = std::min(bufs.size(), max_buffer_count);
+#ifdef _WIN32
+    std::array<WSABUF, max_buffer_count> wsabufs;
+    for (std::size_t i{}; i < count; ++i)
+      wsabufs[i] = {static_cast<ULONG>(bufs[i].size()), bufs[i].data()};
+    DWORD result{};
+    DWORD flags{};
+    if (::WSARecv(socket_, wsabufs.data(), static_cast<DWORD>(count), &result,
+        &flags, nullptr, nullptr) == SOCKET_ERROR)
+      throw DMITIGR_NET_EXCEPTION{"cannot read from socket"};
+#else
+    std::array<iovec, max_buffer_count> iov;
+    for (std::size_t i{}; i < count; ++i)
+      iov[i] = {bufs[i].data(), bufs[i].size()};
+    msghdr msg{};
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = count;
+    const auto result = ::recvmsg(socket_, &msg, 0);
+    if (net::is_socket_error(result))
+      throw DMITIGR_NET_EXCEPTION{"cannot read from socket"};
+#endif
+    return static_cast<std::streamsize>(result);
+  }
+
+  std::streamsize write(const std::span<const std::string_view> bufs) override
+  {
+    const auto count = std::min(bufs.size(), max_buffer_count);
+#ifdef _WIN32
+    std::array<WSABUF, max_buffer_count> wsabufs;
+    for (std::size_t i{}; i < count; ++i)
+      wsabufs[i] = {static_cast<ULONG>(bufs[i].size()),
+        const_cast<char*>(bufs[i].data())};
+    DWORD result{};
+    if (::WSASend(socket_, wsabufs.data(), static_cast<DWORD>(count), &result,
+        0, nullptr, nullptr) == SOCKET_ERROR)
+      throw DMITIGR_NET_EXCEPTION{"cannot write to socket"};
+#else
+#ifdef __APPLE__
+    constexpr int flags{};
+#else
+    constexpr int flags{MSG_NOSIGNAL};
+#endif
+    std::array<iovec, max_buffer_count> iov;
+    for (std::size_t i{}; i < count; ++i)
+      iov[i] = {const_cast<char*>(bufs[i].data()), bufs[i].size()};
+    msghdr msg{};
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = count;
+    const auto result = ::sendmsg(socket_, &msg, flags);
+    if (net::is_socket_error(result))
+      throw DMITIGR_NET_EXCEPTION{"cannot write to socket"};
+#endif
+    return static_cast<std::streamsize>(result);
+  }
+
+  /// Uses sendfile() on Linux, so the file goes to the socket in the kernel.
+  std::uint64_t send_file(const std::filesystem::path& path,
+    const std::uint64_t offset = 0) override
+  {
+#ifdef __linux__
+    struct File_guard final {
+      int fd;
+      ~File_guard() { if (fd >= 0) ::close(fd); }
+    } file{::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    struct stat st;
+    if (file.fd < 0 || ::fstat(file.fd, &st))
+      throw os::Sys_exception{"cannot open file \""+path.generic_string()+"\" to send"};
+
+    std::uint64_t result{};
+    for (auto off = static_cast<off_t>(offset); off < st.st_size;) {
+      const auto len = std::min<std::uint64_t>(
+        static_cast<std::uint64_t>(st.st_size - off),
+        static_cast<std::uint64_t>(max_write_size()));
+      const auto n = ::sendfile(socket_, file.fd, &off, len);
+      if (n < 0 && errno == EINTR)
+        continue;
+      else if (n < 0)
+        throw DMITIGR_NET_EXCEPTION{"cannot send file to socket"};
+      else if (!n)
+        break; // the file is truncated
+      result += static_cast<std::uint64_t>(n);
+    }
+    return result;
+#else
+    return iDescriptor::send_file(path, offset);
+#endif
+  }
+
   void close() override
   {
     if (!is_shutted_down_) {
@@ -208,6 +392,9 @@ private:
 /// The implementation of Descriptor based on Windows Named Pipes.
 class pipe_Descriptor final : public iDescriptor {
 public:
+  using iDescriptor::read;
+  using iDescriptor::write;
+
   ~pipe_Descriptor() override
   {
     if (pipe_ != INVALID_HANDLE_VALUE) {
@@ -31,6 +31,7 @@
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #ifdef _WIN32
 #include "../os/windows.hpp"
@@ -186,6 +187,24 @@ public:
    */
   virtual std::unique_ptr<Descriptor> accept() = 0;
 
+  /**
+   * @brief Accepts every client connection which is pending, without
+   * waiting for more.
+   *
+   * @details Draining the queue of pending connections at once, rather than
+   * accepting them one by one between the other work, keeps the queue from
+   * overflowing when many clients connect together.
+   *
+   * @returns The number of connections appended to `result`.
+   *
+   * @par Requires
+   * `is_listening()`.
+   *
+   * @see wait(), accept().
+   */
+  virtual std::size_t accept_pending(
+    std::vector<std::unique_ptr<Descriptor>>& result) = 0;
+
   /// Stops the listening.
   virtual void close() = 0;
 
@@ -199,6 +218,17 @@ namespace detail {
 
 /// The base implementation of Listener.
 class iListener : public Listener {
+public:
+  std::size_t accept_pending(
+    std::vector<std::unique_ptr<Descriptor>>& result) override
+  {
+    const auto size = result.size();
+    while (wait(std::chrono::milliseconds{}))
+      result.push_back(accept());
+    return result.size() - size;
+  }
+
+private:
   friend socket_Listener;
   friend pipe_Listener;
 
@@ -259,7 +289,7 @@ public:
 
     const auto uds_create_bind = [&]
     {
-      socket_ = make_socket(AF_UNIX, SOCK_STREAM, IPPROTO_TCP);
+      socket_ = make_socket(AF_UNIX, SOCK_STREAM, 0);
       bind_socket(socket_, {eid.uds_path().value()});
     };
 
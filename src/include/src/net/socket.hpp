@@ -36,7 +36,12 @@
 #include <In6addr.h>  // must follows after Winsock2.h
 #else
 #include <cerrno>
+#include <ctime> // nanosleep
 
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <poll.h>
 #include <sys/time.h> // timeval
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -152,6 +157,16 @@ inline void set_timeout(const Socket_native socket,
     throw DMITIGR_NET_EXCEPTION{"cannot set timeout on a socket"};
 }
 
+/// Sets the integer socket option `name` at the `level`.
+inline void set_option(const Socket_native socket, const int level,
+  const int name, const int value)
+{
+  const auto r = setsockopt(socket, level, name,
+    reinterpret_cast<const char*>(&value), sizeof(value));
+  if (net::is_socket_error(r))
+    throw DMITIGR_NET_EXCEPTION{"cannot set option of a socket"};
+}
+
 // =============================================================================
 
 #ifdef _WIN32
@@ -283,10 +298,14 @@ inline Socket_guard make_socket(const Protocol_family family, const int type,
   return make_socket(to_native(family), type, protocol);
 }
 
-/// @returns Newly created TCP socket.
+/**
+ * @returns Newly created TCP socket, or stream socket if `family` is
+ * `Protocol_family::local`.
+ */
 inline Socket_guard make_tcp_socket(const Protocol_family family)
 {
-  return make_socket(family, SOCK_STREAM, IPPROTO_TCP);
+  const int protocol = family == Protocol_family::local ? 0 : IPPROTO_TCP;
+  return make_socket(family, SOCK_STREAM, protocol);
 }
 
 /// Binds `socket` to `addr`.
@@ -321,7 +340,8 @@ inline void shutdown_socket(const Socket_native socket, const int how)
  * @remarks
  * `(timeout < 0)` means *no timeout* and the function can block indefinitely!
  *
- * @remarks The current implementation is based only on select().
+ * @remarks The implementation is based on poll(), so the socket descriptor
+ * is not limited by `FD_SETSIZE`. (On Windows it's based on select().)
  */
 inline Socket_readiness poll(const Socket_native socket,
   const Socket_readiness mask, const std::chrono::milliseconds timeout)
@@ -329,6 +349,9 @@ inline Socket_readiness poll(const Socket_native socket,
   if (!is_socket_valid(socket))
     throw Exception{"cannot poll an invalid socket"};
 
+  using Ut = std::underlying_type_t<Socket_readiness>;
+
+#ifdef _WIN32
   using std::chrono::seconds;
   using std::chrono::milliseconds;
   using std::chrono::microseconds;
@@ -357,8 +380,6 @@ inline Socket_readiness poll(const Socket_native socket,
   fd_set except_mask;
   FD_ZERO(&except_mask);
 
-  using Ut = std::underlying_type_t<Socket_readiness>;
-
   if (static_cast<Ut>(mask & Socket_readiness::read_ready))
     FD_SET(socket, &read_mask);
 
@@ -384,10 +405,137 @@ inline Socket_readiness poll(const Socket_native socket,
     if (FD_ISSET(socket, &except_mask))
       result |= Socket_readiness::exceptions;
   }
+#else
+  pollfd fd{};
+  fd.fd = socket;
+  if (static_cast<Ut>(mask & Socket_readiness::read_ready))
+    fd.events |= POLLIN;
+
+  if (static_cast<Ut>(mask & Socket_readiness::write_ready))
+    fd.events |= POLLOUT;
+
+  if (static_cast<Ut>(mask & Socket_readiness::exceptions))
+    fd.events |= POLLPRI;
+
+  // When (timeout_ms < 0), poll(2) treats it as "no timeout".
+  const int timeout_ms = timeout < std::chrono::milliseconds::zero() ? -1 :
+    static_cast<int>(std::min<std::chrono::milliseconds::rep>(timeout.count(),
+        std::numeric_limits<int>::max()));
+  int r;
+  do {
+    r = ::poll(&fd, 1, timeout_ms);
+  } while (r < 0 && errno == EINTR);
+  if (is_socket_error(r))
+    throw DMITIGR_NET_EXCEPTION{"socket error upon polling"};
+
+  auto result = Socket_readiness::unready;
+  if (r > 0) {
+    // Like select(2), report an error as the readiness asked for, so the
+    // following I/O operation reveals it.
+    if (fd.revents & (POLLERR | POLLHUP | POLLNVAL))
+      return mask;
+
+    if (fd.revents & POLLIN)
+      result |= Socket_readiness::read_ready;
+
+    if (fd.revents & POLLOUT)
+      result |= Socket_readiness::write_ready;
+
+    if (fd.revents & POLLPRI)
+      result |= Socket_readiness::exceptions;
+  }
+#endif
 
   return result;
 }
 
+/// Switches `socket` to the blocking mode if `value`, or to the non-blocking one.
+inline void set_blocking(const Socket_native socket, const bool value)
+{
+#ifdef _WIN32
+  u_long mode = value ? 0 : 1;
+  if (::ioctlsocket(socket, FIONBIO, &mode) != 0)
+    throw DMITIGR_NET_EXCEPTION{"cannot set the blocking mode of a socket"};
+#else
+  const int flags = ::fcntl(socket, F_GETFL);
+  if (flags < 0 || ::fcntl(socket, F_SETFL,
+      value ? flags & ~O_NONBLOCK : flags | O_NONBLOCK) < 0)
+    throw DMITIGR_NET_EXCEPTION{"cannot set the blocking mode of a socket"};
+#endif
+}
+
+/**
+ * @overload
+ *
+ * @brief Connects `socket` to remote `addr` within `timeout`.
+ *
+ * @details The connection is made in the non-blocking mode and waited for by
+ * poll(), so an unreachable host costs `timeout` rather than the timeout of
+ * the system, which is minutes for TCP. The blocking mode is restored before
+ * return. A Unix domain socket whose listener is busy is retried until the
+ * `timeout` elapses.
+ *
+ * @par Requires
+ * `(timeout >= 0)`.
+ */
+inline void connect_socket(const Socket_native socket, const Socket_address& addr,
+  const std::chrono::milliseconds timeout)
+{
+  using Sr = Socket_readiness;
+  using std::chrono::milliseconds;
+  using Clock = std::chrono::steady_clock;
+
+  if (!(timeout >= milliseconds::zero()))
+    throw Exception{"invalid timeout for connect operation on socket"};
+
+  const auto deadline = Clock::now() + timeout;
+  const auto remaining = [deadline]
+  {
+    return std::max(std::chrono::ceil<milliseconds>(deadline - Clock::now()),
+      milliseconds::zero());
+  };
+  const auto timed_out = []
+  {
+    return Exception{"timed out connecting a socket to remote host"};
+  };
+
+  set_blocking(socket, false);
+  while (::connect(socket, addr.addr(), addr.size()) != 0) {
+#ifdef _WIN32
+    if (const int err = ::WSAGetLastError(); err != WSAEWOULDBLOCK)
+      throw Wsa_exception{err, "cannot connect a socket to remote host"};
+#else
+    if (errno == EAGAIN && addr.family() == Protocol_family::local) {
+      if (remaining() == milliseconds::zero())
+        throw timed_out();
+      const timespec pause{0, 10'000'000};
+      ::nanosleep(&pause, nullptr);
+      continue;
+    } else if (errno != EINPROGRESS && errno != EINTR)
+      // An interrupted connect() goes on asynchronously, and calling it
+      // again would fail with EALREADY, so it's waited for like one in
+      // progress.
+      throw DMITIGR_NET_EXCEPTION{"cannot connect a socket to remote host"};
+#endif
+    if (poll(socket, Sr::write_ready | Sr::exceptions, remaining()) == Sr::unready)
+      throw timed_out();
+
+    int err{};
+#ifdef _WIN32
+    int len = static_cast<int>(sizeof(err));
+#else
+    ::socklen_t len = static_cast<::socklen_t>(sizeof(err));
+#endif
+    if (::getsockopt(socket, SOL_SOCKET, SO_ERROR,
+        reinterpret_cast<char*>(&err), &len) != 0)
+      throw DMITIGR_NET_EXCEPTION{"cannot get the error of a socket connection"};
+    else if (err)
+      throw DMITIGR_NET_EXCEPTION{err, "cannot connect a socket to remote host"};
+    break;
+  }
+  set_blocking(socket, true);
+}
+
 } // namespace dmitigr::net
 
 #endif  // DMITIGR_NET_SOCKET_HPP
@@ -18,6 +18,7 @@
 #define DMITIGR_PGFE_ARRAY_CONVERSIONS_HPP
 
 #include "../base/assert.hpp"
+#include "../net/conversions.hpp"
 #include "../str/c_str.hpp"
 #include "../str/predicate.hpp"
 #include "basic_conversions.hpp"
@@ -26,11 +27,20 @@
 #include "exceptions.hpp"
 
 #include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <optional>
 #include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace dmitigr::pgfe {
 namespace detail {
@@ -47,6 +57,29 @@ std::string to_array_literal(const Container<std::optional<T>,
 template<class Container, typename ... Types>
 Container to_container(const char* literal, char delimiter = ',', Types&& ... args);
 
+/**
+ * @brief `true` if `T` is an element type of the arrays which are parsed by
+ * parse_flat_array_literal() and decoded by to_flat_array().
+ */
+template<typename T>
+constexpr bool is_flat_array_element_v = std::is_same_v<T, std::string> ||
+  (std::is_arithmetic_v<T> && !std::is_same_v<T, bool> &&
+    !std::is_same_v<T, char> && !std::is_same_v<T, signed char> &&
+    !std::is_same_v<T, unsigned char>);
+
+/// `true` if `T` is a `std::vector` of optional flat array elements.
+template<typename T>
+constexpr bool is_flat_array_v = false;
+
+/// The partial specialization of is_flat_array_v.
+template<typename T, class Allocator>
+constexpr bool is_flat_array_v<std::vector<std::optional<T>, Allocator>> =
+  is_flat_array_element_v<T>;
+
+/// @returns The vector decoded from the PostgreSQL array in binary format.
+template<class Vector>
+Vector to_flat_array(const char* bytes, std::size_t size);
+
 // =============================================================================
 
 /**
@@ -161,6 +194,11 @@ struct Array_data_conversions_opts<Container<std::optional<T>,
   template<typename ... Types>
   static Type to_type(const Data& data, Types&& ... args)
   {
+    if constexpr (is_flat_array_v<Type>) {
+      if (data.format() == Data_format::binary)
+        return to_flat_array<Type>(static_cast<const char*>(data.bytes()),
+          data.size());
+    }
     if (!(data.format() == Data_format::text))
       throw Client_exception{"cannot convert array to native type: "
         "unsupported input data format"};
@@ -557,6 +595,208 @@ const char* parse_array_literal(const char* literal, const char delimiter,
   return literal;
 }
 
+namespace arrays {
+
+/// @returns The pointer to the first `"` or `\\` in [p, end), or `end`.
+inline const char* find_quote_or_escape(const char* p, const char* const end) noexcept
+{
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i escape = _mm_set1_epi8('\\');
+  for (; end - p >= 16; p += 16) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(
+      _mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, escape))));
+    if (mask)
+      return p + std::countr_zero(mask);
+  }
+#endif
+  while (p != end && *p != '"' && *p != '\\')
+    ++p;
+  return p;
+}
+
+/// Appends the element of `size` bytes at `data` in `format` to `result`.
+template<typename T, class Allocator>
+void push_flat_array_element(std::vector<std::optional<T>, Allocator>& result,
+  const char* const data, const std::size_t size, const Data_format format)
+{
+  if constexpr (std::is_same_v<T, std::string>) {
+    (void)format;
+    result.emplace_back(std::in_place, data, size);
+  } else
+    result.emplace_back(Conversions<T>::to_type(Data_view{data, size, format}));
+}
+
+} // namespace arrays
+
+/**
+ * @brief Parses the one-dimensional PostgreSQL array `literal` of numbers or
+ * strings into `result`.
+ *
+ * @details This is parse_array_literal() for the most common shape of the
+ * arrays, such as of `array_agg()` results. It's a single pass over the
+ * literal, which converts the elements right from it rather than from a
+ * `std::string` per element, and grows `result` once for the count of the
+ * delimiters. Quoted elements are scanned 16 bytes at a time where SSE2 is
+ * available, and only those with escapes are copied to be unescaped.
+ *
+ * @par Requires
+ * `(literal && *literal == '{')`.
+ *
+ * @returns The pointer that points to a next character after the closing
+ * curly bracket.
+ *
+ * @throws Client_exception.
+ */
+template<typename T, class Allocator>
+const char* parse_flat_array_literal(
+  std::vector<std::optional<T>, Allocator>& result,
+  const char* literal, const char delimiter)
+{
+  DMITIGR_ASSERT(literal && *literal == '{');
+  using str::is_space;
+
+  const char* p = literal + 1;
+  const char* const end = p + std::strlen(p);
+  if (const auto* const close = static_cast<const char*>(
+      std::memchr(p, '}', static_cast<std::size_t>(end - p))))
+    result.reserve(result.size() + 1 +
+      static_cast<std::size_t>(std::count(p, close, delimiter)));
+
+  const auto malformed = []
+  {
+    return Client_exception{Client_errc::malformed_literal};
+  };
+  const auto skip_spaces = [&p, end]
+  {
+    while (p != end && is_space(*p))
+      ++p;
+  };
+
+  skip_spaces();
+  if (p != end && *p == '}')
+    return p + 1;
+
+  std::string unescaped;
+  while (true) {
+    skip_spaces();
+    if (p == end)
+      throw malformed();
+    else if (*p == '"') {
+      const char* const first = ++p;
+      p = arrays::find_quote_or_escape(p, end);
+      if (p != end && *p == '"') {
+        arrays::push_flat_array_element(result, first,
+          static_cast<std::size_t>(p - first), Data_format::text);
+      } else {
+        unescaped.assign(first, p);
+        while (p != end && *p != '"') {
+          if (*p == '\\' && ++p == end)
+            break;
+          const char* const next = arrays::find_quote_or_escape(p + 1, end);
+          unescaped.append(p, next);
+          p = next;
+        }
+        if (p == end)
+          throw malformed();
+        arrays::push_flat_array_element(result, unescaped.data(),
+          unescaped.size(), Data_format::text);
+      }
+      ++p; // consuming the closing quote
+    } else if (*p == '{') {
+      // A subarray: the literal has more dimensions than the vector.
+      throw Client_exception{Client_errc::insufficient_dimensionality};
+    } else {
+      const char* const first = p;
+      while (p != end && *p != delimiter && *p != '}' && *p != '{' && *p != '"')
+        ++p;
+      const char* last = p;
+      while (last != first && is_space(last[-1]))
+        --last;
+      const auto size = static_cast<std::size_t>(last - first);
+      if (!size || (p != end && (*p == '{' || *p == '"')))
+        throw malformed();
+
+      const bool is_null = size == 4 &&
+        (first[0] == 'n' || first[0] == 'N') &&
+        (first[1] == 'u' || first[1] == 'U') &&
+        (first[2] == 'l' || first[2] == 'L') &&
+        (first[3] == 'l' || first[3] == 'L');
+      if (is_null)
+        result.emplace_back();
+      else
+        arrays::push_flat_array_element(result, first, size, Data_format::text);
+    }
+
+    skip_spaces();
+    if (p == end)
+      throw malformed();
+    else if (*p == '}')
+      return p + 1;
+    else if (*p != delimiter)
+      throw malformed();
+    ++p; // consuming the delimiter
+  }
+}
+
+/**
+ * @returns The vector decoded from the PostgreSQL array in binary format,
+ * as sent for the results in `FORMAT binary` or with the binary result format.
+ *
+ * @details The array must be one-dimensional (or empty). Every element is
+ * converted right from the data, in binary format.
+ *
+ * @throws Client_exception.
+ */
+template<class Vector>
+Vector to_flat_array(const char* bytes, const std::size_t size)
+{
+  static_assert(is_flat_array_v<Vector>);
+
+  const char* const end = bytes + size;
+  const auto read_int = [&bytes, end]
+  {
+    if (end - bytes < 4)
+      throw Client_exception{"cannot convert array to native type: "
+        "truncated binary data"};
+    const auto result = net::conv<std::int32_t>(bytes, 4);
+    bytes += 4;
+    return result;
+  };
+
+  Vector result;
+  const auto dimension_count = read_int();
+  read_int(); // the flag of nulls
+  read_int(); // the element type
+  if (dimension_count == 0)
+    return result;
+  else if (dimension_count != 1)
+    throw Client_exception{dimension_count > 1 ?
+      Client_errc::insufficient_dimensionality :
+      Client_errc::malformed_literal};
+
+  const auto count = read_int();
+  read_int(); // the lower bound
+  if (count < 0)
+    throw Client_exception{Client_errc::malformed_literal};
+  result.reserve(static_cast<std::size_t>(count));
+  for (std::int32_t i{}; i < count; ++i) {
+    const auto length = read_int();
+    if (length < 0)
+      result.emplace_back();
+    else if (end - bytes < length)
+      throw Client_exception{"cannot convert array to native type: "
+        "truncated binary data"};
+    else {
+      arrays::push_flat_array_element(result, bytes,
+        static_cast<std::size_t>(length), Data_format::binary);
+      bytes += length;
+    }
+  }
+  return result;
+}
+
 /**
  * @brief Fills the container with elements extracted from the PostgreSQL array
  * literal.
@@ -629,9 +869,14 @@ const char* fill_container(Container<std::optional<T>,
       }
     }
   } else {
-    Filler_of_deepest_container<T, Container, Allocator> handler(result);
-    return parse_array_literal(literal, delimiter, handler,
-      std::forward<Types>(args)...);
+    using Result = Container<std::optional<T>, Allocator<std::optional<T>>>;
+    if constexpr (is_flat_array_v<Result> && !sizeof...(Types)) {
+      return parse_flat_array_literal(result, literal, delimiter);
+    } else {
+      Filler_of_deepest_container<T, Container, Allocator> handler(result);
+      return parse_array_literal(literal, delimiter, handler,
+        std::forward<Types>(args)...);
+    }
   }
 }
 
@@ -0,0 +1,373 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../net/conversions.hpp"
+#include "arrow.hpp"
+#include "decimal.hpp"
+#include "exceptions.hpp"
+
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dmitigr::pgfe {
+
+namespace detail {
+
+/// The buffers of an exported Arrow batch, and its structs.
+struct Arrow_holder final {
+  struct Column final {
+    std::string name;
+    std::string format;
+    std::vector<std::uint64_t> validity; // words keep the buffers aligned
+    std::vector<std::uint64_t> values;
+    std::vector<std::int32_t> offsets;
+    std::string data;
+    const void* buffers[3]{};
+  };
+
+  std::vector<Column> columns;
+  std::vector<ArrowSchema> schemas;
+  std::vector<ArrowArray> arrays;
+  std::vector<ArrowSchema*> schema_children;
+  std::vector<ArrowArray*> array_children;
+  const void* buffers[1]{}; // of the struct array, which has no nulls
+};
+
+/**
+ * @brief Releases `s`, an ArrowSchema or ArrowArray whose private data is
+ * a heap-allocated `std::shared_ptr<Arrow_holder>`, after its children.
+ */
+template<class S>
+void release_arrow(S* const s) noexcept
+{
+  for (std::int64_t i{}; i < s->n_children; ++i) {
+    if (auto* const child = s->children[i]; child->release)
+      child->release(child);
+  }
+  delete static_cast<std::shared_ptr<Arrow_holder>*>(s->private_data);
+  s->release = nullptr;
+}
+
+/// Fills `column` with the Arrow layout of `data` of the type `oid`.
+inline void to_arrow_column(Arrow_holder::Column& column, ArrowArray& array,
+  const std::span<const Data_view> data, const std::uint_fast32_t oid,
+  const Data_format format)
+{
+  enum : std::uint_fast32_t {
+    bool_oid = 16, bytea_oid = 17, name_oid = 19, int8_oid = 20, int2_oid = 21,
+    int4_oid = 23, text_oid = 25, oid_oid = 26, json_oid = 114, xml_oid = 142,
+    float4_oid = 700, float8_oid = 701, unknown_oid = 705, bpchar_oid = 1042,
+    varchar_oid = 1043, date_oid = 1082, time_oid = 1083, timestamp_oid = 1114,
+    timestamptz_oid = 1184, numeric_oid = 1700, uuid_oid = 2950,
+    jsonb_oid = 3802
+  };
+  // From 2000-01-01, the origin of PostgreSQL, to 1970-01-01.
+  constexpr std::int32_t epoch_days{10957};
+  constexpr std::int64_t epoch_micros{epoch_days * std::int64_t{86400000000}};
+
+  const std::size_t size{data.size()};
+  column.validity.assign((size + 63) / 64, 0);
+  std::int64_t null_count{};
+  for (std::size_t i{}; i < size; ++i) {
+    if (data[i])
+      column.validity[i / 64] |= std::uint64_t{1} << (i % 64);
+    else
+      ++null_count;
+  }
+
+  const auto bytes = [](const Data_view& d)
+  {
+    return std::string_view{static_cast<const char*>(d.bytes()), d.size()};
+  };
+
+  // Decodes the fields of `width` bytes into values of `width` bytes.
+  const auto fixed = [&](const char* const arrow_format, const std::size_t width,
+    const auto& decode)
+  {
+    column.format = arrow_format;
+    column.values.assign((size * width + 7) / 8, 0);
+    auto* const values = reinterpret_cast<char*>(column.values.data());
+    for (std::size_t i{}; i < size; ++i) {
+      if (!data[i])
+        continue;
+      else if (data[i].size() != width)
+        throw Client_exception{"cannot convert to Arrow: invalid binary "
+          "input size"};
+      decode(values + i * width, data[i].bytes());
+    }
+    array.n_buffers = 2;
+  };
+  const auto integer = [&](const char* const arrow_format, auto sample,
+    const auto&... adjust)
+  {
+    using T = decltype(sample);
+    fixed(arrow_format, sizeof(T), [&](char* const dest, const void* const src)
+    {
+      auto value = net::conv<T>(src, sizeof(T));
+      ((value = adjust(value)), ...);
+      std::memcpy(dest, &value, sizeof(T));
+    });
+  };
+  // Appends the values of the variable-length fields, transformed by `get`.
+  const auto variable = [&](const char* const arrow_format, const auto& get)
+  {
+    column.format = arrow_format;
+    column.offsets.assign(size + 1, 0);
+    for (std::size_t i{}; i < size; ++i) {
+      if (data[i])
+        get(column.data, data[i]);
+      if (column.data.size() >
+        static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max()))
+        throw Client_exception{"cannot convert to Arrow: column of batch "
+          "exceeds 2 GiB"};
+      column.offsets[i + 1] = static_cast<std::int32_t>(column.data.size());
+    }
+    array.n_buffers = 3;
+  };
+  const auto as_is = [&](std::string& result, const Data_view& d)
+  {
+    result.append(bytes(d));
+  };
+  const auto shifted = [](const auto epoch)
+  {
+    return [epoch](const auto value)
+    {
+      using T = decltype(value);
+      constexpr auto max = std::numeric_limits<T>::max();
+      constexpr auto min = std::numeric_limits<T>::min();
+      return value == max || value == min ? value :
+        static_cast<T>(value + epoch);
+    };
+  };
+
+  if (format == Data_format::text) {
+    variable("u", as_is);
+  } else switch (oid) {
+  case bool_oid:
+    column.format = "b";
+    column.values.assign((size + 63) / 64, 0);
+    for (std::size_t i{}; i < size; ++i) {
+      if (data[i] && data[i].size() == 1 &&
+        *static_cast<const char*>(data[i].bytes()))
+        column.values[i / 64] |= std::uint64_t{1} << (i % 64);
+    }
+    array.n_buffers = 2;
+    break;
+  case int2_oid:
+    integer("s", std::int16_t{});
+    break;
+  case int4_oid:
+    integer("i", std::int32_t{});
+    break;
+  case int8_oid:
+    integer("l", std::int64_t{});
+    break;
+  case oid_oid:
+    integer("I", std::uint32_t{});
+    break;
+  case float4_oid:
+    integer("f", float{});
+    break;
+  case float8_oid:
+    integer("g", double{});
+    break;
+  case date_oid:
+    integer("tdD", std::int32_t{}, shifted(epoch_days));
+    break;
+  case time_oid:
+    integer("ttu", std::int64_t{});
+    break;
+  case timestamp_oid:
+    integer("tsu:", std::int64_t{}, shifted(epoch_micros));
+    break;
+  case timestamptz_oid:
+    integer("tsu:UTC", std::int64_t{}, shifted(epoch_micros));
+    break;
+  case uuid_oid:
+    fixed("w:16", 16, [](char* const dest, const void* const src)
+    {
+      std::memcpy(dest, src, 16);
+    });
+    break;
+  case text_oid: [[fallthrough]];
+  case varchar_oid: [[fallthrough]];
+  case bpchar_oid: [[fallthrough]];
+  case name_oid: [[fallthrough]];
+  case json_oid: [[fallthrough]];
+  case xml_oid: [[fallthrough]];
+  case unknown_oid:
+    variable("u", as_is);
+    break;
+  case jsonb_oid:
+    variable("u", [&](std::string& result, const Data_view& d)
+    {
+      // Less the version byte of the binary format.
+      const auto b = bytes(d);
+      if (b.empty() || b.front() != 1)
+        throw Client_exception{"cannot convert to Arrow: unknown binary "
+          "format version of jsonb"};
+      result.append(b.substr(1));
+    });
+    break;
+#ifdef __SIZEOF_INT128__
+  case numeric_oid:
+    variable("u", [&](std::string& result, const Data_view& d)
+    {
+      const auto b = bytes(d);
+      result.append(Decimal::from_numeric_binary(b.data(), b.size()).to_string());
+    });
+    break;
+#endif
+  default:
+    variable("z", as_is);
+  }
+
+  column.buffers[0] = null_count ? column.validity.data() : nullptr;
+  if (array.n_buffers == 2)
+    column.buffers[1] = column.values.data();
+  else {
+    column.buffers[1] = column.offsets.data();
+    column.buffers[2] = column.data.data();
+  }
+  array.length = static_cast<std::int64_t>(size);
+  array.null_count = null_count;
+  array.buffers = column.buffers;
+}
+
+} // namespace detail
+
+DMITIGR_PGFE_INLINE Arrow_batch::Arrow_batch(const Row_batch& batch)
+{
+  if (!batch)
+    throw Client_exception{"cannot convert invalid row batch to Arrow"};
+
+  using detail::Arrow_holder;
+  const auto holder = std::make_shared<Arrow_holder>();
+  const std::size_t count{batch.field_count()};
+  holder->columns.resize(count);
+  holder->schemas.resize(count);
+  holder->arrays.resize(count);
+  for (std::size_t i{}; i < count; ++i) {
+    auto& column = holder->columns[i];
+    auto& schema = holder->schemas[i];
+    auto& array = holder->arrays[i];
+    column.name = batch.field_name(i);
+    detail::to_arrow_column(column, array, batch.column(i), batch.type_oid(i),
+      batch.field_format(i));
+    schema.format = column.format.c_str();
+    schema.name = column.name.c_str();
+    schema.flags = ARROW_FLAG_NULLABLE;
+    holder->schema_children.push_back(&schema);
+    holder->array_children.push_back(&array);
+  }
+
+  // Every struct keeps the holder alive until it's released.
+  using Ptr = std::shared_ptr<Arrow_holder>;
+  for (std::size_t i{}; i < count; ++i) {
+    holder->schemas[i].release = detail::release_arrow<ArrowSchema>;
+    holder->schemas[i].private_data = new Ptr{holder};
+    holder->arrays[i].release = detail::release_arrow<ArrowArray>;
+    holder->arrays[i].private_data = new Ptr{holder};
+  }
+  schema_.format = "+s";
+  schema_.name = "";
+  schema_.n_children = static_cast<std::int64_t>(count);
+  schema_.children = holder->schema_children.data();
+  schema_.release = detail::release_arrow<ArrowSchema>;
+  schema_.private_data = new Ptr{holder};
+  array_.length = static_cast<std::int64_t>(batch.size());
+  array_.n_buffers = 1;
+  array_.n_children = static_cast<std::int64_t>(count);
+  array_.buffers = holder->buffers;
+  array_.children = holder->array_children.data();
+  array_.release = detail::release_arrow<ArrowArray>;
+  array_.private_data = new Ptr{holder};
+}
+
+DMITIGR_PGFE_INLINE Arrow_batch::~Arrow_batch()
+{
+  release__();
+}
+
+DMITIGR_PGFE_INLINE Arrow_batch::Arrow_batch(Arrow_batch&& rhs) noexcept
+  : schema_{rhs.schema_}
+  , array_{rhs.array_}
+{
+  rhs.schema_.release = nullptr;
+  rhs.array_.release = nullptr;
+}
+
+DMITIGR_PGFE_INLINE Arrow_batch& Arrow_batch::operator=(Arrow_batch&& rhs) noexcept
+{
+  if (this != &rhs) {
+    release__();
+    schema_ = rhs.schema_;
+    array_ = rhs.array_;
+    rhs.schema_.release = nullptr;
+    rhs.array_.release = nullptr;
+  }
+  return *this;
+}
+
+DMITIGR_PGFE_INLINE bool Arrow_batch::is_valid() const noexcept
+{
+  return array_.release;
+}
+
+DMITIGR_PGFE_INLINE std::size_t Arrow_batch::size() const noexcept
+{
+  return is_valid() ? static_cast<std::size_t>(array_.length) : 0;
+}
+
+DMITIGR_PGFE_INLINE const ArrowSchema& Arrow_batch::schema() const noexcept
+{
+  return schema_;
+}
+
+DMITIGR_PGFE_INLINE const ArrowArray& Arrow_batch::array() const noexcept
+{
+  return array_;
+}
+
+DMITIGR_PGFE_INLINE void
+Arrow_batch::export_to(ArrowArray* const array, ArrowSchema* const schema)
+{
+  if (!is_valid())
+    throw Client_exception{"cannot export invalid Arrow batch"};
+  else if (!array)
+    throw Client_exception{"cannot export Arrow batch: null array given"};
+
+  *array = array_;
+  array_.release = nullptr;
+  if (schema) {
+    *schema = schema_;
+    schema_.release = nullptr;
+  }
+  release__();
+}
+
+DMITIGR_PGFE_INLINE void Arrow_batch::release__() noexcept
+{
+  if (array_.release)
+    array_.release(&array_);
+  if (schema_.release)
+    schema_.release(&schema_);
+}
+
+} // namespace dmitigr::pgfe
@@ -0,0 +1,201 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_ARROW_HPP
+#define DMITIGR_PGFE_ARROW_HPP
+
+#include "connection.hpp"
+#include "dll.hpp"
+#include "row_batch.hpp"
+#include "types_fwd.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+/*
+ * The ABI of the Arrow C data interface, as given by its specification at
+ * https://arrow.apache.org/docs/format/CDataInterface.html
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct ArrowSchema {
+  // Array type description
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray*);
+  // Opaque producer-specific data
+  void* private_data;
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup utilities
+ *
+ * @brief A batch of rows in the layout of Apache Arrow, exported through the
+ * Arrow C data interface as a struct array of a child array per field.
+ *
+ * @details The fields of the binary format are decoded column by column into
+ * the Arrow buffers as follows:
+ *   - `boolean` to `b`, `int2`, `int4` and `int8` to `s`, `i` and `l`, `oid`
+ *   to `I`, `float4` and `float8` to `f` and `g`;
+ *   - `date` to `tdD`, `time` to `ttu`, `timestamp` and `timestamptz` to
+ *   `tsu:` and `tsu:UTC` (the infinities to the extreme values);
+ *   - `uuid` to `w:16`;
+ *   - `text`, `varchar`, `bpchar`, `name`, `json`, `jsonb`, `xml` and
+ *   `numeric` to `u`;
+ *   - `bytea` and the rest to `z`, as they are.
+ * The fields of the text format are exported as `u`.
+ *
+ * The buffers are shared by the structs of the batch and freed once the last
+ * of them is released, so the consumer can take the children apart.
+ *
+ * @see Connection::execute_to_arrow().
+ */
+class Arrow_batch final {
+public:
+  /// Default-constructible. (Constructs invalid instance.)
+  Arrow_batch() = default;
+
+  /// Decodes `batch`.
+  DMITIGR_PGFE_API explicit Arrow_batch(const Row_batch& batch);
+
+  /// The destructor. Releases the structs not exported.
+  DMITIGR_PGFE_API ~Arrow_batch();
+
+  /// Not copy-constructible.
+  Arrow_batch(const Arrow_batch&) = delete;
+
+  /// Not copy-assignable.
+  Arrow_batch& operator=(const Arrow_batch&) = delete;
+
+  /// Move-constructible.
+  DMITIGR_PGFE_API Arrow_batch(Arrow_batch&& rhs) noexcept;
+
+  /// Move-assignable.
+  DMITIGR_PGFE_API Arrow_batch& operator=(Arrow_batch&& rhs) noexcept;
+
+  /// @returns `true` if the instance is valid.
+  DMITIGR_PGFE_API bool is_valid() const noexcept;
+
+  /// @returns `true` if the instance is valid.
+  explicit operator bool() const noexcept
+  {
+    return is_valid();
+  }
+
+  /// @returns The number of rows.
+  DMITIGR_PGFE_API std::size_t size() const noexcept;
+
+  /// @returns The schema, released with the instance unless exported.
+  DMITIGR_PGFE_API const ArrowSchema& schema() const noexcept;
+
+  /// @returns The array, released with the instance unless exported.
+  DMITIGR_PGFE_API const ArrowArray& array() const noexcept;
+
+  /**
+   * @brief Moves the array to `array` and the schema to `schema`, leaving the
+   * consumer to release them. The schema is released instead if `!schema`.
+   *
+   * @par Requires
+   * `is_valid() && array`.
+   *
+   * @par Effects
+   * `!is_valid()`.
+   */
+  DMITIGR_PGFE_API void export_to(ArrowArray* array, ArrowSchema* schema);
+
+private:
+  ArrowSchema schema_{};
+  ArrowArray array_{};
+
+  void release__() noexcept;
+};
+
+// -----------------------------------------------------------------------------
+// Connection::execute_to_arrow()
+// -----------------------------------------------------------------------------
+
+template<typename F, typename ... Types>
+Completion Connection::execute_to_arrow(F&& callback, const std::size_t batch_rows,
+  const Statement& statement, Types&& ... parameters)
+{
+  static_assert(std::is_invocable_v<F, Arrow_batch&&>,
+    "callback must be callable as callback(Arrow_batch&&)");
+
+  const auto format = result_format();
+  set_result_format(Data_format::binary);
+  try {
+    auto result = execute_batched([&callback](const Row_batch& batch)
+    {
+      callback(Arrow_batch{batch});
+    }, batch_rows, statement, std::forward<Types>(parameters)...);
+    set_result_format(format);
+    return result;
+  } catch (...) {
+    set_result_format(format);
+    throw;
+  }
+}
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "arrow.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_ARROW_HPP
@@ -0,0 +1,354 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../base/assert.hpp"
+#include "async.hpp"
+#include "exceptions.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#ifdef _WIN32
+#include <Winsock2.h>
+#else
+#include <cerrno>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#if defined(DMITIGR_PGFE_EPOLL)
+#include <sys/epoll.h>
+#elif defined(DMITIGR_PGFE_KQUEUE)
+#include <sys/types.h>
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+namespace dmitigr::pgfe {
+
+DMITIGR_PGFE_INLINE Poll_reactor::Poll_reactor()
+{
+#ifndef _WIN32
+  if (::pipe(wakeup_))
+    throw Client_exception{"cannot create pipe of reactor"};
+  for (const int fd : wakeup_)
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+DMITIGR_PGFE_INLINE Poll_reactor::~Poll_reactor()
+{
+#ifndef _WIN32
+  ::close(wakeup_[0]);
+  ::close(wakeup_[1]);
+#endif
+}
+
+DMITIGR_PGFE_INLINE void Poll_reactor::resume_on(const int socket,
+  const Socket_readiness mask, const std::coroutine_handle<> handle)
+{
+  waiters_.push_back(Waiter{socket, mask, handle});
+}
+
+DMITIGR_PGFE_INLINE void Poll_reactor::post(const std::coroutine_handle<> handle)
+{
+  {
+    const std::lock_guard lg{posted_mutex_};
+    posted_.push_back(handle);
+  }
+#ifndef _WIN32
+  const char byte{};
+  (void)::write(wakeup_[1], &byte, 1); // the pipe being full means a wakeup anyway
+#endif
+}
+
+DMITIGR_PGFE_INLINE void Poll_reactor::spawn(Task<void> task)
+{
+  if (!(task && !task.is_done()))
+    throw Client_exception{"cannot spawn invalid or finished task"};
+  tasks_.push_back(std::move(task));
+  post(tasks_.back().handle_);
+}
+
+DMITIGR_PGFE_INLINE void Poll_reactor::run()
+{
+  const auto is_done = [this]
+  {
+    return std::all_of(tasks_.begin(), tasks_.end(),
+      [](const auto& task){ return task.is_done(); });
+  };
+
+  while (true) {
+    std::vector<std::coroutine_handle<>> posted;
+    {
+      const std::lock_guard lg{posted_mutex_};
+      posted.swap(posted_);
+    }
+    for (const auto handle : posted)
+      handle.resume();
+
+    if (is_done())
+      break;
+
+    bool has_posted{};
+    {
+      const std::lock_guard lg{posted_mutex_};
+      has_posted = !posted_.empty();
+    }
+    poll(!has_posted);
+  }
+
+  const auto tasks = std::move(tasks_);
+  tasks_.clear();
+  waiters_.clear();
+  for (const auto& task : tasks)
+    task.handle_.promise().rethrow_if_failed();
+}
+
+DMITIGR_PGFE_INLINE void Poll_reactor::drain_wakeup() noexcept
+{
+#ifndef _WIN32
+  char buffer[64];
+  while (::read(wakeup_[0], buffer, sizeof(buffer)) > 0);
+#endif
+}
+
+DMITIGR_PGFE_INLINE void Poll_reactor::poll(const bool wait)
+{
+#ifdef _WIN32
+  using Pollfd = WSAPOLLFD;
+  const int timeout = wait ? 10 : 0;
+#else
+  using Pollfd = pollfd;
+  const int timeout = wait ? -1 : 0;
+#endif
+  using Ut = std::underlying_type_t<Socket_readiness>;
+  const auto has = [](const Socket_readiness mask, const Socket_readiness bit)
+  {
+    return static_cast<Ut>(mask) & static_cast<Ut>(bit);
+  };
+
+  std::vector<Pollfd> fds;
+  fds.reserve(waiters_.size() + 1);
+  for (const auto& w : waiters_) {
+    Pollfd fd{};
+    fd.fd = static_cast<decltype(fd.fd)>(w.socket);
+    if (has(w.mask, Socket_readiness::read_ready))
+      fd.events |= POLLIN;
+    if (has(w.mask, Socket_readiness::write_ready))
+      fd.events |= POLLOUT;
+    fds.push_back(fd);
+  }
+#ifndef _WIN32
+  fds.push_back(Pollfd{wakeup_[0], POLLIN, 0});
+#endif
+
+#ifdef _WIN32
+  const int r = fds.empty() ? (::Sleep(timeout), 0) :
+    ::WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeout);
+#else
+  const int r = ::poll(fds.data(), static_cast<nfds_t>(fds.size()), timeout);
+  if (r < 0 && errno == EINTR)
+    return;
+#endif
+  if (r < 0)
+    throw Client_exception{"cannot poll sockets of reactor"};
+  else if (!r)
+    return;
+
+#ifndef _WIN32
+  if (fds.back().revents)
+    drain_wakeup();
+#endif
+
+  // The waiters added by the resumed coroutines are kept for the next poll.
+  std::vector<std::coroutine_handle<>> ready;
+  std::vector<Waiter> unready;
+  for (std::size_t i{}; i < waiters_.size(); ++i) {
+    if (fds[i].revents)
+      ready.push_back(waiters_[i].handle);
+    else
+      unready.push_back(waiters_[i]);
+  }
+  waiters_.swap(unready);
+  for (const auto handle : ready)
+    handle.resume();
+}
+
+// -----------------------------------------------------------------------------
+// Event_reactor
+// -----------------------------------------------------------------------------
+
+#if defined(DMITIGR_PGFE_EPOLL)
+
+DMITIGR_PGFE_INLINE Event_reactor::Event_reactor()
+  : queue_{::epoll_create1(EPOLL_CLOEXEC)}
+{
+  if (queue_ < 0)
+    throw Client_exception{"cannot create epoll instance of reactor"};
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = wakeup_socket();
+  if (::epoll_ctl(queue_, EPOLL_CTL_ADD, wakeup_socket(), &event)) {
+    ::close(queue_);
+    throw Client_exception{"cannot register pipe of reactor"};
+  }
+}
+
+DMITIGR_PGFE_INLINE Event_reactor::~Event_reactor()
+{
+  ::close(queue_);
+}
+
+DMITIGR_PGFE_INLINE void Event_reactor::resume_on(const int socket,
+  const Socket_readiness mask, const std::coroutine_handle<> handle)
+{
+  if (!awaiting_.emplace(socket, Awaiting{mask, handle}).second)
+    throw Client_exception{"cannot await socket awaited already"};
+
+  // One-shot, so a socket stays registered but disabled until awaited again.
+  using Ut = std::underlying_type_t<Socket_readiness>;
+  epoll_event event{};
+  event.events = EPOLLONESHOT;
+  if (static_cast<Ut>(mask & Socket_readiness::read_ready))
+    event.events |= EPOLLIN;
+  if (static_cast<Ut>(mask & Socket_readiness::write_ready))
+    event.events |= EPOLLOUT;
+  event.data.fd = socket;
+  if (::epoll_ctl(queue_, EPOLL_CTL_MOD, socket, &event) &&
+    (errno != ENOENT || ::epoll_ctl(queue_, EPOLL_CTL_ADD, socket, &event))) {
+    awaiting_.erase(socket);
+    throw Client_exception{"cannot register socket in reactor"};
+  }
+}
+
+DMITIGR_PGFE_INLINE void Event_reactor::poll(const bool wait)
+{
+  epoll_event events[64];
+  const int r = ::epoll_wait(queue_, events, std::size(events), wait ? -1 : 0);
+  if (r < 0) {
+    if (errno == EINTR)
+      return;
+    throw Client_exception{"cannot poll sockets of reactor"};
+  }
+
+  std::vector<std::coroutine_handle<>> ready;
+  ready.reserve(r);
+  for (int i{}; i < r; ++i) {
+    const int socket = events[i].data.fd;
+    if (socket == wakeup_socket())
+      drain_wakeup();
+    else if (const auto a = awaiting_.find(socket); a != awaiting_.end()) {
+      ready.push_back(a->second.handle);
+      awaiting_.erase(a);
+    }
+  }
+  for (const auto handle : ready)
+    handle.resume();
+}
+
+#elif defined(DMITIGR_PGFE_KQUEUE)
+
+DMITIGR_PGFE_INLINE Event_reactor::Event_reactor()
+  : queue_{::kqueue()}
+{
+  if (queue_ < 0)
+    throw Client_exception{"cannot create kqueue of reactor"};
+  ::fcntl(queue_, F_SETFD, FD_CLOEXEC);
+  struct kevent change;
+  EV_SET(&change, wakeup_socket(), EVFILT_READ, EV_ADD, 0, 0, nullptr);
+  if (::kevent(queue_, &change, 1, nullptr, 0, nullptr) < 0) {
+    ::close(queue_);
+    throw Client_exception{"cannot register pipe of reactor"};
+  }
+}
+
+DMITIGR_PGFE_INLINE Event_reactor::~Event_reactor()
+{
+  ::close(queue_);
+}
+
+DMITIGR_PGFE_INLINE void Event_reactor::resume_on(const int socket,
+  const Socket_readiness mask, const std::coroutine_handle<> handle)
+{
+  if (!awaiting_.emplace(socket, Awaiting{mask, handle}).second)
+    throw Client_exception{"cannot await socket awaited already"};
+
+  using Ut = std::underlying_type_t<Socket_readiness>;
+  struct kevent changes[2];
+  int count{};
+  if (static_cast<Ut>(mask & Socket_readiness::read_ready))
+    EV_SET(&changes[count++], socket, EVFILT_READ, EV_ADD | EV_ONESHOT,
+      0, 0, nullptr);
+  if (static_cast<Ut>(mask & Socket_readiness::write_ready))
+    EV_SET(&changes[count++], socket, EVFILT_WRITE, EV_ADD | EV_ONESHOT,
+      0, 0, nullptr);
+  if (::kevent(queue_, changes, count, nullptr, 0, nullptr) < 0) {
+    awaiting_.erase(socket);
+    throw Client_exception{"cannot register socket in reactor"};
+  }
+}
+
+DMITIGR_PGFE_INLINE void Event_reactor::poll(const bool wait)
+{
+  struct kevent events[64];
+  const timespec zero{};
+  const int r = ::kevent(queue_, nullptr, 0, events, std::size(events),
+    wait ? nullptr : &zero);
+  if (r < 0) {
+    if (errno == EINTR)
+      return;
+    throw Client_exception{"cannot poll sockets of reactor"};
+  }
+
+  std::vector<std::coroutine_handle<>> ready;
+  ready.reserve(r);
+  for (int i{}; i < r; ++i) {
+    const int socket = static_cast<int>(events[i].ident);
+    if (socket == wakeup_socket()) {
+      drain_wakeup();
+      continue;
+    }
+    const auto a = awaiting_.find(socket);
+    if (a == awaiting_.end())
+      continue;
+
+    // The other filter must not fire when the socket is awaited next time.
+    if (a->second.mask == (Socket_readiness::read_ready |
+        Socket_readiness::write_ready)) {
+      struct kevent change;
+      EV_SET(&change, socket, events[i].filter == EVFILT_READ ?
+        EVFILT_WRITE : EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+      (void)::kevent(queue_, &change, 1, nullptr, 0, nullptr);
+    }
+    ready.push_back(a->second.handle);
+    awaiting_.erase(a);
+  }
+  for (const auto handle : ready)
+    handle.resume();
+}
+
+#else
+
+DMITIGR_PGFE_INLINE Event_reactor::Event_reactor() = default;
+
+DMITIGR_PGFE_INLINE Event_reactor::~Event_reactor() = default;
+
+#endif
+
+} // namespace dmitigr::pgfe
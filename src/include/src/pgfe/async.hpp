@@ -0,0 +1,454 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_ASYNC_HPP
+#define DMITIGR_PGFE_ASYNC_HPP
+
+#include "basics.hpp"
+#include "dll.hpp"
+#include "types_fwd.hpp"
+
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#define DMITIGR_PGFE_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+  defined(__OpenBSD__) || defined(__DragonFly__)
+#define DMITIGR_PGFE_KQUEUE
+#endif
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup main
+ *
+ * @brief A lazily started coroutine which produces a value of type `T`.
+ *
+ * @details A task starts running when it's awaited, and resumes the awaiting
+ * coroutine when it finishes. A top-level task is run by a reactor, such as
+ * Poll_reactor::run().
+ */
+template<typename T>
+class [[nodiscard]] Task;
+
+namespace detail {
+
+/// The awaiter which resumes the coroutine awaiting the finished task.
+struct Task_final_awaiter final {
+  bool await_ready() const noexcept
+  {
+    return false;
+  }
+
+  template<class Promise>
+  std::coroutine_handle<>
+  await_suspend(const std::coroutine_handle<Promise> handle) const noexcept
+  {
+    return handle.promise().continuation_;
+  }
+
+  void await_resume() const noexcept
+  {}
+};
+
+/// The common part of the promise types of Task.
+struct Task_promise_base {
+  std::coroutine_handle<> continuation_{std::noop_coroutine()};
+  std::exception_ptr exception_;
+
+  std::suspend_always initial_suspend() const noexcept
+  {
+    return {};
+  }
+
+  Task_final_awaiter final_suspend() const noexcept
+  {
+    return {};
+  }
+
+  void unhandled_exception() noexcept
+  {
+    exception_ = std::current_exception();
+  }
+
+  void rethrow_if_failed() const
+  {
+    if (exception_)
+      std::rethrow_exception(exception_);
+  }
+};
+
+/// The promise type of Task<T>.
+template<typename T>
+struct Task_promise final : Task_promise_base {
+  std::optional<T> value_;
+
+  Task<T> get_return_object() noexcept;
+
+  template<typename U>
+  void return_value(U&& value)
+  {
+    value_.emplace(std::forward<U>(value));
+  }
+
+  T result()
+  {
+    rethrow_if_failed();
+    return std::move(*value_);
+  }
+};
+
+/// The promise type of Task<void>.
+template<>
+struct Task_promise<void> final : Task_promise_base {
+  Task<void> get_return_object() noexcept;
+
+  void return_void() const noexcept
+  {}
+
+  void result() const
+  {
+    rethrow_if_failed();
+  }
+};
+
+} // namespace detail
+
+template<typename T>
+class [[nodiscard]] Task final {
+public:
+  /// The promise type.
+  using promise_type = detail::Task_promise<T>;
+
+  /// Default-constructible. (Constructs invalid instance.)
+  Task() = default;
+
+  /// The destructor.
+  ~Task()
+  {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  /// Not copy-constructible.
+  Task(const Task&) = delete;
+
+  /// Not copy-assignable.
+  Task& operator=(const Task&) = delete;
+
+  /// Move-constructible.
+  Task(Task&& rhs) noexcept
+    : handle_{std::exchange(rhs.handle_, {})}
+  {}
+
+  /// Move-assignable.
+  Task& operator=(Task&& rhs) noexcept
+  {
+    if (this != &rhs) {
+      Task tmp{std::move(rhs)};
+      std::swap(handle_, tmp.handle_);
+    }
+    return *this;
+  }
+
+  /// @returns `true` if the instance is valid.
+  bool is_valid() const noexcept
+  {
+    return static_cast<bool>(handle_);
+  }
+
+  /// @returns `true` if the instance is valid.
+  explicit operator bool() const noexcept
+  {
+    return is_valid();
+  }
+
+  /// @returns `true` if the task has finished.
+  bool is_done() const noexcept
+  {
+    return !handle_ || handle_.done();
+  }
+
+  /**
+   * @returns The result of the task, or rethrows its exception.
+   *
+   * @par Requires
+   * `is_valid() && is_done()`.
+   */
+  T result()
+  {
+    return handle_.promise().result();
+  }
+
+  /// Runs the task, and resumes the awaiting coroutine once it's finished.
+  auto operator co_await() noexcept
+  {
+    struct Awaiter final {
+      std::coroutine_handle<promise_type> handle;
+
+      bool await_ready() const noexcept
+      {
+        return !handle || handle.done();
+      }
+
+      std::coroutine_handle<>
+      await_suspend(const std::coroutine_handle<> awaiting) const noexcept
+      {
+        handle.promise().continuation_ = awaiting;
+        return handle;
+      }
+
+      T await_resume() const
+      {
+        return handle.promise().result();
+      }
+    };
+    return Awaiter{handle_};
+  }
+
+private:
+  friend promise_type;
+  friend Poll_reactor;
+
+  std::coroutine_handle<promise_type> handle_;
+
+  explicit Task(const std::coroutine_handle<promise_type> handle) noexcept
+    : handle_{handle}
+  {}
+};
+
+template<typename T>
+inline Task<T> detail::Task_promise<T>::get_return_object() noexcept
+{
+  return Task<T>{std::coroutine_handle<Task_promise>::from_promise(*this)};
+}
+
+inline Task<void> detail::Task_promise<void>::get_return_object() noexcept
+{
+  return Task<void>{std::coroutine_handle<Task_promise>::from_promise(*this)};
+}
+
+/**
+ * @ingroup main
+ *
+ * @brief An interface of the resumption of the coroutines waiting for
+ * sockets.
+ *
+ * @details The asynchronous API (such as Connection::async_execute()) suspends
+ * the calling coroutine until a socket is ready and lets the reactor resume
+ * it, so a single thread can drive many connections at once. Poll_reactor is
+ * the implementation built on `poll()`; an application with an event loop of
+ * its own can implement this interface on top of it instead.
+ */
+class Reactor {
+public:
+  /// The destructor.
+  virtual ~Reactor() = default;
+
+  /**
+   * @brief Arranges `handle` to be resumed by a thread running the reactor as
+   * soon as `socket` is ready as `mask` says, or has an error.
+   */
+  virtual void resume_on(int socket, Socket_readiness mask,
+    std::coroutine_handle<> handle) = 0;
+
+  /**
+   * @brief Arranges `handle` to be resumed by a thread running the reactor.
+   *
+   * @remarks Thread-safe.
+   */
+  virtual void post(std::coroutine_handle<> handle) = 0;
+
+  /// @returns The awaitable of the readiness `mask` of `socket`.
+  auto readiness(const int socket, const Socket_readiness mask) noexcept
+  {
+    struct Awaiter final {
+      Reactor& reactor;
+      int socket;
+      Socket_readiness mask;
+
+      bool await_ready() const noexcept
+      {
+        return false;
+      }
+
+      void await_suspend(const std::coroutine_handle<> handle) const
+      {
+        reactor.resume_on(socket, mask, handle);
+      }
+
+      void await_resume() const noexcept
+      {}
+    };
+    return Awaiter{*this, socket, mask};
+  }
+};
+
+/**
+ * @ingroup main
+ *
+ * @brief A single-threaded Reactor built on `poll()` (`WSAPoll()` on
+ * Windows).
+ *
+ * @details The coroutines are resumed by the thread calling run() only.
+ * Coroutines resumed via post() from other threads wake the thread up
+ * through a pipe. (On Windows it polls at most 10 milliseconds at a time
+ * instead.)
+ */
+class Poll_reactor : public Reactor {
+public:
+  /// The constructor.
+  DMITIGR_PGFE_API Poll_reactor();
+
+  /// The destructor. Destroys the unfinished tasks.
+  DMITIGR_PGFE_API ~Poll_reactor() override;
+
+  /// Not copy-constructible.
+  Poll_reactor(const Poll_reactor&) = delete;
+
+  /// Not copy-assignable.
+  Poll_reactor& operator=(const Poll_reactor&) = delete;
+
+  /// @see Reactor::resume_on().
+  DMITIGR_PGFE_API void resume_on(int socket, Socket_readiness mask,
+    std::coroutine_handle<> handle) override;
+
+  /// @see Reactor::post().
+  DMITIGR_PGFE_API void post(std::coroutine_handle<> handle) override;
+
+  /**
+   * @brief Adds `task` to the tasks to be run by run().
+   *
+   * @par Requires
+   * `task.is_valid() && !task.is_done()`.
+   */
+  DMITIGR_PGFE_API void spawn(Task<void> task);
+
+  /**
+   * @brief Runs the spawned tasks until all of them are done.
+   *
+   * @details The exception of the first failed task (in the order of spawn())
+   * is rethrown when all are done.
+   */
+  DMITIGR_PGFE_API void run();
+
+  /// Spawns `task`, runs and @returns its result like run() does.
+  template<typename T>
+  T run(Task<T> task)
+  {
+    std::optional<T> result;
+    spawn([](Task<T> task, std::optional<T>& result) -> Task<void>
+    {
+      result.emplace(co_await task);
+    }(std::move(task), result));
+    run();
+    return std::move(*result);
+  }
+
+protected:
+  /**
+   * @brief Waits for the sockets awaited (indefinitely if `wait`), and
+   * resumes the coroutines of the ready ones.
+   *
+   * @details Returns early when post() is called meanwhile.
+   */
+  DMITIGR_PGFE_API virtual void poll(bool wait);
+
+  /// @returns The socket which is readable after post(), or `-1` on Windows.
+  int wakeup_socket() const noexcept
+  {
+    return wakeup_[0];
+  }
+
+  /// Makes the wakeup_socket() unready.
+  DMITIGR_PGFE_API void drain_wakeup() noexcept;
+
+private:
+  struct Waiter final {
+    int socket{};
+    Socket_readiness mask{};
+    std::coroutine_handle<> handle;
+  };
+
+  std::vector<Task<void>> tasks_;
+  std::vector<Waiter> waiters_;
+  std::mutex posted_mutex_;
+  std::vector<std::coroutine_handle<>> posted_;
+  int wakeup_[2]{-1, -1}; // the pipe read by run() and written by post()
+};
+
+/// @overload
+template<>
+inline void Poll_reactor::run(Task<void> task)
+{
+  spawn(std::move(task));
+  run();
+}
+
+/**
+ * @ingroup main
+ *
+ * @brief A Poll_reactor which waits for the sockets using `epoll()` on Linux
+ * and `kqueue()` on BSD and macOS.
+ *
+ * @details Unlike `poll()`, the cost of a wait doesn't grow with the number
+ * of the sockets awaited, which matters when hundreds of connections are
+ * driven by a single thread. On the other systems it's just a Poll_reactor.
+ */
+class Event_reactor final : public Poll_reactor {
+public:
+  /// The constructor.
+  DMITIGR_PGFE_API Event_reactor();
+
+  /// The destructor.
+  DMITIGR_PGFE_API ~Event_reactor() override;
+
+#if defined(DMITIGR_PGFE_EPOLL) || defined(DMITIGR_PGFE_KQUEUE)
+  /**
+   * @see Reactor::resume_on().
+   *
+   * @par Requires
+   * No other coroutine awaits `socket`.
+   */
+  DMITIGR_PGFE_API void resume_on(int socket, Socket_readiness mask,
+    std::coroutine_handle<> handle) override;
+
+private:
+  struct Awaiting final {
+    Socket_readiness mask{};
+    std::coroutine_handle<> handle;
+  };
+
+  int queue_{-1}; // the epoll or kqueue descriptor
+  std::unordered_map<int, Awaiting> awaiting_;
+
+  void poll(bool wait) override;
+#endif
+};
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "async.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_ASYNC_HPP
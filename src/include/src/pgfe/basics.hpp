@@ -268,6 +268,64 @@ inline std::string_view to_string_view(const Ssl_protocol_version spv)
 
 // =============================================================================
 
+/**
+ * @ingroup main
+ *
+ * @brief SSL negotiation.
+ */
+enum class Ssl_negotiation {
+  /// An SSLRequest first, then the handshake if the server accepts it.
+  postgres = 0,
+
+  /// The handshake right away, saving a round trip (PostgreSQL 17+).
+  direct = 100
+};
+
+/**
+ * @ingroup main
+ *
+ * @returns The SSL negotiation by `str`.
+ */
+inline std::optional<Ssl_negotiation>
+to_ssl_negotiation(const std::string_view str) noexcept
+{
+  using Sn = Ssl_negotiation;
+  if (str == "postgres")
+    return Sn::postgres;
+  else if (str == "direct")
+    return Sn::direct;
+  else
+    return std::nullopt;
+}
+
+/**
+ * @ingroup main
+ *
+ * @returns The string representation of `sn`, or `nullptr`.
+ */
+inline const char* to_literal(const Ssl_negotiation sn) noexcept
+{
+  using Sn = Ssl_negotiation;
+  switch (sn) {
+  case Sn::postgres: return "postgres";
+  case Sn::direct: return "direct";
+  }
+  return nullptr;
+}
+
+/**
+ * @ingroup main
+ *
+ * @returns The string representation of `sn`, or an empty view.
+ */
+inline std::string_view to_string_view(const Ssl_negotiation sn)
+{
+  const char* const l = to_literal(sn);
+  return l ? std::string_view{l} : std::string_view{};
+}
+
+// =============================================================================
+
 /**
  * @ingroup main
  *
@@ -344,6 +402,21 @@ inline std::string_view to_string_view(const Session_mode cm)
 
 // =============================================================================
 
+/**
+ * @ingroup utilities
+ *
+ * @brief A role of a server among the endpoints of Connection_router.
+ */
+enum class Endpoint_role {
+  /// The server accepting the writes.
+  primary = 0,
+
+  /// The server in hot standby mode serving the reads.
+  replica = 100
+};
+
+// =============================================================================
+
 /**
  * @ingroup main
  *
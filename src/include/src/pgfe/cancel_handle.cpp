@@ -0,0 +1,38 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../base/assert.hpp"
+#include "cancel_handle.hpp"
+
+namespace dmitigr::pgfe {
+
+DMITIGR_PGFE_INLINE Cancel_handle::Cancel_handle(PGcancel* const handle)
+  : handle_{handle, PQfreeCancel}
+{}
+
+DMITIGR_PGFE_INLINE bool Cancel_handle::is_valid() const noexcept
+{
+  return static_cast<bool>(handle_);
+}
+
+DMITIGR_PGFE_INLINE bool Cancel_handle::cancel() const noexcept
+{
+  DMITIGR_ASSERT(is_valid());
+  char error[256];
+  return PQcancel(handle_.get(), error, sizeof(error));
+}
+
+} // namespace dmitigr::pgfe
@@ -0,0 +1,87 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_CANCEL_HANDLE_HPP
+#define DMITIGR_PGFE_CANCEL_HANDLE_HPP
+
+#include "dll.hpp"
+#include "pq.hpp"
+#include "types_fwd.hpp"
+
+#include <memory>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup main
+ *
+ * @brief A handle to cancel the request a connection is processing, from any
+ * thread.
+ *
+ * @details Unlike the connection, the handle can be used by a thread other
+ * than the one waiting for the response, such as a watchdog of deadlines.
+ * It stays bound to the server session the connection had when the handle
+ * was made.
+ *
+ * @see Connection::cancel_handle().
+ */
+class Cancel_handle final {
+public:
+  /// Constructs invalid instance.
+  Cancel_handle() = default;
+
+  /// @returns `true` if this instance is correctly initialized.
+  DMITIGR_PGFE_API bool is_valid() const noexcept;
+
+  /// @returns `is_valid()`.
+  explicit operator bool() const noexcept
+  {
+    return is_valid();
+  }
+
+  /**
+   * @brief Asks the server to cancel the request being processed.
+   *
+   * @details The request goes over a connection of its own and the call
+   * blocks until the server takes it. The cancelled request, if it was still
+   * running, fails with SQLSTATE 57014 (`query_canceled`); a server which is
+   * idle ignores the request.
+   *
+   * @par Requires
+   * `is_valid()`.
+   *
+   * @returns `true` if the server took the request.
+   *
+   * @par Thread safety
+   * Thread-safe.
+   */
+  DMITIGR_PGFE_API bool cancel() const noexcept;
+
+private:
+  friend Connection;
+
+  std::shared_ptr<PGcancel> handle_;
+
+  explicit Cancel_handle(PGcancel* handle);
+};
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "cancel_handle.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_CANCEL_HANDLE_HPP
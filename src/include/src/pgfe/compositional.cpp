@@ -32,4 +32,18 @@ DMITIGR_PGFE_INLINE bool Compositional::is_invariant_ok() const noexcept
   return fields_ok && field_names_ok;
 }
 
+DMITIGR_PGFE_INLINE std::size_t
+Field_ref::index(const Compositional& compositional) const noexcept
+{
+  // The remembered index is taken as is if the name is there: for the same
+  // fields it's the first such one.
+  const std::size_t remembered{index_.load(std::memory_order_relaxed)};
+  if (remembered < compositional.field_count() &&
+      compositional.field_name(remembered) == name_)
+    return remembered;
+  const std::size_t result{compositional.field_index(name_)};
+  index_.store(result, std::memory_order_relaxed);
+  return result;
+}
+
 } // namespace dmitigr::pgfe
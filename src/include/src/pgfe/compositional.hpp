@@ -17,10 +17,13 @@
 #ifndef DMITIGR_PGFE_COMPOSITIONAL_HPP
 #define DMITIGR_PGFE_COMPOSITIONAL_HPP
 
+#include "dll.hpp"
 #include "types_fwd.hpp"
 
+#include <atomic>
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace dmitigr::pgfe {
 
@@ -65,6 +68,58 @@ private:
   virtual bool is_invariant_ok() const noexcept;
 };
 
+/**
+ * @ingroup main
+ *
+ * @brief A field name which remembers the index it was last found at.
+ *
+ * @details For a sequence of compositionals of the same fields, such as the
+ * rows of a query, finding the field takes one comparison of the name after
+ * the first lookup. Instances can be shared between threads.
+ *
+ * @remarks Among several fields named equally, the one found first for the
+ * fields seen first is kept while the name is still there.
+ */
+class Field_ref final {
+public:
+  /// The constructor.
+  explicit Field_ref(std::string name) noexcept
+    : name_{std::move(name)}
+  {}
+
+  /// Copy-constructible.
+  Field_ref(const Field_ref& rhs)
+    : name_{rhs.name_}
+    , index_{rhs.index_.load(std::memory_order_relaxed)}
+  {}
+
+  /// Copy-assignable.
+  Field_ref& operator=(const Field_ref& rhs)
+  {
+    name_ = rhs.name_;
+    index_.store(rhs.index_.load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+    return *this;
+  }
+
+  /// @returns The field name.
+  const std::string& name() const noexcept
+  {
+    return name_;
+  }
+
+  /**
+   * @returns `compositional.field_index(name())`, that is the index of the
+   * first field named name(), or `compositional.field_count()` if none.
+   */
+  DMITIGR_PGFE_API std::size_t
+  index(const Compositional& compositional) const noexcept;
+
+private:
+  std::string name_;
+  mutable std::atomic<std::size_t> index_{};
+};
+
 } // namespace dmitigr::pgfe
 
 #ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
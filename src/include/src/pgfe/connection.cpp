@@ -16,6 +16,9 @@
 
 #include "../base/assert.hpp"
 #include "../net/socket.hpp"
+#include "../str/escape.hpp"
+#include "../str/hex.hpp"
+#include "../str/predicate.hpp"
 #include "connection.hpp"
 #include "copier.hpp"
 #include "exceptions.hpp"
@@ -23,6 +26,9 @@
 #include "ready_for_query.hpp"
 #include "statement.hpp"
 
+#include <atomic>
+#include <cctype>
+#include <cstring>
 #include <iostream>
 
 namespace dmitigr::pgfe {
@@ -125,6 +131,7 @@ DMITIGR_PGFE_INLINE void Connection::swap(Connection& rhs) noexcept
   swap(conn_, rhs.conn_);
   swap(polling_status_, rhs.polling_status_);
   swap(lo_id_, rhs.lo_id_);
+  swap(query_buffer_, rhs.query_buffer_);
   swap(session_start_time_, rhs.session_start_time_);
   swap(response_, rhs.response_);
   swap(response_status_, rhs.response_status_);
@@ -135,6 +142,12 @@ DMITIGR_PGFE_INLINE void Connection::swap(Connection& rhs) noexcept
   swap(*copier_state_, *rhs.copier_state_);
   //
   swap(is_single_row_mode_enabled_, rhs.is_single_row_mode_enabled_);
+  swap(row_chunk_size_, rhs.row_chunk_size_);
+  swap(result_memory_limit_, rhs.result_memory_limit_);
+  swap(row_memory_, rhs.row_memory_);
+  swap(auto_pipeline_, rhs.auto_pipeline_);
+  swap(auto_pipeline_state_, rhs.auto_pipeline_state_);
+  swap(stats_, rhs.stats_);
   //
   swap(ps_states_, rhs.ps_states_);
   for (auto& state : ps_states_)
@@ -148,6 +161,11 @@ DMITIGR_PGFE_INLINE void Connection::swap(Connection& rhs) noexcept
   for (auto& state : rhs.lo_states_)
     state->connection_ = &rhs;
   //
+  swap(statement_cache_capacity_, rhs.statement_cache_capacity_);
+  swap(statement_cache_id_, rhs.statement_cache_id_);
+  swap(statement_cache_, rhs.statement_cache_);
+  swap(statement_cache_index_, rhs.statement_cache_index_);
+  //
   swap(requests_, rhs.requests_);
   swap(last_processed_request_, rhs.last_processed_request_);
 }
@@ -215,12 +233,40 @@ DMITIGR_PGFE_INLINE std::int_fast32_t Connection::server_pid() const noexcept
   return is_connected() ? PQbackendPID(conn()) : 0;
 }
 
+DMITIGR_PGFE_INLINE Cancel_handle Connection::cancel_handle() const
+{
+  if (!is_connected())
+    throw Client_exception{"cannot make cancel handle of disconnected session"};
+
+  auto* const handle = PQgetCancel(conn());
+  if (!handle)
+    throw Client_exception{"cannot make cancel handle"};
+  return Cancel_handle{handle};
+}
+
 DMITIGR_PGFE_INLINE std::optional<std::chrono::system_clock::time_point>
 Connection::session_start_time() const noexcept
 {
   return session_start_time_;
 }
 
+DMITIGR_PGFE_INLINE auto Connection::session_changes() const noexcept
+  -> const Session_changes&
+{
+  return session_changes_;
+}
+
+DMITIGR_PGFE_INLINE void Connection::clear_session_changes() noexcept
+{
+  session_changes_ = {};
+}
+
+DMITIGR_PGFE_INLINE std::vector<std::string>
+Connection::server_prepared_statements() const
+{
+  return {server_ps_names_.begin(), server_ps_names_.end()};
+}
+
 DMITIGR_PGFE_INLINE void Connection::connect_nio()
 {
   const auto s = status();
@@ -248,6 +294,7 @@ DMITIGR_PGFE_INLINE void Connection::connect_nio()
     case PGRES_POLLING_OK:
       polling_status_.reset();
       session_start_time_ = std::chrono::system_clock::now();
+      set_socket_options();
       /*
        * We cannot assert here that status() is "connected", because it can
        * become "failure" at *any* time, even just after successful connection
@@ -369,6 +416,32 @@ Connection::connect(std::optional<std::chrono::milliseconds> timeout)
   assert(is_invariant_ok());
 }
 
+DMITIGR_PGFE_INLINE Task<void> Connection::async_connect(Reactor& reactor)
+{
+  if (is_connected())
+    co_return;
+
+  connect_nio();
+  while (true) {
+    switch (status()) {
+    case Status::establishment_reading:
+      co_await reactor.readiness(socket(), Socket_readiness::read_ready);
+      break;
+    case Status::establishment_writing:
+      co_await reactor.readiness(socket(), Socket_readiness::write_ready);
+      break;
+    case Status::connected:
+      assert(is_invariant_ok());
+      co_return;
+    case Status::disconnected:
+      DMITIGR_ASSERT(false);
+    case Status::failure:
+      throw Client_exception{error_message()};
+    }
+    connect_nio();
+  }
+}
+
 DMITIGR_PGFE_INLINE void Connection::disconnect() noexcept
 {
   reset_session();
@@ -438,17 +511,61 @@ Connection::handle_input(const bool wait_response)
   if (!is_connected())
     throw Client_exception{"cannot handle input from server: not connected"};
 
+  static const auto is_rows_status = [](const auto status) noexcept
+  {
+    return status == PGRES_SINGLE_TUPLE
+#ifdef LIBPQ_HAS_CHUNK_MODE
+      || status == PGRES_TUPLES_CHUNK
+#endif
+      ;
+  };
+
   const auto check_state = [this]() noexcept
   {
     DMITIGR_ASSERT(response_status_ == Response_status::ready_not_preprocessed);
-    DMITIGR_ASSERT(response_.status() == PGRES_SINGLE_TUPLE);
+    DMITIGR_ASSERT(is_rows_status(response_.status()));
     DMITIGR_ASSERT(!requests_.empty());
     DMITIGR_ASSERT(requests_.front().id_ == Request::Id::execute);
   };
 
-  const auto dismiss_request = [this]() noexcept
+  // Records the rows of response_ to stats_ as received by `request`.
+  const auto record_rows = [this](Request& request) noexcept
+  {
+    if (!stats_ || request.start_time_ == decltype(request.start_time_){})
+      return;
+
+    const int row_count{response_.row_count()};
+    if (row_count > 0 && !request.is_first_row_received_) {
+      request.is_first_row_received_ = true;
+      stats_->first_row_latency.record(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - request.start_time_));
+    }
+    const int field_count{response_.field_count()};
+    std::uint64_t bytes{};
+    for (int i{}; i < row_count; ++i) {
+      for (int j{}; j < field_count; ++j)
+        bytes += static_cast<std::uint64_t>(response_.data_size(i, j));
+    }
+    stats_->row_count.fetch_add(row_count, std::memory_order_relaxed);
+    stats_->bytes_received.fetch_add(bytes, std::memory_order_relaxed);
+  };
+
+  const auto dismiss_request = [this, &record_rows]() noexcept
   {
     if (!requests_.empty()) {
+      if (auto& request = requests_.front(); stats_ &&
+        request.id_ == Request::Id::execute &&
+        request.start_time_ != decltype(request.start_time_){}) {
+        record_rows(request); // of the non-single-row mode
+        stats_->completion_latency.record(
+          std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - request.start_time_));
+        stats_->request_count.fetch_add(1, std::memory_order_relaxed);
+        const auto status = response_.status();
+        if (status == PGRES_FATAL_ERROR || status == PGRES_BAD_RESPONSE)
+          stats_->error_count.fetch_add(1, std::memory_order_relaxed);
+      }
       last_processed_request_ = std::move(requests_.front());
       requests_.pop();
     }
@@ -489,9 +606,10 @@ Connection::handle_input(const bool wait_response)
     } else if (!response_ || (response_status_ == Response_status::ready &&
         is_completion_status(response_.status()))) {
       response_.reset(PQgetResult(conn()));
-      if (response_.status() == PGRES_SINGLE_TUPLE) {
+      if (is_rows_status(response_.status())) {
         response_status_ = Response_status::ready_not_preprocessed;
         check_state();
+        record_rows(requests_.front());
         goto handle_notifications;
       } else if (is_completion_status(response_.status()))
         goto complete_response;
@@ -528,9 +646,10 @@ Connection::handle_input(const bool wait_response)
         is_completion_status(response_.status()))) {
       if (!is_get_result_would_block(conn())) {
         response_.reset(PQgetResult(conn()));
-        if (response_.status() == PGRES_SINGLE_TUPLE) {
+        if (is_rows_status(response_.status())) {
           response_status_ = Response_status::ready_not_preprocessed;
           check_state();
+          record_rows(requests_.front());
           goto handle_notifications;
         } else if (is_completion_status(response_.status())) {
           response_status_ = Response_status::unready;
@@ -548,7 +667,7 @@ Connection::handle_input(const bool wait_response)
   if (response_status_ == Response_status::ready_not_preprocessed) {
     const auto rstatus = response_.status();
     DMITIGR_ASSERT(rstatus != PGRES_NONFATAL_ERROR);
-    DMITIGR_ASSERT(rstatus != PGRES_SINGLE_TUPLE);
+    DMITIGR_ASSERT(!is_rows_status(rstatus));
     if (rstatus == PGRES_TUPLES_OK) {
       DMITIGR_ASSERT(last_processed_request_.id_ == Request::Id::execute);
       is_single_row_mode_enabled_ = false;
@@ -569,8 +688,11 @@ Connection::handle_input(const bool wait_response)
         DMITIGR_ASSERT(ps);
         const auto [p, e] = registered_ps(ps.name());
         DMITIGR_ASSERT(p == e);
+        if (!ps.name().empty())
+          server_ps_names_.insert(ps.name()); // can throw
         register_ps(std::move(ps)); // can throw (ps will not be affected)
         DMITIGR_ASSERT(last_prepared_statement_);
+        last_prepared_statement_.set_cached_description__(); // can throw
       } else if (lpr.id_ == Request::Id::describe) {
         auto& ps = lpr.prepared_statement_;
         DMITIGR_ASSERT(ps);
@@ -582,11 +704,13 @@ Connection::handle_input(const bool wait_response)
           reset_response(std::move(response));
           throw;
         }
+        ps.cache_description__();
         register_ps(std::move(ps)); // can throw (ps will not be affected)
         DMITIGR_ASSERT(last_prepared_statement_);
       } else if (lpr.id_ == Request::Id::unprepare) {
         DMITIGR_ASSERT(lpr.prepared_statement_name_ &&
           !std::strcmp(response_.command_tag(), "DEALLOCATE"));
+        server_ps_names_.erase(*lpr.prepared_statement_name_);
         unregister_ps(*lpr.prepared_statement_name_);
       }
       // is_copy_in_progress() now returns `false`.
@@ -692,6 +816,28 @@ Connection::wait_response(std::optional<std::chrono::milliseconds> timeout)
   DMITIGR_ASSERT(false);
 }
 
+DMITIGR_PGFE_INLINE Task<bool> Connection::async_wait_response(Reactor& reactor)
+{
+  using Sr = Socket_readiness;
+
+  if (!(is_connected() && has_uncompleted_request()))
+    co_return false;
+
+  while (!flush_output()) {
+    co_await reactor.readiness(socket(), Sr::read_ready | Sr::write_ready);
+    read_input();
+  }
+
+  while (true) {
+    const auto s = handle_input(false);
+    if (s == Response_status::unready) {
+      co_await reactor.readiness(socket(), Sr::read_ready);
+      read_input();
+    } else
+      co_return s == Response_status::ready;
+  }
+}
+
 DMITIGR_PGFE_INLINE bool
 Connection::wait_response_throw(const std::optional<std::chrono::milliseconds> timeout)
 {
@@ -731,6 +877,19 @@ DMITIGR_PGFE_INLINE Notification Connection::pop_notification()
   return n ? Notification{n} : Notification{};
 }
 
+DMITIGR_PGFE_INLINE std::size_t
+Connection::drain_notifications(const std::span<Notification> out)
+{
+  std::size_t result{};
+  for (; result < out.size(); ++result) {
+    auto* const n = PQnotifies(conn());
+    if (!n)
+      break;
+    out[result] = Notification{n};
+  }
+  return result;
+}
+
 DMITIGR_PGFE_INLINE void
 Connection::set_notice_handler(Notice_handler handler)
 {
@@ -888,6 +1047,7 @@ DMITIGR_PGFE_INLINE void Connection::describe_nio(const std::string& name)
   }
 
   assert(is_invariant_ok());
+  auto_queued__(name.size());
 }
 
 DMITIGR_PGFE_INLINE Prepared_statement Connection::describe(const std::string& name)
@@ -906,13 +1066,15 @@ DMITIGR_PGFE_INLINE void Connection::unprepare_nio(const std::string& name)
       "invalid name specified"};
 
   auto name_copy = name; // can throw
-  const auto query = "DEALLOCATE " + to_quoted_identifier(name); // can throw
-  execute_nio(query); // can throw
-  DMITIGR_ASSERT(requests_.front().id_ == Request::Id::execute);
-  requests_.front().id_ = Request::Id::unprepare; // cannot throw
-  requests_.front().prepared_statement_name_ = std::move(name_copy); // cannot throw
+  const Statement query{"DEALLOCATE " + to_quoted_identifier(name)}; // can throw
+  Prepared_statement ps{execute_ps_state_, &query, false};
+  const auto bytes = ps.execute_nio__(&query); // can throw
+  DMITIGR_ASSERT(requests_.back().id_ == Request::Id::execute);
+  requests_.back().id_ = Request::Id::unprepare; // cannot throw
+  requests_.back().prepared_statement_name_ = std::move(name_copy); // cannot throw
 
   assert(is_invariant_ok());
+  auto_queued__(bytes);
 }
 
 DMITIGR_PGFE_INLINE Completion Connection::unprepare(const std::string& name)
@@ -925,6 +1087,219 @@ DMITIGR_PGFE_INLINE Completion Connection::unprepare(const std::string& name)
   return completion();
 }
 
+DMITIGR_PGFE_INLINE void
+Connection::set_statement_cache_capacity(const std::size_t capacity)
+{
+  statement_cache_capacity_ = capacity;
+  while (statement_cache_.size() > statement_cache_capacity_)
+    evict_cached_statement__();
+}
+
+DMITIGR_PGFE_INLINE std::size_t
+Connection::statement_cache_capacity() const noexcept
+{
+  return statement_cache_capacity_;
+}
+
+DMITIGR_PGFE_INLINE void
+Connection::set_result_memory_limit(const std::size_t bytes) noexcept
+{
+  result_memory_limit_ = bytes;
+}
+
+DMITIGR_PGFE_INLINE std::size_t Connection::result_memory_limit() const noexcept
+{
+  return result_memory_limit_;
+}
+
+namespace detail {
+
+/// The process-wide result memory: the limit and the bytes held.
+inline std::atomic<std::size_t>& total_result_memory_limit() noexcept
+{
+  static std::atomic<std::size_t> result;
+  return result;
+}
+
+inline std::atomic<std::size_t>& total_result_memory() noexcept
+{
+  static std::atomic<std::size_t> result;
+  return result;
+}
+
+} // namespace detail
+
+DMITIGR_PGFE_INLINE void
+Connection::set_total_result_memory_limit(const std::size_t bytes) noexcept
+{
+  detail::total_result_memory_limit().store(bytes, std::memory_order_relaxed);
+}
+
+DMITIGR_PGFE_INLINE std::size_t Connection::total_result_memory_limit() noexcept
+{
+  return detail::total_result_memory_limit().load(std::memory_order_relaxed);
+}
+
+DMITIGR_PGFE_INLINE std::size_t Connection::total_result_memory() noexcept
+{
+  return detail::total_result_memory().load(std::memory_order_relaxed);
+}
+
+DMITIGR_PGFE_INLINE void
+Connection::Result_memory_hold::add(const std::size_t bytes)
+{
+  const auto limit = total_result_memory_limit();
+  const auto held = detail::total_result_memory().fetch_add(bytes,
+    std::memory_order_relaxed) + bytes;
+  bytes_ += bytes;
+  if (limit && held > limit)
+    throw Client_exception{"cannot execute statement: results of "
+      + std::to_string(held) + " bytes over the total result memory limit of "
+      + std::to_string(limit) + " bytes"};
+}
+
+DMITIGR_PGFE_INLINE void Connection::Result_memory_hold::release() noexcept
+{
+  detail::total_result_memory().fetch_sub(bytes_, std::memory_order_relaxed);
+  bytes_ = 0;
+}
+
+DMITIGR_PGFE_INLINE std::size_t Connection::response_memory__() const noexcept
+{
+  return response_ ? PQresultMemorySize(response_.native_handle()) : 0;
+}
+
+DMITIGR_PGFE_INLINE void
+Connection::note_row_memory__(const std::size_t bytes,
+  const std::size_t rows) noexcept
+{
+  if (rows)
+    row_memory_ = std::max<std::size_t>(bytes / rows, 1);
+}
+
+DMITIGR_PGFE_INLINE int
+Connection::chunk_rows_under_limit__(const std::size_t chunk_rows) const noexcept
+{
+  const auto total = total_result_memory_limit();
+  const auto limit = !result_memory_limit_ ? total : !total ?
+    result_memory_limit_ : std::min(result_memory_limit_, total);
+  if (!limit)
+    return static_cast<int>(chunk_rows);
+
+  // A heap row fits into a page unless it's toasted.
+  constexpr std::size_t page_size{8192};
+  const auto rows = limit / (row_memory_ ? row_memory_ : page_size);
+  return static_cast<int>(std::clamp<std::size_t>(rows, 1, chunk_rows));
+}
+
+DMITIGR_PGFE_INLINE const Type_info*
+Connection::type_info(const std::uint_fast32_t oid)
+{
+  if (const auto i = type_cache_.find(oid); i != type_cache_.end())
+    return &i->second;
+  else if (unknown_types_.contains(oid))
+    return nullptr;
+
+  load_type_info(std::span{&oid, 1});
+  const auto i = type_cache_.find(oid);
+  return i != type_cache_.end() ? &i->second : nullptr;
+}
+
+DMITIGR_PGFE_INLINE void
+Connection::load_type_info(const std::span<const std::uint_fast32_t> oids)
+{
+  std::string missing{"{"};
+  for (const auto oid : oids) {
+    if (!type_cache_.contains(oid) && !unknown_types_.contains(oid)) {
+      if (missing.size() > 1)
+        missing += ',';
+      missing += std::to_string(oid);
+    }
+  }
+  if (missing.size() == 1)
+    return;
+  missing += '}';
+
+  /*
+   * The closure of the types over the element, base and attribute types is
+   * found by the server, so it's one round trip however deep the types nest.
+   */
+  static const Statement query{R"(
+    with recursive closure(oid) as (
+      select unnest($1::oid[])
+      union
+      select d.oid from closure c
+        join pg_type t on t.oid = c.oid
+        cross join lateral (
+          select t.typelem
+          union all
+          select t.typbasetype
+          union all
+          select a.atttypid from pg_attribute a
+            where a.attrelid = t.typrelid and a.attnum > 0 and not a.attisdropped
+        ) d(oid)
+        where d.oid <> 0)
+    select t.oid, n.nspname, t.typname, t.typtype, t.typcategory, t.typelem,
+      t.typbasetype, t.typrelid, t.typlen, a.names, a.types
+      from closure c
+      join pg_type t on t.oid = c.oid
+      join pg_namespace n on n.oid = t.typnamespace
+      cross join lateral (
+        select array_agg(attname::text order by attnum) as names,
+          array_agg(atttypid order by attnum) as types
+          from pg_attribute
+          where attrelid = t.typrelid and attnum > 0 and not attisdropped
+      ) a)"};
+
+  using Oid = std::uint_fast32_t;
+  std::unordered_map<Oid, Type_info> loaded;
+  execute([&loaded](Row&& row)
+  {
+    Type_info info;
+    info.oid = to<Oid>(row[0]);
+    info.schema = to<std::string>(row[1]);
+    info.name = to<std::string>(row[2]);
+    info.kind = to<std::string>(row[3]).front();
+    info.category = to<std::string>(row[4]).front();
+    info.element_oid = to<Oid>(row[5]);
+    info.base_oid = to<Oid>(row[6]);
+    info.relation_oid = to<Oid>(row[7]);
+    info.length = to<int>(row[8]);
+    if (row[9] && row[10]) {
+      auto names = to<std::vector<std::optional<std::string>>>(row[9]);
+      const auto types = to<std::vector<std::optional<Oid>>>(row[10]);
+      if (names.size() != types.size())
+        throw Client_exception{"cannot load type info: "
+          "malformed attribute list"};
+      info.attributes.reserve(names.size());
+      for (std::size_t i{}; i < names.size(); ++i)
+        info.attributes.push_back({std::move(names[i]).value_or(""),
+          types[i].value_or(0)});
+    }
+    const auto oid = info.oid;
+    loaded.emplace(oid, std::move(info));
+  }, query, missing);
+
+  // Nothing is cached until the query succeeds.
+  for (const auto oid : oids) {
+    if (!loaded.contains(oid) && !type_cache_.contains(oid))
+      unknown_types_.insert(oid);
+  }
+  type_cache_.merge(loaded);
+}
+
+DMITIGR_PGFE_INLINE void
+Connection::set_stats(std::shared_ptr<Connection_stats> stats) noexcept
+{
+  stats_ = std::move(stats);
+}
+
+DMITIGR_PGFE_INLINE auto Connection::stats() const noexcept
+  -> const std::shared_ptr<Connection_stats>&
+{
+  return stats_;
+}
+
 DMITIGR_PGFE_INLINE void Connection::set_pipeline_enabled(const bool value)
 {
 #ifdef LIBPQ_HAS_PIPELINING
@@ -972,6 +1347,117 @@ DMITIGR_PGFE_INLINE void Connection::send_sync()
 #endif
 }
 
+DMITIGR_PGFE_INLINE void
+Connection::set_auto_pipeline(const std::optional<Auto_pipeline> options)
+{
+  if (options) {
+    if (!options->requests)
+      throw Client_exception{"cannot enable auto pipeline: "
+        "invalid requests threshold"};
+    if (!auto_pipeline_) {
+      if (!is_ready_for_request())
+        throw Client_exception{"cannot enable auto pipeline: "
+          "not ready for request"};
+      set_pipeline_enabled(true);
+    }
+    auto_pipeline_ = options;
+  } else if (auto_pipeline_) {
+    std::exception_ptr failure;
+    try {
+      complete_queued();
+    } catch (...) {
+      failure = std::current_exception();
+    }
+    auto_pipeline_.reset();
+    auto_pipeline_state_ = {};
+    if (is_connected() && pipeline_status() != Pipeline_status::disabled &&
+      !PQexitPipelineMode(conn()) && !failure)
+      failure = std::make_exception_ptr(Client_exception{error_message()});
+    if (failure)
+      std::rethrow_exception(failure);
+  }
+}
+
+DMITIGR_PGFE_INLINE auto Connection::auto_pipeline() const noexcept
+  -> const std::optional<Auto_pipeline>&
+{
+  return auto_pipeline_;
+}
+
+DMITIGR_PGFE_INLINE void Connection::complete_queued()
+{
+  if (!auto_pipeline_)
+    throw Client_exception{"cannot complete queued requests: "
+      "auto pipeline is disabled"};
+
+  auto& state = auto_pipeline_state_;
+  if (state.requests) {
+    send_sync();
+    ++state.syncs;
+    state.requests = state.bytes = 0;
+  }
+  while (state.syncs && handle_queued__());
+  if (auto failure = std::exchange(state.failure, nullptr))
+    std::rethrow_exception(failure);
+}
+
+DMITIGR_PGFE_INLINE void Connection::auto_queued__(const std::size_t bytes)
+{
+  if (!auto_pipeline_)
+    return;
+
+  auto& state = auto_pipeline_state_;
+  const auto now = std::chrono::steady_clock::now();
+  if (!state.requests++)
+    state.start = now;
+  state.bytes += bytes;
+  if (state.requests >= auto_pipeline_->requests ||
+    state.bytes >= auto_pipeline_->bytes ||
+    now - state.start >= auto_pipeline_->delay) {
+    send_sync();
+    ++state.syncs;
+    state.requests = state.bytes = 0;
+    // The server is not kept waiting for the client to read its output.
+    while (state.syncs > 1 && handle_queued__());
+  }
+}
+
+DMITIGR_PGFE_INLINE bool Connection::handle_queued__()
+{
+  if (!wait_response())
+    return false;
+
+  auto& state = auto_pipeline_state_;
+  const auto call = [&state](const auto& callback, auto&& response)
+  {
+    if (callback && !state.failure) {
+      try {
+        callback(std::move(response));
+      } catch (...) {
+        state.failure = std::current_exception();
+      }
+    }
+  };
+
+  // Rows are of the request in progress, the rest of the one dismissed.
+  if (auto e = error()) {
+    if (const auto& callbacks = last_processed_request_.callbacks_; callbacks.error)
+      call(callbacks.error, std::move(e));
+    else if (!state.failure)
+      state.failure = std::make_exception_ptr(
+        Server_exception{std::make_shared<Error>(std::move(e))});
+  } else if (auto r = row())
+    call(requests_.front().callbacks_.row, std::move(r));
+  else if (ready_for_query().is_valid())
+    --state.syncs;
+  else if (const auto id = last_processed_request_.id_;
+    id == Request::Id::prepare || id == Request::Id::describe)
+    (void)prepared_statement(); // registered by handle_input()
+  else if (auto c = completion()) // or aborted
+    call(last_processed_request_.callbacks_.completion, std::move(c));
+  return true;
+}
+
 DMITIGR_PGFE_INLINE void Connection::send_flush()
 {
 #ifdef LIBPQ_HAS_PIPELINING
@@ -1060,47 +1546,54 @@ Connection::export_large_object(const Oid oid,
 
 DMITIGR_PGFE_INLINE std::string
 Connection::to_quoted_literal(const std::string_view literal) const
+{
+  std::string result;
+  append_quoted_literal(result, literal);
+  return result;
+}
+
+DMITIGR_PGFE_INLINE std::string
+Connection::to_quoted_identifier(const std::string_view identifier) const
+{
+  std::string result;
+  append_quoted_identifier(result, identifier);
+  return result;
+}
+
+DMITIGR_PGFE_INLINE void
+Connection::append_quoted_literal(std::string& result,
+  const std::string_view literal) const
 {
   if (!is_connected())
     throw Client_exception{"cannot quote literal: not connected"};
 
-  using Uptr = std::unique_ptr<char, void(*)(void*)>;
-  if (const auto p = Uptr{PQescapeLiteral(conn(), literal.data(),
-        literal.size()), &PQfreemem})
-    return p.get();
-  else if (is_out_of_memory())
-    throw std::bad_alloc{};
-  else
-    throw Client_exception{error_message()};
+  append_quoted(result, literal, false);
 }
 
-DMITIGR_PGFE_INLINE std::string
-Connection::to_quoted_identifier(const std::string_view identifier) const
+DMITIGR_PGFE_INLINE void
+Connection::append_quoted_identifier(std::string& result,
+  const std::string_view identifier) const
 {
   if (!is_connected())
     throw Client_exception{"cannot quote identifier: not connected"};
 
-  using Uptr = std::unique_ptr<char, void(*)(void*)>;
-  if (const auto p = Uptr{PQescapeIdentifier(conn(), identifier.data(),
-        identifier.size()), &PQfreemem})
-    return p.get();
-  else if (is_out_of_memory())
-    throw std::bad_alloc{};
-  else
-    throw Client_exception{error_message()};
+  append_quoted(result, identifier, true);
 }
 
 DMITIGR_PGFE_INLINE std::unique_ptr<Data>
 Connection::to_hex_data(const Data& data) const
 {
-  auto [storage, size] = to_hex_storage(data);
-  return Data::make(std::move(storage), size, Data_format::text);
+  return Data::make(to_hex_string(data), Data_format::text);
 }
 
 DMITIGR_PGFE_INLINE std::string Connection::to_hex_string(const Data& data) const
 {
-  const auto [storage, size] = to_hex_storage(data);
-  return std::string{static_cast<const char*>(storage.get()), size};
+  const auto prefix = hex_prefix(data);
+  std::string result(prefix.size() + 2 * data.size(), '\0');
+  prefix.copy(result.data(), prefix.size());
+  str::encode_hex({static_cast<const char*>(data.bytes()), data.size()},
+    result.data() + prefix.size());
+  return result;
 }
 
 // -----------------------------------------------------------------------------
@@ -1173,12 +1666,22 @@ DMITIGR_PGFE_INLINE void Connection::reset_session() noexcept
   session_start_time_.reset();
   response_.reset();
   response_status_ = {};
-  requests_ = {};
+  requests_.clear();
+  auto_pipeline_.reset();
+  auto_pipeline_state_ = {};
   is_output_flushed_ = true;
   reset_copier_state();
   is_single_row_mode_enabled_ = false;
 
+  type_cache_.clear();
+  unknown_types_.clear();
+
   // Reset prepared statements.
+  session_changes_ = {};
+  server_ps_names_.clear();
+  statement_cache_index_.clear();
+  statement_cache_.clear();
+  routine_statements_.clear();
   last_prepared_statement_ = {};
   for (auto& s : ps_states_) {
     DMITIGR_ASSERT(s);
@@ -1204,11 +1707,52 @@ DMITIGR_PGFE_INLINE void Connection::reset_copier_state() noexcept
 
 DMITIGR_PGFE_INLINE void Connection::set_single_row_mode_enabled() noexcept
 {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+  const auto set_ok = row_chunk_size_ > 1 ?
+    PQsetChunkedRowsMode(conn(), row_chunk_size_) : PQsetSingleRowMode(conn());
+#else
   const auto set_ok = PQsetSingleRowMode(conn());
+#endif
   DMITIGR_ASSERT(set_ok);
   is_single_row_mode_enabled_ = true;
 }
 
+DMITIGR_PGFE_INLINE bool Connection::take_rows__(Row_batch& batch)
+{
+  const auto status = response_.status();
+#ifdef LIBPQ_HAS_CHUNK_MODE
+  if (status == PGRES_TUPLES_CHUNK) {
+    DMITIGR_ASSERT(!batch);
+    batch.append(release_response());
+    return true;
+  }
+#endif
+  if (status == PGRES_SINGLE_TUPLE) {
+    batch.append(release_response());
+    return true;
+  }
+  return false;
+}
+
+DMITIGR_PGFE_INLINE bool Connection::take_row__(Row& row) noexcept
+{
+  if (response_.status() != PGRES_SINGLE_TUPLE)
+    return false;
+  row.info_.pq_result_ = release_response();
+  return true;
+}
+
+DMITIGR_PGFE_INLINE void Connection::discard_rows__() noexcept
+{
+  try {
+    Row_batch rows;
+    do {
+      wait_response();
+      rows = {};
+    } while (take_rows__(rows));
+  } catch (...) {}
+}
+
 DMITIGR_PGFE_INLINE void
 Connection::notice_receiver(void* const arg, const PGresult* const r) noexcept
 {
@@ -1242,7 +1786,9 @@ Connection::prepare_nio__(const char* const query, const char* const name,
   DMITIGR_ASSERT(query);
   DMITIGR_ASSERT(name);
 
+  note_session_changes__(query);
   auto state = std::make_shared<Prepared_statement::State>(name, this);
+  state->description_key_ = description_key__(query);
   Prepared_statement ps{std::move(state), preparsed, true};
   requests_.emplace(Request::Id::prepare, std::move(ps));
   try {
@@ -1257,6 +1803,28 @@ Connection::prepare_nio__(const char* const query, const char* const name,
   }
 
   assert(is_invariant_ok());
+  auto_queued__(std::strlen(query) + std::strlen(name));
+}
+
+DMITIGR_PGFE_INLINE std::string
+Connection::description_key__(const std::string_view query) const
+{
+  // What the text resolves to may differ after such changes.
+  const auto& c = session_changes_;
+  if (c.settings || c.authorization || c.temporary)
+    return {};
+
+  const auto str = [](const char* const s)
+  {
+    return std::string_view{s ? s : ""};
+  };
+  std::string result;
+  result.append(str(PQuser(conn()))).append(1, '@')
+    .append(str(PQhost(conn()))).append(1, ':')
+    .append(str(PQport(conn()))).append(1, '/')
+    .append(str(PQdb(conn()))).append(1, '\n')
+    .append(query);
+  return result;
 }
 
 DMITIGR_PGFE_INLINE Prepared_statement Connection::wait_prepared_statement__()
@@ -1278,6 +1846,147 @@ Connection::register_ps(Prepared_statement&& ps)
   DMITIGR_ASSERT(last_prepared_statement_);
 }
 
+DMITIGR_PGFE_INLINE Prepared_statement*
+Connection::cached_statement__(const Statement& statement)
+{
+  if (!statement_cache_capacity_ || !statement.parameter_count())
+    return nullptr;
+
+  auto query = statement.to_query_string(*this); // can throw
+  const auto i = statement_cache_index_.find(query);
+  if (i == cend(statement_cache_index_)) {
+    while (statement_cache_.size() >= statement_cache_capacity_)
+      evict_cached_statement__(); // can throw
+    statement_cache_.push_front(Cached_statement{std::move(query), {}});
+    try {
+      statement_cache_index_.emplace(statement_cache_.front().query,
+        begin(statement_cache_)); // can throw
+    } catch (...) {
+      statement_cache_.pop_front();
+      throw;
+    }
+    return nullptr;
+  }
+
+  const auto entry = i->second;
+  statement_cache_.splice(begin(statement_cache_), statement_cache_, entry);
+  if (!entry->statement)
+    entry->statement = prepare(statement, "pgfe_cached_" +
+      std::to_string(++statement_cache_id_)); // can throw
+  else {
+    // Like the unnamed statement, the parameters not passed are NULLs.
+    for (std::size_t p{}; p < entry->statement.parameter_count(); ++p)
+      entry->statement.bind(p, nullptr);
+  }
+  return &entry->statement;
+}
+
+DMITIGR_PGFE_INLINE void
+Connection::check_statement_cache__(const Completion& completion) noexcept
+{
+  if (completion.tag() == "DISCARD ALL" || completion.tag() == "DEALLOCATE ALL") {
+    // The server has already forgotten the statements.
+    statement_cache_index_.clear();
+    statement_cache_.clear();
+    routine_statements_.clear();
+    server_ps_names_.clear();
+  }
+}
+
+DMITIGR_PGFE_INLINE void
+Connection::note_session_changes__(const std::string_view query) noexcept
+{
+  const auto lower = [](const char c) noexcept
+  {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  };
+  const auto is_word_char = [](const char c) noexcept
+  {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+  };
+  // Whether `word` is at `pos`, ignoring the case.
+  const auto is_at = [&](const std::size_t pos, const std::string_view word) noexcept
+  {
+    if (query.size() - pos < word.size())
+      return false;
+    for (std::size_t i{}; i < word.size(); ++i) {
+      if (lower(query[pos + i]) != word[i])
+        return false;
+    }
+    return true;
+  };
+  const auto is_word_at = [&](const std::size_t pos, const std::string_view word) noexcept
+  {
+    return (pos == 0 || !is_word_char(query[pos - 1])) && is_at(pos, word) &&
+      (pos + word.size() == query.size() || !is_word_char(query[pos + word.size()]));
+  };
+
+  auto& c = session_changes_;
+  bool is_statement_start{true};
+  bool is_set{};
+  for (std::size_t i{}; i < query.size(); ++i) {
+    const char ch = query[i];
+    if (ch == ';') {
+      is_statement_start = true;
+      is_set = false;
+      continue;
+    } else if (std::isspace(static_cast<unsigned char>(ch)))
+      continue;
+    else if (ch == '-' && i + 1 < query.size() && query[i + 1] == '-') {
+      while (i < query.size() && query[i] != '\n')
+        ++i;
+      continue;
+    } else if (ch == '/' && i + 1 < query.size() && query[i + 1] == '*') {
+      const auto end = query.find("*/", i + 2);
+      i = end == std::string_view::npos ? query.size() : end + 1;
+      continue;
+    }
+
+    if (is_statement_start) {
+      is_statement_start = false;
+      if (is_word_at(i, "set") || is_word_at(i, "reset")) {
+        // Transaction-scoped ones end with the transaction.
+        auto j = i + 3;
+        while (j < query.size() && std::isspace(static_cast<unsigned char>(query[j])))
+          ++j;
+        if (!is_word_at(i, "set") || !(is_word_at(j, "transaction") ||
+            is_word_at(j, "local") || is_word_at(j, "constraints")))
+          c.settings = true;
+        is_set = true;
+      } else if (is_word_at(i, "listen"))
+        c.listening = true;
+      else if (is_word_at(i, "declare"))
+        c.cursors = true;
+      else if (is_word_at(i, "prepare"))
+        c.statements = true;
+    }
+    if (!is_word_char(ch) || (i > 0 && is_word_char(query[i - 1])))
+      continue;
+    if (is_word_at(i, "temp") || is_word_at(i, "temporary") || is_at(i, "pg_temp"))
+      c.temporary = true;
+    else if (is_at(i, "set_config"))
+      c.settings = true;
+    else if (is_at(i, "nextval") || is_at(i, "setval"))
+      c.sequences = true;
+    else if (is_at(i, "pg_advisory_lock") || is_at(i, "pg_try_advisory_lock"))
+      c.locks = true;
+    else if (is_set && is_word_at(i, "authorization"))
+      c.authorization = true;
+  }
+}
+
+DMITIGR_PGFE_INLINE void Connection::evict_cached_statement__()
+{
+  DMITIGR_ASSERT(!statement_cache_.empty());
+  auto& entry = statement_cache_.back();
+  const bool was_prepared = static_cast<bool>(entry.statement);
+  const auto name = was_prepared ? entry.statement.name() : std::string{};
+  statement_cache_index_.erase(entry.query);
+  statement_cache_.pop_back();
+  if (was_prepared && is_ready_for_request())
+    unprepare(name); // can throw
+}
+
 DMITIGR_PGFE_INLINE void
 Connection::unregister_ps(const std::string_view name) noexcept
 {
@@ -1297,6 +2006,36 @@ DMITIGR_PGFE_INLINE int Connection::socket() const noexcept
   return PQsocket(conn());
 }
 
+DMITIGR_PGFE_INLINE void Connection::set_socket_options()
+{
+  const auto rcvbuf = options_.tcp_receive_buffer_size();
+  const auto sndbuf = options_.tcp_send_buffer_size();
+  const auto nodelay = options_.is_tcp_nodelay_enabled();
+  if (!rcvbuf && !sndbuf && !nodelay)
+    return;
+
+  // The options of TCP are not applicable to the Unix-domain sockets.
+  const auto sock = static_cast<net::Socket_native>(socket());
+  sockaddr_storage addr{};
+  auto addr_size = static_cast<socklen_t>(sizeof(addr));
+  if (net::is_socket_error(getsockname(sock,
+        reinterpret_cast<sockaddr*>(&addr), &addr_size)) ||
+    (addr.ss_family != AF_INET && addr.ss_family != AF_INET6))
+    return;
+
+  try {
+    if (rcvbuf)
+      net::set_option(sock, SOL_SOCKET, SO_RCVBUF, *rcvbuf);
+    if (sndbuf)
+      net::set_option(sock, SOL_SOCKET, SO_SNDBUF, *sndbuf);
+    if (nodelay)
+      net::set_option(sock, IPPROTO_TCP, TCP_NODELAY, *nodelay);
+  } catch (const std::exception& e) {
+    throw Client_exception{std::string{"cannot set socket options: "}
+      .append(e.what())};
+  }
+}
+
 DMITIGR_PGFE_INLINE void Connection::throw_if_error()
 {
   if (auto err = error()) {
@@ -1334,28 +2073,72 @@ DMITIGR_PGFE_INLINE bool Connection::is_out_of_memory() const noexcept
   return !std::strncmp(PQerrorMessage(conn()), msg, sizeof(msg) - 1);
 }
 
-DMITIGR_PGFE_INLINE std::pair<std::unique_ptr<void, void(*)(void*)>, std::size_t>
-Connection::to_hex_storage(const pgfe::Data& data) const
+DMITIGR_PGFE_INLINE std::string_view
+Connection::hex_prefix(const pgfe::Data& data) const
 {
   if (!is_connected())
     throw Client_exception{"cannot encode data to hex: not connected"};
   else if (!(data && (data.format() == Data_format::binary)))
     throw Client_exception{"cannot encode data to hex: invalid data specified"};
 
-  const auto from_length = data.size();
-  const auto* const from = static_cast<const unsigned char*>(data.bytes());
-  std::size_t result_length{};
-  using Uptr = std::unique_ptr<void, void(*)(void*)>;
-  if (auto storage = Uptr{PQescapeByteaConn(conn(), from, from_length,
-        &result_length), &PQfreemem})
-    // The result_length includes the terminating zero byte of the result.
-    return std::make_pair(std::move(storage), result_length - 1);
-  else
-    /*
-     * Currently, the only possible error is insufficient memory for the result
-     * string. See: https://www.postgresql.org/docs/current/static/libpq-exec.html#LIBPQ-PQESCAPEBYTEACONN
-     */
-    throw std::bad_alloc{};
+  /*
+   * Like PQescapeByteaConn() does, the backslash is doubled unless the
+   * string literals are standard conforming.
+   */
+  const char* const std_strings =
+    PQparameterStatus(conn(), "standard_conforming_strings");
+  return std_strings && !std::strcmp(std_strings, "on") ? "\\x" : "\\\\x";
+}
+
+DMITIGR_PGFE_INLINE bool Connection::is_utf8_client_encoding() const noexcept
+{
+  const char* const encoding = PQparameterStatus(conn(), "client_encoding");
+  return encoding && !std::strcmp(encoding, "UTF8");
+}
+
+DMITIGR_PGFE_INLINE void Connection::append_quoted(std::string& result,
+  std::string_view value, const bool is_identifier) const
+{
+  DMITIGR_ASSERT(is_connected());
+
+  if (!is_utf8_client_encoding()) {
+    using Uptr = std::unique_ptr<char, void(*)(void*)>;
+    if (const auto p = Uptr{is_identifier ?
+          PQescapeIdentifier(conn(), value.data(), value.size()) :
+          PQescapeLiteral(conn(), value.data(), value.size()), &PQfreemem})
+      result.append(p.get());
+    else if (is_out_of_memory())
+      throw std::bad_alloc{};
+    else
+      throw Client_exception{error_message()};
+    return;
+  }
+
+  // Like libpq, ignore everything after the zero byte.
+  value = value.substr(0, str::find_any(value, '\0', '\0', '\0', '\0'));
+
+  /*
+   * Like current libpq, reject invalid characters: truncated sequences, stray
+   * continuation bytes, overlong forms, surrogates and lead bytes past
+   * U+10FFFF, whatever an older libpq would have let through.
+   */
+  if (!str::is_valid_utf8(value))
+    throw Client_exception{is_identifier ?
+      "cannot quote identifier: invalid UTF-8 character" :
+      "cannot quote literal: invalid UTF-8 character"};
+
+  const char quote = is_identifier ? '"' : '\'';
+  const bool has_backslashes = !is_identifier &&
+    str::find_any(value, '\\', '\\', '\\', '\\') != value.size();
+  const auto size = result.size();
+  result.resize(size + 2 + str::escaped_size_max(value.size()));
+  char* out = result.data() + size;
+  if (has_backslashes) {
+    *out++ = ' ';
+    *out++ = 'E';
+  }
+  out = str::quote_doubling(value, quote, has_backslashes ? '\\' : quote, out);
+  result.resize(static_cast<std::size_t>(out - result.data()));
 }
 
 DMITIGR_PGFE_INLINE void Connection::register_lo(const Large_object& lo)
@@ -18,9 +18,12 @@
 #define DMITIGR_PGFE_CONNECTION_HPP
 
 #include "../base/assert.hpp"
+#include "async.hpp"
 #include "basics.hpp"
+#include "cancel_handle.hpp"
 #include "completion.hpp"
 #include "connection_options.hpp"
+#include "connection_stats.hpp"
 #include "data.hpp"
 #include "dll.hpp"
 #include "error.hpp"
@@ -30,19 +33,33 @@
 #include "notification.hpp"
 #include "pq.hpp"
 #include "prepared_statement.hpp"
+#include "ready_for_query.hpp"
 #include "row.hpp"
+#include "row_batch.hpp"
+#include "type_info.hpp"
 #include "types_fwd.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <chrono>
 #include <cstdint>
+#include <exception>
 #include <functional>
+#include <limits>
 #include <list>
+#include <map>
 #include <memory>
 #include <optional>
-#include <queue>
+#include <span>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace dmitigr::pgfe {
 
@@ -144,6 +161,17 @@ public:
    */
   DMITIGR_PGFE_API std::int_fast32_t server_pid() const noexcept;
 
+  /**
+   * @returns A handle to cancel the requests of the current session from
+   * another thread.
+   *
+   * @par Requires
+   * `is_connected()`.
+   *
+   * @throws Client_exception if libpq can't make the handle.
+   */
+  DMITIGR_PGFE_API Cancel_handle cancel_handle() const;
+
   /**
    * @returns The last registered time point when is_connected() started to
    * return `true`, or `std::nullopt` if the session has never started.
@@ -151,6 +179,47 @@ public:
   DMITIGR_PGFE_API std::optional<std::chrono::system_clock::time_point>
   session_start_time() const noexcept;
 
+  /**
+   * @brief The kinds of session state the statements sent may have changed.
+   *
+   * @details Told by the text of the statements prepared or executed, so
+   * a statement which may change the state is never missed as far as its
+   * text shows, and one which only looks like it is counted too. A function
+   * changing the state by itself isn't seen.
+   */
+  struct Session_changes final {
+    bool settings{};      ///< `SET`, `RESET` or `set_config()`.
+    bool authorization{}; ///< `SET SESSION AUTHORIZATION`.
+    bool temporary{};     ///< Temporary objects.
+    bool sequences{};     ///< `nextval()` or `setval()`, for `currval()`.
+    bool listening{};     ///< `LISTEN`.
+    bool locks{};         ///< Session level advisory locks.
+    bool cursors{};       ///< `DECLARE`, as a cursor `WITH HOLD` outlives its transaction.
+    bool statements{};    ///< `PREPARE`, unlike prepare() unknown to this instance.
+
+    /// @returns `true` if any is.
+    bool is_any() const noexcept
+    {
+      return settings || authorization || temporary || sequences ||
+        listening || locks || cursors || statements;
+    }
+  };
+
+  /**
+   * @returns The session changes since the session started or since the
+   * last clear_session_changes().
+   */
+  DMITIGR_PGFE_API const Session_changes& session_changes() const noexcept;
+
+  /// Forgets the session changes, as after a reset of the session.
+  DMITIGR_PGFE_API void clear_session_changes() noexcept;
+
+  /**
+   * @returns The names of the statements prepared on the server by prepare()
+   * or describe() and neither unprepared nor discarded since.
+   */
+  DMITIGR_PGFE_API std::vector<std::string> server_prepared_statements() const;
+
   ///@}
 
   // ---------------------------------------------------------------------------
@@ -332,6 +401,15 @@ public:
   /// @returns The valid instance if available.
   DMITIGR_PGFE_API Notification pop_notification();
 
+  /**
+   * @brief Pops up to `out.size()` notifications available into `out`.
+   *
+   * @returns The number of notifications popped.
+   *
+   * @see pop_notification().
+   */
+  DMITIGR_PGFE_API std::size_t drain_notifications(std::span<Notification> out);
+
   /// An alias of a notice handler.
   using Notice_handler = std::function<void(const Notice&)>;
 
@@ -565,6 +643,8 @@ public:
       }
     };
 
+    // The row is reused for each row of the result set.
+    Row r;
     Row_processing rowpro{Row_processing::continu};
     while (true) {
       if constexpr (Traits::has_error_parameter) {
@@ -572,7 +652,7 @@ public:
         if (auto e = error()) {
           callback(Row{}, std::move(e));
           return Completion{};
-        } else if (auto r = row()) {
+        } else if (take_row__(r)) {
           with_complete_on_exception([this, &callback, &rowpro, &r]
           {
             if constexpr (!Traits::is_result_void)
@@ -584,7 +664,7 @@ public:
           return completion();
       } else {
         wait_response_throw();
-        if (auto r = row()) {
+        if (take_row__(r)) {
           with_complete_on_exception([this, &callback, &rowpro, &r]
           {
             if constexpr (!Traits::is_result_void)
@@ -603,6 +683,33 @@ public:
     }
   }
 
+  /**
+   * @brief Processes the responses like process_responses(), but hands the
+   * rows to `callback` in batches.
+   *
+   * @details Every Row owns its data, so the views of the data of the rows
+   * of a batch, such as `to<std::string_view>(row[i])`, are valid until
+   * `callback` returns.
+   *
+   * @param callback A function to be called with `std::span<Row>` of at most
+   * `batch_size` rows, the last batch of which may be shorter.
+   *
+   * @par Requires
+   * `batch_size > 0`.
+   *
+   * @see execute_in_batches().
+   */
+  template<typename F>
+  std::enable_if_t<std::is_invocable_v<F, std::span<Row>>, Completion>
+  process_responses_in_batches(F&& callback, const std::size_t batch_size)
+  {
+    std::vector<Row> batch;
+    auto result = process_responses(batcher__(batch, callback, batch_size));
+    if (!batch.empty())
+      callback(std::span<Row>{batch});
+    return result;
+  }
+
   /**
    * @returns The Prepared_statement as response on descibe or prepare request.
    *
@@ -838,9 +945,15 @@ public:
   {
     if (!is_ready_for_request())
       throw Client_exception{"cannot execute statement: not ready for request"};
+    if (auto* const ps = cached_statement__(statement)) {
+      return ps->execute<on_exception>(std::forward<F>(callback),
+        std::forward<Types>(parameters)...);
+    }
     execute_nio(statement, std::forward<Types>(parameters)...);
-    return completion_or_throw(
+    auto result = completion_or_throw(
       process_responses<on_exception>(std::forward<F>(callback)));
+    check_statement_cache__(result);
+    return result;
   }
 
   /// @overload
@@ -851,6 +964,481 @@ public:
       std::forward<Types>(parameters)...);
   }
 
+  /**
+   * @brief Similar to execute(), but hands the rows to `callback` in
+   * batches like process_responses_in_batches().
+   *
+   * @par Requires
+   * `is_ready_for_request() && !statement.has_missing_parameters() &&
+   * batch_size > 0`.
+   */
+  template<typename F, typename ... Types>
+  std::enable_if_t<std::is_invocable_v<F, std::span<Row>>, Completion>
+  execute_in_batches(F&& callback, const std::size_t batch_size,
+    const Statement& statement, Types&& ... parameters)
+  {
+    std::vector<Row> batch;
+    auto result = execute(batcher__(batch, callback, batch_size), statement,
+      std::forward<Types>(parameters)...);
+    if (!batch.empty())
+      callback(std::span<Row>{batch});
+    return result;
+  }
+
+  /**
+   * @brief Requests the server to execute the statement like execute()
+   * does, and hands the rows to `callback` in batches of Row_batch.
+   *
+   * @details With libpq of PostgreSQL 17 or later the rows are retrieved in
+   * the chunked rows mode, so a batch costs one result instead of one per
+   * row, and the last batch may be shorter. Otherwise (or in the pipeline
+   * mode) the rows are retrieved one by one and gathered into batches of
+   * `chunk_rows` rows. If `callback` throws, the rest of the rows are
+   * discarded before the exception is rethrown.
+   *
+   * @param callback A function to be called with `const Row_batch&`.
+   * @param chunk_rows The number of rows of a batch, at most.
+   *
+   * @par Requires
+   * `is_ready_for_request() && !statement.has_missing_parameters() &&
+   * chunk_rows > 0`.
+   *
+   * @see execute(), Row_batch.
+   */
+  template<typename F, typename ... Types>
+  std::enable_if_t<std::is_invocable_v<F, const Row_batch&>, Completion>
+  execute_batched(F&& callback, const std::size_t chunk_rows,
+    const Statement& statement, Types&& ... parameters)
+  {
+    if (!is_ready_for_request())
+      throw Client_exception{"cannot execute statement: not ready for request"};
+    else if (!chunk_rows ||
+      chunk_rows > static_cast<std::size_t>(std::numeric_limits<int>::max()))
+      throw Client_exception{"cannot execute statement: invalid chunk size"};
+
+    row_chunk_size_ = chunk_rows_under_limit__(chunk_rows);
+    try {
+      if (auto* const ps = cached_statement__(statement))
+        ps->bind_many(std::forward<Types>(parameters)...).execute_nio();
+      else
+        execute_nio(statement, std::forward<Types>(parameters)...);
+    } catch (...) {
+      row_chunk_size_ = 0;
+      throw;
+    }
+    row_chunk_size_ = 0;
+
+    Row_batch batch;
+    Result_memory_hold held; // of batch
+    try {
+      while (true) {
+        wait_response_throw();
+        // A chunk is a batch itself; single rows are gathered.
+        const bool was_empty = !batch;
+        const std::size_t rows{batch.size()};
+        const std::size_t bytes{response_memory__()};
+        if (!take_rows__(batch))
+          break;
+        note_row_memory__(bytes, batch.size() - rows);
+        held.add(bytes); // can throw
+        if (batch.size() >= chunk_rows || (was_empty && batch.size() > 1) ||
+          (result_memory_limit_ && held.bytes() >= result_memory_limit_)) {
+          callback(std::as_const(batch));
+          batch = {};
+          held.release();
+        }
+      }
+      if (batch)
+        callback(std::as_const(batch));
+    } catch (...) {
+      discard_rows__();
+      throw;
+    }
+    auto result = completion_or_throw(completion());
+    check_statement_cache__(result);
+    return result;
+  }
+
+  /**
+   * @brief Executes the statement like execute_batched() does, in the binary
+   * result format, and hands the rows to `callback` as Arrow_batch.
+   *
+   * @details The fields are decoded column by column straight from the
+   * results into the buffers of the Arrow layout, which are exported through
+   * the Arrow C data interface without Row or Data conversions.
+   *
+   * @param callback A function to be called with `Arrow_batch&&`.
+   * @param batch_rows The number of rows of a batch, at most.
+   *
+   * @par Requires
+   * `is_ready_for_request() && !statement.has_missing_parameters() &&
+   * batch_rows > 0`.
+   *
+   * @remarks Defined in arrow.hpp.
+   *
+   * @see execute_batched(), Arrow_batch.
+   */
+  template<typename F, typename ... Types>
+  Completion execute_to_arrow(F&& callback, std::size_t batch_rows,
+    const Statement& statement, Types&& ... parameters);
+
+  /**
+   * @brief Executes the non-empty statements of `statements` in order,
+   * pipelining the executions.
+   *
+   * @details The statements are sent in groups of `group` with a Sync message
+   * after each (all of them in one group if `group` is zero), so a group
+   * takes about one round trip. A statement which fails aborts the rest of its
+   * group, like in any pipeline. The position of an error in the script is
+   * `statements.query_absolute_position(index, *this)` plus the query
+   * position of the error.
+   *
+   * @param callback A function called as `callback(index, row)` for each row,
+   * where `index` is the index of the statement in `statements` which produced
+   * `row`. If it's also callable as `callback(index, completion)` and
+   * `callback(index, error)` it's called for every completion and error, and
+   * the errors are not thrown then.
+   * @param group The number of statements per Sync message.
+   *
+   * @par Requires
+   * `is_ready_for_request()` and no statement has missing parameters.
+   *
+   * @remarks Defined in statement_vector.hpp.
+   *
+   * @par Effects
+   * `is_ready_for_request()` after return, even if thrown.
+   *
+   * @par Exception safety guarantee
+   * Basic.
+   *
+   * @throws Server_exception with the first error unless the errors are
+   * passed to `callback`. The exception thrown by `callback` is rethrown
+   * once the responses are received too.
+   *
+   * @remarks Without libpq support for the pipeline the statements are just
+   * executed one by one, the ones following an error are not.
+   */
+  template<typename F>
+  void execute_pipelined(const Statement_vector& statements, F&& callback,
+    std::size_t group = 0);
+
+  /// @overload
+  void execute_pipelined(const Statement_vector& statements)
+  {
+    execute_pipelined(statements, [](std::size_t, Row&&){});
+  }
+
+  /// The thresholds at which the auto pipeline sends a Sync message.
+  struct Auto_pipeline final {
+    /// The number of requests queued since the last Sync.
+    std::size_t requests{64};
+    /// The bytes of their queries and parameters.
+    std::size_t bytes{256 * 1024};
+    /// The time since the first of them was queued, checked as one is queued.
+    std::chrono::microseconds delay{1000};
+  };
+
+  /**
+   * @brief Enables the auto pipeline with the thresholds of `options`, or
+   * disables it if `!options`.
+   *
+   * @details While enabled, the connection is in pipeline mode and a Sync
+   * message is sent by itself after the requests of execute_nio(),
+   * execute_queued(), prepare_nio(), describe_nio() and unprepare_nio() once
+   * one of the thresholds is reached. The responses are handled by the
+   * connection, in order, calling the callbacks of execute_queued(): those
+   * before the previous Sync as a Sync is sent, so that about two groups of
+   * requests are in flight, the rest by complete_queued(). Disabling the auto
+   * pipeline completes the queued requests first.
+   *
+   * @par Requires
+   * `is_ready_for_request()` to enable, `options->requests > 0`.
+   *
+   * @par Effects
+   * `!auto_pipeline()` after disconnect().
+   *
+   * @throws What complete_queued() throws on disabling, which disables
+   * the auto pipeline even so.
+   *
+   * @see complete_queued().
+   */
+  DMITIGR_PGFE_API void set_auto_pipeline(std::optional<Auto_pipeline> options);
+
+  /// @returns The thresholds of the auto pipeline if enabled.
+  DMITIGR_PGFE_API const std::optional<Auto_pipeline>& auto_pipeline() const noexcept;
+
+  /**
+   * @brief Queues the execution of `statement` into the auto pipeline.
+   *
+   * @param callback A function called as `callback(row)` for each row of
+   * the response. If it's also callable as `callback(completion)` and
+   * `callback(error)` it's called with the completion or the error too, and
+   * the error is not thrown then. A request aborted by an error of one before
+   * it in the group gets neither.
+   *
+   * @par Requires
+   * `auto_pipeline() && !statement.has_missing_parameters()`.
+   *
+   * @remarks The callback may be called before return, with the responses of
+   * the requests queued before.
+   *
+   * @see set_auto_pipeline(), complete_queued().
+   */
+  template<typename F, typename ... Types>
+  void execute_queued(F&& callback, const Statement& statement,
+    Types&& ... parameters)
+  {
+    if (!auto_pipeline_)
+      throw Client_exception{"cannot queue statement: auto pipeline is disabled"};
+    auto callbacks = queued_callbacks__(std::forward<F>(callback)); // can throw
+    Prepared_statement ps{execute_ps_state_, &statement, false};
+    const auto bytes = ps.bind_many(std::forward<Types>(parameters)...)
+      .execute_nio__(&statement);
+    requests_.back().callbacks_ = std::move(callbacks);
+    auto_queued__(bytes);
+  }
+
+  /**
+   * @brief Sends a Sync message after the requests queued into the auto
+   * pipeline since the last one and handles all the responses.
+   *
+   * @par Requires
+   * `auto_pipeline()`.
+   *
+   * @throws Server_exception with the first error not passed to a callback
+   * since the last call, even if it was received before, or the first
+   * exception thrown by a callback, whose later calls are skipped then.
+   */
+  DMITIGR_PGFE_API void complete_queued();
+
+  /**
+   * @brief Connects like connect() does, but suspends the calling coroutine
+   * instead of blocking the thread on I/O.
+   *
+   * @details It's resumed by `reactor`. There is no timeout.
+   *
+   * @par Requires
+   * `options().communication_mode()`.
+   *
+   * @see connect(), Reactor.
+   */
+  DMITIGR_PGFE_API Task<void> async_connect(Reactor& reactor);
+
+  /**
+   * @brief Waits for a response like wait_response() does without timeout,
+   * but suspends the calling coroutine instead of blocking the thread.
+   *
+   * @details Flushes the output first, if it's queued.
+   *
+   * @see wait_response(), Reactor.
+   */
+  DMITIGR_PGFE_API Task<bool> async_wait_response(Reactor& reactor);
+
+  /**
+   * @brief Processes the responses like process_responses() does, but
+   * suspends the calling coroutine instead of blocking the thread.
+   *
+   * @details If `callback` throws, the rest of the rows are discarded before
+   * the exception is rethrown.
+   *
+   * @param callback A function taking `Row&&`, which is kept by the task.
+   *
+   * @see process_responses(), Reactor.
+   */
+  template<typename F>
+  std::enable_if_t<detail::Response_callback_traits<F>::is_valid, Task<Completion>>
+  async_process_responses(Reactor& reactor, F callback)
+  {
+    using Traits = detail::Response_callback_traits<F>;
+    static_assert(!Traits::has_error_parameter,
+      "the callbacks with error parameter are not supported");
+
+    std::exception_ptr failure;
+    bool is_discarding{};
+    while (true) {
+      co_await async_wait_response(reactor);
+      if (failure)
+        (void)error();
+      else
+        throw_if_error();
+
+      if (auto r = row()) {
+        if (failure || is_discarding)
+          continue;
+        try {
+          if constexpr (!Traits::is_result_void) {
+            const auto rowpro = callback(std::move(r));
+            if (rowpro == Row_processing::complete)
+              is_discarding = true;
+            else if (rowpro == Row_processing::suspend)
+              co_return Completion{};
+          } else
+            callback(std::move(r));
+        } catch (...) {
+          failure = std::current_exception();
+        }
+      } else if (failure) {
+        (void)completion();
+        std::rethrow_exception(failure);
+      } else
+        co_return completion_or_throw(completion());
+    }
+  }
+
+  /**
+   * @brief Executes the statement like execute() does, but suspends the
+   * calling coroutine instead of blocking the thread while waiting for the
+   * responses.
+   *
+   * @details The request is sent right away, so the statement and the
+   * parameters need not outlive the call, while the task returned awaits
+   * the responses.
+   *
+   * @param callback Same as for async_process_responses().
+   *
+   * @par Requires
+   * `is_ready_for_request() && !statement.has_missing_parameters()`.
+   *
+   * @see execute(), Reactor.
+   */
+  template<typename F, typename ... Types>
+  std::enable_if_t<detail::Response_callback_traits<std::decay_t<F>>::is_valid,
+    Task<Completion>>
+  async_execute(Reactor& reactor, F&& callback, const Statement& statement,
+    Types&& ... parameters)
+  {
+    if (!is_ready_for_request())
+      throw Client_exception{"cannot execute statement: not ready for request"};
+    if (auto* const ps = cached_statement__(statement))
+      ps->bind_many(std::forward<Types>(parameters)...).execute_nio();
+    else
+      execute_nio(statement, std::forward<Types>(parameters)...);
+    return async_complete_execution__(reactor,
+      std::decay_t<F>{std::forward<F>(callback)});
+  }
+
+  /// @overload
+  template<typename ... Types>
+  Task<Completion> async_execute(Reactor& reactor, const Statement& statement,
+    Types&& ... parameters)
+  {
+    return async_execute(reactor, ignore_row, statement,
+      std::forward<Types>(parameters)...);
+  }
+
+  /**
+   * @brief Sets the capacity of the cache of statements executed by execute().
+   *
+   * @details A parameterized statement executed by execute() is remembered by
+   * its query string, and once executed again while remembered it's
+   * prepared under a generated name and executed as prepared from then on,
+   * so the server parses and plans it no more. When the cache is full, the
+   * least recently executed statement is forgotten, and unprepared if it was
+   * prepared. Executing `DISCARD ALL` or `DEALLOCATE ALL` by execute()
+   * empties the cache. Zero, the default, disables the cache.
+   *
+   * @par Exception safety guarantee
+   * Basic.
+   *
+   * @remarks Statements without parameters are never cached, as these are
+   * often utility ones, and the hot ones which take literals differ anyway.
+   *
+   * @see statement_cache_capacity().
+   */
+  DMITIGR_PGFE_API void set_statement_cache_capacity(std::size_t capacity);
+
+  /// @returns The capacity of the statement cache.
+  DMITIGR_PGFE_API std::size_t statement_cache_capacity() const noexcept;
+
+  /**
+   * @brief Sets the most bytes of results execute_batched() holds at once.
+   *
+   * @details A batch is handed to the callback early once the results it
+   * gathered reach `bytes`, and in the chunked rows mode a chunk is made of
+   * as many rows as fit into `bytes` by the size of the rows of this
+   * connection's results so far (of 8 KiB, a page, before the first). A row
+   * bigger than `bytes` by itself is still handed over, in a batch of its
+   * own. Zero, the default, leaves the batches at the size asked for.
+   *
+   * @see result_memory_limit(), set_total_result_memory_limit().
+   */
+  DMITIGR_PGFE_API void set_result_memory_limit(std::size_t bytes) noexcept;
+
+  /// @returns The result memory limit of this instance.
+  DMITIGR_PGFE_API std::size_t result_memory_limit() const noexcept;
+
+  /**
+   * @brief Sets the most bytes of results the batches of execute_batched()
+   * of all the connections of the process hold at once.
+   *
+   * @details The chunks are sized as by set_result_memory_limit() to the
+   * lesser of both limits. A result which would take the batches over
+   * `bytes` fails the execution with Client_exception, after the rest of
+   * the rows are discarded. Zero, the default, means no limit.
+   *
+   * @see total_result_memory().
+   */
+  static DMITIGR_PGFE_API void set_total_result_memory_limit(std::size_t bytes) noexcept;
+
+  /// @returns The process-wide result memory limit.
+  static DMITIGR_PGFE_API std::size_t total_result_memory_limit() noexcept;
+
+  /// @returns The bytes of results the batches of all connections hold now.
+  static DMITIGR_PGFE_API std::size_t total_result_memory() noexcept;
+
+  /**
+   * @brief Sets the statistics this instance records the executions, the rows
+   * and the `COPY` data to.
+   *
+   * @details The latencies are measured from sending an execution until its
+   * first row and its completion. The same `stats` can be set to several
+   * connections, for example, to each connection of a Connection_pool by its
+   * connect handler. Null, the default, disables the recording.
+   *
+   * @see stats(), Connection_stats.
+   */
+  DMITIGR_PGFE_API void set_stats(std::shared_ptr<Connection_stats> stats) noexcept;
+
+  /// @returns The statistics this instance records to.
+  DMITIGR_PGFE_API const std::shared_ptr<Connection_stats>& stats() const noexcept;
+
+  /**
+   * @brief Finds the metadata of the data type of `oid`, such as of
+   * Row_info::type_oid().
+   *
+   * @details The metadata is cached by this instance. A miss loads the type
+   * along with all the types its decoding involves (the element types of
+   * arrays, the base types of domains and the attribute types of composite
+   * types) by one query of the catalogs, so the types of a result are looked
+   * up by a hash of their OIDs from then on. The cache is emptied when the
+   * session ends, since the types of another one may differ.
+   *
+   * @returns The metadata, or `nullptr` if there is no type of `oid`. The
+   * pointer is valid until the session ends.
+   *
+   * @par Requires
+   * `is_ready_for_request()` unless the type is cached.
+   *
+   * @par Exception safety guarantee
+   * Strong.
+   *
+   * @see load_type_info().
+   */
+  DMITIGR_PGFE_API const Type_info* type_info(std::uint_fast32_t oid);
+
+  /**
+   * @brief Loads the metadata of the data types of `oids` which are not
+   * cached yet, by one query of the catalogs.
+   *
+   * @details Such as for all the fields of a Row_info at once.
+   *
+   * @par Requires
+   * `is_ready_for_request()` unless all the types are cached.
+   *
+   * @see type_info().
+   */
+  DMITIGR_PGFE_API void load_type_info(std::span<const std::uint_fast32_t> oids);
+
   /**
    * @brief Requests the server to invoke the specified function and waits for
    * a response.
@@ -903,6 +1491,12 @@ public:
    * number of parameters. A SQL query with explicit type casts should be
    * executed is such a case. See remarks of prepare_nio().
    *
+   * @remarks The statement of an invocation is prepared on the first one with
+   * the same routine and arguments, positional or named alike, and executed
+   * as prepared on the following ones, by invoke(), invoke_unexpanded() and
+   * call() alike. The statements live as long as the session, or until
+   * `DISCARD ALL` or `DEALLOCATE ALL` executed by execute().
+   *
    * @see invoke_unexpanded(), call(), execute().
    */
   template<Row_processing on_exception = Row_processing::complete, typename F,
@@ -912,10 +1506,9 @@ public:
   {
     static_assert(is_routine_arguments_ok__<Types...>(),
       "named arguments cannot precede positional arguments");
-    const auto stmt = routine_query__(function,
-      "SELECT * FROM", std::forward<Types>(arguments)...);
-    return execute<on_exception>(std::forward<F>(callback),
-      stmt, std::forward<Types>(arguments)...);
+    return routine_statement__(function, "SELECT * FROM", arguments...)
+      .template execute<on_exception>(std::forward<F>(callback),
+        std::forward<Types>(arguments)...);
   }
 
   /// @overload
@@ -948,10 +1541,9 @@ public:
   {
     static_assert(is_routine_arguments_ok__<Types...>(),
       "named arguments cannot precede positional arguments");
-    const auto stmt = routine_query__(function,
-      "SELECT", std::forward<Types>(arguments)...);
-    return execute<on_exception>(std::forward<F>(callback),
-      stmt, std::forward<Types>(arguments)...);
+    return routine_statement__(function, "SELECT", arguments...)
+      .template execute<on_exception>(std::forward<F>(callback),
+        std::forward<Types>(arguments)...);
   }
 
   /// @overload
@@ -983,10 +1575,9 @@ public:
   {
     static_assert(is_routine_arguments_ok__<Types...>(),
       "named arguments cannot precede positional arguments");
-    const auto stmt = routine_query__(procedure,
-      "CALL", std::forward<Types>(arguments)...);
-    return execute<on_exception>(std::forward<F>(callback),
-      stmt, std::forward<Types>(arguments)...);
+    return routine_statement__(procedure, "CALL", arguments...)
+      .template execute<on_exception>(std::forward<F>(callback),
+        std::forward<Types>(arguments)...);
   }
 
   /// @overload
@@ -1198,6 +1789,83 @@ public:
   DMITIGR_PGFE_API std::string
   to_quoted_identifier(const std::string_view identifier) const;
 
+  /**
+   * @brief Appends the result of `to_quoted_literal(literal)` to `result`.
+   *
+   * @details If the client encoding is UTF-8 the literal is quoted by pgfe
+   * itself, right into `result`. Like the quoting of libpq, it uses the form
+   * `E'...'` if the literal contains backslashes, which reads the same
+   * regardless of `standard_conforming_strings`. Otherwise, the libpq is
+   * asked to quote the literal.
+   *
+   * @par Requires
+   * `is_connected()`.
+   *
+   * @throws Client_exception if the client encoding is UTF-8 and `literal`
+   * isn't well-formed UTF-8.
+   */
+  DMITIGR_PGFE_API void append_quoted_literal(std::string& result,
+    std::string_view literal) const;
+
+  /**
+   * @brief Appends the result of `to_quoted_identifier(identifier)` to
+   * `result`, like append_quoted_literal() does.
+   *
+   * @par Requires
+   * `is_connected()`.
+   */
+  DMITIGR_PGFE_API void append_quoted_identifier(std::string& result,
+    std::string_view identifier) const;
+
+  /**
+   * @brief Appends the quoted `literals` separated by `delimiter` to
+   * `result`.
+   *
+   * @param literals A range of the values convertible to `std::string_view`.
+   *
+   * @par Requires
+   * `is_connected()`.
+   *
+   * @see append_quoted_literal().
+   */
+  template<class Range>
+  void append_quoted_literals(std::string& result, const Range& literals,
+    const std::string_view delimiter = ", ") const
+  {
+    bool is_first{true};
+    for (const auto& literal : literals) {
+      if (!is_first)
+        result.append(delimiter);
+      append_quoted_literal(result, literal);
+      is_first = false;
+    }
+  }
+
+  /**
+   * @brief Appends the quoted `identifiers` separated by `delimiter` to
+   * `result`.
+   *
+   * @param identifiers A range of the values convertible to
+   * `std::string_view`.
+   *
+   * @par Requires
+   * `is_connected()`.
+   *
+   * @see append_quoted_identifier().
+   */
+  template<class Range>
+  void append_quoted_identifiers(std::string& result, const Range& identifiers,
+    const std::string_view delimiter = ", ") const
+  {
+    bool is_first{true};
+    for (const auto& identifier : identifiers) {
+      if (!is_first)
+        result.append(delimiter);
+      append_quoted_identifier(result, identifier);
+      is_first = false;
+    }
+  }
+
   /**
    * @brief Encodes the binary data into the textual representation to be used
    * in a SQL query.
@@ -1217,6 +1885,10 @@ public:
    * character encoding). Therefore using it in queries which are submitted
    * by using connections with other session properties is not correct.
    *
+   * @remarks The data is encoded by pgfe itself (with SIMD where available)
+   * rather than by `PQescapeByteaConn()`. To avoid the encoding at all, pass
+   * the data as a parameter in the binary format.
+   *
    * @see Prepared_statement.
    */
   DMITIGR_PGFE_API std::unique_ptr<Data> to_hex_data(const Data& data) const;
@@ -1254,6 +1926,7 @@ private:
   std::unique_ptr<PGconn> conn_;
   std::optional<Status> polling_status_;
   std::int_fast64_t lo_id_{};
+  std::string query_buffer_; // reused by statements rendered to send
 
   PGconn* conn() const noexcept
   {
@@ -1264,6 +1937,13 @@ private:
   // Session data / requests
   // ---------------------------------------------------------------------------
 
+  /// The callbacks of a queued execution.
+  struct Request_callbacks final {
+    std::function<void(Row&&)> row;
+    std::function<void(Completion&&)> completion; // set with error
+    std::function<void(Error&&)> error;
+  };
+
   /// A request.
   struct Request final {
     enum class Id {
@@ -1286,6 +1966,9 @@ private:
     Id id_{};
     Prepared_statement prepared_statement_;
     std::optional<std::string> prepared_statement_name_;
+    std::chrono::steady_clock::time_point start_time_{}; // if stats_ is set
+    bool is_first_row_received_{};
+    Request_callbacks callbacks_; // of execute_queued()
   };
 
   std::optional<std::chrono::system_clock::time_point> session_start_time_;
@@ -1296,11 +1979,140 @@ private:
   bool is_output_flushed_{true};
   std::shared_ptr<Connection*> copier_state_;
   bool is_single_row_mode_enabled_{};
+  int row_chunk_size_{}; // of the next execution, 0 for single-row mode
+  std::size_t result_memory_limit_{};
+  std::size_t row_memory_{}; // of the rows of the results so far, 0 before the first
+  std::optional<Auto_pipeline> auto_pipeline_;
+  // The requests queued into the auto pipeline since the last Sync.
+  struct Auto_pipeline_state final {
+    std::size_t requests{};
+    std::size_t bytes{};
+    std::chrono::steady_clock::time_point start;
+    std::size_t syncs{}; // sent, not yet responded
+    std::exception_ptr failure; // to throw from complete_queued()
+  } auto_pipeline_state_;
+  std::shared_ptr<Connection_stats> stats_;
 
   std::list<std::shared_ptr<Prepared_statement::State>> ps_states_;
   std::list<std::shared_ptr<Large_object::State>> lo_states_;
+  // The named statements of the session, whether or not still referenced.
+  std::unordered_set<std::string> server_ps_names_;
+  Session_changes session_changes_;
+
+  // The statement cache, most recently executed first. (Destroyed before
+  // ps_states_ as the prepared statements unregister from it.)
+  struct Cached_statement final {
+    std::string query;
+    Prepared_statement statement; // invalid until executed again
+  };
+  std::size_t statement_cache_capacity_{};
+  std::int_fast64_t statement_cache_id_{};
+  std::list<Cached_statement> statement_cache_;
+  std::unordered_map<std::string_view,
+    decltype(statement_cache_)::iterator> statement_cache_index_;
+
+  // The statements of the routine invocations by routine_key_. (Destroyed
+  // before ps_states_ too.)
+  std::map<std::string, Prepared_statement, std::less<>> routine_statements_;
+  std::string routine_key_; // of the last invocation, reused
+  std::int_fast64_t routine_statement_id_{};
+
+  // The metadata of the data types, and the OIDs known to be of no type.
+  std::unordered_map<std::uint_fast32_t, Type_info> type_cache_;
+  std::unordered_set<std::uint_fast32_t> unknown_types_;
+
+  /**
+   * @brief The queue of requests: a ring of slots which grows by doubling and
+   * never shrinks, not even when cleared, so that queueing a request doesn't
+   * allocate once the ring has grown to the depth of the pipeline. The slots
+   * are reused, so the requests are pooled.
+   */
+  class Request_ring final {
+  public:
+    bool empty() const noexcept
+    {
+      return !size_;
+    }
+
+    std::size_t size() const noexcept
+    {
+      return size_;
+    }
+
+    Request& front() noexcept
+    {
+      return slots_[head_];
+    }
+
+    const Request& front() const noexcept
+    {
+      return slots_[head_];
+    }
+
+    Request& back() noexcept
+    {
+      return slots_[(head_ + size_ - 1) & mask()];
+    }
+
+    const Request& back() const noexcept
+    {
+      return slots_[(head_ + size_ - 1) & mask()];
+    }
+
+    template<typename ... Types>
+    Request& emplace(Types&& ... args)
+    {
+      if (size_ == slots_.size())
+        grow(size_ + 1); // can throw
+      Request& result = slots_[(head_ + size_) & mask()];
+      result = Request{std::forward<Types>(args)...};
+      ++size_;
+      return result;
+    }
+
+    void pop() noexcept
+    {
+      slots_[head_] = Request{};
+      head_ = (head_ + 1) & mask();
+      --size_;
+    }
 
-  std::queue<Request> requests_;
+    void clear() noexcept
+    {
+      while (!empty())
+        pop();
+      head_ = 0;
+    }
+
+    /// Makes room for `capacity` requests at least.
+    void reserve(const std::size_t capacity)
+    {
+      if (capacity > slots_.size())
+        grow(capacity); // can throw
+    }
+
+  private:
+    std::vector<Request> slots_; // the size is 0 or a power of 2
+    std::size_t head_{};
+    std::size_t size_{};
+
+    std::size_t mask() const noexcept
+    {
+      return slots_.size() - 1;
+    }
+
+    void grow(const std::size_t capacity)
+    {
+      std::vector<Request> slots(std::bit_ceil(std::max<std::size_t>(
+            {8, capacity, 2 * slots_.size()})));
+      for (std::size_t i{}; i < size_; ++i)
+        slots[i] = std::move(slots_[(head_ + i) & mask()]);
+      slots_.swap(slots);
+      head_ = 0;
+    }
+  };
+
+  Request_ring requests_;
   Request last_processed_request_;
 
   bool is_invariant_ok() const noexcept;
@@ -1341,6 +2153,46 @@ private:
   void reset_copier_state() noexcept;
   void set_single_row_mode_enabled() noexcept;
 
+  /// @returns `true` if the rows of the response are moved to `batch`.
+  bool take_rows__(Row_batch& batch);
+
+  /**
+   * @returns `true` if the row of the response is moved to `row`, freeing
+   * the one it held.
+   */
+  bool take_row__(Row& row) noexcept;
+
+  /// Waits for the rest of the responses to the execution being processed.
+  void discard_rows__() noexcept;
+
+  /// The bytes of results of a batch, counted in total_result_memory().
+  class Result_memory_hold final {
+  public:
+    Result_memory_hold() = default;
+    Result_memory_hold(const Result_memory_hold&) = delete;
+    Result_memory_hold& operator=(const Result_memory_hold&) = delete;
+    ~Result_memory_hold() { release(); }
+
+    std::size_t bytes() const noexcept
+    {
+      return bytes_;
+    }
+
+    /// @throws Client_exception if over total_result_memory_limit().
+    void add(std::size_t bytes);
+    void release() noexcept;
+
+  private:
+    std::size_t bytes_{};
+  };
+
+  /// @returns The bytes of response_, or `0` if there's none.
+  std::size_t response_memory__() const noexcept;
+  /// Learns the size of the rows from a result of `bytes` of `rows` rows.
+  void note_row_memory__(std::size_t bytes, std::size_t rows) noexcept;
+  /// @returns The chunk size of `chunk_rows` rows cut to the limits.
+  int chunk_rows_under_limit__(std::size_t chunk_rows) const noexcept;
+
   // ---------------------------------------------------------------------------
   // Handlers
   // ---------------------------------------------------------------------------
@@ -1376,6 +2228,82 @@ private:
     return registered(ps_states_, name);
   }
   void register_ps(Prepared_statement&& ps);
+
+  /// @returns The cached prepared statement to execute, or `nullptr`.
+  Prepared_statement* cached_statement__(const Statement& statement);
+
+  /// Empties the statement cache if `completion` says the server did.
+  void check_statement_cache__(const Completion& completion) noexcept;
+
+  /**
+   * @returns The key of the descriptions of the statements prepared from
+   * `query` in the process-wide cache, or empty string if they mustn't be
+   * cached.
+   */
+  std::string description_key__(std::string_view query) const;
+
+  /// Adds to session_changes_ what `query` may change.
+  void note_session_changes__(std::string_view query) noexcept;
+
+  /// Forgets the least recently executed statement.
+  void evict_cached_statement__();
+
+  /// @returns The callbacks of execute_queued() calling `callback`.
+  template<typename F>
+  static Request_callbacks queued_callbacks__(F&& callback)
+  {
+    static_assert(std::is_invocable_v<F, Row&&>,
+      "callback must be callable as callback(Row&&)");
+    constexpr bool is_error_handled = std::is_invocable_v<F, Error&&>;
+    constexpr bool is_completion_handled = std::is_invocable_v<F, Completion&&>;
+    static_assert(is_error_handled == is_completion_handled,
+      "callback must handle either both completions and errors or none");
+
+    const auto f = std::make_shared<std::decay_t<F>>(std::forward<F>(callback));
+    Request_callbacks result;
+    result.row = [f](Row&& r){(*f)(std::move(r));};
+    if constexpr (is_error_handled) {
+      result.completion = [f](Completion&& c){(*f)(std::move(c));};
+      result.error = [f](Error&& e){(*f)(std::move(e));};
+    }
+    return result;
+  }
+
+  /**
+   * @brief Counts a request of `bytes` toward the thresholds of the auto
+   * pipeline, sending a Sync once one is reached.
+   */
+  void auto_queued__(std::size_t bytes);
+
+  /// Handles a response of the auto pipeline. @returns `false` if none.
+  bool handle_queued__();
+
+  /// @returns The completion of the execution sent by async_execute().
+  template<typename F>
+  Task<Completion> async_complete_execution__(Reactor& reactor, F callback)
+  {
+    auto result = co_await async_process_responses(reactor, std::move(callback));
+    check_statement_cache__(result);
+    co_return result;
+  }
+
+  /// @returns The row callback collecting `batch` of rows for `callback`.
+  template<typename F>
+  static auto batcher__(std::vector<Row>& batch, F& callback,
+    const std::size_t batch_size)
+  {
+    if (!batch_size)
+      throw Client_exception{"cannot process rows: invalid batch size"};
+    batch.reserve(batch_size);
+    return [&batch, &callback, batch_size](Row&& row)
+    {
+      batch.push_back(std::move(row));
+      if (batch.size() == batch_size) {
+        callback(std::span<Row>{batch});
+        batch.clear();
+      }
+    };
+  }
   void unregister_ps(std::string_view name) noexcept;
   void unregister_ps(decltype(ps_states_)::const_iterator p) noexcept;
 
@@ -1384,13 +2312,16 @@ private:
   // ---------------------------------------------------------------------------
 
   int socket() const noexcept;
+  void set_socket_options();
   void throw_if_error();
   static Completion&& completion_or_throw(Completion&& comp);
   std::string error_message() const;
   bool is_out_of_memory() const noexcept;
 
-  std::pair<std::unique_ptr<void, void(*)(void*)>, std::size_t>
-  to_hex_storage(const pgfe::Data& data) const;
+  std::string_view hex_prefix(const pgfe::Data& data) const;
+  bool is_utf8_client_encoding() const noexcept;
+  void append_quoted(std::string& result, std::string_view value,
+    bool is_identifier) const;
 
   // ---------------------------------------------------------------------------
   // Large Object private API
@@ -1440,6 +2371,39 @@ private:
     return result;
   }
 
+  /// @returns The prepared statement of the invocation.
+  template<typename ... Types>
+  Prepared_statement& routine_statement__(const std::string_view function,
+    const std::string_view invocation, const Types& ... arguments)
+  {
+    // The kind, the routine and the name of each argument, or none.
+    routine_key_.assign(invocation).append(1, '\0').append(function);
+    (routine_key_argument__(arguments), ...);
+    if (const auto i = routine_statements_.find(routine_key_);
+        i != routine_statements_.end() && i->second) {
+      i->second.set_result_format(result_format());
+      return i->second;
+    }
+
+    const Statement statement{routine_query__(function, invocation,
+      arguments...)};
+    auto ps = prepare(statement, "pgfe_routine_" +
+      std::to_string(++routine_statement_id_)); // can throw
+    return routine_statements_.insert_or_assign(routine_key_,
+      std::move(ps)).first->second;
+  }
+
+  template<typename T>
+  void routine_key_argument__(const T&)
+  {
+    routine_key_.append(1, '\0');
+  }
+
+  void routine_key_argument__(const Named_argument& na)
+  {
+    routine_key_.append(1, '\0').append(na.name());
+  }
+
   template<std::size_t ... I, typename ... Types>
   std::string routine_arguments__(std::index_sequence<I...>, Types&& ... arguments)
   {
@@ -1497,6 +2461,80 @@ Prepared_statement::execute(F&& callback, Types&& ... parameters)
     connection().process_responses<on_exception>(std::forward<F>(callback)));
 }
 
+template<typename R, typename F>
+void Prepared_statement::execute_batch(const R& parameters, F&& callback,
+  const std::size_t window)
+{
+  if (!is_valid() || !connection().is_ready_for_request() || !window)
+    throw_exception("cannot execute batch");
+
+  auto& conn = connection();
+  std::size_t index{}; // of the first execution without response
+#ifdef LIBPQ_HAS_PIPELINING
+  conn.requests_.reserve(window + 1); // with the Sync
+  std::exception_ptr failure;
+  Error error;
+  std::size_t queued{};
+  const auto drain = [&]
+  {
+    conn.send_sync();
+    queued = 0;
+    while (conn.wait_response()) {
+      if (auto e = conn.error()) {
+        if (!error)
+          error = std::move(e);
+        ++index;
+      } else if (auto r = conn.row()) {
+        if (!failure && !error) {
+          try {
+            callback(index, std::move(r));
+          } catch (...) {
+            failure = std::current_exception();
+          }
+        }
+      } else if (!conn.ready_for_query().is_valid()) {
+        (void)conn.completion(); // or aborted
+        ++index;
+      }
+    }
+  };
+
+  conn.set_pipeline_enabled(true);
+  try {
+    for (const auto& p : parameters) {
+      if (failure)
+        break;
+      std::apply([this](const auto& ... values){ bind_many(values...); }, p);
+      execute_nio();
+      if (++queued == window)
+        drain();
+    }
+    if (queued)
+      drain();
+  } catch (...) {
+    if (!failure)
+      failure = std::current_exception();
+    try {
+      if (queued)
+        drain();
+    } catch (...) {}
+  }
+  conn.set_pipeline_enabled(false);
+
+  if (failure)
+    std::rethrow_exception(failure);
+  else if (error)
+    throw Server_exception{std::make_shared<Error>(std::move(error))};
+#else
+  (void)window;
+  for (const auto& p : parameters) {
+    std::apply([this](const auto& ... values){ bind_many(values...); }, p);
+    execute([&callback, index](Row&& row){ callback(index, std::move(row)); });
+    ++index;
+  }
+#endif
+}
+
 /**
  * @ingroup main
  *
@@ -85,6 +85,9 @@ Connection_options::swap(Connection_options& rhs) noexcept
   swap(tcp_keepalives_interval_, rhs.tcp_keepalives_interval_);
   swap(tcp_keepalives_count_, rhs.tcp_keepalives_count_);
   swap(tcp_user_timeout_, rhs.tcp_user_timeout_);
+  swap(tcp_receive_buffer_size_, rhs.tcp_receive_buffer_size_);
+  swap(tcp_send_buffer_size_, rhs.tcp_send_buffer_size_);
+  swap(tcp_nodelay_enabled_, rhs.tcp_nodelay_enabled_);
   swap(address_, rhs.address_);
   swap(hostname_, rhs.hostname_);
   swap(port_, rhs.port_);
@@ -97,6 +100,7 @@ Connection_options::swap(Connection_options& rhs) noexcept
   swap(is_ssl_enabled_, rhs.is_ssl_enabled_);
   swap(ssl_min_protocol_version_, rhs.ssl_min_protocol_version_);
   swap(ssl_max_protocol_version_, rhs.ssl_max_protocol_version_);
+  swap(ssl_negotiation_, rhs.ssl_negotiation_);
   swap(ssl_compression_enabled_, rhs.ssl_compression_enabled_);
   swap(ssl_certificate_file_, rhs.ssl_certificate_file_);
   swap(ssl_private_key_file_, rhs.ssl_private_key_file_);
@@ -318,6 +322,49 @@ Connection_options::tcp_user_timeout() const noexcept
   return tcp_user_timeout_;
 }
 
+DMITIGR_PGFE_INLINE Connection_options&
+Connection_options::set_tcp_receive_buffer_size(const std::optional<int> value)
+{
+  if (value)
+    validate(*value > 0, "TCP receive buffer size");
+  tcp_receive_buffer_size_ = value;
+  return *this;
+}
+
+DMITIGR_PGFE_INLINE std::optional<int>
+Connection_options::tcp_receive_buffer_size() const noexcept
+{
+  return tcp_receive_buffer_size_;
+}
+
+DMITIGR_PGFE_INLINE Connection_options&
+Connection_options::set_tcp_send_buffer_size(const std::optional<int> value)
+{
+  if (value)
+    validate(*value > 0, "TCP send buffer size");
+  tcp_send_buffer_size_ = value;
+  return *this;
+}
+
+DMITIGR_PGFE_INLINE std::optional<int>
+Connection_options::tcp_send_buffer_size() const noexcept
+{
+  return tcp_send_buffer_size_;
+}
+
+DMITIGR_PGFE_INLINE Connection_options&
+Connection_options::set_tcp_nodelay_enabled(const std::optional<bool> value)
+{
+  tcp_nodelay_enabled_ = value;
+  return *this;
+}
+
+DMITIGR_PGFE_INLINE std::optional<bool>
+Connection_options::is_tcp_nodelay_enabled() const noexcept
+{
+  return tcp_nodelay_enabled_;
+}
+
 DMITIGR_PGFE_INLINE Connection_options&
 Connection_options::set_address(std::optional<std::string> value)
 {
@@ -616,6 +663,25 @@ Connection_options::is_ssl_server_name_indication_enabled() const noexcept
   return ssl_server_name_indication_enabled_;
 }
 
+DMITIGR_PGFE_INLINE Connection_options&
+Connection_options::set_ssl_negotiation(const std::optional<Ssl_negotiation> value)
+{
+  ssl_negotiation_ = value;
+  return *this;
+}
+
+DMITIGR_PGFE_INLINE Connection_options&
+Connection_options::set(const std::optional<Ssl_negotiation> value)
+{
+  return set_ssl_negotiation(value);
+}
+
+DMITIGR_PGFE_INLINE std::optional<Ssl_negotiation>
+Connection_options::ssl_negotiation() const noexcept
+{
+  return ssl_negotiation_;
+}
+
 // =============================================================================
 
 DMITIGR_PGFE_INLINE bool
@@ -624,6 +690,7 @@ operator==(const Connection_options& lhs, const Connection_options& rhs) noexcep
   return
     // booleans
     lhs.tcp_keepalives_enabled_ == rhs.tcp_keepalives_enabled_ &&
+    lhs.tcp_nodelay_enabled_ == rhs.tcp_nodelay_enabled_ &&
     lhs.is_ssl_enabled_ == rhs.is_ssl_enabled_ &&
     lhs.ssl_compression_enabled_ == rhs.ssl_compression_enabled_ &&
     lhs.ssl_server_hostname_verification_enabled_ ==
@@ -640,9 +707,12 @@ operator==(const Connection_options& lhs, const Connection_options& rhs) noexcep
     lhs.tcp_keepalives_interval_ == rhs.tcp_keepalives_interval_ &&
     lhs.tcp_keepalives_count_ == rhs.tcp_keepalives_count_ &&
     lhs.tcp_user_timeout_ == rhs.tcp_user_timeout_ &&
+    lhs.tcp_receive_buffer_size_ == rhs.tcp_receive_buffer_size_ &&
+    lhs.tcp_send_buffer_size_ == rhs.tcp_send_buffer_size_ &&
     lhs.port_ == rhs.port_ &&
     lhs.ssl_min_protocol_version_ == rhs.ssl_min_protocol_version_ &&
     lhs.ssl_max_protocol_version_ == rhs.ssl_max_protocol_version_ &&
+    lhs.ssl_negotiation_ == rhs.ssl_negotiation_ &&
     // strings
     lhs.service_name_ == rhs.service_name_ &&
     lhs.uds_directory_ == rhs.uds_directory_ &&
@@ -709,9 +779,12 @@ public:
       }
     }
 
-    if (const auto& v = o.session_mode())
-      values_[target_session_attrs] = to_literal(*v);
-    else
+    // libpq spells the session modes with hyphens.
+    if (const auto& v = o.session_mode()) {
+      std::string attrs{to_literal(*v)};
+      std::replace(attrs.begin(), attrs.end(), '_', '-');
+      values_[target_session_attrs] = std::move(attrs);
+    } else
       values_[target_session_attrs] = to_literal(Session_mode::any);
 
     if (const auto& v = o.database())
@@ -766,6 +839,9 @@ public:
         values_[sslcrl] = v->generic_string();
       if (const auto v = o.is_ssl_server_name_indication_enabled())
         values_[sslsni] = std::to_string(*v);
+      // Left empty unless set, so that libpq before 17 doesn't see it.
+      if (const auto v = o.ssl_negotiation())
+        values_[sslnegotiation] = to_literal(*v);
     }
 
     // -------------------------------------------------------------------------
@@ -778,7 +854,6 @@ public:
     values_[options] = "";
     values_[application_name] = "";
     values_[fallback_application_name] = "";
-    values_[target_session_attrs] = "any";
 
     update_cache();
   }
@@ -871,7 +946,8 @@ private:
     tcp_user_timeout,
 
     sslmode, sslcompression, sslcert, sslkey, sslpassword, sslrootcert, sslcrl,
-    sslsni, requirepeer, ssl_min_protocol_version, ssl_max_protocol_version,
+    sslsni, sslnegotiation, requirepeer, ssl_min_protocol_version,
+    ssl_max_protocol_version,
 
     target_session_attrs,
     service,
@@ -910,6 +986,7 @@ private:
     case sslrootcert: return "sslrootcert";
     case sslcrl: return "sslcrl";
     case sslsni: return "sslsni";
+    case sslnegotiation: return "sslnegotiation";
     case requirepeer: return "requirepeer";
     case ssl_min_protocol_version: return "ssl_min_protocol_version";
     case ssl_max_protocol_version: return "ssl_max_protocol_version";
@@ -951,6 +1028,17 @@ private:
     DMITIGR_ASSERT(false);
   }
 
+  /// @returns The value literal for libpq.
+  static const char* to_literal(const Ssl_negotiation value) noexcept
+  {
+    using Sn = Ssl_negotiation;
+    switch (value) {
+    case Sn::postgres: return "postgres";
+    case Sn::direct: return "direct";
+    }
+    DMITIGR_ASSERT(false);
+  }
+
   /// @returns The value literal for libpq.
   static const char* to_literal(const Session_mode value) noexcept
   {
@@ -300,6 +300,60 @@ public:
 
   // ---------------------------------------------------------------------------
 
+  /**
+   * @brief Sets the size of the receive buffer of the socket (`SO_RCVBUF`).
+   *
+   * @par Requires
+   * `!value || (*value > 0)`.
+   *
+   * @remarks Unlike the options above, which are passed to libpq, this one
+   * is set on the socket once the connection is established. Since the TCP
+   * window scale is negotiated on connect, the window can grow beyond 64 KiB
+   * only up to the scale chosen from the system defaults.
+   */
+  DMITIGR_PGFE_API Connection_options&
+  set_tcp_receive_buffer_size(std::optional<int> value);
+
+  /// @returns The current value of the option.
+  DMITIGR_PGFE_API std::optional<int>
+  tcp_receive_buffer_size() const noexcept;
+
+  // ---------------------------------------------------------------------------
+
+  /**
+   * @brief Sets the size of the send buffer of the socket (`SO_SNDBUF`).
+   *
+   * @par Requires
+   * `!value || (*value > 0)`.
+   *
+   * @remarks The option is set on the socket once the connection is
+   * established.
+   */
+  DMITIGR_PGFE_API Connection_options&
+  set_tcp_send_buffer_size(std::optional<int> value);
+
+  /// @returns The current value of the option.
+  DMITIGR_PGFE_API std::optional<int>
+  tcp_send_buffer_size() const noexcept;
+
+  // ---------------------------------------------------------------------------
+
+  /**
+   * @brief Sets the mode of sending the small segments without delay, i.e.
+   * disables the Nagle's algorithm (`TCP_NODELAY`).
+   *
+   * @remarks The option is set on the socket once the connection is
+   * established.
+   */
+  DMITIGR_PGFE_API Connection_options&
+  set_tcp_nodelay_enabled(std::optional<bool> value);
+
+  /// @returns The current value of the option.
+  DMITIGR_PGFE_API std::optional<bool>
+  is_tcp_nodelay_enabled() const noexcept;
+
+  // ---------------------------------------------------------------------------
+
   /**
    * @brief Sets the numeric IP address of a PostgreSQL server
    * to avoid hostname lookup.
@@ -635,6 +689,28 @@ public:
   DMITIGR_PGFE_API std::optional<bool>
   is_ssl_server_name_indication_enabled() const noexcept;
 
+  // ---------------------------------------------------------------------------
+
+  /**
+   * @brief Sets the SSL negotiation.
+   *
+   * @details Ssl_negotiation::direct starts the handshake without asking the
+   * server first, saving a round trip per connection. It needs libpq and a
+   * server of PostgreSQL 17+, and the ALPN support of the server's OpenSSL.
+   *
+   * @remarks Ssl_negotiation::postgres is used by default.
+   */
+  DMITIGR_PGFE_API Connection_options&
+  set_ssl_negotiation(std::optional<Ssl_negotiation> value);
+
+  /// Shortcut of set_ssl_negotiation().
+  DMITIGR_PGFE_API Connection_options&
+  set(std::optional<Ssl_negotiation> value);
+
+  /// @returns The current value of the option.
+  DMITIGR_PGFE_API std::optional<Ssl_negotiation>
+  ssl_negotiation() const noexcept;
+
   /// @}
 
 private:
@@ -653,6 +729,9 @@ private:
   std::optional<std::chrono::seconds> tcp_keepalives_interval_;
   std::optional<int> tcp_keepalives_count_;
   std::optional<std::chrono::milliseconds> tcp_user_timeout_;
+  std::optional<int> tcp_receive_buffer_size_;
+  std::optional<int> tcp_send_buffer_size_;
+  std::optional<bool> tcp_nodelay_enabled_;
   std::optional<std::string> address_;
   std::optional<std::string> hostname_;
   std::optional<std::int_fast32_t> port_{5432};
@@ -665,6 +744,7 @@ private:
   std::optional<bool> is_ssl_enabled_;
   std::optional<Ssl_protocol_version> ssl_min_protocol_version_;
   std::optional<Ssl_protocol_version> ssl_max_protocol_version_;
+  std::optional<Ssl_negotiation> ssl_negotiation_;
   std::optional<bool> ssl_compression_enabled_;
   std::optional<std::filesystem::path> ssl_certificate_file_;
   std::optional<std::filesystem::path> ssl_private_key_file_;
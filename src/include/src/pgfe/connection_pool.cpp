@@ -16,9 +16,11 @@
 
 #include "../base/assert.hpp"
 #include "connection_pool.hpp"
+#include "statement_vector.hpp"
 
 #include <algorithm>
 #include <cassert>
+#include <exception>
 #include <iostream>
 
 namespace dmitigr::pgfe {
@@ -78,6 +80,17 @@ DMITIGR_PGFE_INLINE void Connection_pool::Handle::release() noexcept
     p->release(*this);
 }
 
+DMITIGR_PGFE_INLINE Prepared_statement&
+Connection_pool::Handle::prepared_statement(const std::string& name)
+{
+  if (!is_valid())
+    throw Client_exception{"invalid connection pool handle"};
+  if (auto* const p = pool())
+    return p->prepared(*connection_, state_index_, name);
+  throw Client_exception{"cannot get prepared statement of connection "
+    "outlived its pool"};
+}
+
 DMITIGR_PGFE_INLINE Connection_pool::Handle::Handle(
   std::shared_ptr<Connection_pool*> pool,
   std::unique_ptr<Connection>&& connection,
@@ -86,10 +99,50 @@ DMITIGR_PGFE_INLINE Connection_pool::Handle::Handle(
   , connection_{std::move(connection)}
   , state_index_{state_index}
 {
-  // Attention! pool_->mutex_ is locked here!
+  // Attention! The slot of state_index is taken by this thread here!
   DMITIGR_ASSERT(pool_ && *pool_);
   DMITIGR_ASSERT(connection_);
   DMITIGR_ASSERT(state_index_ < (*pool_)->states_.size());
+  (*pool_)->busy_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// -----------------------------------------------------------------------------
+// Connection_pool::Free_list
+// -----------------------------------------------------------------------------
+
+DMITIGR_PGFE_INLINE void Connection_pool::Free_list::reset(const std::size_t size)
+{
+  next_ = std::make_unique<std::atomic<std::uint32_t>[]>(size);
+  head_.store(0, std::memory_order_relaxed);
+  for (std::size_t i = size; i > 0; --i)
+    push(i - 1);
+}
+
+DMITIGR_PGFE_INLINE void Connection_pool::Free_list::push(const std::size_t index) noexcept
+{
+  auto head = head_.load(std::memory_order_relaxed);
+  std::uint64_t next;
+  do {
+    next_[index].store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+    next = ((head >> 32) + 1) << 32 | (index + 1);
+  } while (!head_.compare_exchange_weak(head, next,
+      std::memory_order_release, std::memory_order_relaxed));
+}
+
+DMITIGR_PGFE_INLINE std::optional<std::size_t>
+Connection_pool::Free_list::pop() noexcept
+{
+  auto head = head_.load(std::memory_order_acquire);
+  while (true) {
+    const auto top = static_cast<std::uint32_t>(head);
+    if (!top)
+      return std::nullopt;
+    const std::uint64_t next = ((head >> 32) + 1) << 32 |
+      next_[top - 1].load(std::memory_order_relaxed);
+    if (head_.compare_exchange_weak(head, next,
+        std::memory_order_acquire, std::memory_order_acquire))
+      return top - 1;
+  }
 }
 
 // -----------------------------------------------------------------------------
@@ -98,6 +151,7 @@ DMITIGR_PGFE_INLINE Connection_pool::Handle::Handle(
 
 DMITIGR_PGFE_INLINE Connection_pool::~Connection_pool() noexcept
 {
+  stop_maintenance();
   for (auto& state : states_) {
     DMITIGR_ASSERT(state.second);
     *state.second = nullptr;
@@ -106,15 +160,67 @@ DMITIGR_PGFE_INLINE Connection_pool::~Connection_pool() noexcept
 
 DMITIGR_PGFE_INLINE Connection_pool::Connection_pool(std::size_t count,
   const Connection_options& options)
-  : release_handler_{[](Connection& conn)
+  : release_handler_{[this](Connection& conn)
   {
     conn.process_responses([](auto&&){});
-    conn.execute("DISCARD ALL");
+    reset_session(conn);
   }}
 {
   const auto self = std::make_shared<Connection_pool*>(this);
   for (; count > 0; --count)
     states_.emplace_back(std::make_unique<Connection>(options), self);
+  prepared_.resize(states_.size());
+  free_.reset(states_.size());
+}
+
+DMITIGR_PGFE_INLINE void Connection_pool::reset_session(Connection& conn)
+{
+  if (conn.is_transaction_uncommitted())
+    conn.execute("ROLLBACK");
+
+  // The statements prepared by prepare() but neither registered nor cached.
+  {
+    std::vector<std::string> names = conn.server_prepared_statements();
+    {
+      const std::lock_guard lg{statements_mutex_};
+      std::erase_if(names, [this](const std::string& name)
+      {
+        return statements_.contains(name) || name.starts_with("pgfe_cached_") ||
+          name.starts_with("pgfe_routine_");
+      });
+    }
+    for (const auto& name : names)
+      conn.unprepare(name);
+  }
+
+  /*
+   * What DISCARD ALL would do of what may have changed but DEALLOCATE ALL,
+   * in one round trip. The statements of PREPARE are found by the server.
+   */
+  const auto& changes = conn.session_changes();
+  if (!changes.is_any())
+    return;
+  Statement_vector queries;
+  if (changes.cursors)
+    queries.append(Statement{"CLOSE ALL"});
+  if (changes.authorization)
+    queries.append(Statement{"SET SESSION AUTHORIZATION DEFAULT"});
+  if (changes.settings || changes.authorization)
+    queries.append(Statement{"RESET ALL"});
+  if (changes.listening)
+    queries.append(Statement{"UNLISTEN *"});
+  if (changes.locks)
+    queries.append(Statement{"SELECT pg_advisory_unlock_all()"});
+  if (changes.temporary)
+    queries.append(Statement{"DISCARD TEMP"});
+  if (changes.sequences)
+    queries.append(Statement{"DISCARD SEQUENCES"});
+  if (changes.statements)
+    queries.append(Statement{"DO $$DECLARE n text; BEGIN FOR n IN SELECT name FROM "
+      "pg_prepared_statements WHERE from_sql LOOP EXECUTE format('DEALLOCATE %I', n); "
+      "END LOOP; END$$"});
+  conn.execute_pipelined(queries);
+  conn.clear_session_changes();
 }
 
 DMITIGR_PGFE_INLINE bool Connection_pool::is_valid() const noexcept
@@ -155,11 +261,37 @@ DMITIGR_PGFE_INLINE void Connection_pool::connect()
   if (is_connected_)
     return;
 
-  for (const auto& state : states_) {
-    auto& conn = state.first;
-    conn->connect();
-    if (connect_handler_)
-      connect_handler_(*conn);
+  // Only the free connections, taken off the list meanwhile.
+  std::vector<std::size_t> taken;
+  while (const auto index = free_.pop())
+    taken.push_back(*index);
+  std::vector<std::exception_ptr> errors(taken.size());
+  {
+    std::vector<std::thread> threads;
+    threads.reserve(taken.size());
+    for (std::size_t i = 0; i < taken.size(); ++i) {
+      threads.emplace_back([this, &taken, &errors, i]
+      {
+        try {
+          auto& conn = states_[taken[i]].first;
+          conn->connect();
+          if (connect_handler_)
+            connect_handler_(*conn);
+          conn->clear_session_changes(); // what the sessions start with
+          prepare_registered(taken[i]);
+        } catch (...) {
+          errors[i] = std::current_exception();
+        }
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+  }
+  for (const auto index : taken)
+    free_.push(index);
+  for (const auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
   }
 
   is_connected_ = is_valid();
@@ -172,51 +304,289 @@ DMITIGR_PGFE_INLINE void Connection_pool::disconnect() noexcept
   if (!is_connected_)
     return;
 
-  for (const auto& state : states_) {
-    if (auto& conn = state.first)
-      conn->disconnect();
+  std::vector<std::size_t> taken;
+  while (const auto index = free_.pop())
+    taken.push_back(*index);
+  for (const auto index : taken) {
+    states_[index].first->disconnect();
+    free_.push(index);
   }
 
   is_connected_ = false;
 }
 
+DMITIGR_PGFE_INLINE void
+Connection_pool::register_statement(std::string name, std::string statement)
+{
+  if (name.empty())
+    throw Client_exception{"cannot register unnamed statement in connection pool"};
+  const std::lock_guard lg{statements_mutex_};
+  statements_.insert_or_assign(std::move(name), std::move(statement));
+}
+
 DMITIGR_PGFE_INLINE bool Connection_pool::is_connected() const noexcept
 {
-  const std::lock_guard lg{mutex_};
   return is_connected_;
 }
 
-DMITIGR_PGFE_INLINE auto Connection_pool::connection() -> Handle
+DMITIGR_PGFE_INLINE void
+Connection_pool::start_maintenance(const std::chrono::milliseconds interval)
 {
+  stop_maintenance();
   const std::lock_guard lg{mutex_};
+  maintaining_ = true;
+  maintenance_ = std::thread{[this, interval]
+  {
+    std::unique_lock lk{mutex_};
+    while (!maintenance_wakeup_.wait_for(lk, interval, [this]{ return !maintaining_; })) {
+      lk.unlock();
+      maintain();
+      lk.lock();
+    }
+  }};
+}
+
+DMITIGR_PGFE_INLINE void Connection_pool::stop_maintenance() noexcept
+{
+  {
+    const std::lock_guard lg{mutex_};
+    maintaining_ = false;
+  }
+  maintenance_wakeup_.notify_all();
+  if (maintenance_.joinable())
+    maintenance_.join();
+}
+
+DMITIGR_PGFE_INLINE void Connection_pool::maintain() noexcept
+{
+  std::vector<std::size_t> taken;
+  while (const auto index = free_.pop())
+    taken.push_back(*index);
+  // Each goes back as soon as it's checked.
+  for (const auto index : taken) {
+    auto& conn = *states_[index].first;
+    if (is_connected_) {
+      try {
+        if (conn.is_connected())
+          conn.execute([](auto&&){}, "SELECT 1");
+      } catch (...) {}
+      if (!conn.is_connected() || !conn.is_ready_for_request()) {
+        try {
+          conn.disconnect();
+          conn.connect();
+          if (connect_handler_)
+            connect_handler_(conn);
+          conn.clear_session_changes();
+          prepare_registered(index);
+        } catch (...) {
+          // Left to take() to reopen.
+          conn.disconnect();
+        }
+      }
+    }
+    give_back(index);
+  }
+}
+
+DMITIGR_PGFE_INLINE Prepared_statement&
+Connection_pool::prepared(Connection& conn, const std::size_t index,
+  const std::string& name)
+{
+  // A statement of a closed session is invalid, so it's prepared again.
+  auto& prepared = prepared_[index];
+  if (const auto i = prepared.find(name); i != prepared.end() && i->second)
+    return i->second;
+
+  std::string statement;
+  {
+    const std::lock_guard lg{statements_mutex_};
+    if (const auto i = statements_.find(name); i != statements_.end())
+      statement = i->second;
+    else
+      throw Client_exception{"no statement " + name +
+        " registered in connection pool"};
+  }
+
+  return prepared[name] = conn.prepare_as_is(statement, name);
+}
 
+DMITIGR_PGFE_INLINE void Connection_pool::prepare_registered(const std::size_t index)
+{
+  std::vector<std::string> names;
+  {
+    const std::lock_guard lg{statements_mutex_};
+    for (const auto& statement : statements_)
+      names.push_back(statement.first);
+  }
+  for (const auto& name : names)
+    prepared(*states_[index].first, index, name);
+}
+
+DMITIGR_PGFE_INLINE auto Connection_pool::take(const std::size_t index) -> Handle
+{
+  auto& [conn, self] = states_[index];
+  try {
+    conn->connect();
+  } catch (...) {
+    give_back(index);
+    throw;
+  }
+  DMITIGR_ASSERT(conn->is_ready_for_request());
+  return {self, std::move(conn), index};
+}
+
+DMITIGR_PGFE_INLINE auto Connection_pool::connection() -> Handle
+{
   if (!is_connected_)
     throw Client_exception{"cannot obtain connection from disconnected "
       "connection pool"};
 
-  const auto b = begin(states_);
-  const auto e = end(states_);
-  const auto i = find_if(b, e, [](const auto& pair)
-  {
-    return static_cast<bool>(pair.first);
-  });
-  if (i != e) {
-    auto& conn = i->first;
-    auto& self = i->second;
-    conn->connect();
-    DMITIGR_ASSERT(conn->is_ready_for_request());
-    return {self, std::move(conn), static_cast<std::size_t>(i - b)};
-  } else
+  // Not ahead of the waiters.
+  if (waiting_.load())
+    return {};
+  if (const auto index = free_.pop())
+    return take(*index);
+  else
     return {};
 }
 
+DMITIGR_PGFE_INLINE auto Connection_pool::acquire(
+  const std::optional<std::chrono::milliseconds> timeout) -> Handle
+{
+  if (!is_connected_)
+    throw Client_exception{"cannot obtain connection from disconnected "
+      "connection pool"};
+
+  // The fast path is only taken with none parked, who come first.
+  if (!waiting_.load()) {
+    if (const auto index = free_.pop())
+      return take(*index);
+  }
+
+  /*
+   * Announce the wait before looking once more, so that a connection given
+   * back meanwhile is either seen here or handed over by give_back(): the
+   * fences order the announcement and the look against give_back()'s push
+   * and its look at the waiting count.
+   */
+  std::unique_lock lk{mutex_};
+  waiting_.fetch_add(1);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  Waiter waiter;
+  if (const auto index = waiters_.empty() ? free_.pop() : std::nullopt) {
+    waiter.granted = true;
+    waiter.state_index = *index;
+  } else {
+    waiters_.push_back(&waiter);
+    const auto granted = [&waiter]{ return waiter.granted; };
+    if (timeout)
+      waiter.condition.wait_for(lk, *timeout, granted);
+    else
+      waiter.condition.wait(lk, granted);
+    if (!waiter.granted)
+      waiters_.erase(find(begin(waiters_), end(waiters_), &waiter));
+  }
+  waiting_.fetch_sub(1);
+  lk.unlock();
+
+  if (!waiter.granted)
+    return {};
+  return take(waiter.state_index);
+}
+
+DMITIGR_PGFE_INLINE auto Connection_pool::async_acquire(Reactor& reactor)
+  -> Task<Handle>
+{
+  if (!is_connected_)
+    throw Client_exception{"cannot obtain connection from disconnected "
+      "connection pool"};
+
+  if (!waiting_.load()) {
+    if (const auto index = free_.pop())
+      co_return take(*index);
+  }
+
+  // Like in acquire(), the wait is announced before looking once more.
+  struct Awaiter final {
+    Connection_pool& pool;
+    Waiter waiter;
+
+    bool await_ready() const noexcept
+    {
+      return false;
+    }
+
+    bool await_suspend(const std::coroutine_handle<> coroutine)
+    {
+      const std::lock_guard lg{pool.mutex_};
+      pool.waiting_.fetch_add(1);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (const auto index = pool.waiters_.empty() ? pool.free_.pop() : std::nullopt) {
+        pool.waiting_.fetch_sub(1);
+        waiter.state_index = *index;
+        return false;
+      }
+      waiter.coroutine = coroutine;
+      pool.waiters_.push_back(&waiter);
+      return true;
+    }
+
+    std::size_t await_resume() noexcept
+    {
+      if (waiter.coroutine)
+        pool.waiting_.fetch_sub(1);
+      return waiter.state_index;
+    }
+  };
+  Awaiter awaiter{*this, {}};
+  awaiter.waiter.reactor = &reactor;
+  co_return take(co_await awaiter);
+}
+
+DMITIGR_PGFE_INLINE void Connection_pool::give_back(const std::size_t index) noexcept
+{
+  const auto grant = [this](const std::size_t free)
+  {
+    Waiter* const waiter = waiters_.front();
+    waiters_.pop_front();
+    waiter->granted = true;
+    waiter->state_index = free;
+    if (waiter->coroutine)
+      waiter->reactor->post(waiter->coroutine);
+    else
+      waiter->condition.notify_one();
+  };
+
+  // Straight to the oldest waiter, if any, so none is overtaken.
+  if (waiting_.load()) {
+    const std::lock_guard lg{mutex_};
+    if (!waiters_.empty()) {
+      grant(index);
+      return;
+    }
+  }
+
+  free_.push(index);
+  // Pairs with the fence of acquire(): either it sees the push, or this
+  // sees its announcement.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!waiting_.load())
+    return;
+  const std::lock_guard lg{mutex_};
+  while (!waiters_.empty()) {
+    const auto free = free_.pop();
+    if (!free)
+      break;
+    grant(*free);
+  }
+}
+
 DMITIGR_PGFE_INLINE void Connection_pool::release(Handle& handle) noexcept
 {
   if (!handle.is_valid())
     return;
 
-  const std::lock_guard lg{mutex_};
-
+  // The connection is this thread's until given back.
   DMITIGR_ASSERT(handle.connection_);
   auto& conn = *handle.connection_;
   const auto index = handle.state_index_;
@@ -246,12 +616,18 @@ DMITIGR_PGFE_INLINE void Connection_pool::release(Handle& handle) noexcept
   handle.connection_ = {};
   handle.state_index_ = {};
   DMITIGR_ASSERT(!handle.is_valid());
+  busy_.fetch_sub(1, std::memory_order_relaxed);
+  give_back(index);
 }
 
 DMITIGR_PGFE_INLINE std::size_t Connection_pool::size() const noexcept
 {
-  const std::lock_guard lg{mutex_};
   return states_.size();
 }
 
+DMITIGR_PGFE_INLINE std::size_t Connection_pool::busy_count() const noexcept
+{
+  return busy_.load(std::memory_order_relaxed);
+}
+
 } // namespace dmitigr::pgfe
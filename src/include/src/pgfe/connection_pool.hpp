@@ -20,9 +20,19 @@
 #include "connection.hpp"
 #include "dll.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -101,6 +111,24 @@ public:
     /// Calls pool()->release(*this) if `pool()`.
     DMITIGR_PGFE_API void release() noexcept;
 
+    /**
+     * @returns The statement registered in the pool as `name`, prepared on
+     * the connection of this handle.
+     *
+     * @details The statement is prepared on the first call for the session
+     * of the connection, unless the pool has already done it, and the same
+     * instance is returned afterwards, by whichever handle holds the
+     * connection. The parameters bound to it survive the release.
+     *
+     * @par Requires
+     * `is_valid()`.
+     *
+     * @throws Client_exception if no statement is registered as `name`.
+     *
+     * @see Connection_pool::register_statement().
+     */
+    DMITIGR_PGFE_API Prepared_statement& prepared_statement(const std::string& name);
+
   private:
     friend Connection_pool;
 
@@ -180,7 +208,13 @@ public:
    * @brief Sets the handler which will be called just after returning a
    * connection to the pool.
    *
-   * @remarks By default, it executes the `DISCARD ALL` statement.
+   * @remarks By default, it rolls back a transaction left open, unprepares
+   * the statements prepared neither as registered nor by the statement cache,
+   * and undoes like `DISCARD ALL` does the rest of Connection::session_changes(),
+   * in one round trip, so a session which has changed nothing costs nothing
+   * and keeps its statements and their plans. A session changed in a way its
+   * statements don't show, as by a function, needs a handler executing
+   * `DISCARD ALL`.
    *
    * @see release_handler().
    */
@@ -196,7 +230,27 @@ public:
   release_handler() const noexcept;
 
   /**
-   * @brief Opens the connections to the server.
+   * @brief Registers `statement` to be prepared as `name` on every
+   * connection of the pool.
+   *
+   * @details The connections opened by connect() or by the maintenance
+   * thread get the registered statements prepared just after the connect
+   * handler, the others on the first Handle::prepared_statement() call.
+   * Registering a `name` again replaces the statement for the connections
+   * yet to prepare it only.
+   *
+   * @par Requires
+   * `!name.empty()`.
+   *
+   * @remarks The default release handler keeps the registered statements. A
+   * custom one must keep them as well.
+   */
+  DMITIGR_PGFE_API void register_statement(std::string name, std::string statement);
+
+  /**
+   * @brief Opens the connections to the server, all at once.
+   *
+   * @remarks The connect handler is called on the connections in parallel.
    *
    * @par Effects
    * `is_connected() == is_valid()` on success.
@@ -216,9 +270,23 @@ public:
   /// @returns `true` if the pool is connected.
   DMITIGR_PGFE_API bool is_connected() const noexcept;
 
+  /**
+   * @brief Starts a thread which, every `interval`, pings the free
+   * connections and reopens the broken ones, so that a dead socket is found
+   * before a client takes it and the reconnect doesn't happen on the
+   * acquiring thread.
+   *
+   * @details A connection being checked is taken like by a client, for
+   * about a round trip. Restarts the thread if already started.
+   */
+  DMITIGR_PGFE_API void start_maintenance(std::chrono::milliseconds interval);
+
+  /// Stops the thread started by start_maintenance(), if any.
+  DMITIGR_PGFE_API void stop_maintenance() noexcept;
+
   /**
    * @returns The valid connection handle if there is a free connection in the
-   * pool, or invalid handle otherwise.
+   * pool and no thread waits in acquire(), or invalid handle otherwise.
    *
    * @throws Client_exception if:
    *   - `!is_connected()`;
@@ -227,6 +295,34 @@ public:
    */
   DMITIGR_PGFE_API Handle connection();
 
+  /**
+   * @returns The valid connection handle as soon as a connection of the pool
+   * is free, or invalid handle if none is within `timeout`.
+   *
+   * @details Waiters are served in FIFO order: release() hands the connection
+   * straight to the longest waiting one, and a caller finding others waiting
+   * queues behind them. Without `timeout` waits for as long as it takes.
+   *
+   * @throws Client_exception if:
+   *   - `!is_connected()`;
+   *   - attempt to reopen the connection possibly closed upon of calling
+   *   release() is failed.
+   */
+  DMITIGR_PGFE_API Handle acquire(std::optional<std::chrono::milliseconds> timeout = {});
+
+  /**
+   * @brief Acquires a connection like acquire() does without timeout, but
+   * suspends the calling coroutine instead of blocking the thread.
+   *
+   * @details A waiting coroutine is queued along with the waiting threads,
+   * and resumed by `reactor` once release() hands a connection over to it.
+   *
+   * @throws Same as acquire().
+   *
+   * @see acquire(), Reactor.
+   */
+  DMITIGR_PGFE_API Task<Handle> async_acquire(Reactor& reactor);
+
   /**
    * @brief Returns the connection of `handle` back to the pool.
    *
@@ -246,6 +342,9 @@ public:
   /// @returns The size of the pool.
   DMITIGR_PGFE_API std::size_t size() const noexcept;
 
+  /// @returns The number of the connections held by the handles at the moment.
+  DMITIGR_PGFE_API std::size_t busy_count() const noexcept;
+
 private:
   friend Handle;
 
@@ -253,11 +352,67 @@ private:
     std::unique_ptr<Connection>,
     std::shared_ptr<Connection_pool*>>;
 
-  mutable std::mutex mutex_;
-  bool is_connected_{};
+  /**
+   * @brief The indices of the free states: a lock-free stack whose head
+   * carries a tag against ABA, so taking and giving back a connection is
+   * O(1) and takes no lock unless a thread waits in acquire().
+   */
+  class Free_list final {
+  public:
+    void reset(std::size_t size);
+    void push(std::size_t index) noexcept;
+    std::optional<std::size_t> pop() noexcept;
+
+  private:
+    std::atomic<std::uint64_t> head_{}; // tag << 32 | index + 1, 0 if empty
+    std::unique_ptr<std::atomic<std::uint32_t>[]> next_;
+  };
+
+  /// A thread parked in acquire(), or a coroutine suspended in async_acquire().
+  struct Waiter final {
+    std::condition_variable condition;
+    bool granted{};
+    std::size_t state_index{};
+    Reactor* reactor{}; // of the coroutine
+    std::coroutine_handle<> coroutine;
+  };
+
+  mutable std::mutex mutex_; // of connect(), disconnect() and the waiters
+  std::atomic<bool> is_connected_{};
   std::vector<State> states_;
+  Free_list free_;
+  std::atomic<std::size_t> waiting_{};
+  std::atomic<std::size_t> busy_{};
+  std::deque<Waiter*> waiters_;
+  std::thread maintenance_;
+  std::condition_variable maintenance_wakeup_;
+  bool maintaining_{};
   std::function<void(Connection&)> connect_handler_;
   std::function<void(Connection&)> release_handler_;
+  mutable std::mutex statements_mutex_;
+  std::map<std::string, std::string> statements_; // by name
+  // By state index, touched by the owner of the state only. (Destroyed
+  // before states_ as the prepared statements refer to the connections.)
+  std::vector<std::map<std::string, Prepared_statement>> prepared_;
+
+  /// @returns The handle of the taken state `index`, connected.
+  Handle take(std::size_t index);
+
+  /// Frees the state `index`, handing it to the first waiter if any.
+  void give_back(std::size_t index) noexcept;
+
+  /// Checks the free connections once.
+  void maintain() noexcept;
+
+  /// @returns The statement `name` prepared on `conn` of the taken state `index`.
+  Prepared_statement& prepared(Connection& conn, std::size_t index,
+    const std::string& name);
+
+  /// Prepares every registered statement on the taken state `index`.
+  void prepare_registered(std::size_t index);
+
+  /// Resets what the session may have had changed, as the default release handler.
+  void reset_session(Connection& conn);
 };
 
 } // namespace dmitigr::pgfe
@@ -0,0 +1,177 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connection_router.hpp"
+#include "exceptions.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <optional>
+
+namespace dmitigr::pgfe {
+
+DMITIGR_PGFE_INLINE Connection_router::Connection_router(
+  std::vector<Endpoint> endpoints)
+  : endpoints_{std::move(endpoints)}
+{
+  pools_.reserve(endpoints_.size());
+  for (auto& endpoint : endpoints_) {
+    if (!endpoint.size)
+      throw Client_exception{"cannot create connection router: "
+        "invalid endpoint size"};
+    else if (!endpoint.weight)
+      throw Client_exception{"cannot create connection router: "
+        "invalid endpoint weight"};
+
+    if (!endpoint.options.session_mode())
+      endpoint.options.set(endpoint.role == Endpoint_role::primary ?
+        Session_mode::primary : Session_mode::standby);
+    pools_.push_back(std::make_unique<Connection_pool>(endpoint.size,
+        endpoint.options));
+  }
+}
+
+DMITIGR_PGFE_INLINE bool Connection_router::is_valid() const noexcept
+{
+  return !pools_.empty();
+}
+
+DMITIGR_PGFE_INLINE std::size_t Connection_router::endpoint_count() const noexcept
+{
+  return endpoints_.size();
+}
+
+DMITIGR_PGFE_INLINE auto Connection_router::endpoint(const std::size_t index) const
+  -> const Endpoint&
+{
+  if (!(index < endpoint_count()))
+    throw Client_exception{"cannot get endpoint of connection router: "
+      "invalid index"};
+  return endpoints_[index];
+}
+
+DMITIGR_PGFE_INLINE Connection_pool& Connection_router::pool(const std::size_t index)
+{
+  if (!(index < endpoint_count()))
+    throw Client_exception{"cannot get pool of connection router: "
+      "invalid index"};
+  return *pools_[index];
+}
+
+DMITIGR_PGFE_INLINE void
+Connection_router::set_connect_handler(std::function<void(Connection&)> handler)
+{
+  for (auto& pool : pools_)
+    pool->set_connect_handler(handler);
+}
+
+DMITIGR_PGFE_INLINE void
+Connection_router::set_release_handler(std::function<void(Connection&)> handler)
+{
+  for (auto& pool : pools_)
+    pool->set_release_handler(handler);
+}
+
+DMITIGR_PGFE_INLINE void
+Connection_router::register_statement(const std::string& name,
+  const std::string& statement)
+{
+  for (auto& pool : pools_)
+    pool->register_statement(name, statement);
+}
+
+DMITIGR_PGFE_INLINE void Connection_router::connect()
+{
+  std::exception_ptr error;
+  for (std::size_t i{}; i < pools_.size(); ++i) {
+    try {
+      pools_[i]->connect();
+    } catch (...) {
+      pools_[i]->disconnect();
+      if (endpoints_[i].role == Endpoint_role::primary && !error)
+        error = std::current_exception();
+    }
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+DMITIGR_PGFE_INLINE void Connection_router::disconnect() noexcept
+{
+  for (auto& pool : pools_)
+    pool->disconnect();
+}
+
+DMITIGR_PGFE_INLINE bool Connection_router::is_connected() const noexcept
+{
+  return any_of(pools_.cbegin(), pools_.cend(),
+    [](const auto& pool){ return pool->is_connected(); });
+}
+
+DMITIGR_PGFE_INLINE auto Connection_router::acquire(const Endpoint_role role,
+  const std::optional<std::chrono::milliseconds> timeout) -> Handle
+{
+  auto indices = candidates(role);
+  if (indices.empty() && role == Endpoint_role::replica)
+    indices = candidates(Endpoint_role::primary);
+  if (indices.empty())
+    throw Client_exception{"cannot acquire connection from connection router: "
+      "no server connected"};
+
+  // Take a free connection of the least busy pool having one.
+  std::exception_ptr error;
+  std::optional<std::size_t> waited;
+  for (const auto index : indices) {
+    try {
+      if (auto result = pools_[index]->connection())
+        return result;
+      else if (!waited)
+        waited = index;
+    } catch (...) {
+      if (!error)
+        error = std::current_exception();
+    }
+  }
+  if (!waited)
+    std::rethrow_exception(error);
+
+  // Wait for the least busy one otherwise.
+  return pools_[*waited]->acquire(timeout);
+}
+
+DMITIGR_PGFE_INLINE std::vector<std::size_t>
+Connection_router::candidates(const Endpoint_role role) const
+{
+  std::vector<std::size_t> result;
+  for (std::size_t i{}; i < pools_.size(); ++i) {
+    if (endpoints_[i].role == role && pools_[i]->is_connected())
+      result.push_back(i);
+  }
+
+  // Compare busy_count() / weight without division.
+  std::vector<std::size_t> busy(pools_.size());
+  for (const auto i : result)
+    busy[i] = pools_[i]->busy_count();
+  stable_sort(result.begin(), result.end(),
+    [this, &busy](const auto lhs, const auto rhs)
+    {
+      return busy[lhs] * endpoints_[rhs].weight <
+        busy[rhs] * endpoints_[lhs].weight;
+    });
+  return result;
+}
+
+} // namespace dmitigr::pgfe
@@ -0,0 +1,174 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_CONNECTION_ROUTER_HPP
+#define DMITIGR_PGFE_CONNECTION_ROUTER_HPP
+
+#include "basics.hpp"
+#include "connection_options.hpp"
+#include "connection_pool.hpp"
+#include "dll.hpp"
+#include "types_fwd.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup utilities
+ *
+ * @brief A thread-safe set of connection pools to the servers of a cluster,
+ * which routes the writes to the primary and spreads the reads over the
+ * replicas.
+ *
+ * @details Each endpoint gets a Connection_pool of its own. Unless the
+ * session mode of an endpoint is set explicitly, it's set to
+ * Session_mode::primary or Session_mode::standby by the role, so libpq checks
+ * the server on every connect (like `target_session_attrs` does) and a server
+ * which changed its role after a failover is not used in the old one.
+ */
+class Connection_router final {
+public:
+  /// An alias of Connection_pool::Handle.
+  using Handle = Connection_pool::Handle;
+
+  /// An endpoint.
+  struct Endpoint final {
+    /// The connection options of the server.
+    Connection_options options;
+
+    /// The role of the server.
+    Endpoint_role role{Endpoint_role::replica};
+
+    /// The number of connections to the server.
+    std::size_t size{1};
+
+    /// The share of the reads relative to the other replicas.
+    std::size_t weight{1};
+  };
+
+  /// Default-constructible. (Constructs invalid instance.)
+  Connection_router() = default;
+
+  /**
+   * @brief The constructor.
+   *
+   * @par Requires
+   * `size > 0 && weight > 0` for each of `endpoints`.
+   */
+  explicit DMITIGR_PGFE_API Connection_router(std::vector<Endpoint> endpoints);
+
+  /// @returns `true` if this instance is valid.
+  DMITIGR_PGFE_API bool is_valid() const noexcept;
+
+  /// @returns `is_valid()`.
+  explicit operator bool() const noexcept
+  {
+    return is_valid();
+  }
+
+  /// @returns The number of endpoints.
+  DMITIGR_PGFE_API std::size_t endpoint_count() const noexcept;
+
+  /**
+   * @returns The endpoint `index`.
+   *
+   * @par Requires
+   * `index < endpoint_count()`.
+   */
+  DMITIGR_PGFE_API const Endpoint& endpoint(std::size_t index) const;
+
+  /**
+   * @returns The pool of the endpoint `index`.
+   *
+   * @par Requires
+   * `index < endpoint_count()`.
+   */
+  DMITIGR_PGFE_API Connection_pool& pool(std::size_t index);
+
+  /// Calls Connection_pool::set_connect_handler() of each pool.
+  DMITIGR_PGFE_API void set_connect_handler(std::function<void(Connection&)> handler);
+
+  /// Calls Connection_pool::set_release_handler() of each pool.
+  DMITIGR_PGFE_API void set_release_handler(std::function<void(Connection&)> handler);
+
+  /// Calls Connection_pool::register_statement() of each pool.
+  DMITIGR_PGFE_API void register_statement(const std::string& name,
+    const std::string& statement);
+
+  /**
+   * @brief Connects the pools.
+   *
+   * @details A replica which cannot be connected is left out of routing
+   * until the next call.
+   *
+   * @throws The exception of connecting a primary.
+   */
+  DMITIGR_PGFE_API void connect();
+
+  /// Disconnects the pools.
+  DMITIGR_PGFE_API void disconnect() noexcept;
+
+  /// @returns `true` if any of the pools is connected.
+  DMITIGR_PGFE_API bool is_connected() const noexcept;
+
+  /**
+   * @returns The handle of a connection to a server of the `role`, or
+   * invalid handle if none is free within `timeout`.
+   *
+   * @details The replica with the least busy connections per weight which
+   * has a free one is chosen. If no replica is connected, the reads go to the
+   * primaries. Without `timeout` waits for as long as it takes.
+   *
+   * @throws Client_exception if no pool of servers which can serve the
+   * `role` is connected, or as Connection_pool::acquire().
+   */
+  DMITIGR_PGFE_API Handle acquire(Endpoint_role role,
+    std::optional<std::chrono::milliseconds> timeout = {});
+
+  /// @returns `acquire(Endpoint_role::replica, timeout)`.
+  Handle acquire_read(const std::optional<std::chrono::milliseconds> timeout = {})
+  {
+    return acquire(Endpoint_role::replica, timeout);
+  }
+
+  /// @returns `acquire(Endpoint_role::primary, timeout)`.
+  Handle acquire_write(const std::optional<std::chrono::milliseconds> timeout = {})
+  {
+    return acquire(Endpoint_role::primary, timeout);
+  }
+
+private:
+  std::vector<Endpoint> endpoints_;
+  std::vector<std::unique_ptr<Connection_pool>> pools_;
+
+  /// @returns The indices of the connected pools of `role`, least busy first.
+  std::vector<std::size_t> candidates(Endpoint_role role) const;
+};
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "connection_router.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_CONNECTION_ROUTER_HPP
@@ -0,0 +1,173 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "connection_stats.hpp"
+#include "exceptions.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+namespace dmitigr::pgfe {
+
+// -----------------------------------------------------------------------------
+// Connection_stats::Histogram
+// -----------------------------------------------------------------------------
+
+DMITIGR_PGFE_INLINE void
+Connection_stats::Histogram::record(const std::chrono::microseconds duration) noexcept
+{
+  const auto value = static_cast<std::uint64_t>(std::max(duration.count(),
+      decltype(duration.count()){}));
+  counts_[index(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  auto max = max_.load(std::memory_order_relaxed);
+  while (max < value && !max_.compare_exchange_weak(max, value,
+      std::memory_order_relaxed));
+}
+
+DMITIGR_PGFE_INLINE std::uint64_t
+Connection_stats::Histogram::count() const noexcept
+{
+  return count_.load(std::memory_order_relaxed);
+}
+
+DMITIGR_PGFE_INLINE std::chrono::microseconds
+Connection_stats::Histogram::sum() const noexcept
+{
+  return std::chrono::microseconds(sum_.load(std::memory_order_relaxed));
+}
+
+DMITIGR_PGFE_INLINE std::chrono::microseconds
+Connection_stats::Histogram::max() const noexcept
+{
+  return std::chrono::microseconds(max_.load(std::memory_order_relaxed));
+}
+
+DMITIGR_PGFE_INLINE std::chrono::microseconds
+Connection_stats::Histogram::value_at_percentile(const double percentile) const
+{
+  if (!(0 <= percentile && percentile <= 100))
+    throw Client_exception{"cannot get value at percentile of histogram: "
+      "invalid percentile"};
+
+  std::uint64_t total{};
+  for (const auto& count : counts_)
+    total += count.load(std::memory_order_relaxed);
+  if (!total)
+    return {};
+
+  const auto rank = std::max<std::uint64_t>(1,
+    static_cast<std::uint64_t>(std::ceil(percentile / 100 * total)));
+  std::uint64_t seen{};
+  for (std::size_t i{}; i < counts_.size(); ++i) {
+    seen += counts_[i].load(std::memory_order_relaxed);
+    if (seen >= rank)
+      return std::chrono::microseconds(lower_bound(i));
+  }
+  return max();
+}
+
+DMITIGR_PGFE_INLINE auto Connection_stats::Histogram::buckets() const
+  -> std::vector<Bucket>
+{
+  using std::chrono::microseconds;
+  std::vector<Bucket> result;
+  for (std::size_t i{}; i < counts_.size(); ++i) {
+    if (const auto count = counts_[i].load(std::memory_order_relaxed)) {
+      constexpr std::uint64_t rep_max =
+        std::numeric_limits<microseconds::rep>::max();
+      const auto upper = std::min(i + 1 < counts_.size() ?
+        lower_bound(i + 1) : rep_max, rep_max);
+      result.push_back(Bucket{microseconds(lower_bound(i)),
+          microseconds(upper), count});
+    }
+  }
+  return result;
+}
+
+DMITIGR_PGFE_INLINE void Connection_stats::Histogram::reset() noexcept
+{
+  for (auto& count : counts_)
+    count.store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+DMITIGR_PGFE_INLINE std::size_t
+Connection_stats::Histogram::index(const std::uint64_t value) noexcept
+{
+  if (value < sub_bucket_count_)
+    return static_cast<std::size_t>(value);
+
+  // The shift leaves the sub_bucket_bits_ + 1 most significant bits.
+  const auto shift = static_cast<unsigned>(std::bit_width(value)) -
+    (sub_bucket_bits_ + 1);
+  return (shift + 1) * sub_bucket_count_ +
+    static_cast<std::size_t>((value >> shift) - sub_bucket_count_);
+}
+
+DMITIGR_PGFE_INLINE std::uint64_t
+Connection_stats::Histogram::lower_bound(const std::size_t index) noexcept
+{
+  if (index < sub_bucket_count_)
+    return index;
+
+  const auto shift = index / sub_bucket_count_ - 1;
+  return (sub_bucket_count_ + index % sub_bucket_count_) << shift;
+}
+
+// -----------------------------------------------------------------------------
+// Connection_stats
+// -----------------------------------------------------------------------------
+
+DMITIGR_PGFE_INLINE void Connection_stats::reset() noexcept
+{
+  first_row_latency.reset();
+  completion_latency.reset();
+  for (auto* const counter : {&request_count, &error_count, &row_count,
+         &bytes_sent, &bytes_received, &copy_chunks_sent,
+         &copy_chunks_received})
+    counter->store(0, std::memory_order_relaxed);
+}
+
+DMITIGR_PGFE_INLINE std::ostream& operator<<(std::ostream& os,
+  const Connection_stats& stats)
+{
+  const auto print_histogram = [&os](const char* const name,
+    const Connection_stats::Histogram& histogram)
+  {
+    os << name << ": count=" << histogram.count();
+    for (const double p : {50.0, 90.0, 99.0, 99.9})
+      os << " p" << p << "=" << histogram.value_at_percentile(p).count() << "us";
+    os << " max=" << histogram.max().count() << "us\n";
+  };
+  os << "requests: " << stats.request_count.load() << '\n'
+     << "errors: " << stats.error_count.load() << '\n'
+     << "rows: " << stats.row_count.load() << '\n'
+     << "bytes sent: " << stats.bytes_sent.load() << '\n'
+     << "bytes received: " << stats.bytes_received.load() << '\n'
+     << "copy chunks sent: " << stats.copy_chunks_sent.load() << '\n'
+     << "copy chunks received: " << stats.copy_chunks_received.load() << '\n';
+  print_histogram("first row latency", stats.first_row_latency);
+  print_histogram("completion latency", stats.completion_latency);
+  return os;
+}
+
+} // namespace dmitigr::pgfe
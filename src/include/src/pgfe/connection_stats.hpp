@@ -0,0 +1,161 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_CONNECTION_STATS_HPP
+#define DMITIGR_PGFE_CONNECTION_STATS_HPP
+
+#include "dll.hpp"
+#include "types_fwd.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup utilities
+ *
+ * @brief The statistics of the requests and the traffic of connections.
+ *
+ * @details The counters are atomic and updated with relaxed ordering, so a
+ * single instance can be shared by several connections working in different
+ * threads (for example, the ones of a Connection_pool by setting it in the
+ * connect handler), and read at any time.
+ *
+ * The bytes are the ones of the data: the queries, the parameters, the
+ * fields of the rows and the data of `COPY`. The bytes of the protocol
+ * messages are not counted.
+ *
+ * @see Connection::set_stats().
+ */
+class Connection_stats final {
+public:
+  /**
+   * @brief A lock-free histogram of durations in the manner of HDR Histogram.
+   *
+   * @details The microseconds are counted in buckets of which there are 16
+   * per power of two, so the durations are recorded exactly below 16 us and
+   * within 6.25% above.
+   */
+  class Histogram final {
+  public:
+    /// A non-empty bucket.
+    struct Bucket final {
+      /// The least duration of the bucket.
+      std::chrono::microseconds lower;
+
+      /// The least duration of the next bucket.
+      std::chrono::microseconds upper;
+
+      /// The number of durations recorded.
+      std::uint64_t count{};
+    };
+
+    /// Records `duration`.
+    DMITIGR_PGFE_API void record(std::chrono::microseconds duration) noexcept;
+
+    /// @returns The number of durations recorded.
+    DMITIGR_PGFE_API std::uint64_t count() const noexcept;
+
+    /// @returns The sum of durations recorded.
+    DMITIGR_PGFE_API std::chrono::microseconds sum() const noexcept;
+
+    /// @returns The greatest duration recorded.
+    DMITIGR_PGFE_API std::chrono::microseconds max() const noexcept;
+
+    /**
+     * @returns The lower bound of the bucket containing the `percentile` of
+     * the durations recorded, or zero if none.
+     *
+     * @par Requires
+     * `0 <= percentile && percentile <= 100`.
+     */
+    DMITIGR_PGFE_API std::chrono::microseconds
+    value_at_percentile(double percentile) const;
+
+    /// @returns The non-empty buckets in ascending order.
+    DMITIGR_PGFE_API std::vector<Bucket> buckets() const;
+
+    /// Forgets the recorded durations.
+    DMITIGR_PGFE_API void reset() noexcept;
+
+  private:
+    static constexpr unsigned sub_bucket_bits_{4};
+    static constexpr std::size_t sub_bucket_count_{1 << sub_bucket_bits_};
+    static constexpr std::size_t bucket_count_{
+      (64 - sub_bucket_bits_ + 1) * sub_bucket_count_};
+
+    std::array<std::atomic<std::uint64_t>, bucket_count_> counts_{};
+    std::atomic<std::uint64_t> count_{};
+    std::atomic<std::uint64_t> sum_{};
+    std::atomic<std::uint64_t> max_{};
+
+    static std::size_t index(std::uint64_t value) noexcept;
+    static std::uint64_t lower_bound(std::size_t index) noexcept;
+  };
+
+  /// The durations from sending an execution until its first row.
+  Histogram first_row_latency;
+
+  /// The durations from sending an execution until its completion.
+  Histogram completion_latency;
+
+  /// The number of executions completed.
+  std::atomic<std::uint64_t> request_count{};
+
+  /// The number of executions failed.
+  std::atomic<std::uint64_t> error_count{};
+
+  /// The number of rows received.
+  std::atomic<std::uint64_t> row_count{};
+
+  /// The number of bytes sent.
+  std::atomic<std::uint64_t> bytes_sent{};
+
+  /// The number of bytes received.
+  std::atomic<std::uint64_t> bytes_received{};
+
+  /// The number of chunks of `COPY ... FROM STDIN` sent.
+  std::atomic<std::uint64_t> copy_chunks_sent{};
+
+  /// The number of chunks of `COPY ... TO STDOUT` received.
+  std::atomic<std::uint64_t> copy_chunks_received{};
+
+  /// Resets all the statistics.
+  DMITIGR_PGFE_API void reset() noexcept;
+};
+
+/**
+ * @ingroup utilities
+ *
+ * @brief Prints the counters and the percentiles of the histograms of
+ * `stats`, one per line.
+ */
+DMITIGR_PGFE_API std::ostream& operator<<(std::ostream& os,
+  const Connection_stats& stats);
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "connection_stats.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_CONNECTION_STATS_HPP
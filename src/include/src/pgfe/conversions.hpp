@@ -22,14 +22,21 @@
 #include "basic_conversions.hpp"
 #include "basics.hpp"
 #include "data.hpp"
+#include "decimal.hpp"
 #include "exceptions.hpp"
 #include "row.hpp"
 #include "types_fwd.hpp"
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <limits>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 
@@ -101,144 +108,56 @@ struct Generic_data_conversions final {
 // Optimized numeric to/from std::string conversions
 // -----------------------------------------------------------------------------
 
-/// The common implementation of numeric to/from `std::string` conversions.
+/**
+ * @brief The implementation of numeric to/from `std::string` conversions.
+ *
+ * @details Both directions are done by `std::from_chars` and `std::to_chars`
+ * right on the characters, without extra allocations and locales. The text
+ * must be a whole number in base 10 or a whole floating point number, the
+ * leading plus sign of which is allowed.
+ */
 template<typename T>
-struct Numeric_string_conversions_base {
+struct Numeric_string_conversions final {
+  static_assert(std::is_arithmetic_v<T>);
   using Type = T;
 
-  template<typename ... Types>
-  static std::string to_string(Type value, Types&& ... args)
-  {
-    if constexpr (std::is_floating_point_v<Type>) {
-      return Generic_string_conversions<Type>::to_string(value,
-        std::forward<Types>(args)...);
-    } else
-      return std::to_string(value);
-  }
-
-protected:
-  template<typename R, typename ... Types>
-  static Type to_numeric__(const std::string& text,
-    R(*converter)(const std::string&, std::size_t*, Types ...))
-  {
-    Type result;
-    std::size_t idx;
-    if constexpr (std::is_floating_point_v<R>) // workaround for GCC 7.5
-      result = converter(text, &idx);
-    else
-      result = converter(text, &idx, 10);
-
-    if (idx != text.size())
-      throw Client_exception{"cannot convert to numeric: "
-        "input contains non-convertible symbols"};
-
-    return result;
-  }
-};
-
-// -----------------------------------------------------------------------------
-
-/// The implementation of `short int` to/from `std::string` conversions.
-template<>
-struct Numeric_string_conversions<short int> final
-  : private Numeric_string_conversions_base<int> {
-  using Type = short int;
-  using Numeric_string_conversions_base::to_string;
-
-  template<typename ... Types>
-  static Type to_type(const std::string& text, Types&& ...)
-  {
-    const int result = to_numeric__(text, &std::stoi);
-    constexpr auto max = std::numeric_limits<short int>::max();
-    if (result > max)
-      throw Client_exception{"cannot convert to type: numeric value "
-        + std::to_string(result) + " is greater than " + std::to_string(max)};
-
-    return static_cast<Type>(result);
-  }
-};
-
-/// The implementation of `int` to/from `std::string` conversions.
-template<>
-struct Numeric_string_conversions<int> final
-  : private Numeric_string_conversions_base<int> {
-  using Type = int;
-  using Numeric_string_conversions_base::to_string;
-
-  template<typename ... Types>
-  static Type to_type(const std::string& text, Types&& ...)
-  {
-    return to_numeric__(text, &std::stoi);
-  }
-};
-
-/// The implementation of `long int` to/from `std::string` conversions.
-template<>
-struct Numeric_string_conversions<long int> final
-  : private Numeric_string_conversions_base<long int> {
-  using Type = long int;
-  using Numeric_string_conversions_base::to_string;
-
   template<typename ... Types>
   static Type to_type(const std::string& text, Types&& ...)
   {
-    return to_numeric__(text, &std::stol);
+    return to_type__(text.data(), text.size());
   }
-};
-
-/// The implementation of `long long int` to/from `std::string` conversions.
-template<>
-struct Numeric_string_conversions<long long int> final
-  : private Numeric_string_conversions_base<long long int> {
-  using Type = long long int;
-  using Numeric_string_conversions_base::to_string;
 
   template<typename ... Types>
-  static Type to_type(const std::string& text, Types&& ...)
+  static std::string to_string(const Type value, Types&& ...)
   {
-    return to_numeric__(text, &std::stoll);
-  }
-};
-
-/// The implementation of `float` to/from `std::string` conversions.
-template<>
-struct Numeric_string_conversions<float> final
-  : private Numeric_string_conversions_base<float> {
-  using Type = float;
-  using Numeric_string_conversions_base::to_string;
+    char buffer[64];
+    const auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    if (ec != std::errc{})
+      throw Client_exception{"cannot convert to string: "
+        "invalid native representation"};
 
-  template<typename ... Types>
-  static Type to_type(const std::string& text, Types&& ...)
-  {
-    return to_numeric__(text, &std::stof);
+    return std::string(buffer, end);
   }
-};
 
-/// The implementation of `double` to/from `std::string` conversions.
-template<>
-struct Numeric_string_conversions<double> final
-  : private Numeric_string_conversions_base<double> {
-  using Type = double;
-  using Numeric_string_conversions_base::to_string;
+private:
+  template<typename, class> friend struct Numeric_data_conversions;
 
-  template<typename ... Types>
-  static Type to_type(const std::string& text, Types&& ...)
+  static Type to_type__(const char* text, const std::size_t size)
   {
-    return to_numeric__(text, &std::stod);
-  }
-};
+    const char* const end = text + size;
+    if (text != end && *text == '+')
+      ++text;
 
-/// The implementation of `long double` to/from `std::string` conversions.
-template<>
-struct Numeric_string_conversions<long double> final
-  : private Numeric_string_conversions_base<long double> {
-  using Type = long double;
-  using Numeric_string_conversions_base::to_string;
+    Type result{};
+    const auto [ptr, ec] = std::from_chars(text, end, result);
+    if (ec == std::errc::result_out_of_range)
+      throw Client_exception{"cannot convert to numeric: "
+        "value out of range of the type"};
+    else if (ec != std::errc{} || ptr != end)
+      throw Client_exception{"cannot convert to numeric: "
+        "input contains non-convertible symbols"};
 
-  template<typename ... Types>
-  static Type to_type(const std::string& text, Types&& ...)
-  {
-    return to_numeric__(text, &std::stold);
+    return result;
   }
 };
 
@@ -252,13 +171,13 @@ struct Numeric_data_conversions final {
   using Type = T;
 
   template<typename ... Types>
-  static Type to_type(const Data& data, Types&& ... args)
+  static Type to_type(const Data& data, Types&& ...)
   {
     if (data.format() == Data_format::binary)
-      return net::conv<Type>(data.bytes(), data.size());
+      return from_binary__(data.bytes(), data.size());
     else
-      return Generic_data_conversions<Type, StringConversions>::to_type(data,
-        std::forward<Types>(args)...);
+      return StringConversions::to_type__(
+        static_cast<const char*>(data.bytes()), data.size());
   }
 
   template<typename ... Types>
@@ -266,7 +185,7 @@ struct Numeric_data_conversions final {
   {
     if (!data)
       throw Client_exception{"cannot convert to type: null data given"};
-    return to_type(data, std::forward<Types>(args)...);
+    return to_type(*data, std::forward<Types>(args)...);
   }
 
   template<typename ... Types>
@@ -275,6 +194,44 @@ struct Numeric_data_conversions final {
     return Generic_data_conversions<Type, StringConversions>::to_data(value,
       std::forward<Types>(args)...);
   }
+
+private:
+  template<typename I>
+  using wire_int__ = std::conditional_t<std::is_signed_v<Type>, I,
+    std::make_unsigned_t<I>>;
+
+  /*
+   * The wire integers are read as signed ones (int2, int4, int8) unless
+   * `Type` is unsigned (oid, xid), extended and range checked. The wire
+   * floating point numbers are float4 and float8.
+   */
+  static Type from_binary__(const void* const bytes, const std::size_t size)
+  {
+    if constexpr (std::is_floating_point_v<Type>) {
+      if (size == sizeof(float))
+        return static_cast<Type>(net::conv<float>(bytes, size));
+      else if (size == sizeof(double))
+        return static_cast<Type>(net::conv<double>(bytes, size));
+    } else {
+      switch (size) {
+      case 1: return narrow__(net::conv<wire_int__<std::int8_t>>(bytes, size));
+      case 2: return narrow__(net::conv<wire_int__<std::int16_t>>(bytes, size));
+      case 4: return narrow__(net::conv<wire_int__<std::int32_t>>(bytes, size));
+      case 8: return narrow__(net::conv<wire_int__<std::int64_t>>(bytes, size));
+      }
+    }
+    throw Client_exception{"cannot convert to numeric: "
+      "invalid binary input size"};
+  }
+
+  template<typename I>
+  static Type narrow__(const I value)
+  {
+    if (!std::in_range<Type>(value))
+      throw Client_exception{"cannot convert to numeric: "
+        "value out of range of the type"};
+    return static_cast<Type>(value);
+  }
 };
 
 // -----------------------------------------------------------------------------
@@ -457,6 +414,581 @@ struct String_view_data_conversions final {
   }
 };
 
+// -----------------------------------------------------------------------------
+// Date and timestamp conversions
+// -----------------------------------------------------------------------------
+
+/// The origin of the binary dates and timestamps: 2000-01-01.
+inline constexpr std::chrono::sys_days postgres_epoch{std::chrono::days{10957}};
+
+/**
+ * @brief The text representation of dates and times of `DateStyle = ISO`,
+ * which is the default.
+ */
+struct Iso_time final {
+  [[noreturn]] static void fail()
+  {
+    throw Client_exception{"cannot convert to date or time: "
+      "invalid text representation"};
+  }
+
+  static bool skip(std::string_view& text, const std::string_view prefix) noexcept
+  {
+    if (text.substr(0, prefix.size()) != prefix)
+      return false;
+    text.remove_prefix(prefix.size());
+    return true;
+  }
+
+  /// @returns The number of at least `min` and at most `max` digits.
+  static int number(std::string_view& text, const std::size_t min,
+    const std::size_t max, std::size_t* const count = {})
+  {
+    int result{};
+    std::size_t i{};
+    for (; i < max && i < text.size() && '0' <= text[i] && text[i] <= '9'; ++i)
+      result = result * 10 + (text[i] - '0');
+    if (i < min)
+      fail();
+    text.remove_prefix(i);
+    if (count)
+      *count = i;
+    return result;
+  }
+
+  /// @returns The number of the `N` digits at `p`, or `-1` if not all are digits.
+  template<std::size_t N>
+  static int digits(const char* const p) noexcept
+  {
+    int result{};
+    for (std::size_t i{}; i < N; ++i) {
+      const unsigned digit = static_cast<unsigned char>(p[i]) - unsigned{'0'};
+      if (digit > 9)
+        return -1;
+      result = result * 10 + static_cast<int>(digit);
+    }
+    return result;
+  }
+
+  /// @returns The date `YYYY-MM-DD`, the era suffix of which is parsed by `era()`.
+  static std::chrono::year_month_day date(std::string_view& text)
+  {
+    using namespace std::chrono;
+    // The years of 4 digits at the fixed positions, without the scan.
+    if (text.size() >= 10 && text[4] == '-' && text[7] == '-') {
+      const int y = digits<4>(text.data());
+      const int m = digits<2>(text.data() + 5);
+      const int d = digits<2>(text.data() + 8);
+      if ((y | m | d) >= 0) {
+        text.remove_prefix(10);
+        return year{y}/month(static_cast<unsigned>(m))/day(static_cast<unsigned>(d));
+      }
+    }
+
+    const int y = number(text, 4, 6);
+    if (!skip(text, "-"))
+      fail();
+    const int m = number(text, 2, 2);
+    if (!skip(text, "-"))
+      fail();
+    const int d = number(text, 2, 2);
+    return year{y}/month(m)/day(d);
+  }
+
+  /// @returns The time of day `HH:MM:SS[.ffffff]`.
+  static std::chrono::microseconds time(std::string_view& text)
+  {
+    using namespace std::chrono;
+    int h{}, m{}, s{};
+    if (text.size() >= 8 && text[2] == ':' && text[5] == ':' &&
+      (h = digits<2>(text.data())) >= 0 &&
+      (m = digits<2>(text.data() + 3)) >= 0 &&
+      (s = digits<2>(text.data() + 6)) >= 0)
+      text.remove_prefix(8);
+    else {
+      h = number(text, 2, 2);
+      if (!skip(text, ":"))
+        fail();
+      m = number(text, 2, 2);
+      if (!skip(text, ":"))
+        fail();
+      s = number(text, 2, 2);
+    }
+    int us{};
+    if (text.size() >= 7 && text[0] == '.' && (us = digits<6>(text.data() + 1)) >= 0)
+      text.remove_prefix(7);
+    else if (us = 0; skip(text, ".")) {
+      std::size_t count{};
+      us = number(text, 1, 6, &count);
+      for (; count < 6; ++count)
+        us *= 10;
+    }
+    if (m > 59 || s > 59 || h > 24 || (h == 24 && (m || s || us)))
+      fail();
+    return hours{h} + minutes{m} + seconds{s} + microseconds{us};
+  }
+
+  /// @returns The `date` moved to the era of the `BC` suffix if any.
+  static std::chrono::sys_days era(std::chrono::year_month_day date,
+    std::string_view& text)
+  {
+    using namespace std::chrono;
+    if (skip(text, " BC"))
+      date = year{1 - static_cast<int>(date.year())}/date.month()/date.day();
+    if (!date.ok() || !text.empty())
+      fail();
+    return date;
+  }
+
+  /// Appends `date` as `YYYY-MM-DD` to `result`.
+  static void put_date(std::string& result, const std::chrono::year_month_day date)
+  {
+    const int y = static_cast<int>(date.year());
+    put(result, y > 0 ? y : 1 - y, 4);
+    result += '-';
+    put(result, static_cast<unsigned>(date.month()), 2);
+    result += '-';
+    put(result, static_cast<unsigned>(date.day()), 2);
+  }
+
+  /// Appends the era suffix of `date` to `result`.
+  static void put_era(std::string& result, const std::chrono::year_month_day date)
+  {
+    if (static_cast<int>(date.year()) <= 0)
+      result += " BC";
+  }
+
+  /// Appends `value` of at least `width` digits to `result`.
+  static void put(std::string& result, const long long value, const int width)
+  {
+    char buffer[24];
+    const auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    result.append(std::max<std::ptrdiff_t>(width - (end - buffer), 0), '0');
+    result.append(buffer, end);
+  }
+};
+
+/// The implementation of `std::chrono::sys_days` (date) to/from `std::string` conversions.
+struct Date_string_conversions final {
+  using Type = std::chrono::sys_days;
+
+  template<typename ... Types>
+  static Type to_type(const std::string& text, Types&& ...)
+  {
+    return to_type__(text);
+  }
+
+  template<typename ... Types>
+  static std::string to_string(const Type value, Types&& ...)
+  {
+    if (value == Type::max())
+      return "infinity";
+    else if (value == Type::min())
+      return "-infinity";
+
+    std::string result;
+    const std::chrono::year_month_day date{value};
+    Iso_time::put_date(result, date);
+    Iso_time::put_era(result, date);
+    return result;
+  }
+
+private:
+  friend struct Date_data_conversions;
+  friend struct Year_month_day_string_conversions;
+
+  static Type to_type__(std::string_view text)
+  {
+    if (text == "infinity")
+      return Type::max();
+    else if (text == "-infinity")
+      return Type::min();
+
+    const auto date = Iso_time::date(text);
+    return Iso_time::era(date, text);
+  }
+};
+
+/// The implementation of `std::chrono::sys_days` (date) to/from Data conversions.
+struct Date_data_conversions final {
+  using Type = std::chrono::sys_days;
+
+  template<typename ... Types>
+  static Type to_type(const Data& data, Types&& ...)
+  {
+    if (data.format() == Data_format::binary) {
+      if (data.size() != sizeof(std::int32_t))
+        throw Client_exception{"cannot convert to date: invalid input size"};
+
+      const auto days = net::conv<std::int32_t>(data.bytes(), data.size());
+      if (days == std::numeric_limits<std::int32_t>::max())
+        return Type::max();
+      else if (days == std::numeric_limits<std::int32_t>::min())
+        return Type::min();
+      else
+        return postgres_epoch + std::chrono::days{days};
+    } else
+      return Date_string_conversions::to_type__({
+        static_cast<const char*>(data.bytes()), data.size()});
+  }
+
+  template<typename ... Types>
+  static Type to_type(std::unique_ptr<Data>&& data, Types&& ...)
+  {
+    if (!data)
+      throw Client_exception{"cannot convert to date: null data given"};
+    return to_type(*data);
+  }
+
+  template<typename ... Types>
+  static std::unique_ptr<Data> to_data(const Type value, Types&& ...)
+  {
+    return Data::make(Date_string_conversions::to_string(value),
+      Data_format::text);
+  }
+};
+
+/**
+ * @brief The implementation of `std::chrono::year_month_day` (date) to/from
+ * `std::string` conversions.
+ */
+struct Year_month_day_string_conversions final {
+  using Type = std::chrono::year_month_day;
+
+  template<typename ... Types>
+  static Type to_type(const std::string& text, Types&& ...)
+  {
+    return to_type__(Date_string_conversions::to_type__(text));
+  }
+
+  template<typename ... Types>
+  static std::string to_string(const Type value, Types&& ...)
+  {
+    return Date_string_conversions::to_string(std::chrono::sys_days{value});
+  }
+
+private:
+  friend struct Year_month_day_data_conversions;
+
+  /// @returns The `date`, which must be finite.
+  static Type to_type__(const std::chrono::sys_days date)
+  {
+    if (date == std::chrono::sys_days::max() || date == std::chrono::sys_days::min())
+      throw Client_exception{"cannot convert to year_month_day: infinite date"};
+    return Type{date};
+  }
+};
+
+/// The implementation of `std::chrono::year_month_day` (date) to/from Data conversions.
+struct Year_month_day_data_conversions final {
+  using Type = std::chrono::year_month_day;
+
+  template<typename ... Types>
+  static Type to_type(const Data& data, Types&& ...)
+  {
+    return Year_month_day_string_conversions::to_type__(
+      Date_data_conversions::to_type(data));
+  }
+
+  template<typename ... Types>
+  static Type to_type(std::unique_ptr<Data>&& data, Types&& ...)
+  {
+    if (!data)
+      throw Client_exception{"cannot convert to year_month_day: null data given"};
+    return to_type(*data);
+  }
+
+  template<typename ... Types>
+  static std::unique_ptr<Data> to_data(const Type value, Types&& ...)
+  {
+    return Date_data_conversions::to_data(std::chrono::sys_days{value});
+  }
+};
+
+/**
+ * @brief The implementation of `std::chrono::sys_time<std::chrono::microseconds>`
+ * (timestamp, timestamptz) to/from `std::string` conversions.
+ *
+ * @details A timestamp without time zone is taken as one in UTC.
+ */
+struct Timestamp_string_conversions final {
+  using Type = std::chrono::sys_time<std::chrono::microseconds>;
+
+  template<typename ... Types>
+  static Type to_type(const std::string& text, Types&& ...)
+  {
+    return to_type__(text);
+  }
+
+  template<typename ... Types>
+  static std::string to_string(const Type value, Types&& ...)
+  {
+    using namespace std::chrono;
+    if (value == Type::max())
+      return "infinity";
+    else if (value == Type::min())
+      return "-infinity";
+
+    const auto day = floor<days>(value);
+    const year_month_day date{day};
+    const hh_mm_ss time{value - day};
+    std::string result;
+    Iso_time::put_date(result, date);
+    result += ' ';
+    Iso_time::put(result, time.hours().count(), 2);
+    result += ':';
+    Iso_time::put(result, time.minutes().count(), 2);
+    result += ':';
+    Iso_time::put(result, time.seconds().count(), 2);
+    if (const auto micros = time.subseconds().count()) {
+      result += '.';
+      Iso_time::put(result, micros, 6);
+    }
+    result += "+00";
+    Iso_time::put_era(result, date);
+    return result;
+  }
+
+private:
+  friend struct Timestamp_data_conversions;
+
+  static Type to_type__(std::string_view text)
+  {
+    using namespace std::chrono;
+    if (text == "infinity")
+      return Type::max();
+    else if (text == "-infinity")
+      return Type::min();
+
+    const auto date = Iso_time::date(text);
+    if (!Iso_time::skip(text, " ") && !Iso_time::skip(text, "T"))
+      Iso_time::fail();
+    const auto time = Iso_time::time(text);
+
+    seconds offset{};
+    if (!text.empty() && (text[0] == '+' || text[0] == '-')) {
+      const bool negative = text[0] == '-';
+      text.remove_prefix(1);
+      offset = hours{Iso_time::number(text, 2, 2)};
+      if (Iso_time::skip(text, ":"))
+        offset += minutes{Iso_time::number(text, 2, 2)};
+      if (Iso_time::skip(text, ":"))
+        offset += seconds{Iso_time::number(text, 2, 2)};
+      if (negative)
+        offset = -offset;
+    }
+
+    return Iso_time::era(date, text) + time - offset;
+  }
+};
+
+/// The implementation of `std::chrono::sys_time<std::chrono::microseconds>` to/from Data conversions.
+struct Timestamp_data_conversions final {
+  using Type = std::chrono::sys_time<std::chrono::microseconds>;
+
+  template<typename ... Types>
+  static Type to_type(const Data& data, Types&& ...)
+  {
+    using std::chrono::microseconds;
+    if (data.format() == Data_format::binary) {
+      if (data.size() != sizeof(std::int64_t))
+        throw Client_exception{"cannot convert to timestamp: invalid input size"};
+
+      constexpr auto max = std::numeric_limits<std::int64_t>::max();
+      constexpr auto min = std::numeric_limits<std::int64_t>::min();
+      constexpr Type epoch{postgres_epoch};
+      const auto micros = net::conv<std::int64_t>(data.bytes(), data.size());
+      if (micros == max)
+        return Type::max();
+      else if (micros == min)
+        return Type::min();
+      else if (micros > max - epoch.time_since_epoch().count())
+        throw Client_exception{"cannot convert to timestamp: "
+          "value out of range of the type"};
+      else
+        return epoch + microseconds{micros};
+    } else
+      return Timestamp_string_conversions::to_type__({
+        static_cast<const char*>(data.bytes()), data.size()});
+  }
+
+  template<typename ... Types>
+  static Type to_type(std::unique_ptr<Data>&& data, Types&& ...)
+  {
+    if (!data)
+      throw Client_exception{"cannot convert to timestamp: null data given"};
+    return to_type(*data);
+  }
+
+  template<typename ... Types>
+  static std::unique_ptr<Data> to_data(const Type value, Types&& ...)
+  {
+    return Data::make(Timestamp_string_conversions::to_string(value),
+      Data_format::text);
+  }
+};
+
+// -----------------------------------------------------------------------------
+// uuid conversions
+// -----------------------------------------------------------------------------
+
+/// The implementation of Uuid to/from `std::string` conversions.
+struct Uuid_string_conversions final {
+  using Type = std::array<unsigned char, 16>;
+
+  template<typename ... Types>
+  static Type to_type(const std::string& text, Types&& ...)
+  {
+    return to_type__(text);
+  }
+
+  template<typename ... Types>
+  static std::string to_string(const Type& value, Types&& ...)
+  {
+    constexpr const char* digits = "0123456789abcdef";
+    std::string result;
+    result.reserve(36);
+    for (std::size_t i{}; i < value.size(); ++i) {
+      if (i == 4 || i == 6 || i == 8 || i == 10)
+        result += '-';
+      result += digits[value[i] >> 4];
+      result += digits[value[i] & 0xf];
+    }
+    return result;
+  }
+
+private:
+  friend struct Uuid_data_conversions;
+
+  /**
+   * @details Accepts the input forms of PostgreSQL: 32 hex digits, optionally
+   * in braces, with a hyphen allowed after every group of four.
+   */
+  static Type to_type__(std::string_view text)
+  {
+    const auto invalid = []
+    {
+      return Client_exception{"cannot convert to uuid: "
+        "invalid text representation"};
+    };
+    const auto digit = [&invalid](const char c)
+    {
+      if ('0' <= c && c <= '9')
+        return c - '0';
+      else if ('a' <= c && c <= 'f')
+        return c - 'a' + 10;
+      else if ('A' <= c && c <= 'F')
+        return c - 'A' + 10;
+      else
+        throw invalid();
+    };
+
+    if (text.size() >= 2 && text.front() == '{' && text.back() == '}')
+      text = text.substr(1, text.size() - 2);
+
+    Type result{};
+    std::size_t i{};
+    for (std::size_t n{}; n < 32; ++n) {
+      if (n && !(n % 4) && i < text.size() && text[i] == '-')
+        ++i;
+      if (i >= text.size())
+        throw invalid();
+      const auto value = digit(text[i++]);
+      result[n / 2] |= static_cast<unsigned char>(n % 2 ? value : value << 4);
+    }
+    if (i != text.size())
+      throw invalid();
+
+    return result;
+  }
+};
+
+/// The implementation of Uuid to/from Data conversions.
+struct Uuid_data_conversions final {
+  using Type = std::array<unsigned char, 16>;
+
+  template<typename ... Types>
+  static Type to_type(const Data& data, Types&& ...)
+  {
+    const auto* const bytes = static_cast<const char*>(data.bytes());
+    if (data.format() == Data_format::binary) {
+      Type result;
+      if (data.size() != result.size())
+        throw Client_exception{"cannot convert to uuid: invalid input size"};
+      std::memcpy(result.data(), bytes, result.size());
+      return result;
+    } else
+      return Uuid_string_conversions::to_type__({bytes, data.size()});
+  }
+
+  template<typename ... Types>
+  static Type to_type(std::unique_ptr<Data>&& data, Types&& ...)
+  {
+    if (!data)
+      throw Client_exception{"cannot convert to uuid: null data given"};
+    return to_type(*data);
+  }
+
+  template<typename ... Types>
+  static std::unique_ptr<Data> to_data(const Type& value, Types&& ...)
+  {
+    return Data::make(Uuid_string_conversions::to_string(value),
+      Data_format::text);
+  }
+};
+
+#ifdef __SIZEOF_INT128__
+// -----------------------------------------------------------------------------
+// numeric conversions
+// -----------------------------------------------------------------------------
+
+/// The implementation of Decimal to/from `std::string` conversions.
+struct Decimal_string_conversions final {
+  using Type = Decimal;
+
+  template<typename ... Types>
+  static Type to_type(const std::string& text, Types&& ...)
+  {
+    return Type::from_string(text);
+  }
+
+  template<typename ... Types>
+  static std::string to_string(const Type& value, Types&& ...)
+  {
+    return value.to_string();
+  }
+};
+
+/// The implementation of Decimal to/from Data conversions.
+struct Decimal_data_conversions final {
+  using Type = Decimal;
+
+  template<typename ... Types>
+  static Type to_type(const Data& data, Types&& ...)
+  {
+    const auto* const bytes = static_cast<const char*>(data.bytes());
+    if (data.format() == Data_format::binary)
+      return Type::from_numeric_binary(bytes, data.size());
+    else
+      return Type::from_string({bytes, data.size()});
+  }
+
+  template<typename ... Types>
+  static Type to_type(std::unique_ptr<Data>&& data, Types&& ...)
+  {
+    if (!data)
+      throw Client_exception{"cannot convert to decimal: null data given"};
+    return to_type(*data);
+  }
+
+  template<typename ... Types>
+  static std::unique_ptr<Data> to_data(const Type& value, Types&& ...)
+  {
+    return Data::make(value.to_string(), Data_format::text);
+  }
+};
+#endif  // __SIZEOF_INT128__
+
 } // namespace dmitigr::pgfe::detail
 
 namespace dmitigr::pgfe {
@@ -543,6 +1075,32 @@ struct Conversions<std::string_view> final : Basic_conversions<
   std::string_view,
   detail::Forwarding_string_conversions, detail::String_view_data_conversions> {};
 
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for Data_view.
+ *
+ * @details The view refers to the bytes of the data converted, which must
+ * outlive it. (The data of a Row lives as long as the Row.) Thus there is
+ * no conversion from `std::unique_ptr<Data>&&` or strings.
+ */
+template<>
+struct Conversions<Data_view> final {
+  using Type = Data_view;
+
+  template<typename ... Types>
+  static Type to_type(const Data& data, Types&& ...) noexcept
+  {
+    return Data_view{data};
+  }
+
+  template<typename ... Types>
+  static std::unique_ptr<Data> to_data(const Type& value, Types&& ...)
+  {
+    return value.to_data();
+  }
+};
+
 /**
  * @ingroup conversions
  *
@@ -575,6 +1133,41 @@ struct Conversions<long int> final : Numeric_conversions<long int> {};
 template<>
 struct Conversions<long long int> final : Numeric_conversions<long long int> {};
 
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for `unsigned short int`.
+ */
+template<>
+struct Conversions<unsigned short int> final
+  : Numeric_conversions<unsigned short int> {};
+
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for `unsigned int`.
+ */
+template<>
+struct Conversions<unsigned int> final : Numeric_conversions<unsigned int> {};
+
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for `unsigned long int`.
+ */
+template<>
+struct Conversions<unsigned long int> final
+  : Numeric_conversions<unsigned long int> {};
+
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for `unsigned long long int`.
+ */
+template<>
+struct Conversions<unsigned long long int> final
+  : Numeric_conversions<unsigned long long int> {};
+
 /**
  * @ingroup conversions
  *
@@ -631,6 +1224,94 @@ template<>
 struct Conversions<bool> final : Basic_conversions<bool,
   detail::Bool_string_conversions, detail::Bool_data_conversions> {};
 
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for `std::chrono::sys_days`,
+ * the native type of `date`.
+ *
+ * @details Support of the following data formats is implemented for:
+ *   - input data  - Data_format::text (`DateStyle = ISO`), Data_format::binary;
+ *   - output data - Data_format::text.
+ *
+ * The infinities are represented by `max()` and `min()`.
+ */
+template<>
+struct Conversions<std::chrono::sys_days> final
+  : Basic_conversions<std::chrono::sys_days,
+    detail::Date_string_conversions, detail::Date_data_conversions> {};
+
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for `std::chrono::year_month_day`,
+ * the calendar form of `date`.
+ *
+ * @details Support of the following data formats is implemented for:
+ *   - input data  - Data_format::text (`DateStyle = ISO`), Data_format::binary;
+ *   - output data - Data_format::text.
+ *
+ * The infinities can't be represented, and are not converted.
+ */
+template<>
+struct Conversions<std::chrono::year_month_day> final
+  : Basic_conversions<std::chrono::year_month_day,
+    detail::Year_month_day_string_conversions,
+    detail::Year_month_day_data_conversions> {};
+
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for
+ * `std::chrono::sys_time<std::chrono::microseconds>`, the native type of
+ * `timestamp` and `timestamptz`.
+ *
+ * @details Support of the following data formats is implemented for:
+ *   - input data  - Data_format::text (`DateStyle = ISO`), Data_format::binary;
+ *   - output data - Data_format::text, in UTC.
+ *
+ * A `timestamp` is taken as one in UTC. The infinities are represented by
+ * `max()` and `min()`.
+ */
+template<>
+struct Conversions<std::chrono::sys_time<std::chrono::microseconds>> final
+  : Basic_conversions<std::chrono::sys_time<std::chrono::microseconds>,
+    detail::Timestamp_string_conversions, detail::Timestamp_data_conversions> {};
+
+/// The native type of `uuid`: the 16 bytes of it in network order.
+using Uuid = std::array<unsigned char, 16>;
+
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for Uuid.
+ *
+ * @details Support of the following data formats is implemented for:
+ *   - input data  - Data_format::text, Data_format::binary;
+ *   - output data - Data_format::text.
+ */
+template<>
+struct Conversions<Uuid> final : Basic_conversions<Uuid,
+  detail::Uuid_string_conversions, detail::Uuid_data_conversions> {};
+
+#ifdef __SIZEOF_INT128__
+/**
+ * @ingroup conversions
+ *
+ * @brief Full specialization of Conversions for Decimal, the native type of
+ * `numeric`.
+ *
+ * @details Support of the following data formats is implemented for:
+ *   - input data  - Data_format::text, Data_format::binary;
+ *   - output data - Data_format::text.
+ *
+ * The binary format of the output is Decimal::to_numeric_binary().
+ */
+template<>
+struct Conversions<Decimal> final : Basic_conversions<Decimal,
+  detail::Decimal_string_conversions, detail::Decimal_data_conversions> {};
+#endif  // __SIZEOF_INT128__
+
 /**
  * @ingroup conversions
  *
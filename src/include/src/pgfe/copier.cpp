@@ -97,6 +97,8 @@ DMITIGR_PGFE_INLINE bool Copier::send(const std::string_view data) const
   check_send();
 
   const int r{PQputCopyData(connection().conn(), data.data(), static_cast<int>(data.size()))};
+  if (r == 1)
+    record_chunk(Data_direction::to_server, static_cast<int>(data.size()));
   if (r == 0 || r == 1)
     return r;
   else if (r == -1)
@@ -130,6 +132,7 @@ DMITIGR_PGFE_INLINE Data_view Copier::receive(const bool wait) const
   buffer_ = decltype(buffer_){nullptr, &dummy_free};
   char* buffer{};
   const int size{PQgetCopyData(connection().conn(), &buffer, !wait)};
+  record_chunk(Data_direction::from_server, size);
   if (buffer)
     buffer_ = decltype(buffer_){buffer, &PQfreemem};
   DMITIGR_ASSERT(!buffer_ || size > 0);
@@ -147,6 +150,61 @@ DMITIGR_PGFE_INLINE Data_view Copier::receive(const bool wait) const
   DMITIGR_ASSERT(false);
 }
 
+DMITIGR_PGFE_INLINE bool Copier::receive(std::string& buffer,
+  const bool wait) const
+{
+  check_receive();
+
+  char* data{};
+  const int size{PQgetCopyData(connection().conn(), &data, !wait)};
+  record_chunk(Data_direction::from_server, size);
+  const std::unique_ptr<char, void(*)(void*)> storage{data, &PQfreemem};
+  DMITIGR_ASSERT(!storage || size > 0);
+
+  if (size == -1)
+    return false;
+  else if (size >= 0) {
+    buffer.append(storage.get(), static_cast<std::size_t>(size));
+    return true;
+  } else if (size == -2)
+    throw Client_exception{connection().error_message()};
+
+  DMITIGR_ASSERT(false);
+}
+
+DMITIGR_PGFE_INLINE std::unique_ptr<Data>
+Copier::receive_data(const bool wait) const
+{
+  check_receive();
+
+  char* buffer{};
+  const int size{PQgetCopyData(connection().conn(), &buffer, !wait)};
+  record_chunk(Data_direction::from_server, size);
+  std::unique_ptr<void, void(*)(void*)> storage{buffer, &PQfreemem};
+  DMITIGR_ASSERT(!storage || size > 0);
+
+  if (size == -1)
+    return nullptr;
+  else if (size >= 0)
+    return Data::make(std::move(storage), static_cast<std::size_t>(size),
+      data_format(0));
+  else if (size == -2)
+    throw Client_exception{connection().error_message()};
+
+  DMITIGR_ASSERT(false);
+}
+
+DMITIGR_PGFE_INLINE Task<Data_view> Copier::async_receive(Reactor& reactor) const
+{
+  while (true) {
+    if (auto result = receive(false); !result || result.size())
+      co_return result;
+    auto& conn = const_cast<Copier*>(this)->connection();
+    co_await reactor.readiness(conn.socket(), Socket_readiness::read_ready);
+    conn.read_input();
+  }
+}
+
 DMITIGR_PGFE_INLINE const Connection& Copier::connection() const
 {
   if (is_valid())
@@ -174,4 +232,18 @@ void Copier::check_receive() const
       "wrong data direction"};
 }
 
+DMITIGR_PGFE_INLINE void
+Copier::record_chunk(const Data_direction direction, const int size) const noexcept
+{
+  if (const auto& stats = (*connection_)->stats_; stats && size > 0) {
+    if (direction == Data_direction::to_server) {
+      stats->copy_chunks_sent.fetch_add(1, std::memory_order_relaxed);
+      stats->bytes_sent.fetch_add(size, std::memory_order_relaxed);
+    } else {
+      stats->copy_chunks_received.fetch_add(1, std::memory_order_relaxed);
+      stats->bytes_received.fetch_add(size, std::memory_order_relaxed);
+    }
+  }
+}
+
 } // namespace dmitigr::pgfe
@@ -17,12 +17,14 @@
 #ifndef DMITIGR_PGFE_COPIER_HPP
 #define DMITIGR_PGFE_COPIER_HPP
 
+#include "async.hpp"
 #include "data.hpp"
 #include "dll.hpp"
 #include "pq.hpp"
 #include "response.hpp"
 
 #include <memory>
+#include <string>
 
 namespace dmitigr::pgfe {
 
@@ -147,6 +149,53 @@ public:
    */
   DMITIGR_PGFE_API Data_view receive(bool wait = true) const;
 
+  /**
+   * @brief Receives data from the server like receive() does, but appends it
+   * to the `buffer` instead, so data rows can be gathered in a buffer owned
+   * by the caller.
+   *
+   * @par Requires
+   * `data_direction() == Data_direction::from_server`.
+   *
+   * @returns `false` if the `COPY` command is done. Returns `true` if either
+   * the data was appended, or no row is yet available (this is only possible
+   * when `wait` is `false`, and the `buffer` is unchanged then).
+   *
+   * @see receive().
+   */
+  DMITIGR_PGFE_API bool receive(std::string& buffer, bool wait = true) const;
+
+  /**
+   * @brief Receives data from the server like receive() does, but hands the
+   * ownership of the buffer allocated by libpq out instead of copying it.
+   *
+   * @par Requires
+   * `data_direction() == Data_direction::from_server`.
+   *
+   * @returns Either:
+   *   - `nullptr` if the `COPY` command is done;
+   *   - the empty instance to indicate that the `COPY` is undone, but no row
+   *   is yet available (this is only possible when `wait` is `false`);
+   *   - the non-empty instance received from the server, which outlives this
+   *   instance as well as the connection.
+   *
+   * @see receive().
+   */
+  DMITIGR_PGFE_API std::unique_ptr<Data> receive_data(bool wait = true) const;
+
+  /**
+   * @brief Receives data from the server like receive() does, but suspends
+   * the calling coroutine instead of blocking the thread.
+   *
+   * @returns Either:
+   *   - invalid instance if the `COPY` command is done;
+   *   - the non-empty instance received from the server, valid until the
+   *   next receiving.
+   *
+   * @see receive(), Reactor.
+   */
+  DMITIGR_PGFE_API Task<Data_view> async_receive(Reactor& reactor) const;
+
   /**
    * @returns The underlying connection instance.
    *
@@ -172,6 +221,7 @@ private:
   static void dummy_free(void*) noexcept {};
   void check_send() const;
   void check_receive() const;
+  void record_chunk(Data_direction direction, int size) const noexcept;
 };
 
 /**
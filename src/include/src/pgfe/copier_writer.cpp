@@ -0,0 +1,159 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../str/escape.hpp"
+#include "copier_writer.hpp"
+#include "exceptions.hpp"
+
+namespace dmitigr::pgfe {
+
+DMITIGR_PGFE_INLINE Copier_writer::Copier_writer(Copier&& copier,
+  const std::size_t capacity)
+  : copier_{std::move(copier)}
+  , capacity_{capacity}
+{
+  if (!copier_ || copier_.data_direction() != Data_direction::to_server)
+    throw Client_exception{"cannot create copier writer: invalid copier"};
+  else if (!capacity_)
+    throw Client_exception{"cannot create copier writer: zero capacity"};
+  buffer_.reserve(capacity_);
+}
+
+DMITIGR_PGFE_INLINE bool Copier_writer::is_valid() const noexcept
+{
+  return copier_.is_valid();
+}
+
+DMITIGR_PGFE_INLINE const Copier& Copier_writer::copier() const noexcept
+{
+  return copier_;
+}
+
+DMITIGR_PGFE_INLINE Copier& Copier_writer::copier() noexcept
+{
+  return copier_;
+}
+
+DMITIGR_PGFE_INLINE std::size_t Copier_writer::capacity() const noexcept
+{
+  return capacity_;
+}
+
+DMITIGR_PGFE_INLINE std::size_t Copier_writer::size() const noexcept
+{
+  return buffer_.size();
+}
+
+DMITIGR_PGFE_INLINE bool Copier_writer::append(const std::string_view data)
+{
+  check_valid();
+  if (buffer_.size() + data.size() > capacity_ && !flush()) {
+    buffer_.append(data);
+    return false;
+  }
+
+  if (data.size() >= capacity_ && copier_.send(data))
+    return true;
+
+  buffer_.append(data);
+  return buffer_.size() < capacity_ || flush();
+}
+
+DMITIGR_PGFE_INLINE bool Copier_writer::flush()
+{
+  check_valid();
+  if (buffer_.empty())
+    return true;
+  else if (!copier_.send(buffer_))
+    return false;
+
+  buffer_.clear();
+  return true;
+}
+
+DMITIGR_PGFE_INLINE bool Copier_writer::end(const std::string& error_message)
+{
+  check_valid();
+  if (error_message.empty()) {
+    if (row_format_ == Data_format::binary) {
+      append_binary_integer__(std::int16_t{-1}); // the trailer
+      row_format_.reset(); // appended once even if end() is called again
+    }
+    if (!flush())
+      return false;
+  }
+
+  if (!copier_.end(error_message))
+    return false;
+
+  buffer_.clear();
+  row_format_.reset();
+  copier_ = Copier{};
+  return true;
+}
+
+DMITIGR_PGFE_INLINE void Copier_writer::check_valid() const
+{
+  if (!is_valid())
+    throw Client_exception{"invalid copier writer"};
+}
+
+DMITIGR_PGFE_INLINE void
+Copier_writer::check_row_format__(const Data_format format)
+{
+  if (!row_format_) {
+    row_format_ = format;
+    if (format == Data_format::binary) {
+      // The signature, the flags and the length of the header extension.
+      buffer_.append("PGCOPY\n\377\r\n\0", 11);
+      append_binary_integer__(std::int32_t{});
+      append_binary_integer__(std::int32_t{});
+    }
+  } else if (*row_format_ != format)
+    throw Client_exception{"cannot append rows of both text and binary "
+      "formats to COPY"};
+}
+
+DMITIGR_PGFE_INLINE void
+Copier_writer::append_escaped__(const std::string_view value)
+{
+  const auto size = buffer_.size();
+  buffer_.resize(size + str::escaped_size_max(value.size()));
+  const char* const end = str::escape_copy_text(value, buffer_.data() + size);
+  buffer_.resize(static_cast<std::size_t>(end - buffer_.data()));
+}
+
+DMITIGR_PGFE_INLINE void Copier_writer::append_data__(const Data& value)
+{
+  if (!value)
+    buffer_.append("\\N");
+  else if (value.format() != Data_format::text)
+    throw Client_exception{"cannot append binary data to row of COPY"};
+  else
+    append_escaped__({static_cast<const char*>(value.bytes()), value.size()});
+}
+
+DMITIGR_PGFE_INLINE void Copier_writer::append_binary_data__(const Data& value)
+{
+  if (!value)
+    append_binary_integer__(std::int32_t{-1});
+  else if (value.format() != Data_format::binary)
+    throw Client_exception{"cannot append text data to binary row of COPY"};
+  else
+    append_binary_bytes__({static_cast<const char*>(value.bytes()), value.size()});
+}
+
+} // namespace dmitigr::pgfe
@@ -0,0 +1,380 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_COPIER_WRITER_HPP
+#define DMITIGR_PGFE_COPIER_WRITER_HPP
+
+#include "../net/conversions.hpp"
+#include "conversions.hpp"
+#include "conversions_api.hpp"
+#include "copier.hpp"
+#include "data.hpp"
+#include "dll.hpp"
+#include "exceptions.hpp"
+#include "types_fwd.hpp"
+
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace dmitigr::pgfe {
+
+namespace detail {
+
+/// The trait to detect `std::optional`.
+template<typename T>
+struct Is_optional final : std::false_type {};
+
+/// The specialization for `std::optional`.
+template<typename T>
+struct Is_optional<std::optional<T>> final : std::true_type {};
+
+} // namespace detail
+
+/**
+ * @ingroup main
+ *
+ * @brief A writer of the data of `COPY ... FROM STDIN` which gathers it into
+ * large messages.
+ *
+ * @details Each call of Copier::send() costs a call of libpq and, possibly,
+ * a write to the socket. The writer appends the data to the buffer instead,
+ * and sends the buffer as a single message once it's filled up to the
+ * capacity. The rows appended by append_row() are encoded in the text format
+ * of `COPY` right into the buffer, the ones appended by append_binary_row()
+ * in the binary format, for `COPY ... FROM STDIN (FORMAT binary)`.
+ *
+ * If Connection::is_nio_output_enabled() the appending functions return
+ * `false` when the output buffers of libpq are full. The data is kept in the
+ * buffer then, and the caller should call Connection::flush_output() and
+ * flush() until the latter returns `true` before appending more.
+ *
+ * @see Copier.
+ */
+class Copier_writer final {
+public:
+  /// The default capacity of the buffer.
+  static constexpr std::size_t default_capacity{1024 * 1024};
+
+  /// Default-constructible. (Constructs invalid instance.)
+  Copier_writer() = default;
+
+  /**
+   * @brief The constructor.
+   *
+   * @par Requires
+   * `copier.data_direction() == Data_direction::to_server && capacity > 0`.
+   */
+  DMITIGR_PGFE_API explicit Copier_writer(Copier&& copier,
+    std::size_t capacity = default_capacity);
+
+  /// Not copy-constructible.
+  Copier_writer(const Copier_writer&) = delete;
+
+  /// Move-constructible.
+  Copier_writer(Copier_writer&&) = default;
+
+  /// Not copy-assignable.
+  Copier_writer& operator=(const Copier_writer&) = delete;
+
+  /// Move-assignable.
+  Copier_writer& operator=(Copier_writer&&) = default;
+
+  /// @returns `true` if the instance is valid.
+  DMITIGR_PGFE_API bool is_valid() const noexcept;
+
+  /// @returns `true` if the instance is valid.
+  explicit operator bool() const noexcept
+  {
+    return is_valid();
+  }
+
+  /// @returns The copier.
+  DMITIGR_PGFE_API const Copier& copier() const noexcept;
+
+  /// @overload
+  DMITIGR_PGFE_API Copier& copier() noexcept;
+
+  /// @returns The size of the buffer to be filled before sending.
+  DMITIGR_PGFE_API std::size_t capacity() const noexcept;
+
+  /// @returns The number of bytes buffered.
+  DMITIGR_PGFE_API std::size_t size() const noexcept;
+
+  /**
+   * @brief Appends the data as is.
+   *
+   * @details The data which is not less than the capacity is sent without
+   * copying once the buffered data is sent.
+   *
+   * @returns `false` if the data is buffered, but the buffer must be flushed.
+   *
+   * @par Requires
+   * `is_valid()`.
+   */
+  DMITIGR_PGFE_API bool append(std::string_view data);
+
+  /**
+   * @brief Appends a row of `fields` in the text format of `COPY`.
+   *
+   * @details The fields of type `std::string`, `std::string_view`, character
+   * pointer, Data and arithmetic types are encoded straight into the buffer.
+   * The rest are converted by to_data(). The null pointers, the empty
+   * `std::optional` and the invalid Data are written as nulls.
+   *
+   * @returns `false` if the row is buffered, but the buffer must be flushed.
+   *
+   * @par Requires
+   * `is_valid()`, no field is of the binary format, and no row is appended
+   * by append_binary_row().
+   */
+  template<typename ... Types>
+  bool append_row(const Types& ... fields)
+  {
+    check_valid();
+    check_row_format__(Data_format::text);
+    std::size_t index{};
+    (append_field__(fields, index++), ...);
+    buffer_.push_back('\n');
+    return buffer_.size() < capacity_ || flush();
+  }
+
+  /**
+   * @brief Appends a row of `fields` in the binary format of `COPY`, which the
+   * server stores without parsing.
+   *
+   * @details The first row is preceded by the header of the format, and end()
+   * appends the trailer. The fields are encoded as follows:
+   *   - `bool` as `boolean`;
+   *   - the integers of 2, 4 and 8 bytes as `int2`, `int4` and `int8`;
+   *   - `float` and `double` as `float4` and `float8`;
+   *   - `std::string`, `std::string_view` and character pointers as they are,
+   *   as of `text` or `bytea`;
+   *   - `std::chrono::sys_days` and `std::chrono::year_month_day` as `date`;
+   *   - `std::chrono::sys_time<std::chrono::microseconds>` as `timestamp` or
+   *   `timestamptz`;
+   *   - Uuid as `uuid`, Decimal as `numeric`;
+   *   - Data of the binary format as it is;
+   *   - the rest by to_data(), which must give the binary format.
+   * The nulls are as of append_row(). The server refuses a field of the size
+   * other than of its column's type.
+   *
+   * @returns `false` if the row is buffered, but the buffer must be flushed.
+   *
+   * @par Requires
+   * `is_valid()`, and no row is appended by append_row().
+   */
+  template<typename ... Types>
+  bool append_binary_row(const Types& ... fields)
+  {
+    check_valid();
+    check_row_format__(Data_format::binary);
+    append_binary_integer__(static_cast<std::int16_t>(sizeof...(fields)));
+    (append_binary_field__(fields), ...);
+    return buffer_.size() < capacity_ || flush();
+  }
+
+  /**
+   * @brief Sends the buffered data.
+   *
+   * @returns `true` if the buffer is empty. Returns `false` if the output
+   * buffers of libpq are full and need to be flushed (it's possible only if
+   * Connection::is_nio_output_enabled() returns `true`).
+   *
+   * @par Requires
+   * `is_valid()`.
+   *
+   * @see Connection::flush_output().
+   */
+  DMITIGR_PGFE_API bool flush();
+
+  /**
+   * @brief Sends the buffered data and the end-of-data indication.
+   *
+   * @returns `true` if the indication was sent as with Copier::end().
+   * Returns `false` if the output buffers need to be flushed before calling
+   * this function again.
+   *
+   * @par Requires
+   * `is_valid()`.
+   *
+   * @par Effects
+   * `!is_valid()` if `true` is returned.
+   *
+   * @see Copier::end().
+   */
+  DMITIGR_PGFE_API bool end(const std::string& error_message = {});
+
+private:
+  Copier copier_;
+  std::size_t capacity_{};
+  std::string buffer_;
+  std::optional<Data_format> row_format_; // of the rows appended
+
+  void check_valid() const;
+  void check_row_format__(Data_format format);
+  void append_escaped__(std::string_view value);
+  void append_data__(const Data& value);
+  void append_binary_data__(const Data& value);
+
+  /// Appends `value` in network byte order.
+  template<typename T>
+  void append_binary_integer__(const T value)
+  {
+    const auto size = buffer_.size();
+    buffer_.resize(size + sizeof(T));
+    net::copy(buffer_.data() + size, value);
+  }
+
+  void append_binary_bytes__(const std::string_view value)
+  {
+    if (value.size() > static_cast<std::size_t>(std::numeric_limits<std::int32_t>::max()))
+      throw Client_exception{"cannot append too large field to row of COPY"};
+    append_binary_integer__(static_cast<std::int32_t>(value.size()));
+    buffer_.append(value);
+  }
+
+  template<typename T>
+  void append_binary_field__(const T& value)
+  {
+    using std::chrono::sys_days;
+    using Timestamp = std::chrono::sys_time<std::chrono::microseconds>;
+    constexpr std::int32_t null{-1};
+    if constexpr (std::is_same_v<T, std::nullptr_t>) {
+      append_binary_integer__(null);
+    } else if constexpr (std::is_same_v<T, bool>) {
+      append_binary_integer__(std::int32_t{1});
+      buffer_.push_back(value ? '\1' : '\0');
+    } else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, char>) {
+      static_assert(sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8,
+        "an integer field must be of 2, 4 or 8 bytes");
+      append_binary_integer__(static_cast<std::int32_t>(sizeof(T)));
+      append_binary_integer__(value);
+    } else if constexpr (std::is_floating_point_v<T>) {
+      static_assert(sizeof(T) == 4 || sizeof(T) == 8,
+        "a floating point field must be of 4 or 8 bytes");
+      append_binary_integer__(static_cast<std::int32_t>(sizeof(T)));
+      append_binary_integer__(value);
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+      if constexpr (std::is_pointer_v<T>) {
+        if (!value) {
+          append_binary_integer__(null);
+          return;
+        }
+      }
+      append_binary_bytes__(std::string_view{value});
+    } else if constexpr (std::is_same_v<T, sys_days> ||
+      std::is_same_v<T, std::chrono::year_month_day>) {
+      const sys_days date{value};
+      constexpr auto max = std::numeric_limits<std::int32_t>::max();
+      constexpr auto min = std::numeric_limits<std::int32_t>::min();
+      append_binary_integer__(std::int32_t{4});
+      append_binary_integer__(date == sys_days::max() ? max :
+        date == sys_days::min() ? min :
+        static_cast<std::int32_t>((date - detail::postgres_epoch).count()));
+    } else if constexpr (std::is_same_v<T, Timestamp>) {
+      constexpr Timestamp epoch{detail::postgres_epoch};
+      constexpr auto max = std::numeric_limits<std::int64_t>::max();
+      constexpr auto min = std::numeric_limits<std::int64_t>::min();
+      append_binary_integer__(std::int32_t{8});
+      append_binary_integer__(value == Timestamp::max() ? max :
+        value == Timestamp::min() ? min :
+        static_cast<std::int64_t>((value - epoch).count()));
+    } else if constexpr (std::is_same_v<T, std::array<unsigned char, 16>>) {
+      append_binary_bytes__({reinterpret_cast<const char*>(value.data()),
+        value.size()});
+#ifdef __SIZEOF_INT128__
+    } else if constexpr (std::is_same_v<T, Decimal>) {
+      // The size is known once the value is appended after it.
+      const auto size = buffer_.size();
+      append_binary_integer__(null);
+      value.to_numeric_binary(buffer_);
+      net::copy(buffer_.data() + size,
+        static_cast<std::int32_t>(buffer_.size() - size - sizeof(null)));
+#endif
+    } else if constexpr (std::is_base_of_v<Data, T>) {
+      append_binary_data__(value);
+    } else if constexpr (detail::Is_optional<T>::value) {
+      if (value)
+        append_binary_field__(*value);
+      else
+        append_binary_integer__(null);
+    } else {
+      const auto data = to_data(value);
+      if (data)
+        append_binary_data__(*data);
+      else
+        append_binary_integer__(null);
+    }
+  }
+
+  template<typename T>
+  void append_field__(const T& value, const std::size_t index)
+  {
+    if (index)
+      buffer_.push_back('\t');
+
+    if constexpr (std::is_same_v<T, std::nullptr_t>) {
+      buffer_.append("\\N");
+    } else if constexpr (std::is_same_v<T, bool>) {
+      buffer_.push_back(value ? 't' : 'f');
+    } else if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, char>) {
+      const auto size = buffer_.size();
+      buffer_.resize(size + 64);
+      const auto [end, ec] = std::to_chars(buffer_.data() + size,
+        buffer_.data() + buffer_.size(), value);
+      if (ec != std::errc{})
+        throw Client_exception{"cannot convert number to string"};
+      buffer_.resize(end - buffer_.data());
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+      if constexpr (std::is_pointer_v<T>) {
+        if (!value) {
+          buffer_.append("\\N");
+          return;
+        }
+      }
+      append_escaped__(std::string_view{value});
+    } else if constexpr (std::is_base_of_v<Data, T>) {
+      append_data__(value);
+    } else if constexpr (detail::Is_optional<T>::value) {
+      if (value)
+        append_field__(*value, 0);
+      else
+        buffer_.append("\\N");
+    } else {
+      const auto data = to_data(value);
+      if (data)
+        append_data__(*data);
+      else
+        buffer_.append("\\N");
+    }
+  }
+};
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "copier_writer.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_COPIER_WRITER_HPP
@@ -14,6 +14,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "../str/hex.hpp"
 #include "data.hpp"
 #include "exceptions.hpp"
 #include "pq.hpp"
@@ -21,7 +22,7 @@
 #include <algorithm> // swap
 #include <cassert>
 #include <cstring>
-#include <new> // bad_alloc
+#include <new> // bad_alloc, destroying_delete_t
 
 namespace dmitigr::pgfe::detail {
 
@@ -128,6 +129,79 @@ using custom_memory_Data = memory_Data<void, void(*)(void*)>;
 
 // =============================================================================
 
+/// The implementation of Data allocated along with the bytes from a resource.
+class resource_Data final : public Data {
+public:
+  static std::unique_ptr<Data> make(const std::string_view bytes,
+    const Format format, std::pmr::memory_resource& resource)
+  {
+    void* const block = resource.allocate(allocation_size(bytes.size()),
+      alignof(resource_Data));
+    char* const storage = static_cast<char*>(block) + sizeof(resource_Data);
+    if (!bytes.empty())
+      std::memcpy(storage, bytes.data(), bytes.size());
+    storage[bytes.size()] = '\0';
+    return std::unique_ptr<Data>{new (block)
+      resource_Data{resource, bytes.size(), format}};
+  }
+
+  /// Destroys the instance and returns its block to the resource.
+  void operator delete(resource_Data* const data, std::destroying_delete_t)
+  {
+    auto& resource = *data->resource_;
+    const auto size = allocation_size(data->size_);
+    data->~resource_Data();
+    resource.deallocate(data, size, alignof(resource_Data));
+  }
+
+  std::unique_ptr<Data> to_data() const override
+  {
+    return Data::make(std::string_view{static_cast<const char*>(bytes()), size_},
+      format_);
+  }
+
+  Format format() const noexcept override
+  {
+    return format_;
+  }
+
+  std::size_t size() const noexcept override
+  {
+    return size_;
+  }
+
+  bool is_empty() const noexcept override
+  {
+    return (size() == 0);
+  }
+
+  const void* bytes() const noexcept override
+  {
+    return reinterpret_cast<const char*>(this) + sizeof(resource_Data);
+  }
+
+private:
+  std::pmr::memory_resource* resource_{};
+  std::size_t size_{};
+  const Format format_{Format::text};
+
+  resource_Data(std::pmr::memory_resource& resource, const std::size_t size,
+    const Format format) noexcept
+    : resource_{&resource}
+    , size_{size}
+    , format_{format}
+  {
+    assert(is_invariant_ok());
+  }
+
+  static std::size_t allocation_size(const std::size_t size) noexcept
+  {
+    return sizeof(resource_Data) + size + 1;
+  }
+};
+
+// =============================================================================
+
 /// The implementation of empty Data.
 class empty_Data final : public Data {
 public:
@@ -176,12 +250,26 @@ namespace dmitigr::pgfe {
 
 namespace {
 
-inline std::unique_ptr<pgfe::Data> to_bytea__(const void* const text)
+/**
+ * @par Requires
+ * `text` is followed by the zero byte.
+ */
+inline std::unique_ptr<pgfe::Data> to_bytea__(const std::string_view text)
 {
-  if (!text)
-    throw Client_exception{"cannot convert data to bytea: null input data"};
+  // The hex format is decoded by pgfe without extra copying.
+  if (text.size() >= 2 && text[0] == '\\' && text[1] == 'x') {
+    const auto hex = text.substr(2);
+    const auto size = hex.size() / 2;
+    std::unique_ptr<char[]> storage{new char[size + 1]};
+    if (str::decode_hex(hex, storage.get())) {
+      storage[size] = '\0';
+      return std::make_unique<detail::array_memory_Data>(std::move(storage),
+        size, pgfe::Data_format::binary);
+    }
+  }
 
-  const auto* const bytes = static_cast<const unsigned char*>(text);
+  // The escape format or the hex one with whitespaces.
+  const auto* const bytes = reinterpret_cast<const unsigned char*>(text.data());
   std::size_t storage_size{};
   using Uptr = std::unique_ptr<void, void(*)(void*)>;
   if (auto storage = Uptr{PQunescapeBytea(bytes, &storage_size), &PQfreemem})
@@ -200,24 +288,29 @@ DMITIGR_PGFE_INLINE bool Data::is_valid() const noexcept
 
 DMITIGR_PGFE_INLINE std::unique_ptr<Data> Data::to_bytea() const
 {
-  if (!((format() == Data_format::text)
+  if (format() == Data_format::binary)
+    return to_data();
+  else if (!((format() == Data_format::text)
       && bytes() && (static_cast<const char*>(bytes())[size()] == 0)))
     throw Client_exception{"cannot convert data to bytea:"
       " invalid input data format"};
 
-  return to_bytea__(bytes());
+  return to_bytea__({static_cast<const char*>(bytes()), size()});
 }
 
 DMITIGR_PGFE_INLINE std::unique_ptr<Data>
 Data::to_bytea(const char* const text_data)
 {
+  if (!text_data)
+    throw Client_exception{"cannot convert data to bytea: null input data"};
+
   return to_bytea__(text_data);
 }
 
 DMITIGR_PGFE_INLINE std::unique_ptr<Data>
 Data::to_bytea(const std::string& text_data)
 {
-  return to_bytea__(text_data.c_str());
+  return to_bytea__(text_data);
 }
 
 DMITIGR_PGFE_INLINE bool Data::is_invariant_ok() const
@@ -256,6 +349,13 @@ Data::make(const std::string_view bytes, const Data_format format)
     return std::make_unique<detail::empty_Data>(format);
 }
 
+DMITIGR_PGFE_INLINE std::unique_ptr<Data>
+Data::make(const std::string_view bytes, const Data_format format,
+  std::pmr::memory_resource& resource)
+{
+  return detail::resource_Data::make(bytes, format, resource);
+}
+
 DMITIGR_PGFE_INLINE std::unique_ptr<Data>
 Data::make_no_copy(const std::string_view bytes, const Data_format format)
 {
@@ -24,6 +24,7 @@
 #include <cstddef>
 #include <cstring>
 #include <memory>
+#include <memory_resource>
 #include <string>
 #include <string_view>
 
@@ -84,6 +85,22 @@ public:
     std::string_view bytes,
     Data_format format = Data_format::text);
 
+  /**
+   * @overload
+   *
+   * @details The instance and the copy of `bytes` are placed in a single
+   * block allocated from `resource`, and the block is returned to `resource`
+   * on the destruction. Thus, the data of many values can be allocated at
+   * once by `std::pmr::monotonic_buffer_resource` and released with it.
+   *
+   * @par Requires
+   * `resource` outlives the instance.
+   */
+  static DMITIGR_PGFE_API std::unique_ptr<Data> make(
+    std::string_view bytes,
+    Data_format format,
+    std::pmr::memory_resource& resource);
+
   /**
    * @returns A new instance of this class.
    *
@@ -98,10 +115,12 @@ public:
 
   /**
    * @returns The result of conversion of text representation of the
-   * PostgreSQL's Bytea data type to a plain binary data.
+   * PostgreSQL's Bytea data type to a plain binary data, or the copy of
+   * this instance if it's already in Data_format::binary format.
    *
    * @par Requires
-   * `(format() == Data_format::text) && (bytes()[size()] == 0)`.
+   * `(format() == Data_format::binary) ||
+   * ((format() == Data_format::text) && (bytes()[size()] == 0))`.
    */
   DMITIGR_PGFE_API std::unique_ptr<Data> to_bytea() const;
 
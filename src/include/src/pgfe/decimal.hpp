@@ -0,0 +1,326 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef DMITIGR_PGFE_DECIMAL_HPP
+#define DMITIGR_PGFE_DECIMAL_HPP
+
+#include "../net/conversions.hpp"
+#include "exceptions.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#ifdef __SIZEOF_INT128__
+
+namespace dmitigr::pgfe {
+
+namespace detail {
+/// The powers of 10 which fit into a Decimal.
+inline constexpr auto decimal_powers_of_10 = []
+{
+  std::array<__int128, 39> result{1};
+  for (std::size_t i{1}; i < result.size(); ++i)
+    result[i] = result[i - 1] * 10;
+  return result;
+}();
+} // namespace detail
+
+/**
+ * @ingroup conversions
+ *
+ * @brief A fixed-point decimal number: `unscaled() * 10^-scale()`, of up to
+ * `max_digits` significant digits.
+ *
+ * @details It's the exact native type of `numeric` within those bounds, and it
+ * is converted from and to both the text and the binary formats of `numeric`
+ * without going through a floating point number.
+ *
+ * @remarks Equality compares the representations, so `1.0` and `1.00` differ;
+ * rescale() them first to compare the values.
+ */
+class Decimal final {
+public:
+  /// The type of the unscaled value.
+  using Unscaled = __int128;
+
+  /// The maximum number of digits, and the maximum scale.
+  static constexpr int max_digits{38};
+
+  /// Constructs zero.
+  constexpr Decimal() noexcept = default;
+
+  /**
+   * @brief The constructor.
+   *
+   * @par Requires
+   * `(0 <= scale && scale <= max_digits)` and `unscaled` of at most
+   * `max_digits` digits.
+   */
+  Decimal(const Unscaled unscaled, const int scale)
+    : unscaled_{unscaled}
+    , scale_{static_cast<std::int16_t>(scale)}
+  {
+    if (!(0 <= scale && scale <= max_digits) ||
+      !(-max_unscaled() <= unscaled && unscaled <= max_unscaled()))
+      throw Client_exception{"cannot create decimal: out of range"};
+  }
+
+  /**
+   * @returns The decimal of the text `[-+]digits[.digits]`, the scale of
+   * which is the number of the digits after the point.
+   *
+   * @throws Client_exception if the text is invalid, or is a non-finite or too
+   * precise number.
+   */
+  static Decimal from_string(std::string_view text)
+  {
+    const bool negative = !text.empty() && text.front() == '-';
+    if (!text.empty() && (text.front() == '-' || text.front() == '+'))
+      text.remove_prefix(1);
+
+    Unscaled result{};
+    int digits{};
+    int scale{-1};
+    bool has_digits{};
+    // Up to 18 digits are gathered into a 64-bit chunk, then into the result.
+    std::uint64_t chunk{};
+    int chunk_digits{};
+    for (const char c : text) {
+      if (c == '.' && scale < 0) {
+        scale = 0;
+        continue;
+      }
+      const unsigned digit = static_cast<unsigned char>(c) - unsigned{'0'};
+      if (digit > 9)
+        throw Client_exception{"cannot convert to decimal: invalid text representation"};
+      has_digits = true;
+      if (scale >= 0)
+        ++scale;
+      if (digits || digit) {
+        if (++digits > max_digits || scale > max_digits)
+          throw Client_exception{"cannot convert to decimal: too many digits"};
+      } else if (scale > max_digits)
+        throw Client_exception{"cannot convert to decimal: scale out of range"};
+      chunk = chunk * 10 + digit;
+      if (++chunk_digits == 18) {
+        result = result * pow10(18) + chunk;
+        chunk = chunk_digits = 0;
+      }
+    }
+    if (!has_digits)
+      throw Client_exception{"cannot convert to decimal: invalid text representation"};
+    result = result * pow10(chunk_digits) + chunk;
+    return Decimal{negative ? -result : result, std::max(scale, 0)};
+  }
+
+  /**
+   * @returns The decimal of the binary format of `numeric`.
+   *
+   * @throws Client_exception if the data is invalid, or is a non-finite or too
+   * precise number.
+   */
+  static Decimal from_numeric_binary(const char* bytes, const std::size_t size)
+  {
+    /*
+     * The header is the count of the base 10000 digits, the weight of the
+     * first one, the sign and the display scale, all of them 16-bit.
+     */
+    if (size < 8)
+      throw Client_exception{"cannot convert to decimal: invalid input size"};
+    const auto word = [&bytes](const std::size_t index)
+    {
+      return net::conv<std::uint16_t>(bytes + 2*index, 2);
+    };
+    const int count = static_cast<std::int16_t>(word(0));
+    const int weight = static_cast<std::int16_t>(word(1));
+    const auto sign = word(2);
+    const int scale = static_cast<std::int16_t>(word(3));
+    if (count < 0 || size != 8 + 2*static_cast<std::size_t>(count))
+      throw Client_exception{"cannot convert to decimal: invalid input size"};
+    else if (sign != positive_sign && sign != negative_sign)
+      throw Client_exception{"cannot convert to decimal: not a finite number"};
+    else if (!(0 <= scale && scale <= max_digits))
+      throw Client_exception{"cannot convert to decimal: scale out of range"};
+
+    // The digits make the integer of the scale of 4 * (count - 1 - weight).
+    const auto overflow = []
+    {
+      return Client_exception{"cannot convert to decimal: too many digits"};
+    };
+    Unscaled result{};
+    for (int i{}; i < count; ++i) {
+      const auto digit = word(4 + static_cast<std::size_t>(i));
+      if (digit > 9999)
+        throw Client_exception{"cannot convert to decimal: invalid digit"};
+      // The constructor rejects the excess of up to 9999 over max_unscaled().
+      if (result > max_unscaled() / 10000)
+        throw overflow();
+      result = result * 10000 + digit;
+    }
+    if (const int shift = scale - 4*(count - 1 - weight); result && shift > 0) {
+      if (shift > max_digits || result > max_unscaled() / pow10(shift))
+        throw overflow();
+      result *= pow10(shift);
+    } else if (result && shift < 0)
+      result = -shift > max_digits ? 0 : result / pow10(-shift);
+    return Decimal{sign == negative_sign ? -result : result, scale};
+  }
+
+  /// @returns The unscaled value.
+  constexpr Unscaled unscaled() const noexcept
+  {
+    return unscaled_;
+  }
+
+  /// @returns The number of the digits after the point.
+  constexpr int scale() const noexcept
+  {
+    return scale_;
+  }
+
+  /**
+   * @returns The decimal of `scale`, rounded half away from zero if it's less
+   * than the current one.
+   *
+   * @throws Client_exception if the result is out of range.
+   */
+  Decimal rescaled(const int scale) const
+  {
+    if (!(0 <= scale && scale <= max_digits))
+      throw Client_exception{"cannot rescale decimal: scale out of range"};
+    else if (scale >= scale_) {
+      const auto factor = pow10(scale - scale_);
+      if (unscaled_ > max_unscaled() / factor || unscaled_ < -max_unscaled() / factor)
+        throw Client_exception{"cannot rescale decimal: out of range"};
+      return Decimal{unscaled_ * factor, scale};
+    }
+    const auto divisor = pow10(scale_ - scale);
+    auto result = unscaled_ / divisor;
+    const auto remainder = unscaled_ % divisor;
+    if (2 * (remainder < 0 ? -remainder : remainder) >= divisor)
+      result += unscaled_ < 0 ? -1 : 1;
+    return Decimal{result, scale};
+  }
+
+  /// @returns The nearest `double`.
+  double to_double() const noexcept
+  {
+    return static_cast<double>(unscaled_) / static_cast<double>(pow10(scale_));
+  }
+
+  /// @returns The text `[-]digits[.digits]` of exactly `scale()` digits after the point.
+  std::string to_string() const
+  {
+    // The digits of the absolute value, at least one before the point.
+    auto value = static_cast<unsigned __int128>(unscaled_ < 0 ? -unscaled_ : unscaled_);
+    char digits[max_digits + 1];
+    char* const end = digits + sizeof(digits);
+    char* begin = end;
+    do {
+      *--begin = static_cast<char>('0' + static_cast<int>(value % 10));
+      value /= 10;
+    } while (value);
+    while (end - begin <= scale_)
+      *--begin = '0';
+
+    std::string result;
+    result.reserve(static_cast<std::size_t>(end - begin) + 2);
+    if (unscaled_ < 0)
+      result += '-';
+    const auto point = end - scale_;
+    result.append(begin, point);
+    if (scale_) {
+      result += '.';
+      result.append(point, end);
+    }
+    return result;
+  }
+
+  /// Appends the binary format of `numeric` to `result`.
+  void to_numeric_binary(std::string& result) const
+  {
+    // The decimal digits are padded to whole base 10000 digits at both ends.
+    const auto text = to_string();
+    const auto unsigned_text = std::string_view{text}.substr(unscaled_ < 0);
+    const auto point = unsigned_text.size() - static_cast<std::size_t>(scale_) - !!scale_;
+    std::string padded((4 - point % 4) % 4, '0');
+    padded.append(unsigned_text.substr(0, point));
+    const auto integral_count = static_cast<int>(padded.size() / 4);
+    if (scale_)
+      padded.append(unsigned_text.substr(point + 1))
+        .append((4 - static_cast<std::size_t>(scale_) % 4) % 4, '0');
+
+    std::array<std::uint16_t, 16> digits{};
+    std::size_t digit_count{};
+    for (std::size_t i{}; i < padded.size(); i += 4)
+      digits[digit_count++] = static_cast<std::uint16_t>((padded[i] - '0')*1000 +
+        (padded[i + 1] - '0')*100 + (padded[i + 2] - '0')*10 + (padded[i + 3] - '0'));
+
+    // The zero digits at both ends are implied by the weight and the count.
+    int weight{integral_count - 1};
+    std::size_t first{};
+    for (; first < digit_count && !digits[first]; ++first)
+      --weight;
+    auto last = digit_count;
+    for (; last > first && !digits[last - 1]; --last);
+    if (first == last)
+      weight = 0;
+
+    const auto put = [&result](const std::uint16_t value)
+    {
+      result += static_cast<char>(value >> 8);
+      result += static_cast<char>(value & 0xff);
+    };
+    put(static_cast<std::uint16_t>(last - first));
+    put(static_cast<std::uint16_t>(weight));
+    put(unscaled_ < 0 ? negative_sign : positive_sign);
+    put(static_cast<std::uint16_t>(scale_));
+    for (auto i = first; i < last; ++i)
+      put(digits[i]);
+  }
+
+  /// @returns `true` if the representations are equal.
+  friend bool operator==(const Decimal&, const Decimal&) noexcept = default;
+
+private:
+  static constexpr std::uint16_t positive_sign{0x0000};
+  static constexpr std::uint16_t negative_sign{0x4000};
+
+  Unscaled unscaled_{};
+  std::int16_t scale_{};
+
+  /// @returns `10^exponent`.
+  static constexpr Unscaled pow10(const int exponent) noexcept
+  {
+    return detail::decimal_powers_of_10[static_cast<std::size_t>(exponent)];
+  }
+
+  /// @returns `10^max_digits - 1`.
+  static constexpr Unscaled max_unscaled() noexcept
+  {
+    return pow10(max_digits) - 1;
+  }
+};
+
+} // namespace dmitigr::pgfe
+
+#endif  // __SIZEOF_INT128__
+
+#endif  // DMITIGR_PGFE_DECIMAL_HPP
@@ -34,8 +34,7 @@ DMITIGR_PGFE_INLINE Client_exception::Client_exception(const std::string& what)
 // =============================================================================
 
 DMITIGR_PGFE_INLINE Server_exception::Server_exception(std::shared_ptr<Error>&& error)
-  : Exception{detail::not_false(error)->condition(),
-    detail::not_false(error)->brief()}
+  : Exception{detail::not_false(error)->condition(), std::string{}}
   , error_{std::move(error)}
 {}
 
@@ -49,4 +48,10 @@ DMITIGR_PGFE_INLINE std::shared_ptr<Error> Server_exception::error_ptr() const n
   return error_;
 }
 
+DMITIGR_PGFE_INLINE const char* Server_exception::what() const noexcept
+{
+  const char* const brief{error_->brief()};
+  return brief ? brief : "";
+}
+
 } // namespace dmitigr::pgfe
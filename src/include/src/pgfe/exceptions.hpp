@@ -76,6 +76,12 @@ public:
   /// @returns The error response as the underlying shared pointer.
   DMITIGR_PGFE_API std::shared_ptr<Error> error_ptr() const noexcept;
 
+  /**
+   * @returns The brief of the error response, read from it rather than
+   * copied when thrown.
+   */
+  DMITIGR_PGFE_API const char* what() const noexcept override;
+
 private:
   std::shared_ptr<Error> error_;
 };
@@ -0,0 +1,87 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef DMITIGR_PGFE_JSONB_HPP
+#define DMITIGR_PGFE_JSONB_HPP
+
+#include "data.hpp"
+#include "exceptions.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup conversions
+ *
+ * @brief The OID of `jsonb`.
+ */
+constexpr std::uint_fast32_t jsonb_oid{3802};
+
+/**
+ * @ingroup conversions
+ *
+ * @brief The version of the binary format of `jsonb`, which is a byte of it
+ * in front of the JSON text.
+ */
+constexpr char jsonb_binary_version{1};
+
+/**
+ * @ingroup conversions
+ *
+ * @returns The JSON text of the `jsonb` value `data` of either format, which
+ * is a view into `data`.
+ *
+ * @par Requires
+ * `data`.
+ *
+ * @throws Client_exception if `data` is in binary format of an unknown
+ * version.
+ */
+inline std::string_view jsonb_text(const Data& data)
+{
+  const std::string_view result{static_cast<const char*>(data.bytes()),
+    data.size()};
+  if (data.format() == Data_format::text)
+    return result;
+  else if (result.empty() || result.front() != jsonb_binary_version)
+    throw Client_exception{"cannot decode jsonb: unknown binary format version"};
+  return result.substr(1);
+}
+
+/**
+ * @ingroup conversions
+ *
+ * @brief Encodes the JSON text `json` in binary format of `jsonb`.
+ *
+ * @details The value of binary format passed through from the source, as by
+ * binary COPY, needs no encoding.
+ *
+ * @returns The view of the encoding, which is put into `buffer`.
+ */
+inline Data_view to_jsonb_binary(const std::string_view json,
+  std::string& buffer)
+{
+  buffer.assign(1, jsonb_binary_version).append(json);
+  return Data_view{buffer.data(), buffer.size(), Data_format::binary};
+}
+
+} // namespace dmitigr::pgfe
+
+#endif  // DMITIGR_PGFE_JSONB_HPP
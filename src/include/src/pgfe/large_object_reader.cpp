@@ -0,0 +1,304 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../base/assert.hpp"
+#include "connection.hpp"
+#include "connection_pool.hpp"
+#include "exceptions.hpp"
+#include "large_object_reader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <thread>
+
+namespace dmitigr::pgfe {
+
+DMITIGR_PGFE_INLINE Large_object_reader::Large_object_reader(
+  Connection& connection, const Oid oid, const std::size_t chunk_size,
+  const std::size_t depth, const std::int_fast64_t offset)
+  : connection_{&connection}
+  , oid_{oid}
+  , chunk_size_{chunk_size}
+  , depth_{depth}
+  , offset_{offset}
+  , next_request_{offset}
+{
+  if (!connection.is_ready_for_request())
+    throw Client_exception{"cannot create large object reader: "
+      "connection is not ready for request"};
+  else if (!chunk_size_ ||
+    chunk_size_ > static_cast<std::size_t>(std::numeric_limits<int>::max()))
+    throw Client_exception{"cannot create large object reader: "
+      "invalid chunk size"};
+  else if (!depth_)
+    throw Client_exception{"cannot create large object reader: "
+      "invalid depth"};
+  else if (offset_ < 0)
+    throw Client_exception{"cannot create large object reader: "
+      "invalid offset"};
+
+#ifdef LIBPQ_HAS_PIPELINING
+  connection.set_pipeline_enabled(true);
+#else
+  depth_ = 1;
+#endif
+  try {
+    while (outstanding_ < depth_)
+      request__();
+  } catch (...) {
+    while (outstanding_) {
+      try {
+        (void)take_response__();
+      } catch (...) {}
+    }
+#ifdef LIBPQ_HAS_PIPELINING
+    connection.set_pipeline_enabled(false);
+#endif
+    throw;
+  }
+}
+
+DMITIGR_PGFE_INLINE Large_object_reader::~Large_object_reader() noexcept
+{
+  if (!is_valid())
+    return;
+
+  try {
+    while (outstanding_) {
+      try {
+        (void)take_response__();
+      } catch (const Server_exception&) {}
+    }
+#ifdef LIBPQ_HAS_PIPELINING
+    connection_->set_pipeline_enabled(false);
+#endif
+  } catch (...) {}
+}
+
+DMITIGR_PGFE_INLINE bool Large_object_reader::is_valid() const noexcept
+{
+  return connection_;
+}
+
+DMITIGR_PGFE_INLINE Oid Large_object_reader::oid() const noexcept
+{
+  return oid_;
+}
+
+DMITIGR_PGFE_INLINE std::int_fast64_t Large_object_reader::offset() const noexcept
+{
+  return offset_;
+}
+
+DMITIGR_PGFE_INLINE std::string_view Large_object_reader::read_chunk()
+{
+  if (!is_valid())
+    throw Client_exception{"cannot read chunk of large object: invalid reader"};
+  else if (unread_.empty() && !fetch__())
+    return {};
+
+  const auto result = unread_;
+  offset_ += static_cast<std::int_fast64_t>(result.size());
+  unread_ = {};
+  return result;
+}
+
+DMITIGR_PGFE_INLINE std::size_t Large_object_reader::read(char* buf,
+  const std::size_t size)
+{
+  if (!is_valid())
+    throw Client_exception{"cannot read large object: invalid reader"};
+  else if (!buf && size)
+    throw Client_exception{"cannot read large object: invalid buffer"};
+
+  std::size_t result{};
+  while (result < size && (!unread_.empty() || fetch__())) {
+    const auto count = std::min(size - result, unread_.size());
+    std::memcpy(buf + result, unread_.data(), count);
+    unread_.remove_prefix(count);
+    result += count;
+  }
+  offset_ += static_cast<std::int_fast64_t>(result);
+  return result;
+}
+
+DMITIGR_PGFE_INLINE bool Large_object_reader::fetch__()
+{
+  DMITIGR_ASSERT(unread_.empty());
+  chunk_ = {};
+  if (!outstanding_)
+    return false;
+
+  try {
+    chunk_ = take_response__();
+  } catch (...) {
+    is_request_done_ = true;
+    throw;
+  }
+  const auto data = chunk_ ? chunk_.data(0) : Data_view{};
+  if (!data)
+    throw Client_exception{"cannot read chunk of large object: no data"};
+  unread_ = {static_cast<const char*>(data.bytes()), data.size()};
+
+  // The short chunk is the last one.
+  if (unread_.size() < chunk_size_)
+    is_request_done_ = true;
+  else if (!is_request_done_)
+    request__();
+  return !unread_.empty();
+}
+
+DMITIGR_PGFE_INLINE void Large_object_reader::request__()
+{
+  DMITIGR_ASSERT(is_valid() && !is_request_done_);
+  auto& conn = *connection_;
+  const auto format = conn.result_format();
+  conn.set_result_format(Data_format::binary);
+  try {
+    conn.execute_nio("SELECT pg_catalog.lo_get($1::oid, $2::int8, $3::int4)",
+      oid_, next_request_, static_cast<int>(chunk_size_));
+  } catch (...) {
+    conn.set_result_format(format);
+    throw;
+  }
+  conn.set_result_format(format);
+#ifdef LIBPQ_HAS_PIPELINING
+  conn.send_sync();
+#endif
+  next_request_ += static_cast<std::int_fast64_t>(chunk_size_);
+  ++outstanding_;
+}
+
+DMITIGR_PGFE_INLINE Row Large_object_reader::take_response__()
+{
+  DMITIGR_ASSERT(outstanding_);
+  auto& conn = *connection_;
+  --outstanding_;
+  Row result;
+  Error error;
+  while (conn.wait_response()) {
+    if (auto e = conn.error())
+      error = std::move(e);
+    else if (auto r = conn.row())
+      result = std::move(r);
+    else if (conn.ready_for_query())
+      break;
+    else
+      (void)conn.completion();
+  }
+  if (error)
+    throw Server_exception{std::make_shared<Error>(std::move(error))};
+  return result;
+}
+
+// -----------------------------------------------------------------------------
+// Large_object_istream
+// -----------------------------------------------------------------------------
+
+DMITIGR_PGFE_INLINE Large_object_istream::Buffer::Buffer(
+  Large_object_reader& reader) noexcept
+  : reader_{reader}
+{}
+
+DMITIGR_PGFE_INLINE Large_object_istream::Buffer::int_type
+Large_object_istream::Buffer::underflow()
+{
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+
+  const auto chunk = reader_.read_chunk();
+  if (chunk.empty())
+    return traits_type::eof();
+
+  auto* const data = const_cast<char*>(chunk.data());
+  setg(data, data, data + chunk.size());
+  return traits_type::to_int_type(*gptr());
+}
+
+DMITIGR_PGFE_INLINE Large_object_istream::Large_object_istream(
+  Connection& connection, const Oid oid, const std::size_t chunk_size,
+  const std::size_t depth)
+  : std::istream{nullptr}
+  , reader_{connection, oid, chunk_size, depth}
+  , buffer_{reader_}
+{
+  rdbuf(&buffer_);
+}
+
+DMITIGR_PGFE_INLINE Large_object_reader& Large_object_istream::reader() noexcept
+{
+  return reader_;
+}
+
+// -----------------------------------------------------------------------------
+// export_large_objects()
+// -----------------------------------------------------------------------------
+
+DMITIGR_PGFE_INLINE void export_large_objects(Connection_pool& pool,
+  const std::vector<std::pair<Oid, std::filesystem::path>>& objects,
+  const std::size_t chunk_size, const std::size_t depth)
+{
+  if (!pool.is_connected())
+    throw Client_exception{"cannot export large objects: "
+      "connection pool is not connected"};
+
+  std::atomic<std::size_t> next{};
+  std::vector<std::exception_ptr> errors(objects.size());
+  const auto work = [&]
+  {
+    std::optional<Connection_pool::Handle> conn;
+    for (auto i = next++; i < objects.size(); i = next++) {
+      try {
+        if (!conn)
+          conn.emplace(pool.acquire());
+        const auto& [oid, path] = objects[i];
+        std::ofstream file{path, std::ios_base::binary | std::ios_base::trunc};
+        if (!file)
+          throw Client_exception{"cannot open file " + path.string()};
+        Large_object_reader reader{**conn, oid, chunk_size, depth};
+        while (true) {
+          const auto chunk = reader.read_chunk();
+          if (chunk.empty())
+            break;
+          if (!file.write(chunk.data(), static_cast<std::streamsize>(chunk.size())))
+            throw Client_exception{"cannot write file " + path.string()};
+        }
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  const auto count = std::min(pool.size(), objects.size());
+  threads.reserve(count);
+  for (std::size_t i{}; i < count; ++i)
+    threads.emplace_back(work);
+  for (auto& thread : threads)
+    thread.join();
+  for (const auto& error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+} // namespace dmitigr::pgfe
@@ -0,0 +1,212 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_LARGE_OBJECT_READER_HPP
+#define DMITIGR_PGFE_LARGE_OBJECT_READER_HPP
+
+#include "basics.hpp"
+#include "dll.hpp"
+#include "row.hpp"
+#include "types_fwd.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <streambuf>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup main
+ *
+ * @brief A sequential reader of a large object which keeps several reads of
+ * it in flight.
+ *
+ * @details Each chunk is read by `lo_get(oid, offset, length)` in binary
+ * format. With the pipeline of libpq (since PostgreSQL 14) up to `depth`
+ * requests are queued at once, so the round trips to the server overlap
+ * instead of adding up. Without one the chunks are read one by one.
+ *
+ * Unlike Large_object, no transaction block is required, nor is the large
+ * object opened. Each chunk is read in a transaction of its own though, so
+ * the consistency of the contents being modified concurrently is up to the
+ * caller's transaction block.
+ */
+class Large_object_reader final {
+public:
+  /// The default size of a chunk.
+  static constexpr std::size_t default_chunk_size{1024 * 1024};
+
+  /// The default number of chunks requested ahead.
+  static constexpr std::size_t default_depth{4};
+
+  /// Default-constructible. (Constructs invalid instance.)
+  Large_object_reader() = default;
+
+  /**
+   * @brief The constructor. Requests the first chunks.
+   *
+   * @par Requires
+   * `connection.is_ready_for_request() && 0 < chunk_size <= INT_MAX &&
+   * depth > 0 && offset >= 0`.
+   *
+   * @par Effects
+   * The pipeline is enabled on `connection` until the destruction (if
+   * supported by libpq).
+   */
+  DMITIGR_PGFE_API Large_object_reader(Connection& connection, Oid oid,
+    std::size_t chunk_size = default_chunk_size,
+    std::size_t depth = default_depth, std::int_fast64_t offset = 0);
+
+  /**
+   * @brief The destructor.
+   *
+   * @details Waits for the responses to the outstanding requests, and
+   * disables the pipeline.
+   */
+  DMITIGR_PGFE_API ~Large_object_reader() noexcept;
+
+  /// Not copy-constructible.
+  Large_object_reader(const Large_object_reader&) = delete;
+
+  /// Not copy-assignable.
+  Large_object_reader& operator=(const Large_object_reader&) = delete;
+
+  /// Not move-constructible.
+  Large_object_reader(Large_object_reader&&) = delete;
+
+  /// Not move-assignable.
+  Large_object_reader& operator=(Large_object_reader&&) = delete;
+
+  /// @returns `true` if the instance is valid.
+  DMITIGR_PGFE_API bool is_valid() const noexcept;
+
+  /// @returns `true` if the instance is valid.
+  explicit operator bool() const noexcept
+  {
+    return is_valid();
+  }
+
+  /// @returns The OID of the large object.
+  DMITIGR_PGFE_API Oid oid() const noexcept;
+
+  /// @returns The offset of the data to be read next.
+  DMITIGR_PGFE_API std::int_fast64_t offset() const noexcept;
+
+  /**
+   * @brief Reads the next chunk, and requests one more ahead.
+   *
+   * @returns The view of the chunk, valid until the next reading or the
+   * destruction. The empty view means the end of the large object.
+   *
+   * @par Requires
+   * `is_valid()`.
+   *
+   * @throws Server_exception if reading failed on the server. The instance
+   * is at the end then.
+   */
+  DMITIGR_PGFE_API std::string_view read_chunk();
+
+  /**
+   * @brief Reads up to `size` bytes into `buf`.
+   *
+   * @returns The number of bytes read, which is less than `size` only at the
+   * end of the large object.
+   *
+   * @par Requires
+   * `is_valid() && (buf || !size)`.
+   */
+  DMITIGR_PGFE_API std::size_t read(char* buf, std::size_t size);
+
+private:
+  Connection* connection_{};
+  Oid oid_{invalid_oid};
+  std::size_t chunk_size_{};
+  std::size_t depth_{};
+  std::int_fast64_t offset_{};      // of the data to be read next
+  std::int_fast64_t next_request_{}; // the offset of the next request
+  std::size_t outstanding_{};
+  bool is_request_done_{};
+  Row chunk_;
+  std::string_view unread_;
+
+  void request__();
+  bool fetch__();
+  Row take_response__();
+};
+
+/**
+ * @ingroup main
+ *
+ * @brief An input stream of the contents of a large object.
+ *
+ * @see Large_object_reader.
+ */
+class Large_object_istream final : public std::istream {
+public:
+  /// The constructor. Same as Large_object_reader's.
+  DMITIGR_PGFE_API Large_object_istream(Connection& connection, Oid oid,
+    std::size_t chunk_size = Large_object_reader::default_chunk_size,
+    std::size_t depth = Large_object_reader::default_depth);
+
+  /// @returns The underlying reader.
+  DMITIGR_PGFE_API Large_object_reader& reader() noexcept;
+
+private:
+  class Buffer final : public std::streambuf {
+  public:
+    explicit Buffer(Large_object_reader& reader) noexcept;
+
+  protected:
+    int_type underflow() override;
+
+  private:
+    Large_object_reader& reader_;
+  };
+
+  Large_object_reader reader_;
+  Buffer buffer_;
+};
+
+/**
+ * @ingroup main
+ *
+ * @brief Exports the large objects to the files in parallel, each one read
+ * by a Large_object_reader on a connection of `pool`.
+ *
+ * @details Up to `pool.size()` large objects are exported at once. The
+ * exception of the first failed export (in the order of `objects`) is
+ * rethrown once all are done.
+ *
+ * @par Requires
+ * `pool.is_connected()`.
+ */
+DMITIGR_PGFE_API void export_large_objects(Connection_pool& pool,
+  const std::vector<std::pair<Oid, std::filesystem::path>>& objects,
+  std::size_t chunk_size = Large_object_reader::default_chunk_size,
+  std::size_t depth = Large_object_reader::default_depth);
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "large_object_reader.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_LARGE_OBJECT_READER_HPP
@@ -0,0 +1,144 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "notice_sink.hpp"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <utility>
+
+namespace dmitigr::pgfe {
+
+DMITIGR_PGFE_INLINE Notice_sink::Notice_sink(const std::size_t capacity,
+  const std::size_t rate, Handler handler)
+  : ring_{capacity}
+  , rate_{rate}
+  , handler_{handler ? std::move(handler) : Handler{&default_handler}}
+{
+  thread_ = std::thread{[this]{ run(); }};
+}
+
+DMITIGR_PGFE_INLINE Notice_sink::~Notice_sink()
+{
+  is_closed_.store(true, std::memory_order_release);
+  pushed_.fetch_add(1, std::memory_order_release);
+  pushed_.notify_all();
+  thread_.join();
+}
+
+DMITIGR_PGFE_INLINE Connection::Notice_handler Notice_sink::handler()
+{
+  return [this](const Notice& notice)
+  {
+    push(notice);
+  };
+}
+
+DMITIGR_PGFE_INLINE bool Notice_sink::push(const Problem& notice)
+{
+  if (rate_) {
+    const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto window = window_.load(std::memory_order_relaxed);
+    if (window != now && window_.compare_exchange_strong(window, now,
+        std::memory_order_relaxed))
+      window_count_.store(0, std::memory_order_relaxed);
+    if (window_count_.fetch_add(1, std::memory_order_relaxed) >= rate_) {
+      dropped_count_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  const char* const sqlstate = notice.sqlstate();
+  const char* const brief = notice.brief();
+  Record record{notice.severity(), sqlstate ? sqlstate : "",
+    brief ? brief : ""};
+  if (!ring_.try_push(record)) {
+    dropped_count_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  pushed_.fetch_add(1, std::memory_order_release);
+  pushed_.notify_one();
+  return true;
+}
+
+DMITIGR_PGFE_INLINE std::uint64_t Notice_sink::dropped_count() const noexcept
+{
+  return dropped_count_.load(std::memory_order_relaxed);
+}
+
+DMITIGR_PGFE_INLINE void Notice_sink::run()
+{
+  std::uint64_t reported{};
+  const auto emit = [this, &reported](Record& record)
+  {
+    const auto dropped = dropped_count();
+    record.dropped = dropped - reported;
+    reported = dropped;
+    try {
+      handler_(record);
+    } catch (const std::exception& e) {
+      std::clog << "notice handler: error: " << e.what() << '\n';
+    } catch (...) {
+      std::clog << "notice handler: unknown error\n";
+    }
+  };
+
+  std::optional<Record> pending;
+  while (true) {
+    const auto pushed = pushed_.load(std::memory_order_acquire);
+    Record next;
+    if (ring_.try_pop(next)) {
+      if (pending && pending->brief == next.brief &&
+        pending->sqlstate == next.sqlstate &&
+        pending->severity == next.severity) {
+        ++pending->repeats;
+        continue;
+      }
+      if (pending)
+        emit(*pending);
+      pending = std::move(next);
+      continue;
+    }
+    // The queue ran dry: what has been coalesced goes out.
+    if (pending) {
+      emit(*pending);
+      pending.reset();
+    }
+    if (is_closed_.load(std::memory_order_acquire))
+      break;
+    pushed_.wait(pushed, std::memory_order_acquire);
+  }
+  if (dropped_count() > reported) {
+    Record record;
+    record.repeats = 0;
+    emit(record);
+  }
+}
+
+DMITIGR_PGFE_INLINE void Notice_sink::default_handler(const Record& record)
+{
+  if (record.dropped)
+    std::clog << "PostgreSQL Notices dropped: " << record.dropped << '\n';
+  if (!record.repeats)
+    return;
+  std::clog << "PostgreSQL Notice: " << record.brief;
+  if (record.repeats > 1)
+    std::clog << " (" << record.repeats << " times)";
+  std::clog << '\n';
+}
+
+} // namespace dmitigr::pgfe
@@ -0,0 +1,129 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_NOTICE_SINK_HPP
+#define DMITIGR_PGFE_NOTICE_SINK_HPP
+
+#include "../util/ring_buffer.hpp"
+#include "connection.hpp"
+#include "dll.hpp"
+#include "problem.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup main
+ *
+ * @brief Takes the notices of connections off the threads handling their
+ * input and hands them to a handler on a thread of its own.
+ *
+ * @details The handler() set on a connection copies what a notice says into
+ * a bounded lock-free queue and returns, so a NOTICE per row, as raised by a
+ * trigger during a bulk load, never waits for the terminal. Notices beyond
+ * the rate per second, or which find the queue full, are dropped and counted.
+ * Identical notices which queue up one after another while the handler runs
+ * are handed to it once, with the number of them.
+ */
+class Notice_sink final {
+public:
+  /// What a notice said.
+  struct Record final {
+    std::optional<Problem_severity> severity;
+    std::string sqlstate;
+    std::string brief;
+    /// The number of identical notices this stands for, zero for a record
+    /// which only reports the dropped ones.
+    std::uint64_t repeats{1};
+    /// The number of notices dropped since the record handed on before.
+    std::uint64_t dropped{};
+  };
+
+  /// An alias of a record handler.
+  using Handler = std::function<void(const Record&)>;
+
+  /**
+   * @brief The constructor. Starts the thread of the handler.
+   *
+   * @param capacity The capacity of the queue, rounded up to a power of two.
+   * @param rate The number of notices per second taken at most, or zero to
+   * take them all while the queue has room.
+   * @param handler The handler, which prints the records to the standard
+   * error by default.
+   */
+  DMITIGR_PGFE_API explicit Notice_sink(std::size_t capacity = 1024,
+    std::size_t rate = 0, Handler handler = {});
+
+  /// Hands on the records still queued and joins the thread.
+  DMITIGR_PGFE_API ~Notice_sink();
+
+  /// Not copy-constructible.
+  Notice_sink(const Notice_sink&) = delete;
+
+  /// Not copy-assignable.
+  Notice_sink& operator=(const Notice_sink&) = delete;
+
+  /**
+   * @returns The notice handler which pushes to this sink.
+   *
+   * @remarks The sink must outlive the connections it's set on.
+   *
+   * @see Connection::set_notice_handler().
+   */
+  DMITIGR_PGFE_API Connection::Notice_handler handler();
+
+  /**
+   * @brief Pushes what `notice` says unless the rate is exceeded or the
+   * queue is full.
+   *
+   * @returns `true` if pushed.
+   *
+   * @remarks Thread-safe.
+   */
+  DMITIGR_PGFE_API bool push(const Problem& notice);
+
+  /// @returns The number of notices dropped.
+  DMITIGR_PGFE_API std::uint64_t dropped_count() const noexcept;
+
+private:
+  util::Mpmc_ring<Record> ring_;
+  std::size_t rate_{};
+  Handler handler_;
+  std::atomic<std::uint32_t> pushed_{}; // for the handler's thread
+  std::atomic<bool> is_closed_{};
+  std::atomic<std::int64_t> window_{}; // the second being counted for rate_
+  std::atomic<std::size_t> window_count_{};
+  std::atomic<std::uint64_t> dropped_count_{};
+  std::thread thread_;
+
+  void run();
+  static void default_handler(const Record& record);
+};
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "notice_sink.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_NOTICE_SINK_HPP
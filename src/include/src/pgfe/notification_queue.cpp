@@ -0,0 +1,91 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "notification_queue.hpp"
+
+namespace dmitigr::pgfe {
+
+DMITIGR_PGFE_INLINE Notification_queue::Notification_queue(
+  const std::size_t capacity)
+  : ring_{capacity}
+{}
+
+DMITIGR_PGFE_INLINE Connection::Notification_handler
+Notification_queue::handler()
+{
+  return [this](Notification&& notification)
+  {
+    push(std::move(notification));
+  };
+}
+
+DMITIGR_PGFE_INLINE bool Notification_queue::push(Notification&& notification)
+{
+  if (is_closed())
+    return false;
+  else if (!ring_.try_push(notification)) {
+    overflow_count_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  pushed_.fetch_add(1, std::memory_order_release);
+  pushed_.notify_one();
+  return true;
+}
+
+DMITIGR_PGFE_INLINE bool Notification_queue::try_pop(Notification& notification)
+{
+  return ring_.try_pop(notification);
+}
+
+DMITIGR_PGFE_INLINE std::size_t
+Notification_queue::try_pop(const std::span<Notification> out)
+{
+  std::size_t result{};
+  while (result < out.size() && ring_.try_pop(out[result]))
+    ++result;
+  return result;
+}
+
+DMITIGR_PGFE_INLINE Notification Notification_queue::pop()
+{
+  Notification result;
+  while (true) {
+    const auto pushed = pushed_.load(std::memory_order_acquire);
+    if (ring_.try_pop(result) || is_closed())
+      return result;
+    pushed_.wait(pushed, std::memory_order_acquire);
+  }
+}
+
+DMITIGR_PGFE_INLINE void Notification_queue::close() noexcept
+{
+  is_closed_.store(true, std::memory_order_release);
+  pushed_.fetch_add(1, std::memory_order_release);
+  pushed_.notify_all();
+}
+
+DMITIGR_PGFE_INLINE bool Notification_queue::is_closed() const noexcept
+{
+  return is_closed_.load(std::memory_order_acquire);
+}
+
+DMITIGR_PGFE_INLINE std::uint64_t
+Notification_queue::overflow_count() const noexcept
+{
+  return overflow_count_.load(std::memory_order_relaxed);
+}
+
+} // namespace dmitigr::pgfe
@@ -0,0 +1,125 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_NOTIFICATION_QUEUE_HPP
+#define DMITIGR_PGFE_NOTIFICATION_QUEUE_HPP
+
+#include "../util/ring_buffer.hpp"
+#include "connection.hpp"
+#include "dll.hpp"
+#include "notification.hpp"
+#include "types_fwd.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup main
+ *
+ * @brief A bounded lock-free queue which carries notifications from the
+ * threads handling the input of connections to the consumer threads.
+ *
+ * @details The handler() set on a connection just pushes the notifications
+ * it gets, so a burst of them doesn't delay the processing of the responses
+ * on that connection. If the queue is full a notification is dropped rather
+ * than blocking the connection, and counted by overflow_count(), so the
+ * consumer can tell that it must resynchronize.
+ */
+class Notification_queue final {
+public:
+  /// The constructor. The capacity is rounded up to a power of two.
+  DMITIGR_PGFE_API explicit Notification_queue(std::size_t capacity);
+
+  /// Not copy-constructible.
+  Notification_queue(const Notification_queue&) = delete;
+
+  /// Not copy-assignable.
+  Notification_queue& operator=(const Notification_queue&) = delete;
+
+  /**
+   * @returns The notification handler which pushes to this queue.
+   *
+   * @remarks The queue must outlive the connections it's set on.
+   *
+   * @see Connection::set_notification_handler().
+   */
+  DMITIGR_PGFE_API Connection::Notification_handler handler();
+
+  /**
+   * @brief Pushes `notification` unless the queue is full or closed.
+   *
+   * @returns `true` if pushed.
+   *
+   * @remarks Thread-safe.
+   */
+  DMITIGR_PGFE_API bool push(Notification&& notification);
+
+  /**
+   * @brief Pops into `notification` unless the queue is empty.
+   *
+   * @returns `true` if popped.
+   *
+   * @remarks Thread-safe.
+   */
+  DMITIGR_PGFE_API bool try_pop(Notification& notification);
+
+  /**
+   * @brief Pops up to `out.size()` notifications into `out` without waiting.
+   *
+   * @returns The number of notifications popped.
+   *
+   * @remarks Thread-safe.
+   */
+  DMITIGR_PGFE_API std::size_t try_pop(std::span<Notification> out);
+
+  /**
+   * @returns The popped notification, waiting while the queue is empty, or
+   * the invalid instance if the queue is closed and empty.
+   *
+   * @remarks Thread-safe.
+   */
+  DMITIGR_PGFE_API Notification pop();
+
+  /**
+   * @brief Closes the queue: nothing is pushed afterwards, and the waiting
+   * consumers are woken up.
+   */
+  DMITIGR_PGFE_API void close() noexcept;
+
+  /// @returns `true` if the queue is closed.
+  DMITIGR_PGFE_API bool is_closed() const noexcept;
+
+  /// @returns The number of notifications dropped since the queue was full.
+  DMITIGR_PGFE_API std::uint64_t overflow_count() const noexcept;
+
+private:
+  util::Mpmc_ring<Notification> ring_;
+  std::atomic<std::uint32_t> pushed_{}; // for the waiting consumers
+  std::atomic<bool> is_closed_{};
+  std::atomic<std::uint64_t> overflow_count_{};
+};
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "notification_queue.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_NOTIFICATION_QUEUE_HPP
@@ -19,40 +19,53 @@
 
 #include "array_aliases.hpp"
 #include "array_conversions.hpp"
+#include "arrow.hpp"
+#include "async.hpp"
 #include "basics.hpp"
 #include "basic_conversions.hpp"
+#include "cancel_handle.hpp"
 #include "completion.hpp"
 #include "composite.hpp"
 #include "compositional.hpp"
 #include "connection.hpp"
 #include "connection_options.hpp"
 #include "connection_pool.hpp"
+#include "connection_router.hpp"
+#include "connection_stats.hpp"
 #include "contract.hpp"
 #include "conversions.hpp"
 #include "conversions_api.hpp"
 #include "copier.hpp"
+#include "copier_writer.hpp"
 #include "data.hpp"
+#include "decimal.hpp"
 #include "errc.hpp"
 #include "errctg.hpp"
 #include "error.hpp"
 #include "exceptions.hpp"
+#include "jsonb.hpp"
 #include "large_object.hpp"
+#include "large_object_reader.hpp"
 #include "message.hpp"
 #include "misc.hpp"
 #include "notice.hpp"
+#include "notice_sink.hpp"
 #include "notification.hpp"
+#include "notification_queue.hpp"
 #include "parameterizable.hpp"
 #include "prepared_statement.hpp"
 #include "problem.hpp"
 #include "ready_for_query.hpp"
 #include "response.hpp"
 #include "row.hpp"
+#include "row_batch.hpp"
 #include "row_info.hpp"
 #include "signal.hpp"
 #include "statement.hpp"
 #include "statement_vector.hpp"
 #include "transaction_guard.hpp"
 #include "tuple.hpp"
+#include "type_info.hpp"
 #include "types_fwd.hpp"
 #include "version.hpp"
 #include "lib_version.hpp"
@@ -20,9 +20,59 @@
 #include "statement.hpp"
 
 #include <algorithm>
+#include <mutex>
+#include <new>
+#include <unordered_map>
 
 namespace dmitigr::pgfe {
 
+namespace detail {
+
+/// The descriptions of the prepared statements of the process.
+class Description_cache final {
+public:
+  struct Entry final {
+    std::vector<std::uint_fast32_t> parameter_type_oids;
+    pq::Result fields; // just the attributes of the described result
+  };
+
+  static Description_cache& instance()
+  {
+    static Description_cache result;
+    return result;
+  }
+
+  std::shared_ptr<const Entry> find(const std::string& key) const
+  {
+    const std::lock_guard lg{mutex_};
+    const auto i = entries_.find(key);
+    return i != entries_.cend() ? i->second : nullptr;
+  }
+
+  void insert(const std::string& key, std::shared_ptr<const Entry> entry)
+  {
+    const std::lock_guard lg{mutex_};
+    entries_.insert_or_assign(key, std::move(entry));
+  }
+
+  void clear() noexcept
+  {
+    const std::lock_guard lg{mutex_};
+    entries_.clear();
+  }
+
+private:
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const Entry>> entries_;
+};
+
+} // namespace detail
+
+DMITIGR_PGFE_INLINE void clear_prepared_statement_descriptions() noexcept
+{
+  detail::Description_cache::instance().clear();
+}
+
 DMITIGR_PGFE_INLINE Named_argument::Named_argument(std::string name) noexcept
   : name_{std::move(name)}
   , data_{nullptr, Data_deletion_required{false}}
@@ -223,15 +273,17 @@ Prepared_statement::result_format() const noexcept
 
 DMITIGR_PGFE_INLINE void Prepared_statement::execute_nio()
 {
-  execute_nio__(nullptr);
+  const auto bytes = execute_nio__(nullptr);
+  connection().auto_queued__(bytes);
 }
 
 DMITIGR_PGFE_INLINE void Prepared_statement::execute_nio(const Statement& statement)
 {
-  execute_nio__(&statement);
+  const auto bytes = execute_nio__(&statement);
+  connection().auto_queued__(bytes);
 }
 
-DMITIGR_PGFE_INLINE void
+DMITIGR_PGFE_INLINE std::size_t
 Prepared_statement::execute_nio__(const Statement* const statement)
 {
   if (!is_valid())
@@ -239,14 +291,35 @@ Prepared_statement::execute_nio__(const Statement* const statement)
   else if (!(connection().is_ready_for_nio_request()))
     throw_exception("cannot execute");
 
-  // All the values are NULLs initially. (Can throw.)
+  /*
+   * The parameter arrays are on the stack unless there are too many
+   * parameters, in which case the ones of the state are reused. All the
+   * values are NULLs initially. (Can throw.)
+   */
+  constexpr std::size_t inline_count{16};
   const int param_count{static_cast<int>(parameter_count())};
-  std::vector<const char*> values(static_cast<unsigned>(param_count), nullptr);
-  std::vector<int> lengths(static_cast<unsigned>(param_count), 0);
-  std::vector<int> formats(static_cast<unsigned>(param_count), 0);
+  const auto count = static_cast<std::size_t>(param_count);
+  const char* inline_values[inline_count];
+  int inline_lengths[inline_count];
+  int inline_formats[inline_count];
+  const char** values{inline_values};
+  int* lengths{inline_lengths};
+  int* formats{inline_formats};
+  if (count > inline_count) {
+    state_->values_.resize(count);
+    state_->lengths_.resize(count);
+    state_->formats_.resize(count);
+    values = state_->values_.data();
+    lengths = state_->lengths_.data();
+    formats = state_->formats_.data();
+  }
+  std::fill_n(values, count, nullptr);
+  std::fill_n(lengths, count, 0);
+  std::fill_n(formats, count, 0);
 
   auto& conn = connection();
   conn.requests_.emplace(Connection::Request::Id::execute); // can throw
+  std::size_t bytes{};
   try {
     // Prepare the input for libpq.
     for (unsigned i{}; i < static_cast<unsigned>(param_count); ++i) {
@@ -258,19 +331,32 @@ Prepared_statement::execute_nio__(const Statement* const statement)
     }
     const int result_format = detail::pq::to_int(result_format_);
 
+    if (statement) {
+      statement->to_query_string(conn, conn.query_buffer_);
+      conn.note_session_changes__(conn.query_buffer_);
+    }
     const int send_ok = statement
       ? PQsendQueryParams(conn.conn(),
-        statement->to_query_string(conn).c_str(),
-        param_count, nullptr, values.data(), lengths.data(),
-        formats.data(), result_format)
+        conn.query_buffer_.c_str(),
+        param_count, nullptr, values, lengths, formats, result_format)
       : PQsendQueryPrepared(conn.conn(),
         name().c_str(),
-        param_count, values.data(), lengths.data(),
-        formats.data(), result_format);
+        param_count, values, lengths, formats, result_format);
 
     if (!send_ok)
       throw Client_exception{conn.error_message()};
 
+    const auto& stats = conn.stats_;
+    if (stats || conn.auto_pipeline_) {
+      bytes = statement ? conn.query_buffer_.size() : name().size();
+      for (std::size_t i{}; i < count; ++i)
+        bytes += static_cast<std::size_t>(lengths[i]);
+    }
+    if (stats) {
+      conn.requests_.back().start_time_ = std::chrono::steady_clock::now();
+      stats->bytes_sent.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
     if (conn.pipeline_status() == Pipeline_status::disabled)
       conn.set_single_row_mode_enabled();
   } catch (...) {
@@ -279,6 +365,7 @@ Prepared_statement::execute_nio__(const Statement* const statement)
   }
 
   assert(is_invariant_ok());
+  return bytes;
 }
 
 DMITIGR_PGFE_INLINE Completion Prepared_statement::execute()
@@ -331,9 +418,7 @@ Prepared_statement::parameter_type_oid(const std::size_t index) const
 {
   if (!(index < parameter_count()))
     throw_exception("cannot get parameter type OID of");
-  return is_described() ?
-    state_->description_.pq_result_.ps_param_type_oid(static_cast<int>(index)) :
-    invalid_oid;
+  return is_described() ? state_->parameter_type_oids_[index] : invalid_oid;
 }
 
 DMITIGR_PGFE_INLINE std::uint_fast32_t
@@ -429,6 +514,67 @@ Prepared_statement::bind(const std::size_t index, Data_ptr&& data)
   return *this;
 }
 
+DMITIGR_PGFE_INLINE auto
+Prepared_statement::param(const std::string_view name) const -> Parameter_handle
+{
+  const auto index = parameter_index(name);
+  if (!(index < parameter_count()))
+    throw_exception("cannot get parameter handle of");
+  return Parameter_handle{index};
+}
+
+DMITIGR_PGFE_INLINE auto
+Prepared_statement::handle_text__(const Parameter_handle& handle)
+  -> Parameter::Text&
+{
+  if (!(handle.index_ < parameter_count()))
+    throw_exception("cannot bind parameter of");
+  auto& parameter = parameters_[handle.index_];
+  if (!parameter.text)
+    parameter.text = std::make_unique<Parameter::Text>();
+  return *parameter.text;
+}
+
+DMITIGR_PGFE_INLINE Prepared_statement&
+Prepared_statement::bind(const Parameter_handle& handle,
+  const std::string_view value, const Data_format format)
+{
+  auto& text = handle_text__(handle);
+  text.bytes.assign(value);
+  text.view = Data_view{text.bytes.data(), text.bytes.size(), format};
+  parameters_[handle.index_].data = Data_ptr{&text.view,
+    Data_deletion_required{false}};
+  return *this;
+}
+
+DMITIGR_PGFE_INLINE Prepared_statement&
+Prepared_statement::bind(const Parameter_handle& handle, const char* const value)
+{
+  return bind(handle, std::string_view{value});
+}
+
+DMITIGR_PGFE_INLINE Prepared_statement&
+Prepared_statement::bind(const Parameter_handle& handle, std::string&& value,
+  const Data_format format)
+{
+  auto& text = handle_text__(handle);
+  text.bytes = std::move(value);
+  text.view = Data_view{text.bytes.data(), text.bytes.size(), format};
+  parameters_[handle.index_].data = Data_ptr{&text.view,
+    Data_deletion_required{false}};
+  return *this;
+}
+
+DMITIGR_PGFE_INLINE Prepared_statement&
+Prepared_statement::bind(const Parameter_handle& handle, std::nullptr_t)
+{
+  if (!(handle.index_ < parameter_count()))
+    throw_exception("cannot bind parameter of");
+  parameters_[handle.index_].data = Data_ptr{nullptr,
+    Data_deletion_required{false}};
+  return *this;
+}
+
 DMITIGR_PGFE_INLINE Prepared_statement&
 Prepared_statement::bind__(const std::size_t, Named_argument&& na)
 {
@@ -452,7 +598,12 @@ Prepared_statement::set_description(detail::pq::Result&& r)
 {
   DMITIGR_ASSERT(r);
 
-  parameters_.resize(static_cast<std::size_t>(r.ps_param_count()));
+  const int param_count{r.ps_param_count()};
+  parameters_.resize(static_cast<std::size_t>(param_count));
+  state_->parameter_type_oids_.resize(parameters_.size());
+  for (int i{}; i < param_count; ++i)
+    state_->parameter_type_oids_[static_cast<std::size_t>(i)] =
+      r.ps_param_type_oid(i);
 
   /*
    * If result contains fields info, initialize Row_info.
@@ -470,4 +621,51 @@ Prepared_statement::set_description(detail::pq::Result&& r)
   assert(is_invariant_ok());
 }
 
+DMITIGR_PGFE_INLINE bool Prepared_statement::set_cached_description__()
+{
+  if (state_->description_key_.empty())
+    return false;
+
+  const auto entry = detail::Description_cache::instance()
+    .find(state_->description_key_);
+  if (!entry)
+    return false;
+
+  // A PGresult can't be shared, but its attributes copy without the server.
+  detail::pq::Result fields{PQcopyResult(entry->fields.native_handle(),
+    PG_COPYRES_ATTRS)};
+  if (!fields)
+    throw std::bad_alloc{};
+
+  parameters_.resize(entry->parameter_type_oids.size());
+  state_->parameter_type_oids_ = entry->parameter_type_oids;
+  if (fields.field_count() > 0)
+    state_->description_ = Row_info{std::move(fields)};
+  else
+    state_->description_.pq_result_ = std::move(fields);
+
+  DMITIGR_ASSERT(is_described());
+  assert(is_invariant_ok());
+  return true;
+}
+
+DMITIGR_PGFE_INLINE void
+Prepared_statement::cache_description__() const noexcept
+{
+  DMITIGR_ASSERT(is_described());
+  if (state_->description_key_.empty())
+    return;
+
+  // Not caching is only a round trip more for the next connection.
+  try {
+    auto entry = std::make_shared<detail::Description_cache::Entry>();
+    entry->parameter_type_oids = state_->parameter_type_oids_;
+    entry->fields.reset(PQcopyResult(
+      state_->description_.pq_result_.native_handle(), PG_COPYRES_ATTRS));
+    if (entry->fields)
+      detail::Description_cache::instance().insert(state_->description_key_,
+        std::move(entry));
+  } catch (...) {}
+}
+
 } // namespace dmitigr::pgfe
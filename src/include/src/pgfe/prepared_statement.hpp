@@ -309,6 +309,64 @@ public:
     return bind(parameter_index(name), std::forward<T>(value));
   }
 
+  /**
+   * @brief A parameter resolved once by param(), to be bound with no lookup
+   * of its name.
+   */
+  class Parameter_handle final {
+  public:
+    /// @returns The parameter index.
+    std::size_t index() const noexcept
+    {
+      return index_;
+    }
+
+  private:
+    friend Prepared_statement;
+
+    explicit Parameter_handle(const std::size_t index) noexcept
+      : index_{index}
+    {}
+
+    std::size_t index_{};
+  };
+
+  /**
+   * @returns The handle of the parameter named by the `name`.
+   *
+   * @par Requires
+   * `parameter_index(name) < parameter_count()`.
+   */
+  DMITIGR_PGFE_API Parameter_handle param(std::string_view name) const;
+
+  /**
+   * @brief Binds the parameter of `handle` with a copy of `value` of the
+   * specified `format`.
+   *
+   * @details The value is copied into storage the parameter keeps for the
+   * binds through handles, so that binding allocates only when the value
+   * outgrows it.
+   *
+   * @par Requires
+   * `handle.index() < parameter_count()`.
+   *
+   * @see param().
+   */
+  DMITIGR_PGFE_API Prepared_statement& bind(const Parameter_handle& handle,
+    std::string_view value, Data_format format = Data_format::text);
+
+  /// @overload
+  DMITIGR_PGFE_API Prepared_statement& bind(const Parameter_handle& handle,
+    const char* value);
+
+  /// @brief Binds the parameter of `handle` with `value`, moved into place.
+  DMITIGR_PGFE_API Prepared_statement& bind(const Parameter_handle& handle,
+    std::string&& value, Data_format format = Data_format::text);
+
+  /// @brief Binds the parameter of `handle` with SQL NULL.
+  DMITIGR_PGFE_API Prepared_statement& bind(const Parameter_handle& handle,
+    std::nullptr_t);
+
   /**
    * @brief Binds parameters by indexes in range [0, sizeof ... (values)).
    *
@@ -397,6 +455,46 @@ public:
   /// @overload
   DMITIGR_PGFE_API Completion execute();
 
+  /**
+   * @brief Executes this prepared statement once for each element of
+   * `parameters`, pipelining the executions.
+   *
+   * @details The executions are sent in windows of `window` with a Sync
+   * message after each, so the responses of a whole window take about one
+   * round trip. An execution which fails aborts the rest of its window, like
+   * in any pipeline, and the error is thrown once the batch is over.
+   *
+   * @param parameters A range of tuples (or anything `std::apply()` accepts)
+   * of the parameters to bind, each in a call of bind_many().
+   * @param callback A function called as `callback(index, row)` for each row,
+   * where `index` is the position of the parameters of the execution which
+   * produced `row`.
+   * @param window The number of executions per Sync message.
+   *
+   * @par Requires
+   * `connection()->is_ready_for_request() && window > 0`.
+   *
+   * @par Effects
+   * `connection()->is_ready_for_request()` after return, even if thrown.
+   *
+   * @par Exception safety guarantee
+   * Basic.
+   *
+   * @remarks Without libpq support for the pipeline the executions are just
+   * made one by one.
+   *
+   * @remarks Defined in connection.hpp.
+   */
+  template<typename R, typename F>
+  void execute_batch(const R& parameters, F&& callback, std::size_t window = 256);
+
+  /// @overload
+  template<typename R>
+  void execute_batch(const R& parameters, const std::size_t window = 256)
+  {
+    execute_batch(parameters, [](std::size_t, Row&&){}, window);
+  }
+
   /**
    * @returns The related Connection instance which prepared this statement.
    *
@@ -429,7 +527,14 @@ public:
    * @returns `true` if the information inferred by a PostgreSQL server
    * about this prepared statement is available.
    *
-   * @see describe(), parameter_type_oid(), row_info().
+   * @details A statement prepared from the same text in the same database,
+   * as the same user, by any connection of the process which made no session
+   * changes that could alter how its text resolves, is described as soon as
+   * it's prepared once one of them has described it: the description is
+   * taken from the process-wide cache rather than from the server.
+   *
+   * @see describe(), parameter_type_oid(), row_info(),
+   * clear_prepared_statement_descriptions().
    */
   DMITIGR_PGFE_API bool is_described() const noexcept;
 
@@ -471,8 +576,15 @@ private:
 
   /// A parameter.
   struct Parameter final {
+    /// The storage of the values bound through a handle.
+    struct Text final {
+      std::string bytes;
+      Data_view view;
+    };
+
     Data_ptr data;
     std::string name;
+    std::unique_ptr<Text> text; // allocated by the first bind through a handle
   };
 
   /// A state.
@@ -486,6 +598,14 @@ private:
     Connection* connection_{};
     bool preparsed_{};
     Row_info description_; // may be invalid, see set_description()
+    std::vector<std::uint_fast32_t> parameter_type_oids_;
+    // Of the description cache, empty if the statement mustn't be cached.
+    std::string description_key_;
+
+    // The parameter arrays of libpq, when too many to be on the stack.
+    std::vector<const char*> values_;
+    std::vector<int> lengths_;
+    std::vector<int> formats_;
   };
 
   bool is_registered_{};
@@ -510,6 +630,8 @@ private:
   // ---------------------------------------------------------------------------
 
   Prepared_statement& bind(std::size_t index, Data_ptr&& data);
+  /// @returns The storage of the parameter of `handle`.
+  Parameter::Text& handle_text__(const Parameter_handle& handle);
   Prepared_statement& bind__(std::size_t, Named_argument&& na);
   Prepared_statement& bind__(std::size_t, const Named_argument& na);
 
@@ -531,10 +653,25 @@ private:
   // ---------------------------------------------------------------------------
 
   void set_description(detail::pq::Result&& r);
+  /// @returns `true` if the description was found in the process-wide cache.
+  bool set_cached_description__();
+  /// Puts the description into the process-wide cache.
+  void cache_description__() const noexcept;
   void execute_nio(const Statement& statement);
-  void execute_nio__(const Statement* const statement);
+  /// @returns The bytes of the query and the parameters sent.
+  std::size_t execute_nio__(const Statement* const statement);
 };
 
+/**
+ * @ingroup main
+ *
+ * @brief Forgets the descriptions of the prepared statements cached by the
+ * process, as the schema changes which would make them stale require.
+ *
+ * @see Prepared_statement::is_described().
+ */
+DMITIGR_PGFE_API void clear_prepared_statement_descriptions() noexcept;
+
 /**
  * @ingroup main
  *
@@ -21,17 +21,42 @@
 #include "problem.hpp"
 
 #include <cassert>
-#include <cctype>
-#include <cerrno>
 #include <cstdlib>
 
 namespace dmitigr::pgfe {
 
+namespace detail {
+
+/**
+ * @returns The value of the five alphanumerics of `sqlstate` as a base-36
+ * number, or `-1` if `sqlstate` isn't a SQLSTATE.
+ */
+inline int sqlstate_value(const char* const sqlstate) noexcept
+{
+  if (!sqlstate)
+    return -1;
+  int result{};
+  for (int i{}; i < 5; ++i) {
+    const char c{sqlstate[i]};
+    int digit{};
+    if ('0' <= c && c <= '9')
+      digit = c - '0';
+    else if ('A' <= c && c <= 'Z')
+      digit = c - 'A' + 10;
+    else if ('a' <= c && c <= 'z')
+      digit = c - 'a' + 10;
+    else
+      return -1;
+    result = result * 36 + digit;
+  }
+  return sqlstate[5] ? -1 : result;
+}
+
+} // namespace detail
+
 DMITIGR_PGFE_INLINE Problem::Problem(detail::pq::Result&& result) noexcept
   : pq_result_{std::move(result)}
 {
-  const int condition{sqlstate_string_to_int(pq_result_.er_code())};
-  condition_ = {condition, server_error_category()};
   assert(is_invariant_ok());
 }
 
@@ -44,7 +69,7 @@ DMITIGR_PGFE_INLINE bool Problem::is_invariant_ok() const noexcept
 
 DMITIGR_PGFE_INLINE std::error_condition Problem::condition() const noexcept
 {
-  return condition_;
+  return {detail::sqlstate_value(sqlstate()), server_error_category()};
 }
 
 DMITIGR_PGFE_INLINE const char* Problem::sqlstate() const noexcept
@@ -170,21 +195,10 @@ DMITIGR_PGFE_INLINE std::error_condition Problem::min_error_condition() noexcept
 
 DMITIGR_PGFE_INLINE int Problem::sqlstate_string_to_int(const char* const sqlstate)
 {
-  const std::string_view state{sqlstate};
-  if (!((state.size() == 5) &&
-      std::isalnum(static_cast<unsigned char>(state[0])) &&
-      std::isalnum(static_cast<unsigned char>(state[1])) &&
-      std::isalnum(static_cast<unsigned char>(state[2])) &&
-      std::isalnum(static_cast<unsigned char>(state[3])) &&
-      std::isalnum(static_cast<unsigned char>(state[4]))))
+  const int result{detail::sqlstate_value(sqlstate)};
+  if (result < 0)
     throw Client_exception{"cannot convert SQLSTATE to int"};
-
-  errno = 0;
-  const long int result{std::strtol(state.data(), nullptr, 36)};
-  DMITIGR_ASSERT(errno == 0);
-  DMITIGR_ASSERT(min_condition().value() <= result &&
-    result <= max_condition().value());
-  return static_cast<int>(result);
+  return result;
 }
 
 DMITIGR_PGFE_INLINE std::string Problem::sqlstate_int_to_string(const int sqlstate)
@@ -31,6 +31,10 @@ namespace dmitigr::pgfe {
  * @ingroup main
  *
  * @brief A problem which occurred on a PostgreSQL server.
+ *
+ * @details Nothing is copied out of the result the problem came with: every
+ * field, the condition included, is read from it when asked for, so a caller
+ * which only looks at the condition pays for nothing else.
  */
 class Problem {
 public:
@@ -49,7 +53,12 @@ public:
   /// Move-assignable.
   Problem& operator=(Problem&&) = default;
 
-  /// @returns The error condition that corresponds to SQLSTATE sqlstate().
+  /**
+   * @returns The error condition that corresponds to SQLSTATE sqlstate().
+   *
+   * @remarks Its value is the SQLSTATE read as a base-36 number, which is the
+   * Server_errc of it, decoded without a lookup.
+   */
   DMITIGR_PGFE_API std::error_condition condition() const noexcept;
 
   /// @returns The SQLSTATE of the problem.
@@ -207,7 +216,6 @@ private:
   friend Notice;
 
   detail::pq::Result pq_result_;
-  std::error_condition condition_;
 
   Problem() = default;
   explicit Problem(detail::pq::Result&& result) noexcept;
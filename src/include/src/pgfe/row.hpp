@@ -98,6 +98,22 @@ public:
   DMITIGR_PGFE_API Data_view data(const std::string_view name,
     std::size_t offset = 0) const noexcept override;
 
+  /**
+   * @overload
+   *
+   * @par Requires
+   * `field.index(*this) < field_count()`.
+   */
+  DMITIGR_PGFE_API Data_view data(const Field_ref& field) const;
+
+  using Composite::operator[];
+
+  /// @returns `data(field)`.
+  Data_view operator[](const Field_ref& field) const
+  {
+    return data(field);
+  }
+
   /// @name Iterators
   /// @{
 
@@ -232,6 +248,8 @@ public:
   /// @}
 
 private:
+  friend Connection;
+
   Row_info info_; // has pq_result_
 
   bool is_invariant_ok() const noexcept override;
@@ -0,0 +1,114 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "exceptions.hpp"
+#include "row_batch.hpp"
+
+namespace dmitigr::pgfe {
+
+DMITIGR_PGFE_INLINE bool Row_batch::is_valid() const noexcept
+{
+  return !results_.empty();
+}
+
+DMITIGR_PGFE_INLINE std::size_t Row_batch::size() const noexcept
+{
+  return size_;
+}
+
+DMITIGR_PGFE_INLINE std::size_t Row_batch::field_count() const noexcept
+{
+  return is_valid() ? static_cast<std::size_t>(results_[0].field_count()) : 0;
+}
+
+DMITIGR_PGFE_INLINE std::string_view
+Row_batch::field_name(const std::size_t index) const
+{
+  if (!(index < field_count()))
+    throw Client_exception{"cannot get field name of row batch"};
+  return results_[0].field_name(static_cast<int>(index));
+}
+
+DMITIGR_PGFE_INLINE std::size_t
+Row_batch::field_index(const std::string_view name) const noexcept
+{
+  const std::size_t count = field_count();
+  for (std::size_t i{}; i < count; ++i) {
+    if (results_[0].field_name(static_cast<int>(i)) == name)
+      return i;
+  }
+  return count;
+}
+
+DMITIGR_PGFE_INLINE std::uint_fast32_t
+Row_batch::type_oid(const std::size_t index) const
+{
+  if (!(index < field_count()))
+    throw Client_exception{"cannot get field type OID of row batch"};
+  return results_[0].field_type_oid(static_cast<int>(index));
+}
+
+DMITIGR_PGFE_INLINE Data_format
+Row_batch::field_format(const std::size_t index) const
+{
+  if (!(index < field_count()))
+    throw Client_exception{"cannot get field format of row batch"};
+  return results_[0].field_format(static_cast<int>(index));
+}
+
+DMITIGR_PGFE_INLINE Data_view
+Row_batch::data(const std::size_t row, const std::size_t field) const
+{
+  if (!(row < size() && field < field_count()))
+    throw Client_exception{"cannot get field data of row batch"};
+
+  // A batch is either a single chunk or as many single rows as its size.
+  const bool is_chunk = results_.size() == 1;
+  const auto& r = is_chunk ? results_[0] : results_[row];
+  const auto rn = is_chunk ? static_cast<int>(row) : 0;
+  const auto fn = static_cast<int>(field);
+  return !r.is_data_null(rn, fn) ?
+    Data_view{r.data_value(rn, fn),
+    static_cast<std::size_t>(r.data_size(rn, fn)), r.field_format(fn)} :
+    Data_view{};
+}
+
+DMITIGR_PGFE_INLINE std::span<const Data_view>
+Row_batch::column(const std::size_t index) const
+{
+  if (!(index < field_count()))
+    throw Client_exception{"cannot get column of row batch"};
+
+  if (columns_.empty() && size_) {
+    const std::size_t count = field_count();
+    columns_.reserve(count * size_);
+    for (std::size_t f{}; f < count; ++f) {
+      for (std::size_t r{}; r < size_; ++r)
+        columns_.push_back(data(r, f));
+    }
+  }
+  return {columns_.data() + index * size_, size_};
+}
+
+DMITIGR_PGFE_INLINE void Row_batch::append(detail::pq::Result&& result)
+{
+  const auto rows = static_cast<std::size_t>(result.row_count());
+  results_.push_back(std::move(result));
+  size_ += rows;
+  columns_.clear();
+}
+
+} // namespace dmitigr::pgfe
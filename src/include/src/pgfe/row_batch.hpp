@@ -0,0 +1,138 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_ROW_BATCH_HPP
+#define DMITIGR_PGFE_ROW_BATCH_HPP
+
+#include "data.hpp"
+#include "dll.hpp"
+#include "pq.hpp"
+#include "types_fwd.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup main
+ *
+ * @brief A batch of rows produced by a PostgreSQL server.
+ *
+ * @details The batch is a chunk of rows of the chunked rows mode of libpq
+ * (since PostgreSQL 17) or, without one, the consecutive rows of the
+ * single-row mode. The views it gives out are valid as long as the batch.
+ *
+ * @see Connection::execute_batched().
+ */
+class Row_batch final {
+public:
+  /// Default-constructible. (Constructs invalid instance.)
+  Row_batch() = default;
+
+  /// Not copy-constructible.
+  Row_batch(const Row_batch&) = delete;
+
+  /// Move-constructible.
+  Row_batch(Row_batch&&) = default;
+
+  /// Not copy-assignable.
+  Row_batch& operator=(const Row_batch&) = delete;
+
+  /// Move-assignable.
+  Row_batch& operator=(Row_batch&&) = default;
+
+  /// @returns `true` if the instance is valid.
+  DMITIGR_PGFE_API bool is_valid() const noexcept;
+
+  /// @returns `true` if the instance is valid.
+  explicit operator bool() const noexcept
+  {
+    return is_valid();
+  }
+
+  /// @returns The number of rows.
+  DMITIGR_PGFE_API std::size_t size() const noexcept;
+
+  /// @returns The number of fields of each row.
+  DMITIGR_PGFE_API std::size_t field_count() const noexcept;
+
+  /**
+   * @returns The name of the field at `index`.
+   *
+   * @par Requires
+   * `index < field_count()`.
+   */
+  DMITIGR_PGFE_API std::string_view field_name(std::size_t index) const;
+
+  /// @returns The index of the field named `name`, or `field_count()`.
+  DMITIGR_PGFE_API std::size_t field_index(std::string_view name) const noexcept;
+
+  /**
+   * @returns The OID of the data type of the field at `index`.
+   *
+   * @par Requires
+   * `index < field_count()`.
+   */
+  DMITIGR_PGFE_API std::uint_fast32_t type_oid(std::size_t index) const;
+
+  /**
+   * @returns The data format of the field at `index`.
+   *
+   * @par Requires
+   * `index < field_count()`.
+   */
+  DMITIGR_PGFE_API Data_format field_format(std::size_t index) const;
+
+  /**
+   * @returns The data of the field at `field` of the row at `row`.
+   *
+   * @par Requires
+   * `row < size() && field < field_count()`.
+   */
+  DMITIGR_PGFE_API Data_view data(std::size_t row, std::size_t field) const;
+
+  /**
+   * @returns The data of the field at `index` of every row, in order.
+   *
+   * @details The columns are gathered once for all the fields, on the first
+   * call.
+   *
+   * @par Requires
+   * `index < field_count()`.
+   */
+  DMITIGR_PGFE_API std::span<const Data_view> column(std::size_t index) const;
+
+private:
+  friend Connection;
+
+  std::vector<detail::pq::Result> results_; // one chunk or single rows
+  std::size_t size_{};
+  mutable std::vector<Data_view> columns_;
+
+  void append(detail::pq::Result&& result);
+};
+
+} // namespace dmitigr::pgfe
+
+#ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
+#include "row_batch.cpp"
+#endif
+
+#endif  // DMITIGR_PGFE_ROW_BATCH_HPP
@@ -62,9 +62,13 @@ Row_info::field_index(const std::string_view name,
   const std::size_t fc{field_count()};
   if (!(offset < fc))
     return fc;
+  // Compared without measuring every name first.
   for (std::size_t i{offset}; i < fc; ++i) {
-    const std::string_view nm{pq_result_.field_name(static_cast<int>(i))};
-    if (nm == name)
+    const char* const nm{pq_result_.field_name(static_cast<int>(i))};
+    std::size_t j{};
+    while (j < name.size() && nm[j] && nm[j] == name[j])
+      ++j;
+    if (j == name.size() && !nm[j])
       return i;
   }
   return fc;
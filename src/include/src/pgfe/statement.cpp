@@ -15,6 +15,7 @@
 // limitations under the License.
 
 #include "../base/assert.hpp"
+#include "../str/escape.hpp"
 #include "../str/predicate.hpp"
 #include "connection.hpp"
 #include "data.hpp"
@@ -25,16 +26,13 @@
 #include <cassert>
 #include <cstring>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
+#include <unordered_map>
 
 namespace dmitigr::pgfe {
 
-DMITIGR_PGFE_INLINE
-Statement::Fragment::Fragment(const Type tp, const std::string& s)
-  : type(tp)
-  , str(s)
-{}
-
 DMITIGR_PGFE_INLINE bool
 Statement::Fragment::is_named_parameter() const noexcept
 {
@@ -44,17 +42,11 @@ Statement::Fragment::is_named_parameter() const noexcept
     type == Ft::named_parameter_identifier;
 }
 
-DMITIGR_PGFE_INLINE bool
-Statement::Fragment::is_named_parameter(const std::string_view name) const noexcept
-{
-  return is_named_parameter() && str == name;
-}
-
 // =============================================================================
 
 DMITIGR_PGFE_INLINE Statement::Statement(const std::string_view text)
 {
-  auto s = parse_sql_input(text).first;
+  auto s = parsed(text);
   swap(s);
   assert(is_invariant_ok());
 }
@@ -68,14 +60,15 @@ DMITIGR_PGFE_INLINE Statement::Statement(const char* const text)
 {}
 
 DMITIGR_PGFE_INLINE Statement::Statement(const Statement& rhs)
-  : fragments_{rhs.fragments_}
+  : text_{rhs.text_}
+  , fragments_{rhs.fragments_}
   , positional_parameters_{rhs.positional_parameters_}
+  , named_parameters_{rhs.named_parameters_}
+  , compiled_{rhs.compiled_}
   , is_extra_data_should_be_extracted_from_comments_{
       rhs.is_extra_data_should_be_extracted_from_comments_}
   , extra_{rhs.extra_}
-{
-  named_parameters_ = named_parameters();
-}
+{}
 
 DMITIGR_PGFE_INLINE Statement& Statement::operator=(const Statement& rhs)
 {
@@ -87,14 +80,15 @@ DMITIGR_PGFE_INLINE Statement& Statement::operator=(const Statement& rhs)
 }
 
 DMITIGR_PGFE_INLINE Statement::Statement(Statement&& rhs) noexcept
-  : fragments_{std::move(rhs.fragments_)}
+  : text_{std::move(rhs.text_)}
+  , fragments_{std::move(rhs.fragments_)}
   , positional_parameters_{std::move(rhs.positional_parameters_)}
+  , named_parameters_{std::move(rhs.named_parameters_)}
+  , compiled_{std::move(rhs.compiled_)}
   , is_extra_data_should_be_extracted_from_comments_{
       std::move(rhs.is_extra_data_should_be_extracted_from_comments_)}
   , extra_{std::move(rhs.extra_)}
-{
-  named_parameters_ = named_parameters();
-}
+{}
 
 DMITIGR_PGFE_INLINE Statement& Statement::operator=(Statement&& rhs) noexcept
 {
@@ -108,9 +102,11 @@ DMITIGR_PGFE_INLINE Statement& Statement::operator=(Statement&& rhs) noexcept
 DMITIGR_PGFE_INLINE void Statement::swap(Statement& rhs) noexcept
 {
   using std::swap;
+  swap(text_, rhs.text_);
   swap(fragments_, rhs.fragments_);
   swap(positional_parameters_, rhs.positional_parameters_);
   swap(named_parameters_, rhs.named_parameters_);
+  swap(compiled_, rhs.compiled_);
   swap(is_extra_data_should_be_extracted_from_comments_,
     rhs.is_extra_data_should_be_extracted_from_comments_);
   swap(extra_, rhs.extra_);
@@ -152,7 +148,7 @@ Statement::parameter_name(const std::size_t index) const
 {
   if (!((positional_parameter_count() <= index) && (index < parameter_count())))
     throw Client_exception{"cannot get Statement parameter name"};
-  return named_parameters_[index - positional_parameter_count()]->str;
+  return str(fragments_[named_parameters_[index - positional_parameter_count()]]);
 }
 
 DMITIGR_PGFE_INLINE std::size_t
@@ -171,7 +167,7 @@ DMITIGR_PGFE_INLINE bool Statement::is_query_empty() const noexcept
   return all_of(cbegin(fragments_), cend(fragments_),
     [this](const Fragment& f)
     {
-      return is_comment(f) || (is_text(f) && str::is_blank(f.str));
+      return is_comment(f) || (is_text(f) && str::is_blank(str(f)));
     });
 }
 
@@ -222,8 +218,13 @@ DMITIGR_PGFE_INLINE void Statement::append(const Statement& appendix)
   const bool was_query_empty{is_query_empty()};
 
   // Update fragments.
-  fragments_.insert(cend(fragments_), cbegin(appendix.fragments_),
-    cend(appendix.fragments_));
+  const auto offset = text_.size();
+  text_.append(appendix.text_);
+  fragments_.reserve(fragments_.size() + appendix.fragments_.size());
+  for (const auto& fragment : appendix.fragments_) {
+    fragments_.push_back(fragment);
+    fragments_.back().offset += offset;
+  }
   update_cache(appendix); // can throw
 
   if (was_query_empty)
@@ -239,7 +240,7 @@ Statement::bind(const std::string_view name,
   if (!has_parameter(name))
     throw Client_exception{"cannot bind Statement parameter"};
   for (auto& fragment : fragments_) {
-    if (fragment.is_named_parameter(name))
+    if (is_named_parameter(fragment, name))
       fragment.value = value;
   }
   assert(is_invariant_ok());
@@ -252,23 +253,64 @@ Statement::bound(const std::string_view name) const
   if (!has_parameter(name))
     throw Client_exception{"cannot get bound Statement parameter"};
   for (auto& fragment : fragments_) {
-    if (fragment.is_named_parameter(name))
+    if (is_named_parameter(fragment, name))
       return fragment.value;
   }
   DMITIGR_ASSERT(false);
 }
 
+DMITIGR_PGFE_INLINE auto
+Statement::param(const std::string_view name) const -> Parameter_handle
+{
+  const auto index = parameter_index(name);
+  if (!(index < parameter_count()))
+    throw Client_exception{"cannot get Statement parameter handle"};
+  return Parameter_handle{index,
+    named_parameters_[index - positional_parameter_count()]};
+}
+
+DMITIGR_PGFE_INLINE Statement&
+Statement::bind(const Parameter_handle& handle, const std::string_view value)
+{
+  if (!(handle.fragment_ < fragments_.size() &&
+      fragments_[handle.fragment_].is_named_parameter()))
+    throw Client_exception{"cannot bind Statement parameter"};
+  auto& bound = fragments_[handle.fragment_].value;
+  if (bound)
+    bound->assign(value);
+  else
+    bound.emplace(value);
+  return *this;
+}
+
+DMITIGR_PGFE_INLINE Statement&
+Statement::bind(const Parameter_handle& handle, const char* const value)
+{
+  return bind(handle, std::string_view{value});
+}
+
+DMITIGR_PGFE_INLINE Statement&
+Statement::bind(const Parameter_handle& handle, std::string&& value)
+{
+  if (!(handle.fragment_ < fragments_.size() &&
+      fragments_[handle.fragment_].is_named_parameter()))
+    throw Client_exception{"cannot bind Statement parameter"};
+  fragments_[handle.fragment_].value = std::move(value);
+  return *this;
+}
+
 DMITIGR_PGFE_INLINE std::size_t
 Statement::bound_parameter_count() const noexcept
 {
   return count_if(cbegin(fragments_), cend(fragments_),
-    [counted = std::vector<std::string>{}](const auto& fragment)mutable -> bool
+    [this, counted = std::vector<std::string_view>{}](const auto& fragment)mutable -> bool
     {
       if (fragment.is_named_parameter()) {
+        const auto name = str(fragment);
         const bool is_uncounted{none_of(cbegin(counted), cend(counted),
-          [&fragment](const auto& name){return name == fragment.str;})};
+          [name](const auto& counted_name){return counted_name == name;})};
         if (is_uncounted) {
-          counted.push_back(fragment.str);
+          counted.push_back(name);
           return static_cast<bool>(fragment.value);
         }
       }
@@ -293,17 +335,27 @@ Statement::replace_parameter(const std::string_view name,
   if (!(has_parameter(name) && (this != &replacement)))
     throw Client_exception{"cannot replace Statement parameter"};
 
-  // Update fragments.
-  for (auto fi = begin(fragments_); fi != end(fragments_);) {
-    if (fi->is_named_parameter(name)) {
-      // Insert the `replacement` just before `fi`.
-      fragments_.insert(fi, cbegin(replacement.fragments_),
-        cend(replacement.fragments_));
-      // Erase named parameter pointed by `fi` and got the next iterator.
-      fi = fragments_.erase(fi);
+  // Rebuild the fragments with the `replacement` ones instead of `name`.
+  std::string text;
+  Fragment_vector fragments;
+  text.reserve(text_.size() + replacement.text_.size());
+  fragments.reserve(fragments_.size() + replacement.fragments_.size());
+  const auto push = [&text, &fragments](const Statement& owner,
+    const Fragment& fragment)
+  {
+    fragments.push_back(fragment);
+    fragments.back().offset = text.size();
+    text.append(owner.str(fragment));
+  };
+  for (const auto& fragment : fragments_) {
+    if (is_named_parameter(fragment, name)) {
+      for (const auto& rfragment : replacement.fragments_)
+        push(replacement, rfragment);
     } else
-      ++fi;
+      push(*this, fragment);
   }
+  text_.swap(text);
+  fragments_.swap(fragments);
 
   update_cache(replacement);  // can throw
 
@@ -314,48 +366,55 @@ DMITIGR_PGFE_INLINE std::string Statement::to_string() const
 {
   using Ft = Fragment::Type;
   std::string result;
-  result.reserve(512);
+  result.reserve(text_.size() + 4 * fragments_.size());
   for (const auto& fragment : fragments_) {
     switch (fragment.type) {
     case Ft::text:
-      result += fragment.str;
+      result += str(fragment);
       break;
     case Ft::one_line_comment:
       result += "--";
-      result += fragment.str;
+      result += str(fragment);
       result += '\n';
       break;
     case Ft::multi_line_comment:
       result += "/*";
-      result += fragment.str;
+      result += str(fragment);
       result += "*/";
       break;
     case Ft::named_parameter:
       result += ':';
-      result += fragment.str;
+      result += str(fragment);
       break;
     case Ft::named_parameter_literal:
       result += ":'";
-      result += fragment.str;
+      result += str(fragment);
       result += '\'';
       break;
     case Ft::named_parameter_identifier:
       result += ":\"";
-      result += fragment.str;
+      result += str(fragment);
       result += '"';
       break;
     case Ft::positional_parameter:
       result += '$';
-      result += fragment.str;
+      result += str(fragment);
       break;
     }
   }
-  result.shrink_to_fit();
   return result;
 }
 
 DMITIGR_PGFE_INLINE std::string
 Statement::to_query_string(const Connection& conn) const
+{
+  std::string result;
+  to_query_string(conn, result);
+  return result;
+}
+
+DMITIGR_PGFE_INLINE void
+Statement::to_query_string(const Connection& conn, std::string& result) const
 {
   using Ft = Fragment::Type;
 
@@ -366,12 +425,12 @@ Statement::to_query_string(const Connection& conn) const
     throw Client_exception{"cannot convert Statement to query string: "
       "not connected"};
 
-  static const auto check_value_bound = [](const auto& fragment)
+  const auto check_value_bound = [this](const auto& fragment, const auto& value)
   {
     DMITIGR_ASSERT(fragment.is_named_parameter());
-    if (!fragment.value) {
+    if (!value) {
       std::string what{"named parameter "};
-      what.append(fragment.str);
+      what.append(str(fragment));
       const char* const type_str =
         fragment.type == Ft::named_parameter_literal ? "literal" :
         fragment.type == Ft::named_parameter_identifier ? "identifier" : nullptr;
@@ -382,37 +441,83 @@ Statement::to_query_string(const Connection& conn) const
     }
   };
 
-  std::string result;
-  result.reserve(512);
-  for (const auto& fragment : fragments_) {
+  if (!compiled_)
+    compiled_.emplace(compiled());
+  const auto& [text, slots] = *compiled_;
+
+  // Compute the size to reserve, which is exact except for the quoted values.
+  // The value of a parameter is the one of its first occurrence, which is
+  // all bind() with a handle writes.
+  std::size_t size{text.size()};
+  for (const auto& slot : slots) {
+    const auto& fragment = fragments_[slot.fragment];
+    const auto& value = fragments_[slot.value].value;
+    switch (fragment.type) {
+    case Ft::named_parameter:
+      size += value ? value->size() :
+        1 + std::to_string(slot.index + 1).size();
+      break;
+    case Ft::named_parameter_literal:
+    case Ft::named_parameter_identifier:
+      check_value_bound(fragment, value);
+      size += 2 + str::escaped_size_max(value->size());
+      break;
+    default:
+      DMITIGR_ASSERT(false);
+    }
+  }
+
+  result.clear();
+  result.reserve(size);
+  std::size_t offset{};
+  for (const auto& slot : slots) {
+    result.append(text, offset, slot.offset - offset);
+    offset = slot.offset;
+    const auto& fragment = fragments_[slot.fragment];
+    const auto& value = fragments_[slot.value].value;
+    if (fragment.type == Ft::named_parameter_literal)
+      conn.append_quoted_literal(result, *value);
+    else if (fragment.type == Ft::named_parameter_identifier)
+      conn.append_quoted_identifier(result, *value);
+    else if (value)
+      result += *value;
+    else {
+      result += '$';
+      result += std::to_string(slot.index + 1);
+    }
+  }
+  result.append(text, offset);
+}
+
+DMITIGR_PGFE_INLINE auto Statement::compiled() const -> Compiled
+{
+  using Ft = Fragment::Type;
+  Compiled result;
+  result.text.reserve(text_.size() + fragments_.size());
+  for (std::size_t i{}; i < fragments_.size(); ++i) {
+    const auto& fragment = fragments_[i];
     switch (fragment.type) {
     case Ft::text:
-      result += fragment.str;
+      result.text += str(fragment);
       break;
     case Ft::one_line_comment:
       [[fallthrough]];
     case Ft::multi_line_comment:
       break;
     case Ft::named_parameter:
-      if (!fragment.value) {
-        const auto idx = named_parameter_index(fragment.str);
-        DMITIGR_ASSERT(idx < parameter_count());
-        result += '$';
-        result += std::to_string(idx + 1);
-      } else
-        result += *fragment.value;
-      break;
+      [[fallthrough]];
     case Ft::named_parameter_literal:
-      check_value_bound(fragment);
-      result += conn.to_quoted_literal(*fragment.value);
-      break;
-    case Ft::named_parameter_identifier:
-      check_value_bound(fragment);
-      result += conn.to_quoted_identifier(*fragment.value);
+      [[fallthrough]];
+    case Ft::named_parameter_identifier: {
+      const auto index = named_parameter_index(str(fragment));
+      DMITIGR_ASSERT(index < parameter_count());
+      result.slots.push_back({result.text.size(), i, index,
+        named_parameters_[index - positional_parameter_count()]});
       break;
+    }
     case Ft::positional_parameter:
-      result += '$';
-      result += fragment.str;
+      result.text += '$';
+      result.text += str(fragment);
       break;
     }
   }
@@ -435,17 +540,17 @@ public:
   /// Denotes the fragment type.
   using Fragment = Statement::Fragment;
 
-  /// Denotes the fragment list type.
-  using Fragment_list = Statement::Fragment_list;
+  /// Denotes the fragment vector type.
+  using Fragment_vector = Statement::Fragment_vector;
 
   /// @returns The vector of associated extra data.
   static std::vector<std::pair<Key, Value>>
-  extract(const Fragment_list& fragments)
+  extract(const Statement& statement)
   {
     std::vector<std::pair<Key, Value>> result;
-    const auto iters = first_related_comments(fragments);
-    if (iters.first != cend(fragments)) {
-      const auto comments = joined_comments(iters.first, iters.second);
+    const auto iters = first_related_comments(statement);
+    if (iters.first != cend(statement.fragments_)) {
+      const auto comments = joined_comments(statement, iters.first, iters.second);
       for (const auto& comment : comments) {
         auto associations = extract(comment.first, comment.second);
         result.reserve(result.capacity() + associations.size());
@@ -696,12 +801,12 @@ private:
    *
    * @returns The pair of iterators that specifies the range of relevant comments.
    */
-  std::pair<Fragment_list::const_iterator, Fragment_list::const_iterator>
-  static first_related_comments(const Fragment_list& fragments)
+  std::pair<Fragment_vector::const_iterator, Fragment_vector::const_iterator>
+  static first_related_comments(const Statement& statement)
   {
     using Ft = Fragment::Type;
-    const auto b = cbegin(fragments);
-    const auto e = cend(fragments);
+    const auto b = cbegin(statement.fragments_);
+    const auto e = cend(statement.fragments_);
     auto result = std::make_pair(e, e);
 
     const auto is_nearby_string = [](const std::string_view str)
@@ -722,10 +827,10 @@ private:
      * Stops lookup when either named parameter or positional parameter are found.
      * (Only fragments of type `text` can have related comments.)
      */
-    auto i = find_if(b, e, [&is_nearby_string](const Fragment& f)
+    auto i = find_if(b, e, [&statement, &is_nearby_string](const Fragment& f)
     {
       return (f.type == Ft::text &&
-        is_nearby_string(f.str) && !str::is_blank(f.str)) ||
+        is_nearby_string(statement.str(f)) && !str::is_blank(statement.str(f))) ||
         f.type == Ft::named_parameter ||
         f.type == Ft::positional_parameter;
     });
@@ -734,9 +839,9 @@ private:
       do {
         --i;
         DMITIGR_ASSERT(is_comment(*i) ||
-          (is_text(*i) && str::is_blank(i->str)));
+          (is_text(*i) && str::is_blank(statement.str(*i))));
         if (i->type == Ft::text) {
-          if (!is_nearby_string(i->str))
+          if (!is_nearby_string(statement.str(*i)))
             break;
         }
         result.first = i;
@@ -755,16 +860,16 @@ private:
    *     appended to the result.
    */
   std::pair<std::pair<std::string, Extra::Comment_type>,
-    Fragment_list::const_iterator>
-  static joined_comments_of_same_type(Fragment_list::const_iterator i,
-    const Fragment_list::const_iterator e)
+    Fragment_vector::const_iterator>
+  static joined_comments_of_same_type(const Statement& statement,
+    Fragment_vector::const_iterator i, const Fragment_vector::const_iterator e)
   {
     using Ft = Fragment::Type;
     DMITIGR_ASSERT(is_comment(*i));
     std::string result;
     const auto fragment_type = i->type;
-    for (; i->type == fragment_type && i != e; ++i) {
-      result.append(i->str);
+    for (; i != e && i->type == fragment_type; ++i) {
+      result.append(statement.str(*i));
       if (fragment_type == Ft::one_line_comment)
         result.append("\n");
     }
@@ -790,13 +895,13 @@ private:
    *   - the type of the joined comments as second element.
    */
   std::vector<std::pair<std::string, Extra::Comment_type>>
-  static joined_comments(Fragment_list::const_iterator i,
-    const Fragment_list::const_iterator e)
+  static joined_comments(const Statement& statement,
+    Fragment_vector::const_iterator i, const Fragment_vector::const_iterator e)
   {
     std::vector<std::pair<std::string, Extra::Comment_type>> result;
     while (i != e) {
       if (is_comment(*i)) {
-        auto comments = joined_comments_of_same_type(i, e);
+        auto comments = joined_comments_of_same_type(statement, i, e);
         result.push_back(std::move(comments.first));
         i = comments.second;
       } else
@@ -809,9 +914,9 @@ private:
 DMITIGR_PGFE_INLINE const Tuple& Statement::extra() const noexcept
 {
   if (!extra_)
-    extra_.emplace(Extra::extract(fragments_));
+    extra_.emplace(Extra::extract(*this));
   else if (is_extra_data_should_be_extracted_from_comments_)
-    extra_->append(Tuple{Extra::extract(fragments_)});
+    extra_->append(Tuple{Extra::extract(*this)});
   is_extra_data_should_be_extracted_from_comments_ = false;
   assert(is_invariant_ok());
   return *extra_;
@@ -853,7 +958,15 @@ DMITIGR_PGFE_INLINE bool Statement::is_invariant_ok() const noexcept
 DMITIGR_PGFE_INLINE void
 Statement::push_back_fragment(const Fragment::Type type, const std::string& str)
 {
-  fragments_.emplace_back(type, str);
+  compiled_.reset();
+  const auto offset = text_.size();
+  text_.append(str);
+  try {
+    fragments_.push_back(Fragment{type, offset, str.size(), {}});
+  } catch (...) {
+    text_.resize(offset);
+    throw;
+  }
   assert(is_invariant_ok());
 }
 
@@ -904,10 +1017,8 @@ Statement::push_named_parameter(const std::string& str, const char quote_char)
       quote_char == '\"' ? Ft::named_parameter_identifier : Ft::named_parameter;
     push_back_fragment(type, str);
     if (none_of(cbegin(named_parameters_), cend(named_parameters_),
-        [&str](const auto& i){return (i->str == str);})) {
-      auto e = cend(fragments_);
-      --e;
-      named_parameters_.push_back(e);
+        [this, &str](const auto& i){return this->str(fragments_[i]) == str;})) {
+      named_parameters_.push_back(fragments_.size() - 1);
     }
   } else
     throw Client_exception{"maximum parameters count (" +
@@ -923,6 +1034,8 @@ Statement::push_named_parameter(const std::string& str, const char quote_char)
 // Exception safety guarantee: basic.
 DMITIGR_PGFE_INLINE void Statement::update_cache(const Statement& rhs)
 {
+  compiled_.reset();
+
   // Prepare positional parameters for merge.
   const auto old_pos_params_size = positional_parameters_.size();
   const auto rhs_pos_params_size = rhs.positional_parameters_.size();
@@ -958,7 +1071,7 @@ Statement::named_parameter_type(const std::size_t index) const noexcept
 {
   DMITIGR_ASSERT(positional_parameter_count() <= index && index < parameter_count());
   const auto relative_index = index - positional_parameter_count();
-  return named_parameters_[relative_index]->type;
+  return fragments_[named_parameters_[relative_index]].type;
 }
 
 DMITIGR_PGFE_INLINE std::size_t
@@ -968,22 +1081,25 @@ Statement::named_parameter_index(const std::string_view name) const noexcept
   {
     const auto b = cbegin(named_parameters_);
     const auto e = cend(named_parameters_);
-    const auto i = find_if(b, e, [name](const auto& pi){return pi->str == name;});
+    const auto i = find_if(b, e, [this, name](const auto& pi)
+    {
+      return str(fragments_[pi]) == name;
+    });
     return static_cast<std::size_t>(i - b);
   }();
   return positional_parameter_count() + relative_index;
 }
 
 DMITIGR_PGFE_INLINE auto Statement::named_parameters() const
-  -> std::vector<Fragment_list::const_iterator>
+  -> std::vector<std::size_t>
 {
-  std::vector<Fragment_list::const_iterator> result;
+  std::vector<std::size_t> result;
   result.reserve(8);
-  const auto e = cend(fragments_);
-  for (auto i = cbegin(fragments_); i != e; ++i) {
-    if (i->is_named_parameter()) {
+  for (std::size_t i{}; i < fragments_.size(); ++i) {
+    if (fragments_[i].is_named_parameter()) {
+      const auto name = str(fragments_[i]);
       if (none_of(cbegin(result), cend(result),
-          [i](const auto& result_i){return i->str == result_i->str;}))
+          [this, name](const auto& r){return str(fragments_[r]) == name;}))
         result.push_back(i);
     }
   }
@@ -994,6 +1110,19 @@ DMITIGR_PGFE_INLINE auto Statement::named_parameters() const
 // Predicates
 // ---------------------------------------------------------------------------
 
+DMITIGR_PGFE_INLINE std::string_view
+Statement::str(const Fragment& f) const noexcept
+{
+  return {text_.data() + f.offset, f.size};
+}
+
+DMITIGR_PGFE_INLINE bool
+Statement::is_named_parameter(const Fragment& f,
+  const std::string_view name) const noexcept
+{
+  return f.is_named_parameter() && str(f) == name;
+}
+
 DMITIGR_PGFE_INLINE bool
 Statement::is_comment(const Fragment& f) noexcept
 {
@@ -1010,81 +1139,54 @@ Statement::is_text(const Fragment& f) noexcept
 DMITIGR_PGFE_INLINE bool
 Statement::is_ident_char(const unsigned char c) noexcept
 {
-  return std::isalnum(c) || c == '_' || c == '$';
+  return detail::is_sql_ident_char(c);
 }
 
 DMITIGR_PGFE_INLINE bool
 Statement::is_quote_char(const unsigned char c) noexcept
 {
-  return c == '\'' || c == '\"';
+  return detail::is_sql_quote_char(c);
 }
 
 // -----------------------------------------------------------------------------
-// Basic SQL input parser
+// Parsed statements cache
 // -----------------------------------------------------------------------------
 
-/*
- * SQL SYNTAX BASICS (from PostgreSQL documentation):
- * https://www.postgresql.org/docs/current/static/sql-syntax-lexical.html
- *
- * COMMANDS
- *
- * A command is composed of a sequence of tokens, terminated by a (";").
- * A token can be a key word, an identifier, a quoted identifier,
- * a literal (or constant), or a special character symbol. Tokens are normally
- * separated by whitespace (space, tab, newline), but need not be if there is no
- * ambiguity.
- *
- * IDENTIFIERS (UNQUOTED)
- *
- * SQL identifiers and key words must begin with a letter (a-z, but also
- * letters with diacritical marks and non-Latin letters) or an ("_").
- * Subsequent characters in an identifier or key word can be letters,
- * underscores, digits (0-9), or dollar signs ($).
- *
- * QUOTED IDENTIFIERS
- *
- * The delimited identifier or quoted identifier is formed by enclosing an
- * arbitrary sequence of characters in double-quotes ("). Quoted identifiers can
- * contain any character, except the character with code zero. (To include a
- * double quote, two double quotes should be written.)
- *
- * CONSTANTS
- *
- *   STRING CONSTANTS (QUOTED LITERALS)
- *
- * A string constant in SQL is an arbitrary sequence of characters bounded
- * by single quotes ('), for example 'This is a string'. To include a
- * single-quote character within a string constant, write two adjacent
- * single quotes, e.g., 'Dianne''s horse'.
- *
- *   DOLLAR QUOTED STRING CONSTANTS
- *
- * A dollar-quoted string constant consists of a dollar sign ($), an
- * optional "tag" of zero or more characters, another dollar sign, an
- * arbitrary sequence of characters that makes up the string content, a
- * dollar sign, the same tag that began this dollar quote, and a dollar
- * sign.
- * The tag, if any, of a dollar-quoted string follows the same rules
- * as an unquoted identifier, except that it cannot contain a dollar sign.
- * A dollar-quoted string that follows a keyword or identifier must be
- * separated from it by whitespace; otherwise the dollar quoting delimiter
- * would be taken as part of the preceding identifier.
- *
- * SPECIAL CHARACTERS
- *
- * - A dollar sign ("$") followed by digits is used to represent a positional
- * parameter in the body of a function definition or a prepared statement.
- * In other contexts the dollar sign can be part of an identifier or a
- * dollar-quoted string constant.
- *
- * - The colon (":") is used to select "slices" from arrays. In certain SQL
- * dialects (such as Embedded SQL), the colon is used to prefix variable
- * names.
- * [In Pgfe ":" is user to prefix named parameters and placeholders.]
- *
- * - Brackets ([]) are used to select the elements of an array.
- */
+DMITIGR_PGFE_INLINE Statement Statement::parsed(const std::string_view text)
+{
+  /*
+   * The texts built at run time are mostly seen once, so rather than evict
+   * the cache just restarts when full, and long texts aren't cached at all.
+   */
+  constexpr std::size_t max_size{1024};
+  constexpr std::size_t max_text_size{8192};
+  static std::shared_mutex mutex;
+  static std::unordered_map<std::string, Statement> cache;
+
+  if (text.size() > max_text_size)
+    return parse_sql_input(text).first;
+
+  const std::string key{text};
+  {
+    const std::shared_lock lock{mutex};
+    if (const auto i = cache.find(key); i != cend(cache))
+      return i->second;
+  }
+  auto result = parse_sql_input(text).first;
+  result.compiled_.emplace(result.compiled());
+  {
+    const std::lock_guard lock{mutex};
+    if (cache.size() >= max_size)
+      cache.clear();
+    cache.try_emplace(key, result);
+  }
+  return result;
+}
+
+
+// -----------------------------------------------------------------------------
+// Basic SQL input parser
+// -----------------------------------------------------------------------------
 
 /**
  * @returns Preparsed SQL string in pair with the pointer to a character
@@ -1093,366 +1195,44 @@ Statement::is_quote_char(const unsigned char c) noexcept
 DMITIGR_PGFE_INLINE std::pair<Statement, std::string_view::size_type>
 Statement::parse_sql_input(const std::string_view text)
 {
-  enum {
-    top,
-
-    bracket,
-
-    colon,
-    named_parameter,
-
-    dollar,
-    positional_parameter,
-    dollar_quote_leading_tag,
-    dollar_quote,
-    dollar_quote_dollar,
-
-    quote,
-    quote_quote,
-
-    dash,
-    one_line_comment,
-
-    slash,
-    multi_line_comment,
-    multi_line_comment_star
-  } state = top;
-
-  Statement result;
-  int depth{};
-  char current_char{};
-  char previous_char{};
-  char quote_char{};
-  std::string fragment;
-  std::string dollar_quote_leading_tag_name;
-  std::string dollar_quote_trailing_tag_name;
-  const auto b = cbegin(text);
-  auto i = b;
-  for (const auto e = cend(text); i != e; previous_char = current_char, ++i) {
-    current_char = *i;
-    switch (state) {
-    case top:
-      switch (current_char) {
-      case '\'':
-        state = quote;
-        quote_char = current_char;
-        fragment += current_char;
-        continue;
-
-      case '"':
-        state = quote;
-        quote_char = current_char;
-        fragment += current_char;
-        continue;
-
-      case '[':
-        state = bracket;
-        depth = 1;
-        fragment += current_char;
-        continue;
-
-      case '$':
-        if (!is_ident_char(previous_char))
-          state = dollar;
-        else
-          fragment += current_char;
-
-        continue;
-
-      case ':':
-        if (previous_char != ':')
-          state = colon;
-        else
-          fragment += current_char;
-
-        continue;
-
-      case '-':
-        state = dash;
-        continue;
-
-      case '/':
-        state = slash;
-        continue;
-
-      case ';':
-        goto finish;
-
-      default:
-        fragment += current_char;
-        continue;
-      } // switch (current_char)
-
-    case bracket:
-      if (current_char == ']')
-        --depth;
-      else if (current_char == '[')
-        ++depth;
-
-      if (depth == 0) {
-        DMITIGR_ASSERT(current_char == ']');
-        state = top;
-      }
-
-      fragment += current_char;
-      continue;
-
-    case dollar:
-      DMITIGR_ASSERT(previous_char == '$');
-      if (isdigit(static_cast<unsigned char>(current_char))) {
-        state = positional_parameter;
-        result.push_text(fragment);
-        fragment.clear();
-        // The 1st digit of positional parameter (current_char) will be stored below.
-      } else if (is_ident_char(current_char)) {
-        if (current_char == '$') {
-          state = dollar_quote;
-        } else {
-          state = dollar_quote_leading_tag;
-          dollar_quote_leading_tag_name += current_char;
-        }
-        fragment += previous_char;
-      } else {
-        state = top;
-        fragment += previous_char;
-      }
-
-      fragment += current_char;
-      continue;
-
-    case positional_parameter:
-      DMITIGR_ASSERT(isdigit(static_cast<unsigned char>(previous_char)));
-      if (!isdigit(static_cast<unsigned char>(current_char))) {
-        state = top;
-        result.push_positional_parameter(fragment);
-        fragment.clear();
-      }
-
-      if (current_char != ';') {
-        fragment += current_char;
-        continue;
-      } else
-        goto finish;
-
-    case dollar_quote_leading_tag:
-      DMITIGR_ASSERT(previous_char != '$' && is_ident_char(previous_char));
-      if (current_char == '$') {
-        fragment += current_char;
-        state = dollar_quote;
-      } else if (is_ident_char(current_char)) {
-        dollar_quote_leading_tag_name += current_char;
-        fragment += current_char;
-      } else
-        throw Client_exception{"invalid dollar quote tag"};
-
-      continue;
-
-    case dollar_quote:
-      if (current_char == '$')
-        state = dollar_quote_dollar;
-
-      fragment += current_char;
-      continue;
-
-    case dollar_quote_dollar:
-      if (current_char == '$') {
-        if (dollar_quote_leading_tag_name == dollar_quote_trailing_tag_name) {
-          state = top;
-          dollar_quote_leading_tag_name.clear();
-        } else
-          state = dollar_quote;
-
-        dollar_quote_trailing_tag_name.clear();
-      } else
-        dollar_quote_trailing_tag_name += current_char;
-
-      fragment += current_char;
-      continue;
-
-    case colon:
-      DMITIGR_ASSERT(previous_char == ':');
-      if (is_ident_char(current_char) || is_quote_char(current_char)) {
-        state = named_parameter;
-        result.push_text(fragment);
-        fragment.clear();
-        // The 1st character of the named parameter (current_char) will be stored below.
-      } else {
-        state = top;
-        fragment += previous_char;
-      }
-
-      if (state == named_parameter && is_quote_char(current_char)) {
-        quote_char = current_char;
-        continue;
-      } else if (current_char != ';') {
-        fragment += current_char;
-        continue;
-      } else
-        goto finish;
-
-    case named_parameter:
-      DMITIGR_ASSERT(is_ident_char(previous_char) ||
-        (is_quote_char(previous_char) && quote_char));
-
-      if (!is_ident_char(current_char)) {
-        state = top;
-        result.push_named_parameter(fragment, quote_char);
-        fragment.clear();
-      }
-
-      if (current_char == quote_char) {
-        quote_char = 0;
-        continue;
-      } if (current_char != ';') {
-        fragment += current_char;
-        continue;
-      } else
-        goto finish;
-
-    case quote:
-      if (current_char == quote_char)
-        state = quote_quote;
-      else
-        fragment += current_char;
-
-      continue;
-
-    case quote_quote:
-      DMITIGR_ASSERT(previous_char == quote_char);
-      if (current_char == quote_char) {
-        state = quote;
-        // Skip previous quote.
-      } else {
-        state = top;
-        quote_char = 0;
-        fragment += previous_char; // store previous quote
-      }
-
-      if (current_char != ';') {
-        fragment += current_char;
-        continue;
-      } else
-        goto finish;
-
-    case dash:
-      DMITIGR_ASSERT(previous_char == '-');
-      if (current_char == '-') {
-        state = one_line_comment;
-        result.push_text(fragment);
-        fragment.clear();
-        // The comment marker ("--") will not be included in the next fragment.
-      } else {
-        state = top;
-        fragment += previous_char;
-
-        if (current_char != ';') {
-          fragment += current_char;
-          continue;
-        } else
-          goto finish;
-      }
+  struct Builder final {
+    void push_text(const std::string& str)
+    {
+      result.push_text(str);
+    }
 
-      continue;
+    void push_one_line_comment(const std::string& str)
+    {
+      result.push_one_line_comment(str);
+    }
 
-    case one_line_comment:
-      if (current_char == '\n') {
-        state = top;
-        if (!fragment.empty() && fragment.back() == '\r')
-          fragment.pop_back();
-        result.push_one_line_comment(fragment);
-        fragment.clear();
-      } else
-        fragment += current_char;
-
-      continue;
-
-    case slash:
-      DMITIGR_ASSERT(previous_char == '/');
-      if (current_char == '*') {
-        state = multi_line_comment;
-        if (depth > 0) {
-          fragment += previous_char;
-          fragment += current_char;
-        } else {
-          result.push_text(fragment);
-          fragment.clear();
-          // The comment marker ("/*") will not be included in the next fragment.
-        }
-        ++depth;
-      } else {
-        state = (depth == 0) ? top : multi_line_comment;
-        fragment += previous_char;
-        fragment += current_char;
-      }
+    void push_multi_line_comment(const std::string& str)
+    {
+      result.push_multi_line_comment(str);
+    }
 
-      continue;
+    void push_positional_parameter(const std::string& str)
+    {
+      result.push_positional_parameter(str);
+    }
 
-    case multi_line_comment:
-      if (current_char == '/') {
-        state = slash;
-      } else if (current_char == '*') {
-        state = multi_line_comment_star;
-      } else
-        fragment += current_char;
-
-      continue;
-
-    case multi_line_comment_star:
-      DMITIGR_ASSERT(previous_char == '*');
-      if (current_char == '/') {
-        --depth;
-        if (depth == 0) {
-          state = top;
-          result.push_multi_line_comment(fragment); // without trailing "*/"
-          fragment.clear();
-        } else {
-          state = multi_line_comment;
-          fragment += previous_char; // '*'
-          fragment += current_char;  // '/'
-        }
-      } else {
-        state = multi_line_comment;
-        fragment += previous_char;
-        fragment += current_char;
-      }
+    void push_named_parameter(const std::string& str, const char quote_char)
+    {
+      result.push_named_parameter(str, quote_char);
+    }
 
-      continue;
-    } // switch (state)
-  } // for
-
- finish:
-  switch (state) {
-  case top:
-    if (current_char == ';')
-      ++i;
-    if (!fragment.empty())
-      result.push_text(fragment);
-    break;
-  case quote_quote:
-    fragment += previous_char;
-    result.push_text(fragment);
-    break;
-  case one_line_comment:
-    result.push_one_line_comment(fragment);
-    break;
-  case positional_parameter:
-    result.push_positional_parameter(fragment);
-    break;
-  case named_parameter:
-    if (!quote_char) {
-      result.push_named_parameter(fragment, quote_char);
-      break;
+    [[noreturn]] void invalid_input(const char* const what) const
+    {
+      std::string message{what};
+      if (!result.fragments_.empty())
+        message.append(" after: ").append(result.str(result.fragments_.back()));
+      throw Client_exception{message};
     }
-    [[fallthrough]];
-  default: {
-    std::string message{"invalid SQL input"};
-    if (!result.fragments_.empty())
-      message.append(" after: ").append(result.fragments_.back().str);
-    throw Client_exception{message};
-  }
-  }
 
-  return std::make_pair(result, i - b);
+    Statement result;
+  } builder;
+  const auto position = detail::parse_sql_input(text, builder);
+  return std::make_pair(std::move(builder.result), position);
 }
 
 } // namespace dmitigr::pgfe
@@ -20,12 +20,12 @@
 #include "basics.hpp"
 #include "dll.hpp"
 #include "parameterizable.hpp"
+#include "statement_parser.hpp"
 #include "tuple.hpp"
 #include "types_fwd.hpp"
 
 #include <cctype>
 #include <cstdint>
-#include <list>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -80,6 +80,9 @@ public:
    * @remarks While the SQL input may contain multiple commands, the parser
    * stops on either first top-level semicolon or zero character.
    *
+   * @remarks The recently parsed texts are cached process-wide, so that
+   * constructing from the same text again is just a copy.
+   *
    * @see extra().
    */
   DMITIGR_PGFE_API Statement(std::string_view text);
@@ -246,6 +249,64 @@ public:
   DMITIGR_PGFE_API const std::optional<std::string>&
   bound(const std::string_view name) const;
 
+  /**
+   * @brief A named parameter resolved once by param(), to be bound with no
+   * lookup of its name.
+   *
+   * @details Valid until the instance it's of is modified otherwise than by
+   * bind().
+   */
+  class Parameter_handle final {
+  public:
+    /// @returns The parameter index.
+    std::size_t index() const noexcept
+    {
+      return index_;
+    }
+
+  private:
+    friend Statement;
+
+    Parameter_handle(const std::size_t index,
+      const std::size_t fragment) noexcept
+      : index_{index}
+      , fragment_{fragment}
+    {}
+
+    std::size_t index_{};
+    std::size_t fragment_{}; // of the first occurrence, which holds the value
+  };
+
+  /**
+   * @returns The handle of the parameter named by the `name`.
+   *
+   * @par Requires
+   * `has_parameter(name)`.
+   */
+  DMITIGR_PGFE_API Parameter_handle param(std::string_view name) const;
+
+  /**
+   * @brief Binds the parameter of `handle` with a copy of `value`.
+   *
+   * @details The value is copied into the storage of the previous one, so that
+   * binding allocates only when the value outgrows it.
+   *
+   * @par Requires
+   * `handle` is of this instance.
+   *
+   * @see param().
+   */
+  DMITIGR_PGFE_API Statement&
+  bind(const Parameter_handle& handle, std::string_view value);
+
+  /// @overload
+  DMITIGR_PGFE_API Statement&
+  bind(const Parameter_handle& handle, const char* value);
+
+  /// @brief Binds the parameter of `handle` with `value`, moved into place.
+  DMITIGR_PGFE_API Statement&
+  bind(const Parameter_handle& handle, std::string&& value);
+
   /**
    * @returns The number of bound parameters.
    *
@@ -290,9 +351,27 @@ public:
    *
    * @par Requires
    * `!has_missing_parameters() && conn.is_connected()`.
+   *
+   * @see to_query_string(const Connection&, std::string&).
    */
   DMITIGR_PGFE_API std::string to_query_string(const Connection& conn) const;
 
+  /**
+   * @brief Renders the query string into `result`, reusing its storage.
+   *
+   * @details The constant parts of the query string are joined once and
+   * kept until this instance is modified otherwise than by bind(), so that
+   * rendering just fills in the parameters, with the size computed first.
+   *
+   * @par Requires
+   * `!has_missing_parameters() && conn.is_connected()`.
+   *
+   * @par Exception safety guarantee
+   * Basic.
+   */
+  DMITIGR_PGFE_API void to_query_string(const Connection& conn,
+    std::string& result) const;
+
   /// @returns The extra data associated with this instance.
   ///
   /// @details An any data can be associated with an object of type Statement.
@@ -392,38 +471,84 @@ public:
 
 private:
   friend Statement_vector;
+  template<detail::Sql_text> friend class Sql_literal;
 
-  /// A fragment.
+  /// A fragment, which is a piece of `text_`.
   struct Fragment final {
-    enum class Type {
-      text,
-      one_line_comment,
-      multi_line_comment,
-      named_parameter,
-      named_parameter_literal,
-      named_parameter_identifier,
-      positional_parameter
-    };
+    using Type = detail::Sql_fragment_type;
 
-    Fragment(const Type tp, const std::string& s);
     bool is_named_parameter() const noexcept;
-    bool is_named_parameter(const std::string_view name) const noexcept;
 
     Type type;
-    std::string str;
+    std::size_t offset{};
+    std::size_t size{};
     std::optional<std::string> value;
   };
-  using Fragment_list = std::list<Fragment>;
+  using Fragment_vector = std::vector<Fragment>;
 
-  Fragment_list fragments_;
+  std::string text_; // the fragments back to back
+  Fragment_vector fragments_;
   std::vector<bool> positional_parameters_; // cache
-  std::vector<Fragment_list::const_iterator> named_parameters_; // cache
+  std::vector<std::size_t> named_parameters_; // cache of indices of fragments_
+  /// The query string less the named parameters, see to_query_string().
+  struct Compiled final {
+    /// A named parameter which follows the constant text up to `offset`.
+    struct Slot final {
+      std::size_t offset{};
+      std::size_t fragment{}; // index in fragments_
+      std::size_t index{}; // parameter index
+      std::size_t value{}; // index in fragments_ of the first occurrence
+    };
+    std::string text;
+    std::vector<Slot> slots;
+  };
+  mutable std::optional<Compiled> compiled_; // cache
   mutable bool is_extra_data_should_be_extracted_from_comments_{true};
   mutable std::optional<Tuple> extra_; // cache
 
   static std::pair<Statement, std::string_view::size_type>
   parse_sql_input(std::string_view);
 
+  /// @returns The parsed `text`, a copy of the cached one if seen recently.
+  static Statement parsed(std::string_view text);
+
+  /// @returns The statement of the fragments parsed at compile time.
+  template<std::size_t N>
+  static Statement assembled(const detail::Sql_fragments<N>& parsed)
+  {
+    using Ft = Fragment::Type;
+    Statement result;
+    for (std::size_t i{}; i < parsed.fragment_count; ++i) {
+      const auto& f = parsed.fragments[i];
+      const std::string str{parsed.str(f)};
+      switch (f.type) {
+      case Ft::text:
+        result.push_text(str);
+        break;
+      case Ft::one_line_comment:
+        result.push_one_line_comment(str);
+        break;
+      case Ft::multi_line_comment:
+        result.push_multi_line_comment(str);
+        break;
+      case Ft::positional_parameter:
+        result.push_positional_parameter(str);
+        break;
+      case Ft::named_parameter:
+        result.push_named_parameter(str, 0);
+        break;
+      case Ft::named_parameter_literal:
+        result.push_named_parameter(str, '\'');
+        break;
+      case Ft::named_parameter_identifier:
+        result.push_named_parameter(str, '"');
+        break;
+      }
+    }
+    result.compiled_.emplace(result.compiled());
+    return result;
+  }
+
   bool is_invariant_ok() const noexcept override;
 
   // ---------------------------------------------------------------------------
@@ -444,18 +569,23 @@ private:
   // Exception safety guarantee: strong.
   void update_cache(const Statement& rhs);
 
+  Compiled compiled() const;
+
   // ---------------------------------------------------------------------------
   // Named parameters helpers
   // ---------------------------------------------------------------------------
 
   Fragment::Type named_parameter_type(const std::size_t index) const noexcept;
   std::size_t named_parameter_index(const std::string_view name) const noexcept;
-  std::vector<Fragment_list::const_iterator> named_parameters() const;
+  std::vector<std::size_t> named_parameters() const;
 
   // ---------------------------------------------------------------------------
   // Predicates
   // ---------------------------------------------------------------------------
 
+  std::string_view str(const Fragment& f) const noexcept;
+  bool is_named_parameter(const Fragment& f,
+    const std::string_view name) const noexcept;
   static bool is_comment(const Fragment& f) noexcept;
   static bool is_text(const Fragment& f) noexcept;
   static bool is_ident_char(const unsigned char c) noexcept;
@@ -479,8 +609,83 @@ inline void swap(Statement& lhs, Statement& rhs) noexcept
   lhs.swap(rhs);
 }
 
+/**
+ * @ingroup utilities
+ *
+ * @brief A SQL string parsed at compile time, made by DMITIGR_PGFE_SQL().
+ *
+ * @details The compiler works out the fragments and the parameters of `Text`
+ * and rejects invalid SQL input, and the Statement is assembled from them once,
+ * at first use, without parsing. Converts to `const Statement&`.
+ *
+ * @par Example
+ * @code{cpp}
+ * constexpr auto query = DMITIGR_PGFE_SQL("SELECT * FROM t WHERE id = :id");
+ * ps.bind(query.parameter_index<"id">(), 1); // :ib would not compile
+ * @endcode
+ */
+template<detail::Sql_text Text>
+class Sql_literal final {
+public:
+  /// @returns The number of the positional parameters.
+  static constexpr std::size_t positional_parameter_count() noexcept
+  {
+    return parsed_.positional_parameter_count;
+  }
+
+  /// @returns The number of the distinct named parameters.
+  static constexpr std::size_t named_parameter_count() noexcept
+  {
+    return parsed_.named_parameter_count;
+  }
+
+  /// @returns The number of the parameters.
+  static constexpr std::size_t parameter_count() noexcept
+  {
+    return positional_parameter_count() + named_parameter_count();
+  }
+
+  /**
+   * @returns The index of the named parameter `Name`, as of
+   * Statement::parameter_index().
+   *
+   * @remarks A name not in `Text` is a compile-time error.
+   */
+  template<detail::Sql_text Name>
+  static constexpr std::size_t parameter_index() noexcept
+  {
+    constexpr auto index = parsed_.parameter_index(Name.view());
+    static_assert(index < parameter_count(), "no such named parameter");
+    return index;
+  }
+
+  /// @returns The statement, shared by the uses of `Text`.
+  static const Statement& statement()
+  {
+    static const Statement result{Statement::assembled(parsed_)};
+    return result;
+  }
+
+  /// @returns `statement()`.
+  operator const Statement&() const
+  {
+    return statement();
+  }
+
+private:
+  static constexpr auto parsed_ = detail::parse_sql_literal<Text>();
+};
+
+
 } // namespace dmitigr::pgfe
 
+/**
+ * @ingroup utilities
+ *
+ * @brief Expands to the Sql_literal of the string literal `text`.
+ */
+#define DMITIGR_PGFE_SQL(text) (::dmitigr::pgfe::Sql_literal<text>{})
+
 #ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
 #include "statement.cpp"
 #endif
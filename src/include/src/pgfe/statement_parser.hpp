@@ -0,0 +1,629 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_STATEMENT_PARSER_HPP
+#define DMITIGR_PGFE_STATEMENT_PARSER_HPP
+
+#include "../base/assert.hpp"
+#include "exceptions.hpp"
+#include "parameterizable.hpp"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace dmitigr::pgfe::detail {
+
+/// The type of a fragment of a preparsed SQL string.
+enum class Sql_fragment_type {
+  text,
+  one_line_comment,
+  multi_line_comment,
+  named_parameter,
+  named_parameter_literal,
+  named_parameter_identifier,
+  positional_parameter
+};
+
+constexpr bool is_sql_digit(const unsigned char c) noexcept
+{
+  return '0' <= c && c <= '9';
+}
+
+/// Like `std::isalnum()` in the "C" locale, but usable at compile time.
+constexpr bool is_sql_ident_char(const unsigned char c) noexcept
+{
+  return is_sql_digit(c) || ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+    c == '_' || c == '$';
+}
+
+constexpr bool is_sql_quote_char(const unsigned char c) noexcept
+{
+  return c == '\'' || c == '\"';
+}
+
+// -----------------------------------------------------------------------------
+// Basic SQL input parser
+// -----------------------------------------------------------------------------
+
+/*
+ * SQL SYNTAX BASICS (from PostgreSQL documentation):
+ * https://www.postgresql.org/docs/current/static/sql-syntax-lexical.html
+ *
+ * COMMANDS
+ *
+ * A command is composed of a sequence of tokens, terminated by a (";").
+ * A token can be a key word, an identifier, a quoted identifier,
+ * a literal (or constant), or a special character symbol. Tokens are normally
+ * separated by whitespace (space, tab, newline), but need not be if there is no
+ * ambiguity.
+ *
+ * IDENTIFIERS (UNQUOTED)
+ *
+ * SQL identifiers and key words must begin with a letter (a-z, but also
+ * letters with diacritical marks and non-Latin letters) or an ("_").
+ * Subsequent characters in an identifier or key word can be letters,
+ * underscores, digits (0-9), or dollar signs ($).
+ *
+ * QUOTED IDENTIFIERS
+ *
+ * The delimited identifier or quoted identifier is formed by enclosing an
+ * arbitrary sequence of characters in double-quotes ("). Quoted identifiers can
+ * contain any character, except the character with code zero. (To include a
+ * double quote, two double quotes should be written.)
+ *
+ * CONSTANTS
+ *
+ *   STRING CONSTANTS (QUOTED LITERALS)
+ *
+ * A string constant in SQL is an arbitrary sequence of characters bounded
+ * by single quotes ('), for example 'This is a string'. To include a
+ * single-quote character within a string constant, write two adjacent
+ * single quotes, e.g., 'Dianne''s horse'.
+ *
+ *   DOLLAR QUOTED STRING CONSTANTS
+ *
+ * A dollar-quoted string constant consists of a dollar sign ($), an
+ * optional "tag" of zero or more characters, another dollar sign, an
+ * arbitrary sequence of characters that makes up the string content, a
+ * dollar sign, the same tag that began this dollar quote, and a dollar
+ * sign.
+ * The tag, if any, of a dollar-quoted string follows the same rules
+ * as an unquoted identifier, except that it cannot contain a dollar sign.
+ * A dollar-quoted string that follows a keyword or identifier must be
+ * separated from it by whitespace; otherwise the dollar quoting delimiter
+ * would be taken as part of the preceding identifier.
+ *
+ * SPECIAL CHARACTERS
+ *
+ * - A dollar sign ("$") followed by digits is used to represent a positional
+ * parameter in the body of a function definition or a prepared statement.
+ * In other contexts the dollar sign can be part of an identifier or a
+ * dollar-quoted string constant.
+ *
+ * - The colon (":") is used to select "slices" from arrays. In certain SQL
+ * dialects (such as Embedded SQL), the colon is used to prefix variable
+ * names.
+ * [In Pgfe ":" is user to prefix named parameters and placeholders.]
+ *
+ * - Brackets ([]) are used to select the elements of an array.
+ */
+
+/**
+ * @brief Parses `text` up to either first top-level semicolon or zero
+ * character into `result`, at run time or at compile time.
+ *
+ * @details `result` is called as `push_text(fragment)`,
+ * `push_one_line_comment(fragment)`, `push_multi_line_comment(fragment)`,
+ * `push_positional_parameter(fragment)` and
+ * `push_named_parameter(fragment, quote_char)` in the order of the fragments,
+ * and as `invalid_input(message)`, which throws, on invalid input.
+ *
+ * @returns The position of the character that follows the parsed statement.
+ */
+template<class Builder>
+constexpr std::string_view::size_type
+parse_sql_input(const std::string_view text, Builder& result)
+{
+  enum {
+    top,
+
+    bracket,
+
+    colon,
+    named_parameter,
+
+    dollar,
+    positional_parameter,
+    dollar_quote_leading_tag,
+    dollar_quote,
+    dollar_quote_dollar,
+
+    quote,
+    quote_quote,
+
+    dash,
+    one_line_comment,
+
+    slash,
+    multi_line_comment,
+    multi_line_comment_star
+  } state = top;
+
+  int depth{};
+  char current_char{};
+  char previous_char{};
+  char quote_char{};
+  std::string fragment;
+  std::string dollar_quote_leading_tag_name;
+  std::string dollar_quote_trailing_tag_name;
+  const auto b = cbegin(text);
+  auto i = b;
+  // Handles current_char, returns false at the end of the statement.
+  const auto step = [&]
+  {
+    switch (state) {
+    case top:
+      switch (current_char) {
+      case '\'':
+        state = quote;
+        quote_char = current_char;
+        fragment += current_char;
+        return true;
+
+      case '"':
+        state = quote;
+        quote_char = current_char;
+        fragment += current_char;
+        return true;
+
+      case '[':
+        state = bracket;
+        depth = 1;
+        fragment += current_char;
+        return true;
+
+      case '$':
+        if (!is_sql_ident_char(previous_char))
+          state = dollar;
+        else
+          fragment += current_char;
+
+        return true;
+
+      case ':':
+        if (previous_char != ':')
+          state = colon;
+        else
+          fragment += current_char;
+
+        return true;
+
+      case '-':
+        state = dash;
+        return true;
+
+      case '/':
+        state = slash;
+        return true;
+
+      case ';':
+        return false;
+
+      default:
+        fragment += current_char;
+        return true;
+      } // switch (current_char)
+
+    case bracket:
+      if (current_char == ']')
+        --depth;
+      else if (current_char == '[')
+        ++depth;
+
+      if (depth == 0) {
+        DMITIGR_ASSERT(current_char == ']');
+        state = top;
+      }
+
+      fragment += current_char;
+      return true;
+
+    case dollar:
+      DMITIGR_ASSERT(previous_char == '$');
+      if (is_sql_digit(current_char)) {
+        state = positional_parameter;
+        result.push_text(fragment);
+        fragment.clear();
+        // The 1st digit of positional parameter (current_char) will be stored below.
+      } else if (is_sql_ident_char(current_char)) {
+        if (current_char == '$') {
+          state = dollar_quote;
+        } else {
+          state = dollar_quote_leading_tag;
+          dollar_quote_leading_tag_name += current_char;
+        }
+        fragment += previous_char;
+      } else {
+        state = top;
+        fragment += previous_char;
+      }
+
+      fragment += current_char;
+      return true;
+
+    case positional_parameter:
+      DMITIGR_ASSERT(is_sql_digit(previous_char));
+      if (!is_sql_digit(current_char)) {
+        state = top;
+        result.push_positional_parameter(fragment);
+        fragment.clear();
+      }
+
+      if (current_char != ';') {
+        fragment += current_char;
+        return true;
+      } else
+        return false;
+
+    case dollar_quote_leading_tag:
+      DMITIGR_ASSERT(previous_char != '$' && is_sql_ident_char(previous_char));
+      if (current_char == '$') {
+        fragment += current_char;
+        state = dollar_quote;
+      } else if (is_sql_ident_char(current_char)) {
+        dollar_quote_leading_tag_name += current_char;
+        fragment += current_char;
+      } else
+        result.invalid_input("invalid dollar quote tag");
+
+      return true;
+
+    case dollar_quote:
+      if (current_char == '$')
+        state = dollar_quote_dollar;
+
+      fragment += current_char;
+      return true;
+
+    case dollar_quote_dollar:
+      if (current_char == '$') {
+        if (dollar_quote_leading_tag_name == dollar_quote_trailing_tag_name) {
+          state = top;
+          dollar_quote_leading_tag_name.clear();
+        } else
+          state = dollar_quote;
+
+        dollar_quote_trailing_tag_name.clear();
+      } else
+        dollar_quote_trailing_tag_name += current_char;
+
+      fragment += current_char;
+      return true;
+
+    case colon:
+      DMITIGR_ASSERT(previous_char == ':');
+      if (is_sql_ident_char(current_char) || is_sql_quote_char(current_char)) {
+        state = named_parameter;
+        result.push_text(fragment);
+        fragment.clear();
+        // The 1st character of the named parameter (current_char) will be stored below.
+      } else {
+        state = top;
+        fragment += previous_char;
+      }
+
+      if (state == named_parameter && is_sql_quote_char(current_char)) {
+        quote_char = current_char;
+        return true;
+      } else if (current_char != ';') {
+        fragment += current_char;
+        return true;
+      } else
+        return false;
+
+    case named_parameter:
+      DMITIGR_ASSERT(is_sql_ident_char(previous_char) ||
+        (is_sql_quote_char(previous_char) && quote_char));
+
+      if (!is_sql_ident_char(current_char)) {
+        state = top;
+        result.push_named_parameter(fragment, quote_char);
+        fragment.clear();
+      }
+
+      if (current_char == quote_char) {
+        quote_char = 0;
+        return true;
+      } if (current_char != ';') {
+        fragment += current_char;
+        return true;
+      } else
+        return false;
+
+    case quote:
+      if (current_char == quote_char)
+        state = quote_quote;
+      else
+        fragment += current_char;
+
+      return true;
+
+    case quote_quote:
+      DMITIGR_ASSERT(previous_char == quote_char);
+      if (current_char == quote_char) {
+        state = quote;
+        // Skip previous quote.
+      } else {
+        state = top;
+        quote_char = 0;
+        fragment += previous_char; // store previous quote
+      }
+
+      if (current_char != ';') {
+        fragment += current_char;
+        return true;
+      } else
+        return false;
+
+    case dash:
+      DMITIGR_ASSERT(previous_char == '-');
+      if (current_char == '-') {
+        state = one_line_comment;
+        result.push_text(fragment);
+        fragment.clear();
+        // The comment marker ("--") will not be included in the next fragment.
+      } else {
+        state = top;
+        fragment += previous_char;
+
+        if (current_char != ';') {
+          fragment += current_char;
+          return true;
+        } else
+          return false;
+      }
+
+      return true;
+
+    case one_line_comment:
+      if (current_char == '\n') {
+        state = top;
+        if (!fragment.empty() && fragment.back() == '\r')
+          fragment.pop_back();
+        result.push_one_line_comment(fragment);
+        fragment.clear();
+      } else
+        fragment += current_char;
+
+      return true;
+
+    case slash:
+      DMITIGR_ASSERT(previous_char == '/');
+      if (current_char == '*') {
+        state = multi_line_comment;
+        if (depth > 0) {
+          fragment += previous_char;
+          fragment += current_char;
+        } else {
+          result.push_text(fragment);
+          fragment.clear();
+          // The comment marker ("/*") will not be included in the next fragment.
+        }
+        ++depth;
+      } else {
+        state = (depth == 0) ? top : multi_line_comment;
+        fragment += previous_char;
+        fragment += current_char;
+      }
+
+      return true;
+
+    case multi_line_comment:
+      if (current_char == '/') {
+        state = slash;
+      } else if (current_char == '*') {
+        state = multi_line_comment_star;
+      } else
+        fragment += current_char;
+
+      return true;
+
+    case multi_line_comment_star:
+      DMITIGR_ASSERT(previous_char == '*');
+      if (current_char == '/') {
+        --depth;
+        if (depth == 0) {
+          state = top;
+          result.push_multi_line_comment(fragment); // without trailing "*/"
+          fragment.clear();
+        } else {
+          state = multi_line_comment;
+          fragment += previous_char; // '*'
+          fragment += current_char;  // '/'
+        }
+      } else {
+        state = multi_line_comment;
+        fragment += previous_char;
+        fragment += current_char;
+      }
+
+      return true;
+    } // switch (state)
+    return true;
+  };
+
+  for (const auto e = cend(text); i != e; previous_char = current_char, ++i) {
+    current_char = *i;
+    if (!step())
+      break;
+  }
+
+  switch (state) {
+  case top:
+    if (current_char == ';')
+      ++i;
+    if (!fragment.empty())
+      result.push_text(fragment);
+    break;
+  case quote_quote:
+    fragment += previous_char;
+    result.push_text(fragment);
+    break;
+  case one_line_comment:
+    result.push_one_line_comment(fragment);
+    break;
+  case positional_parameter:
+    result.push_positional_parameter(fragment);
+    break;
+  case named_parameter:
+    if (!quote_char) {
+      result.push_named_parameter(fragment, quote_char);
+      break;
+    }
+    [[fallthrough]];
+  default:
+    result.invalid_input("invalid SQL input");
+  }
+
+  return static_cast<std::string_view::size_type>(i - b);
+}
+
+// -----------------------------------------------------------------------------
+// Compile-time parsing
+// -----------------------------------------------------------------------------
+
+/// A string literal usable as a template argument.
+template<std::size_t N>
+struct Sql_text final {
+  consteval Sql_text(const char (&text)[N]) noexcept
+  {
+    for (std::size_t i{}; i < N; ++i)
+      data[i] = text[i];
+  }
+
+  constexpr std::string_view view() const noexcept
+  {
+    return {data, N - 1};
+  }
+
+  char data[N]{};
+};
+
+/**
+ * @brief The fragments of a SQL string of less than `N` characters parsed at
+ * compile time, which are never more than its characters.
+ */
+template<std::size_t N>
+struct Sql_fragments final {
+  struct Fragment final {
+    Sql_fragment_type type{};
+    std::size_t offset{};
+    std::size_t size{};
+  };
+
+  char text[N]{}; // the fragments back to back
+  std::size_t text_size{};
+  Fragment fragments[N]{};
+  std::size_t fragment_count{};
+  std::size_t positional_parameter_count{}; // the greatest position
+  std::size_t named_parameters[N]{}; // indices of fragments, the first of each
+  std::size_t named_parameter_count{};
+
+  constexpr std::string_view str(const Fragment& f) const noexcept
+  {
+    return {text + f.offset, f.size};
+  }
+
+  /// @returns The index of the named parameter `name`, or `N` if none.
+  constexpr std::size_t parameter_index(const std::string_view name) const noexcept
+  {
+    for (std::size_t i{}; i < named_parameter_count; ++i) {
+      if (str(fragments[named_parameters[i]]) == name)
+        return positional_parameter_count + i;
+    }
+    return N;
+  }
+
+  constexpr void push_text(const std::string& str)
+  {
+    push_back_fragment(Sql_fragment_type::text, str);
+  }
+
+  constexpr void push_one_line_comment(const std::string& str)
+  {
+    push_back_fragment(Sql_fragment_type::one_line_comment, str);
+  }
+
+  constexpr void push_multi_line_comment(const std::string& str)
+  {
+    push_back_fragment(Sql_fragment_type::multi_line_comment, str);
+  }
+
+  constexpr void push_positional_parameter(const std::string& str)
+  {
+    std::size_t position{};
+    for (const char c : str)
+      position = position * 10 + static_cast<std::size_t>(c - '0');
+    if (position < 1 || position > Parameterizable::max_parameter_count())
+      invalid_input("invalid parameter position");
+    push_back_fragment(Sql_fragment_type::positional_parameter, str);
+    if (position > positional_parameter_count)
+      positional_parameter_count = position;
+  }
+
+  constexpr void push_named_parameter(const std::string& str, const char quote_char)
+  {
+    using Ft = Sql_fragment_type;
+    push_back_fragment(quote_char == '\'' ? Ft::named_parameter_literal :
+      quote_char == '\"' ? Ft::named_parameter_identifier : Ft::named_parameter,
+      str);
+    if (parameter_index(str) == N)
+      named_parameters[named_parameter_count++] = fragment_count - 1;
+  }
+
+  [[noreturn]] void invalid_input(const char* const message) const
+  {
+    throw Client_exception{message};
+  }
+
+private:
+  constexpr void push_back_fragment(const Sql_fragment_type type,
+    const std::string& str)
+  {
+    fragments[fragment_count++] = Fragment{type, text_size, str.size()};
+    for (const char c : str)
+      text[text_size++] = c;
+  }
+};
+
+/// @returns The fragments of `Text`, the SQL input of a single statement.
+template<Sql_text Text>
+consteval auto parse_sql_literal()
+{
+  constexpr auto text = Text.view();
+  Sql_fragments<sizeof(Text.data)> result;
+  if (parse_sql_input(text, result) != text.size())
+    result.invalid_input("SQL input of more than one statement");
+  else if (result.positional_parameter_count + result.named_parameter_count >
+    Parameterizable::max_parameter_count())
+    result.invalid_input("maximum parameters count exceeded");
+  return result;
+}
+
+} // namespace dmitigr::pgfe::detail
+
+#endif  // DMITIGR_PGFE_STATEMENT_PARSER_HPP
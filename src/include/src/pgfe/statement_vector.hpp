@@ -17,12 +17,16 @@
 #ifndef DMITIGR_PGFE_STATEMENT_VECTOR_HPP
 #define DMITIGR_PGFE_STATEMENT_VECTOR_HPP
 
+#include "connection.hpp"
 #include "dll.hpp"
 #include "statement.hpp"
 #include "types_fwd.hpp"
 
+#include <exception>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace dmitigr::pgfe {
@@ -166,6 +170,120 @@ inline void swap(Statement_vector& lhs, Statement_vector& rhs) noexcept
   lhs.swap(rhs);
 }
 
+// -----------------------------------------------------------------------------
+// Connection::execute_pipelined()
+// -----------------------------------------------------------------------------
+
+template<typename F>
+void Connection::execute_pipelined(const Statement_vector& statements,
+  F&& callback, const std::size_t group)
+{
+  static_assert(std::is_invocable_v<F, std::size_t, Row&&>,
+    "callback must be callable as callback(std::size_t, Row&&)");
+  constexpr bool is_error_handled =
+    std::is_invocable_v<F, std::size_t, Error&&>;
+  constexpr bool is_completion_handled =
+    std::is_invocable_v<F, std::size_t, Completion&&>;
+  static_assert(is_error_handled == is_completion_handled,
+    "callback must handle either both completions and errors or none");
+
+  if (!is_ready_for_request())
+    throw Client_exception{"cannot execute pipelined statements: "
+      "not ready for request"};
+
+  std::exception_ptr failure;
+  Error error;
+  const auto call = [&](const std::size_t index, auto&& response)
+  {
+    if (!failure) {
+      try {
+        callback(index, std::move(response));
+      } catch (...) {
+        failure = std::current_exception();
+      }
+    }
+  };
+  const auto handle_error = [&](const std::size_t index, Error&& e)
+  {
+    if constexpr (is_error_handled)
+      call(index, std::move(e));
+    else if (!error)
+      error = std::move(e);
+  };
+
+#ifdef LIBPQ_HAS_PIPELINING
+  std::vector<std::size_t> sent; // the indices of the statements of a group
+  std::size_t handled{}; // the number of the statements of sent responded
+  const auto drain = [&]
+  {
+    send_sync();
+    while (wait_response()) {
+      if (auto e = this->error())
+        handle_error(sent[handled++], std::move(e));
+      else if (auto r = row())
+        call(sent[handled], std::move(r));
+      else if (!ready_for_query().is_valid()) {
+        auto c = completion(); // or aborted
+        if constexpr (is_completion_handled) {
+          if (c)
+            call(sent[handled], std::move(c));
+        }
+        ++handled;
+      }
+    }
+    sent.clear();
+    handled = 0;
+  };
+
+  requests_.reserve((group ? group : statements.size()) + 1); // with the Sync
+  set_pipeline_enabled(true);
+  try {
+    for (std::size_t i{}; i < statements.size(); ++i) {
+      if (failure)
+        break;
+      else if (statements[i].is_query_empty())
+        continue;
+      execute_nio(statements[i]);
+      sent.push_back(i);
+      if (sent.size() == group)
+        drain();
+    }
+    if (!sent.empty())
+      drain();
+  } catch (...) {
+    if (!failure)
+      failure = std::current_exception();
+    try {
+      if (!sent.empty())
+        drain();
+    } catch (...) {}
+  }
+  set_pipeline_enabled(false);
+#else
+  (void)group;
+  for (std::size_t i{}; i < statements.size() && !failure && !error; ++i) {
+    if (statements[i].is_query_empty())
+      continue;
+    execute_nio(statements[i]);
+    while (wait_response()) {
+      if (auto e = this->error())
+        handle_error(i, std::move(e));
+      else if (auto r = row())
+        call(i, std::move(r));
+      else if (auto c = completion()) {
+        if constexpr (is_completion_handled)
+          call(i, std::move(c));
+      }
+    }
+  }
+#endif
+
+  if (failure)
+    std::rethrow_exception(failure);
+  else if (error)
+    throw Server_exception{std::make_shared<Error>(std::move(error))};
+}
+
 } // namespace dmitigr::pgfe
 
 #ifndef DMITIGR_PGFE_NOT_HEADER_ONLY
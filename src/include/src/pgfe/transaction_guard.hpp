@@ -124,11 +124,13 @@ public:
 
   /**
    * @brief Rollbacks the transaction (or savepoint if `is_subtransaction()`)
-   * if the transaction is uncommitted.
+   * if the transaction is uncommitted or failed.
    */
   void rollback()
   {
-    if (conn_.is_transaction_uncommitted() && !is_subtransaction_committed_)
+    const auto status = conn_.transaction_status();
+    if ((status == Transaction_status::uncommitted || status == Transaction_status::failed)
+      && !is_subtransaction_committed_)
       conn_.execute(rollback_stmt_);
   }
 
@@ -14,8 +14,10 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "../net/conversions.hpp"
 #include "data.hpp"
 #include "tuple.hpp"
+#include "type_info.hpp"
 
 #include <algorithm>
 
@@ -27,13 +29,20 @@ DMITIGR_PGFE_INLINE Tuple::Tuple(std::vector<Element>&& elements) noexcept
   assert(is_invariant_ok());
 }
 
+DMITIGR_PGFE_INLINE Tuple::Tuple(std::pmr::memory_resource& resource) noexcept
+  : resource_{&resource}
+{}
+
 DMITIGR_PGFE_INLINE Tuple::Tuple(const Tuple& rhs)
   : elements_{rhs.elements_.size()}
+  , resource_{rhs.resource_}
 {
   transform(rhs.elements_.cbegin(), rhs.elements_.cend(), elements_.begin(),
-    [](const auto& pair)
+    [this](const auto& pair)
     {
-      return std::make_pair(pair.first, pair.second->to_data());
+      const auto& data = pair.second;
+      return std::make_pair(pair.first, !data ? nullptr :
+        resource_ && data->is_valid() ? to_resource__(*data) : data->to_data());
     });
   assert(is_invariant_ok());
 }
@@ -51,6 +60,17 @@ DMITIGR_PGFE_INLINE void Tuple::swap(Tuple& rhs) noexcept
 {
   using std::swap;
   swap(elements_, rhs.elements_);
+  swap(resource_, rhs.resource_);
+}
+
+DMITIGR_PGFE_INLINE std::pmr::memory_resource* Tuple::resource() const noexcept
+{
+  return resource_;
+}
+
+DMITIGR_PGFE_INLINE void Tuple::reserve(const std::size_t capacity)
+{
+  elements_.reserve(capacity);
 }
 
 DMITIGR_PGFE_INLINE std::size_t Tuple::field_count() const noexcept
@@ -142,4 +162,60 @@ Tuple::vector() noexcept -> std::vector<Element>&
     static_cast<const Tuple*>(this)->vector());
 }
 
+DMITIGR_PGFE_INLINE std::unique_ptr<Data>
+Tuple::to_resource__(const Data& data) const
+{
+  assert(resource_);
+  return Data::make(std::string_view{static_cast<const char*>(data.bytes()),
+    data.size()}, data.format(), *resource_);
+}
+
+DMITIGR_PGFE_INLINE Tuple
+Tuple::from_binary_record(const Data& data, const Type_info* const type)
+{
+  if (data.format() != Data_format::binary)
+    throw Client_exception{"cannot decode record: not in binary format"};
+
+  /*
+   * The format is the count of the fields, then the type OID, the length (-1
+   * for NULL) and the bytes of every field, the integers in network order.
+   */
+  const auto* bytes = static_cast<const char*>(data.bytes());
+  const char* const end = bytes + data.size();
+  const auto read_int = [&bytes, end]
+  {
+    if (end - bytes < 4)
+      throw Client_exception{"cannot decode record: truncated data"};
+    const auto result = net::conv<std::int32_t>(bytes, 4);
+    bytes += 4;
+    return result;
+  };
+
+  const auto count = read_int();
+  if (count < 0)
+    throw Client_exception{"cannot decode record: invalid field count"};
+  const bool is_named = type && type->is_composite() &&
+    type->attributes.size() == static_cast<std::size_t>(count);
+
+  std::vector<Element> elements;
+  elements.reserve(static_cast<std::size_t>(count));
+  for (std::int32_t i{}; i < count; ++i) {
+    read_int(); // the type OID
+    const auto length = read_int();
+    std::string name = is_named ?
+      type->attributes[static_cast<std::size_t>(i)].name :
+      "f" + std::to_string(i + 1);
+    if (length < 0)
+      elements.emplace_back(std::move(name), nullptr);
+    else if (end - bytes < length)
+      throw Client_exception{"cannot decode record: truncated data"};
+    else {
+      elements.emplace_back(std::move(name), std::make_unique<Data_view>(bytes,
+          static_cast<std::size_t>(length), Data_format::binary));
+      bytes += length;
+    }
+  }
+  return Tuple{std::move(elements)};
+}
+
 } // namespace dmitigr::pgfe
@@ -26,7 +26,10 @@
 #include <cassert>
 #include <iterator>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -38,6 +41,11 @@ namespace dmitigr::pgfe {
  * @brief A tuple.
  *
  * @details A collection of elements in a fixed order.
+ *
+ * The data of the fields of a tuple constructed with a memory resource is
+ * allocated from that resource, which makes a large tuple of parameters
+ * (e.g. of a batch) cheap to build and to destroy by using
+ * `std::pmr::monotonic_buffer_resource`.
  */
 class Tuple final : public Composite {
 public:
@@ -50,6 +58,16 @@ public:
   /// The constructor.
   DMITIGR_PGFE_API Tuple(std::vector<Element>&& elements) noexcept;
 
+  /**
+   * @brief Constructs an empty tuple which allocates the data of the fields
+   * being set, appended or inserted from `resource`.
+   *
+   * @par Requires
+   * `resource` outlives the data of the fields (including the data moved out
+   * of the tuple).
+   */
+  explicit DMITIGR_PGFE_API Tuple(std::pmr::memory_resource& resource) noexcept;
+
   /// Copy-constructible.
   DMITIGR_PGFE_API Tuple(const Tuple& rhs);
 
@@ -65,6 +83,15 @@ public:
   /// Swaps the instances.
   DMITIGR_PGFE_API void swap(Tuple& rhs) noexcept;
 
+  /**
+   * @returns The resource the data of the fields is allocated from, or
+   * `nullptr` if the data is allocated on the heap.
+   */
+  DMITIGR_PGFE_API std::pmr::memory_resource* resource() const noexcept;
+
+  /// Reserves the space for `capacity` fields.
+  DMITIGR_PGFE_API void reserve(std::size_t capacity);
+
   /// @see Compositional::field_count().
   DMITIGR_PGFE_API std::size_t field_count() const noexcept override;
 
@@ -110,7 +137,7 @@ public:
   {
     if (!(index < field_count()))
       throw Client_exception{"cannot set data of tuple"};
-    elements_[index].second = to_data(std::forward<T>(value));
+    elements_[index].second = to_data__(std::forward<T>(value));
   }
 
   /// @overload
@@ -132,7 +159,7 @@ public:
   template<typename T>
   void append(std::string name, T&& value)
   {
-    elements_.emplace_back(std::move(name), to_data(std::forward<T>(value)));
+    elements_.emplace_back(std::move(name), to_data__(std::forward<T>(value)));
     assert(is_invariant_ok());
   }
 
@@ -160,7 +187,7 @@ public:
     const auto b = elements_.begin();
     using Diff = decltype(b)::difference_type;
     elements_.insert(b + static_cast<Diff>(index),
-      std::make_pair(std::move(name), to_data(std::forward<T>(value))));
+      std::make_pair(std::move(name), to_data__(std::forward<T>(value))));
     assert(is_invariant_ok());
   }
 
@@ -178,7 +205,7 @@ public:
   void insert(const std::string_view name, std::string new_field_name, T&& value)
   {
     insert(field_index(name), std::move(new_field_name),
-      to_data(std::forward<T>(value)));
+      std::forward<T>(value));
   }
 
   /**
@@ -208,8 +235,46 @@ public:
   /// @overload
   DMITIGR_PGFE_API std::vector<Element>& vector() noexcept;
 
+  /**
+   * @brief Decodes the composite value (record) in binary format.
+   *
+   * @details The fields are Data_views of the binary format into `data`, so
+   * nothing is copied. They are named after the attributes of `type`, such as
+   * `Connection::type_info(row_info.type_oid(index))`, if it's the composite
+   * type of `data`, or `f1`, `f2`, ... otherwise, as PostgreSQL names the
+   * fields of anonymous records.
+   *
+   * @par Requires
+   * `(data.format() == Data_format::binary)`, and the bytes of `data` outlive
+   * the fields of the result.
+   *
+   * @throws Client_exception if `data` is malformed.
+   */
+  static DMITIGR_PGFE_API Tuple from_binary_record(const Data& data,
+    const Type_info* type = nullptr);
+
 private:
   std::vector<Element> elements_;
+  std::pmr::memory_resource* resource_{};
+
+  template<typename T>
+  std::unique_ptr<Data> to_data__(T&& value) const
+  {
+    using U = std::decay_t<T>;
+    if (!resource_) {
+      return to_data(std::forward<T>(value));
+    } else if constexpr (std::is_same_v<U, std::unique_ptr<Data>>) {
+      return std::move(value);
+    } else if constexpr (std::is_same_v<U, std::string> ||
+      std::is_same_v<U, std::string_view>) {
+      return Data::make(std::string_view{value}, Data_format::text, *resource_);
+    } else {
+      auto data = to_data(std::forward<T>(value));
+      return data && data->is_valid() ? to_resource__(*data) : std::move(data);
+    }
+  }
+
+  std::unique_ptr<Data> to_resource__(const Data& data) const;
 };
 
 /**
@@ -0,0 +1,95 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PGFE_TYPE_INFO_HPP
+#define DMITIGR_PGFE_TYPE_INFO_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dmitigr::pgfe {
+
+/**
+ * @ingroup utilities
+ *
+ * @brief The metadata of a data type from the `pg_type` catalog, as needed
+ * to decode its values.
+ *
+ * @see Connection::type_info().
+ */
+struct Type_info final {
+  /// An attribute of a composite type.
+  struct Attribute final {
+    /// The name.
+    std::string name;
+
+    /// The OID of the type.
+    std::uint_fast32_t type_oid{};
+  };
+
+  /// The OID (`pg_type.oid`).
+  std::uint_fast32_t oid{};
+
+  /// The name of the schema (`pg_namespace.nspname`).
+  std::string schema;
+
+  /// The name (`pg_type.typname`).
+  std::string name;
+
+  /// The kind: `b` (base), `c` (composite), `d` (domain), `e` (enum), etc.
+  char kind{};
+
+  /// The category (`pg_type.typcategory`): `A` for arrays, `N` for numbers, etc.
+  char category{};
+
+  /// The OID of the element type of an array, or zero.
+  std::uint_fast32_t element_oid{};
+
+  /// The OID of the base type of a domain, or zero.
+  std::uint_fast32_t base_oid{};
+
+  /// The OID of the relation of a composite type, or zero.
+  std::uint_fast32_t relation_oid{};
+
+  /// The size in bytes of a fixed-size type, or -1 or -2 for varlena and cstring.
+  int length{};
+
+  /// The attributes of a composite type in order.
+  std::vector<Attribute> attributes;
+
+  /// @returns `true` if this is an array type.
+  bool is_array() const noexcept
+  {
+    return category == 'A' && element_oid;
+  }
+
+  /// @returns `true` if this is a composite type.
+  bool is_composite() const noexcept
+  {
+    return kind == 'c';
+  }
+
+  /// @returns `true` if this is a domain.
+  bool is_domain() const noexcept
+  {
+    return kind == 'd';
+  }
+};
+
+} // namespace dmitigr::pgfe
+
+#endif  // DMITIGR_PGFE_TYPE_INFO_HPP
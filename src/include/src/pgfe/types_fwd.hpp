@@ -36,6 +36,7 @@ enum class Communication_mode;
 enum class Connection_status;
 enum class Data_direction;
 enum class Data_format;
+enum class Endpoint_role;
 enum class External_library;
 enum class Password_encryption;
 enum class Pipeline_status;
@@ -48,6 +49,7 @@ enum class Session_mode;
 enum class Ssl_certificate_authority_policy;
 enum class Ssl_mode;
 enum class Ssl_protocol_version;
+enum class Ssl_negotiation;
 enum class Transaction_status;
 
 enum class Client_errc;
@@ -60,33 +62,49 @@ enum class Large_object_seek_whence;
 // Classes
 // -----------------------------------------------------------------------------
 
+class Arrow_batch;
+class Cancel_handle;
 class Completion;
 class Composite;
 class Compositional;
 class Connection;
 class Connection_options;
 class Connection_pool;
+class Connection_router;
+class Connection_stats;
 class Copier;
+class Copier_writer;
 class Data;
 class Data_view;
+class Decimal;
 class Error;
+class Event_reactor;
+class Field_ref;
 class Large_object;
+class Large_object_istream;
+class Large_object_reader;
 class Message;
 class Notice;
 class Notification;
+class Notification_queue;
 class Parameterizable;
+class Poll_reactor;
 class Prepared_statement;
 class Named_argument;
 class Problem;
+class Reactor;
 class Ready_for_query;
 class Response;
 class Row;
+class Row_batch;
 class Row_info;
 class Signal;
 class Statement;
 class Statement_vector;
+template<typename> class Task;
 class Transaction_guard;
 class Tuple;
+struct Type_info;
 
 class Exception;
 class Client_exception;
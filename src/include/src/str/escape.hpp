@@ -0,0 +1,210 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_STR_ESCAPE_HPP
+#define DMITIGR_STR_ESCAPE_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace dmitigr::str {
+
+// -----------------------------------------------------------------------------
+// Escaping
+// -----------------------------------------------------------------------------
+
+/**
+ * @returns The offset of the first byte of `data` equal to any of `n0`, `n1`,
+ * `n2` or `n3`, or `data.size()` if there is none.
+ *
+ * @remarks Compares 32 bytes at a time with AVX2, 16 with SSE2 or NEON.
+ */
+inline std::size_t find_any(const std::string_view data,
+  const char n0, const char n1, const char n2, const char n3) noexcept
+{
+  const char* const begin = data.data();
+  const char* const end = begin + data.size();
+  const char* p = begin;
+#if defined(__AVX2__)
+  {
+    const __m256i v0 = _mm256_set1_epi8(n0);
+    const __m256i v1 = _mm256_set1_epi8(n1);
+    const __m256i v2 = _mm256_set1_epi8(n2);
+    const __m256i v3 = _mm256_set1_epi8(n3);
+    for (; end - p >= 32; p += 32) {
+      const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+      const __m256i m = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(c, v0), _mm256_cmpeq_epi8(c, v1)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(c, v2), _mm256_cmpeq_epi8(c, v3)));
+      if (const auto bits = static_cast<unsigned>(_mm256_movemask_epi8(m)))
+        return static_cast<std::size_t>(p - begin) + std::countr_zero(bits);
+    }
+  }
+#endif
+#if defined(__SSE2__)
+  {
+    const __m128i v0 = _mm_set1_epi8(n0);
+    const __m128i v1 = _mm_set1_epi8(n1);
+    const __m128i v2 = _mm_set1_epi8(n2);
+    const __m128i v3 = _mm_set1_epi8(n3);
+    for (; end - p >= 16; p += 16) {
+      const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      const __m128i m = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(c, v0), _mm_cmpeq_epi8(c, v1)),
+        _mm_or_si128(_mm_cmpeq_epi8(c, v2), _mm_cmpeq_epi8(c, v3)));
+      if (const auto bits = static_cast<unsigned>(_mm_movemask_epi8(m)))
+        return static_cast<std::size_t>(p - begin) + std::countr_zero(bits);
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  {
+    const uint8x16_t v0 = vdupq_n_u8(static_cast<unsigned char>(n0));
+    const uint8x16_t v1 = vdupq_n_u8(static_cast<unsigned char>(n1));
+    const uint8x16_t v2 = vdupq_n_u8(static_cast<unsigned char>(n2));
+    const uint8x16_t v3 = vdupq_n_u8(static_cast<unsigned char>(n3));
+    for (; end - p >= 16; p += 16) {
+      const uint8x16_t c = vld1q_u8(reinterpret_cast<const unsigned char*>(p));
+      const uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(c, v0), vceqq_u8(c, v1)),
+        vorrq_u8(vceqq_u8(c, v2), vceqq_u8(c, v3)));
+      // Narrow each byte of the mask to a nibble, so one 64-bit lane
+      // locates the match.
+      const auto bits = vget_lane_u64(vreinterpret_u64_u8(
+          vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+      if (bits)
+        return static_cast<std::size_t>(p - begin) + std::countr_zero(bits) / 4;
+    }
+  }
+#endif
+  for (; p < end; ++p) {
+    if (*p == n0 || *p == n1 || *p == n2 || *p == n3)
+      return static_cast<std::size_t>(p - begin);
+  }
+  return data.size();
+}
+
+/**
+ * @returns The number of bytes the escapers below write at most for an input
+ * of `size` bytes.
+ */
+constexpr std::size_t escaped_size_max(const std::size_t size) noexcept
+{
+  return 2 * size + 2;
+}
+
+/**
+ * @brief Writes `data` enclosed in `quote` characters, doubling the ones in
+ * `data` as well as the `escape` characters, as SQL quotes the literals of
+ * the form `E'...'`.
+ *
+ * @par Requires
+ * `out` has room for `escaped_size_max(data.size())` bytes.
+ *
+ * @returns The end of the output.
+ */
+inline char* quote_doubling(std::string_view data, const char quote,
+  const char escape, char* out) noexcept
+{
+  *out++ = quote;
+  while (true) {
+    const auto pos = find_any(data, quote, escape, quote, escape);
+    if (pos)
+      std::memcpy(out, data.data(), pos);
+    out += pos;
+    if (pos == data.size())
+      break;
+    *out++ = data[pos];
+    *out++ = data[pos];
+    data.remove_prefix(pos + 1);
+  }
+  *out++ = quote;
+  return out;
+}
+
+/**
+ * @brief Writes `data` enclosed in `quote` characters, doubling the ones in
+ * `data`, as SQL quotes literals and identifiers.
+ *
+ * @par Requires
+ * `out` has room for `escaped_size_max(data.size())` bytes.
+ *
+ * @returns The end of the output.
+ */
+inline char* quote_doubling(const std::string_view data, const char quote,
+  char* const out) noexcept
+{
+  return quote_doubling(data, quote, quote, out);
+}
+
+/**
+ * @brief Writes `data` as a non-NULL field of the CSV format the way
+ * `COPY ... (FORMAT csv)` reads it back: quoted only if it contains a
+ * delimiter, a quote or a line break, is empty, or could be taken for the
+ * end-of-data marker.
+ *
+ * @par Requires
+ * `out` has room for `escaped_size_max(data.size())` bytes.
+ *
+ * @returns The end of the output.
+ */
+inline char* escape_csv_field(const std::string_view data, char* out) noexcept
+{
+  if (data.empty() || data == "\\." || find_any(data, ',', '"', '\n', '\r') != data.size())
+    return quote_doubling(data, '"', out);
+  std::memcpy(out, data.data(), data.size());
+  return out + data.size();
+}
+
+/**
+ * @brief Writes `data` in the text format of `COPY`, backslash-escaping
+ * backslashes, tabs and line breaks.
+ *
+ * @par Requires
+ * `out` has room for `escaped_size_max(data.size())` bytes.
+ *
+ * @returns The end of the output.
+ */
+inline char* escape_copy_text(std::string_view data, char* out) noexcept
+{
+  while (true) {
+    const auto pos = find_any(data, '\\', '\t', '\n', '\r');
+    if (pos)
+      std::memcpy(out, data.data(), pos);
+    out += pos;
+    if (pos == data.size())
+      break;
+    *out++ = '\\';
+    switch (data[pos]) {
+    case '\t': *out++ = 't'; break;
+    case '\n': *out++ = 'n'; break;
+    case '\r': *out++ = 'r'; break;
+    default: *out++ = '\\';
+    }
+    data.remove_prefix(pos + 1);
+  }
+  return out;
+}
+
+} // namespace dmitigr::str
+
+#endif  // DMITIGR_STR_ESCAPE_HPP
@@ -0,0 +1,205 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_STR_HEX_HPP
+#define DMITIGR_STR_HEX_HPP
+
+#include <cstddef>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace dmitigr::str {
+
+// -----------------------------------------------------------------------------
+// Hex encoding
+// -----------------------------------------------------------------------------
+
+/**
+ * @brief Writes `data` as lowercase hex digits, two per byte.
+ *
+ * @par Requires
+ * `out` has room for `2 * data.size()` bytes.
+ *
+ * @returns The end of the output.
+ *
+ * @remarks Encodes 16 bytes at a time with SSE2 or NEON.
+ */
+inline char* encode_hex(const std::string_view data, char* out) noexcept
+{
+  const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+  const auto* const end = p + data.size();
+#if defined(__SSE2__)
+  {
+    const __m128i low_mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letter = _mm_set1_epi8('a' - '0' - 10);
+    const auto digits = [&](const __m128i n)
+    {
+      return _mm_add_epi8(_mm_add_epi8(n, zero),
+        _mm_and_si128(_mm_cmpgt_epi8(n, nine), letter));
+    };
+    for (; end - p >= 16; p += 16, out += 32) {
+      const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+      const __m128i hi = digits(_mm_and_si128(_mm_srli_epi16(c, 4), low_mask));
+      const __m128i lo = digits(_mm_and_si128(c, low_mask));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+        _mm_unpacklo_epi8(hi, lo));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16),
+        _mm_unpackhi_epi8(hi, lo));
+    }
+  }
+#elif defined(__ARM_NEON)
+  {
+    const uint8x16_t nine = vdupq_n_u8(9);
+    const uint8x16_t zero = vdupq_n_u8('0');
+    const uint8x16_t letter = vdupq_n_u8('a' - '0' - 10);
+    const auto digits = [&](const uint8x16_t n)
+    {
+      return vaddq_u8(vaddq_u8(n, zero), vandq_u8(vcgtq_u8(n, nine), letter));
+    };
+    for (; end - p >= 16; p += 16, out += 32) {
+      const uint8x16_t c = vld1q_u8(p);
+      // The interleaving store puts each high digit before its low one.
+      vst2q_u8(reinterpret_cast<unsigned char*>(out),
+        (uint8x16x2_t{{digits(vshrq_n_u8(c, 4)),
+          digits(vandq_u8(c, vdupq_n_u8(0x0f)))}}));
+    }
+  }
+#endif
+  constexpr const char alphabet[] = "0123456789abcdef";
+  for (; p < end; ++p) {
+    *out++ = alphabet[*p >> 4];
+    *out++ = alphabet[*p & 0x0f];
+  }
+  return out;
+}
+
+/**
+ * @brief Writes the bytes encoded by `hex` digits (of either case), two per
+ * byte.
+ *
+ * @par Requires
+ * `out` has room for `hex.size() / 2` bytes.
+ *
+ * @returns `false` if `hex` has an odd size or any character which is not a
+ * hex digit. The contents of `out` is unspecified then.
+ *
+ * @remarks Decodes 32 digits at a time with SSE2 or 64 with NEON.
+ */
+inline bool decode_hex(const std::string_view hex, char* out) noexcept
+{
+  if (hex.size() % 2)
+    return false;
+
+  const char* p = hex.data();
+  const char* const end = p + hex.size();
+#if defined(__SSE2__)
+  {
+    // The bytes above 0x7f are negative, so the signed comparisons reject them.
+    const auto nibbles = [](const __m128i c, bool& is_valid)
+    {
+      const __m128i is_digit = _mm_and_si128(
+        _mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+        _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+      const __m128i l = _mm_or_si128(c, _mm_set1_epi8(0x20));
+      const __m128i is_letter = _mm_and_si128(
+        _mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(l, _mm_set1_epi8('f' + 1)));
+      is_valid = is_valid &&
+        _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) == 0xffff;
+      return _mm_or_si128(
+        _mm_and_si128(is_digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+        _mm_and_si128(is_letter, _mm_sub_epi8(l, _mm_set1_epi8('a' - 10))));
+    };
+    // Each 16-bit word holds the high nibble in the low byte and the low
+    // nibble in the high byte.
+    const auto bytes = [](const __m128i n)
+    {
+      return _mm_or_si128(_mm_and_si128(_mm_slli_epi16(n, 4),
+          _mm_set1_epi16(0x00ff)), _mm_srli_epi16(n, 8));
+    };
+    for (bool is_valid{true}; end - p >= 32; p += 32, out += 16) {
+      const __m128i n0 = nibbles(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(p)), is_valid);
+      const __m128i n1 = nibbles(_mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(p + 16)), is_valid);
+      if (!is_valid)
+        return false;
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+        _mm_packus_epi16(bytes(n0), bytes(n1)));
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  {
+    const auto nibbles = [](const uint8x16_t c, uint8x16_t& is_valid)
+    {
+      const uint8x16_t d = vsubq_u8(c, vdupq_n_u8('0'));
+      const uint8x16_t l = vsubq_u8(vorrq_u8(c, vdupq_n_u8(0x20)),
+        vdupq_n_u8('a'));
+      const uint8x16_t is_digit = vcltq_u8(d, vdupq_n_u8(10));
+      const uint8x16_t is_letter = vcltq_u8(l, vdupq_n_u8(6));
+      is_valid = vandq_u8(is_valid, vorrq_u8(is_digit, is_letter));
+      return vorrq_u8(vandq_u8(is_digit, d),
+        vandq_u8(is_letter, vaddq_u8(l, vdupq_n_u8(10))));
+    };
+    for (; end - p >= 64; p += 64, out += 32) {
+      // The deinterleaving load splits the high digits from the low ones.
+      const auto* const q = reinterpret_cast<const unsigned char*>(p);
+      const uint8x16x2_t c0 = vld2q_u8(q);
+      const uint8x16x2_t c1 = vld2q_u8(q + 32);
+      uint8x16_t is_valid = vdupq_n_u8(0xff);
+      const uint8x16_t h0 = nibbles(c0.val[0], is_valid);
+      const uint8x16_t l0 = nibbles(c0.val[1], is_valid);
+      const uint8x16_t h1 = nibbles(c1.val[0], is_valid);
+      const uint8x16_t l1 = nibbles(c1.val[1], is_valid);
+      if (vminvq_u8(is_valid) != 0xff)
+        return false;
+      auto* const o = reinterpret_cast<unsigned char*>(out);
+      vst1q_u8(o, vorrq_u8(vshlq_n_u8(h0, 4), l0));
+      vst1q_u8(o + 16, vorrq_u8(vshlq_n_u8(h1, 4), l1));
+    }
+  }
+#endif
+  const auto nibble = [](const char c) noexcept -> int
+  {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    else if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    else
+      return -1;
+  };
+  for (; p < end; p += 2) {
+    const int hi = nibble(p[0]);
+    const int lo = nibble(p[1]);
+    if (hi < 0 || lo < 0)
+      return false;
+    *out++ = static_cast<char>(hi << 4 | lo);
+  }
+  return true;
+}
+
+} // namespace dmitigr::str
+
+#endif  // DMITIGR_STR_HEX_HPP
@@ -19,8 +19,17 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <string_view>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace dmitigr::str {
 
 // -----------------------------------------------------------------------------
@@ -62,16 +71,134 @@ bool is_non_zero(const Ch ch) noexcept
   return !is_zero(ch);
 }
 
+namespace detail {
+
+/**
+ * @returns The position of the first character of `str` for which
+ * `is_space()` is `space`, or `str.size()` if there's none.
+ *
+ * @remarks Tests 16 characters at a time with SSE2 or NEON. A block with a
+ * byte above 0x7f is tested by `is_space()` itself, as the locale decides
+ * such ones.
+ */
+inline std::size_t find_space(const std::string_view str, const bool space) noexcept
+{
+  std::size_t i{};
+  const auto scalar = [&](const std::size_t end) noexcept
+  {
+    for (; i < end; ++i) {
+      if (is_space(str[i]) == space)
+        return true;
+    }
+    return false;
+  };
+#if defined(__SSE2__)
+  for (; str.size() - i >= 16;) {
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + i));
+    if (_mm_movemask_epi8(c)) {
+      if (scalar(i + 16))
+        return i;
+      continue;
+    }
+    // ' ', or '\t', '\n', '\v', '\f' and '\r'.
+    const __m128i is_space_mask = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(' ')),
+      _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('\t' - 1)),
+        _mm_cmplt_epi8(c, _mm_set1_epi8('\r' + 1))));
+    const int mask = _mm_movemask_epi8(is_space_mask) ^ (space ? 0 : 0xffff);
+    if (mask)
+      return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    i += 16;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; str.size() - i >= 16;) {
+    const uint8x16_t c = vld1q_u8(reinterpret_cast<const unsigned char*>(str.data() + i));
+    if (vmaxvq_u8(c) > 0x7f) {
+      if (scalar(i + 16))
+        return i;
+      continue;
+    }
+    const uint8x16_t is_space_mask = vorrq_u8(vceqq_u8(c, vdupq_n_u8(' ')),
+      vcltq_u8(vsubq_u8(c, vdupq_n_u8('\t')), vdupq_n_u8('\r' - '\t' + 1)));
+    const uint8x16_t found = space ? is_space_mask : vmvnq_u8(is_space_mask);
+    if (vmaxvq_u8(found)) {
+      scalar(i + 16);
+      return i;
+    }
+    i += 16;
+  }
+#endif
+  scalar(str.size());
+  return i;
+}
+
+} // namespace detail
+
 /// @returns `true` if `str` is a blank string.
 inline bool is_blank(const std::string_view str) noexcept
 {
-  return std::all_of(cbegin(str), cend(str), is_space<char>);
+  return detail::find_space(str, false) == str.size();
 }
 
 /// @returns `true` if `str` has at least one space character.
 inline bool has_space(const std::string_view str) noexcept
 {
-  return std::any_of(cbegin(str), cend(str), is_space<char>);
+  return detail::find_space(str, true) != str.size();
+}
+
+/**
+ * @returns `true` if `str` is well-formed UTF-8: every lead byte is followed
+ * by as many continuation bytes as it announces, and no sequence is an
+ * overlong form, a surrogate (U+D800..U+DFFF) or above U+10FFFF.
+ *
+ * @remarks The ASCII runs are skipped 8 bytes at a time.
+ */
+inline bool is_valid_utf8(const std::string_view str) noexcept
+{
+  const auto* p = reinterpret_cast<const unsigned char*>(str.data());
+  const auto* const end = p + str.size();
+  while (p != end) {
+    if (end - p >= 8) {
+      std::uint64_t block;
+      std::memcpy(&block, p, sizeof(block));
+      if (!(block & 0x8080808080808080)) {
+        p += 8;
+        continue;
+      }
+    }
+    const unsigned char c = *p;
+    if (c < 0x80) {
+      ++p;
+      continue;
+    }
+    // The range of the first continuation byte narrows for the lead bytes
+    // whose sequences could be overlong, surrogates or too large.
+    std::size_t length{};
+    unsigned char low{0x80}, high{0xbf};
+    if (c >= 0xc2 && c <= 0xdf)
+      length = 2;
+    else if (c >= 0xe0 && c <= 0xef) {
+      length = 3;
+      if (c == 0xe0)
+        low = 0xa0;
+      else if (c == 0xed)
+        high = 0x9f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+      length = 4;
+      if (c == 0xf0)
+        low = 0x90;
+      else if (c == 0xf4)
+        high = 0x8f;
+    } else
+      return false;
+    if (static_cast<std::size_t>(end - p) < length || p[1] < low || p[1] > high)
+      return false;
+    for (std::size_t i = 2; i < length; ++i) {
+      if ((p[i] & 0xc0) != 0x80)
+        return false;
+    }
+    p += length;
+  }
+  return true;
 }
 
 /// @returns `true` if `input` is starting with `pattern`.
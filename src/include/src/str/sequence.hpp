@@ -17,6 +17,10 @@
 #ifndef DMITIGR_STR_SEQUENCE_HPP
 #define DMITIGR_STR_SEQUENCE_HPP
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -92,6 +96,132 @@ inline std::vector<S> to_vector(const std::string_view input,
   return result;
 }
 
+/**
+ * @brief The lazy range of the parts of a string separated by the specified
+ * separators.
+ *
+ * @details The parts are the same as of to_vector(), but are yielded as views
+ * of the input one at a time, so no memory is allocated. A single separator is
+ * searched by `std::memchr()`.
+ *
+ * @remarks The input and the separators must outlive the range.
+ */
+class Split_view final {
+public:
+  /// The iterator of the parts.
+  class Iterator final {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    /// Constructs the past-the-end iterator.
+    Iterator() = default;
+
+    /// @returns The current part.
+    reference operator*() const noexcept
+    {
+      return part_;
+    }
+
+    /// @returns The pointer to the current part.
+    pointer operator->() const noexcept
+    {
+      return &part_;
+    }
+
+    /// Advances to the next part.
+    Iterator& operator++() noexcept
+    {
+      const auto input = view_->input_;
+      const auto offset = static_cast<std::size_t>(part_.data() - input.data())
+        + part_.size();
+      if (offset < input.size())
+        part_ = view_->part(offset + 1);
+      else
+        view_ = nullptr;
+      return *this;
+    }
+
+    /// @overload
+    Iterator operator++(int) noexcept
+    {
+      auto result = *this;
+      ++*this;
+      return result;
+    }
+
+    /// @returns `true` if `lhs` and `rhs` refer to the same part.
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept
+    {
+      return lhs.view_ == rhs.view_ &&
+        (!lhs.view_ || lhs.part_.data() == rhs.part_.data());
+    }
+
+  private:
+    friend Split_view;
+
+    const Split_view* view_{};
+    std::string_view part_;
+
+    explicit Iterator(const Split_view* const view) noexcept
+      : view_{view}
+      , part_{view->part(0)}
+    {}
+  };
+
+  /// The constructor.
+  Split_view(const std::string_view input, const std::string_view separators)
+    noexcept
+    : input_{input}
+    , separators_{separators}
+  {}
+
+  /// @returns The iterator of the first part.
+  Iterator begin() const noexcept
+  {
+    return input_.empty() ? Iterator{} : Iterator{this};
+  }
+
+  /// @returns The past-the-end iterator.
+  Iterator end() const noexcept
+  {
+    return Iterator{};
+  }
+
+private:
+  std::string_view input_;
+  std::string_view separators_;
+
+  /// @returns The part which starts at `offset`.
+  std::string_view part(const std::size_t offset) const noexcept
+  {
+    const auto rest = input_.substr(offset);
+    std::size_t size{};
+    if (separators_.size() == 1) {
+      const auto* const sep = static_cast<const char*>(
+        std::memchr(rest.data(), separators_.front(), rest.size()));
+      size = sep ? static_cast<std::size_t>(sep - rest.data()) : rest.size();
+    } else
+      size = std::min(rest.find_first_of(separators_), rest.size());
+    return rest.substr(0, size);
+  }
+};
+
+/**
+ * @returns The lazy range of the parts of the `input` string separated by the
+ * specified `separators`.
+ *
+ * @see Split_view.
+ */
+inline Split_view split(const std::string_view input,
+  const std::string_view separators) noexcept
+{
+  return Split_view{input, separators};
+}
+
 } // namespace dmitigr::str
 
 #endif  // DMITIGR_STR_SEQUENCE_HPP
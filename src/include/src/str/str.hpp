@@ -20,7 +20,9 @@
 #include "basics.hpp"
 #include "c_str.h"
 #include "c_str.hpp"
+#include "escape.hpp"
 #include "exceptions.hpp"
+#include "hex.hpp"
 #include "line.hpp"
 #include "numeric.hpp"
 #include "predicate.hpp"
@@ -19,6 +19,7 @@
 
 #include "../base/ret.hpp"
 #include "../fsx/filesystem.hpp"
+#include "../fsx/mapped_file.hpp"
 #include "basics.hpp"
 #include "exceptions.hpp"
 #include "predicate.hpp"
@@ -27,11 +28,15 @@
 #include <array>
 #include <cctype>
 #include <cstddef>
+#include <cstring>
 #include <istream>
+#include <iterator>
 #include <fstream>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 namespace dmitigr::str {
@@ -185,6 +190,142 @@ std::string read_to_string(const std::filesystem::path& path,
     throw Exception{err};
 }
 
+/**
+ * @brief The lazy range of the lines of a file which is mapped into memory.
+ *
+ * @details The lines are yielded as views of the mapping, the same lines as by
+ * read_to_strings(), so reading a file of any size allocates no memory per
+ * line. The delimiter is searched by `std::memchr()`.
+ *
+ * @see fsx::Mapped_file.
+ */
+class Line_view final {
+public:
+  /// The iterator of the lines.
+  class Iterator final {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view*;
+    using reference = const std::string_view&;
+
+    /// Constructs the past-the-end iterator.
+    Iterator() = default;
+
+    /// @returns The current line.
+    reference operator*() const noexcept
+    {
+      return line_;
+    }
+
+    /// @returns The pointer to the current line.
+    pointer operator->() const noexcept
+    {
+      return &line_;
+    }
+
+    /// Advances to the next line.
+    Iterator& operator++() noexcept
+    {
+      const auto offset = static_cast<std::size_t>(line_.data() - data_.data())
+        + line_.size() + 1;
+      if (offset < data_.size())
+        line_ = line(offset);
+      else
+        data_ = line_ = {};
+      return *this;
+    }
+
+    /// @overload
+    Iterator operator++(int) noexcept
+    {
+      auto result = *this;
+      ++*this;
+      return result;
+    }
+
+    /// @returns `true` if `lhs` and `rhs` refer to the same line.
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) noexcept
+    {
+      return lhs.data_.data() == rhs.data_.data() &&
+        lhs.line_.data() == rhs.line_.data();
+    }
+
+  private:
+    friend Line_view;
+
+    std::string_view data_;
+    std::string_view line_;
+    char delimiter_{};
+
+    Iterator(const std::string_view data, const char delimiter) noexcept
+      : data_{data}
+      , delimiter_{delimiter}
+    {
+      line_ = line(0);
+    }
+
+    std::string_view line(const std::size_t offset) const noexcept
+    {
+      const auto* const begin = data_.data() + offset;
+      const auto size = data_.size() - offset;
+      const auto* const end = static_cast<const char*>(
+        std::memchr(begin, delimiter_, size));
+      return {begin, end ? static_cast<std::size_t>(end - begin) : size};
+    }
+  };
+
+  /**
+   * @brief Maps the file into memory.
+   *
+   * @param path The path to the file to read the lines from.
+   * @param delimiter The delimiter character.
+   */
+  explicit Line_view(const std::filesystem::path& path,
+    const char delimiter = '\n')
+    : file_{path}
+    , delimiter_{delimiter}
+  {}
+
+  /// @returns The content of the file.
+  std::string_view data() const noexcept
+  {
+    return file_.view();
+  }
+
+  /// @returns The iterator of the first line.
+  Iterator begin() const noexcept
+  {
+    const auto content = data();
+    return content.empty() ? Iterator{} : Iterator{content, delimiter_};
+  }
+
+  /// @returns The past-the-end iterator.
+  Iterator end() const noexcept
+  {
+    return Iterator{};
+  }
+
+private:
+  fsx::Mapped_file file_;
+  char delimiter_{'\n'};
+};
+
+/**
+ * @returns The lazy range of the lines of the file.
+ *
+ * @param path The path to the file to read the lines from.
+ * @param delimiter The delimiter character.
+ *
+ * @see Line_view.
+ */
+inline Line_view read_lines(const std::filesystem::path& path,
+  const char delimiter = '\n')
+{
+  return Line_view{path, delimiter};
+}
+
 } // namespace dmitigr::str
 
 #endif  // DMITIGR_STR_STREAM_HPP
@@ -22,10 +22,18 @@
 #include "predicate.hpp"
 
 #include <algorithm>
+#include <bitset>
 #include <cctype>
+#include <cstddef>
 #include <string>
 #include <string_view>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace dmitigr::str {
 
 // -----------------------------------------------------------------------------
@@ -60,56 +68,118 @@ inline void terminate(std::string& str, const char c)
     str += c;
 }
 
-/// Eliminates duplicate characters from string `str`.
+/**
+ * @brief Eliminates duplicate characters from string `str`, keeping the
+ * first of each in place.
+ */
 inline void eliminate_duplicates(std::string& str)
 {
-  auto new_size = str.size();
-  for (decltype(new_size) i{}; i < new_size; ++i) {
-    const char ch = str[i];
-    const auto b = begin(str) + i + 1;
-    const auto e = begin(str) + new_size;
-    const bool is_non_unique = find(b, e, ch) != e;
-    if (is_non_unique) {
-      remove_if(b, e, [ch, &new_size](const char c)
-      {
-        if (c == ch) {
-          --new_size;
-          return true;
-        } else
-          return false;
-      });
+  std::bitset<256> seen;
+  std::string::size_type new_size{};
+  for (const char ch : str) {
+    const auto c = static_cast<unsigned char>(ch);
+    if (!seen[c]) {
+      seen[c] = true;
+      str[new_size++] = ch;
     }
   }
   str.resize(new_size);
 }
 
-/// Trims `str` by dropping whitespaces at both sides of it.
-inline std::string trimmed(std::string str, const Trim trim = Trim::all)
+/**
+ * @returns The part of `str` without the whitespaces at both sides of it.
+ *
+ * @remarks Doesn't allocate.
+ */
+inline std::string_view trimmed_view(std::string_view str,
+  const Trim trim = Trim::all) noexcept
 {
-  if (str.empty())
-    return str;
-
-  const auto b = begin(str);
-  const auto e = end(str);
-  const auto tb = static_cast<bool>(trim & Trim::lhs) ?
-    find_if(b, e, is_non_space<char>) : b;
-  if (tb == e) {
-    str.clear(); // the string consists of spaces, so just clear it out
-    return str;
+  if (static_cast<bool>(trim & Trim::lhs))
+    str.remove_prefix(detail::find_space(str, false));
+  if (static_cast<bool>(trim & Trim::rhs)) {
+    auto size = str.size();
+    while (size && is_space(str[size - 1]))
+      --size;
+    str.remove_suffix(str.size() - size);
   }
-  const auto te = static_cast<bool>(trim & Trim::rhs) ?
-    find_if(rbegin(str), rend(str), is_non_space<char>).base() : e;
-
-  const std::string::size_type new_size = te - tb;
-  if (new_size != str.size()) {
-    if (tb != b)
-      move(tb, te, b);
-    str.resize(new_size);
+  return str;
+}
+
+/// Trims `str` in place by dropping whitespaces at both sides of it.
+inline void trim(std::string& str, const Trim trim = Trim::all) noexcept
+{
+  const auto view = trimmed_view(str, trim);
+  if (view.size() != str.size()) {
+    const auto offset = static_cast<std::string::size_type>(view.data() - str.data());
+    if (offset)
+      str.erase(0, offset);
+    str.resize(view.size());
   }
+}
 
+/// Trims `str` by dropping whitespaces at both sides of it.
+inline std::string trimmed(std::string str, const Trim trim = Trim::all)
+{
+  str::trim(str, trim);
   return str;
 }
 
+namespace detail {
+
+/**
+ * @brief Replaces the uppercase characters of `data` with the lowercase
+ * ones, or the lowercase with the uppercase if `upper`.
+ *
+ * @remarks Converts 16 characters at a time with SSE2 or NEON. A block with
+ * a byte above 0x7f is converted by `std::tolower()` or `std::toupper()`
+ * itself, as the locale decides such ones.
+ */
+inline void change_case(char* const data, const std::size_t size,
+  const bool upper) noexcept
+{
+  std::size_t i{};
+  const auto scalar = [&](const std::size_t end) noexcept
+  {
+    for (; i < end; ++i) {
+      const auto c = static_cast<unsigned char>(data[i]);
+      data[i] = static_cast<char>(upper ? std::toupper(c) : std::tolower(c));
+    }
+  };
+  const char first = upper ? 'a' : 'A';
+#if defined(__SSE2__)
+  for (; size - i >= 16;) {
+    auto* const p = reinterpret_cast<__m128i*>(data + i);
+    const __m128i c = _mm_loadu_si128(p);
+    if (_mm_movemask_epi8(c)) {
+      scalar(i + 16);
+      continue;
+    }
+    const __m128i is_letter = _mm_and_si128(
+      _mm_cmpgt_epi8(c, _mm_set1_epi8(static_cast<char>(first - 1))),
+      _mm_cmplt_epi8(c, _mm_set1_epi8(static_cast<char>(first + 26))));
+    // The letters differ from their other case by 0x20 only.
+    _mm_storeu_si128(p, _mm_xor_si128(c, _mm_and_si128(is_letter, _mm_set1_epi8(0x20))));
+    i += 16;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; size - i >= 16;) {
+    auto* const p = reinterpret_cast<unsigned char*>(data + i);
+    const uint8x16_t c = vld1q_u8(p);
+    if (vmaxvq_u8(c) > 0x7f) {
+      scalar(i + 16);
+      continue;
+    }
+    const uint8x16_t is_letter = vcltq_u8(vsubq_u8(c,
+        vdupq_n_u8(static_cast<unsigned char>(first))), vdupq_n_u8(26));
+    vst1q_u8(p, veorq_u8(c, vandq_u8(is_letter, vdupq_n_u8(0x20))));
+    i += 16;
+  }
+#endif
+  scalar(size);
+}
+
+} // namespace detail
+
 // -----------------------------------------------------------------------------
 // lowercase
 
@@ -117,11 +187,9 @@ inline std::string trimmed(std::string str, const Trim trim = Trim::all)
  * @brief Replaces all of uppercase characters in `str` by the corresponding
  * lowercase characters.
  */
-inline void lowercase(std::string& str)
+inline void lowercase(std::string& str) noexcept
 {
-  auto b = begin(str);
-  auto e = end(str);
-  transform(b, e, b, [](const unsigned char c){return tolower(c);});
+  detail::change_case(str.data(), str.size(), false);
 }
 
 /**
@@ -150,11 +218,9 @@ inline bool is_lowercased(const std::string_view str) noexcept
  * @brief Replaces all of lowercase characters in `str` by the corresponding
  * uppercase characters.
  */
-inline void uppercase(std::string& str)
+inline void uppercase(std::string& str) noexcept
 {
-  auto b = begin(str);
-  auto e = end(str);
-  transform(b, e, b, [](const unsigned char c){return toupper(c);});
+  detail::change_case(str.data(), str.size(), true);
 }
 
 /**
@@ -17,7 +17,23 @@
 #ifndef DMITIGR_UTIL_MEMORY_HPP
 #define DMITIGR_UTIL_MEMORY_HPP
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 namespace dmitigr::util {
 
@@ -55,6 +71,364 @@ private:
   bool condition_{true};
 };
 
+/**
+ * @brief A memory resource which hands out memory by bumping a pointer
+ * through the blocks it gets from the upstream resource.
+ *
+ * @details Deallocation is a no-op: the memory is taken back all at once by
+ * reset(), which is to be called when a batch of work is done with the
+ * objects allocated. Unlike `std::pmr::monotonic_buffer_resource`, reset()
+ * keeps the largest block, so once the arena has grown to fit a batch it
+ * serves the next ones without calls to the upstream resource.
+ *
+ * @remarks The arena isn't thread-safe. Use thread_arena() for the arena of
+ * the calling thread.
+ */
+class Arena final : public std::pmr::memory_resource {
+public:
+  /// The destructor.
+  ~Arena() override
+  {
+    release();
+  }
+
+  /**
+   * @brief The constructor.
+   *
+   * @param block_size The size of the first block, which is allocated on
+   * the first allocation.
+   * @param upstream The resource the blocks are allocated from.
+   */
+  explicit Arena(const std::size_t block_size = 4096,
+    std::pmr::memory_resource* const upstream =
+    std::pmr::get_default_resource()) noexcept
+    : upstream_{upstream}
+    , next_block_size_{std::max(block_size, sizeof(Block) * 2)}
+  {}
+
+  /// Non copy-constructible.
+  Arena(const Arena&) = delete;
+
+  /// Non copy-assignable.
+  Arena& operator=(const Arena&) = delete;
+
+  /**
+   * @brief Takes back all the memory allocated, keeping the largest block
+   * for the allocations to follow.
+   *
+   * @par Effects
+   * `!allocated()`.
+   */
+  void reset() noexcept
+  {
+    if (!blocks_)
+      return;
+    // The blocks grow, so the head of the list is the largest one.
+    release(blocks_->next);
+    blocks_->next = nullptr;
+    current_ = blocks_->data();
+    end_ = blocks_->end();
+    allocated_ = 0;
+  }
+
+  /**
+   * @brief Returns all the blocks to the upstream resource.
+   *
+   * @par Effects
+   * `!allocated()`.
+   */
+  void release() noexcept
+  {
+    release(blocks_);
+    blocks_ = nullptr;
+    current_ = end_ = nullptr;
+    allocated_ = 0;
+  }
+
+  /// @returns The number of bytes allocated since the last reset().
+  std::size_t allocated() const noexcept
+  {
+    return allocated_;
+  }
+
+  /**
+   * @returns The copy of `value` terminated by a NUL character, which lives
+   * until the next reset().
+   */
+  std::string_view store(const std::string_view value)
+  {
+    auto* const result = static_cast<char*>(allocate(value.size() + 1, 1));
+    if (!value.empty())
+      std::memcpy(result, value.data(), value.size());
+    result[value.size()] = '\0';
+    return {result, value.size()};
+  }
+
+private:
+  struct alignas(std::max_align_t) Block final {
+    Block* next;
+    std::size_t size;
+
+    char* data() noexcept
+    {
+      return reinterpret_cast<char*>(this + 1);
+    }
+
+    char* end() noexcept
+    {
+      return reinterpret_cast<char*>(this) + size;
+    }
+  };
+
+  std::pmr::memory_resource* upstream_{};
+  std::size_t next_block_size_{};
+  Block* blocks_{};
+  char* current_{};
+  char* end_{};
+  std::size_t allocated_{};
+
+  void* do_allocate(const std::size_t bytes, const std::size_t alignment) override
+  {
+    const auto align = [alignment](char* const p) noexcept
+    {
+      const auto address = reinterpret_cast<std::uintptr_t>(p);
+      return p + ((alignment - address % alignment) % alignment);
+    };
+    if (char* const result = current_ ? align(current_) : nullptr;
+      result && result + bytes <= end_) {
+      current_ = result + bytes;
+      allocated_ += bytes;
+      return result;
+    }
+
+    const std::size_t size = std::max(next_block_size_,
+      sizeof(Block) + bytes + alignment);
+    auto* const block = static_cast<Block*>(
+      upstream_->allocate(size, alignof(Block)));
+    block->next = blocks_;
+    block->size = size;
+    blocks_ = block;
+    next_block_size_ = size * 2;
+
+    char* const result = align(block->data());
+    current_ = result + bytes;
+    end_ = block->end();
+    allocated_ += bytes;
+    return result;
+  }
+
+  void do_deallocate(void*, std::size_t, std::size_t) override
+  {}
+
+  bool do_is_equal(const std::pmr::memory_resource& rhs) const noexcept override
+  {
+    return this == &rhs;
+  }
+
+  void release(Block* block) noexcept
+  {
+    while (block) {
+      Block* const next = block->next;
+      upstream_->deallocate(block, block->size, alignof(Block));
+      block = next;
+    }
+  }
+};
+
+/**
+ * @returns The arena of the calling thread.
+ *
+ * @remarks The objects allocated from it live until whoever owns the batch
+ * of work on this thread calls `reset()`, so it suits the temporaries of a
+ * single call best.
+ */
+inline Arena& thread_arena() noexcept
+{
+  thread_local Arena result;
+  return result;
+}
+
+#ifndef _WIN32
+
+/**
+ * @brief A pool of page-aligned buffers of one fixed size, for the stages
+ * which hand data on in blocks.
+ *
+ * @details The buffers are carved from 2 MiB huge pages where the system has
+ * some reserved, and from memory advised for transparent huge pages
+ * otherwise, faulted in as it's mapped: a buffer the pipeline picks up
+ * neither page-faults nor takes a TLB miss per 4 KiB page. A buffer goes
+ * back to the pool when its Chunk is destroyed, for the next user. The
+ * memory is only unmapped with the pool.
+ *
+ * @remarks The pool is thread-safe. Use chunk_pool() for the pool of the
+ * process.
+ */
+class Chunk_pool final {
+public:
+  /// The size of a huge page.
+  static constexpr std::size_t huge_page_size = 2 << 20;
+
+  /// A buffer of the pool, given back to it on destruction.
+  class Chunk final {
+  public:
+    /// The destructor.
+    ~Chunk()
+    {
+      if (data_)
+        pool_->release(data_);
+    }
+
+    /// Constructs an empty chunk.
+    Chunk() = default;
+
+    /// The move constructor.
+    Chunk(Chunk&& rhs) noexcept
+      : pool_{rhs.pool_}
+      , data_{std::exchange(rhs.data_, nullptr)}
+    {}
+
+    /// The move assignment operator.
+    Chunk& operator=(Chunk&& rhs) noexcept
+    {
+      std::swap(pool_, rhs.pool_);
+      std::swap(data_, rhs.data_);
+      return *this;
+    }
+
+    /// @returns The buffer of `Chunk_pool::chunk_size()` bytes.
+    char* data() const noexcept
+    {
+      return data_;
+    }
+
+  private:
+    friend Chunk_pool;
+
+    Chunk_pool* pool_{};
+    char* data_{};
+
+    Chunk(Chunk_pool& pool, char* const data) noexcept
+      : pool_{&pool}
+      , data_{data}
+    {}
+  };
+
+  /// The destructor.
+  ~Chunk_pool()
+  {
+    for (const auto& [base, size] : slabs_)
+      ::munmap(base, size);
+  }
+
+  /**
+   * @brief The constructor.
+   *
+   * @param chunk_size The size of the buffers, which is rounded up to pages.
+   */
+  explicit Chunk_pool(const std::size_t chunk_size)
+    : chunk_size_{(std::max<std::size_t>(chunk_size, 1) + page_size() - 1)
+      / page_size() * page_size()}
+  {}
+
+  /// Non copy-constructible.
+  Chunk_pool(const Chunk_pool&) = delete;
+
+  /// Non copy-assignable.
+  Chunk_pool& operator=(const Chunk_pool&) = delete;
+
+  /// @returns The size of the buffers.
+  std::size_t chunk_size() const noexcept
+  {
+    return chunk_size_;
+  }
+
+  /// Maps enough memory for `count` buffers to be free at once.
+  void reserve(const std::size_t count)
+  {
+    const std::lock_guard lg{mutex_};
+    if (free_.size() < count)
+      grow(count - free_.size());
+  }
+
+  /**
+   * @returns A free buffer, mapping more memory if there is none.
+   *
+   * @throws `std::bad_alloc` if no memory can be mapped.
+   */
+  Chunk acquire()
+  {
+    const std::lock_guard lg{mutex_};
+    // A huge page's worth at a time, or one buffer when it's bigger.
+    if (free_.empty())
+      grow(std::max<std::size_t>(huge_page_size / chunk_size_, 1));
+    char* const result = free_.back();
+    free_.pop_back();
+    return Chunk{*this, result};
+  }
+
+private:
+  std::size_t chunk_size_{};
+  std::mutex mutex_;
+  std::vector<std::pair<void*, std::size_t>> slabs_;
+  std::vector<char*> free_;
+
+  static std::size_t page_size() noexcept
+  {
+    static const auto result = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return result;
+  }
+
+  void release(char* const data)
+  {
+    const std::lock_guard lg{mutex_};
+    free_.push_back(data);
+  }
+
+  void grow(const std::size_t count)
+  {
+    const std::size_t size = (count * chunk_size_ + huge_page_size - 1)
+      / huge_page_size * huge_page_size;
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (base == MAP_FAILED) {
+      // No huge pages reserved: the kernel may still back the range with
+      // transparent ones, faulted in a page at a time here so that the
+      // users of the buffers don't.
+      base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED)
+        throw std::bad_alloc{};
+      ::madvise(base, size, MADV_HUGEPAGE);
+      for (std::size_t offset{}; offset < size; offset += page_size())
+        static_cast<volatile char*>(base)[offset] = 0;
+    }
+    slabs_.emplace_back(base, size);
+    for (std::size_t offset{}; offset + chunk_size_ <= size; offset += chunk_size_)
+      free_.push_back(static_cast<char*>(base) + offset);
+  }
+};
+
+/**
+ * @returns The pool of the process for the buffers of `chunk_size` bytes,
+ * rounded up to pages.
+ *
+ * @remarks The buffers are never unmapped before the exit, so the pool keeps
+ * what its users held at their busiest.
+ */
+inline Chunk_pool& chunk_pool(const std::size_t chunk_size)
+{
+  static std::mutex mutex;
+  static std::map<std::size_t, std::unique_ptr<Chunk_pool>> pools;
+  const std::lock_guard lg{mutex};
+  auto& result = pools[chunk_size];
+  if (!result)
+    result = std::make_unique<Chunk_pool>(chunk_size);
+  return *result;
+}
+
+#endif  // _WIN32
+
 } // namespace dmitigr::util
 
 #endif  // DMITIGR_UTIL_MEMORY_HPP
@@ -0,0 +1,244 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_UTIL_RING_BUFFER_HPP
+#define DMITIGR_UTIL_RING_BUFFER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace dmitigr::util {
+
+/// The assumed size of a cache line.
+inline constexpr std::size_t cache_line_size = 64;
+
+/// @returns The smallest power of two not less than `value`, at least 2.
+inline constexpr std::size_t ring_capacity(const std::size_t value) noexcept
+{
+  std::size_t result = 2;
+  while (result < value)
+    result <<= 1;
+  return result;
+}
+
+/**
+ * @brief A bounded lock-free queue of one producer and one consumer.
+ *
+ * @details The indices live on cache lines of their own, and each side
+ * keeps a cached copy of the other's, so a push or a pop touches the
+ * shared line only when the cache says the ring is full or empty. The
+ * blocking push() and pop() wait on the other index with `std::atomic`
+ * wait/notify instead of a mutex.
+ */
+template<typename T>
+class Spsc_ring final {
+public:
+  /// The constructor. The capacity is rounded up to a power of two.
+  explicit Spsc_ring(const std::size_t capacity)
+    : mask_{ring_capacity(capacity) - 1}
+    , slots_{std::make_unique<T[]>(mask_ + 1)}
+  {}
+
+  /// Not copy-constructible.
+  Spsc_ring(const Spsc_ring&) = delete;
+  /// Not copy-assignable.
+  Spsc_ring& operator=(const Spsc_ring&) = delete;
+
+  /// @returns The number of the elements the ring holds at most.
+  std::size_t capacity() const noexcept
+  {
+    return mask_ + 1;
+  }
+
+  /// Pushes `value` unless the ring is full. Producer only.
+  bool try_push(T& value)
+  {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_cache_ > mask_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head - tail_cache_ > mask_)
+        return false;
+    }
+    slots_[head & mask_] = std::move(value);
+    head_.store(head + 1, std::memory_order_release);
+    head_.notify_one();
+    return true;
+  }
+
+  /// Pushes `value`, waiting while the ring is full. Producer only.
+  void push(T value)
+  {
+    while (!try_push(value))
+      tail_.wait(tail_cache_, std::memory_order_acquire);
+  }
+
+  /// Pops into `value` unless the ring is empty. Consumer only.
+  bool try_pop(T& value)
+  {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_cache_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail == head_cache_)
+        return false;
+    }
+    value = std::move(slots_[tail & mask_]);
+    tail_.store(tail + 1, std::memory_order_release);
+    tail_.notify_one();
+    return true;
+  }
+
+  /// @returns The popped value, waiting while the ring is empty. Consumer only.
+  T pop()
+  {
+    T result;
+    while (!try_pop(result))
+      head_.wait(head_cache_, std::memory_order_acquire);
+    return result;
+  }
+
+private:
+  const std::size_t mask_;
+  const std::unique_ptr<T[]> slots_;
+  alignas(cache_line_size) std::atomic<std::size_t> head_{};
+  std::size_t tail_cache_{}; // the producer's
+  alignas(cache_line_size) std::atomic<std::size_t> tail_{};
+  std::size_t head_cache_{}; // the consumer's
+};
+
+/**
+ * @brief A bounded lock-free queue of any number of producers and
+ * consumers (Dmitry Vyukov's algorithm).
+ *
+ * @details Every slot carries a sequence number which tells the side
+ * claiming it whether it's free or filled, so producers and consumers
+ * only contend on their own index. The blocking push() and pop() wait on
+ * a counter of completed pops and pushes respectively.
+ */
+template<typename T>
+class Mpmc_ring final {
+public:
+  /// The constructor. The capacity is rounded up to a power of two.
+  explicit Mpmc_ring(const std::size_t capacity)
+    : mask_{ring_capacity(capacity) - 1}
+    , slots_{std::make_unique<Slot[]>(mask_ + 1)}
+  {
+    for (std::size_t i = 0; i <= mask_; ++i)
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  /// Not copy-constructible.
+  Mpmc_ring(const Mpmc_ring&) = delete;
+  /// Not copy-assignable.
+  Mpmc_ring& operator=(const Mpmc_ring&) = delete;
+
+  /// @returns The number of the elements the ring holds at most.
+  std::size_t capacity() const noexcept
+  {
+    return mask_ + 1;
+  }
+
+  /// Pushes `value` unless the ring is full.
+  bool try_push(T& value)
+  {
+    std::size_t pos = head_.load(std::memory_order_relaxed);
+    Slot* slot{};
+    while (true) {
+      slot = &slots_[pos & mask_];
+      const auto diff = static_cast<std::intptr_t>(slot->sequence.load(std::memory_order_acquire)) -
+        static_cast<std::intptr_t>(pos);
+      if (!diff) {
+        if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0)
+        return false;
+      else
+        pos = head_.load(std::memory_order_relaxed);
+    }
+    slot->value = std::move(value);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    pushed_.fetch_add(1, std::memory_order_release);
+    pushed_.notify_one();
+    return true;
+  }
+
+  /// Pushes `value`, waiting while the ring is full.
+  void push(T value)
+  {
+    while (true) {
+      const auto popped = popped_.load(std::memory_order_acquire);
+      if (try_push(value))
+        return;
+      popped_.wait(popped, std::memory_order_acquire);
+    }
+  }
+
+  /// Pops into `value` unless the ring is empty.
+  bool try_pop(T& value)
+  {
+    std::size_t pos = tail_.load(std::memory_order_relaxed);
+    Slot* slot{};
+    while (true) {
+      slot = &slots_[pos & mask_];
+      const auto diff = static_cast<std::intptr_t>(slot->sequence.load(std::memory_order_acquire)) -
+        static_cast<std::intptr_t>(pos + 1);
+      if (!diff) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0)
+        return false;
+      else
+        pos = tail_.load(std::memory_order_relaxed);
+    }
+    value = std::move(slot->value);
+    slot->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    popped_.fetch_add(1, std::memory_order_release);
+    popped_.notify_all();
+    return true;
+  }
+
+  /// @returns The popped value, waiting while the ring is empty.
+  T pop()
+  {
+    T result;
+    while (true) {
+      const auto pushed = pushed_.load(std::memory_order_acquire);
+      if (try_pop(result))
+        return result;
+      pushed_.wait(pushed, std::memory_order_acquire);
+    }
+  }
+
+private:
+  struct Slot final {
+    std::atomic<std::size_t> sequence;
+    T value;
+  };
+
+  const std::size_t mask_;
+  const std::unique_ptr<Slot[]> slots_;
+  alignas(cache_line_size) std::atomic<std::size_t> head_{};
+  alignas(cache_line_size) std::atomic<std::size_t> tail_{};
+  alignas(cache_line_size) std::atomic<std::uint32_t> pushed_{};
+  alignas(cache_line_size) std::atomic<std::uint32_t> popped_{};
+};
+
+} // namespace dmitigr::util
+
+#endif  // DMITIGR_UTIL_RING_BUFFER_HPP
@@ -0,0 +1,250 @@
+// -*- C++ -*-
+//
+// Copyright 2022 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_UTIL_THREAD_POOL_HPP
+#define DMITIGR_UTIL_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace dmitigr::util {
+
+/**
+ * @brief Pins the calling thread to the CPU `cpu`, so the scheduler keeps it
+ * there, and the memory it touches first on that CPU's NUMA node.
+ *
+ * @returns `true` on success, `false` if the system refused or doesn't
+ * support it.
+ */
+inline bool pin_current_thread(const unsigned cpu) noexcept
+{
+#ifdef __linux__
+  if (cpu >= CPU_SETSIZE)
+    return false;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+/// A priority of a task. Higher priorities run first pool-wide.
+enum class Task_priority { low, normal, high };
+
+/**
+ * @brief A shared flag by which the tasks submitted with it are cancelled.
+ *
+ * @details A cancelled task which hasn't started is never run, and its
+ * future reports `std::future_errc::broken_promise`. A running task may
+ * poll `is_cancelled()` to stop early.
+ */
+class Cancellation_token final {
+public:
+  /// The constructor.
+  Cancellation_token()
+    : cancelled_{std::make_shared<std::atomic<bool>>(false)}
+  {}
+
+  /// Cancels the tasks of this token and its copies.
+  void cancel() noexcept
+  {
+    cancelled_->store(true, std::memory_order_release);
+  }
+
+  /// @returns `true` if cancel() was called on this token or a copy.
+  bool is_cancelled() const noexcept
+  {
+    return cancelled_->load(std::memory_order_acquire);
+  }
+
+private:
+  std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+/**
+ * @brief A work-stealing pool of threads.
+ *
+ * @details Every worker has a deque per priority. A task submitted from a
+ * worker goes to the worker's own deques, any other task to those of the
+ * workers in turn. A worker takes the oldest task of its own deques and
+ * otherwise steals the newest of another worker, always looking for the
+ * highest priority across the pool first. The destructor runs the tasks
+ * still queued before it joins the workers.
+ */
+class Thread_pool final {
+public:
+  /**
+   * @brief The constructor. Starts `size` workers, at least one.
+   *
+   * @param cpus The CPUs the workers are pinned to, worker `i` to
+   * `cpus[i % cpus.size()]`. Empty: the workers aren't pinned.
+   */
+  explicit Thread_pool(const std::size_t size, const std::vector<unsigned>& cpus = {})
+    : workers_(std::max<std::size_t>(size, 1))
+  {
+    threads_.reserve(workers_.size());
+    for (std::size_t i = 0; i < workers_.size(); ++i) {
+      const bool pinned = !cpus.empty();
+      const unsigned cpu = pinned ? cpus[i % cpus.size()] : 0;
+      threads_.emplace_back([this, i, pinned, cpu]
+      {
+        if (pinned)
+          pin_current_thread(cpu);
+        run(i);
+      });
+    }
+  }
+
+  /// Not copy-constructible.
+  Thread_pool(const Thread_pool&) = delete;
+  /// Not copy-assignable.
+  Thread_pool& operator=(const Thread_pool&) = delete;
+
+  /// Runs the queued tasks and joins the workers.
+  ~Thread_pool()
+  {
+    {
+      const std::lock_guard lock{sleep_mutex_};
+      stopping_ = true;
+    }
+    wakeup_.notify_all();
+    for (auto& thread : threads_)
+      thread.join();
+  }
+
+  /// @returns The number of workers.
+  std::size_t size() const noexcept
+  {
+    return workers_.size();
+  }
+
+  /**
+   * @brief Submits `task` to run on the pool.
+   *
+   * @returns The future of the result of `task`.
+   */
+  template<typename F>
+  std::future<std::invoke_result_t<F>> submit(F task,
+    const Task_priority priority = Task_priority::normal,
+    Cancellation_token token = {})
+  {
+    auto packaged = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::move(task));
+    auto result = packaged->get_future();
+    const std::size_t index = current_pool_ == this ? current_worker_ :
+      next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+    {
+      Worker& worker = workers_[index];
+      const std::lock_guard lock{worker.mutex};
+      worker.queues[static_cast<std::size_t>(priority)].push_back(
+        Job{std::packaged_task<void()>{[packaged]{ (*packaged)(); }}, std::move(token)});
+    }
+    {
+      const std::lock_guard lock{sleep_mutex_};
+      ++queued_;
+    }
+    wakeup_.notify_one();
+    return result;
+  }
+
+private:
+  struct Job final {
+    std::packaged_task<void()> task;
+    Cancellation_token token;
+  };
+
+  struct Worker final {
+    std::mutex mutex;
+    std::deque<Job> queues[3]; // by Task_priority
+  };
+
+  inline static thread_local const Thread_pool* current_pool_{};
+  inline static thread_local std::size_t current_worker_{};
+
+  std::vector<Worker> workers_;
+  std::vector<std::thread> threads_;
+  std::atomic<std::size_t> next_{};
+  std::mutex sleep_mutex_;
+  std::condition_variable wakeup_;
+  std::size_t queued_{};
+  bool stopping_{};
+
+  bool take(const std::size_t index, Job& job)
+  {
+    for (std::size_t p = 3; p-- > 0;) {
+      for (std::size_t k = 0; k < workers_.size(); ++k) {
+        Worker& worker = workers_[(index + k) % workers_.size()];
+        const std::lock_guard lock{worker.mutex};
+        auto& queue = worker.queues[p];
+        if (queue.empty())
+          continue;
+        if (k == 0) {
+          job = std::move(queue.front());
+          queue.pop_front();
+        } else {
+          job = std::move(queue.back());
+          queue.pop_back();
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void run(const std::size_t index)
+  {
+    current_pool_ = this;
+    current_worker_ = index;
+    while (true) {
+      Job job;
+      if (take(index, job)) {
+        {
+          const std::lock_guard lock{sleep_mutex_};
+          --queued_;
+        }
+        // A cancelled task is dropped unrun, which breaks its promise.
+        if (!job.token.is_cancelled())
+          job.task();
+        continue;
+      }
+      std::unique_lock lock{sleep_mutex_};
+      wakeup_.wait(lock, [this]{ return stopping_ || queued_ > 0; });
+      if (stopping_ && !queued_)
+        return;
+    }
+  }
+};
+
+} // namespace dmitigr::util
+
+#endif  // DMITIGR_UTIL_THREAD_POOL_HPP
@@ -1,17 +1,56 @@
+#include "include/src/fsx/mapped_file.hpp"
+#include "include/src/fsx/output_directory.hpp"
 #include "include/src/pgfe/data.hpp"
 #include "include/src/pgfe/exceptions.hpp"
 #include "include/src/pgfe/pgfe.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <unordered_set>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include "struct_mapping/struct_mapping.h"
+#include "subset/job.hpp"
 
 namespace pgfe = dmitigr::pgfe;
 
+#ifdef SUBSET_COUNT_ALLOCATIONS
+// Every allocation of the process counted for the memory summary, in a
+// build with -DSUBSET_COUNT_ALLOCATIONS: a few relaxed atomics per new and
+// delete, too many to pay by default.
+void* operator new(std::size_t size) {
+    void* const p = std::malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc{};
+    auto& counters = subset::allocationCounters();
+    const std::size_t usable = ::malloc_usable_size(p);
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(usable, std::memory_order_relaxed);
+    counters.live.add(usable);
+    return p;
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept {
+    if(!p) return;
+    subset::allocationCounters().live.release(::malloc_usable_size(p));
+    std::free(p);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, std::size_t) noexcept { operator delete(p); }
+#endif
+
 struct DatabaseInfo {
     std::string host;
     std::string dbName;
@@ -19,60 +58,17 @@ struct DatabaseInfo {
     std::string password;
 };
 
-enum PGDataType { NUMERIC, INTEGER, BIGINT, BOOLEAN, CHARACTERVARYING, TEXT, JSONB, TIMESTAMPNOTIMEZONE, DATE, OTHER };
+template<>
+struct struct_mapping::StaticStruct<DatabaseInfo> : struct_mapping::StaticMembers<
+    struct_mapping::StaticMember<"host", &DatabaseInfo::host>,
+    struct_mapping::StaticMember<"dbName", &DatabaseInfo::dbName>,
+    struct_mapping::StaticMember<"username", &DatabaseInfo::username>,
+    struct_mapping::StaticMember<"password", &DatabaseInfo::password>> {};
 
 void parseFileIntoConfig(const std::string& fileName, DatabaseInfo& config) {
     // Assume file exists and is accessible
-    std::ifstream ifs(fileName);
-    std::string content( (std::istreambuf_iterator<char>(ifs) ), (std::istreambuf_iterator<char>()));
-    std::stringstream ssContent(content);
-    struct_mapping::reg(&DatabaseInfo::host, "host");
-    struct_mapping::reg(&DatabaseInfo::dbName, "dbName");
-    struct_mapping::reg(&DatabaseInfo::username, "username");
-    struct_mapping::reg(&DatabaseInfo::password, "password");
-    struct_mapping::map_json_to_struct(config, ssContent);
-}
-
-std::string getChildrenQuery = R"(SELECT
-        tc.table_schema, 
-        tc.constraint_name, 
-        tc.table_name as "tableName", 
-        kcu.column_name, 
-        ccu.table_schema AS foreign_table_schema,
-        ccu.table_name AS foreign_table_name,
-        ccu.column_name AS foreign_column_name 
-        FROM information_schema.table_constraints AS tc 
-        JOIN information_schema.key_column_usage AS kcu
-        ON tc.constraint_name = kcu.constraint_name
-        AND tc.table_schema = kcu.table_schema
-        JOIN information_schema.constraint_column_usage AS ccu
-        ON ccu.constraint_name = tc.constraint_name
-        WHERE tc.constraint_type = 'FOREIGN KEY'
-        AND tc.table_schema='public'
-        AND ccu.table_name =')";
-
-std::string getSupportersQuery = R"(SELECT
-        tc.table_schema, 
-        tc.constraint_name, 
-        tc.table_name as "tableName", 
-        kcu.column_name, 
-        ccu.table_schema AS foreign_table_schema,
-        ccu.table_name AS foreign_table_name,
-        ccu.column_name AS foreign_column_name 
-        FROM information_schema.table_constraints AS tc 
-        JOIN information_schema.key_column_usage AS kcu
-        ON tc.constraint_name = kcu.constraint_name
-        AND tc.table_schema = kcu.table_schema
-        JOIN information_schema.constraint_column_usage AS ccu
-        ON ccu.constraint_name = tc.constraint_name
-        WHERE tc.constraint_type = 'FOREIGN KEY'
-        AND tc.table_schema='public'
-        AND tc.table_name =')";
-
-std::string getTableFieldsAndDataTypes(const std::string& tableName) {
-    return R"(
-        SELECT column_name, is_nullable, data_type
-        FROM information_schema.columns WHERE table_name = ')" + tableName + "'";
+    const dmitigr::fsx::Mapped_file file{fileName};
+    struct_mapping::map_json_to_static_struct(config, file.view());
 }
 
 std::string valuesFromVector(std::vector<std::string> vec, std::string delimiter = ",") {
@@ -91,48 +87,12 @@ std::string getRowsByFKEYQuery(const std::string& tableName, const std::string&
     R"( = )" + value + where );
 }
 
-std::string getSupporterQuery(const std::string& tableName) {
-    return getSupportersQuery + tableName + "'";
-}
-
 struct sortDepListOnDependencySize {
     inline bool operator()(std::pair<std::string, std::unordered_set<std::string>>& a, std::pair<std::string, std::unordered_set<std::string>>& b) {
         return a.second.size() < b.second.size();
     }
 };
 
-std::string getForeignKeyQuery(const std::string& tableName) {
-    return getChildrenQuery + tableName + "'";
-}
-
-PGDataType getPGDataType(const std::string& dataType) {
-    if(dataType == "integer") return PGDataType::INTEGER;
-    else if(dataType == "bigint") return PGDataType::BIGINT;
-    else if(dataType == "numeric") return PGDataType::NUMERIC;
-    else if(dataType == "boolean") return PGDataType::BOOLEAN;
-    else if(dataType == "character varying") return PGDataType::CHARACTERVARYING;
-    else if(dataType == "text") return PGDataType::TEXT;
-    else if(dataType == "jsonb") return PGDataType::JSONB;
-    else if(dataType == "timestamp without time zone") return PGDataType::TIMESTAMPNOTIMEZONE;
-    else if(dataType == "date") return PGDataType::DATE;
-    return PGDataType::OTHER;
-}
-
-// is there a better way of pattern matching?
-bool pgDataTypeNeedsEnclosedQuotes(const PGDataType& dataType) {
-    std::vector<PGDataType> encloseds = { PGDataType::CHARACTERVARYING, PGDataType::TEXT, PGDataType::JSONB, PGDataType::TIMESTAMPNOTIMEZONE, PGDataType::DATE, PGDataType::OTHER };
-    for(auto& dt : encloseds) {
-        if(dt == dataType) return true;
-    }
-    return false;
-}
-
-struct ColInfo {
-    bool isNullable;
-    PGDataType dataType;
-    int index;
-};
-
 int main(int argc, char** argv)
 {
     //DatabaseInfo config;
@@ -143,260 +103,58 @@ int main(int argc, char** argv)
         std::cout << argv[i] <<  '\n';
     }
     std::cout << '\n';
-    auto beforeTime = std::chrono::steady_clock::now();
-    std::string retailerQuery = getForeignKeyQuery(argv[1]);
     try {
-        pgfe::Connection conn{pgfe::Connection_options{}
+        // --connect hands the job to a daemon.
+        if(const auto client = subset::daemonClientArgs(argc, argv)) return subset::submitJob(client->first, client->second);
+        const subset::Options options = subset::parseOptions(argc, argv);
+        // Applies to the connections that use SSL.
+        const auto sslNegotiation = options.directSsl ? std::optional{pgfe::Ssl_negotiation::direct} : std::nullopt;
+        const auto sourceOptions = pgfe::Connection_options{}
             .set(pgfe::Communication_mode::net)
             .set_hostname("localhost")
             .set_database("db_name")
             .set_username("postgres")
             .set_password("postgres")
             .set_ssl_enabled(false)
-        };
-        conn.connect();
-
-        pgfe::Connection local{pgfe::Connection_options{}
+            .set_ssl_negotiation(sslNegotiation);
+        const auto targetOptions = pgfe::Connection_options{}
             .set(pgfe::Communication_mode::net)
             .set_hostname("localhost")
             .set_database("db_name")
             .set_username("postgres")
             .set_password("postgres")
+            .set_ssl_negotiation(sslNegotiation);
             //.set_ssl_enabled(true)
-        };
-
-        local.connect();
-        
-        std::unordered_set<std::string> seen;
-        std::map<std::string, std::unordered_set<std::string>> deps;
-        std::map<std::string, std::unordered_set<std::string>> inv;
-        std::unordered_map<std::string, std::unordered_set<std::string>> locks;
-        std::unordered_map<std::string, std::unordered_map<std::string, std::string>> fkeys;
-        std::unordered_map<std::string, std::unordered_map<std::string, std::string>> invFkeys;
-        std::unordered_map<std::string, std::unordered_map<std::string, std::string>> fkeyCols;  // fkeyCols[table_foo][column_name] = foreign_column_name
-        std::unordered_map<std::string, std::unordered_set<std::string>> tableFkeyNeeds;
-        std::unordered_map<std::string, std::unordered_map<std::string, ColInfo>> tableCols;
-        std::vector<std::string> tableOrder = {argv[1]};
-        std::queue<std::string> q;
-        q.push(std::string(argv[1]));
-        seen.insert(std::string(argv[1]));
-        while(!q.empty()) {
-            std::string currentTable = q.front();
-            q.pop();
 
-            std::string query = getForeignKeyQuery(currentTable);
-            std::string supporter = getSupporterQuery(currentTable);
-            conn.execute([&](auto&& r)
+        if(!options.sources.empty()) return subset::runSources(options, sourceOptions, targetOptions);
+        subset::Session session{sourceOptions, targetOptions, !options.daemon.empty(), options.memoryCache << 20,
+            options.noticeRate};
+        // A replay builds the recorded run's dataset in the source, then
+        // extracts it from the profile's seeds: the root's first rows.
+        if(!options.replay.empty()) {
+            const auto profile = subset::readProfile(options.replay);
             {
-                using dmitigr::pgfe::to;
-                std::vector<std::string> cols;
-                auto dependentTable = to<std::string>(r["tableName"]);
-                auto colName = to<std::string>(r["column_name"]);
-                auto foreignColName = to<std::string>(r["foreign_column_name"]);
-                fkeyCols[currentTable][colName] = foreignColName;
-                tableFkeyNeeds[currentTable].insert(foreignColName);
-                    fkeys[dependentTable][currentTable] = colName; // supporter's col name
-                    invFkeys[currentTable][dependentTable] = colName;
-                if(seen.count(dependentTable) == 0) {
-                    seen.insert(dependentTable);
-                    q.push(dependentTable);
-                }
-                // deps[B] = B depends on [..A]
-                // inv[A] = A supports [..B]
-                deps[dependentTable].insert(currentTable);
-                inv[currentTable].insert(dependentTable);
-                tableOrder.push_back(dependentTable);
-            },
-            query);
-            conn.execute([&](auto&& r){
-                using dmitigr::pgfe::to;
-                auto tableName = to<std::string>(r["foreign_table_name"]);
-                std::cout << currentTable << " depends on: " << tableName << '\n';
-                if(seen.count(tableName) == 0) {
-                    seen.insert(tableName);
-                    q.push(tableName);
-                }
-                deps[currentTable].insert(tableName);
-                inv[tableName].insert(currentTable);
-                
-            }, supporter);
-            std::string colQuery = getTableFieldsAndDataTypes(currentTable);
-            conn.execute([&](auto&& r) {
-                using dmitigr::pgfe::to;
-                std::string colName = to<std::string>(r["column_name"]);
-                std::string isNullable = to<std::string>(r["is_nullable"]);
-                std::string dataType = to<std::string>(r["data_type"]);
-                tableCols[currentTable][colName].isNullable = isNullable == "YES" ? true : false;
-                tableCols[currentTable][colName].dataType = getPGDataType(dataType);
-            }, colQuery);
-        }
-        auto depCopy = deps;
-        std::vector<std::string> order;
-        q.push(argv[1]);
-
-        auto hasIncomingEdges =[&](const std::string& table) {
-            return inv.count(table) > 0;
-        };
-
-        for(auto& d : deps) {
-            std::cout << d.first << " depends on: ";
-            for(auto& di: d.second) {
-                std::cout << di << " | ";
+                subset::Logger logger{std::cout, options.logLevel};
+                subset::buildReplayDataset(session.source(), profile, options.schema, options.replayRebuild, logger);
             }
-            std::cout << '\n';
+            subset::Options job = options;
+            job.rootTable = profile.root;
+            job.seedWhere = "id <= " + std::to_string(profile.seeds);
+            return subset::runJob(job, session);
         }
-
-        // kahn's algorithm
-        std::vector<std::string> L;
-        std::queue<std::string> S;
-
-        for(auto& table : seen) {
-            if(deps[table].size() == 0) {
-                std::cout << "Adding: " << table << '\n';
-                S.push(table);
-            }
-        }   
-
-        // https://en.wikipedia.org/wiki/Topological_sorting#:~:text=.-,Kahn%27s%20algorithm,-%5Bedit%5D
-        while(!S.empty()) {
-            std::string currentTable = S.front();
-            std::cout << "S.front(): " << currentTable << '\n';
-            S.pop();
-            L.push_back(currentTable);
-            std::vector<std::string> toErase;
-            for(std::string m : inv[currentTable]) {
-                toErase.push_back(m);
-                if(deps[m].size() == 1) {
-                    S.push(m);
-                }  
-            }
-            for(auto& erase : toErase) {
-                inv[currentTable].erase(erase);
-                deps[erase].erase(currentTable);
-            }
-        }
-        
-        std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::string>>> tableColValues;
-
-        conn.execute([&](auto&& r)
-            {
-                using dmitigr::pgfe::to;
-                auto id = to<std::string>(r["id"]);
-                for(auto& col : tableFkeyNeeds[argv[1]]) {
-                    auto ye = to<std::string>(r[col]);
-                    tableColValues[argv[1]][col].push_back(ye);
-                }
-            },
-            ("select * from " + std::string(argv[1]) + " where id = " + std::string(argv[2])));
-
-        // maybe need to rethink this
-        auto whereCondition = [&](std::string tableName) {
-            std::string whereCondition = "";
-            std::cout << tableName << '\n';
-            bool first = true;
-            for(auto& dep : depCopy[tableName]) {
-                std::string tableCol = fkeys[tableName][dep];
-                std::string mappedTableCol = fkeyCols[dep][tableCol];
-                std::vector<std::string> values = tableColValues[dep][fkeyCols[dep][fkeys[tableName][dep]]];
-                std::string currentCondition = "";
-                    if(first) {
-                        currentCondition = "WHERE ";
-                        first = false;
-                    } else {
-                        currentCondition = " AND ";
-                    }
-                    currentCondition += ("\"" + fkeys[tableName][dep]);
-                    currentCondition += "\" IN (";
-
-                if(values.size() > 0) {
-                    currentCondition += valuesFromVector(values);
-                } else currentCondition += "NULL";
-                currentCondition += ")";
-                whereCondition += currentCondition;
-            }
-            return whereCondition;
-        };
-
-        int64_t totalRows = 0;
-        auto runTable = [&](const std::string& tableName) {
-            std::string query = R"(
-                SELECT
-                    *
-                FROM 
-            )" + tableName
-            + R"(
-            )" +
-            whereCondition(tableName);
-            std::cout << query << "\n";
-            std::string copyQuery = "COPY(" + query + ") TO '/tmp/" + tableName + ".csv' WITH DELIMITER ',' CSV";
-            std::cout << "copy Query: " << copyQuery << '\n';
-            bool ran = false;
-            bool first = true;
-            std::vector<std::string> colNames;
-            /*
-            conn.execute([&](auto&& r)
-            {   
-                using dmitigr::pgfe::to;
-                /*
-                std::vector<std::string> values;
-                 std::string insertQuery;
-                if(!ran) {
-                    ran = true;
-                    for(size_t i = 0; i < r.field_count(); i++) {
-                        std::string value = to<std::string>(r[i]);
-                        std::string fieldName(r.field_name(i));
-                        if(pgDataTypeNeedsEnclosedQuotes(tableCols[tableName][fieldName].dataType) && value != "") {
-                            std::string enclose = "'";
-                            if(tableCols[tableName][fieldName].dataType == PGDataType::CHARACTERVARYING) {
-                            bool hasSingleQuote = false;
-                                for(auto& chr : value) {
-                                    if(chr == '\'') {
-                                        hasSingleQuote = true;
-                                        break;
-                                    }
-                                }
-                                if(hasSingleQuote) enclose =" $$ ";
-                            }
-                            value = enclose + value + enclose;
-                        } else if(tableCols[tableName][fieldName].dataType == PGDataType::BOOLEAN) {
-                            value = value == "t" ? "TRUE" : "FALSE";
-                        }
-                        values.push_back(value != "" ? value : "NULL");
-                        if(first) {
-                            colNames.push_back(fieldName);
-                        }
-                    }
-                    //std::cout << '\n';
-                    insertQuery = "INSERT INTO " + tableName + " ( " + valuesFromVector(colNames) + " ) " + "VALUES ( " + valuesFromVector(values) + " ) ON CONFLICT DO NOTHING";
-                    outfile << valuesFromVector(values) << '\n';
-                    std::cout << insertQuery << '\n';
-                    //local.execute([&](auto&& r) {
-                    //}, insertQuery);
-                    first = false;
+        if(!options.daemon.empty()) {
+            std::optional<subset::MetricsServer> metricsServer;
+            if(!options.metricsListen.empty()) metricsServer.emplace(options.metricsListen);
+            subset::serveJobs(options.daemon, [&](const subset::Options& job) {
+                try {
+                    return subset::runJob(job, session);
+                } catch(...) {
+                    session.reset();
+                    throw;
                 }
-                totalRows++;
-                for(auto& col : tableFkeyNeeds[tableName]) {
-                    auto colVal = to<std::string>(r[col]);
-                    tableColValues[tableName][col].push_back(colVal);
-                }
-            },
-            copyQuery);
-            */
-        };
-
-        std::vector<std::string> dataSearchOrder = {argv[1]};
-        std::cout << "<-------------------------------------------->\nORDER:\n";
-        for(auto& l : L) {
-            runTable(l);
-            std::cout << l << '\n';
+            });
         }
-
-
-        std::chrono::time_point afterTime = std::chrono::steady_clock::now();
-        std::chrono::duration<float> elapsedTime = afterTime - beforeTime;
-        std::cout << "Program ran in: " << elapsedTime << '\n';
-        std::cout << "Total Number of Rows: " << totalRows << '\n';
-
+        return subset::runJob(options, session);
     } catch (const pgfe::Server_exception& e) {
         std::cout << e.error().detail() << '\n';
         assert(e.error().condition() == pgfe::Server_errc::c42_syntax_error);
@@ -0,0 +1,305 @@
+// Times the hot paths of the libraries on fixed in-memory datasets, with no
+// database, so an optimization or a regression shows up in isolation.
+//
+//   cpp_schema_microbench [--filter TEXT] [--runs K] [--min-ms T]
+//       [--results FILE] [--connected]
+//
+// Each benchmark is run in batches of iterations sized to last at least T ms;
+// the median of K batches is reported in nanoseconds per iteration. The
+// results file gets one JSON object per benchmark, so runs of different
+// builds can be compared. Statement::to_query_string() and
+// Row_info::field_index() need a live connection (for the quoting and for a
+// described result), so they're only timed with --connected, against the same
+// database as cpp_schema_bench.
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "../struct_mapping/struct_mapping.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pgfe = dmitigr::pgfe;
+
+namespace {
+
+struct MicrobenchOptions {
+    std::string filter;
+    std::size_t runs = 5;
+    std::size_t minMs = 50;
+    std::string results = "microbench_results.jsonl";
+    bool connected = false;
+};
+
+MicrobenchOptions parseMicrobenchOptions(int argc, char** argv) {
+    MicrobenchOptions options;
+    for(int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if(arg == "--connected") {
+            options.connected = true;
+            continue;
+        }
+        if(i + 1 >= argc) throw std::invalid_argument{"missing value for " + arg};
+        const std::string value = argv[++i];
+        if(arg == "--filter") options.filter = value;
+        else if(arg == "--runs") options.runs = std::stoul(value);
+        else if(arg == "--min-ms") options.minMs = std::stoul(value);
+        else if(arg == "--results") options.results = value;
+        else throw std::invalid_argument{"unknown option " + arg};
+    }
+    if(options.runs < 1) throw std::invalid_argument{"need at least 1 run"};
+    return options;
+}
+
+// Keeps the compiler from optimizing away the value computed.
+template<typename T>
+void keep(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct Benchmark {
+    std::string name;
+    std::function<void()> iteration;
+};
+
+// The median nanoseconds per iteration of the batches.
+double measure(const Benchmark& benchmark, const MicrobenchOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    const auto minTime = std::chrono::milliseconds{options.minMs};
+    std::size_t iterations = 1;
+    while(true) {
+        const auto start = Clock::now();
+        for(std::size_t i = 0; i < iterations; i++) benchmark.iteration();
+        const auto elapsed = Clock::now() - start;
+        if(elapsed >= minTime / 4) {
+            // Scale the batch from the calibration rather than doubling on.
+            const double perIteration = std::chrono::duration<double>(elapsed).count() / static_cast<double>(iterations);
+            iterations = std::max<std::size_t>(1, static_cast<std::size_t>(std::chrono::duration<double>(minTime).count() / perIteration));
+            break;
+        }
+        iterations *= 2;
+    }
+
+    std::vector<double> samples;
+    for(std::size_t run = 0; run < options.runs; run++) {
+        const auto start = Clock::now();
+        for(std::size_t i = 0; i < iterations; i++) benchmark.iteration();
+        const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+        samples.push_back(elapsed.count() / static_cast<double>(iterations));
+    }
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(samples.size() / 2), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// The datasets. They are fixed, so the numbers of two builds compare.
+
+const std::string extractQuery =
+    "SELECT t.id, t.parent_id, t.payload, t.created_at FROM public.orders t "
+    "WHERE t.customer_id IN (:keys) AND t.created_at >= :since "
+    "AND t.status = $1 -- a comment\n"
+    "AND t.note <> 'a literal with :no_parameter' ORDER BY t.id";
+
+std::vector<std::int64_t> keyValues() {
+    std::vector<std::int64_t> result;
+    for(std::int64_t i = 0; i < 1000; i++) result.push_back(i * 7919 + 1000000);
+    return result;
+}
+
+std::vector<std::string> fieldNames() {
+    std::vector<std::string> result;
+    for(int i = 0; i < 32; i++) result.push_back("column_" + std::to_string(i));
+    return result;
+}
+
+// The query of a described result of the field names with no rows.
+std::string describeQuery(const std::vector<std::string>& names) {
+    std::string result = "SELECT";
+    for(std::size_t i = 0; i < names.size(); i++) result += (i ? ", " : " ") + std::to_string(i) + " AS " + names[i];
+    return result;
+}
+
+struct Config {
+    struct Database {
+        std::string host;
+        std::string dbName;
+        std::string username;
+        std::string password;
+        long long port;
+    };
+    Database source;
+    Database target;
+    std::vector<std::string> tables;
+    bool compress;
+};
+
+const std::string configJson = [] {
+    std::string result = R"({"source":{"host":"localhost","dbName":"db_name","username":"postgres","password":"postgres","port":5432},)"
+        R"("target":{"host":"replica","dbName":"db_copy","username":"postgres","password":"secret","port":5433},"tables":[)";
+    for(int i = 0; i < 64; i++) result += (i ? ",\"" : "\"") + std::string{"public.table_"} + std::to_string(i) + '"';
+    return result + R"(],"compress":true})";
+}();
+
+} // namespace
+
+template<>
+struct struct_mapping::StaticStruct<Config::Database> : struct_mapping::StaticMembers<
+    struct_mapping::StaticMember<"host", &Config::Database::host>,
+    struct_mapping::StaticMember<"dbName", &Config::Database::dbName>,
+    struct_mapping::StaticMember<"username", &Config::Database::username>,
+    struct_mapping::StaticMember<"password", &Config::Database::password>,
+    struct_mapping::StaticMember<"port", &Config::Database::port>> {};
+
+template<>
+struct struct_mapping::StaticStruct<Config> : struct_mapping::StaticMembers<
+    struct_mapping::StaticMember<"source", &Config::source>,
+    struct_mapping::StaticMember<"target", &Config::target>,
+    struct_mapping::StaticMember<"tables", &Config::tables>,
+    struct_mapping::StaticMember<"compress", &Config::compress>> {};
+
+namespace {
+
+std::vector<Benchmark> benchmarks(pgfe::Connection* conn) {
+    std::vector<Benchmark> result;
+
+    result.push_back({"statement_parse", [] {
+        const pgfe::Statement statement{extractQuery};
+        keep(statement);
+    }});
+    if(conn) {
+        auto statement = std::make_shared<pgfe::Statement>(extractQuery);
+        statement->bind("keys", "1,2,3");
+        statement->bind("since", "'2020-01-01'");
+        auto query = std::make_shared<std::string>();
+        result.push_back({"statement_to_query_string", [conn, statement, query] {
+            statement->to_query_string(*conn, *query);
+            keep(*query);
+        }});
+    }
+
+    // An iteration of these converts all of the keys, a typical key set.
+    const auto keys = std::make_shared<std::vector<std::int64_t>>(keyValues());
+    result.push_back({"conversions_int64_to_data", [keys] {
+        for(const auto key : *keys) keep(pgfe::to_data(key));
+    }});
+    auto keyTexts = std::make_shared<std::vector<std::string>>();
+    for(const auto key : *keys) keyTexts->push_back(std::to_string(key));
+    result.push_back({"conversions_int64_from_text", [keyTexts] {
+        for(const auto& text : *keyTexts) keep(pgfe::to<std::int64_t>(pgfe::Data_view{text.data(), text.size()}));
+    }});
+    result.push_back({"conversions_double_from_text", [] {
+        static const std::string text = "31415.926535";
+        keep(pgfe::to<double>(pgfe::Data_view{text.data(), text.size()}));
+    }});
+    result.push_back({"conversions_string_from_text", [keyTexts] {
+        for(const auto& text : *keyTexts) keep(pgfe::to<std::string>(pgfe::Data_view{text.data(), text.size()}));
+    }});
+
+    result.push_back({"conversions_timestamp_from_text", [] {
+        static const std::string text = "2024-03-17 13:45:07.123456+00";
+        keep(pgfe::to<std::chrono::sys_time<std::chrono::microseconds>>(pgfe::Data_view{text.data(), text.size()}));
+    }});
+    result.push_back({"conversions_date_from_text", [] {
+        static const std::string text = "2024-03-17";
+        keep(pgfe::to<std::chrono::sys_days>(pgfe::Data_view{text.data(), text.size()}));
+    }});
+    result.push_back({"conversions_decimal_from_text", [] {
+        static const std::string text = "-1234567.8901";
+        keep(pgfe::to<pgfe::Decimal>(pgfe::Data_view{text.data(), text.size()}));
+    }});
+    result.push_back({"conversions_decimal_from_binary", [] {
+        static const std::string bytes = [] {
+            std::string result;
+            pgfe::Decimal::from_string("-1234567.8901").to_numeric_binary(result);
+            return result;
+        }();
+        keep(pgfe::to<pgfe::Decimal>(pgfe::Data_view{bytes.data(), bytes.size(), pgfe::Data_format::binary}));
+    }});
+    result.push_back({"conversions_timestamp_to_data", [] {
+        static const std::chrono::sys_time<std::chrono::microseconds> value{std::chrono::microseconds{1710683107123456}};
+        keep(pgfe::to_data(value));
+    }});
+
+    using Array = std::vector<std::optional<std::int64_t>>;
+    const auto array = std::make_shared<Array>(keys->begin(), keys->end());
+    const auto arrayData = pgfe::to_data(*array);
+    const auto arrayText = std::make_shared<std::string>(static_cast<const char*>(arrayData->bytes()), arrayData->size());
+    result.push_back({"array_conversions_format", [array] {
+        keep(pgfe::to_data(*array));
+    }});
+    result.push_back({"array_conversions_parse", [arrayText] {
+        keep(pgfe::to<Array>(pgfe::Data_view{arrayText->data(), arrayText->size()}));
+    }});
+
+    if(conn) {
+        const auto names = std::make_shared<std::vector<std::string>>(fieldNames());
+        const auto row = std::make_shared<pgfe::Row>();
+        conn->execute([&row](pgfe::Row&& r) { *row = std::move(r); }, describeQuery(*names));
+        result.push_back({"row_info_field_index", [names, row] {
+            for(const auto& name : *names) keep(row->info().field_index(name));
+        }});
+    }
+
+    result.push_back({"data_make", [keyTexts] {
+        for(const auto& text : *keyTexts) keep(pgfe::Data::make(std::string_view{text}));
+    }});
+
+    result.push_back({"struct_mapping_json_to_static_struct", [] {
+        Config config;
+        struct_mapping::map_json_to_static_struct(config, configJson);
+        keep(config);
+    }});
+
+    // A key at the end of a jsonb document, past the values to skip.
+    result.push_back({"json_view_find_path", [] {
+        static const std::string document = [] {
+            std::string json = "{";
+            for(int i = 0; i < 256; i++) json += "\"key_" + std::to_string(i) + "\": {\"value\": \"" + std::string(32, 'x') + "\", \"n\": [1, 2, 3]}, ";
+            return json + "\"last\": {\"id\": 42}}";
+        }();
+        keep(struct_mapping::JsonView{document}.find_path("last.id")->as_integral());
+    }});
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        const MicrobenchOptions options = parseMicrobenchOptions(argc, argv);
+        std::unique_ptr<pgfe::Connection> conn;
+        if(options.connected) {
+            conn = std::make_unique<pgfe::Connection>(pgfe::Connection_options{}
+                .set(pgfe::Communication_mode::net)
+                .set_hostname("localhost")
+                .set_database("db_name")
+                .set_username("postgres")
+                .set_password("postgres")
+                .set_ssl_enabled(false));
+            conn->connect();
+        }
+
+        std::ofstream results{options.results, std::ios::app};
+        for(const auto& benchmark : benchmarks(conn.get())) {
+            if(benchmark.name.find(options.filter) == std::string::npos) continue;
+            const double ns = measure(benchmark, options);
+            std::printf("%-40s %12.1f ns\n", benchmark.name.c_str(), ns);
+            std::ostringstream line;
+            line << "{\"benchmark\":\"" << benchmark.name << "\",\"runs\":" << options.runs << ",\"ns_per_iteration\":" << ns << "}\n";
+            results << line.str();
+        }
+    } catch(const std::exception& e) {
+        std::fprintf(stderr, "microbench: %s\n", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,386 @@
+#pragma once
+
+#include "exception.h"
+
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace struct_mapping::detail
+{
+
+// Finds the first `"` or `\` of [p, end), 16 bytes at a time with SSE2.
+inline const char* find_quote_or_backslash(const char* p, const char* end)
+{
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('\"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+
+	for (; end - p >= 16; p += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+			_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash))));
+
+		if (mask != 0)
+		{
+			return p + std::countr_zero(mask);
+		}
+	}
+#endif
+
+	while (p != end && *p != '\"' && *p != '\\')
+	{
+		++p;
+	}
+
+	return p;
+}
+
+// The same parser as Parser, but over a contiguous buffer: the whitespace and
+// the contents of the strings are scanned 16 bytes at a time with SSE2, and a
+// string is appended in runs rather than byte by byte.
+template<
+	typename SetBool,
+	typename SetFloatingPoint,
+	typename SetIntegral,
+	typename SetString,
+	typename SetNull,
+	typename StartStruct,
+	typename EndStruct,
+	typename StartArray,
+	typename EndArray>
+class BufferParser
+{
+public:
+	BufferParser(
+		SetBool set_bool_,
+		SetIntegral set_integral_,
+		SetFloatingPoint set_floating_point_,
+		SetString set_string_,
+		SetNull set_null_,
+		StartStruct start_struct_,
+		EndStruct end_struct_,
+		StartArray start_array_,
+		EndArray end_array_)
+		:	set_bool(set_bool_)
+		,	set_integral(set_integral_)
+		,	set_floating_point(set_floating_point_)
+		,	set_string(set_string_)
+		,	set_null(set_null_)
+		,	start_struct(start_struct_)
+		,	end_struct(end_struct_)
+		,	start_array(start_array_)
+		,	end_array(end_array_)
+	{}
+
+	void parse(std::string_view data_)
+	{
+		current = data_.data();
+		end = current + data_.size();
+
+		wait("{");
+		start_struct("");
+		parse_struct();
+	}
+
+private:
+	std::string get_string()
+	{
+		std::string result;
+
+		for (;;)
+		{
+			const char* const stop = find_quote_or_backslash(current);
+
+			if (stop == end)
+			{
+				break;
+			}
+
+			if (*stop == '\"')
+			{
+				result.append(current, stop);
+				current = stop + 1;
+				return result;
+			}
+
+			// An escape sequence is kept as is, but doesn't end the string.
+			if (end - stop < 2)
+			{
+				break;
+			}
+
+			result.append(current, stop + 2);
+			current = stop + 2;
+		}
+
+		throw StructMappingException("parser: unexpected end of data");
+	}
+
+	const char* find_quote_or_backslash(const char* p) const
+	{
+		return detail::find_quote_or_backslash(p, end);
+	}
+
+	void skip_whitespace()
+	{
+#if defined(__SSE2__)
+		const __m128i space = _mm_set1_epi8(' ');
+		const __m128i tab = _mm_set1_epi8('\t');
+		const __m128i carriage_return = _mm_set1_epi8('\r');
+		const __m128i new_line = _mm_set1_epi8('\n');
+
+		while (end - current >= 16)
+		{
+			const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(current));
+			const __m128i is_new_line = _mm_cmpeq_epi8(chunk, new_line);
+			const __m128i is_whitespace = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+				_mm_or_si128(_mm_cmpeq_epi8(chunk, carriage_return), is_new_line));
+			const unsigned other = ~static_cast<unsigned>(_mm_movemask_epi8(is_whitespace)) & 0xffff;
+			const unsigned new_lines = static_cast<unsigned>(_mm_movemask_epi8(is_new_line));
+
+			if (other != 0)
+			{
+				const int count = std::countr_zero(other);
+				line_number += std::popcount(new_lines & ((1u << count) - 1));
+				current += count;
+				return;
+			}
+
+			line_number += std::popcount(new_lines);
+			current += 16;
+		}
+#endif
+
+		for (; current != end; ++current)
+		{
+			if (is_new_line_char(*current))
+			{
+				++line_number;
+			}
+			else if (!is_empty_char(*current))
+			{
+				return;
+			}
+		}
+	}
+
+	bool is_empty_char(char ch) const
+	{
+		return ch == ' ' || ch == '\t' || ch == '\r';
+	}
+
+	bool is_new_line_char(char ch) const
+	{
+		return ch == '\n';
+	}
+
+	void parse_array()
+	{
+		constexpr const char* EXPECTED_AFTER_START = "]{[\"tf-.0123456789n";
+		constexpr const char* EXPECTED_AFTER_VALUE = "]{[\"tf,-.0123456789n";
+		constexpr const char* EXPECTED_AFTER_COMMA = "{[\"tf-.0123456789n";
+		const char* expected_characters = EXPECTED_AFTER_START;
+
+		for (;;)
+		{
+			const char ch = wait(expected_characters);
+
+			if (ch == ']')
+			{
+				end_array();
+				return;
+			}
+
+			if (ch == ',')
+			{
+				expected_characters = EXPECTED_AFTER_COMMA;
+			}
+			else
+			{
+				parse_value(EMPTY_NAME, ch);
+				expected_characters = EXPECTED_AFTER_VALUE;
+			}
+		}
+	}
+
+	void parse_struct()
+	{
+		constexpr const char* EXPECTED_AFTER_START = "\"}";
+		constexpr const char* EXPECTED_AFTER_VALUE = ",}";
+		constexpr const char* EXPECTED_AFTER_COMMA = "\"";
+		const char* expected_characters = EXPECTED_AFTER_START;
+
+		for (;;)
+		{
+			const char ch = wait(expected_characters);
+
+			if (ch == '}')
+			{
+				end_struct();
+				return;
+			}
+
+			if (ch == ',')
+			{
+				expected_characters = EXPECTED_AFTER_COMMA;
+			}
+			else
+			{
+				const auto name = get_string();
+
+				wait(":");
+				parse_value(name, wait("\"{[tf-0123456789n"));
+				expected_characters = EXPECTED_AFTER_VALUE;
+			}
+		}
+	}
+
+	void parse_value(const std::string& name, char start_ch)
+	{
+		if (start_ch == '{')
+		{
+			start_struct(name);
+			parse_struct();
+		}
+		else if (start_ch == '[')
+		{
+			start_array(name);
+			parse_array();
+		}
+		else if (start_ch == 't')
+		{
+			wait_literal("rue");
+			set_bool(name, true);
+		}
+		else if (start_ch == 'f')
+		{
+			wait_literal("alse");
+			set_bool(name, false);
+		}
+		else if (start_ch == 'n')
+		{
+			wait_literal("ull");
+			set_null(name);
+		}
+		else if (start_ch == '\"')
+		{
+			set_string(name, get_string());
+		}
+		else
+		{
+			set_number(name);
+		}
+	}
+
+	void set_number(const std::string& name)
+	{
+		// The first character of the number is consumed by wait() already.
+		const char* const begin = current - 1;
+		bool is_floating_point_number = *begin == '.';
+
+		while (current != end && *current != '\0' && std::strchr(".0123456789eE+-", *current) != nullptr)
+		{
+			if (*current == '.')
+			{
+				is_floating_point_number = true;
+			}
+
+			++current;
+		}
+
+		const std::string_view value(begin, static_cast<std::size_t>(current - begin));
+		wait("}],");
+		--current; // the terminator is handled by the caller
+
+		std::errc error;
+
+		if (is_floating_point_number)
+		{
+			double number{};
+			error = std::from_chars(value.data(), value.data() + value.size(), number).ec;
+
+			if (error == std::errc{})
+			{
+				set_floating_point(name, number);
+			}
+		}
+		else
+		{
+			long long number{};
+			error = std::from_chars(value.data(), value.data() + value.size(), number).ec;
+
+			if (error == std::errc{})
+			{
+				set_integral(name, number);
+			}
+		}
+
+		if (error != std::errc{})
+		{
+			throw StructMappingException(
+				std::string("parser: bad number [") + std::string(value) + std::string("] at line ") + std::to_string(line_number));
+		}
+	}
+
+	void wait_literal(const char* rest)
+	{
+		for (; *rest; ++rest)
+		{
+			const char expected[] = {*rest, '\0'};
+			wait(expected);
+		}
+	}
+
+	char wait(char const* characters)
+	{
+		skip_whitespace();
+
+		if (current == end)
+		{
+			throw StructMappingException("parser: unexpected end of data");
+		}
+
+		const char test_ch = *current++;
+
+		if (test_ch == '\0' || std::strchr(characters, test_ch) == nullptr)
+		{
+			throw StructMappingException(
+				std::string("parser: unexpected character '")
+					+ std::string(1, test_ch)
+					+ std::string("' at line ")
+					+ std::to_string(line_number));
+		}
+
+		return test_ch;
+	}
+
+private:
+	inline static const std::string EMPTY_NAME;
+
+	SetBool set_bool;
+	SetIntegral set_integral;
+	SetFloatingPoint set_floating_point;
+	SetString set_string;
+	SetNull set_null;
+	StartStruct start_struct;
+	EndStruct end_struct;
+	StartArray start_array;
+	EndArray end_array;
+
+	const char* current = nullptr;
+	const char* end = nullptr;
+	size_t line_number = 1;
+};
+
+} // struct_mapping::detail
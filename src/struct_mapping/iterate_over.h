@@ -19,14 +19,16 @@ public:
 	using EndArray = void();
 
 public:
+	// Set by map_struct_to_json for the current thread only, so that structs
+	// may be written by several threads at once.
 	template<typename T>
-	static inline std::function<Set<T>> set;
+	static inline thread_local std::function<Set<T>> set;
 	
-	static inline std::function<SetNull> set_null;
-	static inline std::function<StartStruct> start_struct;
-	static inline std::function<EndStruct> end_struct;
-	static inline std::function<StartArray> start_array;
-	static inline std::function<EndArray> end_array;
+	static inline thread_local std::function<SetNull> set_null;
+	static inline thread_local std::function<StartStruct> start_struct;
+	static inline thread_local std::function<EndStruct> end_struct;
+	static inline thread_local std::function<StartArray> start_array;
+	static inline thread_local std::function<EndArray> end_array;
 };
 
 } // struct_mapping::detail
\ No newline at end of file
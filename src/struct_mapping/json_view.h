@@ -0,0 +1,435 @@
+#pragma once
+
+#include "buffer_parser.h"
+#include "exception.h"
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace struct_mapping
+{
+
+enum class JsonKind
+{
+	Null,
+	Bool,
+	Number,
+	String,
+	Array,
+	Object
+};
+
+// A lazy view of a JSON value in a buffer, such as the text of a jsonb value.
+// Nothing is parsed up front: finding a member or an element skips over the
+// values before it without materializing them, the strings by the same SIMD
+// scan as BufferParser, so pulling a few keys out of a large document costs
+// a scan rather than a parse. The buffer must outlive the view. A malformed
+// document throws StructMappingException as far as it is read.
+class JsonView
+{
+public:
+	JsonView() = default;
+
+	explicit JsonView(std::string_view json_)
+		:	json(trim(json_))
+	{
+		if (json.empty())
+		{
+			throw StructMappingException("json view: empty value");
+		}
+	}
+
+	JsonKind kind() const
+	{
+		// A default view holds no value.
+		if (json.empty())
+		{
+			return JsonKind::Null;
+		}
+
+		switch (json.front())
+		{
+		case 'n': return JsonKind::Null;
+		case 't':
+		case 'f': return JsonKind::Bool;
+		case '\"': return JsonKind::String;
+		case '[': return JsonKind::Array;
+		case '{': return JsonKind::Object;
+		default: return JsonKind::Number;
+		}
+	}
+
+	// The JSON text of the value.
+	std::string_view raw() const
+	{
+		return json;
+	}
+
+	// The value of the member name of an object.
+	std::optional<JsonView> find(std::string_view name) const
+	{
+		if (kind() != JsonKind::Object)
+		{
+			return std::nullopt;
+		}
+
+		const char* p = json.data() + 1;
+		const char* const end = json.data() + json.size();
+		std::string unescaped;
+
+		for (p = skip_whitespace(p, end); p != end && *p != '}'; p = skip_separator(p, end, '}'))
+		{
+			if (*p != '\"')
+			{
+				throw StructMappingException("json view: bad member name");
+			}
+
+			const char* const key_end = skip_string(p, end);
+			const std::string_view key(p + 1, static_cast<std::size_t>(key_end - p - 2));
+			const bool is_match = key.find('\\') == std::string_view::npos ? key == name : unescape(key, unescaped) == name;
+
+			p = skip_whitespace(key_end, end);
+
+			if (p == end || *p != ':')
+			{
+				throw StructMappingException("json view: expected ':' after \"" + std::string(key) + "\"");
+			}
+
+			p = skip_whitespace(p + 1, end);
+			const char* const value_end = skip_value(p, end);
+
+			if (is_match)
+			{
+				return JsonView(p, value_end);
+			}
+
+			p = value_end;
+		}
+
+		return std::nullopt;
+	}
+
+	// The value of a path of member names separated by dots ("a.b.c").
+	std::optional<JsonView> find_path(std::string_view path) const
+	{
+		std::optional<JsonView> result = *this;
+
+		for (std::size_t begin = 0; result;)
+		{
+			const auto end = path.find('.', begin);
+			result = result->find(path.substr(begin, end - begin));
+
+			if (end == std::string_view::npos)
+			{
+				break;
+			}
+
+			begin = end + 1;
+		}
+
+		return result;
+	}
+
+	// The element index of an array.
+	std::optional<JsonView> at(std::size_t index) const
+	{
+		if (kind() != JsonKind::Array)
+		{
+			return std::nullopt;
+		}
+
+		const char* p = json.data() + 1;
+		const char* const end = json.data() + json.size();
+
+		for (p = skip_whitespace(p, end); p != end && *p != ']'; p = skip_separator(p, end, ']'))
+		{
+			const char* const value_end = skip_value(p, end);
+
+			if (index-- == 0)
+			{
+				return JsonView(p, value_end);
+			}
+
+			p = value_end;
+		}
+
+		return std::nullopt;
+	}
+
+	bool is_null() const
+	{
+		return kind() == JsonKind::Null;
+	}
+
+	bool as_bool() const
+	{
+		if (json == "true")
+		{
+			return true;
+		}
+		else if (json == "false")
+		{
+			return false;
+		}
+
+		throw StructMappingException("json view: not a bool: " + std::string(json));
+	}
+
+	long long as_integral() const
+	{
+		return as_number<long long>();
+	}
+
+	double as_floating_point() const
+	{
+		return as_number<double>();
+	}
+
+	// The contents of the string with the escape sequences decoded.
+	std::string as_string() const
+	{
+		if (kind() != JsonKind::String)
+		{
+			throw StructMappingException("json view: not a string: " + std::string(json));
+		}
+
+		std::string result;
+		unescape(json.substr(1, json.size() - 2), result);
+
+		return result;
+	}
+
+private:
+	JsonView(const char* begin, const char* end)
+		:	json(begin, static_cast<std::size_t>(end - begin))
+	{}
+
+	template<typename T>
+	T as_number() const
+	{
+		T result{};
+		const auto [ptr, ec] = std::from_chars(json.data(), json.data() + json.size(), result);
+
+		if (ec != std::errc{} || ptr != json.data() + json.size())
+		{
+			throw StructMappingException("json view: bad number: " + std::string(json));
+		}
+
+		return result;
+	}
+
+	static std::string_view trim(std::string_view value)
+	{
+		const char* const end = value.data() + value.size();
+		const char* const begin = skip_whitespace(value.data(), end);
+		const char* last = end;
+
+		while (last != begin && is_whitespace(last[-1]))
+		{
+			--last;
+		}
+
+		return std::string_view(begin, static_cast<std::size_t>(last - begin));
+	}
+
+	static bool is_whitespace(char ch)
+	{
+		return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+	}
+
+	static const char* skip_whitespace(const char* p, const char* end)
+	{
+		while (p != end && is_whitespace(*p))
+		{
+			++p;
+		}
+
+		return p;
+	}
+
+	// Skips the ',' to the next member or element, or stops at close.
+	static const char* skip_separator(const char* p, const char* end, char close)
+	{
+		p = skip_whitespace(p, end);
+
+		if (p != end && *p == ',')
+		{
+			return skip_whitespace(p + 1, end);
+		}
+		else if (p == end || *p != close)
+		{
+			throw StructMappingException("json view: expected ',' or '" + std::string(1, close) + "'");
+		}
+
+		return p;
+	}
+
+	// Skips the string starting at the quote p, including the closing quote.
+	static const char* skip_string(const char* p, const char* end)
+	{
+		for (++p;;)
+		{
+			p = detail::find_quote_or_backslash(p, end);
+
+			if (p == end || (*p == '\\' && end - p < 2))
+			{
+				throw StructMappingException("json view: unexpected end of data");
+			}
+			else if (*p == '\"')
+			{
+				return p + 1;
+			}
+
+			p += 2;
+		}
+	}
+
+	static const char* skip_value(const char* p, const char* end)
+	{
+		if (p == end)
+		{
+			throw StructMappingException("json view: unexpected end of data");
+		}
+		else if (*p == '\"')
+		{
+			return skip_string(p, end);
+		}
+		else if (*p != '{' && *p != '[')
+		{
+			while (p != end && !is_whitespace(*p) && *p != ',' && *p != '}' && *p != ']')
+			{
+				++p;
+			}
+
+			return p;
+		}
+
+		// The brackets are only counted: the strings within are what could
+		// hold one that doesn't count.
+		for (std::size_t depth = 0; p != end;)
+		{
+			switch (*p)
+			{
+			case '\"':
+				p = skip_string(p, end);
+				continue;
+			case '{':
+			case '[':
+				++depth;
+				break;
+			case '}':
+			case ']':
+				if (--depth == 0)
+				{
+					return p + 1;
+				}
+				break;
+			}
+
+			++p;
+		}
+
+		throw StructMappingException("json view: unexpected end of data");
+	}
+
+	static unsigned hex4(const char* p, const char* end)
+	{
+		unsigned result = 0;
+
+		if (end - p < 4 || std::from_chars(p, p + 4, result, 16).ptr != p + 4)
+		{
+			throw StructMappingException("json view: bad \\u escape");
+		}
+
+		return result;
+	}
+
+	static void append_utf8(std::string& out, std::uint32_t code)
+	{
+		if (code < 0x80)
+		{
+			out += static_cast<char>(code);
+		}
+		else if (code < 0x800)
+		{
+			out += static_cast<char>(0xc0 | (code >> 6));
+			out += static_cast<char>(0x80 | (code & 0x3f));
+		}
+		else if (code < 0x10000)
+		{
+			out += static_cast<char>(0xe0 | (code >> 12));
+			out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+			out += static_cast<char>(0x80 | (code & 0x3f));
+		}
+		else
+		{
+			out += static_cast<char>(0xf0 | (code >> 18));
+			out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+			out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+			out += static_cast<char>(0x80 | (code & 0x3f));
+		}
+	}
+
+	// Decodes the contents of a string into out, which is returned.
+	static const std::string& unescape(std::string_view value, std::string& out)
+	{
+		out.clear();
+		const char* p = value.data();
+		const char* const end = p + value.size();
+
+		for (;;)
+		{
+			const char* const stop = detail::find_quote_or_backslash(p, end);
+			out.append(p, stop);
+
+			if (stop == end)
+			{
+				return out;
+			}
+			else if (end - stop < 2)
+			{
+				throw StructMappingException("json view: bad escape");
+			}
+
+			p = stop + 2;
+
+			switch (stop[1])
+			{
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+			{
+				std::uint32_t code = hex4(p, end);
+				p += 4;
+
+				if (code >= 0xd800 && code < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+				{
+					const std::uint32_t low = hex4(p + 2, end);
+
+					if (low >= 0xdc00 && low < 0xe000)
+					{
+						code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+						p += 6;
+					}
+				}
+
+				append_utf8(out, code);
+				break;
+			}
+			default: out += stop[1];
+			}
+		}
+	}
+
+	std::string_view json = "null";
+};
+
+} // struct_mapping
@@ -5,6 +5,7 @@
 #include "object.h"
 #include "object_array_like.h"
 #include "object_map_like.h"
+#include "buffer_parser.h"
 #include "parser.h"
 #include "reset.h"
 #include "utility.h"
@@ -12,12 +13,16 @@
 #include <istream>
 #include <ostream>
 #include <string>
+#include <string_view>
 
 namespace struct_mapping
 {
 
-template<typename T>
-inline void map_json_to_struct(T& result_struct, std::basic_istream<char>& json_data)
+namespace detail
+{
+
+template<typename T, typename Parse>
+inline void map_json_to_struct(T& result_struct, Parse parse)
 {
 	detail::Reset::reset();
 
@@ -125,7 +130,7 @@ inline void map_json_to_struct(T& result_struct, std::basic_istream<char>& json_
 		detail::Object<T>::release(result_struct);
 	};
 
-	detail::Parser parser(
+	parse(
 		set_bool,
 		set_integral,
 		set_floating_point,
@@ -135,8 +140,30 @@ inline void map_json_to_struct(T& result_struct, std::basic_istream<char>& json_
 		end_struct,
 		start_array,
 		end_array);
-	
-	parser.parse(json_data);
+}
+
+} // detail
+
+template<typename T>
+inline void map_json_to_struct(T& result_struct, std::basic_istream<char>& json_data)
+{
+	detail::map_json_to_struct(result_struct, [&json_data] (auto& ... callbacks)
+	{
+		detail::Parser parser(callbacks...);
+		parser.parse(json_data);
+	});
+}
+
+// The JSON is in memory as a whole, so it's parsed by BufferParser, which is
+// much faster on large documents.
+template<typename T>
+inline void map_json_to_struct(T& result_struct, std::string_view json_data)
+{
+	detail::map_json_to_struct(result_struct, [json_data] (auto& ... callbacks)
+	{
+		detail::BufferParser parser(callbacks...);
+		parser.parse(json_data);
+	});
 }
 
 template<typename T>
@@ -46,7 +46,7 @@ public:
 		typename ... U,
 		template<typename> typename ... Options>
 	Member(const std::string& name_, MemberPtr<T, V> ptr_, Options<U>&& ... options)
-		:	name(name_), type(get_member_type<remove_optional_t<V>>())
+		:	index(static_cast<Index>(ObjectType::members.size())), name(name_), type(get_member_type<remove_optional_t<V>>())
 	{
 		is_optional = is_optional_v<V>;
 		ptr_index = static_cast<Index>(ObjectType::template members_ptr<V>.size());
@@ -119,11 +119,6 @@ public:
 		return Type::Complex;
 	}
 
-	void init()
-	{
-		changed = false;
-	}
-
 	void iterate_over(T& o)
 	{
 		switch (type)
@@ -199,14 +194,14 @@ public:
 		process_required();
 		process_default(o);
 		process_not_empty(o);
-		changed = false;
+		ObjectType::members_changed[index] = false;
 	}
 
 public:
 	Index bounds_index = NO_INDEX;
-	bool changed = false;
 	Index default_index = NO_INDEX;
 	Index deep_index;
+	Index index;
 	bool is_optional;
 	Index member_string_index = NO_INDEX;
 	std::string name;
@@ -331,7 +326,7 @@ private:
 
 	void process_default(T& o)
 	{
-		if (!changed)
+		if (!ObjectType::members_changed[index])
 		{
 			switch (type)
 			{
@@ -403,7 +398,7 @@ private:
 	{
 		if (option_required)
 		{
-			Required<>::check_result(changed, name);
+			Required<>::check_result(ObjectType::members_changed[index], name);
 		}
 	}
 
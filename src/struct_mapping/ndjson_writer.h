@@ -0,0 +1,307 @@
+#pragma once
+
+#include "static_mapper.h"
+#include "utility.h"
+
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace struct_mapping
+{
+
+namespace detail
+{
+
+constexpr std::size_t json_escaped_size(std::string_view value)
+{
+	std::size_t result = 0;
+
+	for (const char ch : value)
+	{
+		const auto c = static_cast<unsigned char>(ch);
+		result += c == '\"' || c == '\\' ? 2 : c < 0x20 ? 6 : 1;
+	}
+
+	return result;
+}
+
+constexpr char* json_escape_char(char ch, char* out)
+{
+	constexpr const char hex[] = "0123456789abcdef";
+	const auto c = static_cast<unsigned char>(ch);
+
+	switch (c)
+	{
+	case '\"': *out++ = '\\'; *out++ = '\"'; break;
+	case '\\': *out++ = '\\'; *out++ = '\\'; break;
+	case '\b': *out++ = '\\'; *out++ = 'b'; break;
+	case '\f': *out++ = '\\'; *out++ = 'f'; break;
+	case '\n': *out++ = '\\'; *out++ = 'n'; break;
+	case '\r': *out++ = '\\'; *out++ = 'r'; break;
+	case '\t': *out++ = '\\'; *out++ = 't'; break;
+	default:
+		if (c < 0x20)
+		{
+			*out++ = '\\'; *out++ = 'u'; *out++ = '0'; *out++ = '0';
+			*out++ = hex[c >> 4]; *out++ = hex[c & 0x0f];
+		}
+		else
+		{
+			*out++ = ch;
+		}
+	}
+
+	return out;
+}
+
+// The key of a member as written after the previous one: `,"name":`, or
+// without the comma for the first member.
+template<
+	typename Member,
+	bool IsFirst>
+struct JsonKey
+{
+	static constexpr std::size_t size = json_escaped_size(Member::name) + (IsFirst ? 3 : 4);
+
+	static constexpr std::array<char, size> make()
+	{
+		std::array<char, size> result{};
+		char* out = result.data();
+
+		if (!IsFirst)
+		{
+			*out++ = ',';
+		}
+
+		*out++ = '\"';
+
+		for (const char ch : Member::name)
+		{
+			out = json_escape_char(ch, out);
+		}
+
+		*out++ = '\"';
+		*out++ = ':';
+
+		return result;
+	}
+
+	static constexpr std::array<char, size> value = make();
+};
+
+} // detail
+
+// Writes values as JSON into a buffer which is handed to the sink (a callable
+// taking std::string_view) whenever it exceeds flush_size, one line per
+// write() for NDJSON. The values are bools, numbers, strings, structs having
+// StaticStruct, std::vector and std::optional of these. The keys of the
+// members are escaped at compile time. The rest is not flushed on destruction:
+// call flush() when done.
+template<typename Sink>
+class NdjsonWriter
+{
+public:
+	explicit NdjsonWriter(Sink sink_, std::size_t flush_size_ = 1 << 20)
+		:	sink(std::move(sink_)), flush_size(flush_size_)
+	{
+		buffer.reserve(flush_size + flush_size / 4);
+	}
+
+	template<typename T>
+	void write(const T& value)
+	{
+		write_value(value);
+		buffer.push_back('\n');
+
+		if (buffer.size() >= flush_size)
+		{
+			flush();
+		}
+	}
+
+	template<typename Range>
+	void write_all(const Range& values)
+	{
+		for (const auto& value : values)
+		{
+			write(value);
+		}
+	}
+
+	void flush()
+	{
+		if (!buffer.empty())
+		{
+			sink(std::string_view(buffer));
+			buffer.clear();
+		}
+	}
+
+private:
+	template<typename T>
+	void write_value(const T& value)
+	{
+		if constexpr (std::is_same_v<T, bool>)
+		{
+			buffer.append(value ? "true" : "false");
+		}
+		else if constexpr (std::is_integral_v<T>)
+		{
+			write_chars(value);
+		}
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			if (std::isfinite(value))
+			{
+				write_chars(value);
+			}
+			else
+			{
+				buffer.append("null");
+			}
+		}
+		else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			write_string(value);
+		}
+		else if constexpr (detail::is_optional_v<T>)
+		{
+			if (value.has_value())
+			{
+				write_value(*value);
+			}
+			else
+			{
+				buffer.append("null");
+			}
+		}
+		else if constexpr (detail::is_vector_v<T>)
+		{
+			buffer.push_back('[');
+
+			for (std::size_t i = 0; i != value.size(); ++i)
+			{
+				if (i != 0)
+				{
+					buffer.push_back(',');
+				}
+
+				write_value(static_cast<const typename T::value_type&>(value[i]));
+			}
+
+			buffer.push_back(']');
+		}
+		else
+		{
+			static_assert(detail::is_static_struct_v<T>, "struct_mapping: the type cannot be written as JSON");
+
+			buffer.push_back('{');
+			write_members(value, std::make_index_sequence<std::tuple_size_v<typename StaticStruct<T>::Tuple>>{});
+			buffer.push_back('}');
+		}
+	}
+
+	template<
+		typename T,
+		std::size_t ... I>
+	void write_members(const T& value, std::index_sequence<I...>)
+	{
+		using Members = typename StaticStruct<T>::Tuple;
+
+		(write_member<std::tuple_element_t<I, Members>, I == 0>(value), ...);
+	}
+
+	template<
+		typename Member,
+		bool IsFirst,
+		typename T>
+	void write_member(const T& value)
+	{
+		const auto& key = detail::JsonKey<Member, IsFirst>::value;
+		buffer.append(key.data(), key.size());
+		write_value(value.*Member::ptr);
+	}
+
+	template<typename T>
+	void write_chars(T value)
+	{
+		constexpr std::size_t max_size = 32;
+		const std::size_t size = buffer.size();
+		buffer.resize(size + max_size);
+		const auto result = std::to_chars(buffer.data() + size, buffer.data() + size + max_size, value);
+		buffer.resize(static_cast<std::size_t>(result.ptr - buffer.data()));
+	}
+
+	void write_string(std::string_view value)
+	{
+		buffer.push_back('\"');
+
+		const char* p = value.data();
+		const char* const end = p + value.size();
+		const char* run = p;
+
+		for (;;)
+		{
+#if defined(__SSE2__)
+			// Finds the next `"`, `\` or control character 16 bytes at a time.
+			const __m128i quote = _mm_set1_epi8('\"');
+			const __m128i backslash = _mm_set1_epi8('\\');
+			const __m128i control = _mm_set1_epi8(0x1f);
+
+			for (; end - p >= 16; p += 16)
+			{
+				const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+				const __m128i is_special = _mm_or_si128(
+					_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+					_mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+				const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(is_special));
+
+				if (mask != 0)
+				{
+					p += std::countr_zero(mask);
+					break;
+				}
+			}
+#endif
+
+			while (p != end && static_cast<unsigned char>(*p) >= 0x20 && *p != '\"' && *p != '\\')
+			{
+				++p;
+			}
+
+			buffer.append(run, p);
+
+			if (p == end)
+			{
+				break;
+			}
+
+			char escaped[6];
+			buffer.append(escaped, detail::json_escape_char(*p, escaped));
+			run = ++p;
+		}
+
+		buffer.push_back('\"');
+	}
+
+private:
+	Sink sink;
+	std::size_t flush_size;
+	std::string buffer;
+};
+
+} // struct_mapping
@@ -31,6 +31,9 @@ public:
 	friend MemberType;
 
 public:
+	// Not thread safe: the members are to be registered before parsing starts.
+	// Afterwards the tables are only read, and the state of a parse is kept per
+	// thread, so any number of threads may map JSON at once.
 	template<
 		typename V,
 		typename ... U,
@@ -70,10 +73,7 @@ public:
 			}
 		}
 
-		for (auto& member : members)
-		{
-			member.init();
-		}
+		members_changed.assign(members.size(), false);
 	}
 
 	static void iterate_over(T& o, const std::string& name)
@@ -305,7 +305,7 @@ public:
 						|| (members[member_name_index].type == MemberType::Type::Complex
 							&& members[member_name_index].member_string_index != NO_INDEX))
 				{
-					members[member_name_index].changed = true;
+					members_changed[member_name_index] = true;
 					member_string_from_string[members[member_name_index].member_string_index](o, value);
 				}
 				else if (members[member_name_index].type != MemberType::Type::String)
@@ -345,7 +345,7 @@ public:
 
 				member_deep_index = members[member_name_index].deep_index;
 				functions.init[member_deep_index](o);
-				members[member_name_index].changed = true;
+				members_changed[member_name_index] = true;
 			}
 			else
 			{
@@ -417,7 +417,7 @@ private:
 			}
 		}
 
-		members[index].changed = true;
+		members_changed[index] = true;
 
 		if (members[index].is_optional)
 		{
@@ -434,7 +434,6 @@ private:
 
 	static inline std::vector<std::function<void(T&, const std::string&)>> member_string_from_string{};
 	static inline std::vector<std::function<std::optional<std::string> (T&)>> member_string_to_string{};
-	static inline Index member_deep_index = NO_INDEX;
 	static inline std::vector<MemberType> members;
 	
 	template<typename V>
@@ -447,6 +446,10 @@ private:
 	
 	template<typename V>
 	static inline std::vector<MemberPtr<T, V>> members_ptr{};
+
+	// The state of the current parse, one per thread.
+	static inline thread_local Index member_deep_index = NO_INDEX;
+	static inline thread_local std::vector<bool> members_changed;
 };
 
 } // struct_mapping::detail
\ No newline at end of file
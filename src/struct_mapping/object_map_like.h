@@ -273,8 +273,9 @@ private:
 	}
 
 private:
-	static inline Iterator last_inserted;
-	static inline bool used = false;
+	// The state of the current parse, one per thread.
+	static inline thread_local Iterator last_inserted;
+	static inline thread_local bool used = false;
 };
 
 } // struct_mapping::detail
\ No newline at end of file
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "exception.h"
+#include "static_mapper.h"
+#include "utility.h"
+
+#include "../include/src/pgfe/pgfe.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace struct_mapping
+{
+
+// The fields of a result which the members of StaticStruct<T> are mapped
+// from, found by name once per result rather than once per row. A member
+// without a field of its name is left as is. The fields are decoded by the
+// conversions of pgfe, so they may be in either format.
+template<typename T>
+class RowLayout
+{
+public:
+	using Members = typename StaticStruct<T>::Tuple;
+
+	static constexpr std::size_t count = std::tuple_size_v<Members>;
+
+public:
+	// Takes a pgfe::Row, pgfe::Row_info or pgfe::Row_batch.
+	template<typename Fields>
+	explicit RowLayout(const Fields& fields)
+	{
+		static_assert(detail::is_static_struct_v<T>, "struct_mapping: StaticStruct is not specialized for the type");
+
+		const std::size_t field_count = fields.field_count();
+
+		for (std::size_t i = 0; i != count; ++i)
+		{
+			const auto index = fields.field_index(StaticStruct<T>::names[i]);
+			indices[i] = index < field_count ? index : NO_FIELD;
+		}
+	}
+
+	void map(const dmitigr::pgfe::Row& row, T& result) const
+	{
+		map(result, [&row] (std::size_t index) { return row.data(index); }, std::make_index_sequence<count>{});
+	}
+
+	void map(const dmitigr::pgfe::Row_batch& batch, std::size_t row, T& result) const
+	{
+		map(result, [&batch, row] (std::size_t index) { return batch.data(row, index); }, std::make_index_sequence<count>{});
+	}
+
+private:
+	static constexpr std::size_t NO_FIELD = static_cast<std::size_t>(-1);
+
+	template<
+		typename Data,
+		std::size_t ... I>
+	void map(T& result, const Data& data, std::index_sequence<I...>) const
+	{
+		(map_member<I>(result, data), ...);
+	}
+
+	template<
+		std::size_t I,
+		typename Data>
+	void map_member(T& result, const Data& data) const
+	{
+		using Member = std::tuple_element_t<I, Members>;
+		using V = std::remove_reference_t<decltype(result.*Member::ptr)>;
+
+		if (indices[I] == NO_FIELD)
+		{
+			return;
+		}
+
+		const auto value = data(indices[I]);
+
+		if constexpr (detail::is_optional_v<V>)
+		{
+			result.*Member::ptr = value ? V{dmitigr::pgfe::to<detail::remove_optional_t<V>>(value)} : V{};
+		}
+		else
+		{
+			if (!value)
+			{
+				throw StructMappingException("null value for member: " + std::string(Member::name));
+			}
+
+			result.*Member::ptr = dmitigr::pgfe::to<V>(value);
+		}
+	}
+
+private:
+	std::array<std::size_t, count> indices{};
+};
+
+template<typename T>
+inline T map_row_to_struct(const dmitigr::pgfe::Row& row)
+{
+	T result{};
+	RowLayout<T>(row).map(row, result);
+
+	return result;
+}
+
+// Appends the rows of batch to result.
+template<typename T>
+inline void map_rows_to_structs(const dmitigr::pgfe::Row_batch& batch, std::vector<T>& result)
+{
+	const RowLayout<T> layout(batch);
+	result.reserve(result.size() + batch.size());
+
+	for (std::size_t row = 0; row != batch.size(); ++row)
+	{
+		layout.map(batch, row, result.emplace_back());
+	}
+}
+
+// Maps the first rows of batch onto result, returning the number of them.
+template<typename T>
+inline std::size_t map_rows_to_structs(const dmitigr::pgfe::Row_batch& batch, std::span<T> result)
+{
+	const RowLayout<T> layout(batch);
+	const std::size_t size = std::min(batch.size(), result.size());
+
+	for (std::size_t row = 0; row != size; ++row)
+	{
+		layout.map(batch, row, result[row]);
+	}
+
+	return size;
+}
+
+} // struct_mapping
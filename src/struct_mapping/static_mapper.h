@@ -0,0 +1,509 @@
+#pragma once
+
+#include "buffer_parser.h"
+#include "exception.h"
+#include "utility.h"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace struct_mapping
+{
+
+// The compile-time alternative to reg(): the members of a struct are listed
+// as template parameters of a specialization of StaticStruct, e.g.
+//
+//   template<>
+//   struct struct_mapping::StaticStruct<Person> : struct_mapping::StaticMembers<
+//     struct_mapping::StaticMember<"name", &Person::name>,
+//     struct_mapping::StaticMember<"friends", &Person::friends>> {};
+//
+// and map_json_to_static_struct() dispatches the events of the parser through
+// a table of function pointers generated per type, finding a member by a
+// perfect hash of its name. The members are bools, numbers, strings,
+// structs having StaticStruct, std::vector of any of these, or std::optional
+// of any of these. The options of reg() are not supported.
+
+template<std::size_t N>
+struct FixedString
+{
+	constexpr FixedString(const char (&value_)[N])
+	{
+		for (std::size_t i = 0; i != N; ++i)
+		{
+			value[i] = value_[i];
+		}
+	}
+
+	constexpr std::string_view view() const
+	{
+		return {value, N - 1};
+	}
+
+	char value[N]{};
+};
+
+template<
+	FixedString Name,
+	auto Ptr>
+struct StaticMember
+{
+	static constexpr std::string_view name = Name.view();
+	static constexpr auto ptr = Ptr;
+};
+
+template<typename ... Members>
+struct StaticMembers
+{
+	using Tuple = std::tuple<Members...>;
+
+	static constexpr std::array<std::string_view, sizeof...(Members)> names{Members::name...};
+};
+
+template<typename T>
+struct StaticStruct
+{};
+
+namespace detail
+{
+
+template<
+	typename,
+	typename = std::void_t<>>
+struct is_static_struct : std::false_type{};
+
+template<typename T>
+struct is_static_struct<T, std::void_t<typename StaticStruct<T>::Tuple>> : std::true_type{};
+
+template<typename T>
+constexpr bool is_static_struct_v = is_static_struct<T>::value;
+
+template<typename>
+struct is_vector : std::false_type{};
+
+template<typename T>
+struct is_vector<std::vector<T>> : std::true_type{};
+
+template<typename T>
+constexpr bool is_vector_v = is_vector<T>::value;
+
+constexpr std::uint32_t static_hash(std::string_view name, std::uint32_t seed)
+{
+	std::uint32_t result = 2166136261u ^ seed;
+
+	for (const char ch : name)
+	{
+		result = (result ^ static_cast<unsigned char>(ch)) * 16777619u;
+	}
+
+	return result;
+}
+
+// A collision-free table of the indices of the names: with the square of the
+// number of names as its size, a few seeds are tried on average.
+template<std::size_t N>
+struct StaticNameIndex
+{
+	static constexpr std::size_t size = std::bit_ceil(N * N + 1);
+
+	constexpr StaticNameIndex(const std::array<std::string_view, N>& names_)
+		:	names(names_)
+	{
+		for (std::size_t i = 0; i != N; ++i)
+		{
+			for (std::size_t j = i + 1; j != N; ++j)
+			{
+				if (names[i] == names[j])
+				{
+					throw StructMappingException("static struct: duplicate member name");
+				}
+			}
+		}
+
+		for (;; ++seed)
+		{
+			slots = {};
+			bool is_collision_free = true;
+
+			for (std::size_t i = 0; i != N && is_collision_free; ++i)
+			{
+				auto& slot = slots[static_hash(names[i], seed) & (size - 1)];
+				is_collision_free = slot == 0;
+				slot = static_cast<Slot>(i + 1);
+			}
+
+			if (is_collision_free)
+			{
+				return;
+			}
+		}
+	}
+
+	// Returns N if there is no such name.
+	constexpr std::size_t find(std::string_view name) const
+	{
+		const auto slot = slots[static_hash(name, seed) & (size - 1)];
+
+		return slot != 0 && names[slot - 1] == name ? slot - 1 : N;
+	}
+
+	using Slot = std::conditional_t<(N < 255), std::uint8_t, std::uint16_t>;
+
+	std::array<std::string_view, N> names;
+	std::uint32_t seed = 0;
+	std::array<Slot, size> slots{};
+};
+
+struct StaticFrameOps;
+
+struct StaticFrame
+{
+	void* object;
+	const StaticFrameOps* ops;
+};
+
+struct StaticFrameOps
+{
+	void (*set_bool)(void*, const std::string&, bool);
+	void (*set_integral)(void*, const std::string&, long long);
+	void (*set_floating_point)(void*, const std::string&, double);
+	void (*set_string)(void*, const std::string&, const std::string&);
+	void (*set_null)(void*, const std::string&);
+	StaticFrame (*start)(void*, const std::string&, bool);
+};
+
+// The frame of an unknown member, whose contents are ignored.
+inline constexpr StaticFrameOps static_skip_ops{
+	[] (void*, const std::string&, bool) {},
+	[] (void*, const std::string&, long long) {},
+	[] (void*, const std::string&, double) {},
+	[] (void*, const std::string&, const std::string&) {},
+	[] (void*, const std::string&) {},
+	[] (void*, const std::string&, bool) { return StaticFrame{nullptr, &static_skip_ops}; }};
+
+template<typename V>
+struct StaticValue
+{
+	using Type = remove_optional_t<V>;
+
+	static Type& value(V& m)
+	{
+		if constexpr (is_optional_v<V>)
+		{
+			return m.has_value() ? *m : m.emplace();
+		}
+		else
+		{
+			return m;
+		}
+	}
+
+	static void set_bool(V& m, const std::string& name, bool value_)
+	{
+		if constexpr (std::is_same_v<Type, bool>)
+		{
+			value(m) = value_;
+		}
+		else
+		{
+			throw StructMappingException("bad type (bool) for member: " + name);
+		}
+	}
+
+	static void set_integral(V& m, const std::string& name, long long value_)
+	{
+		if constexpr (is_integer_v<Type>)
+		{
+			if (!std::in_range<Type>(value_))
+			{
+				throw_out_of_limits(name, std::to_string(value_));
+			}
+
+			value(m) = static_cast<Type>(value_);
+		}
+		else if constexpr (std::is_floating_point_v<Type>)
+		{
+			value(m) = static_cast<Type>(value_);
+		}
+		else
+		{
+			throw StructMappingException("bad type (integral) for member: " + name);
+		}
+	}
+
+	static void set_floating_point(V& m, const std::string& name, double value_)
+	{
+		if constexpr (std::is_floating_point_v<Type>)
+		{
+			if (!in_limits<Type>(value_))
+			{
+				throw_out_of_limits(name, std::to_string(value_));
+			}
+
+			value(m) = static_cast<Type>(value_);
+		}
+		else
+		{
+			throw StructMappingException("bad set type (floating point) for member: " + name);
+		}
+	}
+
+	static void set_string(V& m, const std::string& name, const std::string& value_)
+	{
+		if constexpr (std::is_same_v<Type, std::string>)
+		{
+			value(m) = value_;
+		}
+		else
+		{
+			throw StructMappingException("bad type (string) for member: " + name);
+		}
+	}
+
+	static void set_null(V& m, const std::string&)
+	{
+		if constexpr (is_optional_v<V>)
+		{
+			m.reset();
+		}
+	}
+
+	static StaticFrame start(V& m, const std::string& name, bool is_array);
+
+	[[noreturn]] static void throw_out_of_limits(const std::string& name, const std::string& value_)
+	{
+		throw StructMappingException(
+			"bad value for '"
+				+ name
+				+ "': "
+				+ value_
+				+ " is out of limits of type ["
+				+	std::to_string(std::numeric_limits<Type>::lowest())
+				+ " : "
+				+	std::to_string(std::numeric_limits<Type>::max())
+				+ "]");
+	}
+};
+
+template<typename T>
+struct StaticStructOps
+{
+	using Members = typename StaticStruct<T>::Tuple;
+
+	static constexpr std::size_t count = std::tuple_size_v<Members>;
+	static constexpr StaticNameIndex<count> name_index{StaticStruct<T>::names};
+
+	// Calls f with the member named name, if any.
+	template<typename F>
+	static bool visit(void* o, const std::string& name, F&& f)
+	{
+		return visit(*static_cast<T*>(o), name_index.find(name), f, std::make_index_sequence<count>{});
+	}
+
+	template<
+		typename F,
+		std::size_t ... I>
+	static bool visit(T& o, std::size_t index, F& f, std::index_sequence<I...>)
+	{
+		return ((index == I ? (f(o.*std::tuple_element_t<I, Members>::ptr), true) : false) || ...);
+	}
+
+	static constexpr StaticFrameOps ops{
+		[] (void* o, const std::string& name, bool value_)
+		{
+			visit(o, name, [&] (auto& m) { StaticValue<std::remove_reference_t<decltype(m)>>::set_bool(m, name, value_); });
+		},
+		[] (void* o, const std::string& name, long long value_)
+		{
+			visit(o, name, [&] (auto& m) { StaticValue<std::remove_reference_t<decltype(m)>>::set_integral(m, name, value_); });
+		},
+		[] (void* o, const std::string& name, double value_)
+		{
+			visit(o, name, [&] (auto& m) { StaticValue<std::remove_reference_t<decltype(m)>>::set_floating_point(m, name, value_); });
+		},
+		[] (void* o, const std::string& name, const std::string& value_)
+		{
+			visit(o, name, [&] (auto& m) { StaticValue<std::remove_reference_t<decltype(m)>>::set_string(m, name, value_); });
+		},
+		[] (void* o, const std::string& name)
+		{
+			visit(o, name, [&] (auto& m) { StaticValue<std::remove_reference_t<decltype(m)>>::set_null(m, name); });
+		},
+		[] (void* o, const std::string& name, bool is_array)
+		{
+			StaticFrame result{nullptr, &static_skip_ops};
+			visit(o, name, [&] (auto& m) { result = StaticValue<std::remove_reference_t<decltype(m)>>::start(m, name, is_array); });
+
+			return result;
+		}};
+};
+
+template<typename V>
+struct StaticVectorOps
+{
+	using Element = typename V::value_type;
+
+	template<typename F>
+	static void push(void* o, F&& f)
+	{
+		auto& elements = *static_cast<V*>(o);
+		Element element{};
+		f(element);
+		elements.push_back(std::move(element));
+	}
+
+	static constexpr StaticFrameOps ops{
+		[] (void* o, const std::string& name, bool value_)
+		{
+			push(o, [&] (Element& e) { StaticValue<Element>::set_bool(e, name, value_); });
+		},
+		[] (void* o, const std::string& name, long long value_)
+		{
+			push(o, [&] (Element& e) { StaticValue<Element>::set_integral(e, name, value_); });
+		},
+		[] (void* o, const std::string& name, double value_)
+		{
+			push(o, [&] (Element& e) { StaticValue<Element>::set_floating_point(e, name, value_); });
+		},
+		[] (void* o, const std::string& name, const std::string& value_)
+		{
+			push(o, [&] (Element& e) { StaticValue<Element>::set_string(e, name, value_); });
+		},
+		[] (void* o, const std::string& name)
+		{
+			push(o, [&] (Element& e) { StaticValue<Element>::set_null(e, name); });
+		},
+		[] (void* o, const std::string& name, bool is_array) -> StaticFrame
+		{
+			using Type = remove_optional_t<Element>;
+
+			if constexpr (is_static_struct_v<Type> || is_vector_v<Type>)
+			{
+				// The element stays in place until the frame of it ends.
+				auto& element = static_cast<V*>(o)->emplace_back();
+
+				return StaticValue<Element>::start(element, name, is_array);
+			}
+			else
+			{
+				throw StructMappingException(
+					std::string("bad type (") + (is_array ? "array" : "struct") + ") for member: " + name);
+			}
+		}};
+};
+
+template<typename V>
+StaticFrame StaticValue<V>::start(V& m, const std::string& name, bool is_array)
+{
+	if constexpr (is_static_struct_v<Type>)
+	{
+		if (!is_array)
+		{
+			return StaticFrame{&value(m), &StaticStructOps<Type>::ops};
+		}
+	}
+	else if constexpr (is_vector_v<Type>)
+	{
+		if (is_array)
+		{
+			auto& elements = value(m);
+			elements.clear();
+
+			return StaticFrame{&elements, &StaticVectorOps<Type>::ops};
+		}
+	}
+
+	throw StructMappingException(
+		std::string("bad type (") + (is_array ? "array" : "struct") + ") for member: " + name);
+}
+
+} // detail
+
+template<typename T>
+inline void map_json_to_static_struct(T& result_struct, std::string_view json_data)
+{
+	static_assert(detail::is_static_struct_v<T>, "struct_mapping: StaticStruct is not specialized for the type");
+
+	std::vector<detail::StaticFrame> frames;
+
+	const auto top = [&frames] () -> detail::StaticFrame&
+	{
+		return frames.back();
+	};
+
+	auto set_bool = [&] (const std::string& name, bool value)
+	{
+		top().ops->set_bool(top().object, name, value);
+	};
+
+	auto set_integral = [&] (const std::string& name, long long value)
+	{
+		top().ops->set_integral(top().object, name, value);
+	};
+
+	auto set_floating_point = [&] (const std::string& name, double value)
+	{
+		top().ops->set_floating_point(top().object, name, value);
+	};
+
+	auto set_string = [&] (const std::string& name, const std::string& value)
+	{
+		top().ops->set_string(top().object, name, value);
+	};
+
+	auto set_null = [&] (const std::string& name)
+	{
+		top().ops->set_null(top().object, name);
+	};
+
+	auto start_struct = [&] (const std::string& name)
+	{
+		if (frames.empty())
+		{
+			frames.push_back({&result_struct, &detail::StaticStructOps<T>::ops});
+		}
+		else
+		{
+			frames.push_back(top().ops->start(top().object, name, false));
+		}
+	};
+
+	auto end_struct = [&]
+	{
+		frames.pop_back();
+	};
+
+	auto start_array = [&] (const std::string& name)
+	{
+		frames.push_back(top().ops->start(top().object, name, true));
+	};
+
+	auto end_array = [&]
+	{
+		frames.pop_back();
+	};
+
+	detail::BufferParser parser(
+		set_bool,
+		set_integral,
+		set_floating_point,
+		set_string,
+		set_null,
+		start_struct,
+		end_struct,
+		start_array,
+		end_array);
+
+	parser.parse(json_data);
+}
+
+} // struct_mapping
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "buffer_parser.h"
+#include "exception.h"
+#include "object.h"
+#include "object_array_like.h"
+#include "object_map_like.h"
+#include "parser.h"
+#include "reset.h"
+#include "utility.h"
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace struct_mapping
+{
+
+namespace detail
+{
+
+// Follows the path of the array through the document and maps its elements
+// one at a time, the rest of the document being skipped.
+template<
+	typename T,
+	typename Callback>
+class ArrayElementMapper
+{
+	static constexpr bool is_struct = std::is_class_v<T> && is_complex_v<T>;
+
+public:
+	ArrayElementMapper(std::string_view path_, Callback& callback_)
+		:	callback(callback_)
+	{
+		for (std::size_t begin = 0;;)
+		{
+			const auto end = path_.find('.', begin);
+			path.emplace_back(path_.substr(begin, end - begin));
+
+			if (end == std::string_view::npos)
+			{
+				break;
+			}
+
+			begin = end + 1;
+		}
+	}
+
+	template<typename Parse>
+	void parse(Parse parse_)
+	{
+		parse_(
+			[this] (const std::string& name, bool value) { set(name, value); },
+			[this] (const std::string& name, long long value) { set(name, value); },
+			[this] (const std::string& name, double value) { set(name, value); },
+			[this] (const std::string& name, const std::string& value) { set(name, value); },
+			[] (const std::string&) {},
+			[this] (const std::string& name) { start(name, false); },
+			[this] { end(); },
+			[this] (const std::string& name) { start(name, true); },
+			[this] { end(); });
+	}
+
+private:
+	template<typename V>
+	void set(const std::string& name, const V& value)
+	{
+		if constexpr (is_struct)
+		{
+			if (element_depth != 0)
+			{
+				if constexpr (std::is_same_v<V, bool>)
+				{
+					Object<T>::set_bool(element, name, value);
+				}
+				else if constexpr (std::is_same_v<V, long long>)
+				{
+					Object<T>::set_integral(element, name, value);
+				}
+				else if constexpr (std::is_same_v<V, double>)
+				{
+					Object<T>::set_floating_point(element, name, value);
+				}
+				else
+				{
+					Object<T>::set_string(element, name, value);
+				}
+
+				return;
+			}
+		}
+
+		if (in_array && depth == array_depth)
+		{
+			set_element(value);
+		}
+	}
+
+	template<typename V>
+	void set_element(const V& value)
+	{
+		if constexpr (std::is_same_v<T, V>)
+		{
+			callback(T(value));
+		}
+		else if constexpr (is_integer_or_floating_point_v<T>
+			&& is_integer_or_floating_point_v<V>
+			&& (std::is_floating_point_v<T> || std::is_integral_v<V>))
+		{
+			if (!in_limits<T>(value))
+			{
+				throw StructMappingException(
+					"bad value for element of '" + path.back() + "': " + std::to_string(value) + " is out of limits");
+			}
+
+			callback(static_cast<T>(value));
+		}
+		else
+		{
+			throw StructMappingException("bad type of element of '" + path.back() + "'");
+		}
+	}
+
+	void start(const std::string& name, bool is_array)
+	{
+		if constexpr (is_struct)
+		{
+			if (element_depth != 0)
+			{
+				++element_depth;
+				Object<T>::use(element, name);
+				return;
+			}
+
+			if (in_array && depth == array_depth && !is_array)
+			{
+				Reset::reset();
+				element_depth = 1;
+				Object<T>::init(element);
+				return;
+			}
+		}
+
+		if (in_array && depth == array_depth)
+		{
+			throw StructMappingException("bad type of element of '" + path.back() + "'");
+		}
+		else if (++depth > 1 && matched == depth - 2 && name == path[matched] && ++matched == path.size())
+		{
+			if (!is_array)
+			{
+				throw StructMappingException("not an array: " + path.back());
+			}
+
+			in_array = true;
+			array_depth = depth;
+		}
+	}
+
+	void end()
+	{
+		if constexpr (is_struct)
+		{
+			if (element_depth != 0)
+			{
+				Object<T>::release(element);
+
+				if (--element_depth == 0)
+				{
+					callback(std::move(element));
+					element = T{};
+				}
+
+				return;
+			}
+		}
+
+		if (in_array && depth == array_depth)
+		{
+			in_array = false;
+		}
+
+		if (depth > 1 && matched == depth - 1)
+		{
+			--matched;
+		}
+
+		--depth;
+	}
+
+private:
+	Callback& callback;
+	std::vector<std::string> path;
+
+	T element{};
+	std::size_t depth = 0;
+	std::size_t matched = 0;
+	std::size_t array_depth = 0;
+	std::size_t element_depth = 0;
+	bool in_array = false;
+};
+
+} // detail
+
+// Calls callback with each element of the array at path, a list of member
+// names separated by dots ("seeds" or "job.roots"), as soon as the element is
+// parsed, so only one element is held in memory at a time. The elements are
+// either structs with registered members or values of bool, a number type or
+// std::string. The rest of the document is checked for syntax only.
+template<
+	typename T,
+	typename Callback>
+inline void map_json_array_elements(std::basic_istream<char>& json_data, std::string_view path, Callback callback)
+{
+	detail::ArrayElementMapper<T, Callback>(path, callback).parse([&json_data] (auto ... callbacks)
+	{
+		detail::Parser parser(callbacks...);
+		parser.parse(json_data);
+	});
+}
+
+template<
+	typename T,
+	typename Callback>
+inline void map_json_array_elements(std::string_view json_data, std::string_view path, Callback callback)
+{
+	detail::ArrayElementMapper<T, Callback>(path, callback).parse([json_data] (auto ... callbacks)
+	{
+		detail::BufferParser parser(callbacks...);
+		parser.parse(json_data);
+	});
+}
+
+} // struct_mapping
@@ -1,13 +1,17 @@
 #pragma once
 
 #include "exception.h"
+#include "json_view.h"
 #include "object.h"
 #include "member_string.h"
 #include "mapper.h"
+#include "ndjson_writer.h"
 #include "options/option_bounds.h"
 #include "options/option_default.h"
 #include "options/option_not_empty.h"
 #include "options/option_required.h"
+#include "static_mapper.h"
+#include "stream_mapper.h"
 
 #include <string>
 #include <utility>
@@ -0,0 +1,331 @@
+#pragma once
+
+#include "../include/src/util/memory.hpp"
+#include "sink.hpp"
+#include "task_pool.hpp"
+#include "trace.hpp"
+
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace util = dmitigr::util;
+
+// Writes the remainder of a block synchronously, after a short write.
+inline void writeFully(int fd, const char* data, std::size_t size, std::uint64_t offset) {
+    while(size > 0) {
+        const ssize_t n = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) throw std::system_error{n < 0 ? errno : EIO, std::generic_category(), "cannot write output file"};
+        data += n;
+        size -= static_cast<std::size_t>(n);
+        offset += static_cast<std::uint64_t>(n);
+    }
+}
+
+// Positioned writes of whole blocks, running while the caller goes on.
+// complete() waits for the oldest outstanding write and returns its tag.
+class WriteQueue {
+public:
+    virtual ~WriteQueue() = default;
+    virtual void write(int fd, const char* data, std::size_t size, std::uint64_t offset, std::uint64_t tag) = 0;
+    virtual std::uint64_t complete() = 0;
+};
+
+// The writes go through an io_uring of the sink's own. The ring is set up
+// with the raw system calls, so there's no dependency on liburing; the
+// constructor throws if the kernel refuses it, e.g. in a container whose
+// seccomp profile has io_uring disabled.
+class UringWriteQueue final : public WriteQueue {
+public:
+    explicit UringWriteQueue(unsigned entries) {
+        io_uring_params params{};
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if(fd_ < 0) throw std::system_error{errno, std::generic_category(), "io_uring_setup"};
+        try {
+            sqSize_ = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+            cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            if(params.features & IORING_FEAT_SINGLE_MMAP) sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+            sq_ = map(sqSize_, IORING_OFF_SQ_RING);
+            cq_ = params.features & IORING_FEAT_SINGLE_MMAP ? sq_ : map(cqSize_, IORING_OFF_CQ_RING);
+            sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+            sqes_ = static_cast<io_uring_sqe*>(map(sqesSize_, IORING_OFF_SQES));
+        } catch(...) {
+            unmap();
+            throw;
+        }
+        auto* sq = static_cast<char*>(sq_);
+        auto* cq = static_cast<char*>(cq_);
+        sqTail_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.tail);
+        sqMask_ = *reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+        cqHead_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.head);
+        cqTail_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.tail);
+        cqMask_ = *reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    UringWriteQueue(const UringWriteQueue&) = delete;
+    UringWriteQueue& operator=(const UringWriteQueue&) = delete;
+
+    ~UringWriteQueue() override {
+        try {
+            while(!pending_.empty()) complete();
+        } catch(...) {}
+        unmap();
+    }
+
+    void write(int fd, const char* data, std::size_t size, std::uint64_t offset, std::uint64_t tag) override {
+        const std::uint32_t tail = *sqTail_;
+        const std::uint32_t index = tail & sqMask_;
+        io_uring_sqe& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_WRITE;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(data);
+        sqe.len = static_cast<std::uint32_t>(size);
+        sqe.off = offset;
+        sqe.user_data = pending_.size() + completed_;
+        sqArray_[index] = index;
+        std::atomic_ref{*sqTail_}.store(tail + 1, std::memory_order_release);
+        pending_.push_back(Pending{fd, data, size, offset, tag});
+        while(::syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0) < 0) {
+            if(errno != EINTR) throw std::system_error{errno, std::generic_category(), "io_uring_enter"};
+        }
+    }
+
+    // Writes on one file complete in any order; the tags are handed out in
+    // submission order all the same, since the sink only needs to know that
+    // its oldest block is free again.
+    std::uint64_t complete() override {
+        while(true) {
+            const std::uint32_t head = *cqHead_;
+            if(head != std::atomic_ref{*cqTail_}.load(std::memory_order_acquire)) {
+                const io_uring_cqe cqe = cqes_[head & cqMask_];
+                std::atomic_ref{*cqHead_}.store(head + 1, std::memory_order_release);
+                finish(cqe);
+                continue;
+            }
+            if(!pending_.empty() && pending_.front().done) {
+                const std::uint64_t tag = pending_.front().tag;
+                pending_.pop_front();
+                completed_++;
+                return tag;
+            }
+            if(::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                throw std::system_error{errno, std::generic_category(), "io_uring_enter"};
+        }
+    }
+
+private:
+    struct Pending {
+        int fd;
+        const char* data;
+        std::size_t size;
+        std::uint64_t offset;
+        std::uint64_t tag;
+        bool done = false;
+    };
+
+    void finish(const io_uring_cqe& cqe) {
+        Pending& write = pending_[cqe.user_data - completed_];
+        write.done = true;
+        // Kernels before 5.6 don't know IORING_OP_WRITE; short writes are
+        // possible too. Either way the rest goes out synchronously.
+        if(cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) writeFully(write.fd, write.data, write.size, write.offset);
+        else if(cqe.res < 0) throw std::system_error{-cqe.res, std::generic_category(), "cannot write output file"};
+        else if(static_cast<std::size_t>(cqe.res) < write.size)
+            writeFully(write.fd, write.data + cqe.res, write.size - static_cast<std::size_t>(cqe.res), write.offset + static_cast<std::uint64_t>(cqe.res));
+    }
+
+    void* map(std::size_t size, std::uint64_t offset) {
+        void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, static_cast<off_t>(offset));
+        if(p == MAP_FAILED) throw std::system_error{errno, std::generic_category(), "io_uring mmap"};
+        return p;
+    }
+
+    void unmap() {
+        if(sqes_) ::munmap(sqes_, sqesSize_);
+        if(cq_ && cq_ != sq_) ::munmap(cq_, cqSize_);
+        if(sq_) ::munmap(sq_, sqSize_);
+        ::close(fd_);
+    }
+
+    int fd_ = -1;
+    void* sq_ = nullptr;
+    void* cq_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    std::size_t sqSize_ = 0;
+    std::size_t cqSize_ = 0;
+    std::size_t sqesSize_ = 0;
+    std::uint32_t* sqTail_ = nullptr;
+    std::uint32_t sqMask_ = 0;
+    std::uint32_t* sqArray_ = nullptr;
+    std::uint32_t* cqHead_ = nullptr;
+    std::uint32_t* cqTail_ = nullptr;
+    std::uint32_t cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+    std::deque<Pending> pending_;
+    std::uint64_t completed_ = 0;
+};
+
+// The fallback: the writes run as jobs on a pool of writer threads.
+class ThreadWriteQueue final : public WriteQueue {
+public:
+    explicit ThreadWriteQueue(TaskPool& pool)
+        : pool_{pool} {}
+
+    ~ThreadWriteQueue() override {
+        for(auto& [tag, result] : pending_) result.wait();
+    }
+
+    void write(int fd, const char* data, std::size_t size, std::uint64_t offset, std::uint64_t tag) override {
+        pending_.emplace_back(tag, pool_.submit([=] {
+            const TraceSpan span{"write", "write"};
+            writeFully(fd, data, size, offset);
+        }));
+    }
+
+    std::uint64_t complete() override {
+        auto [tag, result] = std::move(pending_.front());
+        pending_.pop_front();
+        result.get();
+        return tag;
+    }
+
+private:
+    TaskPool& pool_;
+    std::deque<std::pair<std::uint64_t, std::future<void>>> pending_;
+};
+
+// io_uring if the kernel allows it, the writer threads otherwise.
+inline std::unique_ptr<WriteQueue> makeWriteQueue(unsigned depth, TaskPool& fallback) {
+    try {
+        return std::make_unique<UringWriteQueue>(depth);
+    } catch(const std::system_error&) {
+        return std::make_unique<ThreadWriteQueue>(fallback);
+    }
+}
+
+// An output file written through a WriteQueue, so the COPY receive loop
+// only copies rows into memory. The data is gathered in blockCount blocks
+// of blockSize bytes, aligned for O_DIRECT, which is used where the file
+// system supports it; write() only waits when every block is in flight. The
+// blocks come from the process's util::Chunk_pool and go back to it on close. A
+// preallocated file is written over and cut to size on close, like FileSink.
+class AsyncFileSink final : public Sink {
+public:
+    static constexpr std::size_t alignment = 4096;
+
+    // What a block of a bufferSize sink takes.
+    static std::size_t blockBytes(std::size_t bufferSize) {
+        return (std::max(bufferSize, alignment) + alignment - 1) / alignment * alignment;
+    }
+
+    AsyncFileSink(const std::filesystem::path& path, std::size_t blockSize, std::unique_ptr<WriteQueue> queue,
+        std::size_t blockCount = 4, bool preallocated = false)
+        : path_{path}, queue_{std::move(queue)}, blockSize_{blockBytes(blockSize)}, preallocated_{preallocated} {
+        const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (preallocated ? 0 : O_TRUNC);
+        fd_ = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        if(fd_ < 0 && errno == EINVAL) fd_ = ::open(path.c_str(), flags, 0644);
+        if(fd_ < 0) throw std::system_error{errno, std::generic_category(), "cannot open " + path_.string()};
+        util::Chunk_pool& pool = util::chunk_pool(blockSize_);
+        for(std::size_t i = 0; i < std::max<std::size_t>(blockCount, 2); i++) {
+            blocks_.push_back(pool.acquire());
+            free_.push_back(i);
+        }
+        current_ = free_.back();
+        free_.pop_back();
+    }
+
+    AsyncFileSink(const AsyncFileSink&) = delete;
+    AsyncFileSink& operator=(const AsyncFileSink&) = delete;
+
+    ~AsyncFileSink() override {
+        // The queue must be done with the blocks before they go.
+        queue_.reset();
+        if(fd_ >= 0) ::close(fd_);
+    }
+
+    void write(std::string_view data) override {
+        while(!data.empty()) {
+            const std::size_t n = std::min(data.size(), blockSize_ - used_);
+            std::memcpy(blocks_[current_].data() + used_, data.data(), n);
+            used_ += n;
+            data.remove_prefix(n);
+            if(used_ == blockSize_) submit();
+        }
+    }
+
+    void close() override {
+        // Only whole blocks are aligned; the tail goes out buffered.
+        while(inFlight_ > 0) reap();
+        if(used_ > 0) {
+            const int flags = ::fcntl(fd_, F_GETFL);
+            if(flags & O_DIRECT) ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT);
+            writeFully(fd_, blocks_[current_].data(), used_, offset_);
+            offset_ += used_;
+            used_ = 0;
+        }
+        if(preallocated_ && ::ftruncate(fd_, static_cast<off_t>(offset_)) != 0)
+            throw std::system_error{errno, std::generic_category(), "cannot truncate " + path_.string()};
+        const int fd = fd_;
+        fd_ = -1;
+        if(::close(fd) != 0) throw std::system_error{errno, std::generic_category(), "cannot close " + path_.string()};
+    }
+
+    std::uint64_t bytesWritten() const { return offset_ + used_; }
+    const std::filesystem::path& path() const { return path_; }
+
+private:
+    void submit() {
+        queue_->write(fd_, blocks_[current_].data(), used_, offset_, current_);
+        inFlight_++;
+        offset_ += used_;
+        used_ = 0;
+        if(free_.empty()) reap();
+        current_ = free_.back();
+        free_.pop_back();
+    }
+
+    // The wait for a block to come back is what the COPY loop stalls on.
+    void reap() {
+        const TraceSpan span{"write", "write wait"};
+        free_.push_back(queue_->complete());
+        inFlight_--;
+    }
+
+    std::filesystem::path path_;
+    std::unique_ptr<WriteQueue> queue_;
+    std::size_t blockSize_;
+    int fd_ = -1;
+    std::vector<util::Chunk_pool::Chunk> blocks_;
+    std::vector<std::size_t> free_;
+    std::size_t current_ = 0;
+    std::size_t used_ = 0;
+    std::size_t inFlight_ = 0;
+    std::uint64_t offset_ = 0;
+    bool preallocated_;
+};
+
+} // namespace subset
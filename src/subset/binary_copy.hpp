@@ -0,0 +1,86 @@
+#pragma once
+
+#include "pg_types.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+// Readers of the big-endian integers of the binary COPY framing.
+inline std::uint16_t readUint16(const char* p) {
+    const auto* b = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<std::uint16_t>((b[0] << 8) | b[1]);
+}
+
+inline std::uint32_t readUint32(const char* p) {
+    const auto* b = reinterpret_cast<const unsigned char*>(p);
+    return (std::uint32_t{b[0]} << 24) | (std::uint32_t{b[1]} << 16) | (std::uint32_t{b[2]} << 8) | b[3];
+}
+
+inline std::uint64_t readUint64(const char* p) {
+    return (std::uint64_t{readUint32(p)} << 32) | readUint32(p + 4);
+}
+
+inline constexpr std::string_view binaryCopySignature{"PGCOPY\n\377\r\n\0", 11};
+
+// Walks the tuples of a `COPY ... (FORMAT binary)` stream as delivered by
+// Copier::receive(): the server sends the file header in front of the
+// first tuple and every message holds whole tuples.
+class BinaryCopyDecoder {
+public:
+    // Calls onField(index, value, isNull) for every field of the tuples of
+    // message. Returns false once the trailer is seen.
+    template<typename F>
+    bool feed(std::string_view message, F&& onField) {
+        if(!headerSeen_) {
+            if(message.substr(0, binaryCopySignature.size()) != binaryCopySignature || message.size() < 19)
+                throw std::runtime_error{"invalid binary COPY header"};
+            const std::uint32_t extension = readUint32(message.data() + 15);
+            if(message.size() < 19 + std::size_t{extension})
+                throw std::runtime_error{"invalid binary COPY header"};
+            message.remove_prefix(19 + extension);
+            headerSeen_ = true;
+        }
+        while(!message.empty()) {
+            need(message, 2);
+            const auto fieldCount = static_cast<std::int16_t>(readUint16(message.data()));
+            message.remove_prefix(2);
+            if(fieldCount == -1) return false;
+            for(std::int16_t i = 0; i < fieldCount; i++) {
+                need(message, 4);
+                const auto size = static_cast<std::int32_t>(readUint32(message.data()));
+                message.remove_prefix(4);
+                if(size < 0) {
+                    onField(static_cast<std::size_t>(i), std::string_view{}, true);
+                    continue;
+                }
+                need(message, static_cast<std::size_t>(size));
+                onField(static_cast<std::size_t>(i), message.substr(0, size), false);
+                message.remove_prefix(size);
+            }
+            tuples_++;
+        }
+        return true;
+    }
+
+    std::uint64_t tuples() const { return tuples_; }
+
+private:
+    static void need(std::string_view message, std::size_t size) {
+        if(message.size() < size) throw std::runtime_error{"truncated binary COPY tuple"};
+    }
+
+    bool headerSeen_ = false;
+    std::uint64_t tuples_ = 0;
+};
+
+// Whether key values of the type can be read from binary COPY by
+// KeySet::insertBinary().
+inline bool isBinaryKeyType(PGDataType dataType) {
+    return pgTypeTraits(dataType).binaryKey;
+}
+
+} // namespace subset
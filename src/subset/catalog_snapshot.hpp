@@ -0,0 +1,50 @@
+#pragma once
+
+#include "pg_types.hpp"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace subset {
+
+// One column pair of a foreign key. The pairs of a composite key are edges
+// of the same constraint, added one after another in the key's order.
+struct FkEdge {
+    std::string childTable;
+    std::string childColumn;
+    std::string parentTable;
+    std::string parentColumn;
+    std::string constraint;
+};
+
+struct ColumnDef {
+    std::string name;
+    bool isNullable;
+    std::string dataType;
+    Oid typeOid = 0; // 0 when only the name is known
+};
+
+// The fingerprint of each table's catalog rows by its name, of the table's
+// own, its columns' and those of the foreign keys from or to it.
+using TableFingerprints = std::unordered_map<std::string, std::string>;
+
+// The FK edges and column definitions of a whole schema, fetched up front so
+// that the BFS over the dependency graph needs no further round trips.
+struct CatalogSnapshot {
+    std::vector<FkEdge> edges;
+    std::unordered_map<std::string, std::vector<std::size_t>> childEdges;  // childEdges[parent] = edges referencing parent
+    std::unordered_map<std::string, std::vector<std::size_t>> parentEdges; // parentEdges[child] = edges of child
+    std::unordered_map<std::string, std::vector<ColumnDef>> columns;
+    TableFingerprints fingerprints; // as of the load, when read
+
+    void addEdge(FkEdge edge) {
+        const std::size_t i = edges.size();
+        childEdges[edge.parentTable].push_back(i);
+        parentEdges[edge.childTable].push_back(i);
+        edges.push_back(std::move(edge));
+    }
+};
+
+} // namespace subset
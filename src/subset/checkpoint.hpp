@@ -0,0 +1,169 @@
+#pragma once
+
+#include "key_set.hpp"
+#include "schema_graph.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace subset {
+
+// FNV-1a; stable across builds, unlike std::hash.
+inline std::uint64_t fnv1a(std::string_view data, std::uint64_t hash = 0xcbf29ce484222325ULL) {
+    for(const char c : data) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// Identifies the job a checkpoint belongs to: the seeds and the shape of
+// the graph, independent of the order tables were discovered in.
+inline std::string jobSignature(const SchemaGraph& graph, const std::string& rootTable, const std::string& seeds) {
+    std::vector<std::string> lines;
+    for(TableId t = 0; t < graph.tableCount(); t++) {
+        std::string line = graph.tableName(t);
+        std::vector<std::string> links;
+        for(const LinkId l : graph.supporters(t)) {
+            const FkLink& link = graph.link(l);
+            // One column as it always was, for the checkpoints written before
+            // composite keys.
+            std::string child;
+            std::string parent;
+            for(const auto& column : graph.columnNames(graph.childColumns(link))) child += (child.empty() ? "" : ",") + column;
+            for(const auto& column : graph.columnNames(graph.parentColumns(link))) parent += (parent.empty() ? "" : ",") + column;
+            links.push_back(child + "->" + graph.tableName(link.parent) + "." + parent);
+        }
+        std::sort(links.begin(), links.end());
+        for(const auto& link : links) line += "|" + link;
+        lines.push_back(std::move(line));
+    }
+    std::sort(lines.begin(), lines.end());
+    std::uint64_t hash = fnv1a(rootTable + "\n" + seeds + "\n");
+    for(const auto& line : lines) hash = fnv1a(line + "\n", hash);
+    std::ostringstream out;
+    out << std::hex << hash;
+    return out.str();
+}
+
+// Progress of a run persisted in a directory:
+//
+//   job             the job signature
+//   progress.log    one "<rows>\t<bytes>\t<table>" line per finished table
+//   keys/<table>    the key sets of the finished table
+//
+// A table counts as finished once its line is in the log; the key sets are
+// renamed into place before the line is appended, so a crash in between only
+// costs re-extracting that table.
+class Checkpoint {
+public:
+    struct Entry {
+        std::uint64_t rows;
+        std::uint64_t bytes;
+    };
+
+    // Starts a new checkpoint, or picks up the existing one if resume.
+    Checkpoint(const std::filesystem::path& dir, const SchemaGraph& graph, const std::string& signature, bool resume)
+        : dir_{dir}, graph_{graph}, completed_(graph.tableCount(), false) {
+        std::filesystem::create_directories(dir_ / "keys");
+        if(resume) {
+            std::ifstream job{dir_ / "job"};
+            std::string stored;
+            std::getline(job, stored);
+            if(stored != signature)
+                throw std::runtime_error{"checkpoint in " + dir_.string() + " belongs to a different job"};
+            readLog();
+        } else {
+            std::filesystem::remove(dir_ / "progress.log");
+            std::ofstream{dir_ / "job", std::ios::trunc} << signature << '\n';
+        }
+        log_.open(dir_ / "progress.log", std::ios::app);
+        if(!log_) throw std::runtime_error{"cannot open " + (dir_ / "progress.log").string()};
+    }
+
+    const std::vector<bool>& completed() const { return completed_; }
+
+    const Entry* entry(TableId table) const {
+        const auto it = entries_.find(table);
+        return it != entries_.end() ? &it->second : nullptr;
+    }
+
+    // Forgets a finished table, e.g. because its output is gone.
+    void invalidate(TableId table) {
+        completed_[table] = false;
+        entries_.erase(table);
+    }
+
+    // Restores the key sets of the finished tables.
+    void loadKeySets(std::vector<KeySet>& keySets) const {
+        for(TableId t = 0; t < graph_.tableCount(); t++) {
+            const auto [first, last] = graph_.needs(t);
+            if(!completed_[t] || first == last) continue;
+            std::ifstream in{keysPath(t), std::ios::binary};
+            if(!in) throw std::runtime_error{"missing checkpointed key sets of " + graph_.tableName(t)};
+            for(NeedId need = first; need < last; need++) keySets[need].load(in);
+        }
+    }
+
+    // Records a finished table along with its key sets. Thread-safe.
+    void markCompleted(TableId table, const std::vector<KeySet>& keySets, Entry entry) {
+        const auto [first, last] = graph_.needs(table);
+        if(first != last) {
+            auto tmp = keysPath(table);
+            tmp += ".tmp";
+            {
+                std::ofstream out{tmp, std::ios::binary | std::ios::trunc};
+                for(NeedId need = first; need < last; need++) keySets[need].save(out);
+                if(!out) throw std::runtime_error{"cannot write " + tmp.string()};
+            }
+            std::filesystem::rename(tmp, keysPath(table));
+        }
+        std::lock_guard lock{mutex_};
+        log_ << entry.rows << '\t' << entry.bytes << '\t' << graph_.tableName(table) << '\n';
+        log_.flush();
+        if(!log_) throw std::runtime_error{"cannot append to " + (dir_ / "progress.log").string()};
+        completed_[table] = true;
+        entries_[table] = entry;
+    }
+
+private:
+    std::filesystem::path keysPath(TableId table) const {
+        return dir_ / "keys" / graph_.tableName(table);
+    }
+
+    void readLog() {
+        std::ifstream in{dir_ / "progress.log"};
+        std::string line;
+        while(std::getline(in, line)) {
+            // A torn last line has no table name yet and is skipped by the
+            // lookup below.
+            std::istringstream fields{line};
+            Entry entry{};
+            std::string name;
+            if(!(fields >> entry.rows >> entry.bytes)) continue;
+            fields.ignore(1);
+            std::getline(fields, name);
+            if(const auto t = graph_.findTable(name)) {
+                completed_[*t] = true;
+                entries_[*t] = entry;
+            }
+        }
+    }
+
+    std::filesystem::path dir_;
+    const SchemaGraph& graph_;
+    std::vector<bool> completed_;
+    std::unordered_map<TableId, Entry> entries_;
+    std::mutex mutex_;
+    std::ofstream log_;
+};
+
+} // namespace subset
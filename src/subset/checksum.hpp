@@ -0,0 +1,119 @@
+#pragma once
+
+#include "sink.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+namespace subset {
+
+// CRC-32C (Castagnoli), the checksum of iSCSI, ext4 and the cloud object
+// stores, updated as the data goes past. On x86-64 with SSE4.2 and on ARMv8
+// with the CRC extension it takes 8 bytes an instruction, several GB/s, so
+// it can run inline on the writing thread; elsewhere it goes slicing by 8.
+class Crc32c {
+public:
+    void update(std::string_view data) {
+        const auto* p = reinterpret_cast<const unsigned char*>(data.data());
+        std::size_t n = data.size();
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+        if(hardware()) {
+            crc_ = updateSse42(crc_, p, n);
+            return;
+        }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+        for(; n >= 8; p += 8, n -= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, p, 8);
+            crc_ = __crc32cd(crc_, word);
+        }
+        for(; n > 0; p++, n--) crc_ = __crc32cb(crc_, *p);
+        return;
+#endif
+        const auto& t = tables();
+        std::uint32_t crc = crc_;
+        for(; n >= 8; p += 8, n -= 8) {
+            // Little-endian, as the hardware reads it.
+            const std::uint32_t low = crc ^ (std::uint32_t{p[0]} | std::uint32_t{p[1]} << 8 |
+                std::uint32_t{p[2]} << 16 | std::uint32_t{p[3]} << 24);
+            crc = t[7][low & 0xff] ^ t[6][low >> 8 & 0xff] ^ t[5][low >> 16 & 0xff] ^ t[4][low >> 24] ^
+                t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+        }
+        for(; n > 0; p++, n--) crc = t[0][(crc ^ *p) & 0xff] ^ crc >> 8;
+        crc_ = crc;
+    }
+
+    std::uint32_t value() const { return ~crc_; }
+
+private:
+    using Tables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+    static const Tables& tables() {
+        static const Tables result = [] {
+            Tables t{};
+            for(std::uint32_t i = 0; i < 256; i++) {
+                std::uint32_t crc = i;
+                for(int bit = 0; bit < 8; bit++) crc = crc >> 1 ^ (crc & 1 ? 0x82f63b78u : 0);
+                t[0][i] = crc;
+            }
+            for(std::size_t k = 1; k < t.size(); k++) {
+                for(std::size_t i = 0; i < 256; i++) t[k][i] = t[k - 1][i] >> 8 ^ t[0][t[k - 1][i] & 0xff];
+            }
+            return t;
+        }();
+        return result;
+    }
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    static bool hardware() {
+        static const bool result = __builtin_cpu_supports("sse4.2");
+        return result;
+    }
+
+    __attribute__((target("sse4.2")))
+    static std::uint32_t updateSse42(std::uint32_t crc, const unsigned char* p, std::size_t n) {
+        std::uint64_t wide = crc;
+        for(; n >= 8; p += 8, n -= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, p, 8);
+            wide = _mm_crc32_u64(wide, word);
+        }
+        crc = static_cast<std::uint32_t>(wide);
+        for(; n > 0; p++, n--) crc = _mm_crc32_u8(crc, *p);
+        return crc;
+    }
+#endif
+
+    std::uint32_t crc_ = ~std::uint32_t{0};
+};
+
+// Checksums the bytes on their way into out, the file as written, so the
+// manifest has them without the file being read again.
+class ChecksumSink final : public Sink {
+public:
+    ChecksumSink(std::unique_ptr<Sink> out, Crc32c& checksum) : out_{std::move(out)}, checksum_{checksum} {}
+
+    void write(std::string_view data) override {
+        checksum_.update(data);
+        out_->write(data);
+    }
+
+    void close() override { out_->close(); }
+
+private:
+    std::unique_ptr<Sink> out_;
+    Crc32c& checksum_;
+};
+
+} // namespace subset
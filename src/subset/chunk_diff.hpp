@@ -0,0 +1,206 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// A range of integer keys, both ends included.
+struct KeyRange {
+    std::int64_t first = 0;
+    std::int64_t last = 0;
+};
+
+// Compares the rows the source would send into a table with the rows the
+// target has, by the count and the sum of the row hashes of chunks of the
+// integer primary key: the chunks which differ are split in fanout and
+// compared again until they hold at most leafRows rows, so a table which
+// differs little costs a few aggregates on either side instead of its
+// transfer. Both sides aggregate at once, the target's query sent before
+// the source's is run. The rows are hashed in text form, which the two
+// servers have to print the same, in the same time zone and DateStyle.
+class ChunkDiff {
+public:
+    // source is the query of the rows of the subset, target the table's.
+    ChunkDiff(pgfe::Connection& sourceConn, pgfe::Connection& targetConn, std::string source, std::string target,
+        std::string key)
+        : sourceConn_{sourceConn}, targetConn_{targetConn}, source_{std::move(source)}, target_{std::move(target)},
+          key_{std::move(key)} {}
+
+    // The differing ranges, the adjacent ones merged, in order.
+    std::vector<KeyRange> differing(std::size_t fanout = 64, std::int64_t leafRows = 1000) {
+        const TraceSpan span{"compare", "chunks"};
+        std::vector<KeyRange> leaves;
+        std::optional<KeyRange> bounds = this->bounds();
+        if(!bounds) return leaves;
+        // Past 2^62 keys the offsets within a chunk could overflow.
+        if(static_cast<std::uint64_t>(bounds->last) - static_cast<std::uint64_t>(bounds->first) >= std::uint64_t{1} << 62)
+            return {*bounds};
+
+        std::vector<KeyRange> parents{*bounds};
+        std::int64_t width = bounds->last - bounds->first + 1;
+        while(!parents.empty()) {
+            width = (width + static_cast<std::int64_t>(fanout) - 1) / static_cast<std::int64_t>(fanout);
+            const auto [source, target] = aggregate(parents, width);
+            std::vector<KeyRange> next;
+            auto p = parents.begin();
+            const auto compare = [&](std::int64_t chunk, const Aggregate* a, const Aggregate* b) {
+                if(a && b && a->rows == b->rows && a->hash == b->hash) return;
+                while(p->last < chunk) ++p;
+                const KeyRange range{chunk, std::min(p->last, chunk + (width - 1))};
+                // A chunk one side lacks differs in every row.
+                const std::int64_t rows = std::max(a ? a->rows : 0, b ? b->rows : 0);
+                (!a || !b || rows <= leafRows || width == 1 ? leaves : next).push_back(range);
+            };
+            // Both maps are ordered by chunk, as the parents are.
+            auto s = source.begin();
+            auto t = target.begin();
+            while(s != source.end() || t != target.end()) {
+                if(t == target.end() || (s != source.end() && s->first < t->first)) {
+                    compare(s->first, &s->second, nullptr);
+                    ++s;
+                } else if(s == source.end() || t->first < s->first) {
+                    compare(t->first, nullptr, &t->second);
+                    ++t;
+                } else {
+                    compare(s->first, &s->second, &t->second);
+                    ++s;
+                    ++t;
+                }
+            }
+            parents = std::move(next);
+        }
+
+        std::sort(leaves.begin(), leaves.end(), [](const KeyRange& a, const KeyRange& b) { return a.first < b.first; });
+        std::vector<KeyRange> merged;
+        for(const auto& leaf : leaves) {
+            if(!merged.empty() && merged.back().last + 1 == leaf.first) merged.back().last = leaf.last;
+            else merged.push_back(leaf);
+        }
+        return merged;
+    }
+
+    std::int64_t sourceRows() const { return sourceRows_; }
+
+    // The condition on quotedKey of the rows in ranges; false for none.
+    static std::string condition(const std::string& quotedKey, const std::vector<KeyRange>& ranges) {
+        if(ranges.empty()) return "false";
+        std::string result = "(";
+        for(const auto& range : ranges) {
+            if(result.size() > 1) result += " OR ";
+            result += range.first == range.last ? quotedKey + " = " + std::to_string(range.first) :
+                quotedKey + " BETWEEN " + std::to_string(range.first) + " AND " + std::to_string(range.last);
+        }
+        return result + ')';
+    }
+
+private:
+    struct Aggregate {
+        std::int64_t rows = 0;
+        std::string hash;
+    };
+    using Aggregates = std::map<std::int64_t, Aggregate>;
+
+    // The keys of either side; none if both are empty.
+    std::optional<KeyRange> bounds() {
+        std::optional<KeyRange> result;
+        const auto add = [&](auto&& r) {
+            if(!r[0]) return;
+            const KeyRange range{pgfe::to<std::int64_t>(r[0]), pgfe::to<std::int64_t>(r[1])};
+            if(!result) result = range;
+            result->first = std::min(result->first, range.first);
+            result->last = std::max(result->last, range.last);
+        };
+        const auto query = [&](const std::string& rows) {
+            return "SELECT min(s." + key_ + ")::int8, max(s." + key_ + ")::int8, count(*) FROM (" + rows + ") s";
+        };
+        both(query(source_), {}, [&](auto&& r) {
+            add(r);
+            sourceRows_ = pgfe::to<std::int64_t>(r[2]);
+        }, query(target_), add);
+        return result;
+    }
+
+    // The aggregates of the chunks of width into which parents split.
+    std::pair<Aggregates, Aggregates> aggregate(const std::vector<KeyRange>& parents, std::int64_t width) {
+        std::string firsts = "{";
+        std::string lasts = "{";
+        for(const auto& parent : parents) {
+            if(firsts.size() > 1) {
+                firsts += ',';
+                lasts += ',';
+            }
+            firsts += std::to_string(parent.first);
+            lasts += std::to_string(parent.last);
+        }
+        firsts += '}';
+        lasts += '}';
+        const std::string w = std::to_string(width);
+        const auto query = [&](const std::string& rows) {
+            return "SELECT r.first + (s." + key_ + " - r.first) / " + w + " * " + w + ", count(*), "
+                "sum(hashtextextended(s::text, 0))::text "
+                "FROM unnest($1::int8[], $2::int8[]) AS r(first, last) "
+                "JOIN (" + rows + ") s ON s." + key_ + " BETWEEN r.first AND r.last GROUP BY 1";
+        };
+        std::pair<Aggregates, Aggregates> result;
+        const auto into = [](Aggregates& aggregates) {
+            return [&aggregates](auto&& r) {
+                aggregates[pgfe::to<std::int64_t>(r[0])] = Aggregate{pgfe::to<std::int64_t>(r[1]),
+                    r[2] ? pgfe::to<std::string>(r[2]) : std::string{}};
+            };
+        };
+        both(query(source_), {firsts, lasts}, into(result.first), query(target_), into(result.second));
+        return result;
+    }
+
+    // Runs target on the target while source runs on the source.
+    template<typename S, typename T>
+    void both(const std::string& source, const std::pair<std::string, std::string>& parameters, S&& onSource,
+        const std::string& target, T&& onTarget) {
+        const bool array = !parameters.first.empty();
+        if(array) targetConn_.execute_nio(pgfe::Statement{target}, parameters.first, parameters.second);
+        else targetConn_.execute_nio(pgfe::Statement{target});
+        try {
+            if(array) sourceConn_.execute(onSource, source, parameters.first, parameters.second);
+            else sourceConn_.execute(onSource, source);
+        } catch(...) {
+            // The target's response is read before the error goes on.
+            try {
+                while(targetConn_.has_uncompleted_request()) {
+                    targetConn_.wait_response();
+                    targetConn_.error();
+                    targetConn_.row();
+                    targetConn_.completion();
+                }
+            } catch(...) {}
+            throw;
+        }
+        while(targetConn_.wait_response_throw()) {
+            if(auto r = targetConn_.row()) onTarget(r);
+            else {
+                targetConn_.completion();
+                break;
+            }
+        }
+    }
+
+    pgfe::Connection& sourceConn_;
+    pgfe::Connection& targetConn_;
+    std::string source_;
+    std::string target_;
+    std::string key_;
+    std::int64_t sourceRows_ = 0;
+};
+
+} // namespace subset
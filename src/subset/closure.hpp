@@ -0,0 +1,93 @@
+#pragma once
+
+#include "components.hpp"
+#include "schema_graph.hpp"
+#include "sql.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace subset {
+
+// The parts of an extraction statement carrying its key closure.
+struct ServerClosure {
+    std::string with;  // "WITH ... " or empty
+    std::string where; // "WHERE ..." or empty
+};
+
+// Compiles the key propagation from the seeds and the tables without
+// supporters down to table into one statement: every ancestor becomes a CTE
+// selecting the referenced columns of its rows, filtered on the CTEs of its
+// own supporters, or by rootCondition for the root, so no intermediate key
+// set leaves the server. Returns nothing if an ancestor is on a cycle, whose
+// closure needs the rounds of the client.
+inline std::optional<ServerClosure> serverClosure(const SchemaGraph& graph, const Components& components, TableId table,
+    TableId rootTable, const std::string& rootCondition) {
+    // Ancestors in dependency order, by a post-order walk up the supporters.
+    std::vector<TableId> order;
+    std::vector<bool> visited(graph.tableCount(), false);
+    std::vector<std::pair<TableId, std::size_t>> stack{{table, 0}};
+    visited[table] = true;
+    while(!stack.empty()) {
+        auto& [t, next] = stack.back();
+        if(components.cyclic(graph, components.of[t])) return std::nullopt;
+        const auto supporters = t == rootTable ? std::span<const LinkId>{} : graph.supporters(t);
+        if(next < supporters.size()) {
+            const TableId parent = graph.link(supporters[next++]).parent;
+            if(!visited[parent]) {
+                visited[parent] = true;
+                stack.emplace_back(parent, 0);
+            }
+            continue;
+        }
+        order.push_back(t);
+        stack.pop_back();
+    }
+    order.pop_back(); // table itself
+
+    const auto cteName = [](TableId t) { return "subset_k" + std::to_string(t); };
+    // A composite key compares as a row value.
+    const auto list = [&](std::span<const ColumnId> columns) {
+        std::string result;
+        for(const ColumnId c : columns) result += (result.empty() ? "" : ", ") + quoteIdentifier(graph.columnName(c));
+        return result;
+    };
+    const auto row = [&](std::span<const ColumnId> columns) {
+        return columns.size() == 1 ? list(columns) : '(' + list(columns) + ')';
+    };
+    const auto filter = [&](TableId t) {
+        if(t == rootTable) return "WHERE " + rootCondition;
+        std::string where;
+        for(const LinkId l : graph.supporters(t)) {
+            const FkLink& link = graph.link(l);
+            where += (where.empty() ? "WHERE " : " AND ") + row(graph.childColumns(link)) + " IN (SELECT " +
+                list(graph.parentColumns(link)) + " FROM " + cteName(link.parent) + ")";
+        }
+        return where;
+    };
+
+    ServerClosure closure;
+    for(const TableId t : order) {
+        // Only the columns the closure reads of t.
+        std::vector<ColumnId> columns;
+        for(const LinkId l : graph.dependents(t)) {
+            const FkLink& link = graph.link(l);
+            if(!visited[link.child]) continue;
+            for(const ColumnId c : graph.parentColumns(link)) {
+                if(std::find(columns.begin(), columns.end(), c) == columns.end()) columns.push_back(c);
+            }
+        }
+        std::string select;
+        for(const ColumnId c : columns) select += (select.empty() ? "" : ", ") + quoteIdentifier(graph.columnName(c));
+        closure.with += (closure.with.empty() ? "WITH " : ",\n    ") + cteName(t) + " AS (SELECT " + select +
+            " FROM " + graph.tableName(t) + (t != rootTable && graph.supporters(t).empty() ? "" : " " + filter(t)) + ")";
+    }
+    if(!closure.with.empty()) closure.with += "\n";
+    closure.where = filter(table);
+    return closure;
+}
+
+} // namespace subset
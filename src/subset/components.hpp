@@ -0,0 +1,84 @@
+#pragma once
+
+#include "schema_graph.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace subset {
+
+// The strongly connected components of the FK graph. A component of one
+// table without a self-reference is acyclic; every other one contains a
+// cycle and has to be extracted as a unit.
+struct Components {
+    std::vector<std::vector<TableId>> members;
+    std::vector<std::uint32_t> of; // table -> component
+
+    std::uint32_t count() const { return static_cast<std::uint32_t>(members.size()); }
+
+    // Whether the link stays inside one component.
+    bool internal(const SchemaGraph& graph, LinkId l) const {
+        return of[graph.link(l).child] == of[graph.link(l).parent];
+    }
+
+    bool cyclic(const SchemaGraph& graph, std::uint32_t c) const {
+        if(members[c].size() > 1) return true;
+        const TableId t = members[c].front();
+        return std::any_of(graph.supporters(t).begin(), graph.supporters(t).end(),
+            [&](LinkId l) { return graph.link(l).parent == t; });
+    }
+};
+
+// Tarjan's algorithm with an explicit stack, so deep FK chains can't
+// overflow the call stack.
+inline Components stronglyConnectedComponents(const SchemaGraph& graph) {
+    constexpr std::uint32_t unvisited = std::numeric_limits<std::uint32_t>::max();
+    const TableId n = graph.tableCount();
+    Components result;
+    result.of.assign(n, unvisited);
+    std::vector<std::uint32_t> index(n, unvisited);
+    std::vector<std::uint32_t> lowLink(n, 0);
+    std::vector<bool> onStack(n, false);
+    std::vector<TableId> stack;
+    std::vector<std::pair<TableId, std::size_t>> calls; // table, next dependent
+    std::uint32_t counter = 0;
+
+    for(TableId root = 0; root < n; root++) {
+        if(index[root] != unvisited) continue;
+        calls.emplace_back(root, 0);
+        while(!calls.empty()) {
+            auto& [t, next] = calls.back();
+            if(next == 0 && index[t] == unvisited) {
+                index[t] = lowLink[t] = counter++;
+                stack.push_back(t);
+                onStack[t] = true;
+            }
+            const auto dependents = graph.dependents(t);
+            if(next < dependents.size()) {
+                const TableId child = graph.link(dependents[next++]).child;
+                if(index[child] == unvisited) calls.emplace_back(child, 0);
+                else if(onStack[child]) lowLink[t] = std::min(lowLink[t], index[child]);
+                continue;
+            }
+            if(lowLink[t] == index[t]) {
+                auto& members = result.members.emplace_back();
+                TableId member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    onStack[member] = false;
+                    result.of[member] = result.count() - 1;
+                    members.push_back(member);
+                } while(member != t);
+            }
+            const TableId finished = t;
+            calls.pop_back();
+            if(!calls.empty()) lowLink[calls.back().first] = std::min(lowLink[calls.back().first], lowLink[finished]);
+        }
+    }
+    return result;
+}
+
+} // namespace subset
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "sink.hpp"
+#include "task_pool.hpp"
+#include "trace.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+// One complete gzip member holding data. Concatenated members are a valid
+// gzip file, so chunks can be compressed independently.
+inline std::string gzipMember(std::string_view data, int level) {
+    z_stream stream{};
+    if(deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw std::runtime_error{"cannot initialize gzip compression"};
+    std::string out(deflateBound(&stream, static_cast<uLong>(data.size())), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+    const int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    if(result != Z_STREAM_END) throw std::runtime_error{"gzip compression failed"};
+    return out;
+}
+
+// Compresses what is written to it before passing it on. The data is cut
+// into chunks which are compressed on the pool, each into a gzip member of
+// its own, and written in order; write() only waits once maxInFlight chunks
+// are still being compressed.
+class GzipSink final : public Sink {
+public:
+    GzipSink(std::unique_ptr<Sink> out, TaskPool& pool, int level, std::size_t chunkSize, std::size_t maxInFlight = 4)
+        : out_{std::move(out)}, pool_{pool}, level_{level}, chunkSize_{chunkSize}, maxInFlight_{std::max<std::size_t>(maxInFlight, 1)} {
+        chunk_.reserve(chunkSize_);
+    }
+
+    GzipSink(const GzipSink&) = delete;
+    GzipSink& operator=(const GzipSink&) = delete;
+
+    ~GzipSink() override {
+        // The jobs refer to no state of the sink, but their results have to
+        // be waited for before the output goes.
+        for(auto& result : inFlight_) result.wait();
+    }
+
+    void write(std::string_view data) override {
+        chunk_.append(data);
+        if(chunk_.size() >= chunkSize_) submit();
+    }
+
+    void close() override {
+        submit();
+        while(!inFlight_.empty()) drain();
+        out_->close();
+    }
+
+private:
+    void submit() {
+        if(chunk_.empty()) return;
+        if(inFlight_.size() >= maxInFlight_) drain();
+        inFlight_.push_back(pool_.submit([chunk = std::move(chunk_), level = level_] {
+            const TraceSpan span{"compress", "gzip"};
+            return gzipMember(chunk, level);
+        }));
+        chunk_ = std::string{};
+        chunk_.reserve(chunkSize_);
+    }
+
+    void drain() {
+        std::string compressed;
+        {
+            const TraceSpan span{"compress", "gzip wait"};
+            compressed = inFlight_.front().get();
+        }
+        inFlight_.pop_front();
+        out_->write(compressed);
+    }
+
+    std::unique_ptr<Sink> out_;
+    TaskPool& pool_;
+    int level_;
+    std::size_t chunkSize_;
+    std::size_t maxInFlight_;
+    std::string chunk_;
+    std::deque<std::future<std::string>> inFlight_;
+};
+
+} // namespace subset
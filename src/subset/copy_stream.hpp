@@ -0,0 +1,154 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "live_metrics.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "sink.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Runs a `COPY ... TO STDOUT` statement and hands every data message, which
+// is one row for the text and CSV formats, to onRow straight from the libpq
+// buffer. Returns the number of messages received. The time to the first
+// one is the source's latency in the daemon's /metrics.
+template<typename F>
+std::uint64_t copyOut(pgfe::Connection& conn, const std::string& statement, F&& onRow) {
+    const Stopwatch stopwatch;
+    conn.execute_nio(statement);
+    conn.wait_response_throw();
+    std::uint64_t rows = 0;
+    {
+        pgfe::Copier copier = conn.copier();
+        if(!copier) throw std::logic_error{"statement didn't start COPY: " + statement};
+        while(const auto data = copier.receive()) {
+            if(rows == 0) liveMetrics().sourceLatency.observe(stopwatch.seconds());
+            sourceMessageBytes().observe(data.size());
+            onRow(std::string_view{static_cast<const char*>(data.bytes()), data.size()});
+            rows++;
+        }
+    }
+    conn.wait_response_throw();
+    conn.completion();
+    return rows;
+}
+
+// An open `COPY ... FROM STDIN` on a connection. Written data is gathered
+// into messages of up to bufferSize bytes; close() ends the COPY and waits
+// for the server to accept it. Destroying an unclosed instance makes the
+// server fail and discard the COPY.
+class CopyIn final : public Sink {
+public:
+    static constexpr std::size_t defaultBufferSize = 64 * 1024;
+
+    CopyIn(pgfe::Connection& conn, const std::string& statement, std::size_t bufferSize = defaultBufferSize)
+        : conn_{conn} {
+        conn_.execute_nio(statement);
+        conn_.wait_response_throw();
+        pgfe::Copier copier = conn_.copier();
+        if(!copier) throw std::logic_error{"statement didn't start COPY: " + statement};
+        writer_ = pgfe::Copier_writer{std::move(copier), bufferSize};
+    }
+
+    CopyIn(const CopyIn&) = delete;
+    CopyIn& operator=(const CopyIn&) = delete;
+
+    ~CopyIn() override {
+        if(!writer_) return;
+        try {
+            writer_.end("source extraction failed");
+            conn_.wait_response();
+            conn_.error();
+        } catch(...) {}
+    }
+
+    void write(std::string_view data) override { writer_.append(data); }
+
+    // Appends one row encoded in the text format of COPY.
+    template<typename... Types>
+    void writeRow(const Types&... fields) { writer_.append_row(fields...); }
+
+    // Appends one row encoded in the binary format, for a statement with
+    // (FORMAT binary); the fields must have the widths of their columns.
+    template<typename... Types>
+    void writeBinaryRow(const Types&... fields) { writer_.append_binary_row(fields...); }
+
+    void close() override {
+        const Stopwatch stopwatch;
+        writer_.end();
+        conn_.wait_response_throw();
+        conn_.completion();
+        liveMetrics().targetLatency.observe(stopwatch.seconds());
+    }
+
+private:
+    pgfe::Connection& conn_;
+    pgfe::Copier_writer writer_;
+};
+
+// The position of the newline ending the CSV record which i is in, or the
+// size of data if it's cut short; the quotes of a field always pair up, even
+// when doubled inside it.
+inline std::size_t csvRecordEnd(std::string_view data, std::size_t i) {
+    while(true) {
+        const std::size_t newline = std::min(data.find('\n', i), data.size());
+        const std::size_t quote = data.find('"', i);
+        if(quote >= newline) return newline;
+        const std::size_t close = data.find('"', quote + 1);
+        if(close == std::string_view::npos) return data.size();
+        i = close + 1;
+    }
+}
+
+// Calls onRecord(record) for every CSV record of data, which holds whole
+// ones, each with its newline.
+template<typename F>
+void forEachCsvRecord(std::string_view data, F&& onRecord) {
+    for(std::size_t i = 0; i < data.size();) {
+        const std::size_t end = std::min(csvRecordEnd(data, i) + 1, data.size());
+        onRecord(data.substr(i, end - i));
+        i = end;
+    }
+}
+
+// Calls onField(index, value, isNull) for every field of one CSV record as
+// produced by COPY ... (FORMAT csv): unquoted empty fields are NULL, quoted
+// fields have their doubled quotes undone. The trailing newline is ignored.
+template<typename F>
+void forEachCsvField(std::string_view record, F&& onField) {
+    if(!record.empty() && record.back() == '\n') record.remove_suffix(1);
+    std::size_t index = 0;
+    std::size_t i = 0;
+    std::string unquoted;
+    while(true) {
+        if(i < record.size() && record[i] == '"') {
+            unquoted.clear();
+            for(i++; i < record.size(); i++) {
+                if(record[i] == '"') {
+                    if(i + 1 < record.size() && record[i + 1] == '"') i++;
+                    else break;
+                }
+                unquoted += record[i];
+            }
+            i++; // closing quote
+            onField(index, std::string_view{unquoted}, false);
+        } else {
+            const std::size_t end = std::min(record.find(',', i), record.size());
+            onField(index, record.substr(i, end - i), end == i);
+            i = end;
+        }
+        if(i >= record.size()) break;
+        i++; // delimiter
+        index++;
+    }
+}
+
+} // namespace subset
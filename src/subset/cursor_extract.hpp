@@ -0,0 +1,68 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "live_metrics.hpp"
+#include "prepared_extract.hpp"
+#include "trace.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Extracts with a `DECLARE ... NO SCROLL CURSOR` for query, for middleware
+// which won't pass a COPY through, and fetches from it in rounds of depth
+// pipelined `FETCH FORWARD n`: a round is one round trip, and the server has
+// the next fetch of a round queued while the rows of the one before are
+// read. n is sized by sizer, in rows, for a fetch to take about its target.
+// The cursor needs a transaction, the one open or one of its own.
+// Calls onRow for every row and returns the number of rows.
+template<typename F>
+std::uint64_t extractCursor(pgfe::Connection& conn, const std::string& query, BatchSizer& sizer, F&& onRow,
+    std::size_t depth = 2) {
+    static const std::string name = "subset_cursor";
+    std::optional<pgfe::Transaction_guard> transaction;
+    if(!conn.is_transaction_uncommitted()) transaction.emplace(conn);
+    conn.execute("DECLARE " + name + " NO SCROLL CURSOR FOR " + query);
+    std::uint64_t rows = 0;
+    try {
+        for(bool done = false; !done;) {
+            const std::size_t size = sizer.size();
+            pgfe::Statement_vector fetches;
+            for(std::size_t i = 0; i < depth; i++)
+                fetches.append(pgfe::Statement{"FETCH FORWARD " + std::to_string(size) + ' ' + name});
+            std::uint64_t fetched = 0;
+            const Stopwatch stopwatch;
+            {
+                const TraceSpan span{"extract", "fetch"};
+                conn.execute_pipelined(fetches, [&](std::size_t, pgfe::Row&& r) {
+                    onRow(std::as_const(r));
+                    fetched++;
+                });
+            }
+            const double seconds = stopwatch.seconds();
+            // A round short of its rows reached the end of the cursor.
+            done = fetched < size * depth;
+            sizer.observe(static_cast<std::size_t>(fetched / depth), seconds / static_cast<double>(depth));
+            liveMetrics().sourceLatency.observe(seconds);
+            rows += fetched;
+        }
+    } catch(...) {
+        // With a transaction of its own the rollback closes the cursor.
+        if(!transaction && conn.is_ready_for_request()) {
+            try {
+                conn.execute("CLOSE " + name);
+            } catch(...) {}
+        }
+        throw;
+    }
+    conn.execute("CLOSE " + name);
+    if(transaction) transaction->commit();
+    return rows;
+}
+
+} // namespace subset
@@ -0,0 +1,327 @@
+#pragma once
+
+#include "../include/src/net/net.hpp"
+#include "../include/src/util/thread_pool.hpp"
+#include "live_metrics.hpp"
+#include "options.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <stop_token>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace net = dmitigr::net;
+
+// The protocol over the daemon's Unix socket: the client sends the count of
+// its arguments on a line, then each argument terminated by a NUL. The
+// daemon streams back what the job prints, then a NUL and its exit status.
+
+inline void writeAll(net::Descriptor& out, std::string_view data) {
+    while(!data.empty()) data.remove_prefix(static_cast<std::size_t>(out.write(data.data(), static_cast<std::streamsize>(data.size()))));
+}
+
+// Writes the pieces in turn by as few system calls as the descriptor allows,
+// without joining them first.
+inline void writeAll(net::Descriptor& out, std::vector<std::string_view> pieces) {
+    std::span<std::string_view> rest{pieces};
+    while(!rest.empty()) {
+        auto n = static_cast<std::size_t>(out.write(std::span<const std::string_view>{rest}));
+        while(!rest.empty() && n >= rest.front().size()) {
+            n -= rest.front().size();
+            rest = rest.subspan(1);
+        }
+        if(!rest.empty()) rest.front().remove_prefix(n);
+    }
+}
+
+// Forwards what a job prints to the client that submitted it.
+class DescriptorBuffer final : public std::streambuf {
+public:
+    explicit DescriptorBuffer(net::Descriptor& out) : out_{out} { setp(buffer_, buffer_ + sizeof(buffer_)); }
+
+    ~DescriptorBuffer() override { sync(); }
+
+protected:
+    int_type overflow(int_type c) override {
+        if(sync() != 0) return traits_type::eof();
+        if(!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        const std::string_view pending{pbase(), static_cast<std::size_t>(pptr() - pbase())};
+        setp(buffer_, buffer_ + sizeof(buffer_));
+        try {
+            writeAll(out_, pending);
+        } catch(const std::exception&) {
+            return -1; // the client went away; the job runs on
+        }
+        return 0;
+    }
+
+private:
+    net::Descriptor& out_;
+    char buffer_[4096];
+};
+
+inline std::vector<std::string> readJob(net::Descriptor& in) {
+    std::string data;
+    char chunk[4096];
+    std::size_t count = 0;
+    std::size_t header = std::string::npos;
+    std::vector<std::string> args;
+    while(true) {
+        if(header == std::string::npos) {
+            if(const auto eol = data.find('\n'); eol != std::string::npos) {
+                try {
+                    count = std::stoul(data.substr(0, eol));
+                } catch(const std::exception&) {
+                    throw std::runtime_error{"malformed daemon job"};
+                }
+                header = eol + 1;
+            }
+        }
+        if(header != std::string::npos) {
+            args.clear();
+            for(std::size_t first = header; args.size() < count;) {
+                const auto end = data.find('\0', first);
+                if(end == std::string::npos) break;
+                args.push_back(data.substr(first, end - first));
+                first = end + 1;
+            }
+            if(args.size() == count) return args;
+        }
+        const auto n = in.read(chunk, sizeof(chunk));
+        if(n <= 0) throw std::runtime_error{"truncated daemon job"};
+        data.append(chunk, static_cast<std::size_t>(n));
+    }
+}
+
+// A client whose job has been read, with the error if it couldn't be.
+struct PendingJob {
+    std::unique_ptr<net::Descriptor> client;
+    std::vector<std::string> args;
+    std::string error;
+};
+
+// Runs one job of a client, then sends back its exit status.
+inline void runPendingJob(PendingJob& pending, std::uint64_t number, const std::function<int(const Options&)>& job) {
+    auto& client = *pending.client;
+    int status = 1;
+    std::string error = std::move(pending.error);
+    if(error.empty()) {
+        try {
+            auto& args = pending.args;
+            args.insert(args.begin(), "cpp_schema");
+            std::vector<char*> argv;
+            for(auto& arg : args) argv.push_back(arg.data());
+            const Options options = parseOptions(static_cast<int>(argv.size()), argv.data());
+            if(!options.daemon.empty()) throw std::invalid_argument{"a job can't start a daemon"};
+
+            DescriptorBuffer buffer{client};
+            struct Redirect {
+                std::streambuf* previous;
+                ~Redirect() { std::cout.rdbuf(previous); }
+            } redirect{std::cout.rdbuf(&buffer)};
+            try {
+                status = job(options);
+            } catch(...) {
+                std::cout.flush();
+                throw;
+            }
+            std::cout.flush();
+        } catch(const std::exception& e) {
+            error = e.what();
+        }
+    }
+    liveMetrics().endJob(status == 0 && error.empty());
+    std::cout << "job " << number << " exited with " << status << (error.empty() ? "" : ": " + error) << std::endl;
+    try {
+        const auto trailer = '\0' + std::to_string(status) + '\n';
+        writeAll(client, {error.empty() ? "" : "Oops: ", error, error.empty() ? "" : "\n", trailer});
+        client.close();
+    } catch(const std::exception&) {}
+}
+
+// Serves jobs on a Unix socket for as long as the process lives. A job sees
+// the daemon's arguments reparsed from its own, and what it prints on
+// std::cout goes back to its client.
+//
+// The connections are accepted as soon as they arrive and their jobs are
+// read by a pool of threads, so a client is never refused or held up by
+// another that is slow to send its job. The jobs themselves run one at a
+// time in the order they were read, since they share the session and
+// std::cout.
+inline void serveJobs(const std::filesystem::path& socket, const std::function<int(const Options&)>& job) {
+    // A socket left behind by a daemon that died.
+    if(std::filesystem::is_socket(socket)) std::filesystem::remove(socket);
+    const auto listener = net::Listener::make({socket, 128});
+    listener->listen();
+    std::cout << "listening on " << socket.string() << std::endl;
+
+    std::mutex mutex;
+    std::condition_variable_any ready;
+    std::deque<PendingJob> queue;
+    const std::jthread runner{[&](std::stop_token stop) {
+        for(std::uint64_t jobs = 1;; jobs++) {
+            PendingJob pending;
+            {
+                std::unique_lock lock{mutex};
+                if(!ready.wait(lock, stop, [&] { return !queue.empty(); })) return;
+                pending = std::move(queue.front());
+                queue.pop_front();
+                liveMetrics().jobsQueued.store(queue.size(), std::memory_order_relaxed);
+            }
+            liveMetrics().startJob(jobs);
+            runPendingJob(pending, jobs, job);
+        }
+    }};
+
+    dmitigr::util::Thread_pool readers{std::clamp(std::thread::hardware_concurrency(), 2u, 16u)};
+    std::vector<std::unique_ptr<net::Descriptor>> accepted;
+    while(true) {
+        listener->wait();
+        listener->accept_pending(accepted);
+        for(auto& client : accepted) {
+            readers.submit([&, client = std::move(client)]() mutable {
+                PendingJob pending{std::move(client), {}, {}};
+                try {
+                    pending.args = readJob(*pending.client);
+                } catch(const std::exception& e) {
+                    pending.error = e.what();
+                }
+                {
+                    const std::lock_guard lock{mutex};
+                    queue.push_back(std::move(pending));
+                    liveMetrics().jobsQueued.store(queue.size(), std::memory_order_relaxed);
+                }
+                ready.notify_one();
+            });
+        }
+        accepted.clear();
+    }
+}
+
+// Serves GET /metrics over HTTP on a thread of its own, one request per
+// connection. A scrape reads the counters and nothing a worker waits on.
+class MetricsServer {
+public:
+    // listen is host:port.
+    explicit MetricsServer(const std::string& listen) {
+        const auto colon = listen.rfind(':');
+        if(colon == std::string::npos) throw std::invalid_argument{"invalid --metrics-listen: " + listen};
+        int port = 0;
+        try {
+            port = std::stoi(listen.substr(colon + 1));
+        } catch(const std::exception&) {
+            throw std::invalid_argument{"invalid --metrics-listen: " + listen};
+        }
+        listener_ = net::Listener::make({listen.substr(0, colon), port, 16});
+        listener_->listen();
+        thread_ = std::jthread{[this](std::stop_token stop) {
+            while(!stop.stop_requested()) {
+                if(!listener_->wait(std::chrono::milliseconds{250})) continue;
+                try {
+                    const auto client = listener_->accept();
+                    serve(*client);
+                } catch(const std::exception&) {} // the scraper went away
+            }
+        }};
+    }
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+private:
+    static void serve(net::Descriptor& client) {
+        std::string request;
+        char chunk[1024];
+        while(request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+            const auto n = client.read(chunk, sizeof(chunk));
+            if(n <= 0) return;
+            request.append(chunk, static_cast<std::size_t>(n));
+        }
+        const std::string_view line{request.data(), request.find("\r\n")};
+        const bool metrics = line.starts_with("GET /metrics ") || line.starts_with("GET /metrics?");
+        const std::string body = metrics ? liveMetrics().text() : "not found\n";
+        const std::string head = std::string{metrics ? "HTTP/1.1 200 OK" : "HTTP/1.1 404 Not Found"} +
+            "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) +
+            "\r\nConnection: close\r\n\r\n";
+        writeAll(client, {head, body});
+        client.close();
+    }
+
+    std::unique_ptr<net::Listener> listener_;
+    std::jthread thread_; // last, to stop first
+};
+
+// The socket and the job's arguments when they carry --connect, which
+// hands the job to a daemon.
+inline std::optional<std::pair<std::filesystem::path, std::vector<std::string>>> daemonClientArgs(int argc, char** argv) {
+    std::optional<std::pair<std::filesystem::path, std::vector<std::string>>> result;
+    std::vector<std::string> args;
+    for(int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if(arg == "--connect" && i + 1 < argc) result.emplace(argv[++i], std::vector<std::string>{});
+        else if(arg.substr(0, 10) == "--connect=") result.emplace(std::string{arg.substr(10)}, std::vector<std::string>{});
+        else args.emplace_back(arg);
+    }
+    if(result) result->second = std::move(args);
+    return result;
+}
+
+// Submits a job to the daemon, printing what it prints. Returns its exit
+// status.
+inline int submitJob(const std::filesystem::path& socket, const std::vector<std::string>& args) {
+    const auto conn = net::make_tcp_connection(net::Client_options{socket}.set_connect_timeout(std::chrono::seconds{10}));
+    const auto count = std::to_string(args.size()) + '\n';
+    std::vector<std::string_view> request{count};
+    for(const auto& arg : args) {
+        request.emplace_back(arg.c_str(), arg.size() + 1); // with its NUL
+    }
+    writeAll(*conn, std::move(request));
+
+    std::string trailer;
+    bool ended = false;
+    char chunk[4096];
+    while(true) {
+        const auto n = conn->read(chunk, sizeof(chunk));
+        if(n <= 0) break;
+        std::string_view data{chunk, static_cast<std::size_t>(n)};
+        if(!ended) {
+            const auto end = data.find('\0');
+            std::cout.write(data.data(), static_cast<std::streamsize>(std::min(end, data.size())));
+            if(end == std::string_view::npos) continue;
+            ended = true;
+            data.remove_prefix(end + 1);
+        }
+        trailer += data;
+    }
+    std::cout.flush();
+    if(!ended) throw std::runtime_error{"the daemon hung up before the job ended"};
+    return std::stoi(trailer);
+}
+
+} // namespace subset
@@ -0,0 +1,291 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "log.hpp"
+#include "schema_graph.hpp"
+#include "sql.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The indexes and foreign keys of the target tables, dropped before the
+// load and built again after it: once over the loaded rows is cheaper than
+// maintaining them row by row. The indexes are built side by side on as
+// many connections, the primary key and unique constraints attached to
+// theirs afterwards, and the foreign keys added NOT VALID and then
+// validated side by side, which checks them in one join each. With
+// keepUnique the unique indexes stay, for a load resolving conflicts on
+// them. Partitioned tables and exclusion constraints are left alone, as is
+// an index a foreign key kept in place depends on. What builds them again is
+// written to a file before anything is dropped, and kept there until it has
+// run, so that a run which dies in between leaves it to the next one.
+class DeferredIndexes {
+public:
+    // The file with what a run has yet to build again.
+    static std::filesystem::path pendingFile(const std::filesystem::path& dir) { return dir / "deferred_indexes.sql"; }
+
+    // Picks up what a run which didn't finish dropped, from its file.
+    explicit DeferredIndexes(const std::filesystem::path& file) : file_{file}, dropped_{true} {
+        std::ifstream in{file_};
+        for(std::string line; std::getline(in, line);) {
+            if(line.size() < 3 || line[1] != ' ') throw std::runtime_error{"malformed line in " + file_.string() + ": " + line};
+            std::string text;
+            for(std::size_t i = 2; i < line.size(); i++) {
+                if(line[i] == '\\' && i + 1 < line.size()) text += line[++i] == 'n' ? '\n' : line[i];
+                else text += line[i];
+            }
+            statements_.push_back({static_cast<Kind>(line[0]), std::move(text)});
+        }
+        if(!in.eof()) throw std::runtime_error{"cannot read " + file_.string()};
+    }
+
+    DeferredIndexes(pgfe::Connection& conn, const SchemaGraph& graph, const std::string& schema, bool keepUnique,
+        std::filesystem::path file)
+        : file_{std::move(file)} {
+        using dmitigr::pgfe::to;
+        conn.execute([&](auto&& r) {
+            if(!graph.findTable(to<std::string>(r["table_name"]))) return;
+            const auto type = to<std::string>(r["constraint_type"]);
+            if(type == "x" || (keepUnique && to<bool>(r["is_unique"]))) return;
+            indexes_.push_back({to<std::string>(r["relation"]), to<std::string>(r["index_relation"]),
+                to<std::string>(r["index_name"]), to<std::string>(r["definition"]), to<std::string>(r["constraint_name"]),
+                type == "p" ? "PRIMARY KEY" : type == "u" ? "UNIQUE" : "",
+                to<bool>(r["deferrable"]), to<bool>(r["deferred"])});
+        }, R"(
+            SELECT c.relname AS table_name, c.oid::regclass::text AS relation,
+                i.indexrelid::regclass::text AS index_relation, ic.relname AS index_name,
+                pg_catalog.pg_get_indexdef(i.indexrelid) AS definition, i.indisunique AS is_unique,
+                coalesce(con.conname, '') AS constraint_name, coalesce(con.contype::text, '') AS constraint_type,
+                coalesce(con.condeferrable, false) AS deferrable, coalesce(con.condeferred, false) AS deferred
+            FROM pg_catalog.pg_index i
+            JOIN pg_catalog.pg_class c ON c.oid = i.indrelid
+            JOIN pg_catalog.pg_class ic ON ic.oid = i.indexrelid
+            JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+            LEFT JOIN pg_catalog.pg_constraint con
+                ON con.conindid = i.indexrelid AND con.conrelid = c.oid AND con.contype IN ('p', 'u', 'x')
+            WHERE n.nspname = $1 AND c.relkind = 'r' AND NOT c.relispartition AND i.indisvalid
+            ORDER BY c.relname, ic.relname)", schema);
+
+        // Every foreign key into or out of the schema: those of the tables
+        // and those which reference an index going away.
+        struct Candidate {
+            ForeignKey key;
+            bool loaded;   // on a table of the load
+            bool plain;    // on a table which is not partitioned, nor a partition
+            std::string referencedIndex;
+        };
+        std::vector<Candidate> candidates;
+        conn.execute([&](auto&& r) {
+            candidates.push_back({{to<std::string>(r["relation"]), to<std::string>(r["constraint_name"]),
+                to<std::string>(r["definition"]), to<bool>(r["validated"])},
+                to<std::string>(r["schema_name"]) == schema && graph.findTable(to<std::string>(r["table_name"])),
+                to<bool>(r["plain"]), to<std::string>(r["referenced_index"])});
+        }, R"(
+            SELECT n.nspname AS schema_name, c.relname AS table_name, c.oid::regclass::text AS relation,
+                con.conname AS constraint_name, pg_catalog.pg_get_constraintdef(con.oid) AS definition,
+                con.convalidated AS validated, con.conindid::regclass::text AS referenced_index,
+                c.relkind = 'r' AND NOT c.relispartition AS plain
+            FROM pg_catalog.pg_constraint con
+            JOIN pg_catalog.pg_class c ON c.oid = con.conrelid
+            JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+            JOIN pg_catalog.pg_class r ON r.oid = con.confrelid
+            JOIN pg_catalog.pg_namespace rn ON rn.oid = r.relnamespace
+            WHERE con.contype = 'f' AND con.conparentid = 0 AND (n.nspname = $1 OR rn.nspname = $1)
+            ORDER BY c.relname, con.conname)", schema);
+
+        // A foreign key which can't be added NOT VALID again stays, and so
+        // does the index it references.
+        std::set<std::string> pinned;
+        for(const auto& candidate : candidates) {
+            if(!candidate.plain) pinned.insert(candidate.referencedIndex);
+        }
+        std::erase_if(indexes_, [&](const Index& index) { return pinned.count(index.relation); });
+        std::set<std::string> dropped;
+        for(const auto& index : indexes_) dropped.insert(index.relation);
+        for(auto& candidate : candidates) {
+            if(candidate.plain && (candidate.loaded || dropped.count(candidate.referencedIndex)))
+                foreignKeys_.push_back(std::move(candidate.key));
+        }
+
+        for(const auto& index : indexes_) statements_.push_back({Kind::index, index.definition});
+        for(const auto& index : indexes_) {
+            if(index.constraint.empty()) continue;
+            statements_.push_back({Kind::constraint, "ALTER TABLE " + index.table + " ADD CONSTRAINT " +
+                quoteIdentifier(index.constraint) + ' ' + index.constraintType + " USING INDEX " + quoteIdentifier(index.name) +
+                (index.deferrable ? " DEFERRABLE" : "") + (index.deferred ? " INITIALLY DEFERRED" : "")});
+        }
+        for(const auto& key : foreignKeys_) {
+            const std::string alter = "ALTER TABLE " + key.table;
+            statements_.push_back({Kind::foreignKey, alter + " ADD CONSTRAINT " + quoteIdentifier(key.name) + ' ' +
+                key.definition + (key.validated ? " NOT VALID" : "")});
+            if(key.validated) statements_.push_back({Kind::validation, alter + " VALIDATE CONSTRAINT " + quoteIdentifier(key.name)});
+        }
+    }
+
+    std::size_t indexCount() const { return count(Kind::index); }
+    std::size_t foreignKeyCount() const { return count(Kind::foreignKey); }
+
+    // Writes the file, then drops them all in one transaction, the foreign
+    // keys first. A drop rolled back takes the file with it; one whose
+    // commit failed may have happened, and leaves it.
+    void drop(pgfe::Connection& conn) {
+        save(statements_);
+        pgfe::Transaction_guard transaction{conn};
+        try {
+            for(const auto& key : foreignKeys_)
+                conn.execute("ALTER TABLE " + key.table + " DROP CONSTRAINT " + quoteIdentifier(key.name));
+            for(const auto& index : indexes_) {
+                if(index.constraint.empty()) conn.execute("DROP INDEX " + index.relation);
+                else conn.execute("ALTER TABLE " + index.table + " DROP CONSTRAINT " + quoteIdentifier(index.constraint));
+            }
+        } catch(...) {
+            std::filesystem::remove(file_);
+            throw;
+        }
+        transaction.commit();
+        dropped_ = true;
+    }
+
+    // Builds them again on up to jobs connections of pool, each allowed
+    // maintenanceWorkers parallel workers per index when not 0. Every
+    // statement is tried; those that failed are listed by the exception
+    // thrown at the end, to be run by hand, and are what the file keeps.
+    void rebuild(pgfe::Connection_pool& pool, std::size_t jobs, std::size_t maintenanceWorkers, Logger& logger) {
+        if(!dropped_) return;
+        dropped_ = false;
+        std::vector<pgfe::Connection_pool::Handle> conns;
+        for(std::size_t i = 0; i < std::max<std::size_t>(jobs, 1); i++) {
+            conns.push_back(pool.acquire());
+            if(maintenanceWorkers)
+                conns.back()->execute("SET max_parallel_maintenance_workers = " + std::to_string(maintenanceWorkers));
+        }
+        std::mutex mutex;
+        std::vector<Statement> failed;
+        const auto run = [&](pgfe::Connection& conn, const Statement& statement) {
+            try {
+                conn.execute(statement.text);
+                logger.debug([&] { return "Rebuilt: " + statement.text; });
+            } catch(const std::exception& e) {
+                logger.warn([&] { return "Rebuild failed: " + statement.text + ": " + e.what(); });
+                std::lock_guard lock{mutex};
+                failed.push_back(statement);
+            }
+        };
+        // Statements on one table wait for each other's locks, but never in
+        // a cycle: of the locks taken side by side only those on the table
+        // built or validated conflict.
+        const auto runParallel = [&](Kind kind) {
+            std::vector<const Statement*> statements;
+            for(const auto& statement : statements_) {
+                if(statement.kind == kind) statements.push_back(&statement);
+            }
+            std::atomic<std::size_t> next = 0;
+            std::vector<std::thread> threads;
+            for(auto& conn : conns) {
+                threads.emplace_back([&, c = &*conn] {
+                    for(auto i = next++; i < statements.size(); i = next++) run(*c, *statements[i]);
+                });
+            }
+            for(auto& thread : threads) thread.join();
+        };
+        const auto runSerial = [&](Kind kind) {
+            for(const auto& statement : statements_) {
+                if(statement.kind == kind) run(*conns.front(), statement);
+            }
+        };
+
+        runParallel(Kind::index);
+        runSerial(Kind::constraint);
+        runSerial(Kind::foreignKey);
+        runParallel(Kind::validation);
+        if(maintenanceWorkers) {
+            for(auto& conn : conns) conn->execute("RESET max_parallel_maintenance_workers");
+        }
+
+        if(failed.empty()) {
+            std::filesystem::remove(file_);
+            return;
+        }
+        save(failed);
+        std::string message = "rebuilding the deferred indexes and foreign keys failed; still to run, as kept in " +
+            file_.string() + ":";
+        for(const auto& statement : failed) message += "\n" + statement.text + ";";
+        throw std::runtime_error{message};
+    }
+
+private:
+    // How a statement is run: the indexes and the validations side by side,
+    // the constraints and the foreign keys one by one.
+    enum class Kind : char { index = 'i', constraint = 'c', foreignKey = 'f', validation = 'v' };
+
+    struct Statement {
+        Kind kind;
+        std::string text;
+    };
+
+    std::size_t count(Kind kind) const {
+        return static_cast<std::size_t>(std::count_if(statements_.begin(), statements_.end(),
+            [kind](const Statement& s) { return s.kind == kind; }));
+    }
+
+    // A statement a line, after its kind; written whole before it replaces
+    // the file.
+    void save(const std::vector<Statement>& statements) const {
+        const std::filesystem::path temporary = file_.string() + ".tmp";
+        {
+            std::ofstream out{temporary, std::ios::trunc};
+            for(const auto& statement : statements) {
+                out << static_cast<char>(statement.kind) << ' ';
+                for(const char c : statement.text) {
+                    if(c == '\\') out << "\\\\";
+                    else if(c == '\n') out << "\\n";
+                    else out << c;
+                }
+                out << '\n';
+            }
+            out.flush();
+            if(!out) throw std::runtime_error{"cannot write " + temporary.string()};
+        }
+        std::filesystem::rename(temporary, file_);
+    }
+
+    struct Index {
+        std::string table;      // regclass text
+        std::string relation;   // of the index, regclass text
+        std::string name;       // of the index, unqualified
+        std::string definition; // CREATE INDEX
+        std::string constraint; // the primary key or unique constraint backed by it, if any
+        std::string constraintType;
+        bool deferrable;
+        bool deferred;
+    };
+
+    struct ForeignKey {
+        std::string table;
+        std::string name;
+        std::string definition; // pg_get_constraintdef, with NOT VALID if it was
+        bool validated;
+    };
+
+    std::filesystem::path file_;
+    std::vector<Index> indexes_;
+    std::vector<ForeignKey> foreignKeys_;
+    std::vector<Statement> statements_;
+    bool dropped_ = false;
+};
+
+} // namespace subset
@@ -0,0 +1,493 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "catalog_snapshot.hpp"
+#include "graph_cache.hpp"
+#include "log.hpp"
+#include "options.hpp"
+#include "pg_types.hpp"
+#include "schema_graph.hpp"
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+inline std::string getChildrenQuery = R"(SELECT
+        kcu.table_schema,
+        kcu.constraint_name,
+        kcu.table_name as "tableName",
+        kcu.column_name,
+        fk.table_schema AS foreign_table_schema,
+        fk.table_name AS foreign_table_name,
+        fk.column_name AS foreign_column_name
+        FROM information_schema.referential_constraints AS rc
+        JOIN information_schema.key_column_usage AS kcu
+        ON kcu.constraint_schema = rc.constraint_schema
+        AND kcu.constraint_name = rc.constraint_name
+        JOIN information_schema.key_column_usage AS fk
+        ON fk.constraint_schema = rc.unique_constraint_schema
+        AND fk.constraint_name = rc.unique_constraint_name
+        AND fk.ordinal_position = kcu.position_in_unique_constraint
+        WHERE kcu.table_schema='public'
+        AND fk.table_name =')";
+
+inline std::string getSupportersQuery = R"(SELECT
+        kcu.table_schema,
+        kcu.constraint_name,
+        kcu.table_name as "tableName",
+        kcu.column_name,
+        fk.table_schema AS foreign_table_schema,
+        fk.table_name AS foreign_table_name,
+        fk.column_name AS foreign_column_name
+        FROM information_schema.referential_constraints AS rc
+        JOIN information_schema.key_column_usage AS kcu
+        ON kcu.constraint_schema = rc.constraint_schema
+        AND kcu.constraint_name = rc.constraint_name
+        JOIN information_schema.key_column_usage AS fk
+        ON fk.constraint_schema = rc.unique_constraint_schema
+        AND fk.constraint_name = rc.unique_constraint_name
+        AND fk.ordinal_position = kcu.position_in_unique_constraint
+        WHERE kcu.table_schema='public'
+        AND kcu.table_name =')";
+
+inline std::string getTableFieldsAndDataTypes(const std::string& tableName) {
+    return R"(
+        SELECT column_name, is_nullable, data_type
+        FROM information_schema.columns WHERE table_name = ')" + tableName + "'";
+}
+
+// The column pairs of a composite key come in their order, one after another.
+inline std::string getSupporterQuery(const std::string& tableName) {
+    return getSupportersQuery + tableName + "' ORDER BY kcu.constraint_name, kcu.ordinal_position";
+}
+
+inline std::string getForeignKeyQuery(const std::string& tableName) {
+    return getChildrenQuery + tableName + "' ORDER BY kcu.table_name, kcu.constraint_name, kcu.ordinal_position";
+}
+
+// Every FK edge of the schema, one row per referencing column, the columns
+// of a composite key in their order.
+inline const std::string catalogEdgesSelect = R"(
+        SELECT
+            child.relname AS "tableName",
+            ca.attname AS column_name,
+            parent.relname AS foreign_table_name,
+            pa.attname AS foreign_column_name,
+            con.conname AS constraint_name
+        FROM pg_catalog.pg_constraint con
+        JOIN pg_catalog.pg_class child ON child.oid = con.conrelid
+        JOIN pg_catalog.pg_class parent ON parent.oid = con.confrelid
+        JOIN pg_catalog.pg_namespace n ON n.oid = child.relnamespace
+        CROSS JOIN LATERAL unnest(con.conkey, con.confkey) WITH ORDINALITY AS k(child_attnum, parent_attnum, position)
+        JOIN pg_catalog.pg_attribute ca ON ca.attrelid = con.conrelid AND ca.attnum = k.child_attnum
+        JOIN pg_catalog.pg_attribute pa ON pa.attrelid = con.confrelid AND pa.attnum = k.parent_attnum
+        WHERE con.contype = 'f' AND n.nspname = $1)";
+
+inline const std::string catalogEdgesQuery = catalogEdgesSelect + R"(
+        ORDER BY con.oid, k.position)";
+
+// The FK edges from or to the tables of $2.
+inline const std::string catalogTableEdgesQuery = catalogEdgesSelect + R"(
+        AND (child.relname = ANY($2) OR parent.relname = ANY($2))
+        ORDER BY con.oid, k.position)";
+
+// Every column of every ordinary or partitioned table of the schema.
+inline const std::string catalogColumnsSelect = R"(
+        SELECT
+            c.relname AS table_name,
+            a.attname AS column_name,
+            NOT a.attnotnull AS is_nullable,
+            format_type(a.atttypid, NULL) AS data_type,
+            a.atttypid::int8 AS type_oid
+        FROM pg_catalog.pg_attribute a
+        JOIN pg_catalog.pg_class c ON c.oid = a.attrelid
+        JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+        WHERE n.nspname = $1
+        AND c.relkind IN ('r', 'p')
+        AND a.attnum > 0
+        AND NOT a.attisdropped)";
+
+inline const std::string catalogColumnsQuery = catalogColumnsSelect;
+
+// The columns of the tables of $2.
+inline const std::string catalogTableColumnsQuery = catalogColumnsSelect + R"(
+        AND c.relname = ANY($2))";
+
+// Adds to snapshot the edges and columns the queries return.
+template<typename... Args>
+void readCatalog(pgfe::Connection& conn, CatalogSnapshot& snapshot, const std::string& edgesQuery,
+    const std::string& columnsQuery, const Args&... args) {
+    using dmitigr::pgfe::to;
+    using Field = pgfe::Field_ref;
+    const Field childTable{"tableName"}, childColumn{"column_name"}, parentTable{"foreign_table_name"},
+        parentColumn{"foreign_column_name"}, constraint{"constraint_name"};
+    conn.execute([&](auto&& r) {
+        snapshot.addEdge(FkEdge{to<std::string>(r[childTable]), to<std::string>(r[childColumn]),
+            to<std::string>(r[parentTable]), to<std::string>(r[parentColumn]), to<std::string>(r[constraint])});
+    }, edgesQuery, args...);
+    const Field tableName{"table_name"}, columnName{"column_name"}, isNullable{"is_nullable"}, dataType{"data_type"},
+        typeOid{"type_oid"};
+    conn.execute([&](auto&& r) {
+        snapshot.columns[to<std::string>(r[tableName])].push_back(ColumnDef{
+            to<std::string>(r[columnName]), to<bool>(r[isNullable]) != 0,
+            to<std::string>(r[dataType]), static_cast<Oid>(to<std::int64_t>(r[typeOid]))});
+    }, columnsQuery, args...);
+}
+
+inline CatalogSnapshot loadCatalogSnapshot(pgfe::Connection& conn, const std::string& schema) {
+    CatalogSnapshot snapshot;
+    readCatalog(conn, snapshot, catalogEdgesQuery, catalogColumnsQuery, schema);
+    return snapshot;
+}
+
+// Brings snapshot up to the fingerprints, read just before: the tables
+// whose fingerprint changed, or which were dropped or created since, are
+// read again, their columns and the edges from or to them, and the rest is
+// kept as it is. Returns how many tables were read again.
+inline std::size_t refreshCatalogSnapshot(pgfe::Connection& conn, const std::string& schema, CatalogSnapshot& snapshot,
+    TableFingerprints fingerprints) {
+    std::unordered_set<std::string> changed;
+    for(const auto& [table, fingerprint] : fingerprints) {
+        const auto it = snapshot.fingerprints.find(table);
+        if(it == snapshot.fingerprints.end() || it->second != fingerprint) changed.insert(table);
+    }
+    for(const auto& [table, fingerprint] : snapshot.fingerprints) {
+        if(!fingerprints.contains(table)) changed.insert(table);
+    }
+    if(!changed.empty()) {
+        CatalogSnapshot patched;
+        for(auto& edge : snapshot.edges) {
+            if(!changed.contains(edge.childTable) && !changed.contains(edge.parentTable)) patched.addEdge(std::move(edge));
+        }
+        for(auto& [table, columns] : snapshot.columns) {
+            if(!changed.contains(table)) patched.columns.emplace(table, std::move(columns));
+        }
+        const std::vector<std::optional<std::string>> tables(changed.begin(), changed.end());
+        readCatalog(conn, patched, catalogTableEdgesQuery, catalogTableColumnsQuery, schema, tables);
+        snapshot = std::move(patched);
+    }
+    snapshot.fingerprints = std::move(fingerprints);
+    return changed.size();
+}
+
+// A foreign key of a table's dependents, the child's columns in the order
+// of the parent's.
+struct DependentKey {
+    std::string child;
+    std::string constraint;
+    std::vector<std::string> childColumns;
+    std::vector<std::string> parentColumns;
+};
+
+// The tables discovery reaches from the root, as their foreign keys are
+// fetched. With --traversal=all every table reached is expanded both ways,
+// to its dependents and to its supporters; with dependents only the root
+// and the tables reached through dependents are, and the supporters they
+// reach only go on to their own supporters, not to their other dependents.
+// --max-depth counts the dependent hops from the root, supporters being
+// followed regardless for the rows which need them. The tables and foreign
+// keys excluded are never followed; the graph is every foreign key among
+// the tables reached.
+class Frontier {
+public:
+    explicit Frontier(const Options& options)
+        : dependentsOnly_{options.traversal == Traversal::dependents}, maxDepth_{options.maxDepth},
+          excludedTables_{options.excludedTables.begin(), options.excludedTables.end()},
+          excludedEdges_{options.excludedEdges.begin(), options.excludedEdges.end()} {
+        reach(options.rootTable, true, 0);
+    }
+
+    // The tables reached and not fetched yet, in the order reached.
+    std::vector<std::string> take() { return std::exchange(unfetched_, {}); }
+
+    // The dependents and the supporters of a table take() returned.
+    void fetched(const std::string& table, std::vector<DependentKey> dependents, std::vector<std::string> supporters) {
+        State& state = states_.at(table);
+        state.fetched = true;
+        state.dependents = std::move(dependents);
+        state.supporters = std::move(supporters);
+        ready_.push_back(table);
+        while(!ready_.empty()) {
+            const std::string next = std::move(ready_.back());
+            ready_.pop_back();
+            expand(next);
+        }
+    }
+
+    // The tables reached, the root first.
+    const std::vector<std::string>& tables() const { return order_; }
+
+    // Adds the foreign keys among the tables reached.
+    void addLinks(SchemaGraphBuilder& graph) const {
+        for(const auto& table : order_) {
+            for(const auto& key : states_.at(table).dependents) {
+                if(states_.contains(key.child) && !excluded(key.child, table))
+                    graph.addLink(key.child, key.childColumns, table, key.parentColumns);
+            }
+        }
+    }
+
+private:
+    struct State {
+        bool down = false; // reached through dependents, or the root
+        std::size_t depth = 0;
+        bool fetched = false;
+        std::vector<DependentKey> dependents;
+        std::vector<std::string> supporters;
+    };
+
+    bool excluded(const std::string& child, const std::string& parent) const {
+        return excludedEdges_.contains({child, parent});
+    }
+
+    // A table reached a better way than before is expanded again.
+    void reach(const std::string& table, bool down, std::size_t depth) {
+        if(excludedTables_.contains(table)) return;
+        const auto [it, added] = states_.try_emplace(table);
+        State& state = it->second;
+        if(added) {
+            order_.push_back(table);
+            unfetched_.push_back(table);
+        } else if(!(down && (!state.down || depth < state.depth))) return;
+        state.down = down;
+        state.depth = depth;
+        if(state.fetched) ready_.push_back(table);
+    }
+
+    void expand(const std::string& table) {
+        const State& state = states_.at(table);
+        if(state.down && (!maxDepth_ || state.depth < maxDepth_)) {
+            for(const auto& key : state.dependents) {
+                if(!excluded(key.child, table)) reach(key.child, true, state.depth + 1);
+            }
+        }
+        for(const auto& supporter : state.supporters) {
+            if(!excluded(table, supporter)) reach(supporter, !dependentsOnly_ && state.down, state.depth);
+        }
+    }
+
+    bool dependentsOnly_;
+    std::size_t maxDepth_;
+    std::unordered_set<std::string> excludedTables_;
+    std::set<std::pair<std::string, std::string>> excludedEdges_;
+    std::unordered_map<std::string, State> states_;
+    std::vector<std::string> order_;
+    std::vector<std::string> unfetched_;
+    std::vector<std::string> ready_;
+};
+
+// Runs the BFS from the root entirely in memory over a catalog snapshot.
+inline void discoverFromSnapshot(const CatalogSnapshot& snapshot, const Options& options, SchemaGraphBuilder& graph,
+    Logger& logger) {
+    static const std::vector<std::size_t> noEdges;
+    const auto edgesOf = [](const auto& index, const std::string& table) -> const std::vector<std::size_t>& {
+        const auto it = index.find(table);
+        return it != index.end() ? it->second : noEdges;
+    };
+
+    Frontier frontier{options};
+    graph.table(options.rootTable);
+    for(auto tables = frontier.take(); !tables.empty(); tables = frontier.take()) {
+        for(const auto& currentTable : tables) {
+            std::vector<DependentKey> dependents;
+            for(const std::size_t i : edgesOf(snapshot.childEdges, currentTable)) {
+                const FkEdge& edge = snapshot.edges[i];
+                if(dependents.empty() || dependents.back().child != edge.childTable || dependents.back().constraint != edge.constraint)
+                    dependents.push_back({edge.childTable, edge.constraint, {}, {}});
+                dependents.back().childColumns.push_back(edge.childColumn);
+                dependents.back().parentColumns.push_back(edge.parentColumn);
+            }
+            std::vector<std::string> supporters;
+            for(const std::size_t i : edgesOf(snapshot.parentEdges, currentTable)) {
+                const std::string& tableName = snapshot.edges[i].parentTable;
+                logger.debug([&] { return currentTable + " depends on: " + tableName; });
+                supporters.push_back(tableName);
+            }
+            frontier.fetched(currentTable, std::move(dependents), std::move(supporters));
+        }
+    }
+    frontier.addLinks(graph);
+    for(const auto& table : frontier.tables()) {
+        if(const auto cols = snapshot.columns.find(table); cols != snapshot.columns.end()) {
+            for(const auto& col : cols->second)
+                graph.addColumn(table, col.name, col.isNullable, col.typeOid ? pgDataTypeOf(col.typeOid) : getPGDataType(col.dataType));
+        }
+    }
+}
+
+// Applies the rows of the per-table information_schema queries to the
+// graph and the frontier.
+struct InformationSchemaRowHandler {
+    SchemaGraphBuilder& graph;
+    Frontier& frontier;
+    Logger& logger;
+    std::vector<DependentKey> dependents; // of the table whose rows these are
+    std::vector<std::string> supporters;
+
+    // The rows of a composite key come one after another.
+    void child(const std::string&, const pgfe::Row& r) {
+        using dmitigr::pgfe::to;
+        auto dependentTable = to<std::string>(r["tableName"]);
+        auto constraint = to<std::string>(r["constraint_name"]);
+        if(dependents.empty() || dependents.back().child != dependentTable || dependents.back().constraint != constraint)
+            dependents.push_back({std::move(dependentTable), std::move(constraint), {}, {}});
+        dependents.back().childColumns.push_back(to<std::string>(r["column_name"]));
+        dependents.back().parentColumns.push_back(to<std::string>(r["foreign_column_name"]));
+    }
+
+    void supporter(const std::string& currentTable, const pgfe::Row& r) {
+        using dmitigr::pgfe::to;
+        auto tableName = to<std::string>(r["foreign_table_name"]);
+        logger.debug([&] { return currentTable + " depends on: " + tableName; });
+        supporters.push_back(std::move(tableName));
+    }
+
+    void column(const std::string& currentTable, const pgfe::Row& r) {
+        using dmitigr::pgfe::to;
+        std::string colName = to<std::string>(r["column_name"]);
+        std::string isNullable = to<std::string>(r["is_nullable"]);
+        std::string dataType = to<std::string>(r["data_type"]);
+        graph.addColumn(currentTable, colName, isNullable == "YES", getPGDataType(dataType));
+    }
+
+    // Hands the keys of the table to the frontier.
+    void endTable(const std::string& currentTable) {
+        frontier.fetched(currentTable, std::exchange(dependents, {}), std::exchange(supporters, {}));
+    }
+};
+
+#ifdef LIBPQ_HAS_PIPELINING
+// Sends the three queries of every table of the frontier in one pipeline and
+// consumes the responses in order, so a BFS level costs one round trip.
+inline void runPipelinedFrontier(pgfe::Connection& conn, const std::vector<std::string>& frontier,
+    InformationSchemaRowHandler& handler) {
+    conn.set_pipeline_enabled(true);
+    try {
+        for(const auto& table : frontier) {
+            conn.execute_nio(getForeignKeyQuery(table));
+            conn.execute_nio(getSupporterQuery(table));
+            conn.execute_nio(getTableFieldsAndDataTypes(table));
+        }
+        conn.send_sync();
+
+        for(const auto& table : frontier) {
+            for(int query = 0; query < 3; query++) {
+                while(conn.wait_response_throw()) {
+                    if(auto r = conn.row()) {
+                        if(query == 0) handler.child(table, r);
+                        else if(query == 1) handler.supporter(table, r);
+                        else handler.column(table, r);
+                    } else {
+                        conn.completion();
+                        break;
+                    }
+                }
+            }
+            handler.endTable(table);
+        }
+        conn.wait_response_throw();
+        conn.ready_for_query();
+    } catch(...) {
+        // Skip whatever is left of the aborted pipeline up to the sync point.
+        try {
+            while(conn.has_uncompleted_request()) {
+                conn.wait_response();
+                if(conn.ready_for_query()) break;
+                conn.error();
+                conn.row();
+                conn.completion();
+            }
+            conn.set_pipeline_enabled(false);
+        } catch(...) {}
+        throw;
+    }
+    conn.set_pipeline_enabled(false);
+}
+#endif
+
+// Level-by-level BFS against information_schema for roles which can only
+// see it. With libpq pipelining a whole frontier goes out in one batch.
+inline void discoverWithInformationSchema(pgfe::Connection& conn, const Options& options, SchemaGraphBuilder& graph,
+    Logger& logger) {
+    Frontier frontier{options};
+    InformationSchemaRowHandler handler{graph, frontier, logger, {}, {}};
+    graph.table(options.rootTable);
+    for(auto tables = frontier.take(); !tables.empty(); tables = frontier.take()) {
+#ifdef LIBPQ_HAS_PIPELINING
+        runPipelinedFrontier(conn, tables, handler);
+#else
+        for(const auto& currentTable : tables) {
+            conn.execute([&](auto&& r) { handler.child(currentTable, r); }, getForeignKeyQuery(currentTable));
+            conn.execute([&](auto&& r) { handler.supporter(currentTable, r); }, getSupporterQuery(currentTable));
+            conn.execute([&](auto&& r) { handler.column(currentTable, r); }, getTableFieldsAndDataTypes(currentTable));
+            handler.endTable(currentTable);
+        }
+#endif
+    }
+    frontier.addLinks(graph);
+}
+
+inline void saveGraphCache(const Options& options, const CatalogSnapshot& snapshot, Logger& logger) {
+    try {
+        writeGraphCache(options.graphCache, snapshot, options.schema);
+    } catch(const std::exception& e) {
+        logger.warn([&] { return std::string{"graph cache not saved: "} + e.what(); });
+    }
+}
+
+// Brings a snapshot, as cached, up to the catalog's fingerprints, saving it
+// to the graph cache again when it changed.
+inline void refreshCatalogSnapshot(pgfe::Connection& conn, const Options& options, CatalogSnapshot& snapshot,
+    TableFingerprints fingerprints, Logger& logger) {
+    const std::size_t tables = fingerprints.size();
+    const std::size_t changed = refreshCatalogSnapshot(conn, options.schema, snapshot, std::move(fingerprints));
+    if(!changed) return;
+    logger.info([&] {
+        return "Graph cache: " + std::to_string(changed) + " of " + std::to_string(tables) + " tables changed, read again";
+    });
+    if(!options.graphCache.empty()) saveGraphCache(options, snapshot, logger);
+}
+
+// Loads the catalog snapshot, going through the on-disk graph cache when one
+// is configured. A cache hit costs a single fingerprint query, and a cache
+// of a schema changed since reads again only the tables which did.
+inline CatalogSnapshot loadCatalogSnapshot(pgfe::Connection& conn, const Options& options, Logger& logger) {
+    if(options.graphCache.empty()) return loadCatalogSnapshot(conn, options.schema);
+
+    TableFingerprints fingerprints = catalogFingerprints(conn, options.schema);
+    if(auto cached = readGraphCache(options.graphCache, options.schema)) {
+        refreshCatalogSnapshot(conn, options, *cached, std::move(fingerprints), logger);
+        return std::move(*cached);
+    }
+    CatalogSnapshot snapshot = loadCatalogSnapshot(conn, options.schema);
+    snapshot.fingerprints = std::move(fingerprints);
+    saveGraphCache(options, snapshot, logger);
+    return snapshot;
+}
+
+// Builds the graph from the catalog snapshot, falling back to per-table
+// information_schema queries when the role can't read pg_catalog.
+inline SchemaGraph discoverSchema(pgfe::Connection& conn, const Options& options, Logger& logger) {
+    if(options.introspection == Introspection::catalog) {
+        try {
+            SchemaGraphBuilder graph;
+            discoverFromSnapshot(loadCatalogSnapshot(conn, options, logger), options, graph, logger);
+            return std::move(graph).build();
+        } catch(const pgfe::Server_exception& e) {
+            if(e.error().condition() != pgfe::Server_errc::c42_insufficient_privilege) throw;
+            logger.warn([] { return std::string{"catalog snapshot unavailable, falling back to information_schema"}; });
+        }
+    }
+    SchemaGraphBuilder graph;
+    discoverWithInformationSchema(conn, options, graph, logger);
+    return std::move(graph).build();
+}
+
+} // namespace subset
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "sink.hpp"
+#include "task_pool.hpp"
+#include "trace.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+using EncryptionKey = std::array<unsigned char, 32>;
+
+// The AES-256 key of --encrypt-key-env: 64 hex digits in the variable, as
+// a KMS data key is handed over decrypted, by `aws kms generate-data-key`
+// or the like.
+inline EncryptionKey encryptionKey(const std::string& variable) {
+    const char* value = std::getenv(variable.c_str());
+    const std::string_view hex = value ? value : "";
+    const auto digit = [](char c) {
+        return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    };
+    EncryptionKey key{};
+    bool valid = hex.size() == key.size() * 2;
+    for(std::size_t i = 0; valid && i < key.size(); i++) {
+        const int high = digit(hex[2 * i]);
+        const int low = digit(hex[2 * i + 1]);
+        valid = high >= 0 && low >= 0;
+        key[i] = static_cast<unsigned char>(high << 4 | low);
+    }
+    if(!valid) throw std::invalid_argument{"--encrypt-key-env: $" + variable + " must hold a key of 64 hex digits"};
+    return key;
+}
+
+// An encrypted file is a header and frames. The header is the magic
+// "CSGCM01\n", the size of the frames' plaintext as 4 bytes big-endian and 8
+// random bytes, the salt. A frame is the size of its ciphertext as 4 bytes
+// big-endian, the ciphertext and the 16 byte tag of AES-256-GCM, with the
+// nonce the salt followed by the frame's index as 4 bytes big-endian, and
+// the header and one byte, 1 for the last frame and 0 for the others, as
+// the additional data. Every frame but the last holds a full frame of
+// plaintext, so frame i starts at 20 + i * (20 + frame size): a reader seeks
+// to any frame and decrypts it alone, and a file cut short of its last frame
+// fails to.
+struct EncryptedFormat {
+    static constexpr std::string_view magic = "CSGCM01\n";
+    static constexpr std::size_t headerSize = 20;
+    static constexpr std::size_t saltSize = 8;
+    static constexpr std::size_t tagSize = 16;
+    static constexpr std::size_t frameOverhead = 4 + tagSize;
+};
+
+inline void appendBigEndian32(std::string& out, std::uint32_t value) {
+    for(int shift = 24; shift >= 0; shift -= 8) out += static_cast<char>(value >> shift & 0xff);
+}
+
+// One frame of plaintext, encrypted.
+inline std::string encryptFrame(const EncryptionKey& key, std::string_view header, std::uint32_t index, bool last,
+    std::string_view plaintext) {
+    unsigned char nonce[12];
+    std::copy_n(reinterpret_cast<const unsigned char*>(header.data()) + header.size() - EncryptedFormat::saltSize,
+        EncryptedFormat::saltSize, nonce);
+    for(int i = 0; i < 4; i++) nonce[8 + i] = static_cast<unsigned char>(index >> (24 - 8 * i));
+    const std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)> ctx{EVP_CIPHER_CTX_new(), EVP_CIPHER_CTX_free};
+    std::string out;
+    out.reserve(plaintext.size() + EncryptedFormat::frameOverhead);
+    appendBigEndian32(out, static_cast<std::uint32_t>(plaintext.size()));
+    out.resize(4 + plaintext.size());
+    int size = 0;
+    const unsigned char flag = last;
+    // OpenSSL picks AES-NI, or the ARMv8 crypto extensions, when the CPU has them.
+    if(!ctx || !EVP_EncryptInit_ex(ctx.get(), EVP_aes_256_gcm(), nullptr, key.data(), nonce) ||
+        !EVP_EncryptUpdate(ctx.get(), nullptr, &size, reinterpret_cast<const unsigned char*>(header.data()),
+            static_cast<int>(header.size())) ||
+        !EVP_EncryptUpdate(ctx.get(), nullptr, &size, &flag, 1) ||
+        !EVP_EncryptUpdate(ctx.get(), reinterpret_cast<unsigned char*>(out.data()) + 4, &size,
+            reinterpret_cast<const unsigned char*>(plaintext.data()), static_cast<int>(plaintext.size())) ||
+        !EVP_EncryptFinal_ex(ctx.get(), reinterpret_cast<unsigned char*>(out.data()) + 4 + size, &size))
+        throw std::runtime_error{"AES-GCM encryption failed"};
+    out.resize(out.size() + EncryptedFormat::tagSize);
+    if(!EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, static_cast<int>(EncryptedFormat::tagSize),
+        out.data() + out.size() - EncryptedFormat::tagSize))
+        throw std::runtime_error{"AES-GCM encryption failed"};
+    return out;
+}
+
+// Encrypts what is written to it before passing it on, in the format
+// above. Frames are encrypted on the pool and written in order; write() only
+// waits once maxInFlight frames are still being encrypted.
+class EncryptingSink final : public Sink {
+public:
+    EncryptingSink(std::unique_ptr<Sink> out, TaskPool& pool, const EncryptionKey& key, std::size_t frameSize,
+        std::size_t maxInFlight = 4)
+        : out_{std::move(out)}, pool_{pool}, key_{std::make_shared<const EncryptionKey>(key)},
+          frameSize_{std::clamp<std::size_t>(frameSize, 4096, 1 << 30)}, maxInFlight_{std::max<std::size_t>(maxInFlight, 1)} {
+        header_ = EncryptedFormat::magic;
+        appendBigEndian32(header_, static_cast<std::uint32_t>(frameSize_));
+        unsigned char salt[EncryptedFormat::saltSize];
+        if(RAND_bytes(salt, sizeof(salt)) != 1) throw std::runtime_error{"cannot generate the salt of an encrypted file"};
+        header_.append(reinterpret_cast<const char*>(salt), sizeof(salt));
+        frame_.reserve(frameSize_);
+    }
+
+    EncryptingSink(const EncryptingSink&) = delete;
+    EncryptingSink& operator=(const EncryptingSink&) = delete;
+
+    ~EncryptingSink() override {
+        for(auto& result : inFlight_) result.wait();
+    }
+
+    void write(std::string_view data) override {
+        if(!headerWritten_) {
+            out_->write(header_);
+            headerWritten_ = true;
+        }
+        while(!data.empty()) {
+            const std::size_t taken = std::min(data.size(), frameSize_ - frame_.size());
+            frame_.append(data.substr(0, taken));
+            data.remove_prefix(taken);
+            // A full frame waits for more, as the last one is flagged.
+            if(!data.empty()) submit(false);
+        }
+    }
+
+    void close() override {
+        write({});
+        submit(true);
+        while(!inFlight_.empty()) drain();
+        out_->close();
+    }
+
+private:
+    void submit(bool last) {
+        if(inFlight_.size() >= maxInFlight_) drain();
+        if(index_ == UINT32_MAX) throw std::runtime_error{"too many frames for an encrypted file"};
+        inFlight_.push_back(pool_.submit([frame = std::move(frame_), key = key_, header = header_, index = index_++, last] {
+            const TraceSpan span{"encrypt", "aes-gcm"};
+            return encryptFrame(*key, header, index, last, frame);
+        }));
+        frame_ = std::string{};
+        frame_.reserve(frameSize_);
+    }
+
+    void drain() {
+        std::string encrypted;
+        {
+            const TraceSpan span{"encrypt", "aes-gcm wait"};
+            encrypted = inFlight_.front().get();
+        }
+        inFlight_.pop_front();
+        out_->write(encrypted);
+    }
+
+    std::unique_ptr<Sink> out_;
+    TaskPool& pool_;
+    std::shared_ptr<const EncryptionKey> key_;
+    std::size_t frameSize_;
+    std::size_t maxInFlight_;
+    std::string header_;
+    bool headerWritten_ = false;
+    std::uint32_t index_ = 0;
+    std::string frame_;
+    std::deque<std::future<std::string>> inFlight_;
+};
+
+} // namespace subset
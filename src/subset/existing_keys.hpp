@@ -0,0 +1,66 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "copy_stream.hpp"
+#include "integer_bitmap.hpp"
+#include "key_set.hpp"
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The primary keys a target table holds already, read with one COPY before
+// the table is extracted, so that the rows the target has are not sent to
+// it again. Integer keys go into an IntegerBitmap, the others into an exact
+// KeySet: a probabilistic filter's false positives would be rows missing
+// from the target and never loaded.
+class ExistingKeys {
+public:
+    ExistingKeys(pgfe::Connection& conn, const std::string& table, const std::string& quotedColumn, KeySet::Kind kind) {
+        if(kind == KeySet::Kind::integer) keys_.emplace<IntegerBitmap>();
+        else keys_.emplace<KeySet>(kind);
+        copyOut(conn, "COPY (SELECT " + quotedColumn + " FROM " + table + " WHERE " + quotedColumn +
+            " IS NOT NULL) TO STDOUT WITH (FORMAT csv)", [&](std::string_view row) {
+            forEachCsvField(row, [&](std::size_t, std::string_view value, bool) {
+                if(auto* ints = std::get_if<IntegerBitmap>(&keys_)) ints->insert(parseInteger(value));
+                else std::get<KeySet>(keys_).insert(value);
+            });
+        });
+    }
+
+    // Whether the key in text format is in the target.
+    bool contains(std::string_view text) const {
+        if(const auto* ints = std::get_if<IntegerBitmap>(&keys_)) {
+            std::int64_t value = 0;
+            const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+            return ec == std::errc{} && ptr == text.data() + text.size() && ints->contains(value);
+        }
+        return std::get<KeySet>(keys_).contains(text);
+    }
+
+    std::size_t size() const {
+        return std::visit([](const auto& keys) { return keys.size(); }, keys_);
+    }
+
+private:
+    static std::int64_t parseInteger(std::string_view text) {
+        std::int64_t value = 0;
+        const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if(ec != std::errc{} || ptr != text.data() + text.size())
+            throw std::runtime_error{"unexpected integer key " + std::string{text}};
+        return value;
+    }
+
+    std::variant<IntegerBitmap, KeySet> keys_;
+};
+
+} // namespace subset
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "checkpoint.hpp"
+#include "file_sink.hpp"
+#include "key_set.hpp"
+#include "schema_graph.hpp"
+#include "sink.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// A hash of the values of a key set independent of their order: the sum
+// and the xor of a hash of each, and their count.
+inline std::string keySetHash(const KeySet& keys) {
+    std::uint64_t sum = 0;
+    std::uint64_t bits = 0;
+    keys.forEachText([&](std::string_view value) {
+        const std::uint64_t hash = fnv1a(value);
+        sum += hash;
+        bits ^= hash * 0x9e3779b97f4a7c15ULL;
+    });
+    std::ostringstream out;
+    out << std::hex << keys.size() << '.' << sum << '.' << bits;
+    return out.str();
+}
+
+// The database the rows are read from: the cluster's system identifier and
+// the database's oid, or, where the role can't read pg_control_system(),
+// the server's address and port in place of the identifier.
+inline std::string sourceIdentity(pgfe::Connection& conn) {
+    using dmitigr::pgfe::to;
+    std::string result;
+    const auto read = [&](const std::string& query) {
+        conn.execute([&](auto&& r) { result = to<std::string>(r[0]); }, query);
+    };
+    try {
+        read(R"(
+            SELECT (SELECT system_identifier FROM pg_catalog.pg_control_system())::text || '/' ||
+                (SELECT oid FROM pg_catalog.pg_database WHERE datname = current_database())::text)");
+    } catch(const pgfe::Server_exception& e) {
+        if(e.error().condition() != pgfe::Server_errc::c42_insufficient_privilege) throw;
+        read(R"(
+            SELECT coalesce(host(inet_server_addr()), 'local') || ':' || coalesce(inet_server_port()::text, '') || '/' ||
+                (SELECT oid FROM pg_catalog.pg_database WHERE datname = current_database())::text)");
+    }
+    return result;
+}
+
+// What tells whether a table may have changed between two runs, for every
+// table of graph: the source's identity, the file node of each of its
+// partitions, and the transaction snapshot of the server as a whole, its
+// next transaction id and those in progress. A write commits under an id
+// assigned after the snapshot or listed in it as in progress, so an equal
+// snapshot means nothing was committed in between; it is coarse, any write
+// to the database missing every entry, but unlike the statistics'
+// counters transactional, and the same on a standby. Read before the
+// run's snapshot is taken, a write it misses is one the run sees, and the
+// next run misses the entry.
+inline std::vector<std::string> tableWatermarks(pgfe::Connection& conn, const SchemaGraph& graph, const std::string& schema) {
+    using dmitigr::pgfe::to;
+    const std::string identity = sourceIdentity(conn);
+    std::vector<std::string> result(graph.tableCount());
+    conn.execute([&](auto&& r) {
+        if(const auto t = graph.findTable(to<std::string>(r["table_name"])))
+            result[*t] = identity + '/' + to<std::string>(r["snapshot"]) + '/' + to<std::string>(r["watermark"]);
+    }, R"(
+        SELECT p.relname AS table_name, txid_current_snapshot()::text AS snapshot,
+            string_agg(c.relfilenode::text, ',' ORDER BY c.oid) AS watermark
+        FROM pg_catalog.pg_class p
+        JOIN pg_catalog.pg_namespace n ON n.oid = p.relnamespace
+        CROSS JOIN LATERAL pg_catalog.pg_partition_tree(p.oid) t
+        JOIN pg_catalog.pg_class c ON c.oid = t.relid
+        WHERE n.nspname = $1 AND p.relkind IN ('r', 'p')
+        GROUP BY p.relname)", schema);
+    return result;
+}
+
+// The rows earlier runs read from the source, in a directory with a file per
+// extraction, named by the hash of what decided it: the table, the columns
+// and format read, the keys it was filtered on and the table's watermark.
+// A file holds the COPY messages as received, each after its size in four
+// bytes, so a hit is replayed into the sink and through the key collection
+// exactly as the source would have sent it. Files are written aside and
+// renamed into place once the table is loaded, and never expire: the
+// watermark changing is what makes an entry unreachable.
+class ExtractCache {
+public:
+    explicit ExtractCache(std::filesystem::path dir) : dir_{std::move(dir)} {
+        std::filesystem::create_directories(dir_);
+    }
+
+    // The file name of the entry of key, hashed twice for 128 bits.
+    static std::string entryName(const std::string& key) {
+        std::ostringstream out;
+        out << std::hex << fnv1a(key) << fnv1a(key, 0x84222325cbf29ce4ULL);
+        return out.str();
+    }
+
+    // The messages cached under name, if any.
+    std::optional<std::string> find(const std::string& name) const {
+        std::ifstream in{dir_ / name, std::ios::binary};
+        if(!in) return std::nullopt;
+        std::string bytes{std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+        if(in.bad()) return std::nullopt;
+        return bytes;
+    }
+
+    // Calls f(message) for every message of what find() returned.
+    template<typename F>
+    static void forEachMessage(std::string_view bytes, F&& f) {
+        while(!bytes.empty()) {
+            if(bytes.size() < 4) throw std::runtime_error{"truncated extraction cache entry"};
+            std::uint32_t size = 0;
+            for(int i = 3; i >= 0; i--) size = size << 8 | static_cast<unsigned char>(bytes[i]);
+            if(bytes.size() - 4 < size) throw std::runtime_error{"truncated extraction cache entry"};
+            f(bytes.substr(4, size));
+            bytes.remove_prefix(4 + size);
+        }
+    }
+
+    // Hands the messages written on to next, keeping a copy under name
+    // once commit() is called, after next has been closed. Without it the
+    // copy is discarded.
+    class Writer final : public Sink {
+    public:
+        Writer(const ExtractCache& cache, const std::string& name, Sink& next)
+            : next_{next}, path_{cache.dir_ / name}, temporary_{cache.dir_ / (name + ".tmp")},
+              file_{std::make_unique<FileSink>(temporary_)} {}
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        ~Writer() override {
+            if(!file_) return;
+            file_.reset();
+            std::error_code error;
+            std::filesystem::remove(temporary_, error);
+        }
+
+        void write(std::string_view data) override {
+            char size[4];
+            for(int i = 0; i < 4; i++) size[i] = static_cast<char>(data.size() >> (8 * i));
+            file_->write(std::string_view{size, 4});
+            file_->write(data);
+            next_.write(data);
+        }
+
+        // The next sink is closed by its owner.
+        void close() override {}
+
+        void commit() {
+            file_->close();
+            file_.reset();
+            std::filesystem::rename(temporary_, path_);
+        }
+
+    private:
+        Sink& next_;
+        std::filesystem::path path_;
+        std::filesystem::path temporary_;
+        std::unique_ptr<FileSink> file_;
+    };
+
+private:
+    std::filesystem::path dir_;
+};
+
+// The extractions of a daemon's jobs kept in memory for the jobs after
+// them, under the names and in the format of ExtractCache's entries, up to
+// capacity bytes: the least recently used go first. The names hold the
+// tables' watermarks, so an entry of a table written since is never found
+// again and ages out.
+class MemoryCache {
+public:
+    explicit MemoryCache(std::size_t capacity) : capacity_{capacity} {}
+
+    MemoryCache(const MemoryCache&) = delete;
+    MemoryCache& operator=(const MemoryCache&) = delete;
+
+    std::shared_ptr<const std::string> find(const std::string& name) {
+        const std::lock_guard lock{mutex_};
+        const auto it = index_.find(name);
+        if(it == index_.end()) return nullptr;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+    }
+
+    void insert(const std::string& name, std::shared_ptr<const std::string> bytes) {
+        if(bytes->size() > capacity_) return;
+        const std::lock_guard lock{mutex_};
+        if(const auto it = index_.find(name); it != index_.end()) {
+            used_ -= it->second->second->size();
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+        used_ += bytes->size();
+        entries_.emplace_front(name, std::move(bytes));
+        index_[name] = entries_.begin();
+        while(used_ > capacity_) {
+            used_ -= entries_.back().second->size();
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+    // Hands the messages written on to next, keeping a copy under name
+    // once commit() is called, unless it outgrew the cache.
+    class Writer final : public Sink {
+    public:
+        Writer(MemoryCache& cache, std::string name, Sink& next) : cache_{cache}, name_{std::move(name)}, next_{next} {}
+
+        void write(std::string_view data) override {
+            next_.write(data);
+            if(bytes_.size() + 4 + data.size() > cache_.capacity_) {
+                overflowed_ = true;
+                bytes_ = {};
+            }
+            if(overflowed_) return;
+            for(int i = 0; i < 4; i++) bytes_ += static_cast<char>(data.size() >> (8 * i));
+            bytes_ += data;
+        }
+
+        // The next sink is closed by its owner.
+        void close() override {}
+
+        void commit() {
+            if(!overflowed_) cache_.insert(name_, std::make_shared<const std::string>(std::move(bytes_)));
+        }
+
+    private:
+        MemoryCache& cache_;
+        std::string name_;
+        Sink& next_;
+        std::string bytes_;
+        bool overflowed_ = false;
+    };
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const std::string>>;
+
+    std::size_t capacity_;
+    std::mutex mutex_;
+    std::list<Entry> entries_; // the most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::size_t used_ = 0;
+};
+
+} // namespace subset
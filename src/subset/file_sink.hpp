@@ -0,0 +1,88 @@
+#pragma once
+
+#include "sink.hpp"
+#include "trace.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace subset {
+
+// An output file written in large blocks. Rows are appended to an in-memory
+// buffer which goes to the file only once it's full, so the many small COPY
+// rows cost one write per buffer rather than one per row. A preallocated file,
+// created by fsx::Output_directory, is written over and cut to size on close.
+class FileSink final : public Sink {
+public:
+    static constexpr std::size_t defaultBufferSize = 1 << 20;
+
+    explicit FileSink(const std::filesystem::path& path, std::size_t bufferSize = defaultBufferSize,
+        bool preallocated = false)
+        : path_{path}, file_{std::fopen(path.c_str(), preallocated ? "r+b" : "wb")}, capacity_{bufferSize},
+          preallocated_{preallocated} {
+        if(!file_) throw std::system_error{errno, std::generic_category(), "cannot open " + path_.string()};
+        std::setvbuf(file_, nullptr, _IONBF, 0);
+        buffer_.reserve(capacity_);
+    }
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    ~FileSink() override {
+        if(file_) std::fclose(file_);
+    }
+
+    void write(std::string_view data) override {
+        if(buffer_.size() + data.size() > capacity_) flush();
+        if(data.size() >= capacity_) writeThrough(data);
+        else buffer_.append(data);
+        written_ += data.size();
+    }
+
+    void flush() {
+        if(buffer_.empty()) return;
+        writeThrough(buffer_);
+        buffer_.clear();
+    }
+
+    // Flushes and closes the file, reporting errors which the destructor
+    // would have to swallow.
+    void close() override {
+        flush();
+        std::FILE* file = file_;
+        file_ = nullptr;
+        if(preallocated_ && ::ftruncate(::fileno(file), static_cast<off_t>(written_)) != 0) {
+            const int error = errno;
+            std::fclose(file);
+            throw std::system_error{error, std::generic_category(), "cannot truncate " + path_.string()};
+        }
+        if(std::fclose(file) != 0)
+            throw std::system_error{errno, std::generic_category(), "cannot close " + path_.string()};
+    }
+
+    std::uint64_t bytesWritten() const { return written_; }
+    const std::filesystem::path& path() const { return path_; }
+
+private:
+    void writeThrough(std::string_view data) {
+        const TraceSpan span{"write", "write"};
+        if(std::fwrite(data.data(), 1, data.size(), file_) != data.size())
+            throw std::system_error{errno, std::generic_category(), "cannot write " + path_.string()};
+    }
+
+    std::filesystem::path path_;
+    std::FILE* file_;
+    std::size_t capacity_;
+    std::string buffer_;
+    std::uint64_t written_ = 0;
+    bool preallocated_;
+};
+
+} // namespace subset
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "log.hpp"
+#include "schema_graph.hpp"
+#include "sql.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Makes a loaded target usable. Every sequence owned by a column of the
+// tables (serial or identity) is set past the largest value loaded, all of
+// them in one pipeline, a round trip in all. Then the tables are analyzed,
+// or with vacuum vacuumed and analyzed, side by side on up to jobs
+// connections of pool, the largest first so that the last one to finish
+// isn't a big one started late. The first error is rethrown once every
+// table has been tried.
+inline void finalizeTarget(pgfe::Connection_pool& pool, std::size_t jobs, const SchemaGraph& graph,
+    const std::string& schema, bool vacuum, Logger& logger) {
+    using dmitigr::pgfe::to;
+    std::vector<std::pair<std::int64_t, std::string>> tables; // by size
+    {
+        auto conn = pool.acquire();
+        std::vector<pgfe::Statement> setvals;
+        conn->execute([&](auto&& r) {
+            if(!graph.findTable(to<std::string>(r["table_name"]))) return;
+            const auto relation = to<std::string>(r["relation"]);
+            const auto column = quoteIdentifier(to<std::string>(r["column_name"]));
+            setvals.emplace_back("SELECT setval(" + quoteLiteral(to<std::string>(r["sequence"])) + ", m) FROM "
+                "(SELECT CAST(max(" + column + ") AS bigint) AS m FROM " + relation + ") s WHERE m IS NOT NULL");
+        }, R"(
+            SELECT s.oid::regclass::text AS sequence, t.relname AS table_name, t.oid::regclass::text AS relation,
+                a.attname AS column_name
+            FROM pg_catalog.pg_class s
+            JOIN pg_catalog.pg_depend d ON d.classid = 'pg_catalog.pg_class'::regclass AND d.objid = s.oid
+                AND d.refclassid = 'pg_catalog.pg_class'::regclass AND d.deptype IN ('a', 'i')
+            JOIN pg_catalog.pg_class t ON t.oid = d.refobjid
+            JOIN pg_catalog.pg_attribute a ON a.attrelid = t.oid AND a.attnum = d.refobjsubid
+            JOIN pg_catalog.pg_namespace n ON n.oid = t.relnamespace
+            WHERE s.relkind = 'S' AND n.nspname = $1)", schema);
+        const std::size_t sequences = setvals.size();
+        if(!setvals.empty()) conn->execute_pipelined(pgfe::Statement_vector{std::move(setvals)});
+        logger.info([&] { return "Finalize: " + std::to_string(sequences) + " sequences set"; });
+
+        conn->execute([&](auto&& r) {
+            if(!graph.findTable(to<std::string>(r["table_name"]))) return;
+            tables.emplace_back(to<std::int64_t>(r["size"]), to<std::string>(r["relation"]));
+        }, R"(
+            SELECT c.relname AS table_name, c.oid::regclass::text AS relation,
+                pg_catalog.pg_total_relation_size(c.oid) AS size
+            FROM pg_catalog.pg_class c
+            JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+            WHERE n.nspname = $1 AND c.relkind IN ('r', 'p'))", schema);
+    }
+    std::sort(tables.begin(), tables.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::atomic<std::size_t> next = 0;
+    std::exception_ptr error;
+    std::atomic<bool> failed = false;
+    std::vector<std::thread> threads;
+    for(std::size_t w = 0; w < std::min(std::max<std::size_t>(jobs, 1), tables.size()); w++) {
+        threads.emplace_back([&] {
+            try {
+                auto conn = pool.acquire();
+                for(auto i = next++; i < tables.size(); i = next++)
+                    conn->execute((vacuum ? "VACUUM (ANALYZE) " : "ANALYZE ") + tables[i].second);
+            } catch(...) {
+                if(!failed.exchange(true)) error = std::current_exception();
+            }
+        });
+    }
+    for(auto& thread : threads) thread.join();
+    if(error) std::rethrow_exception(error);
+}
+
+} // namespace subset
@@ -0,0 +1,226 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// What a run on a production primary may cost its server, by --governor-*.
+// A zero leaves the signal unwatched.
+struct GovernorBudget {
+    std::chrono::milliseconds lag{0};     // replay lag of the slowest standby
+    std::size_t backends = 0;             // active client backends of the server, ours included
+    std::chrono::milliseconds latency{0}; // of our slowest batch, or COPY, of an interval
+    std::size_t readRate = 0;             // MiB/s the database reads from disk
+
+    bool empty() const { return !lag.count() && !backends && !latency.count() && !readRate; }
+};
+
+// The server's health as sampled, the signals it can't read left empty.
+struct ServerHealth {
+    std::optional<double> lagSeconds;
+    std::optional<std::size_t> backends;
+    std::optional<double> readRate; // MiB/s since the sample before
+    double latency = 0;             // s of our slowest operation since the sample before
+};
+
+// The standbys' lag and the other roles' backends' state are only shown to
+// a role with pg_read_all_stats, as of pg_monitor, and to others as NULL,
+// so without it both are left unknown rather than read as none.
+inline const std::string serverHealthQuery = R"(
+        SELECT (SELECT extract(epoch FROM max(replay_lag))::float8 FROM pg_stat_replication) AS lag,
+            (SELECT count(*)::int8 FROM pg_stat_activity
+                WHERE state = 'active' AND backend_type = 'client backend') AS backends,
+            (SELECT blks_read::int8 FROM pg_stat_database WHERE datname = current_database()) AS blks_read,
+            pg_has_role(current_user, 'pg_read_all_stats', 'USAGE') AS all_stats
+)";
+
+// Keeps a run within its budget, on a connection of its own sampling the
+// server every interval: an operation as slow or a signal over budget
+// halves the tables extracted at once and doubles a pause after every batch,
+// and an interval within it shortens the pause, then admits a table more,
+// up to the jobs. The pause backs off the batches of the tables running,
+// the admissions what is started next.
+class Governor {
+public:
+    static constexpr std::chrono::milliseconds minimumPause{50};
+    static constexpr std::chrono::milliseconds maximumPause{5000};
+
+    // Releases its admission when destroyed.
+    class Permit {
+    public:
+        Permit() = default;
+        explicit Permit(Governor* governor) : governor_{governor} {}
+        Permit(Permit&& rhs) noexcept : governor_{std::exchange(rhs.governor_, nullptr)} {}
+        Permit& operator=(const Permit&) = delete;
+        ~Permit() {
+            if(governor_) governor_->release();
+        }
+
+    private:
+        Governor* governor_ = nullptr;
+    };
+
+    Governor(pgfe::Connection_options options, GovernorBudget budget, std::size_t jobs, std::chrono::milliseconds interval,
+        Logger& logger)
+        : options_{std::move(options)}, budget_{budget}, jobs_{std::max<std::size_t>(jobs, 1)},
+          interval_{std::max(interval, std::chrono::milliseconds{100})}, logger_{logger}, limit_{jobs_} {
+        thread_ = std::thread{[this] { run(); }};
+    }
+
+    Governor(const Governor&) = delete;
+    Governor& operator=(const Governor&) = delete;
+
+    ~Governor() {
+        {
+            const std::lock_guard lock{mutex_};
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        thread_.join();
+    }
+
+    // Waits until a table more may be extracted.
+    Permit admit() {
+        std::unique_lock lock{mutex_};
+        if(running_ >= limit_) {
+            const TraceSpan span{"governor", "admit"};
+            changed_.wait(lock, [&] { return running_ < limit_; });
+        }
+        running_++;
+        return Permit{this};
+    }
+
+    // Told of every batch, and COPY, as it ends; waits the pause.
+    void observe(double seconds) {
+        std::chrono::milliseconds pause;
+        {
+            const std::lock_guard lock{mutex_};
+            latency_ = std::max(latency_, seconds);
+            pause = pause_;
+        }
+        if(pause.count()) {
+            const TraceSpan span{"governor", "pause"};
+            std::this_thread::sleep_for(pause);
+        }
+    }
+
+private:
+    void release() {
+        {
+            const std::lock_guard lock{mutex_};
+            running_--;
+        }
+        changed_.notify_all();
+    }
+
+    void run() {
+        std::optional<pgfe::Connection> conn;
+        std::optional<std::int64_t> blocksRead;
+        Stopwatch sampled;
+        std::unique_lock lock{mutex_};
+        while(!changed_.wait_for(lock, interval_, [&] { return stopping_; })) {
+            ServerHealth health;
+            health.latency = std::exchange(latency_, 0);
+            lock.unlock();
+            try {
+                if(!conn || !conn->is_connected()) {
+                    conn.emplace(options_);
+                    conn->connect();
+                }
+                bool allStats = false;
+                conn->execute([&](auto&& r) {
+                    allStats = pgfe::to<bool>(r[3]);
+                    if(allStats) {
+                        if(r[0]) health.lagSeconds = pgfe::to<double>(r[0]);
+                        health.backends = static_cast<std::size_t>(pgfe::to<std::int64_t>(r[1]));
+                    }
+                    if(r[2]) {
+                        const auto blocks = pgfe::to<std::int64_t>(r[2]);
+                        if(blocksRead) health.readRate = static_cast<double>(blocks - *blocksRead) * 8192 / (1 << 20) / sampled.seconds();
+                        blocksRead = blocks;
+                    }
+                }, serverHealthQuery);
+                sampled = {};
+                if(!allStats && !unprivileged_ && (budget_.lag.count() || budget_.backends)) {
+                    unprivileged_ = true;
+                    logger_.warn([] {
+                        return std::string{"Governor: the role lacks pg_read_all_stats (granted by pg_monitor), so the "
+                            "replication lag and active backends budgets aren't watched"};
+                    });
+                }
+            } catch(const std::exception& e) {
+                // The budget is kept on what can still be read.
+                if(!failed_) logger_.warn([&] { return std::string{"Governor: cannot sample the server: "} + e.what(); });
+                failed_ = true;
+                conn.reset();
+            }
+            lock.lock();
+            adjust(health);
+        }
+    }
+
+    // Called under the lock.
+    void adjust(const ServerHealth& health) {
+        std::string over;
+        char number[64];
+        const auto check = [&](const char* what, double value, double budget, const char* unit) {
+            if(budget <= 0 || value <= budget) return;
+            std::snprintf(number, sizeof(number), "%s %.3g %s over %.3g", what, value, unit, budget);
+            over += (over.empty() ? "" : ", ") + std::string{number};
+        };
+        if(health.lagSeconds) check("replication lag", *health.lagSeconds, static_cast<double>(budget_.lag.count()) / 1000, "s");
+        if(health.backends) check("active backends", static_cast<double>(*health.backends), static_cast<double>(budget_.backends), "");
+        if(health.readRate) check("disk reads", *health.readRate, static_cast<double>(budget_.readRate), "MiB/s");
+        check("batch latency", health.latency, static_cast<double>(budget_.latency.count()) / 1000, "s");
+
+        const std::size_t limit = limit_;
+        const auto pause = pause_;
+        if(!over.empty()) {
+            limit_ = std::max<std::size_t>(limit_ / 2, 1);
+            pause_ = std::clamp(pause_ * 2, minimumPause, maximumPause);
+        } else if(pause_.count()) {
+            pause_ = pause_ > minimumPause ? pause_ - minimumPause : std::chrono::milliseconds{0};
+        } else limit_ = std::min(limit_ + 1, jobs_);
+        if(limit_ == limit && pause_ == pause) return;
+        if(limit_ > limit) changed_.notify_all();
+        logger_.info([&] {
+            return "Governor: " + (over.empty() ? std::string{"within budget"} : over) + "; " + std::to_string(limit_) +
+                " tables at once, " + std::to_string(pause_.count()) + " ms between batches";
+        });
+    }
+
+    pgfe::Connection_options options_;
+    GovernorBudget budget_;
+    std::size_t jobs_;
+    std::chrono::milliseconds interval_;
+    Logger& logger_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool stopping_ = false;
+    bool failed_ = false;
+    bool unprivileged_ = false;
+    std::size_t limit_;
+    std::size_t running_ = 0;
+    std::chrono::milliseconds pause_{0};
+    double latency_ = 0;
+    std::thread thread_;
+};
+
+} // namespace subset
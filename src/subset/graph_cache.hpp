@@ -0,0 +1,227 @@
+#pragma once
+
+#include "../include/src/fsx/mapped_file.hpp"
+#include "../include/src/pgfe/pgfe.hpp"
+#include "catalog_snapshot.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// A cheap fingerprint of each table the snapshot holds: the row versions of
+// its relation, its attributes and the foreign keys from or to it. Any DDL
+// on a table changes at least one xmin of its own, and a foreign key added
+// or dropped one of both its tables. The versions are read in a pass over
+// each catalog and grouped by table.
+inline const std::string catalogFingerprintsQuery = R"(
+        WITH rel AS (
+            SELECT c.oid, c.relname, 'c' || c.oid || ':' || c.xmin AS v
+            FROM pg_catalog.pg_class c
+            JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+            WHERE n.nspname = $1 AND c.relkind IN ('r', 'p')
+        ), fk AS (
+            SELECT con.conrelid, con.confrelid, 'k' || con.oid || ':' || con.xmin AS v
+            FROM pg_catalog.pg_constraint con
+            WHERE con.contype = 'f'
+        ), versions AS (
+            SELECT oid AS relid, v FROM rel
+            UNION ALL
+            SELECT a.attrelid, 'a' || a.attnum || ':' || a.xmin
+            FROM pg_catalog.pg_attribute a
+            WHERE a.attrelid IN (SELECT oid FROM rel) AND a.attnum > 0
+            UNION ALL
+            SELECT conrelid, v FROM fk WHERE conrelid IN (SELECT oid FROM rel)
+            UNION ALL
+            SELECT confrelid, v FROM fk WHERE confrelid IN (SELECT oid FROM rel)
+        )
+        SELECT rel.relname AS table_name, md5(string_agg(versions.v, ',' ORDER BY versions.v)) AS fingerprint
+        FROM versions
+        JOIN rel ON rel.oid = versions.relid
+        GROUP BY rel.oid, rel.relname)";
+
+inline TableFingerprints catalogFingerprints(pgfe::Connection& conn, const std::string& schema) {
+    TableFingerprints result;
+    conn.execute([&](auto&& r) {
+        result.insert_or_assign(pgfe::to<std::string>(r["table_name"]), pgfe::to<std::string>(r["fingerprint"]));
+    }, catalogFingerprintsQuery, schema);
+    return result;
+}
+
+// Cache file layout, in host byte order:
+//
+//   GraphCacheHeader
+//   GraphCacheEdge[edgeCount]
+//   GraphCacheColumn[columnCount]
+//   GraphCacheTable[tableCount]   -- the fingerprints
+//   char strings[stringBytes]     -- referenced by (offset, size) pairs
+//
+// Every reference is an offset into the string pool, so the file is
+// position-independent and can be used straight from a mapping.
+struct GraphCacheStr {
+    std::uint32_t offset;
+    std::uint32_t size;
+};
+
+struct GraphCacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t edgeCount;
+    std::uint32_t columnCount;
+    std::uint32_t tableCount;
+    std::uint32_t stringBytes;
+    GraphCacheStr schema;
+};
+
+struct GraphCacheEdge {
+    GraphCacheStr childTable;
+    GraphCacheStr childColumn;
+    GraphCacheStr parentTable;
+    GraphCacheStr parentColumn;
+    GraphCacheStr constraint;
+};
+
+struct GraphCacheColumn {
+    GraphCacheStr table;
+    GraphCacheStr name;
+    GraphCacheStr dataType;
+    std::uint32_t isNullable;
+    std::uint32_t typeOid;
+};
+
+struct GraphCacheTable {
+    GraphCacheStr table;
+    GraphCacheStr fingerprint;
+};
+
+inline constexpr char graphCacheMagic[8] = {'C', 'P', 'S', 'G', 'R', 'A', 'P', 'H'};
+inline constexpr std::uint32_t graphCacheVersion = 4;
+
+// Decodes a cache image. Returns std::nullopt unless the image is intact and
+// was written for the given schema; the snapshot's fingerprints tell what of
+// it is still current.
+inline std::optional<CatalogSnapshot> decodeGraphCache(std::string_view image, const std::string& schema) {
+    GraphCacheHeader header;
+    if(image.size() < sizeof(header)) return std::nullopt;
+    std::memcpy(&header, image.data(), sizeof(header));
+    if(std::memcmp(header.magic, graphCacheMagic, sizeof(graphCacheMagic)) != 0 ||
+        header.version != graphCacheVersion) return std::nullopt;
+
+    const std::size_t edgesAt = sizeof(header);
+    const std::size_t columnsAt = edgesAt + std::size_t{header.edgeCount} * sizeof(GraphCacheEdge);
+    const std::size_t tablesAt = columnsAt + std::size_t{header.columnCount} * sizeof(GraphCacheColumn);
+    const std::size_t stringsAt = tablesAt + std::size_t{header.tableCount} * sizeof(GraphCacheTable);
+    if(image.size() != stringsAt + header.stringBytes) return std::nullopt;
+
+    const std::string_view strings = image.substr(stringsAt);
+    bool ok = true;
+    const auto str = [&](const GraphCacheStr& s) {
+        if(std::size_t{s.offset} + s.size > strings.size()) {
+            ok = false;
+            return std::string{};
+        }
+        return std::string{strings.substr(s.offset, s.size)};
+    };
+    if(str(header.schema) != schema || !ok) return std::nullopt;
+
+    CatalogSnapshot snapshot;
+    snapshot.edges.reserve(header.edgeCount);
+    for(std::uint32_t i = 0; i < header.edgeCount; i++) {
+        GraphCacheEdge e;
+        std::memcpy(&e, image.data() + edgesAt + i * sizeof(e), sizeof(e));
+        snapshot.addEdge(FkEdge{str(e.childTable), str(e.childColumn), str(e.parentTable), str(e.parentColumn),
+            str(e.constraint)});
+    }
+    for(std::uint32_t i = 0; i < header.columnCount; i++) {
+        GraphCacheColumn c;
+        std::memcpy(&c, image.data() + columnsAt + i * sizeof(c), sizeof(c));
+        snapshot.columns[str(c.table)].push_back(ColumnDef{str(c.name), c.isNullable != 0, str(c.dataType), c.typeOid});
+    }
+    for(std::uint32_t i = 0; i < header.tableCount; i++) {
+        GraphCacheTable t;
+        std::memcpy(&t, image.data() + tablesAt + i * sizeof(t), sizeof(t));
+        snapshot.fingerprints.insert_or_assign(str(t.table), str(t.fingerprint));
+    }
+    if(!ok) return std::nullopt;
+    return snapshot;
+}
+
+inline std::string encodeGraphCache(const CatalogSnapshot& snapshot, const std::string& schema) {
+    std::string strings;
+    std::unordered_map<std::string_view, GraphCacheStr> interned;
+    const auto str = [&](const std::string& s) {
+        if(const auto it = interned.find(s); it != interned.end()) return it->second;
+        const GraphCacheStr ref{static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(s.size())};
+        strings += s;
+        interned.emplace(s, ref);
+        return ref;
+    };
+
+    std::vector<GraphCacheEdge> edges;
+    edges.reserve(snapshot.edges.size());
+    for(const auto& e : snapshot.edges)
+        edges.push_back(GraphCacheEdge{str(e.childTable), str(e.childColumn), str(e.parentTable), str(e.parentColumn),
+            str(e.constraint)});
+    std::vector<GraphCacheColumn> columns;
+    for(const auto& [table, cols] : snapshot.columns) {
+        for(const auto& c : cols)
+            columns.push_back(GraphCacheColumn{str(table), str(c.name), str(c.dataType), c.isNullable ? 1u : 0u, c.typeOid});
+    }
+    std::vector<GraphCacheTable> tables;
+    tables.reserve(snapshot.fingerprints.size());
+    for(const auto& [table, fingerprint] : snapshot.fingerprints) tables.push_back(GraphCacheTable{str(table), str(fingerprint)});
+
+    GraphCacheHeader header{};
+    std::memcpy(header.magic, graphCacheMagic, sizeof(graphCacheMagic));
+    header.version = graphCacheVersion;
+    header.edgeCount = static_cast<std::uint32_t>(edges.size());
+    header.columnCount = static_cast<std::uint32_t>(columns.size());
+    header.tableCount = static_cast<std::uint32_t>(tables.size());
+    header.schema = str(schema);
+    header.stringBytes = static_cast<std::uint32_t>(strings.size());
+
+    std::string image;
+    image.reserve(sizeof(header) + edges.size() * sizeof(GraphCacheEdge) +
+        columns.size() * sizeof(GraphCacheColumn) + tables.size() * sizeof(GraphCacheTable) + strings.size());
+    image.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    image.append(reinterpret_cast<const char*>(edges.data()), edges.size() * sizeof(GraphCacheEdge));
+    image.append(reinterpret_cast<const char*>(columns.data()), columns.size() * sizeof(GraphCacheColumn));
+    image.append(reinterpret_cast<const char*>(tables.data()), tables.size() * sizeof(GraphCacheTable));
+    image += strings;
+    return image;
+}
+
+inline std::optional<CatalogSnapshot> readGraphCache(const std::filesystem::path& path, const std::string& schema) {
+    std::error_code error;
+    if(!std::filesystem::is_regular_file(path, error)) return std::nullopt;
+    try {
+        const dmitigr::fsx::Mapped_file image{path};
+        return decodeGraphCache(image.view(), schema);
+    } catch(const dmitigr::os::Sys_exception&) {
+        return std::nullopt;
+    }
+}
+
+// Writes to a temporary file first so concurrent runs never see a torn cache.
+inline void writeGraphCache(const std::filesystem::path& path, const CatalogSnapshot& snapshot,
+    const std::string& schema) {
+    const std::string image = encodeGraphCache(snapshot, schema);
+    if(path.has_parent_path()) std::filesystem::create_directories(path.parent_path());
+    auto tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream out{tmp, std::ios::binary | std::ios::trunc};
+        out.write(image.data(), static_cast<std::streamsize>(image.size()));
+        if(!out) throw std::runtime_error{"cannot write graph cache " + tmp.string()};
+    }
+    std::filesystem::rename(tmp, path);
+}
+
+} // namespace subset
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <netdb.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+// Thrown when a request gets no response: the connection couldn't be made
+// or broke, or the response didn't parse.
+class HttpError final : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Where requests go: http[s]://host[:port], an IPv6 host in brackets.
+struct HttpEndpoint {
+    bool tls = true;
+    std::string host;
+    std::string port;
+
+    static HttpEndpoint parse(std::string_view url) {
+        HttpEndpoint result;
+        if(url.starts_with("https://")) url.remove_prefix(8);
+        else if(url.starts_with("http://")) {
+            url.remove_prefix(7);
+            result.tls = false;
+        } else throw std::invalid_argument{"endpoint must be http:// or https://: " + std::string{url}};
+        if(const auto slash = url.find('/'); slash != std::string_view::npos) url = url.substr(0, slash);
+        auto colon = url.rfind(':');
+        if(url.starts_with('[')) {
+            const auto bracket = url.find(']');
+            if(bracket == std::string_view::npos) throw std::invalid_argument{"endpoint with an unclosed [: " + std::string{url}};
+            result.host = url.substr(1, bracket - 1);
+            colon = bracket + 1 < url.size() && url[bracket + 1] == ':' ? bracket + 1 : std::string_view::npos;
+            if(colon == std::string_view::npos && bracket + 1 < url.size())
+                throw std::invalid_argument{"endpoint with junk after its host: " + std::string{url}};
+        } else result.host = url.substr(0, colon);
+        result.port = colon == std::string_view::npos ? (result.tls ? "443" : "80") : std::string{url.substr(colon + 1)};
+        if(result.host.empty()) throw std::invalid_argument{"endpoint without a host: " + std::string{url}};
+        return result;
+    }
+
+    // The Host header: the port only when it isn't the scheme's.
+    std::string hostHeader() const {
+        const std::string name = host.find(':') == std::string::npos ? host : '[' + host + ']';
+        return port == (tls ? "443" : "80") ? name : name + ':' + port;
+    }
+};
+
+struct HttpResponse {
+    int status = 0;
+    std::map<std::string, std::string> headers; // names in lower case
+    std::string body;
+
+    std::string header(const std::string& name) const {
+        const auto it = headers.find(name);
+        return it == headers.end() ? std::string{} : it->second;
+    }
+};
+
+// One connection, closed after its response, over TLS verified against the
+// system's certificates when the endpoint is https.
+class HttpConnection {
+public:
+    explicit HttpConnection(const HttpEndpoint& endpoint) : host_{endpoint.host} {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if(const int error = ::getaddrinfo(endpoint.host.c_str(), endpoint.port.c_str(), &hints, &found); error != 0)
+            throw HttpError{"cannot resolve " + endpoint.host + ": " + ::gai_strerror(error)};
+        for(auto* a = found; a && fd_ < 0; a = a->ai_next) {
+            fd_ = ::socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC, a->ai_protocol);
+            if(fd_ >= 0 && ::connect(fd_, a->ai_addr, a->ai_addrlen) != 0) {
+                ::close(fd_);
+                fd_ = -1;
+            }
+        }
+        ::freeaddrinfo(found);
+        if(fd_ < 0) throw HttpError{"cannot connect to " + endpoint.hostHeader() + ": " + std::strerror(errno)};
+        // A stalled server fails the request instead of the run.
+        const timeval timeout{300, 0};
+        ::setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        ::setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        if(!endpoint.tls) return;
+
+        ssl_ = SSL_new(context());
+        if(!ssl_ || !SSL_set_tlsext_host_name(ssl_, host_.c_str()) || !SSL_set1_host(ssl_, host_.c_str()) ||
+            !SSL_set_fd(ssl_, fd_) || SSL_connect(ssl_) != 1) {
+            const std::string error = sslError();
+            if(ssl_) SSL_free(ssl_);
+            ::close(fd_);
+            throw HttpError{"TLS handshake with " + endpoint.hostHeader() + " failed: " + error};
+        }
+    }
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    ~HttpConnection() {
+        if(ssl_) SSL_free(ssl_);
+        if(fd_ >= 0) ::close(fd_);
+    }
+
+    void write(std::string_view data) {
+        while(!data.empty()) {
+            const long n = ssl_ ? SSL_write(ssl_, data.data(), static_cast<int>(std::min<std::size_t>(data.size(), 1 << 30))) :
+                ::send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+            if(n <= 0) {
+                if(!ssl_ && errno == EINTR) continue;
+                throw HttpError{"cannot send to " + host_ + ": " + (ssl_ ? sslError() : std::strerror(errno))};
+            }
+            data.remove_prefix(static_cast<std::size_t>(n));
+        }
+    }
+
+    // Everything up to the end of the connection.
+    std::string readAll() {
+        std::string result;
+        char buffer[1 << 16];
+        for(;;) {
+            const long n = ssl_ ? SSL_read(ssl_, buffer, sizeof(buffer)) : ::recv(fd_, buffer, sizeof(buffer), 0);
+            if(n > 0) result.append(buffer, static_cast<std::size_t>(n));
+            else if(n == 0 || (ssl_ && SSL_get_error(ssl_, static_cast<int>(n)) == SSL_ERROR_ZERO_RETURN)) break;
+            else if(!ssl_ && errno == EINTR) continue;
+            // Servers often close without a TLS close_notify; what came
+            // before is checked against the framing.
+            else if(ssl_ && SSL_get_error(ssl_, static_cast<int>(n)) == SSL_ERROR_SYSCALL && errno == 0) break;
+            else throw HttpError{"cannot receive from " + host_ + ": " + (ssl_ ? sslError() : std::strerror(errno))};
+        }
+        return result;
+    }
+
+private:
+    static SSL_CTX* context() {
+        static SSL_CTX* const result = [] {
+            SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+            if(!ctx) throw HttpError{"cannot create the TLS context: " + sslError()};
+            SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+            SSL_CTX_set_default_verify_paths(ctx);
+            SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+            return ctx;
+        }();
+        return result;
+    }
+
+    static std::string sslError() {
+        const unsigned long error = ERR_get_error();
+        if(!error) return errno ? std::strerror(errno) : "connection closed";
+        char text[256];
+        ERR_error_string_n(error, text, sizeof(text));
+        return text;
+    }
+
+    std::string host_;
+    int fd_ = -1;
+    SSL* ssl_ = nullptr;
+};
+
+// Sends one HTTP/1.1 request on a connection of its own and returns the
+// response, whatever its status.
+inline HttpResponse httpRequest(const HttpEndpoint& endpoint, std::string_view method, const std::string& target,
+    const std::vector<std::pair<std::string, std::string>>& headers, std::string_view body) {
+    HttpConnection conn{endpoint};
+    std::string head = std::string{method} + ' ' + target + " HTTP/1.1\r\nHost: " + endpoint.hostHeader() +
+        "\r\nConnection: close\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+    for(const auto& [name, value] : headers) head += name + ": " + value + "\r\n";
+    head += "\r\n";
+    conn.write(head);
+    conn.write(body);
+
+    const std::string raw = conn.readAll();
+    const auto end = raw.find("\r\n\r\n");
+    if(end == std::string::npos || !raw.starts_with("HTTP/1.") || raw.size() < 12)
+        throw HttpError{"malformed response from " + endpoint.hostHeader()};
+    HttpResponse response;
+    response.status = std::atoi(raw.c_str() + 9);
+    for(auto line = raw.find("\r\n") + 2; line < end;) {
+        const auto next = raw.find("\r\n", line);
+        const auto colon = raw.find(':', line);
+        if(colon < next) {
+            std::string name = raw.substr(line, colon - line);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+            auto value = raw.substr(colon + 1, next - colon - 1);
+            value.erase(0, value.find_first_not_of(" \t"));
+            value.erase(value.find_last_not_of(" \t") + 1);
+            response.headers[std::move(name)] = std::move(value);
+        }
+        line = next + 2;
+    }
+
+    std::string_view rest = std::string_view{raw}.substr(end + 4);
+    if(response.header("transfer-encoding") == "chunked") {
+        for(;;) {
+            const auto eol = rest.find("\r\n");
+            if(eol == std::string_view::npos) throw HttpError{"truncated response from " + endpoint.hostHeader()};
+            const std::size_t size = std::stoul(std::string{rest.substr(0, eol)}, nullptr, 16);
+            rest.remove_prefix(eol + 2);
+            if(size == 0) break;
+            if(rest.size() < size + 2) throw HttpError{"truncated response from " + endpoint.hostHeader()};
+            response.body.append(rest.substr(0, size));
+            rest.remove_prefix(size + 2);
+        }
+    } else if(const auto length = response.header("content-length"); !length.empty()) {
+        const std::size_t size = std::stoul(length);
+        if(rest.size() < size) throw HttpError{"truncated response from " + endpoint.hostHeader()};
+        response.body = rest.substr(0, size);
+    } else response.body = rest;
+    return response;
+}
+
+} // namespace subset
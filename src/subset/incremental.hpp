@@ -0,0 +1,116 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "key_set.hpp"
+#include "schema_graph.hpp"
+#include "sql.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Where a run stands, taken inside its snapshot: rows committed later were
+// created by transactions at least as new as these.
+struct Watermark {
+    std::uint64_t xmin = 0; // oldest transaction still running, as a 64-bit txid
+    std::string timestamp;  // start of the oldest visible transaction still running
+};
+
+// xact_start is only visible for the sessions of the same role unless the
+// role has pg_read_all_stats; now() is the fallback.
+inline Watermark currentWatermark(pgfe::Connection& conn) {
+    Watermark watermark;
+    conn.execute([&](auto&& r) {
+        watermark.xmin = std::stoull(pgfe::to<std::string>(r[0]));
+        watermark.timestamp = pgfe::to<std::string>(r[1]);
+    }, R"(
+        SELECT
+            txid_snapshot_xmin(txid_current_snapshot())::text,
+            least(now(), (SELECT min(xact_start) FROM pg_stat_activity WHERE backend_xid IS NOT NULL))::text
+    )");
+    return watermark;
+}
+
+// The state an incremental run leaves for the next one, in a directory:
+//
+//   watermark   the job signature, the xmin and the timestamp watermarks
+//   keys        every key set, in need order
+//
+// A run with no usable state is a full one; the state is only replaced
+// once a run has succeeded.
+class IncrementalState {
+public:
+    IncrementalState(const std::filesystem::path& dir, const std::string& signature)
+        : dir_{dir}, signature_{signature} {
+        std::ifstream in{dir_ / "watermark"};
+        std::string stored;
+        Watermark watermark;
+        if(std::getline(in, stored) && stored == signature_ && in >> watermark.xmin && in.ignore() &&
+            std::getline(in, watermark.timestamp) && std::filesystem::exists(dir_ / "keys"))
+            previous_ = std::move(watermark);
+    }
+
+    const std::optional<Watermark>& previous() const { return previous_; }
+
+    // Adds the key sets of the previous run, the ones the unchanged rows
+    // still contribute.
+    void loadKeySets(std::vector<KeySet>& keySets) const {
+        if(!previous_) return;
+        std::ifstream in{dir_ / "keys", std::ios::binary};
+        if(!in) throw std::runtime_error{"cannot read " + (dir_ / "keys").string()};
+        for(auto& keySet : keySets) keySet.load(in);
+    }
+
+    // The condition matching the rows of table changed since the previous
+    // run, or an empty string if the table has to be read in full. An
+    // updated_at column is preferred; otherwise the row version's xmin is
+    // compared through age(), which copes with wraparound as long as the
+    // previous run is less than 2^31 transactions old.
+    std::string changedCondition(const SchemaGraph& graph, TableId table, const Watermark& current) const {
+        if(!previous_) return "";
+        for(const auto& col : graph.tableColumns(table)) {
+            if(graph.columnName(col.name) == "updated_at")
+                return quoteIdentifier("updated_at") + " >= " + quoteLiteral(previous_->timestamp) + "::timestamptz";
+        }
+        if(current.xmin < previous_->xmin || current.xmin - previous_->xmin >= (std::uint64_t{1} << 31)) return "";
+        const std::string xid = std::to_string(previous_->xmin & 0xffffffff);
+        return "age(xmin) <= age('" + xid + "'::xid)";
+    }
+
+    void save(const Watermark& current, const std::vector<KeySet>& keySets) const {
+        std::filesystem::create_directories(dir_);
+        const auto replace = [&](const char* name, auto&& write) {
+            auto tmp = dir_ / name;
+            tmp += ".tmp";
+            {
+                std::ofstream out{tmp, std::ios::binary | std::ios::trunc};
+                write(out);
+                if(!out) throw std::runtime_error{"cannot write " + tmp.string()};
+            }
+            std::filesystem::rename(tmp, dir_ / name);
+        };
+        // The keys go first: new keys with an old watermark only cost
+        // rereading rows.
+        replace("keys", [&](std::ofstream& out) {
+            for(const auto& keySet : keySets) keySet.save(out);
+        });
+        replace("watermark", [&](std::ofstream& out) {
+            out << signature_ << '\n' << current.xmin << '\n' << current.timestamp << '\n';
+        });
+    }
+
+private:
+    std::filesystem::path dir_;
+    std::string signature_;
+    std::optional<Watermark> previous_;
+};
+
+} // namespace subset
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "../include/src/util/memory.hpp"
+#include "copy_stream.hpp"
+#include "sink.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+namespace util = dmitigr::util;
+
+// Loads rows with multi-row `INSERT ... VALUES (...), ... ON CONFLICT DO
+// NOTHING` for targets where COPY can't be used, such as poolers in
+// transaction mode. Each write() holds whole CSV records, one or more, as the
+// StageSink and the MaskSink hand them on in chunks. Rows are gathered into
+// batches bounded by row count, by the protocol limit of 65535 parameters and
+// by size; each batch is bound to a prepared statement, so the values need
+// no quoting, and the batches are pipelined up to pipelineDepth deep.
+class InsertSink final : public Sink {
+public:
+    static constexpr std::size_t maxParameters = 65535;
+
+    InsertSink(pgfe::Connection& conn, const std::string& table, const std::vector<std::string>& columns,
+        std::size_t maxRows, std::size_t maxBytes, std::size_t pipelineDepth = 16)
+        : conn_{conn}, table_{table}, columns_{columns}, maxBytes_{maxBytes}, pipelineDepth_{pipelineDepth} {
+        if(columns_.empty()) throw std::invalid_argument{"INSERT loading needs the column list of " + table};
+        maxRows_ = std::max<std::size_t>(1, std::min(maxRows, maxParameters / columns_.size()));
+        values_.reserve(maxRows_ * columns_.size());
+    }
+
+    InsertSink(const InsertSink&) = delete;
+    InsertSink& operator=(const InsertSink&) = delete;
+
+    ~InsertSink() override {
+        try {
+            leavePipeline(false);
+            if(conn_.is_ready_for_request()) {
+                for(auto& [rows, ps] : statements_) conn_.unprepare(ps.name());
+            }
+        } catch(...) {}
+    }
+
+    void write(std::string_view data) override {
+        forEachCsvRecord(data, [&](std::string_view record) {
+            const std::size_t first = values_.size();
+            forEachCsvField(record, [&](std::size_t, std::string_view value, bool isNull) {
+                if(isNull) values_.emplace_back();
+                else values_.emplace_back(std::in_place, arena_.store(value).data(), value.size());
+            });
+            if(values_.size() - first != columns_.size())
+                throw std::runtime_error{"record of " + table_ + " doesn't match its column list"};
+            bytes_ += record.size();
+            if(values_.size() / columns_.size() >= maxRows_ || bytes_ >= maxBytes_) flush();
+        });
+    }
+
+    void close() override {
+        flush();
+        leavePipeline(true);
+        for(auto& [rows, ps] : statements_) conn_.unprepare(ps.name());
+        statements_.clear();
+    }
+
+private:
+    void flush() {
+        const std::size_t rows = values_.size() / columns_.size();
+        if(rows == 0) return;
+        auto& ps = statement(rows);
+        for(std::size_t i = 0; i < values_.size(); i++) {
+            if(values_[i]) ps.bind(i, *values_[i]);
+            else ps.bind(i, nullptr);
+        }
+        bytes_ = 0;
+        // libpq copies the values as it sends them, so the batch's memory is
+        // free for the next one however the statement is executed.
+        struct Release {
+            InsertSink& sink;
+            ~Release() {
+                sink.values_.clear();
+                sink.arena_.reset();
+            }
+        } release{*this};
+#ifdef LIBPQ_HAS_PIPELINING
+        if(conn_.pipeline_status() == pgfe::Pipeline_status::disabled) conn_.set_pipeline_enabled(true);
+        ps.execute_nio();
+        if(++inFlight_ >= pipelineDepth_) leavePipeline(true);
+#else
+        ps.execute();
+#endif
+    }
+
+    // One statement per batch size; in practice the full size and the tail.
+    pgfe::Prepared_statement& statement(std::size_t rows) {
+        if(const auto it = statements_.find(rows); it != statements_.end()) return it->second;
+        leavePipeline(true);
+
+        std::string sql = "INSERT INTO " + table_ + " (";
+        for(std::size_t c = 0; c < columns_.size(); c++) sql += (c ? ", " : "") + columns_[c];
+        sql += ") VALUES ";
+        std::size_t parameter = 1;
+        for(std::size_t r = 0; r < rows; r++) {
+            sql += r ? ", (" : "(";
+            for(std::size_t c = 0; c < columns_.size(); c++) sql += (c ? ", $" : "$") + std::to_string(parameter++);
+            sql += ')';
+        }
+        sql += " ON CONFLICT DO NOTHING";
+        const std::string name = "subset_insert_" + std::to_string(rows) + "_" + table_;
+        return statements_.emplace(rows, conn_.prepare_as_is(sql, name)).first->second;
+    }
+
+    // Syncs and consumes the responses of the batches in flight.
+    void leavePipeline(bool check) {
+#ifdef LIBPQ_HAS_PIPELINING
+        if(conn_.pipeline_status() == pgfe::Pipeline_status::disabled) return;
+        conn_.send_sync();
+        std::exception_ptr failure;
+        for(; inFlight_ > 0; inFlight_--) {
+            try {
+                conn_.wait_response_throw();
+                conn_.completion();
+            } catch(...) {
+                if(!failure) failure = std::current_exception();
+            }
+        }
+        try {
+            conn_.wait_response_throw();
+            conn_.ready_for_query();
+        } catch(...) {
+            if(!failure) failure = std::current_exception();
+        }
+        conn_.set_pipeline_enabled(false);
+        if(failure && check) std::rethrow_exception(failure);
+#else
+        (void)check;
+#endif
+    }
+
+    pgfe::Connection& conn_;
+    std::string table_;
+    std::vector<std::string> columns_;
+    std::size_t maxRows_;
+    std::size_t maxBytes_;
+    std::size_t pipelineDepth_;
+    // The values of the batch are views into the arena, which is reset when
+    // the batch is sent: no allocation per value.
+    util::Arena arena_{1 << 16};
+    std::vector<std::optional<pgfe::Data_view>> values_;
+    std::size_t bytes_ = 0;
+    std::size_t inFlight_ = 0;
+    std::map<std::size_t, pgfe::Prepared_statement> statements_;
+};
+
+} // namespace subset
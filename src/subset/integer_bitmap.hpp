@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+namespace subset {
+
+// A set of 64-bit integers split by their high 48 bits into containers of
+// up to 65536 values, each a sorted array while sparse and a bitmap once
+// dense, as in a roaring bitmap. The serial keys of a table take about a
+// bit each rather than the 8 bytes and the slots of a hash set, and a union
+// is an OR of the words of the bitmaps, in loops the compiler vectorizes.
+// Values come out in ascending order.
+class IntegerBitmap {
+public:
+    using value_type = std::int64_t;
+
+    // Returns false if the value was there already.
+    bool insert(std::int64_t value) {
+        auto [it, added] = containers_.try_emplace(high(value));
+        Container& container = it->second;
+        if(added) bytes_ += containerBytes;
+        const auto bit = low(value);
+        if(!container.bits.empty()) {
+            std::uint64_t& word = container.bits[bit >> 6];
+            const std::uint64_t mask = std::uint64_t{1} << (bit & 63);
+            if(word & mask) return false;
+            word |= mask;
+            container.count++;
+            size_++;
+            return true;
+        }
+        const auto at = std::lower_bound(container.array.begin(), container.array.end(), bit);
+        if(at != container.array.end() && *at == bit) return false;
+        container.array.insert(at, bit);
+        container.count++;
+        size_++;
+        bytes_ += sizeof(std::uint16_t);
+        if(container.array.size() > arrayLimit) toBitmap(container);
+        return true;
+    }
+
+    bool contains(std::int64_t value) const {
+        const auto it = containers_.find(high(value));
+        if(it == containers_.end()) return false;
+        const Container& container = it->second;
+        const auto bit = low(value);
+        if(!container.bits.empty()) return container.bits[bit >> 6] >> (bit & 63) & 1;
+        return std::binary_search(container.array.begin(), container.array.end(), bit);
+    }
+
+    // Adds the values of other, a container at a time.
+    void unite(const IntegerBitmap& other) {
+        for(const auto& [key, from] : other.containers_) {
+            auto [it, added] = containers_.try_emplace(key);
+            Container& into = it->second;
+            if(added) bytes_ += containerBytes;
+            const std::size_t before = into.count;
+            if(!from.bits.empty()) {
+                if(into.bits.empty()) toBitmap(into);
+                for(std::size_t i = 0; i < bitmapWords; i++) into.bits[i] |= from.bits[i];
+                recount(into);
+            } else if(!into.bits.empty()) {
+                for(const auto bit : from.array) into.bits[bit >> 6] |= std::uint64_t{1} << (bit & 63);
+                recount(into);
+            } else {
+                std::vector<std::uint16_t> merged;
+                merged.reserve(into.array.size() + from.array.size());
+                std::set_union(into.array.begin(), into.array.end(), from.array.begin(), from.array.end(),
+                    std::back_inserter(merged));
+                bytes_ += (merged.size() - into.array.size()) * sizeof(std::uint16_t);
+                into.array = std::move(merged);
+                into.count = into.array.size();
+                if(into.array.size() > arrayLimit) toBitmap(into);
+            }
+            size_ += into.count - before;
+        }
+    }
+
+    std::size_t size() const { return size_; }
+    std::size_t containerCount() const { return containers_.size(); }
+
+    // The heap the set holds, about: the containers and their values.
+    std::size_t memoryBytes() const { return bytes_; }
+
+    // Calls f with the values in ascending order until it returns false.
+    template<typename F>
+    void forEach(F&& f) const {
+        std::vector<std::int64_t> keys;
+        keys.reserve(containers_.size());
+        for(const auto& [key, container] : containers_) keys.push_back(key);
+        std::sort(keys.begin(), keys.end());
+        for(const auto key : keys) {
+            const Container& container = containers_.find(key)->second;
+            const auto base = static_cast<std::uint64_t>(key) << 16;
+            if(container.bits.empty()) {
+                for(const auto bit : container.array) {
+                    if(!f(static_cast<std::int64_t>(base | bit))) return;
+                }
+                continue;
+            }
+            for(std::size_t i = 0; i < bitmapWords; i++) {
+                for(std::uint64_t word = container.bits[i]; word != 0; word &= word - 1) {
+                    const auto bit = i * 64 + static_cast<std::size_t>(std::countr_zero(word));
+                    if(!f(static_cast<std::int64_t>(base | bit))) return;
+                }
+            }
+        }
+    }
+
+    // Empties the set, handing out its values in order.
+    std::vector<std::int64_t> take() {
+        std::vector<std::int64_t> values;
+        values.reserve(size_);
+        forEach([&](std::int64_t value) {
+            values.push_back(value);
+            return true;
+        });
+        containers_ = {};
+        size_ = 0;
+        bytes_ = 0;
+        return values;
+    }
+
+private:
+    // Past 4096 values the 8 KiB of a bitmap are the smaller.
+    static constexpr std::size_t arrayLimit = 4096;
+    static constexpr std::size_t bitmapWords = 65536 / 64;
+
+    struct Container {
+        std::vector<std::uint16_t> array;
+        std::vector<std::uint64_t> bits;
+        std::size_t count = 0;
+    };
+
+    // A container's node in the map and its bucket, besides its values.
+    static constexpr std::size_t containerBytes = sizeof(Container) + 4 * sizeof(void*);
+
+    void toBitmap(Container& container) {
+        container.bits.assign(bitmapWords, 0);
+        for(const auto bit : container.array) container.bits[bit >> 6] |= std::uint64_t{1} << (bit & 63);
+        bytes_ += bitmapWords * sizeof(std::uint64_t);
+        bytes_ -= container.array.size() * sizeof(std::uint16_t);
+        container.array = {};
+    }
+
+    static void recount(Container& container) {
+        std::size_t count = 0;
+        for(const auto word : container.bits) count += static_cast<std::size_t>(std::popcount(word));
+        container.count = count;
+    }
+
+    static std::int64_t high(std::int64_t value) { return value >> 16; }
+    static std::uint16_t low(std::int64_t value) { return static_cast<std::uint16_t>(value); }
+
+    std::unordered_map<std::int64_t, Container> containers_;
+    std::size_t size_ = 0;
+    std::size_t bytes_ = 0;
+};
+
+} // namespace subset
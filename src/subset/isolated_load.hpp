@@ -0,0 +1,172 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "copy_stream.hpp"
+#include "sink.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The rows the target refused, a file of them per table in directory: the
+// CSV records as they were sent, loadable once fixed, and next to them the
+// error of each.
+class Rejects {
+public:
+    explicit Rejects(std::filesystem::path directory) : directory_{std::move(directory)} {
+        std::filesystem::create_directories(directory_);
+    }
+
+    Rejects(const Rejects&) = delete;
+    Rejects& operator=(const Rejects&) = delete;
+
+    void reject(const std::string& table, std::string_view record, const std::string& error) {
+        const std::lock_guard lock{mutex_};
+        auto it = files_.find(table);
+        if(it == files_.end()) {
+            Files files{std::ofstream{directory_ / (table + ".csv")}, std::ofstream{directory_ / (table + ".errors")}};
+            if(!files.rows || !files.errors) throw std::runtime_error{"cannot write the rejects of " + table};
+            it = files_.emplace(table, std::move(files)).first;
+        }
+        Files& files = it->second;
+        files.rows << record;
+        if(record.empty() || record.back() != '\n') files.rows << '\n';
+        files.errors << ++files.count << ": " << error << '\n';
+        files.rows.flush();
+        files.errors.flush();
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    const std::filesystem::path& directory() const { return directory_; }
+
+private:
+    struct Files {
+        std::ofstream rows;
+        std::ofstream errors;
+        std::uint64_t count = 0;
+    };
+
+    std::filesystem::path directory_;
+    std::mutex mutex_;
+    std::map<std::string, Files> files_;
+    std::atomic<std::uint64_t> count_ = 0;
+};
+
+// Loads CSV records with one COPY per batch of them, each under a savepoint
+// in one transaction for the whole table. When the target refuses a batch
+// for its data, the savepoint is rolled back and the batch is loaded again
+// in halves, and so on down to the offending rows, which go to the rejects.
+// On clean data that's a savepoint and a COPY per batch; a bad row costs
+// about 2 log2(batch) extra COPYs. Every write has to hold whole records.
+class IsolatedCopySink final : public Sink {
+public:
+    IsolatedCopySink(pgfe::Connection& conn, std::string table, std::string statement, Rejects& rejects,
+        std::size_t batchRows, std::size_t bufferSize)
+        : conn_{conn}, table_{std::move(table)}, statement_{std::move(statement)}, rejects_{rejects},
+          batchRows_{std::max<std::size_t>(batchRows, 1)}, bufferSize_{bufferSize} {
+        // The savepoints need a transaction around them.
+        if(!conn_.is_transaction_uncommitted()) transaction_.emplace(conn_);
+    }
+
+    IsolatedCopySink(const IsolatedCopySink&) = delete;
+    IsolatedCopySink& operator=(const IsolatedCopySink&) = delete;
+
+    void write(std::string_view data) override {
+        data_.append(data);
+        for(std::size_t i = scanned_; i < data_.size();) {
+            const std::size_t end = csvRecordEnd(data_, i);
+            if(end == data_.size()) break;
+            starts_.push_back(i);
+            i = scanned_ = end + 1;
+        }
+        if(starts_.size() >= batchRows_) flush();
+    }
+
+    void close() override {
+        if(scanned_ < data_.size()) {
+            data_ += '\n';
+            starts_.push_back(scanned_);
+            scanned_ = data_.size();
+        }
+        flush();
+        if(transaction_) transaction_->commit();
+    }
+
+private:
+    // The record at index.
+    std::string_view record(std::size_t index) const {
+        const std::size_t end = index + 1 < starts_.size() ? starts_[index + 1] : scanned_;
+        return std::string_view{data_}.substr(starts_[index], end - starts_[index]);
+    }
+
+    void flush() {
+        if(!starts_.empty()) load(0, starts_.size());
+        data_.erase(0, scanned_);
+        starts_.clear();
+        scanned_ = 0;
+    }
+
+    void load(std::size_t first, std::size_t last) {
+        std::string error;
+        if(tryLoad(first, last, error)) return;
+        if(last - first == 1) {
+            rejects_.reject(table_, record(first), error);
+            return;
+        }
+        const std::size_t middle = first + (last - first) / 2;
+        load(first, middle);
+        load(middle, last);
+    }
+
+    // Whether the target took the records first to last; if not, why.
+    // Errors other than in the data are rethrown.
+    bool tryLoad(std::size_t first, std::size_t last, std::string& error) {
+        pgfe::Transaction_guard savepoint{conn_, true, "subset_batch"};
+        try {
+            CopyIn copy{conn_, statement_, bufferSize_};
+            const std::size_t end = last < starts_.size() ? starts_[last] : scanned_;
+            copy.write(std::string_view{data_}.substr(starts_[first], end - starts_[first]));
+            copy.close();
+        } catch(const pgfe::Server_exception& e) {
+            if(!isDataError(e)) throw;
+            error = e.what();
+            return false;
+        }
+        savepoint.commit();
+        return true;
+    }
+
+    // The classes a row can be to blame for: data exceptions and integrity
+    // constraint violations.
+    static bool isDataError(const pgfe::Server_exception& e) {
+        const std::string_view state = e.error().sqlstate();
+        return state.starts_with("22") || state.starts_with("23");
+    }
+
+    pgfe::Connection& conn_;
+    std::string table_;
+    std::string statement_;
+    Rejects& rejects_;
+    std::size_t batchRows_;
+    std::size_t bufferSize_;
+    std::optional<pgfe::Transaction_guard> transaction_;
+    std::string data_;                // the records of the batch, and the start of one more
+    std::vector<std::size_t> starts_; // of the whole records in data_
+    std::size_t scanned_ = 0;         // where the next record starts
+};
+
+} // namespace subset
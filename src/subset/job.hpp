@@ -0,0 +1,1453 @@
+#pragma once
+
+#include "../include/src/fsx/output_directory.hpp"
+#include "../include/src/pgfe/pgfe.hpp"
+#include "async_file.hpp"
+#include "binary_copy.hpp"
+#include "checkpoint.hpp"
+#include "checksum.hpp"
+#include "chunk_diff.hpp"
+#include "closure.hpp"
+#include "compression.hpp"
+#include "copy_stream.hpp"
+#include "cursor_extract.hpp"
+#include "daemon.hpp"
+#include "deferred_indexes.hpp"
+#include "discovery.hpp"
+#include "encryption.hpp"
+#include "existing_keys.hpp"
+#include "extract_cache.hpp"
+#include "file_sink.hpp"
+#include "finalize.hpp"
+#include "governor.hpp"
+#include "incremental.hpp"
+#include "insert_writer.hpp"
+#include "isolated_load.hpp"
+#include "key_sets.hpp"
+#include "log.hpp"
+#include "logical_sync.hpp"
+#include "masking.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "object_store.hpp"
+#include "options.hpp"
+#include "parquet_sink.hpp"
+#include "partitions.hpp"
+#include "persistence.hpp"
+#include "planner.hpp"
+#include "prepared_extract.hpp"
+#include "profile.hpp"
+#include "scheduler.hpp"
+#include "schema_clone.hpp"
+#include "seeds.hpp"
+#include "semi_join.hpp"
+#include "server_stats.hpp"
+#include "session.hpp"
+#include "shard_sink.hpp"
+#include "sink_factory.hpp"
+#include "snapshot.hpp"
+#include "sql.hpp"
+#include "stage_sink.hpp"
+#include "staging_loader.hpp"
+#include "table_plan.hpp"
+#include "table_step.hpp"
+#include "temporary_indexes.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// The extraction as a library: a job is an Options, built by parseOptions()
+// or by hand, run on a Session. main() is only its command line; a service
+// embeds the same path by holding a Session and calling runJob(), its
+// output, the progress and the summary, written to out.
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// One subset job, on the connections of session. Throws on failure.
+inline int runJob(const Options& options, Session& session, std::ostream& out = std::cout)
+{
+    auto beforeTime = std::chrono::steady_clock::now();
+    std::optional<TraceFile> trace;
+    if(!options.trace.empty()) trace.emplace(options.trace);
+    Metrics metrics;
+    Stopwatch phase;
+    // Each phase's peak RSS is its own where the peak can be reset, and the
+    // run's is the highest of them.
+    resetPeakResident();
+    std::uint64_t peakResident = 0;
+    // A phase ends in the metrics and, when traced, on the timeline.
+    const auto endPhase = [&](std::string name) {
+        if(auto* tracer = Tracer::active()) tracer->record(name, "phase", phase.started(), std::chrono::steady_clock::now());
+        const std::uint64_t peak = peakResidentBytes();
+        peakResident = std::max(peakResident, peak);
+        metrics.phase(std::move(name), phase.seconds(), peak, residentBytes());
+        resetPeakResident();
+    };
+    Logger logger{out, options.logLevel};
+    session.connect(options);
+    pgfe::Connection& conn = session.source();
+    endPhase("connect");
+
+    phase = {};
+    const auto discovered = session.discover(options, logger);
+    const SchemaGraph& graph = *discovered;
+    const TableId rootTable = *graph.findTable(options.rootTable);
+    endPhase("introspection");
+    const Seeds seeds{options, graph, rootTable};
+    // Tables sampled at the rate of the root, on top of their supporters'
+    // filters, so the closure still holds.
+    std::vector<bool> sampled(graph.tableCount(), false);
+    std::string filterSignature;
+    for(const auto& name : options.sampleTables) {
+        const auto t = graph.findTable(name);
+        if(!t) throw std::runtime_error{"unknown table in --sample-tables: " + name};
+        sampled[*t] = *t != rootTable;
+        filterSignature += "\nsample " + name;
+    }
+    // The predicates of --table-where cut the rows of their table, and so
+    // the rows reached through them, at the source. A table other rows
+    // reference has to keep those rows for the subset to stay closed.
+    std::vector<std::string> predicates(graph.tableCount());
+    for(const auto& [name, predicate] : options.tableFilters) {
+        const auto t = graph.findTable(name);
+        if(!t) throw std::runtime_error{"unknown table in --table-where: " + name};
+        predicates[*t] += (predicates[*t].empty() ? "(" : " AND (") + predicate + ")";
+        filterSignature += "\nwhere " + name + ' ' + predicate;
+    }
+    // What a table's rows are filtered on besides its supporters' keys.
+    const auto rowFilter = [&](TableId table) {
+        std::string filter = sampled[table] ?
+            sampleCondition(graph.tableName(table), options.samplePercent, options.sampleSeed) : std::string{};
+        if(!predicates[table].empty()) filter += (filter.empty() ? "" : " AND ") + predicates[table];
+        return filter;
+    };
+    // The columns of --mask, by table.
+    const Masker masker{options.masks.empty() ? std::string{} : maskKey(options.maskKeyEnv)};
+    std::vector<std::vector<std::pair<ColumnId, Mask>>> masked(graph.tableCount());
+    for(const auto& rule : options.masks) {
+        const auto t = graph.findTable(rule.table);
+        std::optional<ColumnId> column;
+        for(auto& col : graph.tableColumns(t.value_or(rootTable))) {
+            if(t && graph.columnName(col.name) == rule.column) column = col.name;
+        }
+        if(!column) throw std::runtime_error{"unknown column in --mask: " + rule.table + "." + rule.column};
+        masked[*t].emplace_back(*column, rule.function);
+    }
+    // With --parents=referenced the tables the root doesn't reach through
+    // dependents aren't read whole: they only take the rows the subset
+    // references, once the rest is read, and filter nothing before. Their
+    // supporters are such tables as well.
+    std::vector<bool> referenced(graph.tableCount(), false);
+    if(options.parents == Parents::referenced) {
+        std::vector<bool> reached(graph.tableCount(), false);
+        std::vector<TableId> stack{rootTable};
+        reached[rootTable] = true;
+        while(!stack.empty()) {
+            const TableId t = stack.back();
+            stack.pop_back();
+            for(auto l : graph.dependents(t)) {
+                if(!reached[graph.link(l).child]) stack.push_back(graph.link(l).child);
+                reached[graph.link(l).child] = true;
+            }
+        }
+        for(TableId t = 0; t < graph.tableCount(); t++) referenced[t] = !reached[t];
+    }
+    const auto followed = [&](LinkId l) { return !referenced[graph.link(l).parent]; };
+
+    for(TableId t = 0; t < graph.tableCount() && logger.enabled(LogLevel::debug); t++) {
+        if(graph.supporters(t).empty()) continue;
+        logger.debug([&] {
+            std::string line = graph.tableName(t) + " depends on: ";
+            for(auto l : graph.supporters(t)) line += graph.tableName(graph.link(l).parent) + " | ";
+            return line;
+        });
+    }
+
+    phase = {};
+    const Components components = stronglyConnectedComponents(graph);
+    // The links of --fanout-limit, by child table. A cycle's rounds read
+    // its tables a key set at a time, which a cap per key can't span.
+    std::vector<std::vector<std::pair<LinkId, const FanoutLimit*>>> fanouts(graph.tableCount());
+    for(const auto& cap : options.fanoutLimits) {
+        const auto t = graph.findTable(cap.table);
+        std::optional<LinkId> link;
+        for(auto l : t ? graph.supporters(*t) : std::span<const LinkId>{}) {
+            if(graph.link(l).arity == 1 && graph.columnName(graph.link(l).childColumn) == cap.column) link = l;
+        }
+        if(!link) throw std::runtime_error{"no foreign key for --fanout-limit: " + cap.table + "." + cap.column};
+        if(components.cyclic(graph, components.of[*t]))
+            throw std::runtime_error{"--fanout-limit on a table of a cycle: " + cap.table};
+        fanouts[*t].emplace_back(*link, &cap);
+        filterSignature += "\nfanout " + cap.table + '.' + cap.column + ' ' + std::to_string(cap.limit) + ' ' + cap.order;
+    }
+    const auto waves = topologicalWaves(graph, components);
+    endPhase("topological sort");
+    for(std::size_t w = 0; w < waves.size(); w++) {
+        logger.info([&] {
+            std::string line = "Wave " + std::to_string(w) + ':';
+            for(auto t : waves[w]) line += ' ' + graph.tableName(t);
+            return line;
+        });
+    }
+
+    // The foreign keys followed into a child with no index on the child's
+    // column, each filter on which scans the whole child.
+    const auto describeMissing = [&](const MissingIndex& missing) {
+        const FkLink& link = graph.link(missing.link);
+        char cost[32];
+        std::snprintf(cost, sizeof(cost), "%.0f", missing.scanCost);
+        return "no index on " + graph.tableName(link.child) + '.' + graph.columnName(link.childColumn) +
+            ": every read filtered on it is a sequential scan of cost " + cost;
+    };
+
+    // --plan stops at the estimate, before anything is read.
+    if(options.plan) {
+        logger.flush();
+        const auto stats = loadPlanStats(conn, graph, options.schema);
+        double seedRows = 0;
+        KeySetStage keySets{conn, options.inlineKeys};
+        conn.execute([&](auto&& r) { seedRows = pgfe::to<double>(r[0]); },
+            "SELECT count(*)::float8 FROM " + options.rootTable + " WHERE " + seeds.condition(keySets, options.rootTable));
+        printCostTree(out, graph,
+            estimateSubset(graph, components, waves, stats, rootTable, seedRows), rootTable);
+        if(options.fkIndexes != FkIndexes::off) {
+            for(const auto& missing : findMissingIndexes(conn, graph, options.schema, stats, followed))
+                out << describeMissing(missing) << '\n';
+        }
+        return 0;
+    }
+
+    // Of the tables ready, the head of the heaviest chain of estimated bytes
+    // goes first. A seed predicate is taken to match the whole root table.
+    // Uncompressed output files are preallocated from the estimates too.
+    std::vector<double> ranks;
+    std::vector<TableEstimate> estimates;
+    std::vector<TableStats> stats;
+    const bool preallocate = !options.pipe && options.upload.empty() && options.format == OutputFormat::csv &&
+        options.compress == Compression::none && !options.shardSize && options.encryptKeyEnv.empty();
+    if(options.schedule == Schedule::criticalPath || preallocate || !options.profile.empty()) {
+        phase = {};
+        stats = loadPlanStats(conn, graph, options.schema);
+        const double seedRows = seeds.ids() ? static_cast<double>(seeds.ids()->size()) : stats[rootTable].rows;
+        estimates = estimateSubset(graph, components, waves, stats, rootTable, seedRows);
+        if(options.schedule == Schedule::criticalPath) {
+            std::vector<double> costs;
+            for(const auto& estimate : estimates) costs.push_back(estimate.bytes);
+            ranks = criticalPathRanks(graph, components, costs);
+        }
+        endPhase("schedule");
+    }
+    // A replay starts the tables in the order of the run it was recorded of.
+    if(!options.replay.empty()) ranks = replayRanks(graph, components, readProfile(options.replay));
+
+    // With --fk-indexes=create the missing indexes are built for the run,
+    // before the snapshot they'd wait for; they're dropped after it.
+    std::optional<TemporaryIndexes> temporaryIndexes;
+    if(options.fkIndexes != FkIndexes::off) {
+        phase = {};
+        if(stats.empty()) stats = loadPlanStats(conn, graph, options.schema);
+        const auto missing = findMissingIndexes(conn, graph, options.schema, stats, followed);
+        if(options.fkIndexes == FkIndexes::create && !missing.empty()) temporaryIndexes.emplace(conn, options.schema, logger);
+        for(const auto& m : missing) {
+            const FkLink& link = graph.link(m.link);
+            if(temporaryIndexes && temporaryIndexes->create(graph.tableName(link.child), graph.columnName(link.childColumn))) {
+                logger.info([&] {
+                    return "Indexed " + graph.tableName(link.child) + '.' + graph.columnName(link.childColumn) + " for the run";
+                });
+            } else logger.warn([&] { return describeMissing(m); });
+        }
+        endPhase("foreign key indexes");
+    }
+
+    // With --semi-join=adaptive every read of a child picks for each link
+    // whether the server or the client matches its keys.
+    std::optional<SemiJoinPlanner> semiJoins;
+    if(options.semiJoin == SemiJoin::adaptive) {
+        if(stats.empty()) stats = loadPlanStats(conn, graph, options.schema);
+        semiJoins.emplace(graph, stats, loadIndexedColumns(conn, graph, options.schema));
+    }
+
+    // With --sync the slot decodes every change committed after it's
+    // created, so it goes first.
+    if(options.sync) LogicalSync::createSlot(conn, options.syncSlot);
+    // Read before the snapshot, so that a cached extraction is never
+    // keyed on a write the snapshot doesn't see. The daemon's memory cache
+    // holds the extractions of the jobs before, of which the deltas and the
+    // server closures aren't kept, depending on more than the key sets.
+    std::optional<ExtractCache> cache;
+    MemoryCache* const memoryCache = options.incremental.empty() && options.closure == Closure::client ?
+        session.memoryCache() : nullptr;
+    std::vector<std::string> tableWatermarks;
+    if(!options.cache.empty()) cache.emplace(options.cache);
+    if(cache || memoryCache) tableWatermarks = subset::tableWatermarks(conn, graph, options.schema);
+    // The sessions are named after the table whose statements they run, and
+    // what those cost told by their counters from here to the end.
+    std::optional<ServerStats> serverStats;
+    if(options.serverStats) {
+        serverStats.emplace(conn, session.sourceOptions(), logger);
+        if(!serverStats->statements())
+            logger.warn([] { return std::string{"--server-stats: pg_stat_statements is not available"}; });
+    }
+    // Every worker reads as of the snapshot of the lead connection.
+    std::optional<ExportedSnapshot> snapshot;
+    if(options.snapshot) snapshot.emplace(conn);
+    const auto snapshotId = snapshot ? std::optional{snapshot->id()} : std::nullopt;
+
+    // Outlives the key sets charged to it.
+    std::optional<KeyBudget> keyBudget;
+    if(options.keyMemory) {
+        keyBudget.emplace(options.keyMemory << 20,
+            options.spillDir.empty() ? std::filesystem::temp_directory_path() : options.spillDir);
+    }
+    // keyValues[need] = distinct values of the referenced column collected so far
+    std::vector<KeySet> keyValues = makeKeySets(graph);
+    // referencedKeys[link] = values of the child column of link among the
+    // rows read, which the parent has to hold with --parents=referenced
+    std::vector<KeySet> referencedKeys;
+    for(LinkId l = 0; l < graph.linkCount() && options.parents == Parents::referenced; l++)
+        referencedKeys.emplace_back(keyValues[graph.link(l).need].emptyLike());
+
+    // With --incremental only the rows changed since the previous run are
+    // read, plus the rows of keys which weren't in the subset before,
+    // collected in newKeys.
+    const auto signature = jobSignature(graph, options.rootTable, seeds.signature() + filterSignature);
+    std::optional<IncrementalState> incremental;
+    Watermark watermark;
+    std::vector<KeySet> newKeys;
+    if(!options.incremental.empty()) {
+        incremental.emplace(options.incremental, signature);
+        watermark = currentWatermark(conn);
+        incremental->loadKeySets(keyValues);
+        if(incremental->previous()) newKeys = makeKeySets(graph);
+    }
+
+    // The keys of the links inside cycles, by the round of the cycle
+    // that follows them: found but not followed yet, followed by the
+    // current round, and followed before.
+    std::vector<bool> cyclicNeed(graph.needCount(), false);
+    for(TableId t = 0; t < graph.tableCount(); t++) {
+        for(auto l : graph.supporters(t)) {
+            if(components.internal(graph, l)) cyclicNeed[graph.link(l).need] = true;
+        }
+    }
+    std::vector<KeySet> pendingKeys;
+    std::vector<KeySet> roundKeys;
+    std::vector<KeySet> deliveredKeys;
+    if(std::find(cyclicNeed.begin(), cyclicNeed.end(), true) != cyclicNeed.end()) {
+        pendingKeys = makeKeySets(graph);
+        roundKeys = makeKeySets(graph);
+        deliveredKeys = makeKeySets(graph);
+    }
+    // A spilled set can't tell new keys from old, which the cycles and
+    // the deltas of --incremental go by.
+    for(NeedId need = 0; keyBudget && newKeys.empty() && need < graph.needCount(); need++) {
+        if(!cyclicNeed[need]) keyValues[need].spillTo(*keyBudget);
+    }
+
+    const auto addKey = [&](NeedId need, std::string_view value, bool binary) {
+        const bool added = binary ? keyValues[need].insertBinary(value) : keyValues[need].insert(value);
+        if(!added) return;
+        if(!newKeys.empty()) {
+            if(binary) newKeys[need].insertBinary(value);
+            else newKeys[need].insert(value);
+        }
+        if(cyclicNeed[need]) {
+            if(binary) pendingKeys[need].insertBinary(value);
+            else pendingKeys[need].insert(value);
+        }
+    };
+
+    // Only the referenced columns of the seed rows are needed here.
+    if(const auto [first, last] = graph.needs(rootTable); first < last) {
+        std::string keyColumns;
+        std::vector<std::size_t> fieldOf; // of the first column of each need
+        std::size_t fields = 0;
+        for(auto need = first; need < last; need++) {
+            fieldOf.push_back(fields);
+            for(const ColumnId c : graph.needColumns(need)) {
+                keyColumns += (keyColumns.empty() ? "" : ", ") + quoteIdentifier(graph.columnName(c));
+                fields++;
+            }
+        }
+        KeySetStage keySets{conn, options.inlineKeys};
+        conn.execute([&](auto&& r)
+            {
+                std::vector<std::string_view> tuple;
+                for(auto need = first; need < last; need++) {
+                    const std::size_t field = fieldOf[need - first];
+                    const std::size_t arity = graph.needColumns(need).size();
+                    tuple.clear();
+                    for(std::size_t i = field; i < field + arity && r.data(i); i++) tuple.push_back(pgfe::to<std::string_view>(r.data(i)));
+                    if(tuple.size() < arity) continue;
+                    addKey(need, arity == 1 ? tuple.front() : std::string_view{KeySet::tupleText(tuple)}, false);
+                }
+            },
+            ("select " + keyColumns + " from " + options.rootTable + " where " + seeds.condition(keySets, options.rootTable) +
+                (predicates[rootTable].empty() ? "" : " AND " + predicates[rootTable])));
+    }
+
+    // Parquet compresses its pages itself.
+    const bool parquet = !options.pipe && options.format == OutputFormat::parquet;
+    const bool gzip = !options.pipe && !parquet && options.compress == Compression::gzip;
+    // With --encrypt-key-env every file is encrypted last, after gzip.
+    std::optional<EncryptionKey> encryptionKey;
+    if(!options.encryptKeyEnv.empty()) encryptionKey = subset::encryptionKey(options.encryptKeyEnv);
+    const std::string encryptedSuffix = encryptionKey ? ".enc" : "";
+    const std::string fileSuffix = (gzip ? ".gz" : "") + encryptedSuffix;
+    // With --shard-size a table's rows go to table.00000.csv, table.00001.csv
+    // and on.
+    const auto shardFile = [&](TableId table, std::string_view extension, std::size_t index) {
+        return shardPath(options.outputDir, graph.tableName(table), extension, index, fileSuffix);
+    };
+
+    // With --checkpoint every finished table is recorded along with its
+    // key sets, so --resume can skip it.
+    std::optional<Checkpoint> checkpoint;
+    if(!options.checkpoint.empty()) {
+        checkpoint.emplace(options.checkpoint, graph, signature, options.resume);
+        // An output file which doesn't match the log was lost or
+        // rewritten; extract that table again.
+        for(TableId t = 0; t < graph.tableCount() && !options.pipe; t++) {
+            const auto* entry = checkpoint->entry(t);
+            if(!entry) continue;
+            bool intact = false;
+            for(const char* extension : {".csv", ".bin", ".parquet"}) {
+                std::error_code ec;
+                if(options.shardSize) {
+                    // The shards the table was finished with, up to the first missing.
+                    std::uint64_t size = 0;
+                    std::size_t shards = 0;
+                    for(std::uintmax_t bytes; bytes = std::filesystem::file_size(shardFile(t, extension, shards), ec), !ec; shards++)
+                        size += bytes;
+                    intact = intact || (shards && size == entry->bytes);
+                    continue;
+                }
+                const auto path = options.outputDir / (graph.tableName(t) + extension + (parquet ? encryptedSuffix : fileSuffix));
+                const auto size = std::filesystem::file_size(path, ec);
+                intact = intact || (!ec && size == entry->bytes);
+            }
+            if(!intact) checkpoint->invalidate(t);
+        }
+        checkpoint->loadKeySets(keyValues);
+    }
+
+    // The columns a link's keys are matched on, two or more of a composite key.
+    const auto childKey = [&](const FkLink& link) { return graph.columnNames(graph.childColumns(link)); };
+
+    // The root table is read for the seeds alone. The links of scanned are
+    // matched by the client.
+    auto whereCondition = [&](TableId table, KeySetStage& keySets,
+        const std::vector<LinkId>& scanned = {}) {
+        std::string whereCondition = "";
+        bool first = true;
+        const auto supporters = table == rootTable ? std::span<const LinkId>{} : graph.supporters(table);
+        if(table == rootTable) {
+            whereCondition = "WHERE " + seeds.condition(keySets, options.rootTable);
+            first = false;
+        }
+        for(auto l : supporters) {
+            if(!followed(l) || std::find(scanned.begin(), scanned.end(), l) != scanned.end()) continue;
+            const FkLink& link = graph.link(l);
+            whereCondition += first ? "WHERE " : " AND ";
+            first = false;
+            whereCondition += keySets.match(graph.tableName(table), childKey(link), keyValues[link.need]);
+        }
+        if(const std::string sample = rowFilter(table); !sample.empty()) {
+            whereCondition += (first ? "WHERE " : " AND ") + sample;
+            first = false;
+        }
+        // Each capped link keeps the first rows per key of those matching
+        // the rest; the row identity spans the partitions.
+        std::string caps;
+        for(auto& [l, cap] : fanouts[table]) {
+            if(table == rootTable || !followed(l)) continue;
+            const std::string column = quoteIdentifier(cap->column);
+            caps += (first && caps.empty() ? "WHERE " : " AND ") + std::string{"(tableoid, ctid) IN (SELECT tableoid, ctid FROM ("
+                "SELECT tableoid, ctid, row_number() OVER (PARTITION BY "} + column + " ORDER BY " +
+                (cap->order.empty() ? "ctid" : cap->order) + ") AS fanout FROM " + graph.tableName(table) + ' ' +
+                whereCondition + ") capped WHERE fanout <= " + std::to_string(cap->limit) + ")";
+        }
+        whereCondition += caps;
+        first = first && caps.empty();
+        const std::string changed = incremental ? incremental->changedCondition(graph, table, watermark) : "";
+        if(!changed.empty()) {
+            std::string delta = changed;
+            for(auto l : supporters) {
+                const FkLink& link = graph.link(l);
+                if(newKeys[link.need].empty()) continue;
+                delta += " OR " + keySets.match(graph.tableName(table), childKey(link), newKeys[link.need]);
+            }
+            whereCondition += (first ? "WHERE (" : " AND (") + delta + ")";
+        }
+        return whereCondition;
+    };
+
+    std::atomic<int64_t> totalRows = 0;
+    // With --pipe every worker also takes a target connection, so the
+    // target pool never runs dry.
+    pgfe::Connection_pool* const targetPool = options.pipe ? &session.targetPool(options.jobs) : nullptr;
+    // With --clone-schema the target gets the tables it lacks first, from
+    // the source's catalog.
+    if(options.cloneSchema) {
+        phase = {};
+        const SchemaClone clone{conn, graph, options.schema};
+        const std::size_t created = clone.apply(*targetPool, options.jobs, logger);
+        logger.info([&] {
+            return "Cloned " + std::to_string(created) + " of " + std::to_string(clone.tableCount()) + " tables into the target";
+        });
+        endPhase("clone schema");
+    }
+    // Ranges of one table can only be read together as of one snapshot.
+    pgfe::Connection_pool* const helperPool = options.splitSize && snapshotId && options.jobs > 1 ?
+        &session.helperPool(options.jobs - 1) : nullptr;
+    // The extra COPY streams of --load-streams, shared by the tables.
+    pgfe::Connection_pool* const streamPool = options.pipe && options.loadStreams > 1 ?
+        &session.streamPool(options.loadStreams - 1) : nullptr;
+    const auto partitioned = loadPartitions(conn, graph, options.schema);
+    // Finished files are synced by --sync-threads of its own, and listed in
+    // its manifest at the end.
+    // With --upload they go to the object store instead, which keeps the
+    // manifest.
+    std::optional<dmitigr::fsx::Output_directory> outputDirectory;
+    std::optional<ObjectStore> objectStore;
+    if(!options.upload.empty()) {
+        RetryPolicy uploadRetry;
+        uploadRetry.attempts = static_cast<unsigned>(options.retries);
+        uploadRetry.base = std::chrono::milliseconds{options.retryBackoff};
+        uploadRetry.onRetry = [&](const std::string& error, unsigned attempt, std::chrono::milliseconds delay) {
+            logger.warn([&] {
+                return "upload retry " + std::to_string(attempt) + " of " + std::to_string(options.retries) + " in " +
+                    std::to_string(delay.count()) + " ms: " + error;
+            });
+        };
+        objectStore.emplace(ObjectLocation::parse(options.upload, options.s3Endpoint, options.s3Region),
+            std::move(uploadRetry));
+    } else if(!options.pipe) outputDirectory.emplace(options.outputDir, options.syncThreads);
+    // The checksum of each output file, taken as it's written.
+    std::vector<Crc32c> checksums(graph.tableCount());
+    // The files of each table with --shard-size, in order.
+    std::vector<std::deque<FileShard>> fileShards(graph.tableCount());
+    // The rows the target refuses, with --rejects.
+    std::optional<Rejects> rejects;
+    if(!options.rejects.empty()) rejects.emplace(options.rejects);
+    // One pool of threads for the work taken off the COPY receive loops:
+    // the writes for when io_uring is unavailable, which free the buffers
+    // the loops wait on, go before compression.
+    const bool asyncWrites = !options.pipe && !objectStore && options.writer == Writer::async;
+    const std::size_t workThreads = (gzip ? options.compressThreads : 0) + (encryptionKey ? options.encryptThreads : 0) +
+        (asyncWrites ? options.jobs : 0) +
+        (options.masks.empty() ? 0 : options.maskThreads) + (objectStore ? options.uploadThreads : 0);
+    CpuPlacement placement{options.pinCpus, options.jobs};
+    std::optional<dmitigr::util::Thread_pool> workPool;
+    if(workThreads) workPool.emplace(workThreads, placement.poolCpus());
+    std::optional<TaskPool> compressionPool;
+    if(gzip) compressionPool.emplace(*workPool, dmitigr::util::Task_priority::normal);
+    std::optional<TaskPool> encryptionPool;
+    if(encryptionKey) encryptionPool.emplace(*workPool, dmitigr::util::Task_priority::normal);
+    std::optional<TaskPool> writerPool;
+    if(asyncWrites) {
+        writerPool.emplace(*workPool, dmitigr::util::Task_priority::high);
+        // The blocks of the file sinks the workers have open at once,
+        // mapped and faulted in before the first COPY. Pinned workers map
+        // their own, on their nodes.
+        if(!placement.pinning())
+            util::chunk_pool(AsyncFileSink::blockBytes(options.bufferSize)).reserve(options.jobs * 4);
+    }
+    std::optional<TaskPool> maskPool;
+    std::optional<TaskPool> uploadPool;
+    if(objectStore) uploadPool.emplace(*workPool, dmitigr::util::Task_priority::high);
+    if(!options.masks.empty()) maskPool.emplace(*workPool, dmitigr::util::Task_priority::normal);
+    const PlanInputs planning{options, graph, rootTable, referenced, predicates, fanouts, masked, masker, keyValues,
+        semiJoins ? &*semiJoins : nullptr, targetPool != nullptr, parquet, rejects.has_value(), logger};
+
+    const SinkFactory sinkFactory{options, graph, fileSuffix, encryptedSuffix, encryptionKey ? &*encryptionKey : nullptr,
+        outputDirectory ? &*outputDirectory : nullptr, objectStore ? &*objectStore : nullptr, rejects ? &*rejects : nullptr,
+        compressionPool ? &*compressionPool : nullptr, encryptionPool ? &*encryptionPool : nullptr,
+        writerPool ? &*writerPool : nullptr, uploadPool ? &*uploadPool : nullptr, maskPool ? &*maskPool : nullptr,
+        preallocate, estimates, checksums, fileShards};
+
+    const auto takeTarget = [&] {
+        const Stopwatch stopwatch;
+        auto target = targetPool->acquire();
+        liveMetrics().poolWait.observe(stopwatch.seconds());
+        return target;
+    };
+
+    // The key batches of each table's prepared extractions.
+    std::vector<BatchSizer> batchSizers(graph.tableCount(),
+        BatchSizer{options.batchSize, static_cast<double>(options.batchLatency) / 1000});
+    // With --explain-slow the first batch of a table over the threshold is
+    // run again under EXPLAIN ANALYZE, which costs its time once more; a
+    // COPY is one batch.
+    const auto explained = std::make_unique<std::atomic_flag[]>(graph.tableCount());
+    // With a --governor-* budget the extraction backs off while the
+    // source's health is over it.
+    const GovernorBudget budget{std::chrono::milliseconds{options.governorLag}, options.governorBackends,
+        std::chrono::milliseconds{options.governorLatency}, options.governorReadRate};
+    std::optional<Governor> governor;
+    if(!budget.empty())
+        governor.emplace(session.sourceOptions(), budget, options.jobs, std::chrono::milliseconds{options.governorInterval}, logger);
+    // With --profile every table's shape and batches are recorded as well.
+    std::optional<ProfileRecorder> profile;
+    if(!options.profile.empty()) profile.emplace(graph, stats);
+    const auto explainWanted = [&](TableId table, double seconds) {
+        return options.explainSlow && seconds * 1000 >= static_cast<double>(options.explainSlow) &&
+            !explained[table].test_and_set();
+    };
+    const auto recordPlan = [&](TableId table, double seconds, const std::string& statement, std::string plan) {
+        logger.info([&] { return graph.tableName(table) + ": a batch took " + std::to_string(seconds) + " s, explained"; });
+        metrics.slowPlan({graph.tableName(table), seconds, statement, std::move(plan)});
+    };
+    // Reads the rows of table matching where into sink, collecting their
+    // keys along the way: into the shared key sets, or into keys when given.
+    const auto extract = [&](TableId table, const TablePlan& plan, pgfe::Connection& conn, Sink& sink,
+        Output& output, const std::function<std::string(KeySetStage&)>& where, const std::string& with = "",
+        std::vector<KeySet>* keys = nullptr, const std::string& relation = "") {
+        const std::string& tableName = graph.tableName(table);
+        const NamedSession named{conn, serverStats ? &*serverStats : nullptr, table, tableName};
+        const auto collect = [&](NeedId need, std::string_view value, bool binary) {
+            if(!keys) addKey(need, value, binary);
+            else if(binary) (*keys)[need].insertBinary(value);
+            else (*keys)[need].insert(value);
+        };
+        TupleGatherer tuples{plan.tuples};
+        const auto endRow = [&] {
+            tuples.endRow([&](std::size_t t, std::string_view tuple) {
+                if(t < plan.tupleNeeds.size()) collect(plan.tupleNeeds[t], tuple, false);
+                else referencedKeys[plan.tupleLinks[t - plan.tupleNeeds.size()]].insert(tuple);
+            });
+        };
+        const TraceSpan span{"extract", tableName, relation};
+        if(profile && profile->start(table)) {
+            for(const auto l : graph.supporters(table)) {
+                if(table != rootTable && followed(l)) profile->linkKeys(l, keyValues[graph.link(l).need].size());
+            }
+        }
+        const Stopwatch stopwatch;
+        const double cpuStart = threadCpuSeconds();
+        // Adds the times on whichever way the extraction returns.
+        struct Timing {
+            Output& output;
+            const Stopwatch& stopwatch;
+            double cpuStart;
+            ~Timing() {
+                output.seconds += stopwatch.seconds();
+                output.cpuSeconds += threadCpuSeconds() - cpuStart;
+            }
+        } timing{output, stopwatch, cpuStart};
+        const auto emit = [&](std::string_view data) {
+            sink.write(data);
+            output.bytes += data.size();
+            liveMetrics().rows.add(1);
+            liveMetrics().bytes.add(data.size());
+        };
+
+        // The rows of a prepared or a cursor extraction come as text fields,
+        // and go to the sink as the CSV records a COPY would have sent.
+        std::string record;
+        std::uint64_t skipped = 0;
+        // The rows of a scan the client's filter dropped.
+        ScanFilter scanFilter{plan.scanChecks};
+        std::uint64_t dropped = 0;
+        const auto onRow = [&](const pgfe::Row& r) {
+            if(!scanFilter.empty()) {
+                for(std::size_t i = 0; i < r.field_count(); i++) {
+                    const auto data = r.data(i);
+                    scanFilter.field(i, pgfe::to<std::string_view>(data), !data);
+                }
+                if(!scanFilter.endRow()) {
+                    dropped++;
+                    return;
+                }
+            }
+            record.clear();
+            for(std::size_t i = 0; i < r.field_count(); i++) {
+                if(i > 0) record += ',';
+                const auto data = r.data(i);
+                const auto value = pgfe::to<std::string_view>(data);
+                appendCsvField(record, value, !data);
+                tuples.field(i, value, !data);
+                if(!data) continue;
+                for(auto& [field, need] : plan.keyFields) {
+                    if(field == i) collect(need, value, false);
+                }
+                for(auto& [field, link] : plan.referenceFields) {
+                    if(field == i) referencedKeys[link].insert(value);
+                }
+            }
+            record += '\n';
+            endRow();
+            if(plan.existing && r.data(plan.existingField) &&
+                plan.existing->contains(pgfe::to<std::string_view>(r.data(plan.existingField)))) {
+                skipped++;
+                return;
+            }
+            emit(record);
+        };
+
+        if(plan.prepared) {
+            std::vector<KeyFilter> filters;
+            std::string select = "SELECT " + plan.selectList + " FROM " + tableName;
+            if(table != rootTable) {
+                for(auto l : graph.supporters(table)) {
+                    if(!followed(l)) continue;
+                    const FkLink& link = graph.link(l);
+                    filters.push_back(KeyFilter{graph.columnName(link.childColumn), &keyValues[link.need]});
+                }
+            } else if(seeds.ids()) filters.push_back(KeyFilter{"id", seeds.ids()});
+            else select += " WHERE (" + seeds.predicate() + ")";
+            logger.debug([&] { return tableName + '\n' + select + " (prepared, " + std::to_string(filters.size()) + " key sets)"; });
+            const BatchExplainer explainer{[&](double seconds) {
+                    if(profile) profile->batch(table, seconds);
+                    if(governor) governor->observe(seconds);
+                    return explainWanted(table, seconds);
+                },
+                [&](double seconds, const std::string& statement, std::string plan) {
+                    recordPlan(table, seconds, statement, std::move(plan));
+                }};
+            const BatchDeadline deadline{std::chrono::milliseconds{options.batchTimeout}, BatchSizer::minimum,
+                10000, [&](std::size_t keys, double seconds) {
+                    logger.warn([&] { return tableName + ": batch of " + std::to_string(keys) +
+                        " keys cancelled after " + std::to_string(seconds) + " s, running it in halves"; });
+                    metrics.cancelledBatch({tableName, keys, seconds});
+                }};
+            const auto rows = extractPrepared(conn, select, filters, batchSizers[table], onRow, &explainer,
+                options.batchTimeout ? &deadline : nullptr);
+            output.rows += rows - skipped;
+            output.skipped += skipped;
+            logger.debug([&] { return tableName + ": batches of " + std::to_string(batchSizers[table].size()) + " keys"; });
+            return;
+        }
+
+        KeySetStage keySets{conn, options.inlineKeys};
+        // The filter first: it may be what decides the WITH clause.
+        const std::string filter = where(keySets);
+        std::string query = with + R"(
+            SELECT
+                )" + (plan.selectList.empty() ? "*" : plan.selectList) + R"(
+            FROM 
+        )" + (relation.empty() ? tableName : relation)
+            + R"(
+        )" +
+            filter;
+        std::string copyQuery = "COPY(" + query + ") TO STDOUT" + plan.copyOptions;
+        logger.debug([&] { return tableName + '\n' + query + "\ncopy Query: " + copyQuery; });
+
+        BinaryCopyDecoder decoder;
+        // Whether the row being parsed is one the target has; its keys are
+        // still collected, as its children may be missing.
+        bool exists = false;
+        const auto onField = [&](std::size_t index, std::string_view value, bool isNull) {
+            tuples.field(index, value, isNull);
+            if(isNull) return;
+            for(auto& [field, need] : plan.keyFields) {
+                if(field == index) collect(need, value, plan.binary);
+            }
+            for(auto& [field, link] : plan.referenceFields) {
+                if(field == index) referencedKeys[link].insert(value);
+            }
+            if(plan.existing && index == plan.existingField) exists = plan.existing->contains(value);
+        };
+        const Stopwatch copying;
+        std::uint64_t read = 0;
+        if(plan.cursor) {
+            read = extractCursor(conn, query, batchSizers[table], onRow);
+            output.rows += read - skipped - dropped;
+            output.skipped += skipped;
+            logger.debug([&] { return tableName + ": fetches of " + std::to_string(batchSizers[table].size()) + " rows"; });
+        } else {
+            const auto messages = copyOut(conn, copyQuery, [&](std::string_view row) {
+                if(!scanFilter.empty()) {
+                    forEachCsvField(row, [&](std::size_t index, std::string_view value, bool isNull) {
+                        scanFilter.field(index, value, isNull);
+                    });
+                    if(!scanFilter.endRow()) {
+                        dropped++;
+                        return;
+                    }
+                }
+                if(plan.existing) {
+                    exists = false;
+                    forEachCsvField(row, onField);
+                    endRow();
+                    if(exists) skipped++;
+                    else emit(row);
+                    return;
+                }
+                emit(row);
+                if(plan.binary) decoder.feed(row, onField);
+                else if(plan.collectsKeys() || plan.references()) {
+                    forEachCsvField(row, onField);
+                    endRow();
+                }
+            });
+            // Binary messages carry the header and the trailer as well.
+            read = messages;
+            output.rows += plan.binary ? decoder.tuples() : messages - skipped - dropped;
+            output.skipped += skipped;
+        }
+        for(const auto l : plan.scanned) semiJoins->observe(l, keyValues[graph.link(l).need].size(), read, read - dropped);
+        if(profile) profile->batch(table, copying.seconds());
+        if(governor) governor->observe(copying.seconds());
+        if(explainWanted(table, copying.seconds())) {
+            std::string explainedPlan;
+            conn.execute([&](auto&& r) { explainedPlan += pgfe::to<std::string_view>(r[0]); }, explainAnalyze + query);
+            recordPlan(table, copying.seconds(), query, std::move(explainedPlan));
+        }
+    };
+
+    // In file mode the checkpoint keeps the size of the file, which is
+    // what a resumed run can check.
+    const auto finish = [&](TableId table, const TablePlan& plan, const Output& output) {
+        totalRows += output.rows;
+        metrics.table({graph.tableName(table), output.rows, output.bytes, output.seconds, output.cpuSeconds, output.loadSeconds});
+        if(profile) profile->finish(table, output.rows, output.bytes, output.seconds);
+        // The shards go into the manifest one by one, in order.
+        std::uint64_t shardBytes = 0;
+        for(const auto& shard : fileShards[table]) {
+            if(outputDirectory) {
+                outputDirectory->finish(shard.name, shard.checksum.value(), shard.rows);
+                shardBytes += std::filesystem::file_size(options.outputDir / shard.name);
+            }
+            if(objectStore) objectStore->finish(shard.name, shard.checksum.value(), shard.rows);
+        }
+        const bool sharded = !targetPool && options.shardSize;
+        if(outputDirectory && !sharded)
+            outputDirectory->finish(sinkFactory.outputFile(table, plan).filename(), checksums[table].value(), output.rows);
+        if(objectStore && !sharded)
+            objectStore->finish(sinkFactory.outputFile(table, plan).filename().string(), checksums[table].value(), output.rows);
+        if(!checkpoint) return;
+        const std::uint64_t bytes = targetPool ? output.bytes :
+            sharded ? shardBytes : std::filesystem::file_size(sinkFactory.outputFile(table, plan));
+        checkpoint->markCompleted(table, keyValues, {output.rows, bytes});
+    };
+
+    // The cache entry of what a table's extraction reads: the same columns
+    // and format, the same seeds or keys of its supporters, and the table
+    // unchanged. The key pass and the references are never cached, nor are
+    // the tables whose rows are skipped or masked on the way to the sink.
+    const auto cacheEntry = [&](TableId table, const TablePlan& plan, Pass pass) -> std::optional<std::string> {
+        if((!cache && !memoryCache) || pass == Pass::keys || pass == Pass::references || plan.existing || plan.masker ||
+            tableWatermarks[table].empty())
+            return std::nullopt;
+        std::string key = graph.tableName(table) + '\n' + plan.selectList + '\n' + plan.copyOptions +
+            (plan.prepared ? "\nprepared\n" : "\n") + tableWatermarks[table] + '\n' + rowFilter(table) + '\n';
+        for(auto& [l, cap] : fanouts[table]) key += "fanout " + cap->column + ' ' + std::to_string(cap->limit) + ' ' + cap->order + '\n';
+        if(table == rootTable) key += seeds.signature();
+        else {
+            for(auto l : graph.supporters(table)) {
+                if(!followed(l)) continue;
+                const FkLink& link = graph.link(l);
+                std::string columns;
+                for(const auto& column : childKey(link)) columns += (columns.empty() ? "" : ",") + column;
+                key += columns + '=' + keySetHash(keyValues[link.need]) + '\n';
+            }
+        }
+        return ExtractCache::entryName(key);
+    };
+    // Feeds a cached extraction to sink and the key sets as the source would.
+    const auto replay = [&](const TablePlan& plan, Sink& sink, Output& output, std::string_view bytes) {
+        BinaryCopyDecoder decoder;
+        TupleGatherer tuples{plan.tuples};
+        const auto onField = [&](std::size_t index, std::string_view value, bool isNull) {
+            tuples.field(index, value, isNull);
+            if(isNull) return;
+            for(auto& [field, need] : plan.keyFields) {
+                if(field == index) addKey(need, value, plan.binary);
+            }
+        };
+        std::uint64_t messages = 0;
+        ExtractCache::forEachMessage(bytes, [&](std::string_view row) {
+            sink.write(row);
+            output.bytes += row.size();
+            messages++;
+            if(plan.binary) decoder.feed(row, onField);
+            else if(plan.collectsKeys()) {
+                forEachCsvField(row, onField);
+                tuples.endRow([&](std::size_t t, std::string_view tuple) {
+                    if(t < plan.tupleNeeds.size()) addKey(plan.tupleNeeds[t], tuple, false);
+                });
+            }
+        });
+        output.rows += plan.binary ? decoder.tuples() : messages;
+    };
+
+    const auto takeHelpers = [&](std::vector<pgfe::Connection_pool::Handle>& helpers, std::size_t count) {
+        while(helperPool && helpers.size() < count) {
+            auto helper = helperPool->connection();
+            if(!helper.is_valid()) break;
+            helpers.push_back(std::move(helper));
+        }
+    };
+
+    // A table of --split-size or more is cut into ranges of heap blocks,
+    // read side by side on helper connections under the same snapshot; rows
+    // go into the table's sink a batch at a time and the keys of each range
+    // are merged once all are done. Without a free helper the table is read
+    // whole. Ranges need CSV rows, which can be interleaved, and TID range
+    // scans (PostgreSQL 14) to read only their blocks.
+    const auto blockRanges = [&](TableId table, const TablePlan& plan, pgfe::Connection& conn,
+        std::vector<pgfe::Connection_pool::Handle>& helpers) {
+        std::vector<TablePart> ranges;
+        // A capped table's every range would rank all of its rows.
+        if(!helperPool || plan.binary || plan.prepared || plan.references() || !fanouts[table].empty())
+            return ranges;
+        std::int64_t blocks = 0;
+        conn.execute([&](auto&& r) {
+            const auto bytes = pgfe::to<std::int64_t>(r["bytes"]);
+            if(bytes >= static_cast<std::int64_t>(options.splitSize) << 20) blocks = bytes / pgfe::to<std::int64_t>(r["block_size"]);
+        }, "SELECT pg_relation_size($1::regclass)::int8 AS bytes, current_setting('block_size')::int8 AS block_size",
+            graph.tableName(table));
+        if(blocks > 0) takeHelpers(helpers, options.jobs - 1);
+        const auto n = static_cast<std::int64_t>(helpers.size() + 1);
+        if(n < 2) return ranges;
+        const auto tid = [](std::int64_t block) { return "'(" + std::to_string(block) + ",0)'::tid"; };
+        for(std::int64_t i = 0; i < n; i++) {
+            std::string range;
+            if(i > 0) range = "ctid >= " + tid(blocks * i / n);
+            // The last range is open, for the blocks added since the size was taken.
+            if(i + 1 < n) range += (range.empty() ? "" : " AND ") + std::string{"ctid < "} + tid(blocks * (i + 1) / n);
+            ranges.push_back(TablePart{"", std::move(range)});
+        }
+        return ranges;
+    };
+
+    // A partitioned table is read a partition at a time, the partitions
+    // shared among the free helpers. When its partition key is the column
+    // of a supporter's link, the partitions which can't hold any of the
+    // link's keys are left out, which the planner can't do for a staged
+    // key set; with none left the table reads nothing. Without pruning or
+    // a helper it is read whole.
+    const auto partitionParts = [&](TableId table, const TablePlan& plan, pgfe::Connection& conn,
+        std::vector<pgfe::Connection_pool::Handle>& helpers) {
+        std::vector<TablePart> parts;
+        const auto it = partitioned.find(table);
+        if(it == partitioned.end() || plan.binary || plan.prepared || plan.references() ||
+            options.closure != Closure::client)
+            return parts;
+        const PartitionedTable& partitions = it->second;
+        std::optional<std::vector<std::size_t>> surviving;
+        for(auto l : table == rootTable ? std::span<const LinkId>{} : graph.supporters(table)) {
+            const FkLink& link = graph.link(l);
+            if(!followed(l) || partitions.keyColumn.empty() || link.arity != 1 ||
+                graph.columnName(link.childColumn) != partitions.keyColumn)
+                continue;
+            KeySetStage keySets{conn, options.inlineKeys};
+            surviving = survivingPartitions(conn, keySets, graph.tableName(table), partitions, keyValues[link.need]);
+            break;
+        }
+        if(surviving) {
+            logger.info([&] {
+                return graph.tableName(table) + ": " + std::to_string(surviving->size()) + " of " +
+                    std::to_string(partitions.partitions.size()) + " partitions";
+            });
+            if(surviving->empty()) return std::vector<TablePart>{TablePart{"", "false"}};
+        } else {
+            takeHelpers(helpers, std::min(partitions.partitions.size(), options.jobs) - 1);
+            if(helpers.empty()) return parts;
+            surviving.emplace();
+            for(std::size_t i = 0; i < partitions.partitions.size(); i++) surviving->push_back(i);
+        }
+        for(auto i : *surviving) parts.push_back(TablePart{partitions.partitions[i].relation, ""});
+        takeHelpers(helpers, std::min(parts.size(), options.jobs) - 1);
+        return parts;
+    };
+
+    const auto mergeKeys = [&](NeedId need, const KeySet& keys) {
+        if(newKeys.empty()) keyValues[need].merge(keys);
+        else keys.forEachText([&](std::string_view value) { addKey(need, value, false); });
+    };
+
+    const TableStep step{options, graph, components, seeds, rootTable, snapshotId, planning, sinkFactory, placement,
+        logger, targetPool, streamPool, cache ? &*cache : nullptr, memoryCache, takeTarget, whereCondition, extract,
+        cacheEntry, replay, [&](TableId table, const TablePlan& plan, pgfe::Connection& conn,
+            std::vector<pgfe::Connection_pool::Handle>& helpers) {
+            auto parts = partitionParts(table, plan, conn, helpers);
+            if(parts.empty()) parts = blockRanges(table, plan, conn, helpers);
+            return parts;
+        }, mergeKeys, finish};
+
+    // A cycle is read in rounds until its key sets stop growing. The
+    // tables with supporters outside of the cycle are read once, filtered
+    // on those; the others are reached through the links of the cycle,
+    // each round taking the rows matching the keys found by the one
+    // before and none of the older keys. With --pipe the whole cycle is
+    // loaded in one target transaction with the constraints deferred.
+    // After a key pass the key sets are final, and each table is read
+    // once for every key the cycle has.
+    auto runCycle = [&](const std::vector<TableId>& tables, pgfe::Connection& conn, Pass pass) {
+        SnapshotTransaction transaction{conn, snapshotId};
+        std::optional<pgfe::Connection_pool::Handle> target;
+        std::optional<pgfe::Transaction_guard> targetTransaction;
+        if(targetPool && pass != Pass::keys) {
+            target = takeTarget();
+            targetTransaction.emplace(**target);
+            (*target)->execute("SET CONSTRAINTS ALL DEFERRED");
+            if(options.load == Load::freeze) {
+                std::string list;
+                for(auto t : tables) list += (list.empty() ? "" : ", ") + graph.tableName(t);
+                (*target)->execute("TRUNCATE " + list);
+            }
+        }
+
+        std::vector<NeedId> internalNeeds;
+        std::vector<bool> external(tables.size(), false);
+        for(std::size_t i = 0; i < tables.size(); i++) {
+            // The root is read once, for the seeds.
+            if(tables[i] == rootTable) external[i] = true;
+            for(auto l : graph.supporters(tables[i])) {
+                if(!components.internal(graph, l)) external[i] = true;
+                else if(std::find(internalNeeds.begin(), internalNeeds.end(), graph.link(l).need) == internalNeeds.end())
+                    internalNeeds.push_back(graph.link(l).need);
+            }
+        }
+        // Keys known before, from the root row or a previous run, seed
+        // the first round.
+        if(pass != Pass::rows) {
+            for(auto need : internalNeeds) pendingKeys[need].merge(keyValues[need]);
+        }
+
+        std::vector<TablePlan> plans;
+        std::vector<std::unique_ptr<Sink>> files(tables.size());
+        std::vector<Output> outputs(tables.size());
+        for(std::size_t i = 0; i < tables.size(); i++) {
+            plans.push_back(planTable(planning, tables[i], true, pass));
+            if(pass == Pass::keys) files[i] = std::make_unique<NullSink>();
+            else if(!target) files[i] = sinkFactory.openSink(tables[i], plans[i], nullptr);
+        }
+
+        const auto keyFilter = [&](TableId table, KeySetStage& keySets, std::vector<KeySet>& keys) {
+            std::string filter;
+            for(auto l : graph.supporters(table)) {
+                const FkLink& link = graph.link(l);
+                if(keys[link.need].empty()) continue;
+                filter += (filter.empty() ? "" : " OR ") + keySets.match(graph.tableName(table), childKey(link), keys[link.need]);
+            }
+            return filter;
+        };
+
+        const auto externalFilter = [&](TableId table, KeySetStage& keySets) {
+            if(table == rootTable) return "WHERE " + seeds.condition(keySets, options.rootTable);
+            std::string condition;
+            for(auto l : graph.supporters(table)) {
+                if(components.internal(graph, l) || !followed(l)) continue;
+                const FkLink& link = graph.link(l);
+                condition += (condition.empty() ? "WHERE " : " AND ") +
+                    keySets.match(graph.tableName(table), childKey(link), keyValues[link.need]);
+            }
+            if(const std::string sample = rowFilter(table); !sample.empty())
+                condition += (condition.empty() ? "WHERE " : " AND ") + sample;
+            return condition;
+        };
+        const auto read = [&](std::size_t i, const std::function<std::string(KeySetStage&)>& where) {
+            if(pass == Pass::keys && !plans[i].collectsKeys()) return;
+            if(files[i]) extract(tables[i], plans[i], conn, *files[i], outputs[i], where);
+            else {
+                const auto sink = sinkFactory.openSink(tables[i], plans[i], &**target);
+                extract(tables[i], plans[i], conn, *sink, outputs[i], where);
+                const Stopwatch load;
+                const TraceSpan loading{"load", graph.tableName(tables[i])};
+                sink->close();
+                outputs[i].loadSeconds += load.seconds();
+            }
+        };
+
+        for(std::size_t i = 0; i < tables.size() && pass == Pass::rows; i++) {
+            const TableId table = tables[i];
+            if(external[i]) read(i, [&](KeySetStage& keySets) { return externalFilter(table, keySets); });
+            else read(i, [&](KeySetStage& keySets) {
+                const std::string filter = keyFilter(table, keySets, keyValues);
+                if(filter.empty()) return std::string{"WHERE false"};
+                const std::string sample = rowFilter(table);
+                return "WHERE (" + filter + ")" + (sample.empty() ? "" : " AND " + sample);
+            });
+        }
+        for(bool firstRound = true; pass != Pass::rows; firstRound = false) {
+            bool growing = false;
+            for(auto need : internalNeeds) {
+                growing = growing || !pendingKeys[need].empty();
+                roundKeys[need] = std::move(pendingKeys[need]);
+                pendingKeys[need] = roundKeys[need].emptyLike();
+            }
+            if(!firstRound && !growing) break;
+
+            for(std::size_t i = 0; i < tables.size(); i++) {
+                const TableId table = tables[i];
+                std::function<std::string(KeySetStage&)> where;
+                if(external[i]) {
+                    if(!firstRound) continue;
+                    where = [&](KeySetStage& keySets) { return externalFilter(table, keySets); };
+                } else {
+                    const bool reachable = std::any_of(graph.supporters(table).begin(), graph.supporters(table).end(),
+                        [&](LinkId l) { return !roundKeys[graph.link(l).need].empty(); });
+                    if(!reachable) continue;
+                    where = [&](KeySetStage& keySets) {
+                        std::string condition = "WHERE (" + keyFilter(table, keySets, roundKeys) + ")";
+                        const std::string seen = keyFilter(table, keySets, deliveredKeys);
+                        if(!seen.empty()) condition += " AND NOT COALESCE(" + seen + ", false)";
+                        if(const std::string sample = rowFilter(table); !sample.empty()) condition += " AND " + sample;
+                        return condition;
+                    };
+                }
+                read(i, where);
+            }
+            for(auto need : internalNeeds) deliveredKeys[need].merge(roundKeys[need]);
+        }
+
+        for(std::size_t i = 0; i < tables.size(); i++) {
+            if(!files[i]) continue;
+            const Stopwatch load;
+            const TraceSpan loading{"load", graph.tableName(tables[i])};
+            files[i]->close();
+            outputs[i].loadSeconds += load.seconds();
+        }
+        if(!target) {
+            transaction.commit();
+            if(pass == Pass::keys) return;
+            for(std::size_t i = 0; i < tables.size(); i++) finish(tables[i], plans[i], outputs[i]);
+            return;
+        }
+        runFinal([&] {
+            targetTransaction->commit();
+            transaction.commit();
+            for(std::size_t i = 0; i < tables.size(); i++) finish(tables[i], plans[i], outputs[i]);
+        });
+    };
+
+    // The rows referenced with --parents=referenced, by a semi-naive
+    // fixpoint: each round takes the keys referenced by the rows read
+    // before which are new to the key set of their need, and reads every
+    // table with new keys once, for the union of the new keys of all the
+    // links to it. The rows it reads bring their own references to the
+    // next round, until there are no new ones. A key is asked for once, so
+    // the rounds cost what the new keys do rather than scans of what is
+    // selected already. The tables of a round are read side by side.
+    const auto runReferenced = [&](pgfe::Connection_pool& pool) {
+        std::vector<std::optional<TablePlan>> plans(graph.tableCount());
+        std::vector<std::unique_ptr<Sink>> sinks(graph.tableCount());
+        std::vector<Output> outputs(graph.tableCount());
+        for(std::size_t round = 0;; round++) {
+            std::vector<KeySet> delta = makeKeySets(graph);
+            for(LinkId l = 0; l < graph.linkCount(); l++) {
+                const NeedId need = graph.link(l).need;
+                referencedKeys[l].forEachText([&](std::string_view value) {
+                    if(keyValues[need].insert(value)) delta[need].insert(value);
+                });
+                referencedKeys[l] = keyValues[need].emptyLike();
+            }
+            std::vector<TableId> tables;
+            for(TableId t = 0; t < graph.tableCount(); t++) {
+                const auto [first, last] = graph.needs(t);
+                if(std::any_of(delta.begin() + first, delta.begin() + last, [](const auto& keys) { return !keys.empty(); }))
+                    tables.push_back(t);
+            }
+            if(tables.empty()) break;
+            logger.info([&] {
+                std::string line = "References " + std::to_string(round) + ':';
+                for(auto t : tables) line += ' ' + graph.tableName(t);
+                return line;
+            });
+
+            std::atomic<std::size_t> next = 0;
+            std::vector<std::exception_ptr> errors(std::min(tables.size(), options.jobs));
+            const auto work = [&](std::size_t w) {
+                placement.pinWorker();
+                try {
+                    auto conn = pool.acquire();
+                    SnapshotTransaction transaction{*conn, snapshotId};
+                    for(auto i = next++; i < tables.size(); i = next++) {
+                        const TableId table = tables[i];
+                        if(!plans[table]) {
+                            plans[table] = planTable(planning, table, false, Pass::references);
+                            sinks[table] = sinkFactory.openSink(table, *plans[table], nullptr);
+                        }
+                        extract(table, *plans[table], *conn, *sinks[table], outputs[table], [&](KeySetStage& keySets) {
+                            std::string condition;
+                            const auto [first, last] = graph.needs(table);
+                            for(auto need = first; need < last; need++) {
+                                if(delta[need].empty()) continue;
+                                condition += (condition.empty() ? "WHERE " : " OR ") + keySets.match(graph.tableName(table),
+                                    graph.columnNames(graph.needColumns(need)), delta[need]);
+                            }
+                            return condition;
+                        });
+                    }
+                    transaction.commit();
+                } catch(...) {
+                    errors[w] = std::current_exception();
+                }
+            };
+            std::vector<std::thread> threads;
+            for(std::size_t w = 0; w < errors.size(); w++) threads.emplace_back(withTracer(work), w);
+            for(auto& thread : threads) thread.join();
+            for(const auto& error : errors) {
+                if(error) std::rethrow_exception(error);
+            }
+        }
+        for(TableId t = 0; t < graph.tableCount(); t++) {
+            if(!sinks[t]) continue;
+            const Stopwatch load;
+            const TraceSpan loading{"load", graph.tableName(t)};
+            sinks[t]->close();
+            outputs[t].loadSeconds = load.seconds();
+            finish(t, *plans[t], outputs[t]);
+        }
+    };
+
+    const auto runComponents = [&](Pass pass) {
+        return [&, pass](const std::vector<TableId>& tables, pgfe::Connection& conn) {
+            placement.pinWorker();
+            const auto permit = governor ? governor->admit() : Governor::Permit{};
+            if(components.cyclic(graph, components.of[tables.front()])) runCycle(tables, conn, pass);
+            // Outside of a cycle's transaction --load=insert commits as it
+            // goes, so a table failing half way can't be read again.
+            else if(targetPool && pass != Pass::keys && options.load == Load::insert)
+                runFinal([&] { runTable(step, tables.front(), conn, pass); });
+            else runTable(step, tables.front(), conn, pass);
+        };
+    };
+
+    phase = {};
+    pgfe::Connection_pool& pool = session.sourcePool(options.jobs);
+    endPhase("connect pool");
+    // The tables failing on what may pass by itself are read again, on a
+    // fresh connection, as long as none of their rows can be in the target.
+    RetryPolicy retry;
+    retry.attempts = static_cast<unsigned>(options.retries);
+    retry.base = std::chrono::milliseconds{options.retryBackoff};
+    retry.onRetry = [&](const std::string& error, unsigned attempt, std::chrono::milliseconds delay) {
+        logger.warn([&] {
+            return "retry " + std::to_string(attempt) + " of " + std::to_string(options.retries) + " in " +
+                std::to_string(delay.count()) + " ms: " + error;
+        });
+    };
+    if(options.keyPass) {
+        phase = {};
+        runInDependencyOrder(graph, components, pool, runComponents(Pass::keys), {}, ranks, retry);
+        endPhase("key pass");
+    }
+    // The unique indexes stay for the loads that resolve conflicts on them.
+    // What a run before dropped and didn't build again is picked up from
+    // its file instead, the target being without it.
+    std::optional<DeferredIndexes> deferred;
+    if(options.deferIndexes) {
+        phase = {};
+        const auto& dir = options.checkpoint.empty() ? options.outputDir : options.checkpoint;
+        std::filesystem::create_directories(dir);
+        const auto file = DeferredIndexes::pendingFile(dir);
+        if(std::filesystem::exists(file)) {
+            deferred.emplace(file);
+            logger.warn([&] { return "Picked up the indexes and foreign keys a run before left dropped, from " + file.string(); });
+        } else {
+            auto target = targetPool->acquire();
+            deferred.emplace(*target, graph, options.schema, options.load == Load::insert ||
+                options.load == Load::staging || options.sync, file);
+            deferred->drop(*target);
+        }
+        logger.info([&] {
+            return "Deferred " + std::to_string(deferred->indexCount()) + " indexes and " +
+                std::to_string(deferred->foreignKeyCount()) + " foreign keys of the target";
+        });
+        endPhase("drop indexes");
+    }
+    // The tables go back to logged before the foreign keys between them do.
+    std::vector<std::string> targetTables;
+    if(options.unlogged != Unlogged::off) {
+        phase = {};
+        for(TableId t = 0; t < graph.tableCount(); t++) targetTables.push_back(graph.tableName(t));
+        setLogged(*targetPool, options.jobs, targetTables, false);
+        endPhase("set unlogged");
+    }
+    phase = {};
+    logger.info([] { return std::string{"<-------------------------------------------->\nORDER:"}; });
+    try {
+        runInDependencyOrder(graph, components, pool, runComponents(options.keyPass ? Pass::rows : Pass::single),
+            checkpoint ? checkpoint->completed() : referenced, ranks, retry);
+    } catch(...) {
+        // Whatever made it into the target gets its indexes back.
+        if(deferred) {
+            try {
+                if(options.unlogged == Unlogged::load) setLogged(*targetPool, options.jobs, targetTables, true);
+                deferred->rebuild(*targetPool, options.jobs, options.maintenanceWorkers, logger);
+            } catch(const std::exception& e) {
+                logger.warn([&] { return std::string{e.what()}; });
+            }
+        }
+        throw;
+    }
+    endPhase("extract");
+    if(rejects && rejects->count()) {
+        logger.warn([&] {
+            return std::to_string(rejects->count()) + " rows refused by the target, in " + rejects->directory().string();
+        });
+    }
+    if(options.unlogged == Unlogged::load) {
+        phase = {};
+        setLogged(*targetPool, options.jobs, targetTables, true);
+        endPhase("set logged");
+    }
+    if(deferred) {
+        phase = {};
+        deferred->rebuild(*targetPool, options.jobs, options.maintenanceWorkers, logger);
+        endPhase("rebuild indexes");
+    }
+    if(targetPool && options.finalize != Finalize::off) {
+        phase = {};
+        finalizeTarget(*targetPool, options.jobs, graph, options.schema, options.finalize == Finalize::vacuum,
+            logger);
+        endPhase("finalize");
+    }
+    if(options.parents == Parents::referenced) {
+        phase = {};
+        runReferenced(pool);
+        endPhase("references");
+    }
+    if(outputDirectory) {
+        phase = {};
+        outputDirectory->close();
+        endPhase("sync");
+    }
+    if(objectStore) {
+        phase = {};
+        objectStore->close();
+        endPhase("upload manifest");
+    }
+    if(incremental) incremental->save(watermark, keyValues);
+
+
+    std::chrono::time_point afterTime = std::chrono::steady_clock::now();
+    std::chrono::duration<float> elapsedTime = afterTime - beforeTime;
+    logger.flush();
+    out << "Program ran in: " << elapsedTime << '\n';
+    out << "Total Number of Rows: " << totalRows << '\n';
+    if(keyBudget && keyBudget->runs()) out << "Key set runs spilled: " << keyBudget->runs() << '\n';
+    metrics.phase("total", elapsedTime.count(), std::max(peakResident, peakResidentBytes()), residentBytes());
+    // The key sets are what grows with the subset; the largest are named.
+    MemoryMetrics memory;
+    memory.heap = heapBytes();
+    memory.pipelinePeak = pipelineBytes().peak();
+    memory.largestMessage = sourceMessageBytes().peak();
+    for(TableId t = 0; t < graph.tableCount(); t++) {
+        for(auto [need, last] = graph.needs(t); need < last; need++) {
+            const std::uint64_t bytes = keyValues[need].memoryBytes();
+            memory.keySets += bytes;
+            memory.largestKeySets.emplace_back(graph.tableName(t) + '.' + graph.columnName(graph.needColumn(need)), bytes);
+        }
+    }
+    std::sort(memory.largestKeySets.begin(), memory.largestKeySets.end(),
+        [](const auto& a, const auto& b) { return a.second > b.second; });
+    if(memory.largestKeySets.size() > 10) memory.largestKeySets.resize(10);
+    if constexpr(countingAllocations) {
+        auto& counters = allocationCounters();
+        memory.counted = true;
+        memory.allocations = counters.allocations.load();
+        memory.allocatedBytes = counters.bytes.load();
+        memory.livePeak = counters.live.peak();
+    }
+    metrics.memory(std::move(memory));
+    if(serverStats) {
+        auto [costs, io] = serverStats->finish(conn);
+        metrics.serverCosts(std::move(costs), io);
+    }
+    metrics.printSummary(out);
+    if(!options.metrics.empty()) {
+        std::ofstream out{options.metrics};
+        out << metrics.json();
+        if(!out) throw std::runtime_error{"cannot write " + options.metrics.string()};
+    }
+    if(profile) profile->write(options.profile, rootTable);
+    if(trace) trace->write();
+
+    // The changes are read and applied beyond the snapshot, on the lead
+    // connection and a target one of its own.
+    if(options.sync) {
+        snapshot.reset();
+        auto target = targetPool->acquire();
+        logger.info([&] { return "Sync: streaming the changes of slot " + options.syncSlot; });
+        LogicalSync{conn, *target, graph, rootTable, seeds, keyValues,
+            {options.syncSlot, options.schema, options.syncBatch, std::chrono::milliseconds{options.syncInterval}},
+            logger}.run();
+    }
+    return 0;
+}
+
+// With --sources a job runs on each shard, --source-jobs of them at once,
+// each on a session of its own. They all read the graph discovered on the
+// first shard, and with --pipe load into the one target, finalized once
+// they're all done. A shard's rows are those its seeds reach: seeds it
+// doesn't hold select nothing there.
+inline int runSources(const Options& options, const pgfe::Connection_options& sourceOptions,
+    const pgfe::Connection_options& targetOptions, std::ostream& out = std::cout)
+{
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::vector<Options> jobs;
+    for(std::size_t i = 0; i < options.sources.size(); i++) {
+        const auto& source = options.sources[i];
+        auto shard = sourceOptions;
+        shard.set_hostname(source.host).set_port(source.port).set_database(source.database);
+        sessions.push_back(std::make_unique<Session>(shard, targetOptions, false, 0, options.noticeRate));
+        jobs.push_back(sourceJobOptions(options, i));
+        if(!options.pipe && options.upload.empty()) std::filesystem::create_directories(jobs.back().outputDir);
+    }
+    Logger logger{out, options.logLevel};
+    const auto graph = sessions.front()->discover(options, logger);
+    for(auto& session : sessions) session->shareSchema(graph);
+
+    std::atomic<std::size_t> next = 0;
+    std::vector<std::exception_ptr> errors(sessions.size());
+    const auto work = [&] {
+        for(std::size_t i; (i = next++) < sessions.size();) {
+            try {
+                runJob(jobs[i], *sessions[i], out);
+            } catch(...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    const std::size_t parallel = options.sourceJobs ? std::min(options.sourceJobs, sessions.size()) : sessions.size();
+    std::vector<std::thread> threads;
+    for(std::size_t t = 0; t < parallel; t++) threads.emplace_back(work);
+    for(auto& thread : threads) thread.join();
+    std::exception_ptr failed;
+    for(std::size_t i = 0; i < errors.size(); i++) {
+        if(!errors[i]) continue;
+        try {
+            std::rethrow_exception(errors[i]);
+        } catch(const std::exception& e) {
+            const auto& source = options.sources[i];
+            logger.warn([&] { return sourceName(i) + " (" + source.host + '/' + source.database + "): " + e.what(); });
+        } catch(...) {}
+        if(!failed) failed = errors[i];
+    }
+    if(failed) std::rethrow_exception(failed);
+    if(options.pipe && options.finalize != Finalize::off) {
+        finalizeTarget(sessions.front()->targetPool(options.jobs), options.jobs, *graph, options.schema,
+            options.finalize == Finalize::vacuum, logger);
+    }
+    logger.flush();
+    return 0;
+}
+
+} // namespace subset
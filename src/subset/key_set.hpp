@@ -0,0 +1,770 @@
+#pragma once
+
+#include "binary_copy.hpp"
+#include "integer_bitmap.hpp"
+#include "key_spill.hpp"
+#include "pg_types.hpp"
+#include "schema_graph.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace subset {
+
+using Uuid = std::array<std::uint8_t, 16>;
+
+// splitmix64 finalizer; spreads sequential ids over the whole table.
+inline std::uint64_t mixHash(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+struct KeyHash {
+    std::size_t operator()(std::int64_t v) const { return mixHash(static_cast<std::uint64_t>(v)); }
+    std::size_t operator()(const Uuid& v) const {
+        std::uint64_t hi = 0;
+        std::uint64_t lo = 0;
+        for(std::size_t i = 0; i < 8; i++) {
+            hi = (hi << 8) | v[i];
+            lo = (lo << 8) | v[i + 8];
+        }
+        return mixHash(hi ^ mixHash(lo));
+    }
+    std::size_t operator()(const std::string& v) const { return std::hash<std::string>{}(v); }
+};
+
+// Values in insertion order plus an open-addressing index over them, so a
+// duplicate costs one probe sequence and no allocation.
+template<typename T>
+class DedupSet {
+public:
+    using value_type = T;
+
+    bool insert(T value) {
+        if((values_.size() + 1) * 2 > slots_.size()) grow();
+        const std::size_t mask = slots_.size() - 1;
+        for(std::size_t i = KeyHash{}(value) & mask;; i = (i + 1) & mask) {
+            if(slots_[i] == 0) {
+                values_.push_back(std::move(value));
+                slots_[i] = static_cast<std::uint32_t>(values_.size());
+                return true;
+            }
+            if(values_[slots_[i] - 1] == value) return false;
+        }
+    }
+
+    bool contains(const T& value) const {
+        if(slots_.empty()) return false;
+        const std::size_t mask = slots_.size() - 1;
+        for(std::size_t i = KeyHash{}(value) & mask; slots_[i] != 0; i = (i + 1) & mask) {
+            if(values_[slots_[i] - 1] == value) return true;
+        }
+        return false;
+    }
+
+    const std::vector<T>& values() const { return values_; }
+    std::size_t size() const { return values_.size(); }
+
+    // Calls f with the values in insertion order until it returns false.
+    template<typename F>
+    void forEach(F&& f) const {
+        for(const auto& value : values_) {
+            if(!f(value)) return;
+        }
+    }
+
+    // The heap the set holds: both arrays as allocated, and long strings.
+    std::size_t memoryBytes() const {
+        std::size_t bytes = values_.capacity() * sizeof(T) + slots_.capacity() * sizeof(std::uint32_t);
+        if constexpr(std::is_same_v<T, std::string>) {
+            for(const auto& value : values_) bytes += value.capacity() > 15 ? value.capacity() + 1 : 0;
+        }
+        return bytes;
+    }
+
+    // Empties the set, handing out its values.
+    std::vector<T> take() {
+        slots_ = {};
+        return std::exchange(values_, {});
+    }
+
+private:
+    void grow() {
+        slots_.assign(slots_.empty() ? 16 : slots_.size() * 2, 0);
+        const std::size_t mask = slots_.size() - 1;
+        for(std::size_t v = 0; v < values_.size(); v++) {
+            std::size_t i = KeyHash{}(values_[v]) & mask;
+            while(slots_[i] != 0) i = (i + 1) & mask;
+            slots_[i] = static_cast<std::uint32_t>(v + 1);
+        }
+    }
+
+    std::vector<T> values_;
+    std::vector<std::uint32_t> slots_; // 1-based index into values_, 0 if empty
+};
+
+// The distinct values of one referenced key column. Integer and uuid keys
+// are kept unboxed; any other type keeps its text form. Integer keys start
+// out in an IntegerBitmap, and move to a hash set if they turn out too
+// sparse for its containers to pay.
+//
+// The tuples of a composite key are packed into one string each, hashed
+// and compared as a unit: integer fields as 8 bytes and uuid fields as 16,
+// in an order preserving form, other fields as their text and a NUL, which
+// text can't hold. Their text form is the row of COPY's text format, the
+// fields joined by tabs, as tupleText() makes it.
+//
+// A set given a budget spills: once the budget is exceeded, it sorts its
+// values into a run file and starts over empty. The values are then the
+// union of the runs and of memory, streamed back in order by a merge. A
+// spilled set no longer knows whether a value is new, so insert() and
+// size() count a value once per run it reaches, and the sets whose new
+// values drive the extraction must not spill.
+class KeySet {
+public:
+    enum class Kind { integer, uuid, text, tuple };
+
+    static Kind kindOf(PGDataType dataType) {
+        switch(pgTypeTraits(dataType).key) {
+        case KeyEncoding::integer: return Kind::integer;
+        case KeyEncoding::uuid: return Kind::uuid;
+        default: return Kind::text;
+        }
+    }
+
+    explicit KeySet(Kind kind = Kind::text) {
+        if(kind == Kind::integer) set_.emplace<IntegerBitmap>();
+        else if(kind == Kind::uuid) set_.emplace<DedupSet<Uuid>>();
+    }
+
+    // A set of tuples of fields of these kinds, two at least.
+    explicit KeySet(std::vector<Kind> fields) : fields_{std::move(fields)} {}
+
+    // An empty set of the same kind.
+    KeySet emptyLike() const { return fields_.empty() ? KeySet{kind()} : KeySet{fields_}; }
+
+    // The text form of a tuple of fields, none of them NULL.
+    static std::string tupleText(const std::vector<std::string_view>& fields) {
+        std::string result;
+        for(std::size_t i = 0; i < fields.size(); i++) {
+            if(i > 0) result += '\t';
+            for(const char c : fields[i]) {
+                if(c == '\\') result += "\\\\";
+                else if(c == '\t') result += "\\t";
+                else if(c == '\n') result += "\\n";
+                else if(c == '\r') result += "\\r";
+                else result += c;
+            }
+        }
+        return result;
+    }
+
+    // Calls f with the index and the text of each field of a tuple's text.
+    template<typename F>
+    static void forEachTupleField(std::string_view tuple, F&& f) {
+        std::string field;
+        std::size_t index = 0;
+        for(std::size_t i = 0; i <= tuple.size(); i++) {
+            if(i == tuple.size() || tuple[i] == '\t') {
+                f(index++, std::string_view{field});
+                field.clear();
+            } else if(tuple[i] == '\\' && i + 1 < tuple.size()) {
+                const char c = tuple[++i];
+                field += c == 't' ? '\t' : c == 'n' ? '\n' : c == 'r' ? '\r' : c;
+            } else field += tuple[i];
+        }
+    }
+
+    // Lets the set spill past the budget.
+    void spillTo(KeyBudget& budget) { charge_ = KeyCharge{budget}; }
+
+    bool spilled() const { return !runs_.empty(); }
+
+    // Adds a value in text format. Returns false if it was there already.
+    bool insert(std::string_view text) {
+        if(!fields_.empty()) return add(std::get<DedupSet<std::string>>(set_), packTuple(text));
+        const bool added = std::visit([&](auto& set) { return add(set, parse(set, text)); }, set_);
+        settle();
+        return added;
+    }
+
+    // Whether the value in text format is in the set, which must not have
+    // spilled.
+    bool contains(std::string_view text) const {
+        if(spilled()) throw std::logic_error{"membership of a spilled key set"};
+        if(!fields_.empty()) return std::get<DedupSet<std::string>>(set_).contains(packTuple(text));
+        return std::visit([&](const auto& set) { return set.contains(parse(set, text)); }, set_);
+    }
+
+    // Adds a value in the binary format of COPY or of a binary result.
+    bool insertBinary(std::string_view value) {
+        if(!fields_.empty()) throw std::logic_error{"binary tuple key"};
+        if(kind() == Kind::integer) {
+            std::int64_t integer = 0;
+            if(value.size() == 2) integer = static_cast<std::int16_t>(readUint16(value.data()));
+            else if(value.size() == 4) integer = static_cast<std::int32_t>(readUint32(value.data()));
+            else if(value.size() == 8) integer = static_cast<std::int64_t>(readUint64(value.data()));
+            else throw std::runtime_error{"unexpected binary integer key size"};
+            return addInteger(integer);
+        } else if(auto* uuids = std::get_if<DedupSet<Uuid>>(&set_)) {
+            if(value.size() != 16) throw std::runtime_error{"unexpected binary uuid key size"};
+            Uuid uuid;
+            for(std::size_t i = 0; i < 16; i++) uuid[i] = static_cast<std::uint8_t>(value[i]);
+            return add(*uuids, uuid);
+        }
+        return add(std::get<DedupSet<std::string>>(set_), std::string{value});
+    }
+
+    Kind kind() const {
+        if(!fields_.empty()) return Kind::tuple;
+        if(std::holds_alternative<IntegerBitmap>(set_) || std::holds_alternative<DedupSet<std::int64_t>>(set_))
+            return Kind::integer;
+        if(std::holds_alternative<DedupSet<Uuid>>(set_)) return Kind::uuid;
+        return Kind::text;
+    }
+
+    // Adds the values of a key set of the same kind: two bitmaps a
+    // container at a time, the others a value at a time.
+    void merge(const KeySet& other) {
+        auto* bitmap = std::get_if<IntegerBitmap>(&set_);
+        const auto* from = std::get_if<IntegerBitmap>(&other.set_);
+        if(bitmap && from && !other.spilled()) {
+            const std::size_t before = bitmap->memoryBytes();
+            bitmap->unite(*from);
+            const auto grown = static_cast<std::int64_t>(bitmap->memoryBytes()) - static_cast<std::int64_t>(before);
+            if(charge_.budget() && charge_.add(grown) && bitmap->size() >= minimumRun) spill(*bitmap);
+        } else if(kind() == Kind::integer) {
+            std::visit([&](const auto& otherSet) {
+                if constexpr(std::is_same_v<typename std::decay_t<decltype(otherSet)>::value_type, std::int64_t>) {
+                    other.forEachValue(otherSet, [&](std::int64_t value) {
+                        addInteger(value);
+                        return true;
+                    });
+                } else throw std::logic_error{"merge of key sets of different kinds"};
+            }, other.set_);
+        } else {
+            std::visit([&](auto& set) {
+                std::visit([&](const auto& otherSet) {
+                    using T = typename std::decay_t<decltype(set)>::value_type;
+                    if constexpr(std::is_same_v<T, typename std::decay_t<decltype(otherSet)>::value_type>) {
+                        other.forEachValue(otherSet, [&](const auto& value) {
+                            add(set, value);
+                            return true;
+                        });
+                    } else throw std::logic_error{"merge of key sets of different kinds"};
+                }, other.set_);
+            }, set_);
+        }
+        settle();
+    }
+
+    // Exact unless spilled, when it bounds the number of values from above.
+    std::size_t size() const {
+        return spilled_ + std::visit([](const auto& set) { return set.size(); }, set_);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // The memory held in this process, without the spilled runs.
+    std::size_t memoryBytes() const {
+        return std::visit([](const auto& set) { return set.memoryBytes(); }, set_);
+    }
+
+    // Calls f with the text form of the values of [first, last): integers
+    // in ascending order, the others in insertion order, or once spilled in
+    // sorted order.
+    template<typename F>
+    void forEachText(std::size_t first, std::size_t last, F&& f) const {
+        std::visit([&](const auto& set) {
+            std::string text;
+            std::size_t i = 0;
+            forEachValue(set, [&](const auto& value) {
+                if(i >= last) return false;
+                if(i++ >= first) {
+                    if constexpr(std::is_same_v<std::decay_t<decltype(value)>, std::string>) {
+                        if(!fields_.empty()) unpackTuple(value, text);
+                        else format(value, text);
+                    } else format(value, text);
+                    f(std::string_view{text});
+                }
+                return true;
+            });
+        }, set_);
+    }
+
+    template<typename F>
+    void forEachText(F&& f) const { forEachText(0, size(), std::forward<F>(f)); }
+
+    // The integer values as the runs of consecutive ones, in order; none
+    // for a set of another kind.
+    struct Range {
+        std::int64_t first;
+        std::int64_t last;
+    };
+    std::vector<Range> ranges() const {
+        std::vector<Range> result;
+        const auto extend = [&](std::int64_t value) {
+            if(!result.empty() && value - 1 == result.back().last) result.back().last = value;
+            else result.push_back({value, value});
+            return true;
+        };
+        if(const auto* bitmap = std::get_if<IntegerBitmap>(&set_)) forEachValue(*bitmap, extend);
+        else if(const auto* ints = std::get_if<DedupSet<std::int64_t>>(&set_)) {
+            if(spilled()) forEachValue(*ints, extend);
+            else {
+                std::vector<std::int64_t> sorted{ints->values().begin(), ints->values().end()};
+                std::sort(sorted.begin(), sorted.end());
+                for(const auto value : sorted) extend(value);
+            }
+        }
+        return result;
+    }
+
+    // Writes the values in the in-memory representation, so that reading
+    // them back needs no parsing.
+    void save(std::ostream& out) const {
+        std::visit([&](const auto& set) {
+            std::uint64_t count = 0;
+            // The runs may share values, which costs a pass to count.
+            forEachValue(set, [&](const auto&) {
+                count++;
+                return true;
+            });
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            forEachValue(set, [&](const auto& value) {
+                saveValue(out, value);
+                return true;
+            });
+        }, set_);
+    }
+
+    // Adds the values written by save() of a key set of the same kind.
+    void load(std::istream& in) {
+        std::visit([&](auto& set) {
+            std::uint64_t count = 0;
+            in.read(reinterpret_cast<char*>(&count), sizeof(count));
+            for(std::uint64_t i = 0; i < count && in; i++) {
+                typename std::decay_t<decltype(set)>::value_type value{};
+                loadValue(in, value);
+                add(set, std::move(value));
+            }
+        }, set_);
+        if(!in) throw std::runtime_error{"truncated key set"};
+        settle();
+    }
+
+private:
+    static constexpr std::size_t minimumRun = 1 << 12;
+    // Where a container's overhead makes a bitmap larger than a hash set.
+    static constexpr std::size_t sparseValues = 8;
+
+    // The memory a value takes in a DedupSet: itself, its two index slots
+    // and the heap of a long string.
+    static std::int64_t memoryCost(const std::int64_t&) { return sizeof(std::int64_t) + 8; }
+    static std::int64_t memoryCost(const Uuid&) { return sizeof(Uuid) + 8; }
+    static std::int64_t memoryCost(const std::string& value) {
+        return static_cast<std::int64_t>(sizeof(std::string) + 8 + (value.size() > 15 ? value.size() + 1 : 0));
+    }
+
+    template<typename Set>
+    bool add(Set& set, typename Set::value_type value) {
+        if(!charge_.budget()) return set.insert(std::move(value));
+        std::int64_t cost = 0;
+        if constexpr(std::is_same_v<Set, IntegerBitmap>) {
+            const std::size_t before = set.memoryBytes();
+            if(!set.insert(value)) return false;
+            cost = static_cast<std::int64_t>(set.memoryBytes()) - static_cast<std::int64_t>(before);
+        } else {
+            cost = memoryCost(value);
+            if(!set.insert(std::move(value))) return false;
+        }
+        if(charge_.add(cost) && set.size() >= minimumRun) spill(set);
+        return true;
+    }
+
+    // Adds to whichever set holds the integers, which the value may move.
+    bool addInteger(std::int64_t value) {
+        auto* bitmap = std::get_if<IntegerBitmap>(&set_);
+        const bool added = bitmap ? add(*bitmap, value) : add(std::get<DedupSet<std::int64_t>>(set_), value);
+        settle();
+        return added;
+    }
+
+    // Moves the integers out of a bitmap into a hash set once there are
+    // fewer than sparseValues per container of it, checked each time the
+    // bitmap doubles.
+    void settle() {
+        auto* bitmap = std::get_if<IntegerBitmap>(&set_);
+        if(!bitmap) return;
+        const std::size_t size = bitmap->size();
+        if(size < settleAt_) return;
+        settleAt_ = size * 2;
+        if(bitmap->containerCount() * sparseValues <= size) return;
+        const std::size_t before = bitmap->memoryBytes();
+        DedupSet<std::int64_t> ints;
+        bitmap->forEach([&](std::int64_t value) {
+            ints.insert(value);
+            return true;
+        });
+        set_ = std::move(ints);
+        if(charge_.budget())
+            charge_.add(static_cast<std::int64_t>(memoryBytes()) - static_cast<std::int64_t>(before));
+    }
+
+    template<typename Set>
+    void spill(Set& set) {
+        auto values = set.take();
+        std::sort(values.begin(), values.end());
+        auto run = std::make_shared<SpillRun>();
+        run->path = charge_.budget()->nextRun();
+        run->count = values.size();
+        std::vector<char> buffer(1 << 16);
+        std::ofstream out;
+        out.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        out.open(run->path, std::ios::binary | std::ios::trunc);
+        for(const auto& value : values) saveValue(out, value);
+        out.flush();
+        if(!out) throw std::runtime_error{"cannot spill key set to " + run->path.string()};
+        out.close();
+        spilled_ += run->count;
+        runs_.push_back(std::move(run));
+        charge_.release();
+        settleAt_ = minimumRun;
+    }
+
+    // Calls f with the distinct values in memory and in the runs until it
+    // returns false; merges them in order once spilled.
+    template<typename Set, typename F>
+    void forEachValue(const Set& set, F&& f) const {
+        using T = typename Set::value_type;
+        if(runs_.empty()) {
+            set.forEach(f);
+            return;
+        }
+
+        struct Cursor {
+            std::vector<char> buffer;
+            std::ifstream in;
+            std::uint64_t left = 0;
+            T value{};
+        };
+        std::vector<std::unique_ptr<Cursor>> cursors;
+        const auto advance = [](Cursor& c) {
+            if(c.left == 0) return false;
+            loadValue(c.in, c.value);
+            c.left--;
+            if(!c.in) throw std::runtime_error{"truncated key set run"};
+            return true;
+        };
+        for(const auto& run : runs_) {
+            auto c = std::make_unique<Cursor>();
+            c->buffer.resize(1 << 16);
+            c->in.rdbuf()->pubsetbuf(c->buffer.data(), static_cast<std::streamsize>(c->buffer.size()));
+            c->in.open(run->path, std::ios::binary);
+            if(!c->in) throw std::runtime_error{"cannot read key set run " + run->path.string()};
+            c->left = run->count;
+            cursors.push_back(std::move(c));
+        }
+        // A bitmap comes out sorted, but has no values to point at.
+        std::vector<T> copies;
+        std::vector<const T*> memory;
+        memory.reserve(set.size());
+        if constexpr(std::is_same_v<Set, IntegerBitmap>) {
+            copies.reserve(set.size());
+            set.forEach([&](T value) {
+                copies.push_back(value);
+                return true;
+            });
+            for(const auto& value : copies) memory.push_back(&value);
+        } else {
+            for(const auto& value : set.values()) memory.push_back(&value);
+            std::sort(memory.begin(), memory.end(), [](const T* a, const T* b) { return *a < *b; });
+        }
+
+        // Sources are the cursors and, last, the memory.
+        const std::size_t fromMemory = cursors.size();
+        std::size_t next = 0;
+        const auto current = [&](std::size_t source) -> const T& {
+            return source == fromMemory ? *memory[next] : cursors[source]->value;
+        };
+        const auto later = [&](std::size_t a, std::size_t b) { return current(b) < current(a); };
+        std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heap{later};
+        for(std::size_t i = 0; i < cursors.size(); i++) {
+            if(advance(*cursors[i])) heap.push(i);
+        }
+        if(!memory.empty()) heap.push(fromMemory);
+
+        T last{};
+        bool first = true;
+        while(!heap.empty()) {
+            const std::size_t source = heap.top();
+            heap.pop();
+            if(first || last < current(source)) {
+                last = current(source);
+                first = false;
+                if(!f(last)) return;
+            }
+            if(source == fromMemory ? ++next < memory.size() : advance(*cursors[source])) heap.push(source);
+        }
+    }
+    static std::int64_t parse(const IntegerBitmap&, std::string_view text) {
+        return parse(DedupSet<std::int64_t>{}, text);
+    }
+
+    static std::int64_t parse(const DedupSet<std::int64_t>&, std::string_view text) {
+        std::int64_t result = 0;
+        const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), result);
+        if(ec != std::errc{} || end != text.data() + text.size())
+            throw std::runtime_error{"invalid integer key: " + std::string{text}};
+        return result;
+    }
+
+    static Uuid parse(const DedupSet<Uuid>&, std::string_view text) {
+        Uuid result{};
+        std::size_t n = 0;
+        const auto nibble = [&](char c) -> int {
+            if(c >= '0' && c <= '9') return c - '0';
+            if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+        for(std::size_t i = 0; i < text.size(); i++) {
+            if(text[i] == '-' || text[i] == '{' || text[i] == '}') continue;
+            const int hi = nibble(text[i]);
+            const int lo = i + 1 < text.size() ? nibble(text[i + 1]) : -1;
+            if(hi < 0 || lo < 0 || n == result.size())
+                throw std::runtime_error{"invalid uuid key: " + std::string{text}};
+            result[n++] = static_cast<std::uint8_t>(hi << 4 | lo);
+            i++;
+        }
+        if(n != result.size()) throw std::runtime_error{"invalid uuid key: " + std::string{text}};
+        return result;
+    }
+
+    static std::string parse(const DedupSet<std::string>&, std::string_view text) {
+        return std::string{text};
+    }
+
+    static void saveValue(std::ostream& out, std::int64_t value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    static void saveValue(std::ostream& out, const Uuid& value) {
+        out.write(reinterpret_cast<const char*>(value.data()), value.size());
+    }
+
+    static void saveValue(std::ostream& out, const std::string& value) {
+        const std::uint32_t size = static_cast<std::uint32_t>(value.size());
+        out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        out.write(value.data(), size);
+    }
+
+    static void loadValue(std::istream& in, std::int64_t& value) {
+        in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    }
+
+    static void loadValue(std::istream& in, Uuid& value) {
+        in.read(reinterpret_cast<char*>(value.data()), value.size());
+    }
+
+    static void loadValue(std::istream& in, std::string& value) {
+        std::uint32_t size = 0;
+        in.read(reinterpret_cast<char*>(&size), sizeof(size));
+        value.resize(size);
+        in.read(value.data(), size);
+    }
+
+    std::string packTuple(std::string_view text) const {
+        std::string packed;
+        std::size_t f = 0;
+        forEachTupleField(text, [&](std::size_t, std::string_view field) {
+            if(f == fields_.size()) throw std::runtime_error{"invalid tuple key: " + std::string{text}};
+            if(fields_[f] == Kind::integer) {
+                const auto bits = static_cast<std::uint64_t>(parse(DedupSet<std::int64_t>{}, field)) ^ (std::uint64_t{1} << 63);
+                for(int shift = 56; shift >= 0; shift -= 8) packed += static_cast<char>(bits >> shift);
+            } else if(fields_[f] == Kind::uuid) {
+                const Uuid uuid = parse(DedupSet<Uuid>{}, field);
+                packed.append(reinterpret_cast<const char*>(uuid.data()), uuid.size());
+            } else {
+                packed += field;
+                packed += '\0';
+            }
+            f++;
+        });
+        if(f != fields_.size()) throw std::runtime_error{"invalid tuple key: " + std::string{text}};
+        return packed;
+    }
+
+    void unpackTuple(const std::string& packed, std::string& out) const {
+        std::vector<std::string> values;
+        std::vector<std::string_view> views;
+        std::size_t at = 0;
+        for(const Kind kind : fields_) {
+            std::string value;
+            if(kind == Kind::integer) {
+                std::uint64_t bits = 0;
+                for(int i = 0; i < 8; i++) bits = bits << 8 | static_cast<unsigned char>(packed[at++]);
+                format(static_cast<std::int64_t>(bits ^ (std::uint64_t{1} << 63)), value);
+            } else if(kind == Kind::uuid) {
+                Uuid uuid;
+                for(auto& byte : uuid) byte = static_cast<std::uint8_t>(packed[at++]);
+                format(uuid, value);
+            } else {
+                const auto end = packed.find('\0', at);
+                value = packed.substr(at, end - at);
+                at = end + 1;
+            }
+            values.push_back(std::move(value));
+        }
+        for(const auto& value : values) views.push_back(value);
+        out = tupleText(views);
+    }
+
+    static void format(std::int64_t value, std::string& out) {
+        char buffer[24];
+        const auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+        out.assign(buffer, end);
+    }
+
+    static void format(const Uuid& value, std::string& out) {
+        static constexpr char digits[] = "0123456789abcdef";
+        out.clear();
+        for(std::size_t i = 0; i < value.size(); i++) {
+            if(i == 4 || i == 6 || i == 8 || i == 10) out += '-';
+            out += digits[value[i] >> 4];
+            out += digits[value[i] & 0xf];
+        }
+    }
+
+    static void format(const std::string& value, std::string& out) {
+        out = value;
+    }
+
+    std::variant<DedupSet<std::string>, IntegerBitmap, DedupSet<std::int64_t>, DedupSet<Uuid>> set_;
+    KeyCharge charge_;
+    std::vector<std::shared_ptr<const SpillRun>> runs_;
+    std::size_t spilled_ = 0; // values in the runs
+    std::size_t settleAt_ = minimumRun; // size of the bitmap for settle() to look at it again
+    std::vector<Kind> fields_; // of a tuple
+};
+
+// One key set per key-set slot of the graph, typed after the referenced
+// column or columns.
+inline std::vector<KeySet> makeKeySets(const SchemaGraph& graph) {
+    std::vector<KeySet> keySets;
+    keySets.reserve(graph.needCount());
+    for(TableId t = 0; t < graph.tableCount(); t++) {
+        const auto [first, last] = graph.needs(t);
+        for(NeedId need = first; need < last; need++) {
+            std::vector<KeySet::Kind> fields;
+            for(const ColumnId column : graph.needColumns(need)) {
+                PGDataType dataType = PGDataType::OTHER;
+                for(const auto& col : graph.tableColumns(t)) {
+                    if(col.name == column) dataType = col.dataType;
+                }
+                fields.push_back(KeySet::kindOf(dataType));
+            }
+            if(fields.size() == 1) keySets.emplace_back(fields.front());
+            else keySets.emplace_back(std::move(fields));
+        }
+    }
+    return keySets;
+}
+
+// Merges the key sets of needs [first, last) of every worker's sets into
+// the first worker's, pairwise: each round merges every other remaining
+// worker into its neighbour, on threads of their own, so the merge takes
+// as long as log2(workers) merges instead of a merge per worker. The sets
+// merged are emptied.
+inline void mergeKeySets(std::vector<std::vector<KeySet>>& sets, NeedId first, NeedId last) {
+    for(std::size_t width = 1; width < sets.size(); width *= 2) {
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(sets.size());
+        for(std::size_t w = 0; w + width < sets.size(); w += 2 * width) {
+            threads.emplace_back([&sets, &errors, w, width, first, last] {
+                try {
+                    for(NeedId need = first; need < last; need++) {
+                        sets[w][need].merge(sets[w + width][need]);
+                        sets[w + width][need] = sets[w + width][need].emptyLike();
+                    }
+                } catch(...) {
+                    errors[w] = std::current_exception();
+                }
+            });
+        }
+        for(auto& thread : threads) thread.join();
+        for(const auto& error : errors) {
+            if(error) std::rethrow_exception(error);
+        }
+    }
+}
+
+// Gathers the fields of composite keys, given by their indexes in the row,
+// as the fields of a row go past, and hands out the text of each tuple at
+// the end of the row; not those with a NULL field, which a foreign key
+// (MATCH SIMPLE) doesn't check.
+class TupleGatherer {
+public:
+    explicit TupleGatherer(const std::vector<std::vector<std::size_t>>& tuples) : tuples_{tuples} {
+        for(const auto& fields : tuples_) {
+            for(const std::size_t f : fields) {
+                if(f >= wanted_.size()) wanted_.resize(f + 1, false);
+                wanted_[f] = true;
+            }
+        }
+        values_.resize(wanted_.size());
+        present_.resize(wanted_.size(), false);
+    }
+
+    bool empty() const { return tuples_.empty(); }
+
+    void field(std::size_t index, std::string_view value, bool isNull) {
+        if(index >= wanted_.size() || !wanted_[index]) return;
+        values_[index].assign(value);
+        present_[index] = !isNull;
+    }
+
+    // Calls f with the index of each complete tuple and its text.
+    template<typename F>
+    void endRow(F&& f) {
+        std::vector<std::string_view> fields;
+        for(std::size_t t = 0; t < tuples_.size(); t++) {
+            fields.clear();
+            for(const std::size_t i : tuples_[t]) {
+                if(!present_[i]) break;
+                fields.push_back(values_[i]);
+            }
+            if(fields.size() == tuples_[t].size()) f(t, std::string_view{KeySet::tupleText(fields)});
+        }
+        std::fill(present_.begin(), present_.end(), false);
+    }
+
+private:
+    std::vector<std::vector<std::size_t>> tuples_;
+    std::vector<bool> wanted_;
+    std::vector<std::string> values_;
+    std::vector<bool> present_;
+};
+
+} // namespace subset
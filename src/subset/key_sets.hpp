@@ -0,0 +1,197 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "copy_stream.hpp"
+#include "key_set.hpp"
+#include "sql.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Ships the key sets of one extraction statement to the server. Small sets
+// are inlined as literals; larger ones are COPYed into session temp tables
+// and referenced by a subquery, so the statement stays the same size however
+// many keys there are and the planner is free to hash them. The temp tables
+// live until the stage is destroyed.
+class KeySetStage {
+public:
+    KeySetStage(pgfe::Connection& conn, std::size_t inlineLimit)
+        : conn_{conn}, inlineLimit_{inlineLimit} {}
+
+    KeySetStage(const KeySetStage&) = delete;
+    KeySetStage& operator=(const KeySetStage&) = delete;
+
+    ~KeySetStage() {
+        for(const auto& name : tables_) {
+            try {
+                conn_.execute("DROP TABLE IF EXISTS " + name);
+            } catch(...) {}
+        }
+    }
+
+    // Returns the condition on column matching the values. Dense integer
+    // keys, as serial ids mostly are, go as the ranges they form, with the
+    // values left out of any long run behind an IN: a range costs the
+    // server one comparison or index range scan instead of a hash probe per
+    // key, and the statement or the temp table holds two values instead of
+    // the whole run.
+    std::string match(const std::string& tableName, const std::string& column, const KeySet& values) {
+        const std::string quoted = quoteIdentifier(column);
+        if(values.kind() != KeySet::Kind::integer || values.size() < minimumRun)
+            return quoted + " IN " + in(tableName, column, values);
+        std::vector<KeySet::Range> runs;
+        KeySet others{KeySet::Kind::integer};
+        for(const auto& range : values.ranges()) {
+            if(static_cast<std::uint64_t>(range.last - range.first) + 1 >= minimumRun) runs.push_back(range);
+            else {
+                for(auto value = range.first;; value++) {
+                    others.insert(std::to_string(value));
+                    if(value == range.last) break;
+                }
+            }
+        }
+        // Not worth it unless the runs hold most of the keys.
+        if(others.size() * 2 > values.size()) return quoted + " IN " + in(tableName, column, values);
+
+        std::string condition = "(";
+        if(runs.size() <= inlineLimit_) {
+            for(const auto& range : runs) {
+                if(condition.size() > 1) condition += " OR ";
+                condition += quoted + " BETWEEN " + std::to_string(range.first) + " AND " + std::to_string(range.last);
+            }
+        } else {
+            // The ranges are disjoint, so the one starting last at or
+            // before a key is the only one which may hold it: a probe of
+            // the index on the starts per row, however wide the ranges.
+            condition += "EXISTS (SELECT FROM (SELECT subset_hi FROM " + rangeTable(tableName, column, runs) +
+                " WHERE subset_lo <= " + quoted + " ORDER BY subset_lo DESC LIMIT 1) r WHERE " + quoted + " <= r.subset_hi)";
+        }
+        if(!others.empty()) condition += " OR " + quoted + " IN " + in(tableName, column, others);
+        return condition += ')';
+    }
+
+    // Returns the condition on the columns of a composite key matching its
+    // tuples, a row-value IN; with one column the condition on it. No
+    // tuples match nothing.
+    std::string match(const std::string& tableName, const std::vector<std::string>& columns, const KeySet& values) {
+        if(columns.size() == 1) return match(tableName, columns.front(), values);
+        if(values.empty()) return "false";
+        return rowValue(columns) + " IN " + in(tableName, columns, values);
+    }
+
+    // Returns the right-hand side of `(column, ...) IN ...` matching the
+    // tuples. No tuples are an empty select of the columns themselves, typed
+    // as they are, where untyped NULLs would be text.
+    std::string in(const std::string& tableName, const std::vector<std::string>& columns, const KeySet& values) {
+        if(values.empty()) {
+            std::string select;
+            for(const auto& column : columns) select += (select.empty() ? "" : ", ") + quoteIdentifier(column);
+            return "(SELECT " + select + " FROM " + tableName + " WHERE false)";
+        }
+        if(values.size() <= inlineLimit_) {
+            std::string list = "(";
+            values.forEachText([&](std::string_view tuple) {
+                list += list.size() > 1 ? ",(" : "(";
+                KeySet::forEachTupleField(tuple, [&](std::size_t i, std::string_view field) {
+                    if(i > 0) list += ',';
+                    list += quoteLiteral(field);
+                });
+                list += ')';
+            });
+            return list += ')';
+        }
+        std::string select;
+        for(std::size_t i = 0; i < columns.size(); i++) select += (i ? ", k" : "k") + std::to_string(i + 1);
+        return "(SELECT " + select + " FROM " + table(tableName, columns, values) + ")";
+    }
+
+    // Stages the tuples in a temporary table of columns k1, k2, ... and
+    // returns its name.
+    std::string table(const std::string& tableName, const std::vector<std::string>& columns, const KeySet& values) {
+        const std::string name = "pg_temp.subset_keys_" + std::to_string(tables_.size());
+        std::string select;
+        for(std::size_t i = 0; i < columns.size(); i++)
+            select += (i ? ", " : "") + quoteIdentifier(columns[i]) + " AS k" + std::to_string(i + 1);
+        conn_.execute("CREATE TEMP TABLE " + name + " AS SELECT " + select + " FROM " + tableName + " WITH NO DATA");
+        tables_.push_back(name);
+
+        // The text form of a tuple is a row of COPY's text format.
+        CopyIn copyIn{conn_, "COPY " + name + " FROM STDIN"};
+        values.forEachText([&](std::string_view tuple) {
+            copyIn.write(tuple);
+            copyIn.write("\n");
+        });
+        copyIn.close();
+        conn_.execute("ANALYZE " + name);
+        return name;
+    }
+
+    // Returns the right-hand side of `column IN ...` matching the values.
+    std::string in(const std::string& tableName, const std::string& column, const KeySet& values) {
+        if(values.empty()) return "(NULL)";
+        if(values.size() <= inlineLimit_) {
+            std::string list = "(";
+            values.forEachText([&](std::string_view value) {
+                if(list.size() > 1) list += ',';
+                list += quoteLiteral(value);
+            });
+            return list += ')';
+        }
+        return "(SELECT k FROM " + table(tableName, column, values) + ")";
+    }
+
+    // Stages the values in a temporary table of one column k, whatever
+    // their count, and returns its name.
+    std::string table(const std::string& tableName, const std::string& column, const KeySet& values) {
+        const std::string name = "pg_temp.subset_keys_" + std::to_string(tables_.size());
+        // Borrow the exact type of the referencing column.
+        conn_.execute("CREATE TEMP TABLE " + name + " AS SELECT " + quoteIdentifier(column) +
+            " AS k FROM " + tableName + " WITH NO DATA");
+        tables_.push_back(name);
+
+        CopyIn copyIn{conn_, "COPY " + name + " FROM STDIN"};
+        values.forEachText([&](std::string_view value) { copyIn.writeRow(value); });
+        copyIn.close();
+        conn_.execute("ANALYZE " + name);
+        return name;
+    }
+
+private:
+    static std::string rowValue(const std::vector<std::string>& columns) {
+        std::string result = "(";
+        for(const auto& column : columns) result += (result.size() > 1 ? ", " : "") + quoteIdentifier(column);
+        return result + ')';
+    }
+
+    // The consecutive keys a range takes the place of, at least.
+    static constexpr std::uint64_t minimumRun = 4;
+
+    // Stages the ranges in a temporary table of columns subset_lo and
+    // subset_hi, typed after column and indexed on subset_lo, and returns its
+    // name. The names keep clear of the columns of the table matched, which
+    // the subquery on them refers to unqualified.
+    std::string rangeTable(const std::string& tableName, const std::string& column, const std::vector<KeySet::Range>& ranges) {
+        const std::string name = "pg_temp.subset_ranges_" + std::to_string(tables_.size());
+        conn_.execute("CREATE TEMP TABLE " + name + " AS SELECT " + quoteIdentifier(column) + " AS subset_lo, " +
+            quoteIdentifier(column) + " AS subset_hi FROM " + tableName + " WITH NO DATA");
+        tables_.push_back(name);
+
+        CopyIn copyIn{conn_, "COPY " + name + " FROM STDIN"};
+        for(const auto& range : ranges) copyIn.writeRow(std::to_string(range.first), std::to_string(range.last));
+        copyIn.close();
+        conn_.execute("CREATE INDEX ON " + name + " (subset_lo)");
+        conn_.execute("ANALYZE " + name);
+        return name;
+    }
+
+    pgfe::Connection& conn_;
+    std::size_t inlineLimit_;
+    std::vector<std::string> tables_;
+};
+
+} // namespace subset
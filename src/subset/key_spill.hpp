@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <utility>
+
+#include <unistd.h>
+
+namespace subset {
+
+// The memory the spillable key sets may hold between them. A set which
+// finds the budget exceeded while growing writes its values to a run file
+// in dir and starts over empty.
+class KeyBudget {
+public:
+    KeyBudget(std::size_t bytes, std::filesystem::path dir)
+        : limit_{static_cast<std::int64_t>(bytes)}, dir_{std::move(dir)} {}
+
+    KeyBudget(const KeyBudget&) = delete;
+    KeyBudget& operator=(const KeyBudget&) = delete;
+
+    void charge(std::int64_t bytes) { used_.fetch_add(bytes, std::memory_order_relaxed); }
+    bool exceeded() const { return used_.load(std::memory_order_relaxed) > limit_; }
+
+    std::filesystem::path nextRun() {
+        return dir_ / ("subset_keys_" + std::to_string(::getpid()) + "_" + std::to_string(runs_++) + ".run");
+    }
+
+    std::uint64_t runs() const { return runs_; }
+
+private:
+    std::int64_t limit_;
+    std::filesystem::path dir_;
+    std::atomic<std::int64_t> used_ = 0;
+    std::atomic<std::uint64_t> runs_ = 0;
+};
+
+// What one key set holds of a budget. It is charged in steps rather than
+// per value, so the shared counter stays off the insert path; a copy
+// starts out unbudgeted.
+class KeyCharge {
+public:
+    static constexpr std::int64_t step = 1 << 16;
+
+    KeyCharge() = default;
+    explicit KeyCharge(KeyBudget& budget) : budget_{&budget} {}
+    KeyCharge(const KeyCharge&) noexcept {}
+    KeyCharge(KeyCharge&& other) noexcept
+        : budget_{std::exchange(other.budget_, nullptr)}, charged_{std::exchange(other.charged_, 0)},
+          pending_{std::exchange(other.pending_, 0)} {}
+
+    KeyCharge& operator=(KeyCharge other) noexcept {
+        release();
+        budget_ = std::exchange(other.budget_, nullptr);
+        charged_ = std::exchange(other.charged_, 0);
+        pending_ = std::exchange(other.pending_, 0);
+        return *this;
+    }
+
+    ~KeyCharge() { release(); }
+
+    KeyBudget* budget() const { return budget_; }
+
+    // Returns true if this charge reached the budget and it's exceeded.
+    bool add(std::int64_t bytes) {
+        pending_ += bytes;
+        if(pending_ < step) return false;
+        budget_->charge(pending_);
+        charged_ += pending_;
+        pending_ = 0;
+        return budget_->exceeded();
+    }
+
+    // The values are gone from memory.
+    void release() {
+        if(budget_ && charged_) budget_->charge(-charged_);
+        charged_ = 0;
+        pending_ = 0;
+    }
+
+private:
+    KeyBudget* budget_ = nullptr;
+    std::int64_t charged_ = 0;
+    std::int64_t pending_ = 0;
+};
+
+// A sorted run of distinct values written by a spilling key set. The file
+// goes with the last key set referring to it.
+struct SpillRun {
+    std::filesystem::path path;
+    std::uint64_t count = 0;
+
+    ~SpillRun() {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+};
+
+} // namespace subset
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "memory.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// A counter bumped by many threads at once: each adds to a cache line of its
+// own, and only a scrape sums the stripes.
+class StripedCounter {
+public:
+    void add(std::uint64_t n) { stripes_[stripe()].value.fetch_add(n, std::memory_order_relaxed); }
+
+    std::uint64_t value() const {
+        std::uint64_t sum = 0;
+        for(const auto& s : stripes_) sum += s.value.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+private:
+    static constexpr std::size_t stripes = 16;
+
+    struct alignas(64) Stripe {
+        std::atomic<std::uint64_t> value = 0;
+    };
+
+    static std::size_t stripe() {
+        thread_local const std::size_t index = std::hash<std::thread::id>{}(std::this_thread::get_id()) % stripes;
+        return index;
+    }
+
+    std::array<Stripe, stripes> stripes_;
+};
+
+// Latencies in buckets of fixed bounds, cumulative as Prometheus has them
+// only when written out.
+class LatencyHistogram {
+public:
+    static constexpr std::array<double, 11> bounds{0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 5, 30};
+
+    void observe(double seconds) {
+        std::size_t i = 0;
+        while(i < bounds.size() && seconds > bounds[i]) i++;
+        buckets_[i].fetch_add(1, std::memory_order_relaxed);
+        micros_.fetch_add(static_cast<std::uint64_t>(seconds * 1e6), std::memory_order_relaxed);
+    }
+
+    // The series of the histogram name with labels, which are either empty
+    // or end with a comma.
+    void write(std::string& out, std::string_view name, std::string_view labels) const {
+        std::uint64_t count = 0;
+        for(std::size_t i = 0; i <= bounds.size(); i++) {
+            count += buckets_[i].load(std::memory_order_relaxed);
+            const std::string le = i < bounds.size() ? trimmed(bounds[i]) : "+Inf";
+            ((out += name) += "_bucket{") += labels;
+            out += "le=\"" + le + "\"} " + std::to_string(count) + '\n';
+        }
+        const std::string brace = labels.empty() ? "" : '{' + std::string{labels.substr(0, labels.size() - 1)} + '}';
+        out += std::string{name} + "_sum" + brace + ' ' +
+            trimmed(static_cast<double>(micros_.load(std::memory_order_relaxed)) / 1e6) + '\n';
+        out += std::string{name} + "_count" + brace + ' ' + std::to_string(count) + '\n';
+    }
+
+private:
+    static std::string trimmed(double value) {
+        std::string text = std::to_string(value);
+        text.erase(text.find_last_not_of('0') + 1);
+        if(text.back() == '.') text.pop_back();
+        return text;
+    }
+
+    std::array<std::atomic<std::uint64_t>, bounds.size() + 1> buckets_{};
+    std::atomic<std::uint64_t> micros_ = 0;
+};
+
+// What a daemon's /metrics reports, kept up by the jobs as they run. The
+// workers only ever touch atomics; the lock of the pools is taken by a
+// scrape and by the session opening or dropping its pools, never by a
+// worker.
+class LiveMetrics {
+public:
+    // Counted by the daemon's runner around every job.
+    std::atomic<std::uint64_t> jobsSucceeded = 0;
+    std::atomic<std::uint64_t> jobsFailed = 0;
+    std::atomic<std::uint64_t> jobsQueued = 0;
+    std::atomic<std::uint64_t> currentJob = 0; // 0 while idle
+
+    StripedCounter rows;  // sent to the sinks, over the process's life
+    StripedCounter bytes;
+
+    LatencyHistogram sourceLatency; // to a COPY's first row, and per prepared batch
+    LatencyHistogram targetLatency; // of the target accepting a COPY
+    LatencyHistogram poolWait;      // for a connection out of a pool
+
+    void startJob(std::uint64_t number) {
+        jobRows_.store(rows.value(), std::memory_order_relaxed);
+        jobBytes_.store(bytes.value(), std::memory_order_relaxed);
+        jobStart_.store(now(), std::memory_order_relaxed);
+        currentJob.store(number, std::memory_order_relaxed);
+    }
+
+    void endJob(bool succeeded) {
+        currentJob.store(0, std::memory_order_relaxed);
+        (succeeded ? jobsSucceeded : jobsFailed).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Sets the pool a session has open for role, or none.
+    void setPool(const char* role, const pgfe::Connection_pool* pool) {
+        const std::lock_guard lock{mutex_};
+        for(auto& [r, p] : pools_) {
+            if(std::string_view{r} == role) {
+                p = pool;
+                return;
+            }
+        }
+        pools_.emplace_back(role, pool);
+    }
+
+    // The Prometheus text exposition of it all.
+    std::string text() const {
+        std::string out;
+        const auto series = [&](const char* name, const char* type, const char* help) {
+            out += std::string{"# HELP "} + name + ' ' + help + "\n# TYPE " + name + ' ' + type + '\n';
+        };
+        series("subset_jobs_total", "counter", "Jobs the daemon ran, by outcome.");
+        out += "subset_jobs_total{outcome=\"succeeded\"} " + std::to_string(jobsSucceeded.load()) + '\n';
+        out += "subset_jobs_total{outcome=\"failed\"} " + std::to_string(jobsFailed.load()) + '\n';
+        const std::uint64_t job = currentJob.load();
+        series("subset_jobs_in_flight", "gauge", "Jobs running.");
+        out += "subset_jobs_in_flight " + std::to_string(job != 0) + '\n';
+        series("subset_jobs_queued", "gauge", "Jobs read and waiting for the one running.");
+        out += "subset_jobs_queued " + std::to_string(jobsQueued.load()) + '\n';
+
+        series("subset_rows_total", "counter", "Rows extracted.");
+        const std::uint64_t allRows = rows.value();
+        out += "subset_rows_total " + std::to_string(allRows) + '\n';
+        series("subset_bytes_total", "counter", "Bytes extracted.");
+        const std::uint64_t allBytes = bytes.value();
+        out += "subset_bytes_total " + std::to_string(allBytes) + '\n';
+        if(job != 0) {
+            const double seconds = std::max(static_cast<double>(now() - jobStart_.load()) / 1e9, 1e-3);
+            const std::string label = "{job=\"" + std::to_string(job) + "\"} ";
+            const std::uint64_t jobRows = allRows - jobRows_.load();
+            const std::uint64_t jobBytes = allBytes - jobBytes_.load();
+            series("subset_job_rows", "gauge", "Rows extracted by the running job.");
+            out += "subset_job_rows" + label + std::to_string(jobRows) + '\n';
+            series("subset_job_rows_per_second", "gauge", "Rows per second of the running job since it started.");
+            out += "subset_job_rows_per_second" + label + std::to_string(static_cast<double>(jobRows) / seconds) + '\n';
+            series("subset_job_bytes", "gauge", "Bytes extracted by the running job.");
+            out += "subset_job_bytes" + label + std::to_string(jobBytes) + '\n';
+            series("subset_job_bytes_per_second", "gauge", "Bytes per second of the running job since it started.");
+            out += "subset_job_bytes_per_second" + label + std::to_string(static_cast<double>(jobBytes) / seconds) + '\n';
+        }
+
+        {
+            const std::lock_guard lock{mutex_};
+            series("subset_pool_connections", "gauge", "Connections of the session's pools.");
+            for(const auto& [role, pool] : pools_) {
+                if(pool) out += std::string{"subset_pool_connections{pool=\""} + role + "\"} " + std::to_string(pool->size()) + '\n';
+            }
+            series("subset_pool_busy_connections", "gauge", "Connections of the pools in use.");
+            for(const auto& [role, pool] : pools_) {
+                if(pool)
+                    out += std::string{"subset_pool_busy_connections{pool=\""} + role + "\"} " + std::to_string(pool->busy_count()) + '\n';
+            }
+        }
+        series("subset_pool_wait_seconds", "histogram", "Waits for a connection out of a pool.");
+        poolWait.write(out, "subset_pool_wait_seconds", "");
+        series("subset_pipeline_queued_bytes", "gauge", "Rows received and not yet handed to the sinks' output threads.");
+        out += "subset_pipeline_queued_bytes " + std::to_string(pipelineBytes().current()) + '\n';
+        series("subset_connection_latency_seconds", "histogram", "Round trips of the connections, by role.");
+        sourceLatency.write(out, "subset_connection_latency_seconds", "role=\"source\",");
+        targetLatency.write(out, "subset_connection_latency_seconds", "role=\"target\",");
+        return out;
+    }
+
+private:
+    static std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Where the counters stood when the running job started.
+    std::atomic<std::uint64_t> jobRows_ = 0;
+    std::atomic<std::uint64_t> jobBytes_ = 0;
+    std::atomic<std::int64_t> jobStart_ = 0;
+    mutable std::mutex mutex_; // of pools_
+    std::vector<std::pair<const char*, const pgfe::Connection_pool*>> pools_;
+};
+
+inline LiveMetrics& liveMetrics() {
+    static LiveMetrics metrics;
+    return metrics;
+}
+
+} // namespace subset
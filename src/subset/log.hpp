@@ -0,0 +1,153 @@
+#pragma once
+
+#include "options.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+namespace subset {
+
+inline constexpr std::string_view logLevelName(LogLevel level) {
+    constexpr std::string_view names[] = {"debug", "info", "warn", "error", "off"};
+    return names[static_cast<std::size_t>(level)];
+}
+
+// A leveled logger whose workers never wait on the output. Messages go into
+// a bounded lock-free ring (Vyukov's MPMC queue, drained by one consumer)
+// and a background thread writes them out in batches, each stamped with the
+// time it was logged rather than written. A message below the level costs
+// a comparison: its text is only built when it's enabled. When the ring is
+// full the message is dropped and counted rather than blocking the worker.
+class Logger {
+public:
+    // capacity is a power of two.
+    Logger(std::ostream& out, LogLevel level, std::size_t capacity = 1 << 12)
+        : out_{out}, level_{level}, slots_{std::make_unique<Slot[]>(capacity)}, mask_{capacity - 1} {
+        for(std::size_t i = 0; i < capacity; i++) slots_[i].sequence.store(i, std::memory_order_relaxed);
+        if(level_ != LogLevel::off) flusher_ = std::thread{[this] { run(); }};
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    ~Logger() {
+        stop_.store(true, std::memory_order_release);
+        if(flusher_.joinable()) flusher_.join();
+    }
+
+    bool enabled(LogLevel level) const { return level >= level_ && level_ != LogLevel::off; }
+
+    // Logs the string message() returns, if level is enabled.
+    template<typename F>
+    void log(LogLevel level, F&& message) {
+        if(!enabled(level)) return;
+        if(!push(level, std::forward<F>(message)())) dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    template<typename F> void debug(F&& message) { log(LogLevel::debug, std::forward<F>(message)); }
+    template<typename F> void info(F&& message) { log(LogLevel::info, std::forward<F>(message)); }
+    template<typename F> void warn(F&& message) { log(LogLevel::warn, std::forward<F>(message)); }
+
+    // Returns once everything logged before has been written, so that direct
+    // output which follows doesn't overtake it.
+    void flush() {
+        const std::size_t target = head_.load(std::memory_order_acquire);
+        while(flusher_.joinable() && written_.load(std::memory_order_acquire) < target)
+            std::this_thread::sleep_for(std::chrono::microseconds{200});
+    }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> sequence;
+        LogLevel level = LogLevel::info;
+        double seconds = 0; // since the start, when logged
+        std::string text;
+    };
+
+    bool push(LogLevel level, std::string text) {
+        const double seconds = since();
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        while(true) {
+            slot = &slots_[pos & mask_];
+            const std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+            if(diff == 0) {
+                if(head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if(diff < 0) {
+                return false;
+            } else pos = head_.load(std::memory_order_relaxed);
+        }
+        slot->level = level;
+        slot->seconds = seconds;
+        slot->text = std::move(text);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Appends the messages ready in the ring to batch. Returns their count.
+    std::size_t drain(std::string& batch) {
+        std::size_t count = 0;
+        while(true) {
+            Slot& slot = slots_[tail_ & mask_];
+            if(slot.sequence.load(std::memory_order_acquire) != tail_ + 1) return count;
+            char stamp[32];
+            std::snprintf(stamp, sizeof(stamp), "[%9.3f %-5s] ", slot.seconds, logLevelName(slot.level).data());
+            batch += stamp;
+            batch += slot.text;
+            if(batch.back() != '\n') batch += '\n';
+            slot.text = {};
+            slot.sequence.store(tail_ + mask_ + 1, std::memory_order_release);
+            tail_++;
+            count++;
+        }
+    }
+
+    void run() {
+        std::string batch;
+        std::uint64_t reported = 0;
+        while(true) {
+            const bool stopping = stop_.load(std::memory_order_acquire);
+            const std::size_t count = drain(batch);
+            if(const auto dropped = dropped_.load(std::memory_order_relaxed); dropped != reported) {
+                batch += "[log] " + std::to_string(dropped - reported) + " messages dropped\n";
+                reported = dropped;
+            }
+            if(!batch.empty()) {
+                out_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+                out_.flush();
+                batch.clear();
+            }
+            written_.fetch_add(count, std::memory_order_release);
+            if(stopping && count == 0) return;
+            if(count == 0) std::this_thread::sleep_for(std::chrono::milliseconds{2});
+        }
+    }
+
+    double since() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    std::ostream& out_;
+    LogLevel level_;
+    std::unique_ptr<Slot[]> slots_;
+    std::size_t mask_; // capacity - 1; the capacity is a power of two
+    alignas(64) std::atomic<std::size_t> head_ = 0;
+    alignas(64) std::size_t tail_ = 0; // the flusher's alone
+    std::atomic<std::size_t> written_ = 0;
+    std::atomic<std::uint64_t> dropped_ = 0;
+    std::atomic<bool> stop_ = false;
+    std::chrono::steady_clock::time_point start_ = std::chrono::steady_clock::now();
+    std::thread flusher_;
+};
+
+} // namespace subset
@@ -0,0 +1,357 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "../struct_mapping/json_view.h"
+#include "key_set.hpp"
+#include "log.hpp"
+#include "schema_graph.hpp"
+#include "seeds.hpp"
+#include "sql.hpp"
+#include "staging_loader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The columns of a row as wal2json or a result gives them, in text format.
+struct RowImage {
+    std::vector<std::string> names;
+    std::vector<std::string> types; // empty when unknown
+    std::vector<std::optional<std::string>> values;
+
+    const std::optional<std::string>* find(std::string_view name) const {
+        for(std::size_t i = 0; i < names.size(); i++) {
+            if(names[i] == name) return &values[i];
+        }
+        return nullptr;
+    }
+};
+
+// A change of a row, decoded from the format-version 2 output of wal2json.
+struct RowChange {
+    enum class Action { insert, update, remove, truncate };
+    Action action;
+    std::string table;
+    RowImage row;      // the new row of an insert or an update
+    RowImage identity; // the replica identity of an update or a delete, if sent
+};
+
+// Decodes a change of the schema, or nothing for the transaction markers,
+// messages and the other schemas.
+inline std::optional<RowChange> parseWal2jsonChange(std::string_view json, std::string_view schema) {
+    const struct_mapping::JsonView change{json};
+    const auto action = change.find("action");
+    if(!action) throw std::runtime_error{"wal2json change without action"};
+    RowChange result;
+    const std::string code = action->as_string();
+    if(code == "I") result.action = RowChange::Action::insert;
+    else if(code == "U") result.action = RowChange::Action::update;
+    else if(code == "D") result.action = RowChange::Action::remove;
+    else if(code == "T") result.action = RowChange::Action::truncate;
+    else return std::nullopt;
+    if(const auto s = change.find("schema"); !s || s->as_string() != schema) return std::nullopt;
+    result.table = change.find("table")->as_string();
+
+    const auto image = [&](std::string_view name, RowImage& row) {
+        const auto columns = change.find(name);
+        if(!columns) return;
+        for(std::size_t i = 0;; i++) {
+            const auto column = columns->at(i);
+            if(!column) break;
+            row.names.push_back(column->find("name")->as_string());
+            const auto type = column->find("type");
+            row.types.push_back(type ? type->as_string() : std::string{});
+            const auto value = column->find("value");
+            if(!value || value->is_null()) row.values.emplace_back();
+            else if(value->kind() == struct_mapping::JsonKind::String) row.values.emplace_back(value->as_string());
+            else row.values.emplace_back(value->raw());
+        }
+    };
+    image("columns", result.row);
+    image("identity", result.identity);
+    return result;
+}
+
+// Keeps a subset loaded into the target up to date with the source, from
+// the changes a logical replication slot decodes with wal2json. The slot is
+// created before the snapshot of the initial extraction is exported, so every
+// change committed after the snapshot is streamed; the ones which the
+// snapshot has already seen are applied again, which the upserts and the
+// deletes by key make harmless.
+//
+// A row changed belongs to the subset when it would have been extracted: a
+// root row matching the seeds, or a row whose followed foreign keys are all in
+// the key sets. The key sets only grow: the keys of the rows coming in are
+// added, and the rows which already reference them are read from the source
+// and loaded too. A row updated out of the subset is deleted from the target
+// unless other rows still reference it there.
+class LogicalSync {
+public:
+    struct Settings {
+        std::string slot;
+        std::string schema;
+        std::size_t batchChanges = 10000;       // changes per target transaction
+        std::chrono::milliseconds interval{1000}; // the wait when there are no changes
+    };
+
+    // Creates the slot; on the lead connection before it exports the snapshot.
+    static void createSlot(pgfe::Connection& source, const std::string& slot) {
+        source.execute("SELECT pg_create_logical_replication_slot($1, 'wal2json')", slot);
+    }
+
+    LogicalSync(pgfe::Connection& source, pgfe::Connection& target, const SchemaGraph& graph, TableId rootTable,
+        const Seeds& seeds, std::vector<KeySet>& keyValues, Settings settings, Logger& logger)
+        : source_{source}, target_{target}, graph_{graph}, rootTable_{rootTable}, seeds_{seeds}, keyValues_{keyValues},
+        settings_{std::move(settings)}, logger_{logger} {}
+
+    // Applies the changes committed since the previous poll in one target
+    // transaction, then confirms them to the slot. Returns their number.
+    std::size_t poll() {
+        std::vector<RowChange> changes;
+        std::string lastCommit;
+        source_.execute([&](auto&& r) {
+            const auto data = pgfe::to<std::string_view>(r["data"]);
+            if(struct_mapping::JsonView{data}.find("action")->raw() == "\"C\"") lastCommit = pgfe::to<std::string>(r["lsn"]);
+            else if(auto change = parseWal2jsonChange(data, settings_.schema)) changes.push_back(std::move(*change));
+        }, R"(
+            SELECT lsn::text AS lsn, data
+            FROM pg_logical_slot_peek_changes($1, NULL, $2, 'format-version', '2', 'include-transaction', 'true',
+                'add-tables', $3)
+        )", settings_.slot, static_cast<std::int64_t>(settings_.batchChanges), settings_.schema + ".*");
+        if(lastCommit.empty()) return 0;
+
+        target_.execute("BEGIN");
+        try {
+            for(const auto& change : changes) apply(change);
+            backfill();
+            target_.execute("COMMIT");
+        } catch(...) {
+            if(target_.is_ready_for_request()) target_.execute("ROLLBACK");
+            throw;
+        }
+        source_.execute(DMITIGR_PGFE_SQL("SELECT pg_replication_slot_advance($1, $2::pg_lsn)"), settings_.slot, lastCommit);
+        return changes.size();
+    }
+
+    // Polls until stopped, waiting the interval whenever there's nothing new.
+    [[noreturn]] void run() {
+        while(true) {
+            const auto applied = poll();
+            if(applied) logger_.info([&] { return "Sync: " + std::to_string(applied) + " changes applied"; });
+            else std::this_thread::sleep_for(settings_.interval);
+        }
+    }
+
+private:
+    void apply(const RowChange& change) {
+        const auto table = graph_.findTable(change.table);
+        if(!table) return;
+        const std::string& name = graph_.tableName(*table);
+        if(change.action == RowChange::Action::truncate) {
+            // The source truncated the tables referencing it as well.
+            target_.execute("TRUNCATE " + name + " CASCADE");
+            return;
+        }
+        const RowImage& identity = change.identity.names.empty() ? change.row : change.identity;
+        if(change.action == RowChange::Action::remove) {
+            remove(*table, identity);
+            return;
+        }
+        if(!belongs(*table, change.row)) {
+            if(change.action == RowChange::Action::update) leave(*table, identity);
+            return;
+        }
+        // The row of a changed key replaces the one of the old key.
+        if(!change.identity.names.empty() && !sameKey(*table, change.identity, change.row)) leave(*table, change.identity);
+        upsert(*table, change.row);
+    }
+
+    // Whether the row would be extracted, as whereCondition() selects them.
+    bool belongs(TableId table, const RowImage& row) {
+        if(table == rootTable_) {
+            if(const KeySet* ids = seeds_.ids()) {
+                const auto* id = row.find("id");
+                return id && *id && ids->contains(**id);
+            }
+            return matchesPredicate(row);
+        }
+        for(auto l : graph_.supporters(table)) {
+            const FkLink& link = graph_.link(l);
+            const auto value = keyOf(row, graph_.childColumns(link));
+            if(!value || !keyValues_[link.need].contains(*value)) return false;
+        }
+        return true;
+    }
+
+    // The seed predicate evaluated over the row's values, typed as wal2json
+    // names their types.
+    bool matchesPredicate(const RowImage& row) {
+        std::string select;
+        for(std::size_t i = 0; i < row.names.size(); i++) {
+            select += i ? ", " : "SELECT ";
+            select += row.values[i] ? quoteLiteral(*row.values[i]) : "NULL";
+            if(!row.types[i].empty()) select += "::" + row.types[i];
+            select += " AS " + quoteIdentifier(row.names[i]);
+        }
+        bool result = false;
+        source_.execute([&](auto&& r) { result = pgfe::to<bool>(r[0]); },
+            "SELECT EXISTS (SELECT FROM (" + select + ") AS " + quoteIdentifier(graph_.tableName(rootTable_)) +
+            " WHERE " + seeds_.predicate() + ")");
+        return result;
+    }
+
+    // Loads the row and adds its keys, the new ones to be backfilled.
+    void upsert(TableId table, const RowImage& row) {
+        const auto& key = primaryKey(table);
+        std::string columns;
+        std::string values;
+        std::string set;
+        for(std::size_t i = 0; i < row.names.size(); i++) {
+            const std::string column = quoteIdentifier(row.names[i]);
+            columns += (i ? ", " : "") + column;
+            values += (i ? ", " : "") + (row.values[i] ? quoteLiteral(*row.values[i]) : std::string{"NULL"});
+            if(std::find(key.begin(), key.end(), column) == key.end())
+                set += (set.empty() ? "" : ", ") + column + " = EXCLUDED." + column;
+        }
+        std::string conflict;
+        for(const auto& column : key) conflict += (conflict.empty() ? "" : ", ") + column;
+        target_.execute("INSERT INTO " + graph_.tableName(table) + " (" + columns + ") VALUES (" + values + ")" +
+            (conflict.empty() ? " ON CONFLICT DO NOTHING" :
+                " ON CONFLICT (" + conflict + ")" + (set.empty() ? " DO NOTHING" : " DO UPDATE SET " + set)));
+
+        const auto [first, last] = graph_.needs(table);
+        for(auto need = first; need < last; need++) {
+            auto value = keyOf(row, graph_.needColumns(need));
+            if(value && keyValues_[need].insert(*value)) newKeys_.emplace_back(need, std::move(*value));
+        }
+    }
+
+    // The row's key in columns, a tuple's text for several; none if a
+    // column is missing or NULL.
+    std::optional<std::string> keyOf(const RowImage& row, std::span<const ColumnId> columns) const {
+        std::vector<std::string_view> fields;
+        for(const ColumnId column : columns) {
+            const auto* value = row.find(graph_.columnName(column));
+            if(!value || !*value) return std::nullopt;
+            fields.emplace_back(**value);
+        }
+        return fields.size() == 1 ? std::string{fields.front()} : KeySet::tupleText(fields);
+    }
+
+    void remove(TableId table, const RowImage& identity) {
+        const std::string where = keyCondition(table, identity);
+        if(!where.empty()) target_.execute("DELETE FROM " + graph_.tableName(table) + " WHERE " + where);
+    }
+
+    // Deletes a row which no longer belongs, unless the target's foreign
+    // keys still need it.
+    void leave(TableId table, const RowImage& identity) {
+        target_.execute(DMITIGR_PGFE_SQL("SAVEPOINT subset_sync_leave"));
+        try {
+            remove(table, identity);
+            target_.execute(DMITIGR_PGFE_SQL("RELEASE SAVEPOINT subset_sync_leave"));
+        } catch(const pgfe::Server_exception&) {
+            target_.execute(DMITIGR_PGFE_SQL("ROLLBACK TO SAVEPOINT subset_sync_leave"));
+            logger_.warn([&] { return "Sync: a row left the subset of " + graph_.tableName(table) + " but is still referenced"; });
+        }
+    }
+
+    // The rows of the source referencing the new keys are in the subset now,
+    // and so are the ones referencing theirs.
+    void backfill() {
+        while(!newKeys_.empty()) {
+            std::map<NeedId, std::vector<std::string>> keys;
+            for(auto& [need, value] : newKeys_) keys[need].push_back(std::move(value));
+            newKeys_.clear();
+            for(TableId parent = 0; parent < graph_.tableCount(); parent++) {
+                for(auto l : graph_.dependents(parent)) {
+                    const FkLink& link = graph_.link(l);
+                    const auto it = keys.find(link.need);
+                    if(it == keys.end()) continue;
+                    const auto columns = graph_.columnNames(graph_.childColumns(link));
+                    std::string in;
+                    for(const auto& value : it->second) {
+                        in += in.empty() ? "" : ", ";
+                        if(columns.size() == 1) {
+                            in += quoteLiteral(value);
+                            continue;
+                        }
+                        in += '(';
+                        KeySet::forEachTupleField(value, [&](std::size_t i, std::string_view field) {
+                            in += (i ? ", " : "") + quoteLiteral(field);
+                        });
+                        in += ')';
+                    }
+                    std::string match;
+                    for(const auto& column : columns) match += (match.empty() ? "" : ", ") + quoteIdentifier(column);
+                    if(columns.size() > 1) match = '(' + match + ')';
+                    std::vector<RowImage> rows;
+                    source_.execute([&](auto&& r) {
+                        RowImage row;
+                        for(std::size_t i = 0; i < r.field_count(); i++) {
+                            row.names.emplace_back(r.info().field_name(i));
+                            row.types.emplace_back();
+                            const auto data = r.data(i);
+                            if(data) row.values.emplace_back(pgfe::to<std::string_view>(data));
+                            else row.values.emplace_back();
+                        }
+                        rows.push_back(std::move(row));
+                    }, "SELECT * FROM " + graph_.tableName(link.child) + " WHERE " + match + " IN (" + in + ")");
+                    for(const auto& row : rows) {
+                        if(belongs(link.child, row)) upsert(link.child, row);
+                    }
+                }
+            }
+        }
+    }
+
+    const std::vector<std::string>& primaryKey(TableId table) {
+        auto it = primaryKeys_.find(table);
+        if(it == primaryKeys_.end()) it = primaryKeys_.emplace(table, primaryKeyColumns(target_, graph_.tableName(table))).first;
+        return it->second;
+    }
+
+    // The condition of the primary key on the values of the row, or of all
+    // its columns without one.
+    std::string keyCondition(TableId table, const RowImage& row) {
+        const auto& key = primaryKey(table);
+        std::string result;
+        for(std::size_t i = 0; i < row.names.size(); i++) {
+            const std::string column = quoteIdentifier(row.names[i]);
+            if(!key.empty() && std::find(key.begin(), key.end(), column) == key.end()) continue;
+            result += (result.empty() ? "" : " AND ") + column +
+                (row.values[i] ? " = " + quoteLiteral(*row.values[i]) : std::string{" IS NULL"});
+        }
+        return result;
+    }
+
+    bool sameKey(TableId table, const RowImage& a, const RowImage& b) {
+        return keyCondition(table, a) == keyCondition(table, b);
+    }
+
+    pgfe::Connection& source_;
+    pgfe::Connection& target_;
+    const SchemaGraph& graph_;
+    TableId rootTable_;
+    const Seeds& seeds_;
+    std::vector<KeySet>& keyValues_;
+    Settings settings_;
+    Logger& logger_;
+    std::map<TableId, std::vector<std::string>> primaryKeys_;
+    std::vector<std::pair<NeedId, std::string>> newKeys_;
+};
+
+} // namespace subset
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "checkpoint.hpp"
+#include "copy_stream.hpp"
+#include "options.hpp"
+#include "prepared_extract.hpp"
+#include "sink.hpp"
+#include "task_pool.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+// SipHash-2-4 of data under a 128-bit key: a keyed hash, so the masked
+// values can't be looked up in a dictionary of hashed emails without the
+// key, and cheap on the short values of a column.
+inline std::uint64_t sipHash(std::uint64_t k0, std::uint64_t k1, std::string_view data) {
+    std::uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+    std::uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+    std::uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+    std::uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+    const auto rotl = [](std::uint64_t x, int b) { return x << b | x >> (64 - b); };
+    const auto round = [&] {
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+    };
+    const auto load = [&](std::size_t at, std::size_t n) {
+        std::uint64_t word = 0;
+        for(std::size_t i = 0; i < n; i++) word |= std::uint64_t{static_cast<unsigned char>(data[at + i])} << (8 * i);
+        return word;
+    };
+    const std::size_t whole = data.size() / 8 * 8;
+    for(std::size_t i = 0; i < whole; i += 8) {
+        const std::uint64_t m = load(i, 8);
+        v3 ^= m;
+        round();
+        round();
+        v0 ^= m;
+    }
+    const std::uint64_t last = load(whole, data.size() - whole) | std::uint64_t{data.size() & 0xff} << 56;
+    v3 ^= last;
+    round();
+    round();
+    v0 ^= last;
+    v2 ^= 0xff;
+    for(int i = 0; i < 4; i++) round();
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// The secret of --mask-key-env, read from the variable so that it shows in
+// neither the process list nor the shell's history.
+inline std::string maskKey(const std::string& variable) {
+    const char* value = std::getenv(variable.c_str());
+    if(!value || !*value) throw std::invalid_argument{"--mask-key-env: $" + variable + " is not set"};
+    return value;
+}
+
+// The masking functions, deterministic under the key: a value is masked the
+// same way in every table and every run, so joins on masked columns still
+// match and a run against the same target stays consistent.
+class Masker {
+public:
+    explicit Masker(const std::string& key) : k0_{fnv1a(key)}, k1_{fnv1a(key, 0x84222325cbf29ce4ULL)} {}
+
+    // Appends the masked value of a non-NULL field to out, in text format.
+    void apply(Mask function, std::string_view value, std::string& out) const {
+        static constexpr char hex[] = "0123456789abcdef";
+        const std::uint64_t hash = sipHash(k0_, k1_, value);
+        switch(function) {
+        case Mask::hash:
+            for(int shift = 60; shift >= 0; shift -= 4) out += hex[hash >> shift & 15];
+            break;
+        case Mask::email:
+            out += "user_";
+            for(int shift = 60; shift >= 0; shift -= 4) out += hex[hash >> shift & 15];
+            out += "@example.com";
+            break;
+        case Mask::digits: {
+            // The format stays, for the checks and the displays expecting it.
+            std::uint64_t stream = hash;
+            std::size_t used = 0;
+            for(const char c : value) {
+                if(c < '0' || c > '9') {
+                    out += c;
+                    continue;
+                }
+                if(used++ % 16 == 15) stream = sipHash(k0_, k1_ ^ used, value);
+                out += static_cast<char>('0' + stream % 10);
+                stream /= 10;
+            }
+            break;
+        }
+        case Mask::name: {
+            static constexpr char consonants[] = "bcdfghjklmnprstvz";
+            static constexpr char vowels[] = "aeiou";
+            std::uint64_t stream = hash;
+            const std::size_t syllables = 2 + stream % 2;
+            stream /= 2;
+            for(std::size_t i = 0; i < syllables; i++) {
+                const char c = consonants[stream % 17];
+                out += i ? c : static_cast<char>(c - 'a' + 'A');
+                stream /= 17;
+                out += vowels[stream % 5];
+                stream /= 5;
+            }
+            break;
+        }
+        case Mask::null:
+            break;
+        }
+    }
+
+private:
+    std::uint64_t k0_;
+    std::uint64_t k1_;
+};
+
+// The masked fields of one table's CSV records, by position. Only the
+// fields up to the last masked one are delimited; the rest of a record is
+// copied through after a scan for its end, which only has to keep track of
+// the quotes.
+class RowMasker {
+public:
+    RowMasker(const Masker& masker, std::vector<std::pair<std::size_t, Mask>> fields)
+        : masker_{masker}, fields_{std::move(fields)} {
+        std::sort(fields_.begin(), fields_.end());
+    }
+
+    // Appends the masked records of data, whole records in COPY ... (FORMAT
+    // csv), to out.
+    void mask(std::string_view data, std::string& out) const {
+        out.reserve(out.size() + data.size() + data.size() / 8);
+        std::string value;
+        std::size_t i = 0;
+        while(i < data.size()) {
+            std::size_t field = 0;
+            auto next = fields_.begin();
+            while(next != fields_.end() && i < data.size()) {
+                const std::size_t end = fieldEnd(data, i);
+                if(field == next->first) {
+                    const std::string_view raw = data.substr(i, end - i);
+                    if(raw.empty() || next->second == Mask::null) {
+                        // NULL stays NULL.
+                    } else if(raw == "\"\"") out += raw;
+                    else {
+                        value.clear();
+                        masker_.apply(next->second, unquote(raw), value);
+                        appendCsvField(out, value, false);
+                    }
+                    ++next;
+                } else out.append(data.substr(i, end - i));
+                i = end;
+                if(i >= data.size() || data[i] == '\n') break;
+                out += ',';
+                i++;
+                field++;
+            }
+            const std::size_t end = std::min(csvRecordEnd(data, i) + 1, data.size());
+            out.append(data.substr(i, end - i));
+            i = end;
+        }
+    }
+
+private:
+    // The position of the delimiter or the newline after the field at i.
+    static std::size_t fieldEnd(std::string_view data, std::size_t i) {
+        if(i < data.size() && data[i] == '"') {
+            for(i++; i < data.size(); i++) {
+                if(data[i] != '"') continue;
+                if(i + 1 < data.size() && data[i + 1] == '"') i++;
+                else return i + 1;
+            }
+            return data.size();
+        }
+        const std::size_t end = data.find_first_of(",\n", i);
+        return end == std::string_view::npos ? data.size() : end;
+    }
+
+    std::string_view unquote(std::string_view raw) const {
+        if(raw.front() != '"') return raw;
+        unquoted_.clear();
+        for(std::size_t i = 1; i + 1 < raw.size(); i++) {
+            unquoted_ += raw[i];
+            if(raw[i] == '"') i++;
+        }
+        return unquoted_;
+    }
+
+    const Masker& masker_;
+    std::vector<std::pair<std::size_t, Mask>> fields_;
+    inline static thread_local std::string unquoted_;
+};
+
+// Masks the CSV records written to it before passing them on. Like the
+// GzipSink the data is cut into chunks of whole records, masked on the pool
+// and written in their order; write() only waits once maxInFlight chunks are
+// still being masked. Every write has to hold whole records, and the sink
+// after one takes them several to a write.
+class MaskSink final : public Sink {
+public:
+    MaskSink(std::unique_ptr<Sink> out, TaskPool& pool, std::shared_ptr<const RowMasker> masker, std::size_t chunkSize,
+        std::size_t maxInFlight = 4)
+        : out_{std::move(out)}, pool_{pool}, masker_{std::move(masker)}, chunkSize_{chunkSize},
+          maxInFlight_{std::max<std::size_t>(maxInFlight, 1)} {
+        chunk_.reserve(chunkSize_);
+    }
+
+    MaskSink(const MaskSink&) = delete;
+    MaskSink& operator=(const MaskSink&) = delete;
+
+    ~MaskSink() override {
+        for(auto& result : inFlight_) result.wait();
+    }
+
+    void write(std::string_view data) override {
+        chunk_.append(data);
+        if(chunk_.size() >= chunkSize_) submit();
+    }
+
+    void close() override {
+        submit();
+        while(!inFlight_.empty()) drain();
+        out_->close();
+    }
+
+private:
+    void submit() {
+        if(chunk_.empty()) return;
+        if(inFlight_.size() >= maxInFlight_) drain();
+        inFlight_.push_back(pool_.submit([chunk = std::move(chunk_), masker = masker_] {
+            const TraceSpan span{"mask", "mask"};
+            std::string masked;
+            masker->mask(chunk, masked);
+            return masked;
+        }));
+        chunk_ = std::string{};
+        chunk_.reserve(chunkSize_);
+    }
+
+    void drain() {
+        const std::string masked = inFlight_.front().get();
+        inFlight_.pop_front();
+        out_->write(masked);
+    }
+
+    std::unique_ptr<Sink> out_;
+    TaskPool& pool_;
+    std::shared_ptr<const RowMasker> masker_;
+    std::size_t chunkSize_;
+    std::size_t maxInFlight_;
+    std::string chunk_;
+    std::deque<std::future<std::string>> inFlight_;
+};
+
+} // namespace subset
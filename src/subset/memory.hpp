@@ -0,0 +1,109 @@
+#pragma once
+
+#include <malloc.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace subset {
+
+// The resident set of the process now, 0 where /proc isn't mounted.
+inline std::uint64_t residentBytes() {
+    std::ifstream statm{"/proc/self/statm"};
+    std::uint64_t size = 0;
+    std::uint64_t resident = 0;
+    if(!(statm >> size >> resident)) return 0;
+    return resident * static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+
+// The peak of the resident set since the last resetPeakResident(), or since
+// the start without one.
+inline std::uint64_t peakResidentBytes() {
+    std::ifstream status{"/proc/self/status"};
+    for(std::string line; std::getline(status, line);) {
+        if(line.rfind("VmHWM:", 0) == 0) return std::stoull(line.substr(6)) * 1024;
+    }
+    rusage usage{};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+// Starts a new peak, so each phase reports its own: clear_refs takes 5 for
+// that since Linux 4.0. Returns whether it did.
+inline bool resetPeakResident() {
+    std::ofstream clear{"/proc/self/clear_refs"};
+    clear << "5";
+    clear.flush();
+    return static_cast<bool>(clear);
+}
+
+// What malloc has handed out and not been given back, 0 before glibc 2.33.
+inline std::uint64_t heapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    const auto info = ::mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+// A number of bytes held somewhere, and the most it has been.
+class MemoryGauge {
+public:
+    void add(std::uint64_t bytes) { raise(peak_, current_.fetch_add(bytes, std::memory_order_relaxed) + bytes); }
+    void release(std::uint64_t bytes) { current_.fetch_sub(bytes, std::memory_order_relaxed); }
+    // For a gauge of sizes rather than of holdings: keeps the largest.
+    void observe(std::uint64_t bytes) { raise(peak_, bytes); }
+
+    std::uint64_t current() const { return current_.load(std::memory_order_relaxed); }
+    std::uint64_t peak() const { return peak_.load(std::memory_order_relaxed); }
+
+private:
+    static void raise(std::atomic<std::uint64_t>& peak, std::uint64_t value) {
+        auto seen = peak.load(std::memory_order_relaxed);
+        while(value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+
+    std::atomic<std::uint64_t> current_ = 0;
+    std::atomic<std::uint64_t> peak_ = 0;
+};
+
+// The chunks of rows queued between the COPY receive loops and the output
+// threads of the stage sinks.
+inline MemoryGauge& pipelineBytes() {
+    static MemoryGauge gauge;
+    return gauge;
+}
+
+// The largest message libpq handed over from the source, which it held in
+// its input buffer whole: a COPY row, or a row of a result.
+inline MemoryGauge& sourceMessageBytes() {
+    static MemoryGauge gauge;
+    return gauge;
+}
+
+// Counted by the operator new of a build with SUBSET_COUNT_ALLOCATIONS, in
+// usable bytes as malloc rounds them.
+struct AllocationCounters {
+    std::atomic<std::uint64_t> allocations = 0;
+    std::atomic<std::uint64_t> bytes = 0;
+    MemoryGauge live;
+};
+
+inline AllocationCounters& allocationCounters() {
+    static AllocationCounters counters;
+    return counters;
+}
+
+#ifdef SUBSET_COUNT_ALLOCATIONS
+inline constexpr bool countingAllocations = true;
+#else
+inline constexpr bool countingAllocations = false;
+#endif
+
+} // namespace subset
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <time.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+// CPU time of the calling thread. Wall time minus this is what a worker
+// spent blocked: waiting for the server, the network or the disk.
+inline double threadCpuSeconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+class Stopwatch {
+public:
+    Stopwatch()
+        : start_{std::chrono::steady_clock::now()} {}
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    std::chrono::steady_clock::time_point started() const { return start_; }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+struct TableMetrics {
+    std::string table;
+    std::uint64_t rows = 0;
+    std::uint64_t bytes = 0;
+    double seconds = 0;     // wall time of the extraction
+    double cpuSeconds = 0;  // of it, spent on the worker's CPU
+    double loadSeconds = 0; // closing the sink: flushing, or the target finishing its COPY
+};
+
+struct PhaseMetrics {
+    std::string name;
+    double seconds = 0;
+    std::uint64_t peakResident = 0; // the resident set's peak during the phase, 0 if unknown
+    std::uint64_t resident = 0;     // at its end
+};
+
+// Where the memory was at the end of the extraction, for sizing the
+// process and for finding what grows.
+struct MemoryMetrics {
+    std::uint64_t heap = 0;             // held from malloc
+    std::uint64_t keySets = 0;          // of that, by the key sets in memory
+    std::uint64_t pipelinePeak = 0;     // the most bytes queued in stage sinks at once
+    std::uint64_t largestMessage = 0;   // the largest message received from the source
+    bool counted = false;               // the allocation counters below are kept
+    std::uint64_t allocations = 0;
+    std::uint64_t allocatedBytes = 0;
+    std::uint64_t livePeak = 0;         // the most bytes from operator new held at once
+    std::vector<std::pair<std::string, std::uint64_t>> largestKeySets; // table.column and bytes, largest first
+};
+
+// A batch of a table slower than --explain-slow, with the plan of running
+// it again under EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON).
+struct SlowPlan {
+    std::string table;
+    double seconds = 0;
+    std::string statement;
+    std::string plan; // JSON as the server gives it
+};
+
+// A batch of a table cancelled past --batch-timeout and run again in halves.
+struct CancelledBatch {
+    std::string table;
+    std::size_t keys = 0;
+    double seconds = 0;
+};
+
+// What a table's extraction statements cost the server during the run, from
+// pg_stat_statements.
+struct ServerCost {
+    std::string table;
+    std::uint64_t calls = 0;
+    double execSeconds = 0;
+    std::uint64_t sharedHit = 0;   // blocks
+    std::uint64_t sharedRead = 0;
+    std::uint64_t tempRead = 0;
+    std::uint64_t tempWritten = 0;
+};
+
+// The blocks all client backends of the cluster moved during the run, from
+// pg_stat_io.
+struct ServerIo {
+    std::uint64_t reads = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t writes = 0;
+};
+
+inline void appendJsonString(std::string& out, std::string_view s) {
+    out += '"';
+    for(const char c : s) {
+        if(c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if(static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+            out += escape;
+        } else out += c;
+    }
+    out += '"';
+}
+
+// The timings of one run: the phases in the order they ran, and the tables
+// in the order they finished. Thread-safe.
+class Metrics {
+public:
+    void phase(std::string name, double seconds, std::uint64_t peakResident = 0, std::uint64_t resident = 0) {
+        std::lock_guard lock{mutex_};
+        phases_.push_back({std::move(name), seconds, peakResident, resident});
+    }
+
+    void memory(MemoryMetrics memory) {
+        std::lock_guard lock{mutex_};
+        memory_ = std::move(memory);
+    }
+
+    void table(TableMetrics metrics) {
+        std::lock_guard lock{mutex_};
+        tables_.push_back(std::move(metrics));
+    }
+
+    void slowPlan(SlowPlan plan) {
+        std::lock_guard lock{mutex_};
+        slowPlans_.push_back(std::move(plan));
+    }
+
+    void cancelledBatch(CancelledBatch batch) {
+        std::lock_guard lock{mutex_};
+        cancelledBatches_.push_back(std::move(batch));
+    }
+
+    void serverCosts(std::vector<ServerCost> costs, std::optional<ServerIo> io) {
+        std::lock_guard lock{mutex_};
+        serverCosts_ = std::move(costs);
+        serverIo_ = io;
+    }
+
+    void printSummary(std::ostream& out) const {
+        std::lock_guard lock{mutex_};
+        char line[256];
+        out << "Phases:\n";
+        for(const auto& p : phases_) {
+            std::snprintf(line, sizeof(line), "  %-16s %10.3f s %10.1f MiB peak RSS\n", p.name.c_str(), p.seconds, mib(p.peakResident));
+            out << line;
+        }
+        if(memory_) {
+            std::snprintf(line, sizeof(line), "Memory: %.1f MiB heap, %.1f MiB in key sets, %.1f MiB peak in pipelines, "
+                "%.1f MiB largest source message\n", mib(memory_->heap), mib(memory_->keySets), mib(memory_->pipelinePeak),
+                mib(memory_->largestMessage));
+            out << line;
+            if(memory_->counted) {
+                std::snprintf(line, sizeof(line), "  %llu allocations, %.1f MiB allocated, %.1f MiB peak live\n",
+                    static_cast<unsigned long long>(memory_->allocations), mib(memory_->allocatedBytes), mib(memory_->livePeak));
+                out << line;
+            }
+            for(const auto& [name, bytes] : memory_->largestKeySets) {
+                std::snprintf(line, sizeof(line), "  %-40s %10.1f MiB\n", name.c_str(), mib(bytes));
+                out << line;
+            }
+        }
+        for(const auto& p : slowPlans_) {
+            std::snprintf(line, sizeof(line), "Slow batch of %s: %.3f s, explained in the metrics\n", p.table.c_str(), p.seconds);
+            out << line;
+        }
+        for(const auto& b : cancelledBatches_) {
+            std::snprintf(line, sizeof(line), "Cancelled batch of %s: %zu keys after %.3f s, split\n", b.table.c_str(),
+                b.keys, b.seconds);
+            out << line;
+        }
+        if(!serverCosts_.empty()) {
+            std::snprintf(line, sizeof(line), "%-32s %8s %10s %12s %12s %10s %10s\n",
+                "server cost", "calls", "exec s", "shared hit", "shared read", "temp read", "temp write");
+            out << line;
+            for(const auto& c : serverCosts_) {
+                std::snprintf(line, sizeof(line), "%-32s %8llu %10.3f %12llu %12llu %10llu %10llu\n", c.table.c_str(),
+                    static_cast<unsigned long long>(c.calls), c.execSeconds, static_cast<unsigned long long>(c.sharedHit),
+                    static_cast<unsigned long long>(c.sharedRead), static_cast<unsigned long long>(c.tempRead),
+                    static_cast<unsigned long long>(c.tempWritten));
+                out << line;
+            }
+        }
+        if(serverIo_) {
+            std::snprintf(line, sizeof(line), "Server I/O of client backends: %llu blocks read, %llu hit, %llu written\n",
+                static_cast<unsigned long long>(serverIo_->reads), static_cast<unsigned long long>(serverIo_->hits),
+                static_cast<unsigned long long>(serverIo_->writes));
+            out << line;
+        }
+        std::snprintf(line, sizeof(line), "%-32s %12s %14s %10s %12s %9s %9s %9s\n",
+            "table", "rows", "bytes", "seconds", "rows/s", "cpu", "wait", "load");
+        out << line;
+        for(const auto& t : tables_) {
+            std::snprintf(line, sizeof(line), "%-32s %12llu %14llu %10.3f %12.0f %9.3f %9.3f %9.3f\n",
+                t.table.c_str(), static_cast<unsigned long long>(t.rows), static_cast<unsigned long long>(t.bytes),
+                t.seconds, rate(t), t.cpuSeconds, t.seconds - t.cpuSeconds, t.loadSeconds);
+            out << line;
+        }
+    }
+
+    std::string json() const {
+        std::lock_guard lock{mutex_};
+        std::string out = "{\"phases\":[";
+        char number[160];
+        for(std::size_t i = 0; i < phases_.size(); i++) {
+            out += i ? ",{\"name\":" : "{\"name\":";
+            appendJsonString(out, phases_[i].name);
+            std::snprintf(number, sizeof(number), ",\"seconds\":%.6f,\"peak_rss_bytes\":%llu,\"rss_bytes\":%llu}",
+                phases_[i].seconds, static_cast<unsigned long long>(phases_[i].peakResident),
+                static_cast<unsigned long long>(phases_[i].resident));
+            out += number;
+        }
+        out += "],\"tables\":[";
+        for(std::size_t i = 0; i < tables_.size(); i++) {
+            const auto& t = tables_[i];
+            out += i ? ",{\"table\":" : "{\"table\":";
+            appendJsonString(out, t.table);
+            std::snprintf(number, sizeof(number), ",\"rows\":%llu,\"bytes\":%llu",
+                static_cast<unsigned long long>(t.rows), static_cast<unsigned long long>(t.bytes));
+            out += number;
+            std::snprintf(number, sizeof(number), ",\"seconds\":%.6f,\"rows_per_second\":%.1f",
+                t.seconds, rate(t));
+            out += number;
+            std::snprintf(number, sizeof(number), ",\"cpu_seconds\":%.6f,\"wait_seconds\":%.6f,\"load_seconds\":%.6f}",
+                t.cpuSeconds, t.seconds - t.cpuSeconds, t.loadSeconds);
+            out += number;
+        }
+        out += ']';
+        if(memory_) {
+            const auto& m = *memory_;
+            std::snprintf(number, sizeof(number), ",\"memory\":{\"heap_bytes\":%llu,\"key_set_bytes\":%llu,"
+                "\"pipeline_peak_bytes\":%llu,\"largest_message_bytes\":%llu", static_cast<unsigned long long>(m.heap),
+                static_cast<unsigned long long>(m.keySets), static_cast<unsigned long long>(m.pipelinePeak),
+                static_cast<unsigned long long>(m.largestMessage));
+            out += number;
+            if(m.counted) {
+                std::snprintf(number, sizeof(number), ",\"allocations\":%llu,\"allocated_bytes\":%llu,\"live_peak_bytes\":%llu",
+                    static_cast<unsigned long long>(m.allocations), static_cast<unsigned long long>(m.allocatedBytes),
+                    static_cast<unsigned long long>(m.livePeak));
+                out += number;
+            }
+            out += ",\"key_sets\":[";
+            for(std::size_t i = 0; i < m.largestKeySets.size(); i++) {
+                out += i ? ",{\"column\":" : "{\"column\":";
+                appendJsonString(out, m.largestKeySets[i].first);
+                out += ",\"bytes\":" + std::to_string(m.largestKeySets[i].second) + '}';
+            }
+            out += "]}";
+        }
+        if(!slowPlans_.empty()) {
+            out += ",\"slow_plans\":[";
+            for(std::size_t i = 0; i < slowPlans_.size(); i++) {
+                const auto& p = slowPlans_[i];
+                out += i ? ",{\"table\":" : "{\"table\":";
+                appendJsonString(out, p.table);
+                std::snprintf(number, sizeof(number), ",\"seconds\":%.6f,\"statement\":", p.seconds);
+                out += number;
+                appendJsonString(out, p.statement);
+                out += ",\"plan\":" + (p.plan.empty() ? std::string{"null"} : p.plan) + '}';
+            }
+            out += ']';
+        }
+        if(!cancelledBatches_.empty()) {
+            out += ",\"cancelled_batches\":[";
+            for(std::size_t i = 0; i < cancelledBatches_.size(); i++) {
+                const auto& b = cancelledBatches_[i];
+                out += i ? ",{\"table\":" : "{\"table\":";
+                appendJsonString(out, b.table);
+                std::snprintf(number, sizeof(number), ",\"keys\":%zu,\"seconds\":%.6f}", b.keys, b.seconds);
+                out += number;
+            }
+            out += ']';
+        }
+        if(!serverCosts_.empty()) {
+            out += ",\"server_costs\":[";
+            for(std::size_t i = 0; i < serverCosts_.size(); i++) {
+                const auto& c = serverCosts_[i];
+                out += i ? ",{\"table\":" : "{\"table\":";
+                appendJsonString(out, c.table);
+                std::snprintf(number, sizeof(number), ",\"calls\":%llu,\"exec_seconds\":%.6f,\"shared_blks_hit\":%llu",
+                    static_cast<unsigned long long>(c.calls), c.execSeconds, static_cast<unsigned long long>(c.sharedHit));
+                out += number;
+                std::snprintf(number, sizeof(number), ",\"shared_blks_read\":%llu,\"temp_blks_read\":%llu,"
+                    "\"temp_blks_written\":%llu}", static_cast<unsigned long long>(c.sharedRead),
+                    static_cast<unsigned long long>(c.tempRead), static_cast<unsigned long long>(c.tempWritten));
+                out += number;
+            }
+            out += ']';
+        }
+        if(serverIo_) {
+            std::snprintf(number, sizeof(number), ",\"server_io\":{\"reads\":%llu,\"hits\":%llu,\"writes\":%llu}",
+                static_cast<unsigned long long>(serverIo_->reads), static_cast<unsigned long long>(serverIo_->hits),
+                static_cast<unsigned long long>(serverIo_->writes));
+            out += number;
+        }
+        return out += "}\n";
+    }
+
+private:
+    static double rate(const TableMetrics& t) {
+        return t.seconds > 0 ? static_cast<double>(t.rows) / t.seconds : 0;
+    }
+
+    static double mib(std::uint64_t bytes) { return static_cast<double>(bytes) / (1 << 20); }
+
+    mutable std::mutex mutex_;
+    std::vector<PhaseMetrics> phases_;
+    std::vector<TableMetrics> tables_;
+    std::optional<MemoryMetrics> memory_;
+    std::vector<SlowPlan> slowPlans_;
+    std::vector<CancelledBatch> cancelledBatches_;
+    std::vector<ServerCost> serverCosts_; // with --server-stats, costliest first
+    std::optional<ServerIo> serverIo_;
+};
+
+} // namespace subset
@@ -0,0 +1,386 @@
+#pragma once
+
+#include "http_client.hpp"
+#include "retry.hpp"
+#include "sink.hpp"
+#include "task_pool.hpp"
+#include "trace.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+// An error status of the object store. The throttling and the server errors
+// may pass by themselves; the others come back on every attempt.
+class ObjectStoreError final : public std::runtime_error {
+public:
+    ObjectStoreError(int status, const std::string& message) : std::runtime_error{message}, status_{status} {}
+
+    bool transient() const { return status_ == 429 || status_ >= 500; }
+
+private:
+    int status_;
+};
+
+// Where --upload puts the objects: s3://bucket/prefix, on the endpoint of
+// the region or on an S3-compatible one, addressed path-style.
+struct ObjectLocation {
+    HttpEndpoint endpoint;
+    std::string region;
+    std::string bucket;
+    std::string prefix; // empty or ending in a slash
+
+    static ObjectLocation parse(std::string_view url, const std::string& endpoint, const std::string& region) {
+        if(!url.starts_with("s3://")) throw std::invalid_argument{"--upload must be s3://bucket[/prefix]: " + std::string{url}};
+        url.remove_prefix(5);
+        ObjectLocation result;
+        const auto slash = url.find('/');
+        result.bucket = url.substr(0, slash);
+        if(slash != std::string_view::npos) result.prefix = url.substr(slash + 1);
+        if(!result.prefix.empty() && !result.prefix.ends_with('/')) result.prefix += '/';
+        if(result.bucket.empty()) throw std::invalid_argument{"--upload without a bucket"};
+        const char* envRegion = std::getenv("AWS_REGION");
+        result.region = !region.empty() ? region : envRegion && *envRegion ? envRegion : "us-east-1";
+        result.endpoint = HttpEndpoint::parse(endpoint.empty() ? "https://s3." + result.region + ".amazonaws.com" : endpoint);
+        return result;
+    }
+};
+
+inline std::string hexDigest(const unsigned char* data, std::size_t size) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string result;
+    result.reserve(size * 2);
+    for(std::size_t i = 0; i < size; i++) {
+        result += digits[data[i] >> 4];
+        result += digits[data[i] & 15];
+    }
+    return result;
+}
+
+inline std::string sha256Hex(std::string_view data) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned size = 0;
+    if(!EVP_Digest(data.data(), data.size(), digest, &size, EVP_sha256(), nullptr))
+        throw std::runtime_error{"SHA-256 failed"};
+    return hexDigest(digest, size);
+}
+
+inline std::string hmacSha256(std::string_view key, std::string_view data) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    std::size_t size = 0;
+    if(!EVP_Q_mac(nullptr, "HMAC", nullptr, "SHA256", nullptr, key.data(), key.size(),
+        reinterpret_cast<const unsigned char*>(data.data()), data.size(), digest, sizeof(digest), &size))
+#else
+    unsigned size = 0;
+    if(!HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()), reinterpret_cast<const unsigned char*>(data.data()),
+        data.size(), digest, &size))
+#endif
+        throw std::runtime_error{"HMAC-SHA256 failed"};
+    return std::string{reinterpret_cast<const char*>(digest), size};
+}
+
+// RFC 3986 escaping, as SigV4 canonicalizes; the slashes of a path stay.
+inline std::string uriEncode(std::string_view text, bool path) {
+    static constexpr char digits[] = "0123456789ABCDEF";
+    std::string result;
+    for(const unsigned char c : text) {
+        if(std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || (path && c == '/')) result += static_cast<char>(c);
+        else {
+            result += '%';
+            result += digits[c >> 4];
+            result += digits[c & 15];
+        }
+    }
+    return result;
+}
+
+// The text between <tag> and </tag> in xml, or an empty string.
+inline std::string xmlElement(std::string_view xml, std::string_view tag) {
+    const std::string open = '<' + std::string{tag} + '>';
+    const auto first = xml.find(open);
+    if(first == std::string_view::npos) return {};
+    const auto last = xml.find("</" + std::string{tag} + '>', first);
+    if(last == std::string_view::npos) return {};
+    return std::string{xml.substr(first + open.size(), last - first - open.size())};
+}
+
+// The bucket of --upload, with requests signed by AWS Signature Version 4
+// with the credentials of AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY and
+// AWS_SESSION_TOKEN. The requests are safe to make from several threads.
+// Like fsx::Output_directory keeps a manifest of the finished objects and
+// puts it last.
+class ObjectStore {
+public:
+    ObjectStore(ObjectLocation location, RetryPolicy retry) : location_{std::move(location)}, retry_{std::move(retry)} {
+        const auto env = [](const char* name) {
+            const char* value = std::getenv(name);
+            return value ? std::string{value} : std::string{};
+        };
+        accessKey_ = env("AWS_ACCESS_KEY_ID");
+        secretKey_ = env("AWS_SECRET_ACCESS_KEY");
+        sessionToken_ = env("AWS_SESSION_TOKEN");
+        if(accessKey_.empty() || secretKey_.empty())
+            throw std::runtime_error{"--upload needs AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY"};
+    }
+
+    ObjectStore(const ObjectStore&) = delete;
+    ObjectStore& operator=(const ObjectStore&) = delete;
+
+    // Runs f again while it fails transiently, as the retry policy allows.
+    template<typename F>
+    auto withRetries(F&& f) const {
+        for(unsigned attempt = 1;; attempt++) {
+            std::string error;
+            try {
+                return f();
+            } catch(const ObjectStoreError& e) {
+                if(!e.transient() || attempt > retry_.attempts) throw;
+                error = e.what();
+            } catch(const HttpError& e) {
+                if(attempt > retry_.attempts) throw;
+                error = e.what();
+            }
+            const auto delay = retry_.delay(attempt);
+            if(retry_.onRetry) retry_.onRetry(error, attempt, delay);
+            std::this_thread::sleep_for(delay);
+        }
+    }
+
+    void put(const std::string& name, std::string_view body) {
+        request("PUT", name, {}, body);
+        recordSize(name, body.size());
+    }
+
+    // Returns the id of a new multipart upload of the object name.
+    std::string createUpload(const std::string& name) {
+        const auto response = request("POST", name, {{"uploads", ""}}, {});
+        auto id = xmlElement(response.body, "UploadId");
+        if(id.empty()) throw ObjectStoreError{response.status, "no upload id for " + name + ": " + response.body};
+        return id;
+    }
+
+    // Returns the ETag of the part, numbered from 1.
+    std::string uploadPart(const std::string& name, const std::string& id, std::size_t number, std::string_view body) {
+        const auto response = request("PUT", name, {{"partNumber", std::to_string(number)}, {"uploadId", id}}, body);
+        auto etag = response.header("etag");
+        if(etag.empty()) throw ObjectStoreError{response.status, "no ETag for part " + std::to_string(number) + " of " + name};
+        return etag;
+    }
+
+    void completeUpload(const std::string& name, const std::string& id, const std::vector<std::string>& etags,
+        std::uint64_t size) {
+        std::string body = "<CompleteMultipartUpload>";
+        for(std::size_t i = 0; i < etags.size(); i++)
+            body += "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber><ETag>" + etags[i] + "</ETag></Part>";
+        body += "</CompleteMultipartUpload>";
+        // An error may come after the 200 status, in the body.
+        const auto response = request("POST", name, {{"uploadId", id}}, body);
+        if(!xmlElement(response.body, "Code").empty())
+            throw ObjectStoreError{500, "cannot complete the upload of " + name + ": " + response.body};
+        recordSize(name, size);
+    }
+
+    void abortUpload(const std::string& name, const std::string& id) {
+        request("DELETE", name, {{"uploadId", id}}, {});
+    }
+
+    // Records the object name in the manifest with the CRC-32C checksum of
+    // its content and its number of rows.
+    void finish(const std::string& name, std::uint32_t checksum, std::uint64_t rows) {
+        char hex[9];
+        std::snprintf(hex, sizeof(hex), "%08x", static_cast<unsigned>(checksum));
+        const std::lock_guard lock{mutex_};
+        objects_[name].second = std::string{"\tcrc32c:"} + hex + '\t' + std::to_string(rows);
+    }
+
+    // Puts the manifest of the finished objects, in the format of
+    // fsx::Output_directory's.
+    void close(const std::string& name = "MANIFEST") {
+        std::string content;
+        {
+            const std::lock_guard lock{mutex_};
+            for(const auto& [object, entry] : objects_) content += object + '\t' + std::to_string(entry.first) + entry.second + '\n';
+        }
+        withRetries([&] {
+            request("PUT", name, {}, content);
+            return 0;
+        });
+    }
+
+private:
+    void recordSize(const std::string& name, std::uint64_t size) {
+        const std::lock_guard lock{mutex_};
+        objects_[name].first = size;
+    }
+
+    // Sends a signed request for the object name, throwing on an error status.
+    HttpResponse request(std::string_view method, const std::string& name,
+        const std::vector<std::pair<std::string, std::string>>& query, std::string_view body) {
+        const TraceSpan span{"upload", method, name};
+        const std::string path = "/" + location_.bucket + '/' + uriEncode(location_.prefix + name, true);
+        std::map<std::string, std::string> sorted;
+        for(const auto& [key, value] : query) sorted[uriEncode(key, false)] = uriEncode(value, false);
+        std::string canonicalQuery;
+        for(const auto& [key, value] : sorted) canonicalQuery += (canonicalQuery.empty() ? "" : "&") + key + '=' + value;
+
+        const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+        std::tm utc{};
+        ::gmtime_r(&now, &utc);
+        char stamp[17];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", &utc);
+        const std::string date = std::string{stamp, 8};
+        const std::string payloadHash = sha256Hex(body);
+
+        std::vector<std::pair<std::string, std::string>> headers{
+            {"x-amz-content-sha256", payloadHash}, {"x-amz-date", stamp}};
+        if(!sessionToken_.empty()) headers.emplace_back("x-amz-security-token", sessionToken_);
+        std::string canonicalHeaders = "host:" + location_.endpoint.hostHeader() + '\n';
+        std::string signedHeaders = "host";
+        for(const auto& [header, value] : headers) {
+            canonicalHeaders += header + ':' + value + '\n';
+            signedHeaders += ';' + header;
+        }
+        const std::string canonical = std::string{method} + '\n' + path + '\n' + canonicalQuery + '\n' + canonicalHeaders +
+            '\n' + signedHeaders + '\n' + payloadHash;
+        const std::string scope = date + '/' + location_.region + "/s3/aws4_request";
+        const std::string toSign = "AWS4-HMAC-SHA256\n" + std::string{stamp} + '\n' + scope + '\n' + sha256Hex(canonical);
+        std::string key = hmacSha256("AWS4" + secretKey_, date);
+        key = hmacSha256(key, location_.region);
+        key = hmacSha256(key, "s3");
+        key = hmacSha256(key, "aws4_request");
+        const auto signature = hmacSha256(key, toSign);
+        headers.emplace_back("Authorization", "AWS4-HMAC-SHA256 Credential=" + accessKey_ + '/' + scope + ", SignedHeaders=" +
+            signedHeaders + ", Signature=" + hexDigest(reinterpret_cast<const unsigned char*>(signature.data()), signature.size()));
+
+        auto response = httpRequest(location_.endpoint, method, path + (canonicalQuery.empty() ? "" : '?' + canonicalQuery),
+            headers, body);
+        if(response.status < 200 || response.status >= 300) {
+            const auto code = xmlElement(response.body, "Code");
+            throw ObjectStoreError{response.status, std::string{method} + ' ' + location_.prefix + name + ": HTTP " +
+                std::to_string(response.status) + (code.empty() ? "" : ' ' + code)};
+        }
+        return response;
+    }
+
+    ObjectLocation location_;
+    RetryPolicy retry_;
+    std::string accessKey_;
+    std::string secretKey_;
+    std::string sessionToken_;
+    std::mutex mutex_;
+    std::map<std::string, std::pair<std::uint64_t, std::string>> objects_;
+};
+
+// An output file uploaded to the object store as it's written: the data is
+// cut into parts of at least partSize bytes which are uploaded on the pool,
+// each retried on its own, as parts of a multipart upload. The part size
+// doubles every partsPerSize parts, up to the store's largest, so that an
+// object isn't bounded by the store's count of parts times partSize. write() only
+// waits once maxInFlight parts are still uploading, which bounds the memory
+// to that many parts. An object which ends before its first part is put
+// whole; one destroyed without close() has its upload aborted.
+class ObjectStoreSink final : public Sink {
+public:
+    ObjectStoreSink(ObjectStore& store, std::string name, TaskPool& pool, std::size_t partSize, std::size_t maxInFlight = 4)
+        : store_{store}, name_{std::move(name)}, pool_{pool}, partSize_{partSize},
+          maxInFlight_{std::max<std::size_t>(maxInFlight, 1)} {
+        part_.reserve(partSize_);
+    }
+
+    ObjectStoreSink(const ObjectStoreSink&) = delete;
+    ObjectStoreSink& operator=(const ObjectStoreSink&) = delete;
+
+    ~ObjectStoreSink() override {
+        for(auto& etag : inFlight_) etag.wait();
+        if(!uploadId_.empty() && !closed_) {
+            try {
+                store_.abortUpload(name_, uploadId_);
+            } catch(...) {}
+        }
+    }
+
+    void write(std::string_view data) override {
+        part_.append(data);
+        size_ += data.size();
+        if(part_.size() >= partSize()) submit();
+    }
+
+    void close() override {
+        if(uploadId_.empty()) {
+            store_.withRetries([&] {
+                store_.put(name_, part_);
+                return 0;
+            });
+        } else {
+            if(!part_.empty()) submit();
+            while(!inFlight_.empty()) drain();
+            store_.withRetries([&] {
+                store_.completeUpload(name_, uploadId_, etags_, size_);
+                return 0;
+            });
+        }
+        closed_ = true;
+    }
+
+private:
+    void submit() {
+        if(uploadId_.empty()) uploadId_ = store_.withRetries([&] { return store_.createUpload(name_); });
+        if(inFlight_.size() >= maxInFlight_) drain();
+        const std::size_t number = etags_.size() + inFlight_.size() + 1;
+        inFlight_.push_back(pool_.submit([&store = store_, name = name_, id = uploadId_, number, part = std::move(part_)] {
+            return store.withRetries([&] { return store.uploadPart(name, id, number, part); });
+        }));
+        part_ = std::string{};
+        part_.reserve(partSize());
+    }
+
+    // The size of the part numbered next.
+    std::size_t partSize() const {
+        static constexpr std::size_t partsPerSize = 1000;
+        static constexpr std::size_t largest = std::size_t{5} << 30;
+        const std::size_t doublings = (etags_.size() + inFlight_.size()) / partsPerSize;
+        return doublings >= 10 ? largest : std::min(partSize_ << doublings, largest);
+    }
+
+    void drain() {
+        const TraceSpan span{"upload", "part wait"};
+        etags_.push_back(inFlight_.front().get());
+        inFlight_.pop_front();
+    }
+
+    ObjectStore& store_;
+    std::string name_;
+    TaskPool& pool_;
+    std::size_t partSize_;
+    std::size_t maxInFlight_;
+    std::string part_;
+    std::uint64_t size_ = 0;
+    std::string uploadId_;
+    std::vector<std::string> etags_;
+    std::deque<std::future<std::string>> inFlight_;
+    bool closed_ = false;
+};
+
+} // namespace subset
@@ -0,0 +1,643 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+enum class Introspection { catalog, informationSchema };
+enum class Traversal { all, dependents };
+enum class CopyFormat { csv, binary };
+enum class Extraction { copy, prepared, cursor };
+enum class Load { copy, insert, staging, freeze };
+enum class Unlogged { off, load, keep };
+enum class Finalize { off, analyze, vacuum };
+enum class OnConflict { nothing, update };
+enum class Closure { client, server };
+enum class SemiJoin { server, adaptive };
+enum class Parents { all, referenced };
+enum class Schedule { ready, criticalPath };
+enum class FkIndexes { off, report, create };
+enum class Compression { none, gzip };
+enum class OutputFormat { csv, parquet };
+enum class Writer { sync, async };
+enum class LogLevel { debug, info, warn, error, off };
+enum class Mask { hash, email, digits, name, null };
+
+// A column masked on its way out, by --mask=table.column:function.
+struct MaskRule {
+    std::string table;
+    std::string column;
+    Mask function;
+};
+
+// At most limit rows of table per key of its foreign key column, the first
+// in order, by --fanout-limit=table.column:limit[:order].
+struct FanoutLimit {
+    std::string table;
+    std::string column;
+    std::size_t limit;
+    std::string order; // empty: in the order of the rows on disk
+};
+
+// A source database of --sources, one of several of the same schema.
+struct SourceEndpoint {
+    std::string host;
+    std::optional<std::int_fast32_t> port; // empty: the default
+    std::string database;
+};
+
+struct Options {
+    std::string rootTable;
+    std::string rootId;
+    std::filesystem::path seeds; // a file of root ids, one per line; "-" reads stdin
+    std::string seedWhere;  // a predicate on the root table selecting the seeds
+    std::string samplePercent; // empty: no sampling; otherwise the seeds are a TABLESAMPLE SYSTEM of the root
+    std::vector<std::string> sampleTables; // further tables sampled at the same rate
+    std::uint64_t sampleSeed = 0; // REPEATABLE seed, so every statement sees the same sample
+    std::vector<std::pair<std::string, std::string>> tableFilters; // table and predicate, by --table-where=table:predicate
+    std::vector<FanoutLimit> fanoutLimits;
+    std::string schema = "public";
+    Introspection introspection = Introspection::catalog;
+    Traversal traversal = Traversal::all; // the tables reached expanded both ways, or only the root's dependents with their supporters
+    std::size_t maxDepth = 0; // dependent hops from the root discovery follows; 0: no limit
+    std::vector<std::string> excludedTables; // never discovered, by --exclude-table=table[,table...]
+    std::vector<std::pair<std::string, std::string>> excludedEdges; // child and parent, by --exclude-edge=child:parent
+    std::string graphCache; // empty: no on-disk graph cache
+    std::size_t jobs = 4;   // extraction connections
+    Schedule schedule = Schedule::criticalPath; // which ready table starts first: any, or the head of the heaviest estimated chain
+    FkIndexes fkIndexes = FkIndexes::report; // the followed foreign keys without a source index: ignored, logged, or indexed for the run
+    std::filesystem::path outputDir = "."; // one <table>.csv per table
+    std::vector<SourceEndpoint> sources; // identically shaped source shards read into one target; empty: the one source
+    std::size_t sourceJobs = 0; // shards of --sources extracted at once; 0: all
+    bool disjointKeys = false; // the shards' primary keys don't overlap, so --pipe may merge them into one target
+    bool pipe = false;      // COPY straight into the target instead of files
+    bool directSsl = false; // sslnegotiation=direct (PostgreSQL 17), a round trip less per SSL handshake
+    CopyFormat copyFormat = CopyFormat::csv;
+    std::size_t inlineKeys = 1000; // larger key sets go through temp tables
+    std::size_t keyMemory = 0; // MiB the key sets may hold before spilling to disk; 0: no limit
+    std::filesystem::path spillDir; // empty: the system temp directory
+    Extraction extract = Extraction::copy;
+    std::size_t batchSize = 10000; // keys of the first execution of a prepared extraction, rows of a cursor's first fetch
+    std::size_t batchLatency = 200; // ms a prepared batch or a fetch is sized to take; 0: batches stay at --batch-size
+    std::size_t batchTimeout = 0; // ms past which a prepared batch is cancelled and run again in halves; 0: never
+    std::size_t explainSlow = 0; // ms past which a table's first slow batch is explained into --metrics; 0: none
+    bool serverStats = false; // what the tables' statements cost the server, from pg_stat_statements, in the summary
+    std::size_t bufferSize = 1 << 20; // bytes buffered per table sink
+    std::size_t splitSize = 0; // MiB from which a table is read in --jobs ctid ranges at once; 0: never
+    bool snapshot = true;   // read every table as of one exported snapshot
+    Load load = Load::copy; // how --pipe writes into the target
+    std::size_t pipelineDepth = 4; // --buffer-size chunks in flight to a --pipe target's own thread; 0: loaded inline
+    std::size_t loadStreams = 1; // COPY streams loading one --pipe table at once, a --buffer-size chunk of rows to each in turn
+    bool cloneSchema = false; // create the discovered tables the target lacks, with their types, sequences and functions
+    bool deferIndexes = false; // drop the target's indexes and foreign keys for the load and build them after it
+    Unlogged unlogged = Unlogged::off; // the target tables are unlogged for the load (load), or from it on (keep)
+    Finalize finalize = Finalize::analyze; // after a --pipe load: the sequences advanced and the tables analyzed, or vacuumed too
+    std::size_t maintenanceWorkers = 0; // max_parallel_maintenance_workers of the index builds; 0: the server's
+    std::size_t insertRows = 1000; // rows per INSERT statement with --load=insert
+    OnConflict onConflict = OnConflict::nothing; // for rows --load=staging finds in the target
+    bool skipExisting = false; // the rows whose primary key is in the target already aren't sent to it
+    bool compare = false;   // only the chunks of the primary key where the target differs from the subset are sent to it
+    std::filesystem::path rejects; // empty: a load fails on a bad row; otherwise the rows the target refuses go here
+    std::size_t rejectBatch = 10000; // rows per COPY, bisected on failure, with --rejects
+    std::size_t governorLag = 0; // ms of standby replay lag past which the extraction slows down; 0: not watched
+    std::size_t governorBackends = 0; // active backends of the source past which it slows down; 0: not watched
+    std::size_t governorLatency = 0; // ms a batch may take before it slows down; 0: not watched
+    std::size_t governorReadRate = 0; // MiB/s of the source's disk reads past which it slows down; 0: not watched
+    std::size_t governorInterval = 1000; // ms between the governor's samples of the source
+    // Attempts more at a table failing on a broken connection, a serialization
+    // failure or a deadlock, each extracting the whole table again rather than
+    // the batch which failed; 0: none.
+    std::size_t retries = 3;
+    std::size_t retryBackoff = 500; // ms before the first retry, doubling up to 30 s
+    std::vector<MaskRule> masks; // columns masked before they reach the output or the target
+    std::string maskKeyEnv; // variable holding the secret the masks are keyed with, kept off the command line
+    std::size_t maskThreads = 2; // threads masking the rows of the tables with masked columns
+    std::filesystem::path checkpoint; // empty: no checkpointing
+    bool resume = false;    // skip the tables the checkpoint has finished
+    std::filesystem::path incremental; // empty: full extraction every run
+    std::filesystem::path cache; // empty: no cache of the extractions of earlier runs
+    Closure closure = Closure::client; // where keys are propagated between tables
+    SemiJoin semiJoin = SemiJoin::server; // a child's rows filtered on the keys by the server, or per link by the cheaper side
+    Parents parents = Parents::all; // the tables the root doesn't reach: read whole, or only the rows the subset references
+    Compression compress = Compression::none; // codec of the output files
+    std::size_t compressLevel = 6;
+    std::size_t compressThreads = 2;
+    std::string encryptKeyEnv; // variable holding the AES-256 key the output files are encrypted with; empty: not encrypted
+    std::size_t encryptThreads = 2;
+    std::vector<unsigned> pinCpus; // cores the threads are pinned to, the --jobs workers' first; empty: not pinned
+    OutputFormat format = OutputFormat::csv; // of the output files
+    std::size_t rowGroupRows = 100000; // rows per Parquet row group
+    std::size_t shardSize = 0; // MiB of rows per output file, table.00000.csv on; 0: one file per table
+    Writer writer = Writer::async; // how output files are written
+    std::size_t syncThreads = 0; // threads fsyncing the finished output files while others are written; 0: no fsync
+    std::string upload;     // s3://bucket[/prefix]: the output files are uploaded there as they're written, not kept locally
+    std::string s3Endpoint; // empty: https://s3.<region>.amazonaws.com; otherwise an S3-compatible http[s]://host[:port]
+    std::string s3Region;   // empty: $AWS_REGION, or us-east-1
+    std::size_t uploadPartSize = 8; // MiB per part of a multipart upload, at least 5
+    std::size_t uploadThreads = 4; // threads uploading the parts of all the files
+    std::filesystem::path metrics; // empty: summary on stdout only
+    std::filesystem::path trace; // empty: no Chrome Trace Event JSON of the run's spans
+    std::filesystem::path profile; // empty: none; otherwise the run's shape, which --replay builds again
+    std::filesystem::path replay; // empty: none; otherwise a --profile built as a dataset in --schema of the source and run in its order
+    bool replayRebuild = false; // drop the tables of --replay and build them again, instead of reusing the ones built before
+    bool plan = false;      // estimate the subset from the statistics instead of extracting it
+    bool keyPass = false;   // compute the closure from the key columns before reading the rows
+    std::filesystem::path daemon; // empty: run one job; otherwise serve jobs on this Unix socket
+    std::string metricsListen; // host:port of the daemon's Prometheus /metrics; empty: none
+    std::size_t memoryCache = 0; // MiB of extractions a daemon keeps in memory for its next jobs; 0: none
+    std::size_t noticeRate = 0; // server notices printed a second at most, off the connections' threads; 0: all, inline
+    LogLevel logLevel = LogLevel::info; // debug adds the dependency edges and every query
+    bool sync = false;      // after the load keep the target up to date from a logical replication slot
+    std::string syncSlot = "subset_sync"; // the slot --sync creates, decoding with wal2json
+    std::size_t syncInterval = 1000; // ms --sync waits when there are no changes
+    std::size_t syncBatch = 10000; // changes per target transaction of --sync
+};
+
+// Options which take no value.
+inline bool isFlag(std::string_view name) {
+    return name == "pipe" || name == "snapshot" || name == "resume" || name == "plan" || name == "key-pass" ||
+        name == "sync" || name == "defer-indexes" || name == "clone-schema" || name == "direct-ssl" ||
+        name == "skip-existing" || name == "compare" || name == "server-stats" || name == "disjoint-keys" ||
+        name == "replay-rebuild";
+}
+
+inline std::size_t parseCount(const std::string& name, const std::string& value) {
+    std::size_t pos = 0;
+    unsigned long result = 0;
+    try {
+        result = std::stoul(value, &pos);
+    } catch(const std::exception&) {
+        pos = 0;
+    }
+    if(pos == 0 || pos != value.size() || result == 0)
+        throw std::invalid_argument{"invalid --" + name + ": " + value};
+    return result;
+}
+
+// A count which may be 0, where 0 turns something off.
+inline std::uint64_t parseNumber(const std::string& name, const std::string& value) {
+    std::size_t pos = 0;
+    unsigned long long result = 0;
+    try {
+        if(!value.empty() && value[0] >= '0' && value[0] <= '9') result = std::stoull(value, &pos);
+    } catch(const std::exception&) {
+        pos = 0;
+    }
+    if(pos == 0 || pos != value.size()) throw std::invalid_argument{"invalid --" + name + ": " + value};
+    return result;
+}
+
+// A list of cores and ranges of them: 0-7,16-23.
+inline std::vector<unsigned> parseCpus(const std::string& name, const std::string& value) {
+    std::vector<unsigned> result;
+    const auto number = [&](const std::string& text) {
+        std::size_t pos = 0;
+        unsigned long n = 0;
+        try {
+            n = std::stoul(text, &pos);
+        } catch(const std::exception&) {
+            pos = 0;
+        }
+        if(pos == 0 || pos != text.size() || n > 4095) throw std::invalid_argument{"invalid --" + name + ": " + value};
+        return static_cast<unsigned>(n);
+    };
+    for(std::size_t first = 0; first <= value.size();) {
+        const auto comma = std::min(value.find(',', first), value.size());
+        const std::string item = value.substr(first, comma - first);
+        const auto dash = item.find('-');
+        const unsigned low = number(item.substr(0, dash));
+        const unsigned high = dash == std::string::npos ? low : number(item.substr(dash + 1));
+        if(high < low) throw std::invalid_argument{"invalid --" + name + ": " + value};
+        for(unsigned cpu = low; cpu <= high; cpu++) result.push_back(cpu);
+        first = comma + 1;
+    }
+    return result;
+}
+
+// host[:port]/database, comma separated.
+inline std::vector<SourceEndpoint> parseSources(const std::string& name, const std::string& value) {
+    std::vector<SourceEndpoint> result;
+    for(std::size_t first = 0; first <= value.size();) {
+        const auto comma = std::min(value.find(',', first), value.size());
+        const std::string item = value.substr(first, comma - first);
+        const auto slash = item.find('/');
+        const auto colon = item.rfind(':', slash);
+        if(slash == 0 || slash == std::string::npos || slash + 1 == item.size())
+            throw std::invalid_argument{"--" + name + " must be host[:port]/database,...: " + value};
+        SourceEndpoint& source = result.emplace_back();
+        source.database = item.substr(slash + 1);
+        if(colon != std::string::npos && colon < slash) {
+            source.host = item.substr(0, colon);
+            source.port = static_cast<std::int_fast32_t>(parseCount(name, item.substr(colon + 1, slash - colon - 1)));
+            if(source.host.empty() || *source.port == 0 || *source.port > 65535)
+                throw std::invalid_argument{"--" + name + " must be host[:port]/database,...: " + value};
+        } else source.host = item.substr(0, slash);
+        first = comma + 1;
+    }
+    return result;
+}
+
+inline bool parseFlag(const std::string& name, const std::string& value) {
+    if(value == "true") return true;
+    else if(value == "false") return false;
+    throw std::invalid_argument{"invalid --" + name + ": " + value};
+}
+
+// Usage: cpp_schema <root_table> [<root_id> | --seeds <file> | --seed-where <predicate> | --sample <percent>]
+//     [--name=value | --name value]...
+inline Options parseOptions(int argc, char** argv) {
+    Options options;
+    std::vector<std::string> positionals;
+    for(int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if(arg.substr(0, 2) != "--") {
+            positionals.emplace_back(arg);
+            continue;
+        }
+        arg.remove_prefix(2);
+        std::string name;
+        std::string value;
+        if(const auto eq = arg.find('='); eq != std::string_view::npos) {
+            name = arg.substr(0, eq);
+            value = arg.substr(eq + 1);
+        } else {
+            name = arg;
+            if(isFlag(name)) value = "true";
+            else if(i + 1 < argc) value = argv[++i];
+            else throw std::invalid_argument{"missing value for --" + name};
+        }
+
+        if(name == "schema") options.schema = value;
+        else if(name == "graph-cache") options.graphCache = value;
+        else if(name == "output-dir") options.outputDir = value;
+        else if(name == "sources") options.sources = parseSources(name, value);
+        else if(name == "disjoint-keys") options.disjointKeys = parseFlag(name, value);
+        else if(name == "source-jobs") options.sourceJobs = parseCount(name, value);
+        else if(name == "jobs") options.jobs = parseCount(name, value);
+        else if(name == "inline-keys") options.inlineKeys = parseCount(name, value);
+        else if(name == "key-memory") options.keyMemory = parseCount(name, value);
+        else if(name == "spill-dir") options.spillDir = value;
+        else if(name == "daemon") options.daemon = value;
+        else if(name == "metrics-listen") options.metricsListen = value;
+        else if(name == "memory-cache") options.memoryCache = parseCount(name, value);
+        else if(name == "notice-rate") options.noticeRate = parseCount(name, value);
+        else if(name == "pipe") options.pipe = parseFlag(name, value);
+        else if(name == "snapshot") options.snapshot = parseFlag(name, value);
+        else if(name == "batch-size") options.batchSize = parseCount(name, value);
+        else if(name == "batch-latency") options.batchLatency = parseNumber(name, value);
+        else if(name == "batch-timeout") options.batchTimeout = parseCount(name, value);
+        else if(name == "explain-slow") options.explainSlow = parseCount(name, value);
+        else if(name == "server-stats") options.serverStats = parseFlag(name, value);
+        else if(name == "checkpoint") options.checkpoint = value;
+        else if(name == "seeds") options.seeds = value;
+        else if(name == "seed-where") options.seedWhere = value;
+        else if(name == "sample") {
+            std::size_t pos = 0;
+            double percent = 0;
+            try {
+                percent = std::stod(value, &pos);
+            } catch(const std::exception&) {
+                pos = 0;
+            }
+            if(pos == 0 || pos != value.size() || !(percent > 0 && percent <= 100))
+                throw std::invalid_argument{"--sample must be a percentage in (0, 100]: " + value};
+            options.samplePercent = value;
+        } else if(name == "sample-tables") {
+            for(std::size_t first = 0; first <= value.size();) {
+                const auto comma = std::min(value.find(',', first), value.size());
+                if(comma > first) options.sampleTables.push_back(value.substr(first, comma - first));
+                first = comma + 1;
+            }
+        } else if(name == "exclude-table") {
+            for(std::size_t first = 0; first <= value.size();) {
+                const auto comma = std::min(value.find(',', first), value.size());
+                if(comma > first) options.excludedTables.push_back(value.substr(first, comma - first));
+                first = comma + 1;
+            }
+        } else if(name == "exclude-edge") {
+            const auto colon = value.find(':');
+            if(colon == 0 || colon == std::string::npos || colon + 1 == value.size())
+                throw std::invalid_argument{"--exclude-edge must be child:parent: " + value};
+            options.excludedEdges.emplace_back(value.substr(0, colon), value.substr(colon + 1));
+        } else if(name == "traversal") {
+            if(value == "all") options.traversal = Traversal::all;
+            else if(value == "dependents") options.traversal = Traversal::dependents;
+            else throw std::invalid_argument{"invalid --traversal: " + value};
+        } else if(name == "max-depth") options.maxDepth = parseCount(name, value);
+        else if(name == "table-where") {
+            const auto colon = value.find(':');
+            if(colon == 0 || colon == std::string::npos || colon + 1 == value.size())
+                throw std::invalid_argument{"--table-where must be table:predicate: " + value};
+            options.tableFilters.emplace_back(value.substr(0, colon), value.substr(colon + 1));
+        } else if(name == "fanout-limit") {
+            const auto dot = value.find('.');
+            const auto colon = value.find(':');
+            const auto order = colon == std::string::npos ? colon : value.find(':', colon + 1);
+            if(dot == 0 || dot == std::string::npos || colon == std::string::npos || colon < dot + 2)
+                throw std::invalid_argument{"--fanout-limit must be table.column:limit[:order]: " + value};
+            options.fanoutLimits.push_back({value.substr(0, dot), value.substr(dot + 1, colon - dot - 1),
+                parseCount(name, value.substr(colon + 1, order == std::string::npos ? order : order - colon - 1)),
+                order == std::string::npos ? "" : value.substr(order + 1)});
+        } else if(name == "sample-seed") options.sampleSeed = parseNumber(name, value);
+        else if(name == "incremental") options.incremental = value;
+        else if(name == "cache") options.cache = value;
+        else if(name == "resume") options.resume = parseFlag(name, value);
+        else if(name == "insert-rows") options.insertRows = parseCount(name, value);
+        else if(name == "compress-level") {
+            options.compressLevel = parseCount(name, value);
+            if(options.compressLevel > 9) throw std::invalid_argument{"--compress-level must be 1 to 9"};
+        } else if(name == "compress-threads") options.compressThreads = parseCount(name, value);
+        else if(name == "encrypt-key-env") options.encryptKeyEnv = value;
+        else if(name == "encrypt-threads") options.encryptThreads = parseCount(name, value);
+        else if(name == "pin-cpus") options.pinCpus = parseCpus(name, value);
+        else if(name == "sync-threads") options.syncThreads = parseCount(name, value);
+        else if(name == "upload") options.upload = value;
+        else if(name == "s3-endpoint") options.s3Endpoint = value;
+        else if(name == "s3-region") options.s3Region = value;
+        else if(name == "upload-part-size") options.uploadPartSize = parseCount(name, value);
+        else if(name == "shard-size") options.shardSize = parseCount(name, value);
+        else if(name == "upload-threads") options.uploadThreads = parseCount(name, value);
+        else if(name == "row-group-rows") options.rowGroupRows = parseCount(name, value);
+        else if(name == "metrics") options.metrics = value;
+        else if(name == "trace") options.trace = value;
+        else if(name == "profile") options.profile = value;
+        else if(name == "replay") options.replay = value;
+        else if(name == "replay-rebuild") options.replayRebuild = parseFlag(name, value);
+        else if(name == "plan") options.plan = parseFlag(name, value);
+        else if(name == "key-pass") options.keyPass = parseFlag(name, value);
+        else if(name == "sync") options.sync = parseFlag(name, value);
+        else if(name == "defer-indexes") options.deferIndexes = parseFlag(name, value);
+        else if(name == "clone-schema") options.cloneSchema = parseFlag(name, value);
+        else if(name == "direct-ssl") options.directSsl = parseFlag(name, value);
+        else if(name == "skip-existing") options.skipExisting = parseFlag(name, value);
+        else if(name == "compare") options.compare = parseFlag(name, value);
+        else if(name == "rejects") options.rejects = value;
+        else if(name == "reject-batch") options.rejectBatch = parseCount(name, value);
+        else if(name == "governor-lag") options.governorLag = parseCount(name, value);
+        else if(name == "governor-backends") options.governorBackends = parseCount(name, value);
+        else if(name == "governor-latency") options.governorLatency = parseCount(name, value);
+        else if(name == "governor-read-rate") options.governorReadRate = parseCount(name, value);
+        else if(name == "governor-interval") options.governorInterval = parseCount(name, value);
+        else if(name == "retries") options.retries = parseNumber(name, value);
+        else if(name == "retry-backoff") options.retryBackoff = parseCount(name, value);
+        else if(name == "mask") {
+            for(std::size_t first = 0; first <= value.size();) {
+                const auto comma = std::min(value.find(',', first), value.size());
+                const std::string rule = value.substr(first, comma - first);
+                first = comma + 1;
+                if(rule.empty()) continue;
+                const auto dot = rule.find('.');
+                const auto colon = rule.rfind(':');
+                if(dot == 0 || dot == std::string::npos || colon == std::string::npos || colon < dot + 2)
+                    throw std::invalid_argument{"--mask must be table.column:function: " + rule};
+                const std::string function = rule.substr(colon + 1);
+                Mask mask;
+                if(function == "hash") mask = Mask::hash;
+                else if(function == "email") mask = Mask::email;
+                else if(function == "digits") mask = Mask::digits;
+                else if(function == "name") mask = Mask::name;
+                else if(function == "null") mask = Mask::null;
+                else throw std::invalid_argument{"invalid --mask function: " + function};
+                options.masks.push_back({rule.substr(0, dot), rule.substr(dot + 1, colon - dot - 1), mask});
+            }
+        } else if(name == "mask-key-env") options.maskKeyEnv = value;
+        else if(name == "mask-threads") options.maskThreads = parseCount(name, value);
+        else if(name == "sync-slot") options.syncSlot = value;
+        else if(name == "sync-interval") options.syncInterval = parseCount(name, value);
+        else if(name == "sync-batch") options.syncBatch = parseCount(name, value);
+        else if(name == "writer") {
+            if(value == "sync") options.writer = Writer::sync;
+            else if(value == "async") options.writer = Writer::async;
+            else throw std::invalid_argument{"invalid --writer: " + value};
+        } else if(name == "log-level") {
+            if(value == "debug") options.logLevel = LogLevel::debug;
+            else if(value == "info") options.logLevel = LogLevel::info;
+            else if(value == "warn") options.logLevel = LogLevel::warn;
+            else if(value == "error") options.logLevel = LogLevel::error;
+            else if(value == "off") options.logLevel = LogLevel::off;
+            else throw std::invalid_argument{"invalid --log-level: " + value};
+        } else if(name == "format") {
+            if(value == "csv") options.format = OutputFormat::csv;
+            else if(value == "parquet") options.format = OutputFormat::parquet;
+            else throw std::invalid_argument{"invalid --format: " + value};
+        } else if(name == "compress") {
+            if(value == "none") options.compress = Compression::none;
+            else if(value == "gzip") options.compress = Compression::gzip;
+            else throw std::invalid_argument{"invalid --compress: " + value};
+        } else if(name == "closure") {
+            if(value == "client") options.closure = Closure::client;
+            else if(value == "server") options.closure = Closure::server;
+            else throw std::invalid_argument{"invalid --closure: " + value};
+        } else if(name == "semi-join") {
+            if(value == "server") options.semiJoin = SemiJoin::server;
+            else if(value == "adaptive") options.semiJoin = SemiJoin::adaptive;
+            else throw std::invalid_argument{"invalid --semi-join: " + value};
+        } else if(name == "parents") {
+            if(value == "all") options.parents = Parents::all;
+            else if(value == "referenced") options.parents = Parents::referenced;
+            else throw std::invalid_argument{"invalid --parents: " + value};
+        } else if(name == "schedule") {
+            if(value == "ready") options.schedule = Schedule::ready;
+            else if(value == "critical-path") options.schedule = Schedule::criticalPath;
+            else throw std::invalid_argument{"invalid --schedule: " + value};
+        } else if(name == "fk-indexes") {
+            if(value == "off") options.fkIndexes = FkIndexes::off;
+            else if(value == "report") options.fkIndexes = FkIndexes::report;
+            else if(value == "create") options.fkIndexes = FkIndexes::create;
+            else throw std::invalid_argument{"invalid --fk-indexes: " + value};
+        } else if(name == "load") {
+            if(value == "copy") options.load = Load::copy;
+            else if(value == "insert") options.load = Load::insert;
+            else if(value == "staging") options.load = Load::staging;
+            else if(value == "freeze") options.load = Load::freeze;
+            else throw std::invalid_argument{"invalid --load: " + value};
+        } else if(name == "unlogged") {
+            if(value == "off") options.unlogged = Unlogged::off;
+            else if(value == "load") options.unlogged = Unlogged::load;
+            else if(value == "keep") options.unlogged = Unlogged::keep;
+            else throw std::invalid_argument{"invalid --unlogged: " + value};
+        } else if(name == "finalize") {
+            if(value == "off") options.finalize = Finalize::off;
+            else if(value == "analyze") options.finalize = Finalize::analyze;
+            else if(value == "vacuum") options.finalize = Finalize::vacuum;
+            else throw std::invalid_argument{"invalid --finalize: " + value};
+        } else if(name == "on-conflict") {
+            if(value == "nothing") options.onConflict = OnConflict::nothing;
+            else if(value == "update") options.onConflict = OnConflict::update;
+            else throw std::invalid_argument{"invalid --on-conflict: " + value};
+        } else if(name == "buffer-size") options.bufferSize = parseCount(name, value);
+        else if(name == "split-size") options.splitSize = parseCount(name, value);
+        else if(name == "pipeline-depth") options.pipelineDepth = parseNumber(name, value);
+        else if(name == "load-streams") options.loadStreams = parseCount(name, value);
+        else if(name == "maintenance-workers") options.maintenanceWorkers = parseCount(name, value);
+        else if(name == "extract") {
+            if(value == "copy") options.extract = Extraction::copy;
+            else if(value == "prepared") options.extract = Extraction::prepared;
+            else if(value == "cursor") options.extract = Extraction::cursor;
+            else throw std::invalid_argument{"invalid --extract: " + value};
+        } else if(name == "copy-format") {
+            if(value == "csv") options.copyFormat = CopyFormat::csv;
+            else if(value == "binary") options.copyFormat = CopyFormat::binary;
+            else throw std::invalid_argument{"invalid --copy-format: " + value};
+        } else if(name == "introspection") {
+            if(value == "catalog") options.introspection = Introspection::catalog;
+            else if(value == "information_schema") options.introspection = Introspection::informationSchema;
+            else throw std::invalid_argument{"invalid --introspection: " + value};
+        } else throw std::invalid_argument{"unknown option --" + name};
+    }
+    // The dataset built stands in for the one source.
+    if(!options.replay.empty() && (!options.sources.empty() || !options.daemon.empty()))
+        throw std::invalid_argument{"--replay builds its source and can't be combined with --sources or --daemon"};
+    if(options.replayRebuild && options.replay.empty()) throw std::invalid_argument{"--replay-rebuild needs --replay"};
+    if(!options.sources.empty() && !options.daemon.empty())
+        throw std::invalid_argument{"--sources runs a job on each shard and can't be combined with --daemon"};
+    // The daemon takes its jobs' arguments from its clients.
+    if(!options.daemon.empty()) {
+        if(!positionals.empty()) throw std::invalid_argument{"usage: cpp_schema --daemon <socket> [options]"};
+        return options;
+    }
+    if(!options.metricsListen.empty()) throw std::invalid_argument{"--metrics-listen needs --daemon"};
+    if(options.memoryCache) throw std::invalid_argument{"--memory-cache needs --daemon"};
+    const std::size_t seedSources = (positionals.size() == 2) + !options.seeds.empty() + !options.seedWhere.empty() +
+        !options.samplePercent.empty();
+    // A replay's root and seeds are the profile's.
+    if(!options.replay.empty() && (!positionals.empty() || seedSources))
+        throw std::invalid_argument{"usage: cpp_schema --replay <profile> [options]"};
+    if(options.replay.empty() && (positionals.empty() || positionals.size() > 2 || seedSources != 1))
+        throw std::invalid_argument{"usage: cpp_schema <root_table> [<root_id> | --seeds <file> | --seed-where <predicate> | "
+            "--sample <percent>] [options]"};
+    if(!options.sampleTables.empty() && options.samplePercent.empty())
+        throw std::invalid_argument{"--sample-tables needs --sample"};
+    if(!options.sampleTables.empty() && (options.closure == Closure::server || options.extract == Extraction::prepared))
+        throw std::invalid_argument{"--sample-tables needs --extract=copy and --closure=client"};
+    if((!options.tableFilters.empty() || !options.fanoutLimits.empty()) && options.closure == Closure::server)
+        throw std::invalid_argument{"--table-where and --fanout-limit need --closure=client"};
+    // Deltas carry updated rows, which only the staging loader can apply.
+    const bool upserts = options.load == Load::staging && options.onConflict == OnConflict::update;
+    if(!options.incremental.empty() && options.pipe && !upserts)
+        throw std::invalid_argument{"--incremental with --pipe needs --load=staging --on-conflict=update"};
+    if(options.batchTimeout && options.extract != Extraction::prepared)
+        throw std::invalid_argument{"--batch-timeout needs --extract=prepared"};
+    if(!options.incremental.empty() && options.extract == Extraction::prepared)
+        throw std::invalid_argument{"--incremental needs --extract=copy"};
+    if(options.format == OutputFormat::parquet && options.pipe)
+        throw std::invalid_argument{"--format=parquet writes files and can't be combined with --pipe"};
+    // The tables the shards have in common arrive once per shard, and the
+    // target as a whole is changed only once, after all of them.
+    if(!options.sources.empty() && options.pipe && options.load != Load::insert && options.load != Load::staging)
+        throw std::invalid_argument{"--sources with --pipe needs --load=insert or --load=staging, which merge the shards' rows"};
+    // Shards numbering their rows alike would collide on the primary keys,
+    // the rows of all but one of them skipped by ON CONFLICT.
+    if(!options.sources.empty() && options.pipe && !options.disjointKeys)
+        throw std::invalid_argument{"--sources with --pipe merges the shards' rows by primary key and needs --disjoint-keys "
+            "to assert that no two shards hold the same key"};
+    if(options.disjointKeys && (options.sources.empty() || !options.pipe))
+        throw std::invalid_argument{"--disjoint-keys only applies to --sources with --pipe"};
+    if(!options.sources.empty() && options.seeds == "-")
+        throw std::invalid_argument{"--sources reads the seeds once per shard and needs them in a file, not on stdin"};
+    if(!options.sources.empty() && (options.deferIndexes || options.unlogged != Unlogged::off || options.sync))
+        throw std::invalid_argument{"--sources loads the shards at once and can't be combined with --defer-indexes, --unlogged or --sync"};
+    if(!options.encryptKeyEnv.empty() && options.pipe)
+        throw std::invalid_argument{"--encrypt-key-env encrypts the output files and can't be combined with --pipe"};
+    if(options.shardSize && (options.pipe || options.format == OutputFormat::parquet))
+        throw std::invalid_argument{"--shard-size splits CSV and binary output files: it can't be combined with --pipe or --format=parquet"};
+    if(options.closure == Closure::server && (!options.incremental.empty() || options.extract == Extraction::prepared))
+        throw std::invalid_argument{"--closure=server needs --extract=copy and can't be combined with --incremental"};
+    if(options.closure == Closure::server && options.semiJoin != SemiJoin::server)
+        throw std::invalid_argument{"--closure=server matches the keys in its statements and needs --semi-join=server"};
+    if(options.closure == Closure::server && options.keyPass)
+        throw std::invalid_argument{"--closure=server computes the closure on the server and needs no --key-pass"};
+    // The referenced rows come last and are looked up by the key sets.
+    if(options.parents == Parents::referenced && (options.closure == Closure::server || options.pipe || options.keyPass ||
+        !options.incremental.empty() || !options.checkpoint.empty() || options.keyMemory))
+        throw std::invalid_argument{"--parents=referenced writes files with --closure=client and can't be combined with "
+            "--pipe, --key-pass, --incremental, --checkpoint or --key-memory"};
+    // The stream is filtered by the key sets of the load, as they were
+    // made, and the slot has to be in place before the snapshot.
+    if(options.sync && (!options.pipe || !options.snapshot || options.closure == Closure::server ||
+        options.parents == Parents::referenced || options.keyMemory || !options.incremental.empty() ||
+        !options.samplePercent.empty()))
+        throw std::invalid_argument{"--sync needs --pipe and --snapshot, and can't be combined with --closure=server, "
+            "--parents=referenced, --key-memory, --incremental or --sample"};
+    // Deltas and server closures depend on more than the key sets.
+    if(!options.cache.empty() && (!options.incremental.empty() || options.closure == Closure::server))
+        throw std::invalid_argument{"--cache can't be combined with --incremental or --closure=server"};
+    if(options.deferIndexes && !options.pipe) throw std::invalid_argument{"--defer-indexes needs --pipe"};
+    if(options.cloneSchema && (!options.pipe || !options.sources.empty()))
+        throw std::invalid_argument{"--clone-schema needs --pipe and can't be combined with --sources"};
+    // The foreign keys would be in the way of the TRUNCATE and of the table
+    // switching persistence.
+    if((options.load == Load::freeze || options.unlogged != Unlogged::off) && (!options.pipe || !options.deferIndexes))
+        throw std::invalid_argument{"--load=freeze and --unlogged need --pipe and --defer-indexes"};
+    if(options.load == Load::freeze && (!options.incremental.empty() || options.resume))
+        throw std::invalid_argument{"--load=freeze truncates the target tables and can't be combined with "
+            "--incremental or --resume"};
+    // Skipped rows would be neither updated nor loaded after the TRUNCATE.
+    if(options.skipExisting && (!options.pipe || upserts || options.load == Load::freeze))
+        throw std::invalid_argument{"--skip-existing needs --pipe and can't be combined with --on-conflict=update "
+            "or --load=freeze"};
+    // The rows of the chunks which differ are upserted, and the key pass
+    // collects the keys of the rows not read; the masked rows and the
+    // servers' closures can't be compared.
+    if(options.compare && (!options.pipe || !upserts || !options.keyPass || options.closure == Closure::server ||
+        options.extract != Extraction::copy || !options.masks.empty() || !options.cache.empty() ||
+        !options.incremental.empty()))
+        throw std::invalid_argument{"--compare needs --pipe, --load=staging --on-conflict=update, --key-pass, "
+            "--closure=client and --extract=copy, and can't be combined with --mask, --cache or --incremental"};
+    // Without a key the masks of known values could be computed by anyone;
+    // the changes --sync replays don't go through them.
+    if(!options.masks.empty() && (options.maskKeyEnv.empty() || options.sync))
+        throw std::invalid_argument{"--mask needs --mask-key-env and can't be combined with --sync"};
+    // The batches are COPYs of their own, under savepoints: COPY FREEZE
+    // allows none, and the staged and inserted rows don't go through them.
+    if(!options.rejects.empty() && (!options.pipe || options.load != Load::copy || options.loadStreams > 1))
+        throw std::invalid_argument{"--rejects needs --pipe and --load=copy, with one load stream"};
+    // The checkpoint checks the files it recorded on the disk.
+    if(!options.upload.empty() && (options.pipe || !options.checkpoint.empty()))
+        throw std::invalid_argument{"--upload writes no local files and can't be combined with --pipe or --checkpoint"};
+    if(options.uploadPartSize < 5) throw std::invalid_argument{"--upload-part-size needs at least 5 MiB"};
+    if(options.explainSlow && options.metrics.empty()) throw std::invalid_argument{"--explain-slow needs --metrics"};
+    if(!options.rejectBatch) throw std::invalid_argument{"--reject-batch needs at least 1 row"};
+    if(!options.loadStreams) throw std::invalid_argument{"--load-streams needs at least 1 stream"};
+    if(!options.replay.empty()) return options;
+    options.rootTable = positionals[0];
+    if(positionals.size() == 2) options.rootId = positionals[1];
+    if(std::find(options.excludedTables.begin(), options.excludedTables.end(), options.rootTable) != options.excludedTables.end())
+        throw std::invalid_argument{"--exclude-table can't exclude the root table"};
+    return options;
+}
+
+// The directory of shard index of --sources under the run's, source-00 on.
+inline std::string sourceName(std::size_t index) {
+    std::string number = std::to_string(index);
+    return "source-" + std::string(number.size() < 2 ? 2 - number.size() : 0, '0') + number;
+}
+
+// The job of options on shard index of --sources: what it writes goes under
+// the shard's name, and the target is finalized once, after every shard.
+inline Options sourceJobOptions(const Options& options, std::size_t index) {
+    Options result = options;
+    const std::string name = sourceName(index);
+    result.sources.clear();
+    result.outputDir /= name;
+    for(auto* path : {&result.rejects, &result.checkpoint, &result.incremental, &result.cache}) {
+        if(!path->empty()) *path /= name;
+    }
+    for(auto* path : {&result.metrics, &result.profile, &result.trace}) {
+        if(!path->empty()) path->replace_filename(path->stem().string() + '.' + name + path->extension().string());
+    }
+    if(!result.upload.empty()) result.upload += (result.upload.ends_with('/') ? "" : "/") + name;
+    if(result.pipe) result.finalize = Finalize::off;
+    return result;
+}
+
+} // namespace subset
@@ -0,0 +1,393 @@
+#pragma once
+
+#include "compression.hpp"
+#include "copy_stream.hpp"
+#include "pg_types.hpp"
+#include "sink.hpp"
+
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace subset {
+
+// Writer of the Thrift compact protocol, which Parquet uses for its
+// metadata. Only what the footer and the page headers need.
+class ThriftCompactWriter {
+public:
+    enum Type : std::uint8_t { boolTrue = 1, boolFalse = 2, i32 = 5, i64 = 6, binary = 8, list = 9, structure = 12 };
+
+    std::string& out() { return out_; }
+
+    void fieldI32(std::int16_t id, std::int32_t value) {
+        header(id, i32);
+        varint(zigzag(value));
+    }
+
+    void fieldI64(std::int16_t id, std::int64_t value) {
+        header(id, i64);
+        varint(zigzag(value));
+    }
+
+    void fieldBinary(std::int16_t id, std::string_view value) {
+        header(id, binary);
+        elementBinary(value);
+    }
+
+    void fieldList(std::int16_t id, Type element, std::size_t size) {
+        header(id, list);
+        if(size < 15) out_ += static_cast<char>(size << 4 | element);
+        else {
+            out_ += static_cast<char>(0xf0 | element);
+            varint(size);
+        }
+    }
+
+    void elementI32(std::int32_t value) { varint(zigzag(value)); }
+
+    void elementBinary(std::string_view value) {
+        varint(value.size());
+        out_.append(value);
+    }
+
+    // A struct as a field, or as an element of a list if id is 0.
+    void beginStruct(std::int16_t id = 0) {
+        if(id) header(id, structure);
+        lastIds_.push_back(lastId_);
+        lastId_ = 0;
+    }
+
+    void endStruct() {
+        out_ += '\0';
+        lastId_ = lastIds_.back();
+        lastIds_.pop_back();
+    }
+
+private:
+    static std::uint64_t zigzag(std::int64_t value) {
+        return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+    }
+
+    void varint(std::uint64_t value) {
+        while(value >= 0x80) {
+            out_ += static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        out_ += static_cast<char>(value);
+    }
+
+    void header(std::int16_t id, Type type) {
+        const int delta = id - lastId_;
+        if(delta > 0 && delta <= 15) out_ += static_cast<char>(delta << 4 | type);
+        else {
+            out_ += static_cast<char>(type);
+            varint(zigzag(id));
+        }
+        lastId_ = id;
+    }
+
+    std::string out_;
+    std::int16_t lastId_ = 0;
+    std::vector<std::int16_t> lastIds_;
+};
+
+// Days since 1970-01-01 of a proleptic Gregorian date.
+inline std::int64_t daysFromCivil(std::int64_t y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const auto yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+// Writes a table to a Parquet file. Each write() is one CSV record as
+// produced by COPY; the fields are parsed after the column types and kept
+// per column until rowGroupRows rows are buffered, which then become a row
+// group with one PLAIN-encoded data page per column. Every column is
+// OPTIONAL. With a compression level, pages are GZIP-compressed.
+class ParquetSink final : public Sink {
+public:
+    struct Column {
+        std::string name;
+        PGDataType dataType;
+    };
+
+    ParquetSink(std::unique_ptr<Sink> out, std::vector<Column> columns, std::size_t rowGroupRows, int gzipLevel = 0)
+        : out_{std::move(out)}, columns_{std::move(columns)}, rowGroupRows_{rowGroupRows}, gzipLevel_{gzipLevel},
+          buffers_(columns_.size()) {
+        if(columns_.empty()) throw std::invalid_argument{"Parquet output needs the column list"};
+        emit("PAR1");
+    }
+
+    ParquetSink(const ParquetSink&) = delete;
+    ParquetSink& operator=(const ParquetSink&) = delete;
+
+    // Takes whole CSV records, one or more, as the MaskSink hands them on.
+    void write(std::string_view data) override {
+        forEachCsvRecord(data, [&](std::string_view record) {
+            std::size_t fields = 0;
+            forEachCsvField(record, [&](std::size_t index, std::string_view value, bool isNull) {
+                if(index < columns_.size()) append(index, value, isNull);
+                fields++;
+            });
+            if(fields != columns_.size()) throw std::runtime_error{"record doesn't match the Parquet schema"};
+            if(++rows_ >= rowGroupRows_) flushRowGroup();
+        });
+    }
+
+    void close() override {
+        flushRowGroup();
+        const std::string footer = fileMetaData();
+        emit(footer);
+        const auto size = static_cast<std::uint32_t>(footer.size());
+        std::string trailer;
+        appendLittleEndian(trailer, size);
+        trailer += "PAR1";
+        emit(trailer);
+        out_->close();
+    }
+
+private:
+    enum PhysicalType { boolean = 0, int32 = 1, int64 = 2, byteArray = 6 };
+    enum ConvertedType { none = -1, utf8 = 0, date = 6, timestampMicros = 10, int16 = 16, json = 19 };
+
+    struct ColumnBuffer {
+        std::string values; // PLAIN encoded
+        std::vector<bool> booleans;
+        std::vector<std::uint8_t> defined;
+    };
+
+    struct ChunkInfo {
+        std::int64_t offset;
+        std::int64_t uncompressed;
+        std::int64_t compressed;
+    };
+
+    struct RowGroupInfo {
+        std::int64_t rows;
+        std::int64_t bytes;
+        std::vector<ChunkInfo> chunks;
+    };
+
+    static PhysicalType physicalType(PGDataType type) {
+        switch(type) {
+        case PGDataType::BOOLEAN: return boolean;
+        case PGDataType::SMALLINT:
+        case PGDataType::INTEGER:
+        case PGDataType::DATE: return int32;
+        case PGDataType::BIGINT:
+        case PGDataType::TIMESTAMPNOTIMEZONE: return int64;
+        default: return byteArray;
+        }
+    }
+
+    static ConvertedType convertedType(PGDataType type) {
+        switch(type) {
+        case PGDataType::SMALLINT: return int16;
+        case PGDataType::DATE: return date;
+        case PGDataType::TIMESTAMPNOTIMEZONE: return timestampMicros;
+        case PGDataType::JSONB: return json;
+        case PGDataType::BOOLEAN:
+        case PGDataType::INTEGER:
+        case PGDataType::BIGINT: return none;
+        default: return utf8;
+        }
+    }
+
+    template<typename T>
+    static void appendLittleEndian(std::string& out, T value) {
+        for(std::size_t i = 0; i < sizeof(T); i++) out += static_cast<char>(static_cast<std::uint64_t>(value) >> (8 * i));
+    }
+
+    static std::int64_t parseInteger(std::string_view text) {
+        std::int64_t value = 0;
+        const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+        if(ec != std::errc{} || end != text.data() + text.size())
+            throw std::runtime_error{"invalid integer for Parquet: " + std::string{text}};
+        return value;
+    }
+
+    // ISO dates as COPY writes them with the default DateStyle. The
+    // infinities map to the extremes, as in PostgreSQL itself.
+    static std::int64_t parseDays(std::string_view text) {
+        if(text == "infinity") return INT32_MAX;
+        if(text == "-infinity") return INT32_MIN;
+        if(text.size() != 10 || text[4] != '-' || text[7] != '-')
+            throw std::runtime_error{"unsupported date for Parquet: " + std::string{text}};
+        return daysFromCivil(parseInteger(text.substr(0, 4)), static_cast<unsigned>(parseInteger(text.substr(5, 2))),
+            static_cast<unsigned>(parseInteger(text.substr(8, 2))));
+    }
+
+    static std::int64_t parseMicros(std::string_view text) {
+        if(text == "infinity") return INT64_MAX;
+        if(text == "-infinity") return INT64_MIN;
+        if(text.size() < 19 || text[10] != ' ' || text[13] != ':' || text[16] != ':')
+            throw std::runtime_error{"unsupported timestamp for Parquet: " + std::string{text}};
+        std::int64_t micros = ((parseDays(text.substr(0, 10)) * 24 + parseInteger(text.substr(11, 2))) * 60 +
+            parseInteger(text.substr(14, 2))) * 60 + parseInteger(text.substr(17, 2));
+        micros *= 1000000;
+        if(text.size() > 20 && text[19] == '.') {
+            std::string fraction{text.substr(20)};
+            fraction.resize(6, '0');
+            micros += parseInteger(fraction);
+        }
+        return micros;
+    }
+
+    void append(std::size_t index, std::string_view value, bool isNull) {
+        ColumnBuffer& buffer = buffers_[index];
+        buffer.defined.push_back(isNull ? 0 : 1);
+        if(isNull) return;
+        const PGDataType type = columns_[index].dataType;
+        switch(physicalType(type)) {
+        case boolean:
+            buffer.booleans.push_back(value == "t");
+            break;
+        case int32:
+            appendLittleEndian(buffer.values, static_cast<std::int32_t>(type == PGDataType::DATE ? parseDays(value) : parseInteger(value)));
+            break;
+        case int64:
+            appendLittleEndian(buffer.values, type == PGDataType::TIMESTAMPNOTIMEZONE ? parseMicros(value) : parseInteger(value));
+            break;
+        case byteArray:
+            appendLittleEndian(buffer.values, static_cast<std::uint32_t>(value.size()));
+            buffer.values.append(value);
+            break;
+        }
+    }
+
+    // The definition levels in the RLE/bit-packing hybrid, as RLE runs only.
+    static void appendLevels(std::string& out, const std::vector<std::uint8_t>& levels) {
+        std::string runs;
+        for(std::size_t i = 0; i < levels.size();) {
+            std::size_t j = i;
+            while(j < levels.size() && levels[j] == levels[i]) j++;
+            for(std::uint64_t header = (j - i) << 1; ; header >>= 7) {
+                if(header < 0x80) {
+                    runs += static_cast<char>(header);
+                    break;
+                }
+                runs += static_cast<char>(header | 0x80);
+            }
+            runs += static_cast<char>(levels[i]);
+            i = j;
+        }
+        appendLittleEndian(out, static_cast<std::uint32_t>(runs.size()));
+        out += runs;
+    }
+
+    void flushRowGroup() {
+        if(rows_ == 0) return;
+        RowGroupInfo group{static_cast<std::int64_t>(rows_), 0, {}};
+        for(std::size_t c = 0; c < columns_.size(); c++) {
+            ColumnBuffer& buffer = buffers_[c];
+            std::string body;
+            appendLevels(body, buffer.defined);
+            if(physicalType(columns_[c].dataType) == boolean) {
+                for(std::size_t i = 0; i < buffer.booleans.size(); i += 8) {
+                    std::uint8_t bits = 0;
+                    for(std::size_t b = 0; b < 8 && i + b < buffer.booleans.size(); b++) bits |= buffer.booleans[i + b] << b;
+                    body += static_cast<char>(bits);
+                }
+            } else body += buffer.values;
+            const std::string page = gzipLevel_ > 0 ? gzipMember(body, gzipLevel_) : std::string{};
+            const std::string_view stored = gzipLevel_ > 0 ? std::string_view{page} : std::string_view{body};
+
+            ThriftCompactWriter header;
+            header.beginStruct();
+            header.fieldI32(1, 0); // DATA_PAGE
+            header.fieldI32(2, static_cast<std::int32_t>(body.size()));
+            header.fieldI32(3, static_cast<std::int32_t>(stored.size()));
+            header.beginStruct(5);
+            header.fieldI32(1, static_cast<std::int32_t>(rows_));
+            header.fieldI32(2, 0); // PLAIN
+            header.fieldI32(3, 3); // RLE
+            header.fieldI32(4, 3); // RLE
+            header.endStruct();
+            header.endStruct();
+
+            const ChunkInfo chunk{offset_, static_cast<std::int64_t>(header.out().size() + body.size()),
+                static_cast<std::int64_t>(header.out().size() + stored.size())};
+            emit(header.out());
+            emit(stored);
+            group.bytes += chunk.uncompressed;
+            group.chunks.push_back(chunk);
+            buffer = ColumnBuffer{};
+        }
+        rowGroups_.push_back(std::move(group));
+        totalRows_ += rows_;
+        rows_ = 0;
+    }
+
+    std::string fileMetaData() const {
+        ThriftCompactWriter meta;
+        meta.beginStruct();
+        meta.fieldI32(1, 1);
+        meta.fieldList(2, ThriftCompactWriter::structure, columns_.size() + 1);
+        meta.beginStruct();
+        meta.fieldBinary(4, "schema");
+        meta.fieldI32(5, static_cast<std::int32_t>(columns_.size()));
+        meta.endStruct();
+        for(const auto& column : columns_) {
+            meta.beginStruct();
+            meta.fieldI32(1, physicalType(column.dataType));
+            meta.fieldI32(3, 1); // OPTIONAL
+            meta.fieldBinary(4, column.name);
+            if(convertedType(column.dataType) != none) meta.fieldI32(6, convertedType(column.dataType));
+            meta.endStruct();
+        }
+        meta.fieldI64(3, static_cast<std::int64_t>(totalRows_));
+        meta.fieldList(4, ThriftCompactWriter::structure, rowGroups_.size());
+        for(const auto& group : rowGroups_) {
+            meta.beginStruct();
+            meta.fieldList(1, ThriftCompactWriter::structure, columns_.size());
+            for(std::size_t c = 0; c < columns_.size(); c++) {
+                const ChunkInfo& chunk = group.chunks[c];
+                meta.beginStruct();
+                meta.fieldI64(2, chunk.offset);
+                meta.beginStruct(3);
+                meta.fieldI32(1, physicalType(columns_[c].dataType));
+                meta.fieldList(2, ThriftCompactWriter::i32, 2);
+                meta.elementI32(0); // PLAIN
+                meta.elementI32(3); // RLE
+                meta.fieldList(3, ThriftCompactWriter::binary, 1);
+                meta.elementBinary(columns_[c].name);
+                meta.fieldI32(4, gzipLevel_ > 0 ? 2 : 0); // GZIP or UNCOMPRESSED
+                meta.fieldI64(5, group.rows);
+                meta.fieldI64(6, chunk.uncompressed);
+                meta.fieldI64(7, chunk.compressed);
+                meta.fieldI64(9, chunk.offset);
+                meta.endStruct();
+                meta.endStruct();
+            }
+            meta.fieldI64(2, group.bytes);
+            meta.fieldI64(3, group.rows);
+            meta.endStruct();
+        }
+        meta.fieldBinary(6, "cpp_schema");
+        meta.endStruct();
+        return std::move(meta.out());
+    }
+
+    void emit(std::string_view data) {
+        out_->write(data);
+        offset_ += static_cast<std::int64_t>(data.size());
+    }
+
+    std::unique_ptr<Sink> out_;
+    std::vector<Column> columns_;
+    std::size_t rowGroupRows_;
+    int gzipLevel_;
+    std::vector<ColumnBuffer> buffers_;
+    std::vector<RowGroupInfo> rowGroups_;
+    std::size_t rows_ = 0;
+    std::size_t totalRows_ = 0;
+    std::int64_t offset_ = 0;
+};
+
+} // namespace subset
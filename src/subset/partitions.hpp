@@ -0,0 +1,85 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "key_sets.hpp"
+#include "schema_graph.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+struct Partition {
+    std::string relation;   // as regclass prints it, ready for a FROM clause
+    std::string constraint; // pg_get_partition_constraintdef, empty for none
+};
+
+// A declaratively partitioned table and its direct partitions. A partition
+// which is partitioned again is read whole, leaving its own partitions to
+// the planner.
+struct PartitionedTable {
+    std::string keyColumn; // the only column of the partition key; empty for several or an expression
+    std::vector<Partition> partitions;
+};
+
+inline const std::string partitionsQuery = R"(
+        SELECT p.relname AS table_name, c.oid::regclass::text AS partition,
+            coalesce(pg_catalog.pg_get_partition_constraintdef(c.oid), '') AS constraint_def,
+            coalesce((SELECT a.attname FROM pg_catalog.pg_attribute a
+                WHERE pt.partnatts = 1 AND a.attrelid = pt.partrelid AND a.attnum = pt.partattrs[0]), '') AS key_column
+        FROM pg_catalog.pg_partitioned_table pt
+        JOIN pg_catalog.pg_class p ON p.oid = pt.partrelid
+        JOIN pg_catalog.pg_namespace n ON n.oid = p.relnamespace
+        JOIN pg_catalog.pg_inherits i ON i.inhparent = p.oid
+        JOIN pg_catalog.pg_class c ON c.oid = i.inhrelid
+        WHERE n.nspname = $1
+        ORDER BY p.relname, c.relname)";
+
+inline std::unordered_map<TableId, PartitionedTable> loadPartitions(pgfe::Connection& conn, const SchemaGraph& graph,
+    const std::string& schema) {
+    using dmitigr::pgfe::to;
+    std::unordered_map<TableId, PartitionedTable> result;
+    conn.execute([&](auto&& r) {
+        const auto t = graph.findTable(to<std::string>(r["table_name"]));
+        if(!t) return;
+        PartitionedTable& table = result[*t];
+        table.keyColumn = to<std::string>(r["key_column"]);
+        table.partitions.push_back(Partition{to<std::string>(r["partition"]), to<std::string>(r["constraint_def"])});
+    }, partitionsQuery, schema);
+    return result;
+}
+
+// The partitions of table which can hold a row whose partition key is one
+// of the values, in order: each partition constraint is evaluated on the
+// values themselves, staged under the name of the key column, and a
+// partition none of them satisfies holds no row the filter would take.
+inline std::vector<std::size_t> survivingPartitions(pgfe::Connection& conn, KeySetStage& keySets, const std::string& tableName,
+    const PartitionedTable& table, const KeySet& values) {
+    std::vector<std::size_t> result;
+    if(values.empty()) return result;
+    const std::string keys = "(SELECT k AS " + quoteIdentifier(table.keyColumn) + " FROM " +
+        keySets.table(tableName, table.keyColumn, values) + ") AS keys";
+    std::string query;
+    std::vector<bool> survives(table.partitions.size(), false);
+    for(std::size_t i = 0; i < table.partitions.size(); i++) {
+        const std::string& constraint = table.partitions[i].constraint;
+        if(constraint.empty()) {
+            survives[i] = true;
+            continue;
+        }
+        if(!query.empty()) query += " UNION ALL ";
+        query += "SELECT " + std::to_string(i) + " AS i WHERE EXISTS (SELECT 1 FROM " + keys + " WHERE " + constraint + ")";
+    }
+    if(!query.empty()) conn.execute([&](auto&& r) { survives[pgfe::to<std::size_t>(r["i"])] = true; }, query);
+    for(std::size_t i = 0; i < survives.size(); i++) {
+        if(survives[i]) result.push_back(i);
+    }
+    return result;
+}
+
+} // namespace subset
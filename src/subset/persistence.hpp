@@ -0,0 +1,44 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Makes the target tables unlogged, or logged again, side by side on up to
+// jobs connections of pool. Each ALTER rewrites its table: unlogged ones
+// are loaded without WAL, and SET LOGGED writes a table into it in one go
+// rather than row by row (not at all with wal_level=minimal). A foreign key
+// between a logged and an unlogged table makes the switch fail, so it's
+// done with the foreign keys out of the way. The first error is rethrown
+// once all the tables have been tried.
+inline void setLogged(pgfe::Connection_pool& pool, std::size_t jobs, const std::vector<std::string>& tables, bool logged) {
+    std::atomic<std::size_t> next = 0;
+    std::exception_ptr error;
+    std::atomic<bool> failed = false;
+    std::vector<std::thread> threads;
+    for(std::size_t w = 0; w < std::min(std::max<std::size_t>(jobs, 1), tables.size()); w++) {
+        threads.emplace_back([&] {
+            try {
+                auto conn = pool.acquire();
+                for(auto i = next++; i < tables.size(); i = next++)
+                    conn->execute("ALTER TABLE " + tables[i] + (logged ? " SET LOGGED" : " SET UNLOGGED"));
+            } catch(...) {
+                if(!failed.exchange(true)) error = std::current_exception();
+            }
+        });
+    }
+    for(auto& thread : threads) thread.join();
+    if(error) std::rethrow_exception(error);
+}
+
+} // namespace subset
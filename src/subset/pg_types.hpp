@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+
+namespace subset {
+
+enum PGDataType { NUMERIC, INTEGER, BIGINT, BOOLEAN, CHARACTERVARYING, TEXT, JSONB, TIMESTAMPNOTIMEZONE, DATE, SMALLINT, UUID, OTHER };
+
+using Oid = std::uint32_t;
+
+struct ColInfo {
+    bool isNullable;
+    PGDataType dataType;
+    int index;
+};
+
+// How a key set holds the values of a type.
+enum class KeyEncoding { text, integer, uuid };
+
+struct PGTypeTraits {
+    bool quoted;          // literals need enclosing quotes
+    bool binaryKey;       // binary COPY values can be read into a key set
+    KeyEncoding key;
+};
+
+inline constexpr PGTypeTraits pgTypeTraitsTable[] = {
+    {false, false, KeyEncoding::text},    // NUMERIC
+    {false, true, KeyEncoding::integer},  // INTEGER
+    {false, true, KeyEncoding::integer},  // BIGINT
+    {false, false, KeyEncoding::text},    // BOOLEAN
+    {true, true, KeyEncoding::text},      // CHARACTERVARYING
+    {true, true, KeyEncoding::text},      // TEXT
+    {true, false, KeyEncoding::text},     // JSONB
+    {true, false, KeyEncoding::text},     // TIMESTAMPNOTIMEZONE
+    {true, false, KeyEncoding::text},     // DATE
+    {false, true, KeyEncoding::integer},  // SMALLINT
+    {true, true, KeyEncoding::uuid},      // UUID
+    {true, false, KeyEncoding::text},     // OTHER
+};
+static_assert(std::size(pgTypeTraitsTable) == OTHER + 1);
+
+constexpr const PGTypeTraits& pgTypeTraits(PGDataType dataType) {
+    return pgTypeTraitsTable[dataType];
+}
+
+struct PGBuiltinType {
+    Oid oid;
+    std::string_view name; // as format_type() and information_schema spell it
+    PGDataType dataType;
+};
+
+// The builtin types of pg_type.dat, by OID. Those without a PGDataType of
+// their own are OTHER: quoted, and keyed by their text.
+inline constexpr PGBuiltinType pgBuiltinTypes[] = {
+    {16, "boolean", BOOLEAN},
+    {17, "bytea", OTHER},
+    {18, "\"char\"", OTHER},
+    {19, "name", OTHER},
+    {20, "bigint", BIGINT},
+    {21, "smallint", SMALLINT},
+    {22, "int2vector", OTHER},
+    {23, "integer", INTEGER},
+    {24, "regproc", OTHER},
+    {25, "text", TEXT},
+    {26, "oid", OTHER},
+    {27, "tid", OTHER},
+    {28, "xid", OTHER},
+    {29, "cid", OTHER},
+    {30, "oidvector", OTHER},
+    {114, "json", OTHER},
+    {142, "xml", OTHER},
+    {194, "pg_node_tree", OTHER},
+    {600, "point", OTHER},
+    {601, "lseg", OTHER},
+    {602, "path", OTHER},
+    {603, "box", OTHER},
+    {604, "polygon", OTHER},
+    {628, "line", OTHER},
+    {650, "cidr", OTHER},
+    {700, "real", OTHER},
+    {701, "double precision", OTHER},
+    {718, "circle", OTHER},
+    {774, "macaddr8", OTHER},
+    {790, "money", OTHER},
+    {829, "macaddr", OTHER},
+    {869, "inet", OTHER},
+    {1033, "aclitem", OTHER},
+    {1042, "character", OTHER},
+    {1043, "character varying", CHARACTERVARYING},
+    {1082, "date", DATE},
+    {1083, "time without time zone", OTHER},
+    {1114, "timestamp without time zone", TIMESTAMPNOTIMEZONE},
+    {1184, "timestamp with time zone", OTHER},
+    {1186, "interval", OTHER},
+    {1266, "time with time zone", OTHER},
+    {1560, "bit", OTHER},
+    {1562, "bit varying", OTHER},
+    {1700, "numeric", NUMERIC},
+    {1790, "refcursor", OTHER},
+    {2202, "regprocedure", OTHER},
+    {2203, "regoper", OTHER},
+    {2204, "regoperator", OTHER},
+    {2205, "regclass", OTHER},
+    {2206, "regtype", OTHER},
+    {2950, "uuid", UUID},
+    {2970, "txid_snapshot", OTHER},
+    {3220, "pg_lsn", OTHER},
+    {3614, "tsvector", OTHER},
+    {3615, "tsquery", OTHER},
+    {3642, "gtsvector", OTHER},
+    {3734, "regconfig", OTHER},
+    {3769, "regdictionary", OTHER},
+    {3802, "jsonb", JSONB},
+    {3904, "int4range", OTHER},
+    {3906, "numrange", OTHER},
+    {3908, "tsrange", OTHER},
+    {3910, "tstzrange", OTHER},
+    {3912, "daterange", OTHER},
+    {3926, "int8range", OTHER},
+    {4072, "jsonpath", OTHER},
+    {4089, "regnamespace", OTHER},
+    {4096, "regrole", OTHER},
+    {4191, "regcollation", OTHER},
+    {5038, "pg_snapshot", OTHER},
+    {5069, "xid8", OTHER},
+};
+
+constexpr bool pgBuiltinTypesSorted() {
+    for(std::size_t i = 1; i < std::size(pgBuiltinTypes); i++) {
+        if(pgBuiltinTypes[i - 1].oid >= pgBuiltinTypes[i].oid) return false;
+    }
+    return true;
+}
+static_assert(pgBuiltinTypesSorted());
+
+// pg_attribute.atttypid or Row_info::type_oid to PGDataType.
+constexpr PGDataType pgDataTypeOf(Oid oid) {
+    const auto it = std::lower_bound(std::begin(pgBuiltinTypes), std::end(pgBuiltinTypes), oid,
+        [](const PGBuiltinType& type, Oid o) { return type.oid < o; });
+    return it != std::end(pgBuiltinTypes) && it->oid == oid ? it->dataType : OTHER;
+}
+static_assert(pgDataTypeOf(20) == BIGINT && pgDataTypeOf(2950) == UUID && pgDataTypeOf(1) == OTHER);
+
+// For the information_schema path, which only has the type's name.
+constexpr PGDataType getPGDataType(std::string_view dataType) {
+    for(const auto& type : pgBuiltinTypes) {
+        if(type.name == dataType) return type.dataType;
+    }
+    return OTHER;
+}
+
+constexpr bool pgDataTypeNeedsEnclosedQuotes(PGDataType dataType) {
+    return pgTypeTraits(dataType).quoted;
+}
+
+} // namespace subset
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "components.hpp"
+#include "schema_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+struct ColumnStats {
+    double nullFraction = 0;
+    double distinct = 0; // pg_stats.n_distinct: negative is a fraction of the rows
+    double width = 0;
+};
+
+// What the planner knows of a table: pg_class.reltuples and the pg_stats
+// rows of its columns, which ANALYZE may not have written yet.
+struct TableStats {
+    double rows = 0;
+    double pages = 0;
+    std::unordered_map<ColumnId, ColumnStats> columns;
+};
+
+inline const std::string planTablesQuery = R"(
+        SELECT c.relname AS table_name, greatest(c.reltuples, 0)::float8 AS reltuples, c.relpages::float8 AS relpages
+        FROM pg_catalog.pg_class c
+        JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+        WHERE n.nspname = $1 AND c.relkind IN ('r', 'p'))";
+
+// Partitioned tables only have inherited statistics; the others prefer
+// their own, which sort last.
+inline const std::string planColumnsQuery = R"(
+        SELECT tablename AS table_name, attname AS column_name,
+            null_frac::float8 AS null_frac, n_distinct::float8 AS n_distinct, avg_width::float8 AS avg_width
+        FROM pg_catalog.pg_stats
+        WHERE schemaname = $1
+        ORDER BY inherited DESC)";
+
+inline std::vector<TableStats> loadPlanStats(pgfe::Connection& conn, const SchemaGraph& graph, const std::string& schema) {
+    using dmitigr::pgfe::to;
+    std::vector<TableStats> stats(graph.tableCount());
+    conn.execute([&](auto&& r) {
+        if(const auto t = graph.findTable(to<std::string>(r["table_name"]))) {
+            stats[*t].rows = to<double>(r["reltuples"]);
+            stats[*t].pages = to<double>(r["relpages"]);
+        }
+    }, planTablesQuery, schema);
+    conn.execute([&](auto&& r) {
+        const auto t = graph.findTable(to<std::string>(r["table_name"]));
+        const auto c = graph.columns.find(to<std::string>(r["column_name"]));
+        if(!t || !c) return;
+        stats[*t].columns[*c] = ColumnStats{to<double>(r["null_frac"]), to<double>(r["n_distinct"]), to<double>(r["avg_width"])};
+    }, planColumnsQuery, schema);
+    return stats;
+}
+
+struct TableEstimate {
+    double rows = 0;
+    double bytes = 0;
+    double fanOut = 0; // rows per key of the supporter that selects the most per key
+};
+
+// Estimates the rows the subset takes from every table, the way the
+// extraction selects them: the root table gives its rootRows seed rows, any
+// other table is filtered on all of its supporters' key sets, and one
+// without supporters is read in full. The keys of a link are the distinct
+// values of the parent column among the parent's selected rows, and a key
+// set of k values matches k / n_distinct of the child's non-null rows.
+// Filters are taken as independent. A cycle is iterated the way it is extracted, its
+// tables without outside supporters taking the union of the internal links
+// round after round, until the estimate settles.
+inline std::vector<TableEstimate> estimateSubset(const SchemaGraph& graph, const Components& components,
+    const std::vector<std::vector<TableId>>& waves, const std::vector<TableStats>& stats, TableId rootTable, double rootRows) {
+    std::vector<TableEstimate> estimates(graph.tableCount());
+    const auto columnStats = [&](TableId t, ColumnId c) -> const ColumnStats* {
+        const auto it = stats[t].columns.find(c);
+        return it == stats[t].columns.end() ? nullptr : &it->second;
+    };
+    // Without statistics a column is taken to be unique.
+    const auto distinct = [&](TableId t, ColumnId c) {
+        const double rows = std::max(stats[t].rows, 1.0);
+        const ColumnStats* s = columnStats(t, c);
+        if(!s || s->distinct == 0) return rows;
+        return std::clamp(s->distinct > 0 ? s->distinct : -s->distinct * rows, 1.0, rows);
+    };
+    const auto keys = [&](const FkLink& link) {
+        const double values = distinct(link.parent, link.parentColumn);
+        const double selected = estimates[link.parent].rows / std::max(stats[link.parent].rows, 1.0);
+        if(selected >= 1) return values;
+        // The expected number of values hit when taking that share of rows
+        // holding rows / values copies of each.
+        return values * (1 - std::pow(1 - selected, std::max(stats[link.parent].rows, 1.0) / values));
+    };
+    const auto selectivity = [&](const FkLink& link) {
+        const ColumnStats* s = columnStats(link.child, link.childColumn);
+        const double values = s && s->distinct != 0 ? distinct(link.child, link.childColumn) :
+            std::min(distinct(link.parent, link.parentColumn), std::max(stats[link.child].rows, 1.0));
+        return std::min(1.0, keys(link) / values) * (1 - (s ? s->nullFraction : 0));
+    };
+    const auto settle = [&](TableId t, double rows) {
+        TableEstimate& e = estimates[t];
+        e.rows = rows;
+        double width = 0;
+        for(const auto& col : graph.tableColumns(t)) {
+            const ColumnStats* s = columnStats(t, col.name);
+            width += (s ? s->width : 8) + 1; // the value and its delimiter
+        }
+        e.bytes = rows * width;
+        e.fanOut = 0;
+        for(const LinkId l : graph.supporters(t)) {
+            const double k = keys(graph.link(l));
+            if(k > 0) e.fanOut = std::max(e.fanOut, rows / k);
+        }
+    };
+
+    std::vector<bool> seen(components.count(), false);
+    for(const auto& wave : waves) {
+        for(const TableId first : wave) {
+            const std::uint32_t c = components.of[first];
+            if(seen[c]) continue;
+            seen[c] = true;
+            const auto& tables = components.members[c];
+            if(!components.cyclic(graph, c)) {
+                const TableId t = tables.front();
+                double share = 1;
+                for(const LinkId l : graph.supporters(t)) share *= selectivity(graph.link(l));
+                settle(t, t == rootTable ? rootRows : stats[t].rows * share);
+                continue;
+            }
+
+            std::vector<bool> external(tables.size(), false);
+            for(std::size_t i = 0; i < tables.size(); i++) {
+                double share = 1;
+                for(const LinkId l : graph.supporters(tables[i])) {
+                    if(components.internal(graph, l)) continue;
+                    external[i] = true;
+                    share *= selectivity(graph.link(l));
+                }
+                if(tables[i] == rootTable) {
+                    external[i] = true;
+                    settle(tables[i], rootRows);
+                } else settle(tables[i], external[i] ? stats[tables[i]].rows * share : 0);
+            }
+            for(int round = 0; round < 64; round++) {
+                double change = 0;
+                double total = 0;
+                for(std::size_t i = 0; i < tables.size(); i++) {
+                    if(external[i]) continue;
+                    double missed = 1;
+                    for(const LinkId l : graph.supporters(tables[i])) missed *= 1 - selectivity(graph.link(l));
+                    const double before = estimates[tables[i]].rows;
+                    settle(tables[i], std::max(before, stats[tables[i]].rows * (1 - missed)));
+                    change += estimates[tables[i]].rows - before;
+                    total += estimates[tables[i]].rows;
+                }
+                if(change <= total * 0.001) break;
+            }
+        }
+    }
+    return estimates;
+}
+
+// The column each valid, non-partial index of the schema starts with,
+// which is what a filter on the column can use.
+inline const std::string indexedColumnsQuery = R"(
+        SELECT c.relname AS table_name, a.attname AS column_name
+        FROM pg_catalog.pg_index i
+        JOIN pg_catalog.pg_class c ON c.oid = i.indrelid
+        JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+        JOIN pg_catalog.pg_attribute a ON a.attrelid = i.indrelid AND a.attnum = i.indkey[0]
+        WHERE n.nspname = $1 AND i.indisvalid AND i.indpred IS NULL)";
+
+// The leading columns of each table's indexes.
+inline std::vector<std::vector<ColumnId>> loadIndexedColumns(pgfe::Connection& conn, const SchemaGraph& graph,
+    const std::string& schema) {
+    using dmitigr::pgfe::to;
+    std::vector<std::vector<ColumnId>> indexed(graph.tableCount());
+    conn.execute([&](auto&& r) {
+        const auto t = graph.findTable(to<std::string>(r["table_name"]));
+        const auto c = graph.columns.find(to<std::string>(r["column_name"]));
+        if(t && c) indexed[*t].push_back(*c);
+    }, indexedColumnsQuery, schema);
+    return indexed;
+}
+
+// A foreign key followed from parent to child with no index of the child
+// starting with its column: every read of the child filtered on the keys
+// is a sequential scan, once per batch for a prepared extraction.
+struct MissingIndex {
+    LinkId link;
+    double scanCost = 0; // of one sequential scan, in the planner's units at the default costs
+};
+
+// The missing indexes of the links followed, costliest first.
+template<typename Followed>
+std::vector<MissingIndex> findMissingIndexes(pgfe::Connection& conn, const SchemaGraph& graph, const std::string& schema,
+    const std::vector<TableStats>& stats, Followed&& followed) {
+    const auto indexed = loadIndexedColumns(conn, graph, schema);
+    std::vector<MissingIndex> missing;
+    for(LinkId l = 0; l < graph.linkCount(); l++) {
+        const FkLink& link = graph.link(l);
+        if(!followed(l)) continue;
+        const auto& columns = indexed[link.child];
+        if(std::find(columns.begin(), columns.end(), link.childColumn) != columns.end()) continue;
+        const bool seen = std::any_of(missing.begin(), missing.end(), [&](const MissingIndex& m) {
+            return graph.link(m.link).child == link.child && graph.link(m.link).childColumn == link.childColumn;
+        });
+        if(seen) continue;
+        // seq_page_cost for every page, cpu_tuple_cost and cpu_operator_cost
+        // for every row.
+        const TableStats& s = stats[link.child];
+        missing.push_back({l, s.pages + s.rows * (0.01 + 0.0025)});
+    }
+    std::sort(missing.begin(), missing.end(), [](const MissingIndex& a, const MissingIndex& b) { return a.scanCost > b.scanCost; });
+    return missing;
+}
+
+inline std::string formatVolume(double bytes) {
+    static const char* const units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    std::size_t unit = 0;
+    while(bytes >= 1024 && unit + 1 < std::size(units)) {
+        bytes /= 1024;
+        unit++;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), unit ? "%.1f %s" : "%.0f %s", bytes, units[unit]);
+    return text;
+}
+
+// Prints the dependents of the root as a tree, heaviest branch first, each
+// table once; tables reached another way hang off the tree's side. A fan-out
+// of ten or more rows per parent key is flagged.
+inline void printCostTree(std::ostream& out, const SchemaGraph& graph, const std::vector<TableEstimate>& estimates, TableId rootTable) {
+    const auto heavier = [&](TableId a, TableId b) { return estimates[a].bytes > estimates[b].bytes; };
+    std::vector<bool> printed(graph.tableCount(), false);
+    char line[256];
+    const auto print = [&](TableId t, std::size_t depth, bool again) {
+        const TableEstimate& e = estimates[t];
+        const std::string name = std::string(depth * 2, ' ') + graph.tableName(t) + (again ? " (above)" : "");
+        std::snprintf(line, sizeof(line), "%-48s %14.0f %12s", name.c_str(), e.rows, formatVolume(e.bytes).c_str());
+        out << line;
+        if(!again && e.fanOut >= 10) {
+            std::snprintf(line, sizeof(line), "  fan-out x%.0f", e.fanOut);
+            out << line;
+        }
+        out << '\n';
+    };
+    const auto walk = [&](TableId from) {
+        std::vector<std::pair<TableId, std::size_t>> stack{{from, 0}};
+        while(!stack.empty()) {
+            const auto [t, depth] = stack.back();
+            stack.pop_back();
+            print(t, depth, printed[t]);
+            if(printed[t]) continue;
+            printed[t] = true;
+            std::vector<TableId> children;
+            for(const LinkId l : graph.dependents(t)) {
+                const TableId child = graph.link(l).child;
+                if(child != t && std::find(children.begin(), children.end(), child) == children.end()) children.push_back(child);
+            }
+            // The stack pops the heaviest child first.
+            std::sort(children.begin(), children.end(), [&](TableId a, TableId b) { return heavier(b, a); });
+            for(const TableId child : children) stack.emplace_back(child, depth + 1);
+        }
+    };
+
+    std::snprintf(line, sizeof(line), "%-48s %14s %12s\n", "estimated subset", "rows", "bytes");
+    out << line;
+    walk(rootTable);
+    std::vector<TableId> rest;
+    for(TableId t = 0; t < graph.tableCount(); t++) {
+        if(!printed[t]) rest.push_back(t);
+    }
+    std::sort(rest.begin(), rest.end(), heavier);
+    for(const TableId t : rest) {
+        if(!printed[t]) walk(t);
+    }
+
+    std::vector<TableId> order(graph.tableCount());
+    double rows = 0;
+    double bytes = 0;
+    for(TableId t = 0; t < graph.tableCount(); t++) {
+        order[t] = t;
+        rows += estimates[t].rows;
+        bytes += estimates[t].bytes;
+    }
+    std::sort(order.begin(), order.end(), heavier);
+    std::snprintf(line, sizeof(line), "\n%-48s %14.0f %12s\n", "total", rows, formatVolume(bytes).c_str());
+    out << line;
+    for(std::size_t i = 0; i < order.size() && i < 10; i++) {
+        const TableId t = order[i];
+        std::snprintf(line, sizeof(line), "  %-46s %13.1f%%\n", graph.tableName(t).c_str(), bytes > 0 ? 100 * estimates[t].bytes / bytes : 0.0);
+        out << line;
+    }
+}
+
+} // namespace subset
@@ -0,0 +1,323 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "key_set.hpp"
+#include "live_metrics.hpp"
+#include "metrics.hpp"
+#include "sql.hpp"
+#include "trace.hpp"
+#include "watchdog.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The keys one extraction filters a referencing column by.
+struct KeyFilter {
+    std::string column;
+    const KeySet* values;
+};
+
+// Sizes the key batches of a table's prepared extraction to take about
+// target seconds each, which covers both the rows per key and their cost:
+// a full batch scales the next one by target over its latency, by at most
+// a factor of two either way so one outlier doesn't swing it. The size
+// stays with the table for its next extraction. A zero target keeps the
+// size fixed.
+class BatchSizer {
+public:
+    static constexpr std::size_t minimum = 16;
+    static constexpr std::size_t maximum = 1 << 20;
+
+    BatchSizer(std::size_t size, double target) : size_{std::max<std::size_t>(size, 1)}, target_{target} {}
+
+    std::size_t size() const { return size_; }
+
+    void observe(std::size_t keys, double seconds) {
+        // A short last batch says little.
+        if(target_ <= 0 || keys < size_) return;
+        const double scale = seconds > 0 ? std::clamp(target_ / seconds, 0.5, 2.0) : 2.0;
+        size_ = std::clamp(static_cast<std::size_t>(static_cast<double>(keys) * scale), minimum, maximum);
+    }
+
+private:
+    std::size_t size_;
+    double target_;
+};
+
+// The options of the EXPLAIN a slow batch is run again under.
+inline const std::string explainAnalyze = "EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) ";
+
+// Told of the batches of an extraction slower than wanted: wants(seconds)
+// says which, and record gets each with its plan.
+struct BatchExplainer {
+    std::function<bool(double seconds)> wants;
+    std::function<void(double seconds, const std::string& statement, std::string plan)> record;
+};
+
+// Cancels the batches of an extraction still running after timeout, which
+// then run again as two halves of their keys, down to batches of minimum
+// keys, which run to their end. The rows of a batch are held until it
+// completes, up to heldRows of them: past those it couldn't run again
+// without sending them twice, and runs to its end as well. Inside a
+// transaction every batch runs under a savepoint to go back to. onCancel is
+// told of every batch cancelled.
+struct BatchDeadline {
+    std::chrono::milliseconds timeout{0};
+    std::size_t minimum = BatchSizer::minimum;
+    std::size_t heldRows = 10000;
+    std::function<void(std::size_t keys, double seconds)> onCancel;
+};
+
+// Extracts with one prepared `SELECT ... WHERE c1 = ANY($1) AND ...` whose
+// parameters are the key sets bound as arrays, leaving the element type to
+// be inferred from the columns. The largest key set is cut into batches as
+// sizer sizes them, which all run the same statement, and thus the same plan.
+// pgfe executes in single-row mode, so rows reach onRow one at a time as
+// they arrive and the result is never materialized; memory stays bounded by
+// the batch and the sink no matter how large the table is.
+// Calls onRow for every row and returns the number of rows. A batch the
+// explainer wants is run once more under EXPLAIN ANALYZE, with the same
+// parameters. With a deadline the batches past it are split.
+template<typename F>
+std::uint64_t extractPrepared(pgfe::Connection& conn, const std::string& select,
+    const std::vector<KeyFilter>& filters, BatchSizer& sizer, F&& onRow, const BatchExplainer* explainer = nullptr,
+    const BatchDeadline* deadline = nullptr) {
+    std::size_t batched = 0;
+    for(std::size_t i = 0; i < filters.size(); i++) {
+        if(filters[i].values->empty()) return 0; // nothing can match
+        if(filters[i].values->size() > filters[batched].values->size()) batched = i;
+    }
+
+    std::string statement = select;
+    for(std::size_t i = 0; i < filters.size(); i++) {
+        statement += i == 0 ? " WHERE " : " AND ";
+        statement += quoteIdentifier(filters[i].column) + " = ANY($" + std::to_string(i + 1) + ")";
+    }
+
+    // pgfe converts containers of optionals to array literals.
+    const auto toArray = [](const KeySet& keys) {
+        std::vector<std::optional<std::string>> result;
+        result.reserve(keys.size());
+        keys.forEachText([&](std::string_view value) { result.emplace_back(value); });
+        return result;
+    };
+
+    static const std::string name = "subset_extract";
+    static const std::string explainName = "subset_explain";
+    auto ps = conn.prepare_as_is(statement, name);
+    std::uint64_t rows = 0;
+    const auto run = [&] {
+        ps.execute([&](auto&& r) {
+            onRow(r);
+            rows++;
+        });
+    };
+    const auto explainNow = [&](double seconds, const std::vector<std::optional<std::string>>* batch) {
+        auto explained = conn.prepare_as_is(explainAnalyze + statement, explainName);
+        for(std::size_t i = 0; i < filters.size(); i++) {
+            if(i == batched) explained.bind(i, *batch);
+            else explained.bind(i, toArray(*filters[i].values));
+        }
+        std::string plan;
+        explained.execute([&](auto&& r) { plan += pgfe::to<std::string_view>(r[0]); });
+        conn.unprepare(explainName);
+        explainer->record(seconds, statement, std::move(plan));
+    };
+    const auto explain = [&](double seconds, const std::vector<std::optional<std::string>>* batch) {
+        if(explainer && explainer->wants(seconds)) explainNow(seconds, batch);
+    };
+    try {
+        if(filters.empty()) {
+            const Stopwatch stopwatch;
+            run();
+            explain(stopwatch.seconds(), nullptr);
+        } else {
+            for(std::size_t i = 0; i < filters.size(); i++) {
+                if(i != batched) ps.bind(i, toArray(*filters[i].values));
+            }
+            // One pass over the batched keys, which may be streamed from
+            // spilled runs.
+            std::vector<std::optional<std::string>> batch;
+            batch.reserve(std::min(sizer.size(), filters[batched].values->size()));
+            const bool savepoints = deadline && conn.is_transaction_uncommitted();
+            // Returns whether the batch ran to its end rather than being
+            // cancelled, with its rows passed on.
+            const auto timed = [&](Watchdog::Deadline armed) {
+                std::vector<pgfe::Row> held;
+                bool holding = true;
+                bool dropped = false;
+                std::optional<pgfe::Transaction_guard> savepoint;
+                if(savepoints) savepoint.emplace(conn, true, "subset_batch");
+                try {
+                    ps.execute([&](auto&& r) {
+                        if(holding && held.size() < deadline->heldRows) {
+                            held.push_back(std::move(r));
+                            return;
+                        } else if(holding) {
+                            // Cancelled meanwhile, which a completion
+                            // doesn't undo: the rows dropped have to be read
+                            // again.
+                            dropped = armed.disarm();
+                            if(dropped) return;
+                            holding = false;
+                            for(const auto& h : held) onRow(h);
+                            rows += held.size();
+                            held.clear();
+                        }
+                        onRow(r);
+                        rows++;
+                    });
+                } catch(const pgfe::Server_exception& e) {
+                    if(!holding || std::string_view{e.error().sqlstate()} != "57014" || !armed.disarm()) throw;
+                    dropped = true;
+                }
+                // Cancelled after the last row, the cancel may still be
+                // pending on the server: rolled back and read again like one
+                // that failed the query.
+                if(armed.disarm()) dropped = true;
+                if(dropped && savepoint) savepoint->rollback();
+                if(!dropped) {
+                    for(const auto& h : held) onRow(h);
+                    rows += held.size();
+                }
+                if(savepoint) savepoint->commit();
+                return !dropped;
+            };
+            const auto runBatch = [&](const auto& self, const std::vector<std::optional<std::string>>& keys) -> void {
+                const Stopwatch stopwatch;
+                const TraceSpan span{"extract", "batch"};
+                ps.bind(batched, keys);
+                const bool splittable = deadline && keys.size() / 2 >= deadline->minimum;
+                if(!splittable) run();
+                else if(!timed(watchdog().arm(conn, deadline->timeout))) {
+                    const double seconds = stopwatch.seconds();
+                    if(deadline->onCancel) deadline->onCancel(keys.size(), seconds);
+                    sizer.observe(keys.size(), seconds);
+                    const auto middle = keys.begin() + static_cast<std::ptrdiff_t>(keys.size() / 2);
+                    self(self, std::vector<std::optional<std::string>>{keys.begin(), middle});
+                    self(self, std::vector<std::optional<std::string>>{middle, keys.end()});
+                    return;
+                }
+                sizer.observe(keys.size(), stopwatch.seconds());
+                liveMetrics().sourceLatency.observe(stopwatch.seconds());
+                explain(stopwatch.seconds(), &keys);
+            };
+#ifdef LIBPQ_HAS_PIPELINING
+            // Without a deadline the next batch is sent, with a sync of its
+            // own, before the rows of the one before are read: the server
+            // runs it as soon as it's done with the one before, so its round
+            // trip and its planning pass while the client consumes. A batch
+            // takes from the end of the one before to its own end. One to
+            // explain drains the pipeline, which EXPLAIN can't run in.
+            std::deque<std::vector<std::optional<std::string>>> inFlight;
+            Stopwatch draining;
+            const auto drain = [&](const auto& self) -> void {
+                const auto keys = std::move(inFlight.front());
+                inFlight.pop_front();
+                {
+                    const TraceSpan span{"extract", "batch"};
+                    while(conn.wait_response_throw()) {
+                        if(auto r = conn.row()) {
+                            onRow(r);
+                            rows++;
+                        } else {
+                            conn.completion();
+                            break;
+                        }
+                    }
+                    conn.wait_response_throw();
+                    conn.ready_for_query();
+                }
+                const double seconds = draining.seconds();
+                draining = Stopwatch{};
+                sizer.observe(keys.size(), seconds);
+                liveMetrics().sourceLatency.observe(seconds);
+                if(explainer && explainer->wants(seconds)) {
+                    while(!inFlight.empty()) self(self);
+                    conn.set_pipeline_enabled(false);
+                    explainNow(seconds, &keys);
+                }
+            };
+            const auto send = [&] {
+                if(conn.pipeline_status() == pgfe::Pipeline_status::disabled) {
+                    conn.set_pipeline_enabled(true);
+                    draining = Stopwatch{};
+                }
+                ps.bind(batched, batch);
+                ps.execute_nio();
+                conn.send_sync();
+                inFlight.push_back(std::move(batch));
+                batch.clear();
+                if(inFlight.size() > 1) drain(drain);
+            };
+#endif
+            const auto flush = [&] {
+#ifdef LIBPQ_HAS_PIPELINING
+                if(!deadline) return send();
+#endif
+                runBatch(runBatch, batch);
+                batch.clear();
+            };
+            try {
+                filters[batched].values->forEachText([&](std::string_view value) {
+                    batch.emplace_back(value);
+                    if(batch.size() >= sizer.size()) flush();
+                });
+                if(!batch.empty()) flush();
+#ifdef LIBPQ_HAS_PIPELINING
+                while(!inFlight.empty()) drain(drain);
+                if(conn.pipeline_status() != pgfe::Pipeline_status::disabled) conn.set_pipeline_enabled(false);
+#endif
+            } catch(...) {
+#ifdef LIBPQ_HAS_PIPELINING
+                // Skip whatever is left of the aborted pipeline.
+                if(conn.pipeline_status() != pgfe::Pipeline_status::disabled) {
+                    try {
+                        while(conn.has_uncompleted_request()) {
+                            conn.wait_response();
+                            conn.ready_for_query();
+                            conn.error();
+                            conn.row();
+                            conn.completion();
+                        }
+                        conn.set_pipeline_enabled(false);
+                    } catch(...) {}
+                }
+#endif
+                throw;
+            }
+        }
+    } catch(...) {
+        if(conn.is_ready_for_request()) {
+            for(const auto* prepared : {&name, &explainName}) {
+                try {
+                    conn.unprepare(*prepared);
+                } catch(...) {}
+            }
+        }
+        throw;
+    }
+    conn.unprepare(name);
+    return rows;
+}
+
+// Appends the text-format value as a field of a CSV record in the flavour
+// COPY ... (FORMAT csv) reads back: NULL is an empty unquoted field, so an
+// empty string has to be quoted.
+inline void appendCsvField(std::string& record, std::string_view value, bool isNull) {
+    if(!isNull) appendEscaped(record, value, dmitigr::str::escape_csv_field);
+}
+
+} // namespace subset
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "components.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "planner.hpp"
+#include "schema_graph.hpp"
+#include "sql.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The shape of a run, as --profile records it: of every table extracted
+// its size, estimated and extracted, when it started and how long its
+// batches took, and of every link followed how many keys the child was read
+// with. --replay builds a dataset of the same shape from it and starts the
+// tables in the same order, so a production run's skew can be reproduced on
+// staging.
+struct ProfileTable {
+    std::string name;
+    double tableRows = 0;     // of the whole table, as estimated
+    std::uint64_t rows = 0;   // extracted
+    std::uint64_t bytes = 0;
+    std::size_t order = 0;    // the table's extraction started order-th, from 1
+    double start = 0;         // s from the extraction's start
+    double seconds = 0;
+    std::vector<double> batches; // s of each prepared batch or COPY
+};
+
+struct ProfileLink {
+    std::string parent;
+    std::string parentColumn;
+    std::string child;
+    std::string childColumn;
+    std::uint64_t keys = 0; // in the parent's key set when the child was read
+};
+
+// A profile file is tab separated, one line per record after the magic:
+//   root     <seeds> <table>
+//   table    <name> <order> <start> <seconds> <table rows> <rows> <bytes> <batch seconds, space separated>
+//   link     <keys> <parent> <parent column> <child> <child column>
+struct RunProfile {
+    static constexpr std::string_view magic = "cpp_schema profile 1";
+
+    std::string root;
+    std::uint64_t seeds = 0;
+    std::vector<ProfileTable> tables; // in the order they started
+    std::vector<ProfileLink> links;
+
+    std::string text() const {
+        std::string out{magic};
+        out += "\nroot\t" + std::to_string(seeds) + '\t' + root + '\n';
+        char number[64];
+        const auto append = [&](const char* format, double value) {
+            std::snprintf(number, sizeof(number), format, value);
+            out += number;
+        };
+        for(const auto& table : tables) {
+            out += "table\t" + table.name + '\t' + std::to_string(table.order);
+            append("\t%.6f", table.start);
+            append("\t%.6f", table.seconds);
+            append("\t%.0f", table.tableRows);
+            out += '\t' + std::to_string(table.rows) + '\t' + std::to_string(table.bytes) + '\t';
+            for(std::size_t i = 0; i < table.batches.size(); i++) append(i ? " %.6f" : "%.6f", table.batches[i]);
+            out += '\n';
+        }
+        for(const auto& link : links) {
+            out += "link\t" + std::to_string(link.keys) + '\t' + link.parent + '\t' + link.parentColumn + '\t' + link.child +
+                '\t' + link.childColumn + '\n';
+        }
+        return out;
+    }
+
+    const ProfileTable* table(const std::string& name) const {
+        const auto it = std::find_if(tables.begin(), tables.end(), [&](const ProfileTable& t) { return t.name == name; });
+        return it != tables.end() ? &*it : nullptr;
+    }
+};
+
+inline RunProfile readProfile(const std::filesystem::path& path) {
+    std::ifstream in{path};
+    std::string line;
+    if(!std::getline(in, line) || line != RunProfile::magic)
+        throw std::runtime_error{path.string() + " is not a profile of --profile"};
+    RunProfile profile;
+    const auto invalid = [&] { return std::runtime_error{"invalid line in " + path.string() + ": " + line}; };
+    while(std::getline(in, line)) {
+        std::vector<std::string> fields;
+        for(std::size_t first = 0; first <= line.size();) {
+            const auto tab = std::min(line.find('\t', first), line.size());
+            fields.push_back(line.substr(first, tab - first));
+            first = tab + 1;
+        }
+        try {
+            if(fields[0] == "root" && fields.size() == 3) {
+                profile.seeds = std::stoull(fields[1]);
+                profile.root = fields[2];
+            } else if(fields[0] == "table" && fields.size() == 9) {
+                ProfileTable& table = profile.tables.emplace_back();
+                table.name = fields[1];
+                table.order = std::stoull(fields[2]);
+                table.start = std::stod(fields[3]);
+                table.seconds = std::stod(fields[4]);
+                table.tableRows = std::stod(fields[5]);
+                table.rows = std::stoull(fields[6]);
+                table.bytes = std::stoull(fields[7]);
+                std::istringstream batches{fields[8]};
+                for(double seconds; batches >> seconds;) table.batches.push_back(seconds);
+            } else if(fields[0] == "link" && fields.size() == 6) {
+                profile.links.push_back({fields[2], fields[3], fields[4], fields[5], std::stoull(fields[1])});
+            } else if(!line.empty()) throw invalid();
+        } catch(const std::logic_error&) {
+            throw invalid();
+        }
+    }
+    if(profile.root.empty() || !profile.table(profile.root)) throw std::runtime_error{path.string() + " has no root table"};
+    return profile;
+}
+
+// Records the profile of a run as its tables are extracted. stats, if
+// given, are the tables' estimated sizes. Thread-safe.
+class ProfileRecorder {
+public:
+    ProfileRecorder(const SchemaGraph& graph, const std::vector<TableStats>& stats)
+        : graph_{graph}, tables_(graph.tableCount()), links_(graph.linkCount()) {
+        for(TableId t = 0; t < graph.tableCount() && t < stats.size(); t++) tables_[t].tableRows = stats[t].rows;
+    }
+
+    // Returns whether the extraction of table is its first, whose key sets
+    // are then recorded by linkKeys().
+    bool start(TableId table) {
+        std::lock_guard lock{mutex_};
+        if(tables_[table].order) return false;
+        tables_[table].order = ++started_;
+        tables_[table].start = stopwatch_.seconds();
+        return true;
+    }
+
+    void linkKeys(LinkId link, std::uint64_t keys) {
+        std::lock_guard lock{mutex_};
+        links_[link] = keys;
+    }
+
+    void batch(TableId table, double seconds) {
+        std::lock_guard lock{mutex_};
+        tables_[table].batches.push_back(seconds);
+    }
+
+    void finish(TableId table, std::uint64_t rows, std::uint64_t bytes, double seconds) {
+        std::lock_guard lock{mutex_};
+        tables_[table].rows += rows;
+        tables_[table].bytes += bytes;
+        tables_[table].seconds += seconds;
+    }
+
+    // The links recorded are the followed ones of a single column.
+    RunProfile profile(TableId root) const {
+        std::lock_guard lock{mutex_};
+        RunProfile profile;
+        profile.root = graph_.tableName(root);
+        profile.seeds = tables_[root].rows;
+        for(TableId t = 0; t < graph_.tableCount(); t++) {
+            if(!tables_[t].order) continue;
+            profile.tables.push_back(tables_[t]);
+            profile.tables.back().name = graph_.tableName(t);
+        }
+        std::sort(profile.tables.begin(), profile.tables.end(),
+            [](const ProfileTable& a, const ProfileTable& b) { return a.order < b.order; });
+        for(LinkId l = 0; l < graph_.linkCount(); l++) {
+            const FkLink& link = graph_.link(l);
+            if(!links_[l] || link.arity != 1 || !tables_[link.child].order || !tables_[link.parent].order) continue;
+            profile.links.push_back({graph_.tableName(link.parent), graph_.columnName(link.parentColumn),
+                graph_.tableName(link.child), graph_.columnName(link.childColumn), *links_[l]});
+        }
+        return profile;
+    }
+
+    void write(const std::filesystem::path& path, TableId root) const {
+        std::ofstream out{path, std::ios::trunc};
+        out << profile(root).text();
+        if(!out) throw std::runtime_error{"cannot write " + path.string()};
+    }
+
+private:
+    const SchemaGraph& graph_;
+    mutable std::mutex mutex_;
+    const Stopwatch stopwatch_;
+    std::size_t started_ = 0;
+    std::vector<ProfileTable> tables_;
+    std::vector<std::optional<std::uint64_t>> links_;
+};
+
+// Creates the tables of profile in schema and fills them to its shape. Every
+// table has an id bigint primary key, a bigint for each column a link
+// references or references with, and a text padding its rows to the width
+// recorded. Of a table's rows, 1 to its extracted rows reference the first
+// keys of their parents, as many as the link was read with, and those after
+// reference the parents' rows beyond their extracted ones: the root's seeds
+// being its first rows, the subset read again is of the recorded sizes. The
+// foreign keys are added NOT VALID once the rows are in.
+//
+// A dataset built before is reused when every table is there with its rows,
+// ids 1 to its size, so that replays after the first start right away; with
+// rebuild the tables are dropped and built again. Tables there only in part
+// are an error rather than dropped unasked.
+inline void buildReplayDataset(pgfe::Connection& conn, const RunProfile& profile, const std::string& schema, bool rebuild,
+    Logger& logger) {
+    using dmitigr::pgfe::to;
+    const auto qualified = [&](const std::string& table) { return quoteIdentifier(schema) + '.' + quoteIdentifier(table); };
+    const auto size = [](const ProfileTable& table) {
+        return std::max<std::uint64_t>(table.rows, static_cast<std::uint64_t>(std::llround(table.tableRows)));
+    };
+    std::vector<std::optional<std::string>> names;
+    for(const auto& table : profile.tables) names.emplace_back(table.name);
+    std::unordered_set<std::string> existing;
+    conn.execute([&](auto&& r) { existing.insert(to<std::string>(r[0])); }, R"(
+        SELECT c.relname FROM pg_catalog.pg_class c
+        JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+        WHERE n.nspname = $1 AND c.relname = ANY($2) AND c.relkind IN ('r', 'p'))", schema, names);
+    if(rebuild) {
+        for(const auto& name : existing) conn.execute("DROP TABLE IF EXISTS " + qualified(name) + " CASCADE");
+    } else if(!existing.empty()) {
+        std::string mismatched = existing.size() < profile.tables.size() ? "some tables missing" : "";
+        for(const auto& table : profile.tables) {
+            if(!mismatched.empty()) break;
+            std::optional<std::uint64_t> rows;
+            conn.execute([&](auto&& r) {
+                if(r[0]) rows = to<std::uint64_t>(r[0]);
+            }, "SELECT max(id)::int8 FROM " + qualified(table.name));
+            if(rows.value_or(0) != size(table)) mismatched = table.name + " not of its recorded size";
+        }
+        if(!mismatched.empty()) {
+            throw std::runtime_error{"--replay: " + schema + " holds a dataset other than the profile's (" + mismatched +
+                "); --replay-rebuild drops its tables and builds them again"};
+        }
+        logger.info([&] { return "Replay: reusing the dataset built in " + schema; });
+        return;
+    }
+    conn.execute("CREATE SCHEMA IF NOT EXISTS " + quoteIdentifier(schema));
+    for(const auto& table : profile.tables) {
+        const std::uint64_t rows = size(table);
+        const std::size_t digits = std::to_string(rows).size() + 1;
+        std::string columns = "id bigint PRIMARY KEY";
+        std::string values = "g";
+        std::size_t width = digits;
+        std::unordered_set<std::string> named{"id"};
+        for(const auto& link : profile.links) {
+            if(link.parent != table.name || !named.insert(link.parentColumn).second) continue;
+            columns += ", " + quoteIdentifier(link.parentColumn) + " bigint UNIQUE";
+            values += ", g";
+            width += digits;
+        }
+        for(const auto& link : profile.links) {
+            if(link.child != table.name || !named.insert(link.childColumn).second) continue;
+            const ProfileTable* parent = profile.table(link.parent);
+            const std::uint64_t parentRows = parent ? size(*parent) : 0;
+            const std::uint64_t parentExtracted = parent ? parent->rows : 0;
+            const std::uint64_t keys = std::max<std::uint64_t>(1, std::min(link.keys, parentExtracted));
+            const std::string beyond = parentRows > parentExtracted ?
+                std::to_string(parentExtracted + 1) + " + g % " + std::to_string(parentRows - parentExtracted) : "NULL";
+            columns += ", " + quoteIdentifier(link.childColumn) + " bigint";
+            values += ", CASE WHEN g <= " + std::to_string(table.rows) + " THEN 1 + (g - 1) % " + std::to_string(keys) +
+                " ELSE " + beyond + " END";
+            width += digits;
+        }
+        const std::uint64_t recorded = table.rows ? table.bytes / table.rows : 0;
+        const std::uint64_t pad = recorded > width + 1 ? recorded - width - 1 : 0;
+        conn.execute("CREATE TABLE " + qualified(table.name) + " (" + columns + ", pad text)");
+        conn.execute("INSERT INTO " + qualified(table.name) + " SELECT " + values + ", repeat('x', " +
+            std::to_string(pad) + ") FROM generate_series(1, " + std::to_string(rows) + "::bigint) g");
+        logger.info([&] { return "Replay: " + table.name + " built with " + std::to_string(rows) + " rows"; });
+    }
+    for(const auto& link : profile.links) {
+        conn.execute("ALTER TABLE " + qualified(link.child) + " ADD FOREIGN KEY (" + quoteIdentifier(link.childColumn) +
+            ") REFERENCES " + qualified(link.parent) + " (" + quoteIdentifier(link.parentColumn) + ") NOT VALID");
+    }
+    for(const auto& table : profile.tables) conn.execute("ANALYZE " + qualified(table.name));
+}
+
+// Ranks which start the components in the order the profile's run started
+// their tables; those it didn't start come last.
+inline std::vector<double> replayRanks(const SchemaGraph& graph, const Components& components, const RunProfile& profile) {
+    std::unordered_map<std::string, std::size_t> order;
+    for(const auto& table : profile.tables) order.emplace(table.name, table.order);
+    std::vector<double> ranks(components.count(), -static_cast<double>(profile.tables.size() + 1));
+    for(std::uint32_t c = 0; c < components.count(); c++) {
+        for(const TableId t : components.members[c]) {
+            if(const auto it = order.find(graph.tableName(t)); it != order.end())
+                ranks[c] = std::max(ranks[c], -static_cast<double>(it->second));
+        }
+    }
+    return ranks;
+}
+
+} // namespace subset
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Thrown in place of an error once the rows of a unit of work may have been
+// committed to the target, when another attempt could load them twice.
+class FinalError final : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Whether error may pass by itself: the connection broke, the server rolled
+// the transaction back over a serialization failure or a deadlock, or it is
+// restarting or out of connections. An error in the data or in a statement
+// would come back on every attempt.
+inline bool isTransient(const std::exception_ptr& error) {
+    try {
+        std::rethrow_exception(error);
+    } catch(const FinalError&) {
+        return false;
+    } catch(const pgfe::Server_exception& e) {
+        const std::string_view state = e.error().sqlstate();
+        return state.starts_with("08") || state == "40001" || state == "40P01" || state == "53300" ||
+            state == "57P01" || state == "57P02" || state == "57P03" || state == "57P05";
+    } catch(const pgfe::Client_exception& e) {
+        // The rest are the socket, the connection or a timeout.
+        const auto condition = e.condition();
+        return condition != pgfe::Client_errc::malformed_literal && condition != pgfe::Client_errc::improper_value_type &&
+            condition != pgfe::Client_errc::insufficient_dimensionality &&
+            condition != pgfe::Client_errc::excessive_dimensionality;
+    } catch(...) {
+        return false;
+    }
+}
+
+// Runs f, making whatever it throws final.
+template<typename F>
+void runFinal(F&& f) {
+    try {
+        f();
+    } catch(const FinalError&) {
+        throw;
+    } catch(const std::exception& e) {
+        throw FinalError{e.what()};
+    }
+}
+
+inline std::string describe(const std::exception_ptr& error) {
+    try {
+        std::rethrow_exception(error);
+    } catch(const std::exception& e) {
+        return e.what();
+    } catch(...) {
+        return "unknown error";
+    }
+}
+
+// How a unit of work failing transiently is retried: after a delay doubling
+// from base up to max, of which the second half is random, so that workers
+// which failed together don't come back together.
+struct RetryPolicy {
+    unsigned attempts = 0; // after the first; 0: none
+    std::chrono::milliseconds base{500};
+    std::chrono::milliseconds max{30000};
+    // Told of every retry before its delay.
+    std::function<void(const std::string& error, unsigned attempt, std::chrono::milliseconds delay)> onRetry;
+
+    // The delay before attempt, from 1.
+    std::chrono::milliseconds delay(unsigned attempt) const {
+        thread_local std::mt19937_64 random{std::random_device{}()};
+        const std::int64_t cap = std::min<std::int64_t>(max.count(), base.count() << std::min(attempt - 1, 20u));
+        return std::chrono::milliseconds{std::uniform_int_distribution<std::int64_t>{cap / 2, cap}(random)};
+    }
+};
+
+} // namespace subset
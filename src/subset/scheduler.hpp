@@ -0,0 +1,300 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "components.hpp"
+#include "live_metrics.hpp"
+#include "metrics.hpp"
+#include "retry.hpp"
+#include "schema_graph.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The number of links into each component from other components.
+inline std::vector<std::uint32_t> componentInDegrees(const SchemaGraph& graph, const Components& components) {
+    std::vector<std::uint32_t> pending(components.count(), 0);
+    for(TableId t = 0; t < graph.tableCount(); t++) {
+        for(const LinkId l : graph.supporters(t)) {
+            if(!components.internal(graph, l)) pending[components.of[t]]++;
+        }
+    }
+    return pending;
+}
+
+// Kahn's algorithm over the components, keeping the levels apart: every
+// table of a wave depends only on tables of earlier waves or of its own
+// component.
+inline std::vector<std::vector<TableId>> topologicalWaves(const SchemaGraph& graph, const Components& components) {
+    std::vector<std::uint32_t> pending = componentInDegrees(graph, components);
+    std::vector<std::vector<std::uint32_t>> waves(1);
+    for(std::uint32_t c = 0; c < components.count(); c++) {
+        if(pending[c] == 0) waves[0].push_back(c);
+    }
+    while(!waves.back().empty()) {
+        std::vector<std::uint32_t> next;
+        for(const std::uint32_t c : waves.back()) {
+            for(const TableId t : components.members[c]) {
+                for(const LinkId l : graph.dependents(t)) {
+                    if(components.internal(graph, l)) continue;
+                    const std::uint32_t child = components.of[graph.link(l).child];
+                    if(--pending[child] == 0) next.push_back(child);
+                }
+            }
+        }
+        waves.push_back(std::move(next));
+    }
+    waves.pop_back();
+
+    std::vector<std::vector<TableId>> tables(waves.size());
+    for(std::size_t w = 0; w < waves.size(); w++) {
+        for(const std::uint32_t c : waves[w]) {
+            tables[w].insert(tables[w].end(), components.members[c].begin(), components.members[c].end());
+        }
+    }
+    return tables;
+}
+
+// The upward rank of every component in list-scheduling terms (HEFT): the
+// weight of the heaviest chain from it down through its dependents, a
+// component weighing the costs of its tables. Started by rank, the chain
+// bounding the makespan doesn't wait behind a small leaf.
+inline std::vector<double> criticalPathRanks(const SchemaGraph& graph, const Components& components,
+    const std::vector<double>& costs) {
+    std::vector<std::uint32_t> pending = componentInDegrees(graph, components);
+    std::vector<std::uint32_t> order;
+    for(std::uint32_t c = 0; c < components.count(); c++) {
+        if(pending[c] == 0) order.push_back(c);
+    }
+    for(std::size_t i = 0; i < order.size(); i++) {
+        for(const TableId t : components.members[order[i]]) {
+            for(const LinkId l : graph.dependents(t)) {
+                if(components.internal(graph, l)) continue;
+                const std::uint32_t child = components.of[graph.link(l).child];
+                if(--pending[child] == 0) order.push_back(child);
+            }
+        }
+    }
+    std::vector<double> ranks(components.count(), 0);
+    for(auto it = order.rbegin(); it != order.rend(); ++it) {
+        double below = 0;
+        for(const TableId t : components.members[*it]) {
+            ranks[*it] += costs[t];
+            for(const LinkId l : graph.dependents(t)) {
+                if(!components.internal(graph, l)) below = std::max(below, ranks[components.of[graph.link(l).child]]);
+            }
+        }
+        ranks[*it] += below;
+    }
+    return ranks;
+}
+
+// The components ready to run, each one made ready as soon as all of its
+// supporters outside of it have finished. Components whose tables are all
+// marked in done, if given, count as finished already. Of the components
+// ready, the one of the highest rank comes first, if ranks are given.
+class ComponentQueue {
+public:
+    ComponentQueue(const SchemaGraph& graph, const Components& components, const std::vector<bool>& done,
+        const std::vector<double>& ranks)
+        : graph_(graph), components_(components), ranks_(ranks), pending_(componentInDegrees(graph, components)) {
+        const auto isDone = [&](std::uint32_t c) {
+            return std::all_of(components.members[c].begin(), components.members[c].end(),
+                [&](TableId t) { return t < done.size() && done[t]; });
+        };
+        std::vector<std::uint32_t> finished;
+        for(std::uint32_t c = 0; c < components.count(); c++) {
+            if(pending_[c] == 0) finished.push_back(c);
+        }
+        while(!finished.empty()) {
+            const std::uint32_t c = finished.back();
+            finished.pop_back();
+            if(isDone(c)) release(c, finished);
+            else ready_.push_back(c);
+        }
+    }
+
+    bool empty() const { return ready_.empty(); }
+
+    std::uint32_t pop() {
+        if(!ranks_.empty()) {
+            std::iter_swap(std::max_element(ready_.begin(), ready_.end(),
+                [&](std::uint32_t a, std::uint32_t b) { return ranks_[a] < ranks_[b]; }), ready_.end() - 1);
+        }
+        const std::uint32_t component = ready_.back();
+        ready_.pop_back();
+        return component;
+    }
+
+    void finish(std::uint32_t component) { release(component, ready_); }
+
+private:
+    const SchemaGraph& graph_;
+    const Components& components_;
+    const std::vector<double>& ranks_;
+    std::vector<std::uint32_t> pending_;
+    std::vector<std::uint32_t> ready_;
+
+    void release(std::uint32_t c, std::vector<std::uint32_t>& into) {
+        for(const TableId t : components_.members[c]) {
+            for(const LinkId l : graph_.dependents(t)) {
+                if(components_.internal(graph_, l)) continue;
+                const std::uint32_t child = components_.of[graph_.link(l).child];
+                if(--pending_[child] == 0) into.push_back(child);
+            }
+        }
+    }
+};
+
+// All connections of the pool, waiting a moment for one out for a
+// background check.
+inline std::vector<pgfe::Connection_pool::Handle> acquireAll(pgfe::Connection_pool& pool) {
+    std::vector<pgfe::Connection_pool::Handle> handles;
+    for(std::size_t i = 0; i < pool.size(); i++) {
+        const Stopwatch stopwatch;
+        auto handle = pool.acquire(std::chrono::seconds{1});
+        liveMetrics().poolWait.observe(stopwatch.seconds());
+        if(!handle.is_valid()) break;
+        handles.push_back(std::move(handle));
+    }
+    if(handles.empty())
+        throw std::runtime_error{"no free connection in the pool"};
+    return handles;
+}
+
+using ComponentTask = std::function<void(const std::vector<TableId>&, pgfe::Connection&)>;
+
+// Runs task for every component on the connections of the pool, one worker
+// thread per connection, in the order of a ComponentQueue. A task failing
+// transiently is run again as retry has it, on a fresh connection of the
+// pool, the broken one being closed on its way back. The first exception
+// thrown by a task for good stops the scheduling and is rethrown once the
+// running tasks have returned.
+inline void runInDependencyOrder(const SchemaGraph& graph, const Components& components, pgfe::Connection_pool& pool,
+    const ComponentTask& task, const std::vector<bool>& done = {}, const std::vector<double>& ranks = {},
+    const RetryPolicy& retry = {}) {
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    ComponentQueue queue{graph, components, done, ranks};
+    std::size_t running = 0;
+    std::exception_ptr failure;
+
+    const auto worker = [&](pgfe::Connection_pool::Handle& handle) {
+        std::unique_lock lock{mutex};
+        while(true) {
+            // A worker waiting with work left is a stall of the schedule.
+            const auto ready = [&] { return !queue.empty() || running == 0 || failure; };
+            if(!ready()) {
+                const TraceSpan span{"schedule", "wait"};
+                wakeup.wait(lock, ready);
+            }
+            if(failure || queue.empty()) break;
+            const std::uint32_t component = queue.pop();
+            running++;
+
+            lock.unlock();
+            std::exception_ptr error;
+            for(unsigned attempt = 1;; attempt++) {
+                try {
+                    if(!handle) handle = pool.acquire();
+                    task(components.members[component], *handle);
+                    error = nullptr;
+                    break;
+                } catch(...) {
+                    error = std::current_exception();
+                }
+                if(attempt > retry.attempts || !isTransient(error)) break;
+                lock.lock();
+                const bool stopping = static_cast<bool>(failure);
+                lock.unlock();
+                if(stopping) break;
+                const auto delay = retry.delay(attempt);
+                if(retry.onRetry) retry.onRetry(describe(error), attempt, delay);
+                handle.release();
+                const TraceSpan span{"schedule", "retry"};
+                std::this_thread::sleep_for(delay);
+            }
+            lock.lock();
+
+            running--;
+            if(error && !failure) failure = error;
+            if(!error) queue.finish(component);
+            wakeup.notify_all();
+        }
+    };
+
+    std::vector<pgfe::Connection_pool::Handle> handles = acquireAll(pool);
+    std::vector<std::thread> threads;
+    threads.reserve(handles.size());
+    for(auto& handle : handles) threads.emplace_back(withTracer(worker), std::ref(handle));
+    for(auto& thread : threads) thread.join();
+    if(failure) std::rethrow_exception(failure);
+}
+
+using AsyncComponentTask = std::function<pgfe::Task<void>(const std::vector<TableId>&, pgfe::Connection&)>;
+
+// Like runInDependencyOrder, but the connections are driven by the calling
+// thread alone: the tasks are coroutines suspended on a pgfe::Event_reactor
+// while their connections wait for the server.
+inline void runInDependencyOrderAsync(const SchemaGraph& graph, const Components& components,
+    pgfe::Connection_pool& pool, const AsyncComponentTask& task, const std::vector<bool>& done = {},
+    const std::vector<double>& ranks = {}) {
+    pgfe::Event_reactor reactor;
+    ComponentQueue queue{graph, components, done, ranks};
+    std::size_t running = 0;
+    std::exception_ptr failure;
+    std::vector<std::coroutine_handle<>> idle;
+
+    // Suspends a worker with nothing to run until a component finishes.
+    struct Idle {
+        std::vector<std::coroutine_handle<>>& idle;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { idle.push_back(handle); }
+        void await_resume() const noexcept {}
+    };
+    const auto wakeAll = [&] {
+        for(const auto handle : idle) reactor.post(handle);
+        idle.clear();
+    };
+    const auto worker = [&](pgfe::Connection& conn) -> pgfe::Task<void> {
+        while(true) {
+            if(failure || (queue.empty() && running == 0)) break;
+            if(queue.empty()) {
+                co_await Idle{idle};
+                continue;
+            }
+            const std::uint32_t component = queue.pop();
+            running++;
+            std::exception_ptr error;
+            try {
+                co_await task(components.members[component], conn);
+            } catch(...) {
+                error = std::current_exception();
+            }
+            running--;
+            if(error && !failure) failure = error;
+            if(!error) queue.finish(component);
+            wakeAll();
+        }
+    };
+
+    std::vector<pgfe::Connection_pool::Handle> handles = acquireAll(pool);
+    for(auto& handle : handles) reactor.spawn(worker(*handle));
+    reactor.run();
+    if(failure) std::rethrow_exception(failure);
+}
+
+} // namespace subset
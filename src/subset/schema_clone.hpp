@@ -0,0 +1,429 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "log.hpp"
+#include "schema_graph.hpp"
+#include "sql.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The relations of the schema a clone creates: the discovered tables and
+// the partitions of those partitioned.
+inline const std::string clonedRelationsQuery = R"(
+        SELECT c.oid FROM pg_catalog.pg_class c
+        JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+        LEFT JOIN pg_catalog.pg_inherits i ON i.inhrelid = c.oid AND c.relispartition
+        LEFT JOIN pg_catalog.pg_class p ON p.oid = i.inhparent
+        WHERE n.nspname = $1 AND c.relkind IN ('r', 'p') AND (c.relname = ANY($2) OR p.relname = ANY($2)))";
+
+// The DDL of the discovered tables of the source, read in a query per kind
+// of object and run on the target in waves, each one's statements side by
+// side on as many connections: the schema's types the columns use, by
+// their dependencies; the sequences of the column defaults and the
+// functions the defaults and checks call; the domains' defaults and
+// checks, which may call those functions; the tables, then their
+// partitions; the primary key, unique, exclusion and check constraints,
+// a statement per table; the foreign keys, a statement per table one after
+// another, as they lock the tables on both sides; and the other indexes.
+// The tables are empty, so the constraints are valid and the indexes built
+// at no cost; --defer-indexes moves the indexes after the load as usual.
+// Tables the target has already are left as they are, with their
+// constraints and indexes, and so are its types of the same names.
+class SchemaClone {
+public:
+    SchemaClone(pgfe::Connection& source, const SchemaGraph& graph, const std::string& schema) : schema_{schema} {
+        using dmitigr::pgfe::to;
+        // pgfe converts containers of optionals to array literals.
+        std::vector<std::optional<std::string>> tables;
+        for(TableId t = 0; t < graph.tableCount(); t++) tables.emplace_back(graph.tableName(t));
+
+        std::unordered_set<std::int64_t> typesUsed;
+        source.execute([&](auto&& r) {
+            Table& table = tables_.emplace_back();
+            table.oid = to<std::int64_t>(r["oid"]);
+            table.name = to<std::string>(r["table_name"]);
+            table.parent = to<std::string>(r["parent_name"]);
+            table.bound = to<std::string>(r["bound"]);
+            table.partitionKey = to<std::string>(r["partition_key"]);
+        }, R"(
+            SELECT c.oid::int8 AS oid, c.relname AS table_name, coalesce(p.relname, '') AS parent_name,
+                coalesce(pg_catalog.pg_get_expr(c.relpartbound, c.oid), '') AS bound,
+                coalesce(pg_catalog.pg_get_partkeydef(c.oid), '') AS partition_key
+            FROM pg_catalog.pg_class c
+            LEFT JOIN pg_catalog.pg_inherits i ON i.inhrelid = c.oid AND c.relispartition
+            LEFT JOIN pg_catalog.pg_class p ON p.oid = i.inhparent
+            WHERE c.oid IN ()" + clonedRelationsQuery + R"()
+            ORDER BY c.relname)", schema, tables);
+        std::unordered_map<std::int64_t, Table*> byOid;
+        for(auto& table : tables_) byOid[table.oid] = &table;
+
+        source.execute([&](auto&& r) {
+            Table& table = *byOid.at(to<std::int64_t>(r["oid"]));
+            std::string column = quoteIdentifier(to<std::string>(r["column_name"])) + ' ' + to<std::string>(r["type_name"]);
+            if(r["collation"]) column += " COLLATE " + to<std::string>(r["collation"]);
+            const auto identity = to<std::string>(r["identity"]);
+            const auto generated = to<std::string>(r["generated"]);
+            const auto defaultExpr = to<std::string>(r["default_expr"]);
+            if(identity == "a") column += " GENERATED ALWAYS AS IDENTITY";
+            else if(identity == "d") column += " GENERATED BY DEFAULT AS IDENTITY";
+            else if(generated == "s") column += " GENERATED ALWAYS AS (" + defaultExpr + ") STORED";
+            else if(!defaultExpr.empty()) column += " DEFAULT " + defaultExpr;
+            if(to<bool>(r["not_null"])) column += " NOT NULL";
+            table.columns.push_back(std::move(column));
+            typesUsed.insert(to<std::int64_t>(r["type_oid"]));
+        }, R"(
+            SELECT a.attrelid::int8 AS oid, a.attname AS column_name,
+                pg_catalog.format_type(a.atttypid, a.atttypmod) AS type_name,
+                CASE WHEN t.typcategory = 'A' THEN t.typelem ELSE t.oid END::int8 AS type_oid,
+                CASE WHEN a.attcollation <> t.typcollation
+                    THEN pg_catalog.quote_ident(cn.nspname) || '.' || pg_catalog.quote_ident(co.collname) END AS collation,
+                a.attnotnull AS not_null, a.attidentity::text AS identity, a.attgenerated::text AS generated,
+                coalesce(pg_catalog.pg_get_expr(d.adbin, d.adrelid), '') AS default_expr
+            FROM pg_catalog.pg_attribute a
+            JOIN pg_catalog.pg_type t ON t.oid = a.atttypid
+            LEFT JOIN pg_catalog.pg_collation co ON co.oid = a.attcollation
+            LEFT JOIN pg_catalog.pg_namespace cn ON cn.oid = co.collnamespace
+            LEFT JOIN pg_catalog.pg_attrdef d ON d.adrelid = a.attrelid AND d.adnum = a.attnum
+            WHERE a.attrelid IN ()" + clonedRelationsQuery + R"() AND a.attnum > 0 AND NOT a.attisdropped
+            ORDER BY a.attrelid, a.attnum)", schema, tables);
+
+        // The types of the schema, kept if a column uses them or a type kept
+        // depends on them.
+        struct Type {
+            std::string name;
+            std::string statement;
+            std::vector<std::int64_t> dependencies;
+        };
+        std::map<std::int64_t, Type> types;
+        source.execute([&](auto&& r) {
+            Type& type = types[to<std::int64_t>(r["oid"])];
+            type.name = to<std::string>(r["type_name"]);
+            type.statement = to<std::string>(r["statement"]);
+            std::istringstream dependencies{to<std::string>(r["dependencies"])};
+            for(std::string oid; std::getline(dependencies, oid, ',');) type.dependencies.push_back(std::stoll(oid));
+        }, R"(
+            SELECT t.oid::int8 AS oid, t.typname AS type_name,
+                CASE t.typtype
+                WHEN 'e' THEN 'CREATE TYPE ' || t.oid::regtype::text || ' AS ENUM (' || coalesce((SELECT
+                    string_agg(pg_catalog.quote_literal(e.enumlabel), ', ' ORDER BY e.enumsortorder)
+                    FROM pg_catalog.pg_enum e WHERE e.enumtypid = t.oid), '') || ')'
+                WHEN 'd' THEN 'CREATE DOMAIN ' || t.oid::regtype::text || ' AS ' ||
+                    pg_catalog.format_type(t.typbasetype, t.typtypmod) || CASE WHEN t.typnotnull THEN ' NOT NULL' ELSE '' END
+                ELSE 'CREATE TYPE ' || t.oid::regtype::text || ' AS (' || coalesce((SELECT
+                    string_agg(pg_catalog.quote_ident(a.attname) || ' ' || pg_catalog.format_type(a.atttypid, a.atttypmod),
+                        ', ' ORDER BY a.attnum)
+                    FROM pg_catalog.pg_attribute a WHERE a.attrelid = t.typrelid AND a.attnum > 0 AND NOT a.attisdropped), '') || ')'
+                END AS statement,
+                array_to_string(ARRAY(
+                    SELECT CASE WHEN d.typcategory = 'A' THEN d.typelem ELSE d.oid END FROM pg_catalog.pg_type d
+                    WHERE d.oid = t.typbasetype OR d.oid IN (SELECT a.atttypid FROM pg_catalog.pg_attribute a
+                        WHERE a.attrelid = t.typrelid AND a.attnum > 0 AND NOT a.attisdropped)), ',') AS dependencies
+            FROM pg_catalog.pg_type t
+            JOIN pg_catalog.pg_namespace n ON n.oid = t.typnamespace
+            LEFT JOIN pg_catalog.pg_class c ON c.oid = t.typrelid
+            WHERE n.nspname = $1 AND (t.typtype IN ('e', 'd') OR (t.typtype = 'c' AND c.relkind = 'c')))", schema);
+        // Dependencies first, a wave per depth.
+        std::map<std::int64_t, std::size_t> depth;
+        const auto visit = [&](auto& self, std::int64_t oid, std::size_t level) -> void {
+            const auto it = types.find(oid);
+            if(it == types.end() || level > types.size()) return; // not of the schema, or a cycle
+            if(auto [d, added] = depth.emplace(oid, level); !added) {
+                if(d->second >= level) return;
+                d->second = level;
+            }
+            for(const auto dependency : it->second.dependencies) self(self, dependency, level + 1);
+        };
+        for(const auto oid : typesUsed) visit(visit, oid, 0);
+        std::size_t deepest = 0;
+        for(const auto& [oid, level] : depth) deepest = std::max(deepest, level);
+        typeWaves_.resize(depth.empty() ? 0 : deepest + 1);
+        for(const auto& [oid, level] : depth)
+            typeWaves_[deepest - level].push_back({types[oid].name, types[oid].statement});
+        std::vector<std::optional<std::string>> clonedTypes;
+        for(const auto& [oid, level] : depth) clonedTypes.emplace_back(std::to_string(oid));
+
+        // The domains' defaults and checks, added once the functions they
+        // may call are there.
+        source.execute([&](auto&& r) {
+            if(depth.count(to<std::int64_t>(r["oid"])))
+                domainAlterations_.push_back({to<std::string>(r["type_name"]), to<std::string>(r["statement"])});
+        }, R"(
+            SELECT t.oid::int8 AS oid, t.typname AS type_name,
+                'ALTER DOMAIN ' || t.oid::regtype::text || ' SET DEFAULT ' || t.typdefault AS statement
+            FROM pg_catalog.pg_type t
+            JOIN pg_catalog.pg_namespace n ON n.oid = t.typnamespace
+            WHERE n.nspname = $1 AND t.typtype = 'd' AND t.typdefault IS NOT NULL
+            UNION ALL
+            SELECT t.oid::int8, t.typname, 'ALTER DOMAIN ' || t.oid::regtype::text || ' ADD CONSTRAINT ' ||
+                pg_catalog.quote_ident(con.conname) || ' ' || pg_catalog.pg_get_constraintdef(con.oid)
+            FROM pg_catalog.pg_constraint con
+            JOIN pg_catalog.pg_type t ON t.oid = con.contypid
+            JOIN pg_catalog.pg_namespace n ON n.oid = t.typnamespace
+            WHERE n.nspname = $1 AND con.contype = 'c'
+            ORDER BY 1, 3)", schema);
+
+        source.execute([&](auto&& r) {
+            sequences_.push_back({to<std::string>(r["statement"]), to<std::string>(r["owned_by"]),
+                to<std::string>(r["sequence"])});
+        }, R"(
+            SELECT DISTINCT s.seqrelid::regclass::text AS sequence,
+                'CREATE SEQUENCE IF NOT EXISTS ' || s.seqrelid::regclass::text || ' AS ' ||
+                    pg_catalog.format_type(s.seqtypid, NULL) || ' INCREMENT ' || s.seqincrement || ' MINVALUE ' ||
+                    s.seqmin || ' MAXVALUE ' || s.seqmax || ' START ' || s.seqstart || ' CACHE ' || s.seqcache ||
+                    CASE WHEN s.seqcycle THEN ' CYCLE' ELSE '' END AS statement,
+                coalesce((SELECT oc.oid::regclass::text || '.' || pg_catalog.quote_ident(a.attname)
+                    FROM pg_catalog.pg_depend od
+                    JOIN pg_catalog.pg_class oc ON oc.oid = od.refobjid
+                    JOIN pg_catalog.pg_attribute a ON a.attrelid = od.refobjid AND a.attnum = od.refobjsubid
+                    WHERE od.classid = 'pg_catalog.pg_class'::regclass AND od.objid = s.seqrelid AND od.deptype = 'a'
+                        AND od.refobjid IN ()" + clonedRelationsQuery + R"()), '') AS owned_by
+            FROM pg_catalog.pg_attrdef ad
+            JOIN pg_catalog.pg_depend d ON d.classid = 'pg_catalog.pg_attrdef'::regclass AND d.objid = ad.oid
+                AND d.refclassid = 'pg_catalog.pg_class'::regclass
+            JOIN pg_catalog.pg_sequence s ON s.seqrelid = d.refobjid
+            WHERE ad.adrelid IN ()" + clonedRelationsQuery + R"()
+            ORDER BY 1)", schema, tables);
+
+        // The functions of the column and domain defaults and of the table
+        // and cloned domains' checks, but those of the system and of
+        // extensions.
+        source.execute([&](auto&& r) { functions_.push_back(to<std::string>(r["definition"])); }, R"(
+            SELECT DISTINCT p.oid, pg_catalog.pg_get_functiondef(p.oid) AS definition
+            FROM pg_catalog.pg_depend d
+            JOIN pg_catalog.pg_proc p ON p.oid = d.refobjid AND d.refclassid = 'pg_catalog.pg_proc'::regclass
+            JOIN pg_catalog.pg_namespace n ON n.oid = p.pronamespace
+            LEFT JOIN pg_catalog.pg_attrdef ad ON d.classid = 'pg_catalog.pg_attrdef'::regclass AND ad.oid = d.objid
+            LEFT JOIN pg_catalog.pg_constraint con ON d.classid = 'pg_catalog.pg_constraint'::regclass AND con.oid = d.objid
+            WHERE n.nspname NOT IN ('pg_catalog', 'information_schema') AND p.prokind IN ('f', 'p')
+                AND NOT EXISTS (SELECT FROM pg_catalog.pg_depend e
+                    WHERE e.classid = 'pg_catalog.pg_proc'::regclass AND e.objid = p.oid AND e.deptype = 'e')
+                AND (ad.adrelid IN ()" + clonedRelationsQuery + R"() OR con.conrelid IN ()" + clonedRelationsQuery + R"()
+                    OR con.contypid = ANY($3::oid[])
+                    OR (d.classid = 'pg_catalog.pg_type'::regclass AND d.objid = ANY($3::oid[])))
+            ORDER BY p.oid)", schema, tables, clonedTypes);
+
+        // The constraints local to the tables. A foreign key to a table not
+        // cloned is left out: it may not be in the target.
+        source.execute([&](auto&& r) {
+            Table& table = *byOid.at(to<std::int64_t>(r["oid"]));
+            const std::string clause = "ADD CONSTRAINT " + quoteIdentifier(to<std::string>(r["constraint_name"])) + ' ' +
+                to<std::string>(r["definition"]);
+            const auto type = to<std::string>(r["constraint_type"]);
+            if(type != "f") table.constraints.push_back(clause);
+            else if(byOid.count(to<std::int64_t>(r["referenced"]))) table.foreignKeys.push_back(clause);
+        }, R"(
+            SELECT con.conrelid::int8 AS oid, con.conname AS constraint_name, con.contype::text AS constraint_type,
+                pg_catalog.pg_get_constraintdef(con.oid) AS definition, con.confrelid::int8 AS referenced
+            FROM pg_catalog.pg_constraint con
+            WHERE con.conrelid IN ()" + clonedRelationsQuery + R"() AND con.contype IN ('p', 'u', 'x', 'c', 'f')
+                AND con.conparentid = 0 AND con.conislocal
+            ORDER BY con.conrelid, con.contype <> 'p', con.conname)", schema, tables);
+
+        // The indexes backing no constraint, but those a partition has of
+        // its parent's.
+        source.execute([&](auto&& r) {
+            byOid.at(to<std::int64_t>(r["oid"]))->indexes.push_back(to<std::string>(r["definition"]));
+        }, R"(
+            SELECT i.indrelid::int8 AS oid, pg_catalog.pg_get_indexdef(i.indexrelid) AS definition
+            FROM pg_catalog.pg_index i
+            WHERE i.indrelid IN ()" + clonedRelationsQuery + R"()
+                AND NOT EXISTS (SELECT FROM pg_catalog.pg_constraint con WHERE con.conindid = i.indexrelid
+                    AND con.conrelid = i.indrelid)
+                AND NOT EXISTS (SELECT FROM pg_catalog.pg_inherits h WHERE h.inhrelid = i.indexrelid)
+            ORDER BY i.indexrelid)", schema, tables);
+    }
+
+    std::size_t tableCount() const { return tables_.size(); }
+
+    // Creates what the target lacks, on up to jobs connections of pool.
+    // Returns the number of tables created.
+    std::size_t apply(pgfe::Connection_pool& pool, std::size_t jobs, Logger& logger) const {
+        using dmitigr::pgfe::to;
+        std::vector<pgfe::Connection_pool::Handle> conns;
+        for(std::size_t i = 0; i < std::max<std::size_t>(jobs, 1); i++) conns.push_back(pool.acquire());
+        pgfe::Connection& lead = *conns.front();
+
+        std::set<std::string> existingTables;
+        std::set<std::string> existingTypes;
+        lead.execute([&](auto&& r) {
+            (to<bool>(r["is_type"]) ? existingTypes : existingTables).insert(to<std::string>(r["name"]));
+        }, R"(
+            SELECT c.relname AS name, false AS is_type FROM pg_catalog.pg_class c
+            JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace
+            WHERE n.nspname = $1 AND c.relkind IN ('r', 'p')
+            UNION ALL
+            SELECT t.typname, true FROM pg_catalog.pg_type t
+            JOIN pg_catalog.pg_namespace n ON n.oid = t.typnamespace
+            WHERE n.nspname = $1)", schema_);
+        lead.execute("CREATE SCHEMA IF NOT EXISTS " + quoteIdentifier(schema_));
+
+        for(const auto& wave : typeWaves_) {
+            std::vector<std::string> statements;
+            for(const auto& [name, statement] : wave) {
+                if(!existingTypes.count(name)) statements.push_back(statement);
+            }
+            run(conns, statements, logger);
+        }
+        std::vector<std::string> statements;
+        for(const auto& sequence : sequences_) statements.push_back(sequence.statement);
+        run(conns, statements, logger);
+        {
+            // Like pg_dump: the bodies may use what isn't there yet. Reset
+            // even on failure, the connections going back to the pool.
+            struct BodiesUnchecked {
+                std::vector<pgfe::Connection_pool::Handle>& conns;
+                ~BodiesUnchecked() {
+                    for(auto& conn : conns) {
+                        try {
+                            conn->execute("RESET check_function_bodies");
+                        } catch(...) {}
+                    }
+                }
+            } unchecked{conns};
+            for(auto& conn : conns) conn->execute("SET check_function_bodies = off");
+            run(conns, functions_, logger);
+        }
+        statements.clear();
+        for(const auto& [name, statement] : domainAlterations_) {
+            if(!existingTypes.count(name)) statements.push_back(statement);
+        }
+        // On the lead connection, one after another: they are few, and those
+        // of one domain lock it.
+        for(const auto& statement : statements) runOne(lead, statement, logger);
+
+        std::vector<const Table*> created;
+        for(const auto& table : tables_) {
+            if(!existingTables.count(table.name)) created.push_back(&table);
+        }
+        const auto qualified = [&](const std::string& name) { return quoteIdentifier(schema_) + '.' + quoteIdentifier(name); };
+        // A partition of a table neither cloned nor in the target is
+        // created a table of its own.
+        std::set<std::string> parents = existingTables;
+        for(const Table* table : created) parents.insert(table->name);
+        for(const bool partitions : {false, true}) {
+            statements.clear();
+            for(const Table* table : created) {
+                const bool partition = !table->parent.empty() && parents.count(table->parent);
+                if(partition != partitions) continue;
+                std::string statement = "CREATE TABLE " + qualified(table->name);
+                if(partition) statement += " PARTITION OF " + qualified(table->parent) + ' ' + table->bound;
+                else {
+                    statement += " (";
+                    for(std::size_t i = 0; i < table->columns.size(); i++) statement += (i ? ", " : "") + table->columns[i];
+                    statement += ')';
+                }
+                if(!table->partitionKey.empty()) statement += " PARTITION BY " + table->partitionKey;
+                statements.push_back(std::move(statement));
+            }
+            run(conns, statements, logger);
+        }
+        statements.clear();
+        for(const auto& sequence : sequences_) {
+            if(!sequence.ownedBy.empty()) statements.push_back("ALTER SEQUENCE " + sequence.name + " OWNED BY " + sequence.ownedBy);
+        }
+        run(conns, statements, logger);
+
+        const auto alter = [&](const Table& table, const std::vector<std::string>& clauses) {
+            std::string statement = "ALTER TABLE " + qualified(table.name);
+            for(std::size_t i = 0; i < clauses.size(); i++) statement += (i ? ", " : " ") + clauses[i];
+            return statement;
+        };
+        statements.clear();
+        for(const Table* table : created) {
+            if(!table->constraints.empty()) statements.push_back(alter(*table, table->constraints));
+        }
+        run(conns, statements, logger);
+        for(const Table* table : created) {
+            if(!table->foreignKeys.empty()) runOne(lead, alter(*table, table->foreignKeys), logger);
+        }
+        statements.clear();
+        for(const Table* table : created) statements.insert(statements.end(), table->indexes.begin(), table->indexes.end());
+        run(conns, statements, logger);
+        return created.size();
+    }
+
+private:
+    struct Table {
+        std::int64_t oid = 0;
+        std::string name;
+        std::string parent;       // the partitioned table of a partition
+        std::string bound;        // FOR VALUES of a partition
+        std::string partitionKey; // of a partitioned table
+        std::vector<std::string> columns;
+        std::vector<std::string> constraints; // ADD CONSTRAINT clauses
+        std::vector<std::string> foreignKeys; // of those
+        std::vector<std::string> indexes;
+    };
+
+    struct Sequence {
+        std::string statement;
+        std::string ownedBy; // table.column of the clone, if any
+        std::string name;
+    };
+
+    struct TypeStatement {
+        std::string name;
+        std::string statement;
+    };
+
+    static void runOne(pgfe::Connection& conn, const std::string& statement, Logger& logger) {
+        try {
+            conn.execute(statement);
+            logger.debug([&] { return "Cloned: " + statement; });
+        } catch(const std::exception& e) {
+            throw std::runtime_error{"cloning the schema failed: " + statement + ": " + e.what()};
+        }
+    }
+
+    // Runs the statements side by side on conns; the first error is thrown
+    // once they have all returned.
+    static void run(std::vector<pgfe::Connection_pool::Handle>& conns, const std::vector<std::string>& statements,
+        Logger& logger) {
+        std::atomic<std::size_t> next = 0;
+        std::mutex mutex;
+        std::exception_ptr failure;
+        std::vector<std::thread> threads;
+        for(std::size_t c = 0; c < conns.size() && c < statements.size(); c++) {
+            threads.emplace_back([&, conn = &*conns[c]] {
+                for(auto i = next++; i < statements.size(); i = next++) {
+                    try {
+                        runOne(*conn, statements[i], logger);
+                    } catch(...) {
+                        std::lock_guard lock{mutex};
+                        if(!failure) failure = std::current_exception();
+                    }
+                }
+            });
+        }
+        for(auto& thread : threads) thread.join();
+        if(failure) std::rethrow_exception(failure);
+    }
+
+    std::string schema_;
+    std::vector<Table> tables_;
+    std::vector<std::vector<TypeStatement>> typeWaves_;
+    std::vector<Sequence> sequences_;
+    std::vector<std::string> functions_;
+    std::vector<TypeStatement> domainAlterations_; // by type, run in order
+};
+
+} // namespace subset
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "pg_types.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+using TableId = std::uint32_t;
+using ColumnId = std::uint32_t;
+using LinkId = std::uint32_t;
+using NeedId = std::uint32_t;
+
+// Interns names to dense IDs. The deque keeps the strings in place so the
+// index can key on views of them.
+class NameTable {
+public:
+    NameTable() = default;
+    NameTable(const NameTable&) = delete;
+    NameTable& operator=(const NameTable&) = delete;
+    NameTable(NameTable&&) = default;
+    NameTable& operator=(NameTable&&) = default;
+
+    std::uint32_t intern(std::string_view name) {
+        if(const auto it = ids_.find(name); it != ids_.end()) return it->second;
+        const auto id = static_cast<std::uint32_t>(names_.size());
+        ids_.emplace(names_.emplace_back(name), id);
+        return id;
+    }
+
+    std::optional<std::uint32_t> find(std::string_view name) const {
+        if(const auto it = ids_.find(name); it != ids_.end()) return it->second;
+        return std::nullopt;
+    }
+
+    const std::string& name(std::uint32_t id) const { return names_[id]; }
+    std::uint32_t size() const { return static_cast<std::uint32_t>(names_.size()); }
+
+private:
+    std::deque<std::string> names_;
+    std::unordered_map<std::string_view, std::uint32_t> ids_;
+};
+
+// child.childColumn references parent.parentColumn. `need` is the key-set
+// slot holding the values of parent.parentColumn collected during the walk.
+// A composite foreign key has arity columns on either side, the graph's
+// childColumns(link) and parentColumns(link), of which childColumn and
+// parentColumn are the first.
+struct FkLink {
+    TableId child;
+    TableId parent;
+    ColumnId childColumn;
+    ColumnId parentColumn;
+    NeedId need;
+    std::uint32_t columns = 0; // offset of the columns in the graph's
+    std::uint32_t arity = 1;
+};
+
+struct GraphColumn {
+    ColumnId name;
+    bool isNullable;
+    PGDataType dataType;
+};
+
+// The FK dependency graph with both directions in compressed sparse row form:
+// supporters(t) are the links of t to the tables it depends on, dependents(t)
+// the links of the tables depending on t. needs(t) are the key-set slots of
+// the columns of t that dependents reference, one per column or, for a
+// composite key, per tuple of columns.
+class SchemaGraph {
+public:
+    NameTable tables;
+    NameTable columns;
+
+    TableId tableCount() const { return tables.size(); }
+    std::optional<TableId> findTable(std::string_view name) const { return tables.find(name); }
+    const std::string& tableName(TableId t) const { return tables.name(t); }
+    const std::string& columnName(ColumnId c) const { return columns.name(c); }
+
+    const FkLink& link(LinkId l) const { return links_[l]; }
+    LinkId linkCount() const { return static_cast<LinkId>(links_.size()); }
+    std::span<const LinkId> supporters(TableId t) const { return slice(supporterOffsets_, supporterLinks_, t); }
+    std::span<const LinkId> dependents(TableId t) const { return slice(dependentOffsets_, dependentLinks_, t); }
+    std::span<const ColumnId> childColumns(const FkLink& link) const { return {childColumns_.data() + link.columns, link.arity}; }
+    std::span<const ColumnId> parentColumns(const FkLink& link) const { return {parentColumns_.data() + link.columns, link.arity}; }
+
+    NeedId needCount() const { return static_cast<NeedId>(needKeys_.size() - 1); }
+    ColumnId needColumn(NeedId n) const { return needColumns_[needKeys_[n]]; }
+    std::span<const ColumnId> needColumns(NeedId n) const {
+        return {needColumns_.data() + needKeys_[n], needKeys_[n + 1] - needKeys_[n]};
+    }
+    std::pair<NeedId, NeedId> needs(TableId t) const { return {needOffsets_[t], needOffsets_[t + 1]}; }
+
+    std::span<const GraphColumn> tableColumns(TableId t) const { return slice(columnOffsets_, columnDefs_, t); }
+
+    std::vector<std::string> columnNames(std::span<const ColumnId> columns) const {
+        std::vector<std::string> result;
+        for(const ColumnId c : columns) result.push_back(columnName(c));
+        return result;
+    }
+
+private:
+    friend class SchemaGraphBuilder;
+
+    template<typename T>
+    static std::span<const T> slice(const std::vector<std::uint32_t>& offsets, const std::vector<T>& items, TableId t) {
+        return {items.data() + offsets[t], items.data() + offsets[t + 1]};
+    }
+
+    std::vector<FkLink> links_;
+    std::vector<ColumnId> childColumns_;
+    std::vector<ColumnId> parentColumns_;
+    std::vector<std::uint32_t> supporterOffsets_;
+    std::vector<LinkId> supporterLinks_;
+    std::vector<std::uint32_t> dependentOffsets_;
+    std::vector<LinkId> dependentLinks_;
+    std::vector<std::uint32_t> needOffsets_;
+    std::vector<std::uint32_t> needKeys_{0}; // offsets of the needs' columns
+    std::vector<ColumnId> needColumns_;
+    std::vector<std::uint32_t> columnOffsets_;
+    std::vector<GraphColumn> columnDefs_;
+};
+
+// Accumulates links and columns during discovery, then freezes them into a
+// SchemaGraph. A pair of tables keeps a single link; the last one added wins.
+class SchemaGraphBuilder {
+public:
+    TableId table(std::string_view name) {
+        const TableId t = graph_.tables.intern(name);
+        if(t >= columns_.size()) columns_.resize(t + 1);
+        return t;
+    }
+
+    std::optional<TableId> findTable(std::string_view name) const { return graph_.tables.find(name); }
+
+    void addLink(std::string_view child, std::string_view childColumn, std::string_view parent, std::string_view parentColumn) {
+        addLink(child, std::vector<std::string>{std::string{childColumn}}, parent,
+            std::vector<std::string>{std::string{parentColumn}});
+    }
+
+    // A composite foreign key, its columns paired in order.
+    void addLink(std::string_view child, const std::vector<std::string>& childColumns, std::string_view parent,
+        const std::vector<std::string>& parentColumns) {
+        const TableId c = table(child);
+        const TableId p = table(parent);
+        const auto columns = static_cast<std::uint32_t>(graph_.childColumns_.size());
+        for(std::size_t i = 0; i < childColumns.size(); i++) {
+            graph_.childColumns_.push_back(graph_.columns.intern(childColumns[i]));
+            graph_.parentColumns_.push_back(graph_.columns.intern(parentColumns[i]));
+        }
+        const FkLink link{c, p, graph_.childColumns_[columns], graph_.parentColumns_[columns], 0, columns,
+            static_cast<std::uint32_t>(childColumns.size())};
+        const auto key = (std::uint64_t{c} << 32) | p;
+        if(const auto it = linkIndex_.find(key); it != linkIndex_.end()) {
+            graph_.links_[it->second] = link;
+            return;
+        }
+        linkIndex_.emplace(key, static_cast<LinkId>(graph_.links_.size()));
+        graph_.links_.push_back(link);
+    }
+
+    void addColumn(std::string_view tableName, std::string_view name, bool isNullable, PGDataType dataType) {
+        const TableId t = table(tableName);
+        const ColumnId c = graph_.columns.intern(name);
+        for(auto& col : columns_[t]) {
+            if(col.name == c) {
+                col = GraphColumn{c, isNullable, dataType};
+                return;
+            }
+        }
+        columns_[t].push_back(GraphColumn{c, isNullable, dataType});
+    }
+
+    SchemaGraph build() && {
+        SchemaGraph& g = graph_;
+        const TableId n = g.tableCount();
+        const auto bucket = [&](auto key, std::vector<std::uint32_t>& offsets, std::vector<LinkId>& items) {
+            offsets.assign(n + 1, 0);
+            for(const auto& link : g.links_) offsets[key(link) + 1]++;
+            for(TableId t = 0; t < n; t++) offsets[t + 1] += offsets[t];
+            items.resize(g.links_.size());
+            auto cursor = offsets;
+            for(LinkId l = 0; l < g.links_.size(); l++) items[cursor[key(g.links_[l])]++] = l;
+        };
+        bucket([](const FkLink& l) { return l.child; }, g.supporterOffsets_, g.supporterLinks_);
+        bucket([](const FkLink& l) { return l.parent; }, g.dependentOffsets_, g.dependentLinks_);
+
+        g.needOffsets_.assign(n + 1, 0);
+        for(TableId t = 0; t < n; t++) {
+            g.needOffsets_[t] = g.needCount();
+            for(const LinkId l : g.dependents(t)) {
+                FkLink& link = g.links_[l];
+                const auto key = g.parentColumns(link);
+                NeedId need = g.needOffsets_[t];
+                while(need < g.needCount() && !std::ranges::equal(g.needColumns(need), key)) need++;
+                if(need == g.needCount()) {
+                    g.needColumns_.insert(g.needColumns_.end(), key.begin(), key.end());
+                    g.needKeys_.push_back(static_cast<std::uint32_t>(g.needColumns_.size()));
+                }
+                link.need = need;
+            }
+        }
+        g.needOffsets_[n] = g.needCount();
+
+        g.columnOffsets_.assign(n + 1, 0);
+        for(TableId t = 0; t < n; t++) {
+            g.columnOffsets_[t] = static_cast<std::uint32_t>(g.columnDefs_.size());
+            g.columnDefs_.insert(g.columnDefs_.end(), columns_[t].begin(), columns_[t].end());
+        }
+        g.columnOffsets_[n] = static_cast<std::uint32_t>(g.columnDefs_.size());
+        return std::move(graph_);
+    }
+
+private:
+    SchemaGraph graph_;
+    std::unordered_map<std::uint64_t, LinkId> linkIndex_;
+    std::vector<std::vector<GraphColumn>> columns_;
+};
+
+} // namespace subset
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "../include/src/str/stream.hpp"
+#include "key_set.hpp"
+#include "key_sets.hpp"
+#include "options.hpp"
+#include "schema_graph.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+// The rows of a TABLESAMPLE SYSTEM of table, as a condition on table. The
+// REPEATABLE seed and the shared snapshot make every statement see the same
+// sample. A ctid is only unique within its relation, so the rows are matched
+// by relation and ctid both: a partitioned or inherited table's partitions
+// and children repeat each other's.
+inline std::string sampleCondition(const std::string& table, const std::string& percent, std::uint64_t seed) {
+    return "(tableoid, ctid) IN (SELECT tableoid, ctid FROM " + table + " TABLESAMPLE SYSTEM (" + percent +
+        ") REPEATABLE (" + std::to_string(seed) + "))";
+}
+
+// The rows of the root table the subset starts from: the id of the command
+// line, the ids of a seed file, the rows matching a predicate, or a sample.
+// A batch of seeds is one closure over their union, so shared parents are
+// read once.
+class Seeds {
+public:
+    Seeds(const Options& options, const SchemaGraph& graph, TableId rootTable)
+        : predicate_{options.seedWhere} {
+        if(!options.samplePercent.empty())
+            predicate_ = sampleCondition(options.rootTable, options.samplePercent, options.sampleSeed);
+        if(!predicate_.empty()) return;
+        for(const auto& col : graph.tableColumns(rootTable)) {
+            if(graph.columnName(col.name) == "id") ids_ = KeySet{KeySet::kindOf(col.dataType)};
+        }
+        if(options.seeds.empty()) ids_.insert(options.rootId);
+        else if(options.seeds == "-") read(std::cin);
+        else if(std::error_code error; std::filesystem::is_regular_file(options.seeds, error)) {
+            for(const auto line : dmitigr::str::read_lines(options.seeds)) add(line);
+        } else {
+            // A pipe can't be mapped.
+            std::ifstream in{options.seeds};
+            if(!in) throw std::runtime_error{"cannot read " + options.seeds.string()};
+            read(in);
+        }
+        if(ids_.empty()) throw std::invalid_argument{"no seed ids"};
+    }
+
+    // The seed ids, or nothing for a predicate.
+    const KeySet* ids() const { return predicate_.empty() ? &ids_ : nullptr; }
+    const std::string& predicate() const { return predicate_; }
+
+    // The condition on the root table selecting the seed rows.
+    std::string condition(KeySetStage& keySets, const std::string& rootTable) const {
+        if(!predicate_.empty()) return "(" + predicate_ + ")";
+        return keySets.match(rootTable, "id", ids_);
+    }
+
+    // Identifies the seeds in a job signature.
+    std::string signature() const {
+        if(!predicate_.empty()) return "where " + predicate_;
+        std::string result;
+        ids_.forEachText([&](std::string_view id) {
+            result += id;
+            result += '\n';
+        });
+        return result;
+    }
+
+private:
+    // One id per line; blank lines and lines starting with # are skipped.
+    void read(std::istream& in) {
+        std::string line;
+        while(std::getline(in, line)) add(line);
+    }
+
+    void add(std::string_view line) {
+        const auto first = line.find_first_not_of(" \t\r");
+        if(first == std::string_view::npos || line[first] == '#') return;
+        const auto last = line.find_last_not_of(" \t\r");
+        ids_.insert(line.substr(first, last - first + 1));
+    }
+
+    std::string predicate_;
+    KeySet ids_;
+};
+
+} // namespace subset
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "key_set.hpp"
+#include "planner.hpp"
+#include "schema_graph.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+// Picks, for each read of a child, how its rows are restricted to the keys
+// of a link: filtered on the server, the key set shipped as KeySetStage
+// sees fit, or the child scanned whole and its rows checked here. Shipping
+// a key set which matches most of the child costs more than the rows it
+// keeps off the network, the more so when no index could have skipped the
+// pages of the others. The share of the child a key matches comes from the
+// statistics until a scan of the link has kept some of its rows, then from
+// what the last one kept.
+class SemiJoinPlanner {
+public:
+    SemiJoinPlanner(const SchemaGraph& graph, std::vector<TableStats> stats, std::vector<std::vector<ColumnId>> indexed)
+        : graph_{graph}, stats_{std::move(stats)}, indexed_{std::move(indexed)}, observed_(graph.linkCount(), -1) {}
+
+    // Whether the child of l is better scanned than filtered on keys.
+    bool scan(LinkId l, const KeySet& keys) const {
+        const FkLink& link = graph_.link(l);
+        const TableStats& s = stats_[link.child];
+        // A spilled set can't be probed, and a table never analyzed is
+        // taken to be small.
+        if(keys.spilled() || keys.empty() || s.rows < 1) return false;
+        const double n = static_cast<double>(keys.size());
+        const double share = std::min(1.0, n * perKey(l));
+        double rowBytes = 0;
+        for(const auto& col : graph_.tableColumns(link.child)) rowBytes += width(link.child, col.name) + 1;
+        double keyBytes = 0;
+        for(const ColumnId c : graph_.childColumns(link)) keyBytes += width(link.child, c) + 1;
+        const auto& indexed = indexed_[link.child];
+        const bool index = std::find(indexed.begin(), indexed.end(), link.childColumn) != indexed.end();
+        // The scan sends the rows the filter would drop, and reads the pages
+        // an index would have skipped.
+        const double scanCost = s.rows * (1 - share) * rowBytes + (index ? s.pages * (1 - share) * pageBytes : 0);
+        // The filter sends the keys, which the server copies into a temp
+        // table, analyzes and hashes.
+        const double filterCost = n * keyBytes * keyCost;
+        return scanCost < filterCost;
+    }
+
+    // Records a scan of the child of l, with keys in its set, which kept
+    // kept of the rows it read.
+    void observe(LinkId l, std::size_t keys, std::uint64_t read, std::uint64_t kept) {
+        if(!keys || !read) return;
+        const std::lock_guard lock{mutex_};
+        observed_[l] = static_cast<double>(kept) / static_cast<double>(read) / static_cast<double>(keys);
+    }
+
+private:
+    // Bytes moved per key shipped, for every byte of it.
+    static constexpr double keyCost = 4;
+    static constexpr double pageBytes = 8192;
+
+    // The share of the child's rows one key matches.
+    double perKey(LinkId l) const {
+        {
+            const std::lock_guard lock{mutex_};
+            if(observed_[l] >= 0) return observed_[l];
+        }
+        // Without statistics the column is taken to be unique.
+        const FkLink& link = graph_.link(l);
+        const TableStats& s = stats_[link.child];
+        const auto it = s.columns.find(link.childColumn);
+        if(it == s.columns.end() || it->second.distinct == 0) return 1 / s.rows;
+        const double distinct = it->second.distinct > 0 ? it->second.distinct : -it->second.distinct * s.rows;
+        return (1 - it->second.nullFraction) / std::clamp(distinct, 1.0, s.rows);
+    }
+
+    double width(TableId t, ColumnId c) const {
+        const auto it = stats_[t].columns.find(c);
+        return it == stats_[t].columns.end() ? 8 : it->second.width;
+    }
+
+    const SchemaGraph& graph_;
+    std::vector<TableStats> stats_;
+    std::vector<std::vector<ColumnId>> indexed_;
+    mutable std::mutex mutex_;
+    std::vector<double> observed_; // per key; negative: no scan yet
+};
+
+// Checks the rows of a scanned child against the key sets of the links
+// left out of its statement. A NULL in a key column matches nothing, as in
+// the IN it replaces.
+class ScanFilter {
+public:
+    struct Check {
+        std::vector<std::size_t> fields; // of the link's columns, in order
+        const KeySet* keys;
+    };
+
+    explicit ScanFilter(const std::vector<Check>& checks) : checks_{checks} {
+        for(const auto& check : checks_) {
+            for(const std::size_t f : check.fields) {
+                if(f >= values_.size()) {
+                    values_.resize(f + 1);
+                    present_.resize(f + 1, false);
+                }
+            }
+        }
+    }
+
+    bool empty() const { return checks_.empty(); }
+
+    void field(std::size_t index, std::string_view value, bool isNull) {
+        if(index >= values_.size()) return;
+        values_[index].assign(value);
+        present_[index] = !isNull;
+    }
+
+    // Whether the row matches every key set.
+    bool endRow() {
+        bool result = true;
+        std::vector<std::string_view> fields;
+        for(const auto& check : checks_) {
+            fields.clear();
+            for(const std::size_t f : check.fields) {
+                if(!present_[f]) break;
+                fields.push_back(values_[f]);
+            }
+            const bool match = fields.size() == check.fields.size() &&
+                (fields.size() == 1 ? check.keys->contains(fields.front()) : check.keys->contains(KeySet::tupleText(fields)));
+            if(!match) {
+                result = false;
+                break;
+            }
+        }
+        std::fill(present_.begin(), present_.end(), false);
+        return result;
+    }
+
+private:
+    std::vector<Check> checks_;
+    std::vector<std::string> values_;
+    std::vector<bool> present_;
+};
+
+} // namespace subset
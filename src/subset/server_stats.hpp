@@ -0,0 +1,252 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "schema_graph.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+inline const std::string statementStatsQuery = R"(
+        SELECT queryid::int8 AS queryid, sum(calls)::int8 AS calls, sum(total_exec_time)::float8 AS exec_ms,
+            sum(shared_blks_hit)::int8 AS shared_hit, sum(shared_blks_read)::int8 AS shared_read,
+            sum(temp_blks_read)::int8 AS temp_read, sum(temp_blks_written)::int8 AS temp_written
+        FROM pg_stat_statements
+        WHERE dbid = (SELECT oid FROM pg_catalog.pg_database WHERE datname = current_database())
+        GROUP BY queryid)";
+
+inline const std::string ioStatsQuery = R"(
+        SELECT coalesce(sum(reads), 0)::int8 AS reads, coalesce(sum(hits), 0)::int8 AS hits,
+            coalesce(sum(writes), 0)::int8 AS writes
+        FROM pg_catalog.pg_stat_io
+        WHERE backend_type = 'client backend')";
+
+// The query ids of the sessions named by a prefix, with the last query of
+// an idle one (PostgreSQL 14+, compute_query_id on).
+inline const std::string namedQueriesQuery = R"(
+        SELECT application_name, query_id FROM pg_catalog.pg_stat_activity
+        WHERE starts_with(application_name, $1) AND query_id IS NOT NULL)";
+
+// What the server spent on each table's statements during a run. A session
+// is named by its application_name after the table whose statements it
+// runs; the query ids of the sessions so named are sampled every interval,
+// and as each table ends, on a connection of its own, and a query id seen
+// under two tables, as a SET or a RELEASE is, is no table's. What the
+// tables cost is then summed from the pg_stat_statements counters of their
+// query ids, before the run and after it. Either view is missing where the
+// server doesn't have it: pg_stat_statements is an extension loaded at the
+// server's start, pg_stat_io came with PostgreSQL 16. The first read is
+// taken outside a transaction, where a view that fails can't abort one.
+class ServerStats {
+public:
+    static constexpr std::chrono::milliseconds interval{100};
+
+    ServerStats(pgfe::Connection& conn, pgfe::Connection_options options, Logger& logger)
+        : options_{std::move(options)}, logger_{logger}, prefix_{"cpp_schema:" + std::to_string(conn.server_pid()) + ':'} {
+        try {
+            before_ = readStatements(conn);
+        } catch(const pgfe::Server_exception&) {}
+        try {
+            io_ = readIo(conn);
+        } catch(const pgfe::Server_exception&) {}
+        if(before_) thread_ = std::thread{[this] { run(); }};
+    }
+
+    ServerStats(const ServerStats&) = delete;
+    ServerStats& operator=(const ServerStats&) = delete;
+
+    ~ServerStats() { stop(); }
+
+    bool statements() const { return before_.has_value(); }
+
+    // The application_name of a session running table's statements, its
+    // name cut to what the server keeps.
+    std::string name(TableId table, const std::string& tableName) {
+        {
+            const std::lock_guard lock{mutex_};
+            tables_.try_emplace(table, tableName);
+        }
+        std::string result = prefix_ + std::to_string(table) + ' ' + tableName;
+        if(result.size() > 63) result.resize(63);
+        return result;
+    }
+
+    // Notes the query ids of the sessions named after table.
+    void sample(TableId table) {
+        if(!before_) return;
+        const std::lock_guard lock{mutex_};
+        sample(prefix_ + std::to_string(table) + ' ');
+    }
+
+    // What the tables' statements cost since the start, costliest first,
+    // and the client backends' I/O. A statement evicted or reset on the way
+    // counts from zero.
+    std::pair<std::vector<ServerCost>, std::optional<ServerIo>> finish(pgfe::Connection& conn) {
+        stop();
+        std::vector<ServerCost> costs;
+        if(before_) {
+            std::map<TableId, ServerCost> byTable;
+            for(const auto& [id, after] : readStatements(conn)) {
+                const auto owner = owners_.find(id);
+                if(owner == owners_.end() || !owner->second) continue;
+                ServerCost cost = after;
+                const auto it = before_->find(id);
+                if(it != before_->end() && it->second.calls <= after.calls) {
+                    const ServerCost& was = it->second;
+                    cost.calls -= was.calls;
+                    cost.execSeconds = std::max(0.0, cost.execSeconds - was.execSeconds);
+                    cost.sharedHit -= std::min(cost.sharedHit, was.sharedHit);
+                    cost.sharedRead -= std::min(cost.sharedRead, was.sharedRead);
+                    cost.tempRead -= std::min(cost.tempRead, was.tempRead);
+                    cost.tempWritten -= std::min(cost.tempWritten, was.tempWritten);
+                }
+                ServerCost& sum = byTable[*owner->second];
+                sum.calls += cost.calls;
+                sum.execSeconds += cost.execSeconds;
+                sum.sharedHit += cost.sharedHit;
+                sum.sharedRead += cost.sharedRead;
+                sum.tempRead += cost.tempRead;
+                sum.tempWritten += cost.tempWritten;
+            }
+            for(auto& [table, cost] : byTable) {
+                if(!cost.calls) continue;
+                cost.table = tables_[table];
+                costs.push_back(std::move(cost));
+            }
+            std::sort(costs.begin(), costs.end(), [](const ServerCost& a, const ServerCost& b) {
+                return a.execSeconds > b.execSeconds;
+            });
+            if(owners_.empty() && !failed_) {
+                logger_.warn([] {
+                    return std::string{"--server-stats: no statement's query id was seen; is compute_query_id off?"};
+                });
+            }
+        }
+        std::optional<ServerIo> io;
+        if(io_) {
+            const ServerIo after = readIo(conn);
+            const auto since = [](std::uint64_t after, std::uint64_t before) { return after - std::min(after, before); };
+            io = ServerIo{since(after.reads, io_->reads), since(after.hits, io_->hits), since(after.writes, io_->writes)};
+        }
+        return {std::move(costs), io};
+    }
+
+private:
+    void stop() {
+        {
+            const std::lock_guard lock{mutex_};
+            stopping_ = true;
+        }
+        changed_.notify_all();
+        if(thread_.joinable()) thread_.join();
+    }
+
+    void run() {
+        std::unique_lock lock{mutex_};
+        while(!changed_.wait_for(lock, interval, [&] { return stopping_; })) sample(prefix_);
+    }
+
+    // Called under the lock.
+    void sample(const std::string& prefix) {
+        if(failed_) return;
+        try {
+            if(!conn_ || !conn_->is_connected()) {
+                conn_.emplace(options_);
+                conn_->connect();
+            }
+            conn_->execute([&](auto&& r) {
+                const auto name = pgfe::to<std::string_view>(r[0]).substr(prefix_.size());
+                const auto table = static_cast<TableId>(std::stoul(std::string{name.substr(0, name.find(' '))}));
+                const auto [owner, added] = owners_.try_emplace(pgfe::to<std::int64_t>(r[1]), table);
+                if(!added && owner->second != table) owner->second.reset();
+            }, namedQueriesQuery, prefix);
+        } catch(const std::exception& e) {
+            failed_ = true;
+            conn_.reset();
+            logger_.warn([&] { return std::string{"--server-stats: cannot sample the sessions' queries: "} + e.what(); });
+        }
+    }
+
+    static std::map<std::int64_t, ServerCost> readStatements(pgfe::Connection& conn) {
+        using dmitigr::pgfe::to;
+        std::map<std::int64_t, ServerCost> result;
+        conn.execute([&](auto&& r) {
+            if(!r["queryid"]) return;
+            ServerCost& cost = result[to<std::int64_t>(r["queryid"])];
+            cost.calls = to<std::uint64_t>(r["calls"]);
+            cost.execSeconds = to<double>(r["exec_ms"]) / 1000;
+            cost.sharedHit = to<std::uint64_t>(r["shared_hit"]);
+            cost.sharedRead = to<std::uint64_t>(r["shared_read"]);
+            cost.tempRead = to<std::uint64_t>(r["temp_read"]);
+            cost.tempWritten = to<std::uint64_t>(r["temp_written"]);
+        }, statementStatsQuery);
+        return result;
+    }
+
+    static ServerIo readIo(pgfe::Connection& conn) {
+        using dmitigr::pgfe::to;
+        ServerIo result;
+        conn.execute([&](auto&& r) {
+            result = ServerIo{to<std::uint64_t>(r["reads"]), to<std::uint64_t>(r["hits"]), to<std::uint64_t>(r["writes"])};
+        }, ioStatsQuery);
+        return result;
+    }
+
+    pgfe::Connection_options options_;
+    Logger& logger_;
+    std::string prefix_;
+    std::optional<std::map<std::int64_t, ServerCost>> before_;
+    std::optional<ServerIo> io_;
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    bool stopping_ = false;
+    bool failed_ = false;
+    std::optional<pgfe::Connection> conn_;
+    std::map<TableId, std::string> tables_;
+    std::map<std::int64_t, std::optional<TableId>> owners_; // none: seen under two tables
+    std::thread thread_;
+};
+
+// Names conn's session after a table while it runs the table's statements,
+// noting their query ids before the name is reset.
+class NamedSession {
+public:
+    NamedSession(pgfe::Connection& conn, ServerStats* stats, TableId table, const std::string& tableName)
+        : conn_{conn}, stats_{stats}, table_{table} {
+        if(stats_) conn_.execute("SELECT pg_catalog.set_config('application_name', $1, false)", stats_->name(table, tableName));
+    }
+
+    NamedSession(const NamedSession&) = delete;
+    NamedSession& operator=(const NamedSession&) = delete;
+
+    ~NamedSession() {
+        if(!stats_) return;
+        stats_->sample(table_);
+        // In a transaction which failed the name goes with its rollback.
+        try {
+            conn_.execute("RESET application_name");
+        } catch(...) {}
+    }
+
+private:
+    pgfe::Connection& conn_;
+    ServerStats* stats_;
+    TableId table_;
+};
+
+} // namespace subset
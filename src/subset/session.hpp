@@ -0,0 +1,173 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "catalog_snapshot.hpp"
+#include "discovery.hpp"
+#include "extract_cache.hpp"
+#include "graph_cache.hpp"
+#include "live_metrics.hpp"
+#include "log.hpp"
+#include "options.hpp"
+#include "schema_graph.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// What outlives a job: the connections to source and target and, when warm,
+// the catalog snapshots and the extractions of --memory-cache. A single run
+// fills it once; the daemon keeps it from job to job, so a job only pays
+// for a fingerprint query and the BFS from its root, and reads again what
+// the tables written since and its own seeds decide. With a notice rate the
+// connections' notices are printed off their threads, at most that many a
+// second.
+class Session {
+public:
+    Session(pgfe::Connection_options source, pgfe::Connection_options target, bool warm, std::size_t memoryCache = 0,
+        std::size_t noticeRate = 0)
+        : sourceOptions_{std::move(source)}, targetOptions_{std::move(target)}, warm_{warm} {
+        if(warm_ && memoryCache) memoryCache_.emplace(memoryCache);
+        if(noticeRate) notices_.emplace(4096, noticeRate);
+    }
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    ~Session() { reset(); }
+
+    const pgfe::Connection_options& sourceOptions() const { return sourceOptions_; }
+
+    // The lead connection, which exports the snapshot.
+    pgfe::Connection& source() {
+        if(!conn_ || !conn_->is_connected()) {
+            conn_.emplace(sourceOptions_);
+            if(notices_) conn_->set_notice_handler(notices_->handler());
+            conn_->connect();
+        }
+        return *conn_;
+    }
+
+    // Opens the lead connection and the pools a job of options reads and
+    // loads with, all at once: the handshakes overlap rather than add up.
+    // The pools that depend on the job's snapshot open when first asked for.
+    void connect(const Options& options) {
+        std::vector<std::thread> threads;
+        std::vector<std::exception_ptr> errors(4);
+        const auto start = [&](std::size_t i, auto open) {
+            threads.emplace_back([&errors, i, open] {
+                try {
+                    open();
+                } catch(...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        };
+        start(0, [this] { source(); });
+        start(1, [this, &options] { sourcePool(options.jobs); });
+        if(options.pipe) start(2, [this, &options] { targetPool(options.jobs); });
+        if(options.pipe && options.loadStreams > 1) start(3, [this, &options] { streamPool(options.loadStreams - 1); });
+        for(auto& thread : threads) thread.join();
+        for(const auto& error : errors) {
+            if(error) std::rethrow_exception(error);
+        }
+    }
+
+    pgfe::Connection_pool& sourcePool(std::size_t size) { return pool("source", sourcePool_, size, sourceOptions_); }
+    pgfe::Connection_pool& targetPool(std::size_t size) { return pool("target", targetPool_, size, targetOptions_); }
+    // Extra source connections for reading ranges of a table.
+    pgfe::Connection_pool& helperPool(std::size_t size) { return pool("helper", helperPool_, size, sourceOptions_); }
+    // Extra target connections for loading a table in several COPY streams.
+    pgfe::Connection_pool& streamPool(std::size_t size) { return pool("stream", streamPool_, size, targetOptions_); }
+
+    // With --sources the shards share the graph the first one was
+    // discovered into, their schemas being the same.
+    void shareSchema(std::shared_ptr<const SchemaGraph> graph) { sharedGraph_ = std::move(graph); }
+
+    std::shared_ptr<const SchemaGraph> discover(const Options& options, Logger& logger) {
+        if(sharedGraph_) return sharedGraph_;
+        if(!warm_ || options.introspection != Introspection::catalog)
+            return std::make_shared<const SchemaGraph>(discoverSchema(source(), options, logger));
+        TableFingerprints fingerprints;
+        try {
+            fingerprints = catalogFingerprints(source(), options.schema);
+        } catch(const pgfe::Server_exception& e) {
+            if(e.error().condition() != pgfe::Server_errc::c42_insufficient_privilege) throw;
+            return std::make_shared<const SchemaGraph>(discoverSchema(source(), options, logger));
+        }
+        auto it = catalogs_.find(options.schema);
+        if(it == catalogs_.end()) {
+            CatalogSnapshot catalog = loadCatalogSnapshot(source(), options, logger);
+            if(catalog.fingerprints.empty()) catalog.fingerprints = std::move(fingerprints);
+            it = catalogs_.emplace(options.schema, std::move(catalog)).first;
+        } else if(it->second.fingerprints != fingerprints) {
+            // The statements described before may have changed with the
+            // tables: their parameter types and rows are described again.
+            pgfe::clear_prepared_statement_descriptions();
+            refreshCatalogSnapshot(source(), options, it->second, std::move(fingerprints), logger);
+        }
+        SchemaGraphBuilder graph;
+        discoverFromSnapshot(it->second, options, graph, logger);
+        return std::make_shared<const SchemaGraph>(std::move(graph).build());
+    }
+
+    MemoryCache* memoryCache() { return memoryCache_ ? &*memoryCache_ : nullptr; }
+
+    // Drops the connections, which a failed job may have left in any state.
+    // The catalogs stay, being checked against the fingerprint anyway.
+    void reset() {
+        for(const char* role : {"source", "target", "helper", "stream"}) liveMetrics().setPool(role, nullptr);
+        conn_.reset();
+        sourcePool_.reset();
+        targetPool_.reset();
+        helperPool_.reset();
+        streamPool_.reset();
+    }
+
+private:
+    static constexpr std::chrono::milliseconds maintenanceInterval{30000};
+
+    // Between a daemon's jobs the pools are kept alive and checked in the
+    // background, so a job doesn't start on a connection which died idle.
+    // The pool open for role is what the daemon's /metrics reports on.
+    pgfe::Connection_pool& pool(const char* role, std::optional<pgfe::Connection_pool>& pool, std::size_t size,
+        const pgfe::Connection_options& options) {
+        if(!pool || pool->size() != size || !pool->is_connected()) {
+            liveMetrics().setPool(role, nullptr);
+            pool.reset();
+            pool.emplace(size, options);
+            if(notices_) pool->set_connect_handler([handler = notices_->handler()](pgfe::Connection& conn) {
+                conn.set_notice_handler(handler);
+            });
+            pool->connect();
+            if(warm_) pool->start_maintenance(maintenanceInterval);
+            liveMetrics().setPool(role, &*pool);
+        }
+        return *pool;
+    }
+
+    pgfe::Connection_options sourceOptions_;
+    pgfe::Connection_options targetOptions_;
+    bool warm_;
+    std::optional<pgfe::Notice_sink> notices_; // outlives the connections
+    std::optional<pgfe::Connection> conn_;
+    std::optional<pgfe::Connection_pool> sourcePool_;
+    std::optional<pgfe::Connection_pool> targetPool_;
+    std::optional<pgfe::Connection_pool> helperPool_;
+    std::optional<pgfe::Connection_pool> streamPool_;
+    std::unordered_map<std::string, CatalogSnapshot> catalogs_; // by schema
+    std::shared_ptr<const SchemaGraph> sharedGraph_;
+    std::optional<MemoryCache> memoryCache_;
+};
+
+} // namespace subset
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "binary_copy.hpp"
+#include "sink.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+// Spreads the rows of one table over several sinks, chunkSize bytes to one
+// before moving on to the next, so as many COPY streams load it at once on
+// their own backends. Every write has to hold whole rows, which is what the
+// COPY receive loop and SinkBatch hand on. In the binary format each shard
+// is a COPY of its own: the header, which the server sends in front of the
+// first tuple, and the trailer, which it sends in a message of its own, go
+// to all of them. Nothing is buffered here, the shards being expected to be
+// StageSinks with threads of their own.
+class ShardSink final : public Sink {
+public:
+    ShardSink(std::vector<std::unique_ptr<Sink>> shards, std::size_t chunkSize, bool binary)
+        : shards_{std::move(shards)}, chunkSize_{chunkSize}, binary_{binary}, headerPending_{binary} {
+        if(shards_.empty()) throw std::logic_error{"shard sink without shards"};
+    }
+
+    void write(std::string_view data) override {
+        if(headerPending_) data = splitHeader(data);
+        if(binary_ && data == trailer) {
+            trailerSeen_ = true;
+            return;
+        }
+        if(data.empty()) return;
+        shards_[current_]->write(data);
+        written_ += data.size();
+        if(written_ >= chunkSize_) {
+            written_ = 0;
+            current_ = (current_ + 1) % shards_.size();
+        }
+    }
+
+    void close() override {
+        if(binary_ && (headerPending_ || !trailerSeen_)) throw std::runtime_error{"binary COPY stream ended early"};
+        for(auto& shard : shards_) {
+            if(binary_) shard->write(trailer);
+            shard->close();
+        }
+    }
+
+private:
+    static constexpr std::string_view trailer{"\xff\xff", 2};
+    static constexpr std::size_t headerSize = 19; // the signature, the flags and the extension length
+
+    // Hands the header to every shard and returns what follows it.
+    std::string_view splitHeader(std::string_view data) {
+        if(data.size() < headerSize) throw std::runtime_error{"binary COPY header split across messages"};
+        const auto byte = [&](std::size_t i) { return static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])); };
+        const std::size_t size = headerSize + (byte(15) << 24 | byte(16) << 16 | byte(17) << 8 | byte(18));
+        if(data.size() < size) throw std::runtime_error{"binary COPY header split across messages"};
+        for(auto& shard : shards_) shard->write(data.substr(0, size));
+        headerPending_ = false;
+        return data.substr(size);
+    }
+
+    std::vector<std::unique_ptr<Sink>> shards_;
+    std::size_t chunkSize_;
+    bool binary_;
+    bool headerPending_;
+    bool trailerSeen_ = false;
+    std::size_t current_ = 0;
+    std::size_t written_ = 0;
+};
+
+// Rotates the rows of one table over shards of about shardSize bytes, the
+// next opened by open(index) once a write has taken the current one past
+// it, so downstream loaders can read them side by side. Every write has to
+// hold whole rows, as for ShardSink, so each shard ends on a row's end; the
+// rows are counted on the way. In the binary format every shard is a COPY
+// file of its own, with the header and the trailer. finished(index, rows)
+// is called as a shard is closed. A table without rows still has a shard.
+class RotatingSink final : public Sink {
+public:
+    using Open = std::function<std::unique_ptr<Sink>(std::size_t index)>;
+    using Finished = std::function<void(std::size_t index, std::uint64_t rows)>;
+
+    RotatingSink(Open open, Finished finished, std::uint64_t shardSize, bool binary)
+        : open_{std::move(open)}, finished_{std::move(finished)}, shardSize_{shardSize}, binary_{binary} {}
+
+    void write(std::string_view data) override {
+        if(binary_) {
+            if(data == trailer) {
+                trailerSeen_ = true;
+                return;
+            }
+            const std::uint64_t before = decoder_.tuples();
+            decoder_.feed(data, [](std::size_t, std::string_view, bool) {});
+            rows_ += decoder_.tuples() - before;
+            if(header_.empty()) {
+                const auto byte = [&](std::size_t i) { return static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])); };
+                header_ = data.substr(0, 19 + (byte(15) << 24 | byte(16) << 16 | byte(17) << 8 | byte(18)));
+                data.remove_prefix(header_.size());
+            }
+        } else rows_ += csvRows(data);
+        if(data.empty()) return;
+        if(!current_) openShard();
+        current_->write(data);
+        written_ += data.size();
+        if(written_ >= shardSize_) closeShard();
+    }
+
+    void close() override {
+        if(binary_ && (header_.empty() || !trailerSeen_)) throw std::runtime_error{"binary COPY stream ended early"};
+        if(!current_ && index_ == 0) openShard();
+        if(current_) closeShard();
+    }
+
+private:
+    static constexpr std::string_view trailer{"\xff\xff", 2};
+
+    // The records of whole CSV rows: the newlines outside quotes.
+    static std::uint64_t csvRows(std::string_view data) {
+        std::uint64_t rows = 0;
+        bool quoted = false;
+        for(const char c : data) {
+            if(c == '"') quoted = !quoted;
+            else if(c == '\n' && !quoted) rows++;
+        }
+        return rows;
+    }
+
+    void openShard() {
+        current_ = open_(index_);
+        if(binary_) current_->write(header_);
+    }
+
+    void closeShard() {
+        if(binary_) current_->write(trailer);
+        current_->close();
+        current_.reset();
+        finished_(index_++, rows_);
+        rows_ = 0;
+        written_ = 0;
+    }
+
+    Open open_;
+    Finished finished_;
+    std::uint64_t shardSize_;
+    bool binary_;
+    BinaryCopyDecoder decoder_;
+    std::string header_;
+    bool trailerSeen_ = false;
+    std::unique_ptr<Sink> current_;
+    std::size_t index_ = 0;
+    std::uint64_t rows_ = 0; // of the current shard
+    std::uint64_t written_ = 0;
+};
+
+} // namespace subset
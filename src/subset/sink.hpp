@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+// Where the extracted rows of a table go. Implementations buffer at most a
+// fixed window, so memory use doesn't grow with the size of the table.
+class Sink {
+public:
+    virtual ~Sink() = default;
+
+    virtual void write(std::string_view data) = 0;
+
+    // Flushes what's buffered and completes the output. A sink destroyed
+    // without close() discards or truncates it.
+    virtual void close() = 0;
+};
+
+// Discards the rows, for a pass that only wants their keys.
+class NullSink final : public Sink {
+public:
+    void write(std::string_view) override {}
+    void close() override {}
+};
+
+// One of several writers of whole rows into a shared sink: rows are batched
+// and handed over a batch at a time under the lock. close() flushes the
+// batch and leaves the shared sink open.
+class SinkBatch final : public Sink {
+public:
+    SinkBatch(Sink& sink, std::mutex& mutex, std::size_t size) : sink_{sink}, mutex_{mutex}, size_{size} {}
+
+    void write(std::string_view data) override {
+        buffer_ += data;
+        if(buffer_.size() >= size_) close();
+    }
+
+    void close() override {
+        if(buffer_.empty()) return;
+        std::lock_guard lock{mutex_};
+        sink_.write(buffer_);
+        buffer_.clear();
+    }
+
+private:
+    Sink& sink_;
+    std::mutex& mutex_;
+    std::size_t size_;
+    std::string buffer_;
+};
+
+} // namespace subset
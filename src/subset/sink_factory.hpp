@@ -0,0 +1,186 @@
+#pragma once
+
+#include "../include/src/fsx/output_directory.hpp"
+#include "../include/src/pgfe/pgfe.hpp"
+#include "async_file.hpp"
+#include "checksum.hpp"
+#include "compression.hpp"
+#include "copy_stream.hpp"
+#include "encryption.hpp"
+#include "file_sink.hpp"
+#include "insert_writer.hpp"
+#include "isolated_load.hpp"
+#include "masking.hpp"
+#include "object_store.hpp"
+#include "options.hpp"
+#include "parquet_sink.hpp"
+#include "planner.hpp"
+#include "schema_graph.hpp"
+#include "shard_sink.hpp"
+#include "sink.hpp"
+#include "stage_sink.hpp"
+#include "staging_loader.hpp"
+#include "table_plan.hpp"
+#include "task_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// One of the files of a table with --shard-size.
+struct FileShard {
+    std::string name;
+    Crc32c checksum;
+    std::uint64_t rows = 0;
+};
+
+// With --shard-size a table's rows go to table.00000.csv, table.00001.csv
+// and on.
+inline std::filesystem::path shardPath(const std::filesystem::path& directory, const std::string& tableName,
+    std::string_view extension, std::size_t index, const std::string& suffix) {
+    char number[24];
+    std::snprintf(number, sizeof(number), ".%05zu", index);
+    return directory / (tableName + number + std::string{extension} + suffix);
+}
+
+// Opens where the rows of a table go: the target COPY with --pipe, a file
+// or an object otherwise, through the compression, the encryption and the
+// masking the job has. The pools are those of the job, none for a stage it
+// doesn't have; each sink opened notes its checksum, or its shards', for
+// the manifest.
+struct SinkFactory {
+    const Options& options;
+    const SchemaGraph& graph;
+    const std::string& fileSuffix;
+    const std::string& encryptedSuffix; // of a Parquet file, which compresses itself
+    const EncryptionKey* encryptionKey;
+    dmitigr::fsx::Output_directory* outputDirectory;
+    ObjectStore* objectStore; // with --upload
+    Rejects* rejects;
+    TaskPool* compressionPool;
+    TaskPool* encryptionPool;
+    TaskPool* writerPool;
+    TaskPool* uploadPool;
+    TaskPool* maskPool;
+    // Uncompressed output files are preallocated from the estimates, if any.
+    bool preallocate;
+    const std::vector<TableEstimate>& estimates;
+    std::vector<Crc32c>& checksums;
+    std::vector<std::deque<FileShard>>& fileShards;
+
+    std::filesystem::path outputFile(TableId table, const TablePlan& plan) const {
+        if(plan.parquet) return options.outputDir / (graph.tableName(table) + ".parquet" + encryptedSuffix);
+        return options.outputDir / (graph.tableName(table) + (plan.binary ? ".bin" : ".csv") + fileSuffix);
+    }
+
+    std::filesystem::path shardFile(TableId table, std::string_view extension, std::size_t index) const {
+        return shardPath(options.outputDir, graph.tableName(table), extension, index, fileSuffix);
+    }
+
+    // An output file, or with --upload an object of its name, checksummed
+    // as written.
+    std::unique_ptr<Sink> openFile(TableId table, const TablePlan& plan, const std::filesystem::path& path,
+        Crc32c& checksum, bool preallocated) const {
+        std::unique_ptr<Sink> file;
+        if(objectStore)
+            file = std::make_unique<ObjectStoreSink>(*objectStore, path.filename().string(), *uploadPool,
+                options.uploadPartSize << 20);
+        else if(writerPool) file = std::make_unique<AsyncFileSink>(path, options.bufferSize,
+            makeWriteQueue(4, *writerPool), 4, preallocated);
+        else file = std::make_unique<FileSink>(path, options.bufferSize, preallocated);
+        file = std::make_unique<ChecksumSink>(std::move(file), checksum);
+        if(encryptionKey)
+            file = std::make_unique<EncryptingSink>(std::move(file), *encryptionPool, *encryptionKey, options.bufferSize);
+        if(plan.parquet) {
+            std::vector<ParquetSink::Column> columns;
+            for(auto& col : graph.tableColumns(table)) columns.push_back({graph.columnName(col.name), col.dataType});
+            const int level = options.compress == Compression::gzip ? static_cast<int>(options.compressLevel) : 0;
+            return std::make_unique<ParquetSink>(std::move(file), std::move(columns), options.rowGroupRows, level);
+        }
+        if(!compressionPool) return file;
+        return std::make_unique<GzipSink>(std::move(file), *compressionPool,
+            static_cast<int>(options.compressLevel), options.bufferSize);
+    }
+
+    // Where the rows go: the target COPY when there's a target, a file
+    // otherwise. With streams a COPY is sharded over them and target, each
+    // shard loaded on a thread of its own.
+    std::unique_ptr<Sink> openOutput(TableId table, const TablePlan& plan, pgfe::Connection* target,
+        std::vector<pgfe::Connection_pool::Handle>* streams = nullptr) const {
+        const std::string& tableName = graph.tableName(table);
+        if(!target && options.shardSize) {
+            auto& shards = fileShards[table];
+            // Read again, the table starts over without what the read
+            // before left.
+            for(const auto& shard : shards) {
+                std::error_code ec;
+                if(!objectStore) std::filesystem::remove(options.outputDir / shard.name, ec);
+            }
+            shards.clear();
+            const std::string_view extension = plan.binary ? ".bin" : ".csv";
+            return std::make_unique<RotatingSink>([this, &plan, table, extension](std::size_t index) {
+                auto& shard = fileShards[table].emplace_back();
+                const auto path = shardFile(table, extension, index);
+                shard.name = path.filename().string();
+                return openFile(table, plan, path, shard.checksum, false);
+            }, [this, table](std::size_t, std::uint64_t rows) {
+                fileShards[table].back().rows = rows;
+            }, std::uint64_t{options.shardSize} << 20, plan.binary);
+        }
+        if(!target) {
+            const bool preallocated = preallocate && !estimates.empty();
+            const auto path = preallocated ? outputDirectory->create(outputFile(table, plan).filename(),
+                static_cast<std::uint64_t>(estimates[table].bytes)) : outputFile(table, plan);
+            checksums[table] = {};
+            return openFile(table, plan, path, checksums[table], preallocated);
+        }
+        std::unique_ptr<Sink> load;
+        if(plan.inserts)
+            load = std::make_unique<InsertSink>(*target, tableName, plan.quotedColumns, options.insertRows, options.bufferSize);
+        else if(options.load == Load::staging && !plan.quotedColumns.empty())
+            load = std::make_unique<StagingSink>(*target, tableName, plan.quotedColumns, plan.copyOptions,
+                options.onConflict == OnConflict::update, options.bufferSize);
+        else {
+            const std::string copy = "COPY " + tableName +
+                (plan.selectList.empty() ? "" : " (" + plan.selectList + ")") + " FROM STDIN" + plan.loadOptions;
+            if(rejects)
+                load = std::make_unique<IsolatedCopySink>(*target, tableName, copy, *rejects, options.rejectBatch,
+                    options.bufferSize);
+            else if(streams && !streams->empty()) {
+                const std::size_t depth = std::max<std::size_t>(options.pipelineDepth, 1);
+                std::vector<std::unique_ptr<Sink>> shards;
+                shards.push_back(std::make_unique<StageSink>(
+                    std::make_unique<CopyIn>(*target, copy, options.bufferSize), options.bufferSize, depth));
+                for(auto& stream : *streams) {
+                    shards.push_back(std::make_unique<StageSink>(
+                        std::make_unique<CopyIn>(*stream, copy, options.bufferSize), options.bufferSize, depth));
+                }
+                return std::make_unique<ShardSink>(std::move(shards), options.bufferSize, plan.binary);
+            } else load = std::make_unique<CopyIn>(*target, copy, options.bufferSize);
+        }
+        if(!options.pipelineDepth) return load;
+        return std::make_unique<StageSink>(std::move(load), options.bufferSize, options.pipelineDepth);
+    }
+
+    // The masked columns are masked on the way to either, on the pool.
+    std::unique_ptr<Sink> openSink(TableId table, const TablePlan& plan, pgfe::Connection* target,
+        std::vector<pgfe::Connection_pool::Handle>* streams = nullptr) const {
+        auto sink = openOutput(table, plan, target, streams);
+        if(!plan.masker) return sink;
+        return std::make_unique<MaskSink>(std::move(sink), *maskPool, plan.masker, options.bufferSize);
+    }
+};
+
+} // namespace subset
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+
+#include <optional>
+#include <string>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// A REPEATABLE READ transaction on the lead connection whose snapshot the
+// worker sessions import, so every table is read as of the same instant, as
+// pg_dump -j does. The transaction has to stay open until the last worker has
+// imported the snapshot, so it's held for the lifetime of the instance.
+class ExportedSnapshot {
+public:
+    explicit ExportedSnapshot(pgfe::Connection& lead)
+        : lead_{lead} {
+        lead_.execute("BEGIN ISOLATION LEVEL REPEATABLE READ");
+        try {
+            lead_.execute([&](auto&& r) {
+                id_ = pgfe::to<std::string>(r[0]);
+            }, "SELECT pg_export_snapshot()");
+        } catch(...) {
+            lead_.execute("ROLLBACK");
+            throw;
+        }
+    }
+
+    ExportedSnapshot(const ExportedSnapshot&) = delete;
+    ExportedSnapshot& operator=(const ExportedSnapshot&) = delete;
+
+    ~ExportedSnapshot() {
+        try {
+            if(lead_.is_connected()) lead_.execute("COMMIT");
+        } catch(...) {}
+    }
+
+    const std::string& id() const { return id_; }
+
+private:
+    pgfe::Connection& lead_;
+    std::string id_;
+};
+
+// A transaction of a worker reading as of an exported snapshot. Rolls back
+// unless committed.
+class SnapshotTransaction {
+public:
+    SnapshotTransaction(pgfe::Connection& conn, const std::optional<std::string>& snapshotId)
+        : conn_{conn}, open_{snapshotId.has_value()} {
+        if(!open_) return;
+        conn_.execute("BEGIN ISOLATION LEVEL REPEATABLE READ");
+        try {
+            conn_.execute("SET TRANSACTION SNAPSHOT " + conn_.to_quoted_literal(*snapshotId));
+        } catch(...) {
+            rollback();
+            throw;
+        }
+    }
+
+    SnapshotTransaction(const SnapshotTransaction&) = delete;
+    SnapshotTransaction& operator=(const SnapshotTransaction&) = delete;
+
+    ~SnapshotTransaction() {
+        if(open_) rollback();
+    }
+
+    void commit() {
+        if(!open_) return;
+        open_ = false;
+        conn_.execute("COMMIT");
+    }
+
+private:
+    void rollback() noexcept {
+        open_ = false;
+        try {
+            if(conn_.is_ready_for_request()) conn_.execute("ROLLBACK");
+        } catch(...) {}
+    }
+
+    pgfe::Connection& conn_;
+    bool open_;
+};
+
+} // namespace subset
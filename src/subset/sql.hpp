@@ -0,0 +1,31 @@
+#pragma once
+
+#include "../include/src/str/escape.hpp"
+
+#include <string>
+#include <string_view>
+
+namespace subset {
+
+// Appends what escape writes for value, straight into the string.
+template<typename F>
+void appendEscaped(std::string& out, std::string_view value, F&& escape) {
+    const std::size_t size = out.size();
+    out.resize(size + dmitigr::str::escaped_size_max(value.size()));
+    out.resize(static_cast<std::size_t>(escape(value, out.data() + size) - out.data()));
+}
+
+inline std::string quoteIdentifier(std::string_view name) {
+    std::string result;
+    appendEscaped(result, name, [](std::string_view v, char* out) { return dmitigr::str::quote_doubling(v, '"', out); });
+    return result;
+}
+
+// Assumes standard_conforming_strings, the default since PostgreSQL 9.1.
+inline std::string quoteLiteral(std::string_view value) {
+    std::string result;
+    appendEscaped(result, value, [](std::string_view v, char* out) { return dmitigr::str::quote_doubling(v, '\'', out); });
+    return result;
+}
+
+} // namespace subset
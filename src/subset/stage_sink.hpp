@@ -0,0 +1,100 @@
+#pragma once
+
+#include "../include/src/util/ring_buffer.hpp"
+#include "memory.hpp"
+#include "sink.hpp"
+#include "trace.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+namespace subset {
+
+namespace util = dmitigr::util;
+
+// Hands what is written on to the next sink on a thread of its own, so the
+// COPY receive loop and the load into the target overlap. The data goes in
+// chunks of chunkSize bytes through a lock-free ring of depth chunks, and
+// the written chunks come back through another for reuse, so nothing is
+// allocated once the chunks have grown and a full ring is what holds the
+// receive loop back. An error of the next sink is rethrown by the next
+// write() or close().
+class StageSink final : public Sink {
+public:
+    StageSink(std::unique_ptr<Sink> next, std::size_t chunkSize, std::size_t depth)
+        : next_{std::move(next)}, chunkSize_{chunkSize}, full_{depth}, free_{full_.capacity() + 1} {
+        // One chunk more than the ring holds, for the one being filled.
+        for(std::size_t i = 0; i < full_.capacity(); i++) free_.push(std::string{});
+        thread_ = std::thread{withTracer([this] { run(); })};
+    }
+
+    StageSink(const StageSink&) = delete;
+    StageSink& operator=(const StageSink&) = delete;
+
+    ~StageSink() override {
+        // Unclosed, the next sink is destroyed unclosed as well.
+        if(thread_.joinable()) stop();
+    }
+
+    void write(std::string_view data) override {
+        if(failed_.load(std::memory_order_acquire)) std::rethrow_exception(error_);
+        chunk_.append(data);
+        if(chunk_.size() >= chunkSize_) handOff();
+    }
+
+    void close() override {
+        if(!chunk_.empty()) handOff();
+        stop();
+        if(error_) std::rethrow_exception(error_);
+        next_->close();
+    }
+
+private:
+    void handOff() {
+        pipelineBytes().add(chunk_.size());
+        full_.push(std::move(chunk_));
+        chunk_ = free_.pop();
+    }
+
+    // An empty chunk ends the stream.
+    void stop() {
+        full_.push(std::string{});
+        thread_.join();
+    }
+
+    void run() {
+        while(true) {
+            std::string chunk = full_.pop();
+            if(chunk.empty()) return;
+            if(!error_) {
+                try {
+                    const TraceSpan span{"load", "chunk"};
+                    next_->write(chunk);
+                } catch(...) {
+                    error_ = std::current_exception();
+                    failed_.store(true, std::memory_order_release);
+                }
+            }
+            pipelineBytes().release(chunk.size());
+            chunk.clear();
+            free_.push(std::move(chunk));
+        }
+    }
+
+    std::unique_ptr<Sink> next_;
+    std::size_t chunkSize_;
+    util::Spsc_ring<std::string> full_;
+    util::Spsc_ring<std::string> free_;
+    std::string chunk_;
+    std::exception_ptr error_; // the stage thread's until failed_ or the join
+    std::atomic<bool> failed_ = false;
+    std::thread thread_;
+};
+
+} // namespace subset
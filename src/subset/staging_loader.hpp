@@ -0,0 +1,102 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "copy_stream.hpp"
+#include "sink.hpp"
+#include "sql.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// The quoted primary key columns of a target table, empty without one.
+inline std::vector<std::string> primaryKeyColumns(pgfe::Connection& conn, const std::string& table) {
+    std::vector<std::string> columns;
+    conn.execute([&](auto&& r) {
+        columns.push_back(quoteIdentifier(pgfe::to<std::string>(r["attname"])));
+    }, R"(
+        SELECT a.attname
+        FROM pg_catalog.pg_index i
+        CROSS JOIN LATERAL unnest(i.indkey) WITH ORDINALITY AS k(attnum, n)
+        JOIN pg_catalog.pg_attribute a ON a.attrelid = i.indrelid AND a.attnum = k.attnum
+        WHERE i.indrelid = $1::regclass AND i.indisprimary
+        ORDER BY k.n)", table);
+    return columns;
+}
+
+// Loads a table into a target that may hold some of its rows already: the
+// rows are COPYed into a temp table, which like an unlogged one skips the
+// WAL, and merged with one set-based INSERT ... SELECT when the sink is
+// closed. Conflicting rows are kept, or with update overwritten, matched on
+// the primary key.
+class StagingSink final : public Sink {
+public:
+    StagingSink(pgfe::Connection& conn, const std::string& table, const std::vector<std::string>& columns,
+        const std::string& copyOptions, bool update, std::size_t bufferSize)
+        : conn_{conn}, stage_{"pg_temp.subset_stage_" + std::to_string(counter_++)} {
+        if(columns.empty()) throw std::invalid_argument{"staged loading needs the column list of " + table};
+        std::string list;
+        for(const auto& c : columns) list += (list.empty() ? "" : ", ") + c;
+
+        merge_ = "INSERT INTO " + table + " (" + list + ") SELECT " + list + " FROM " + stage_;
+        if(update) {
+            const auto key = primaryKeyColumns(conn_, table);
+            if(key.empty()) throw std::runtime_error{"--on-conflict=update needs a primary key on " + table};
+            std::string target;
+            for(const auto& c : key) target += (target.empty() ? "" : ", ") + c;
+            std::string set;
+            for(const auto& c : columns) {
+                if(std::find(key.begin(), key.end(), c) != key.end()) continue;
+                set += (set.empty() ? "" : ", ") + c + " = EXCLUDED." + c;
+            }
+            merge_ += " ON CONFLICT (" + target + ")" + (set.empty() ? " DO NOTHING" : " DO UPDATE SET " + set);
+        } else merge_ += " ON CONFLICT DO NOTHING";
+
+        conn_.execute("CREATE TEMP TABLE " + stage_ + " AS SELECT " + list + " FROM " + table + " WITH NO DATA");
+        copyIn_.emplace(conn_, "COPY " + stage_ + " (" + list + ") FROM STDIN" + copyOptions, bufferSize);
+    }
+
+    StagingSink(const StagingSink&) = delete;
+    StagingSink& operator=(const StagingSink&) = delete;
+
+    ~StagingSink() override {
+        copyIn_.reset();
+        if(merged_) return;
+        try {
+            if(conn_.is_ready_for_request()) conn_.execute("DROP TABLE IF EXISTS " + stage_);
+        } catch(...) {}
+    }
+
+    void write(std::string_view data) override {
+        copyIn_->write(data);
+    }
+
+    void close() override {
+        copyIn_->close();
+        copyIn_.reset();
+        conn_.execute("ANALYZE " + stage_);
+        conn_.execute(merge_);
+        conn_.execute("DROP TABLE " + stage_);
+        merged_ = true;
+    }
+
+private:
+    static inline std::atomic<std::uint64_t> counter_ = 0;
+
+    pgfe::Connection& conn_;
+    std::string stage_;
+    std::string merge_;
+    std::optional<CopyIn> copyIn_;
+    bool merged_ = false;
+};
+
+} // namespace subset
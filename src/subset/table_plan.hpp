@@ -0,0 +1,196 @@
+#pragma once
+
+#include "binary_copy.hpp"
+#include "existing_keys.hpp"
+#include "key_set.hpp"
+#include "log.hpp"
+#include "masking.hpp"
+#include "options.hpp"
+#include "schema_graph.hpp"
+#include "semi_join.hpp"
+#include "sql.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+// How a table is read and written, shared by the rounds of a cycle.
+struct TablePlan {
+    std::string selectList;
+    std::vector<std::string> quotedColumns;
+    std::vector<std::pair<std::size_t, NeedId>> keyFields;
+    std::vector<std::pair<std::size_t, LinkId>> referenceFields;
+    // The fields of composite keys, whose tuples go to the key sets of
+    // tupleNeeds and, those after them, of tupleLinks' references.
+    std::vector<std::vector<std::size_t>> tuples;
+    std::vector<NeedId> tupleNeeds;
+    std::vector<LinkId> tupleLinks;
+    bool collectsKeys() const { return !keyFields.empty() || !tupleNeeds.empty(); }
+    bool references() const { return !referenceFields.empty() || !tupleLinks.empty(); }
+    // The links whose keys the rows are checked against by the client,
+    // the table scanned instead of filtered on them.
+    std::vector<LinkId> scanned;
+    std::vector<ScanFilter::Check> scanChecks;
+    bool prepared = false;
+    bool cursor = false; // fetched through a cursor instead of a COPY
+    bool inserts = false;
+    bool binary = false;
+    bool parquet = false;
+    std::string copyOptions;
+    std::string loadOptions; // of the COPY into the target
+    // With --skip-existing, the keys the target has of the field at
+    // existingField; the rows with one of them aren't loaded.
+    std::shared_ptr<const ExistingKeys> existing;
+    std::size_t existingField = 0;
+    std::shared_ptr<const RowMasker> masker; // of the masked fields, if any
+};
+
+// With --key-pass the closure is computed first by reading only the
+// key columns, then the rows are read with the final key sets. The
+// references pass reads the rows referenced with --parents=referenced.
+enum class Pass { single, keys, rows, references };
+
+// What a table's plan is made of besides the table: the job's options and
+// filters, and the key sets its scans are checked against.
+struct PlanInputs {
+    const Options& options;
+    const SchemaGraph& graph;
+    TableId rootTable;
+    // With --parents=referenced the tables which only take the rows the
+    // others reference.
+    const std::vector<bool>& referenced;
+    const std::vector<std::string>& predicates; // of --table-where, by table
+    const std::vector<std::vector<std::pair<LinkId, const FanoutLimit*>>>& fanouts;
+    const std::vector<std::vector<std::pair<ColumnId, Mask>>>& masked;
+    const Masker& masker;
+    const std::vector<KeySet>& keyValues;
+    const SemiJoinPlanner* semiJoins; // with --semi-join=adaptive
+    bool target; // the rows are loaded into a target, with --pipe
+    bool parquet;
+    bool rejects;
+    Logger& logger;
+
+    bool followed(LinkId l) const { return !referenced[graph.link(l).parent]; }
+};
+
+// How table is read in pass, as one of a cycle's tables when cyclic.
+inline TablePlan planTable(const PlanInputs& inputs, TableId table, bool cyclic, Pass pass) {
+    const Options& options = inputs.options;
+    const SchemaGraph& graph = inputs.graph;
+    TablePlan plan;
+    const auto columns = graph.tableColumns(table);
+    const auto [firstNeed, lastNeed] = graph.needs(table);
+    const auto isKey = [&](ColumnId c) {
+        for(auto need = firstNeed; need < lastNeed; need++) {
+            const auto key = graph.needColumns(need);
+            if(std::find(key.begin(), key.end(), c) != key.end()) return true;
+        }
+        return false;
+    };
+
+    // Select the columns explicitly, so the positions of the key
+    // columns in the COPY output are known.
+    std::vector<ColumnId> selected;
+    for(auto& col : columns) {
+        if(pass == Pass::keys && !isKey(col.name)) continue;
+        selected.push_back(col.name);
+        plan.quotedColumns.push_back(quoteIdentifier(graph.columnName(col.name)));
+        if(!plan.selectList.empty()) plan.selectList += ", ";
+        plan.selectList += plan.quotedColumns.back();
+    }
+    // The fields of the columns, if all are selected.
+    const auto fieldsOf = [&](std::span<const ColumnId> key) {
+        std::vector<std::size_t> fields;
+        for(const ColumnId c : key) {
+            const auto it = std::find(selected.begin(), selected.end(), c);
+            if(it == selected.end()) return std::vector<std::size_t>{};
+            fields.push_back(static_cast<std::size_t>(it - selected.begin()));
+        }
+        return fields;
+    };
+    for(auto need = firstNeed; need < lastNeed && pass != Pass::rows; need++) {
+        auto fields = fieldsOf(graph.needColumns(need));
+        if(fields.size() == 1) plan.keyFields.emplace_back(fields.front(), need);
+        else if(!fields.empty()) {
+            plan.tuples.push_back(std::move(fields));
+            plan.tupleNeeds.push_back(need);
+        }
+    }
+    // The references to tables the rows may not be in yet.
+    for(auto l : graph.supporters(table)) {
+        if(options.parents != Parents::referenced || (pass != Pass::references && inputs.followed(l))) continue;
+        auto fields = fieldsOf(graph.childColumns(graph.link(l)));
+        if(fields.size() == 1) plan.referenceFields.emplace_back(fields.front(), l);
+        else if(!fields.empty()) {
+            plan.tuples.push_back(std::move(fields));
+            plan.tupleLinks.push_back(l);
+        }
+    }
+
+    // The capped links number the rows matching all the others.
+    const auto supporters = graph.supporters(table);
+    const bool scannable = inputs.semiJoins && table != inputs.rootTable && !cyclic && pass != Pass::references && inputs.fanouts[table].empty();
+    for(auto l : supporters) {
+        if(!scannable || !inputs.followed(l)) continue;
+        const FkLink& link = graph.link(l);
+        auto fields = fieldsOf(graph.childColumns(link));
+        if(fields.empty() || !inputs.semiJoins->scan(l, inputs.keyValues[link.need])) continue;
+        plan.scanned.push_back(l);
+        plan.scanChecks.push_back({std::move(fields), &inputs.keyValues[link.need]});
+        inputs.logger.info([&] {
+            std::string columns;
+            for(const auto& column : graph.columnNames(graph.childColumns(link))) columns += (columns.empty() ? "" : ", ") + column;
+            return graph.tableName(table) + ": scanned, (" + columns + ") matched against " +
+                std::to_string(inputs.keyValues[link.need].size()) + " keys here";
+        });
+    }
+
+    // Binary COPY only when every key column can be decoded here, as
+    // the type of its own need; references and tuples are kept as text.
+    // The filters of a cycle, of --table-where, of --fanout-limit, of
+    // composite keys and of the client are beyond prepared extraction.
+    plan.prepared = options.extract == Extraction::prepared && !plan.selectList.empty() && !cyclic &&
+        pass != Pass::references && inputs.predicates[table].empty() && inputs.fanouts[table].empty() && plan.scanned.empty() &&
+        std::none_of(supporters.begin(), supporters.end(), [&](LinkId l) { return graph.link(l).arity > 1; });
+    plan.inserts = inputs.target && options.load == Load::insert && pass != Pass::keys;
+    // Parquet needs the column list, and parses CSV.
+    plan.parquet = inputs.parquet && !plan.selectList.empty() && pass != Pass::keys;
+    plan.cursor = options.extract == Extraction::cursor;
+    plan.binary = options.copyFormat == CopyFormat::binary && !plan.selectList.empty() && !plan.prepared &&
+        !plan.cursor && !plan.inserts && !plan.parquet && !plan.references() && plan.tuples.empty() &&
+        plan.scanned.empty();
+    // Rows skipped for their primary key have to be whole messages, and
+    // the rows of isolated loads CSV records.
+    if(inputs.target && options.skipExisting && !cyclic && pass != Pass::keys) plan.binary = false;
+    if(inputs.rejects && pass != Pass::keys) plan.binary = false;
+    // Masking rewrites CSV records.
+    std::vector<std::pair<std::size_t, Mask>> maskedFields;
+    for(auto& [column, function] : inputs.masked[table]) {
+        for(std::size_t i = 0; i < selected.size() && pass != Pass::keys; i++) {
+            if(selected[i] == column) maskedFields.emplace_back(i, function);
+        }
+    }
+    if(!maskedFields.empty()) {
+        plan.masker = std::make_shared<const RowMasker>(inputs.masker, std::move(maskedFields));
+        plan.binary = false;
+    }
+    for(auto& [field, need] : plan.keyFields) {
+        for(auto& col : columns) {
+            if(col.name == selected[field] && !isBinaryKeyType(col.dataType)) plan.binary = false;
+        }
+    }
+    plan.copyOptions = plan.binary ? " WITH (FORMAT binary)" : " WITH (FORMAT csv)";
+    // The table is truncated in the transaction of the COPY, so the rows
+    // can go in frozen.
+    plan.loadOptions = options.load != Load::freeze ? plan.copyOptions :
+        plan.binary ? " WITH (FORMAT binary, FREEZE)" : " WITH (FORMAT csv, FREEZE)";
+    return plan;
+}
+
+} // namespace subset
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "chunk_diff.hpp"
+#include "closure.hpp"
+#include "components.hpp"
+#include "existing_keys.hpp"
+#include "extract_cache.hpp"
+#include "key_set.hpp"
+#include "key_sets.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "retry.hpp"
+#include "schema_graph.hpp"
+#include "seeds.hpp"
+#include "sink.hpp"
+#include "sink_factory.hpp"
+#include "snapshot.hpp"
+#include "staging_loader.hpp"
+#include "table_plan.hpp"
+#include "task_pool.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// What the reads of a table gave, and took.
+struct Output {
+    std::uint64_t rows = 0;
+    std::uint64_t bytes = 0;
+    double seconds = 0;
+    double cpuSeconds = 0;
+    double loadSeconds = 0;
+    std::uint64_t skipped = 0; // rows the target had
+};
+
+// What one statement of a table reads: a partition of it, a range of
+// its blocks, or with neither all of it.
+struct TablePart {
+    std::string relation;
+    std::string range;
+};
+
+// What a table's extraction and load run on besides the table: the job's
+// connections, caches and sinks, and the parts of the job it calls back
+// into, which share the key sets of all the tables.
+struct TableStep {
+    using Where = std::function<std::string(KeySetStage&)>;
+
+    const Options& options;
+    const SchemaGraph& graph;
+    const Components& components;
+    const Seeds& seeds;
+    TableId rootTable;
+    const std::optional<std::string>& snapshotId; // every worker reads as of
+    const PlanInputs& planning;
+    const SinkFactory& sinks;
+    CpuPlacement& placement;
+    Logger& logger;
+    pgfe::Connection_pool* targetPool; // with --pipe
+    pgfe::Connection_pool* streamPool; // the extra COPY streams of --load-streams
+    ExtractCache* cache;
+    MemoryCache* memoryCache;
+    std::function<pgfe::Connection_pool::Handle()> takeTarget;
+    // The WHERE clause of a table, the links scanned left to the client.
+    std::function<std::string(TableId, KeySetStage&, const std::vector<LinkId>& scanned)> whereCondition;
+    // Reads the rows of table matching where into sink, collecting their
+    // keys: into the shared key sets, or into keys when given.
+    std::function<void(TableId, const TablePlan&, pgfe::Connection&, Sink&, Output&, const Where& where,
+        const std::string& with, std::vector<KeySet>* keys, const std::string& relation)> extract;
+    // The cache entry of a table's extraction, none if it isn't cached.
+    std::function<std::optional<std::string>(TableId, const TablePlan&, Pass)> cacheEntry;
+    // Feeds a cached extraction to a sink and the key sets.
+    std::function<void(const TablePlan&, Sink&, Output&, std::string_view)> replay;
+    // The parts a table is read in side by side, one at a time on each of
+    // the helpers taken; none to read it whole.
+    std::function<std::vector<TablePart>(TableId, const TablePlan&, pgfe::Connection&,
+        std::vector<pgfe::Connection_pool::Handle>& helpers)> split;
+    std::function<void(NeedId, const KeySet&)> mergeKeys;
+    // Records a table done, in the metrics, the manifest and the checkpoint.
+    std::function<void(TableId, const TablePlan&, const Output&)> finish;
+};
+
+// Reads table on conn in pass and writes it to its sink, within a
+// transaction of the snapshot. The key pass skips the tables nothing
+// references and discards the rows it reads.
+inline void runTable(const TableStep& step, TableId table, pgfe::Connection& conn, Pass pass) {
+    const Options& options = step.options;
+    const SchemaGraph& graph = step.graph;
+    Logger& logger = step.logger;
+    TablePlan plan = planTable(step.planning, table, false, pass);
+    if(pass == Pass::keys && !plan.collectsKeys()) return;
+    SnapshotTransaction transaction{conn, step.snapshotId};
+    std::optional<pgfe::Connection_pool::Handle> target;
+    if(step.targetPool && pass != Pass::keys) target = step.takeTarget();
+    const bool freeze = target && options.load == Load::freeze;
+    // The keys are read on the table's own target connection, before
+    // its load starts, and dropped with the plan.
+    if(target && options.skipExisting) {
+        const std::string& tableName = graph.tableName(table);
+        const auto key = primaryKeyColumns(**target, tableName);
+        const auto field = key.size() == 1 ?
+            std::find(plan.quotedColumns.begin(), plan.quotedColumns.end(), key.front()) : plan.quotedColumns.end();
+        if(field != plan.quotedColumns.end()) {
+            plan.existingField = static_cast<std::size_t>(field - plan.quotedColumns.begin());
+            plan.existing = std::make_shared<const ExistingKeys>(**target, tableName, key.front(),
+                KeySet::kindOf(graph.tableColumns(table)[plan.existingField].dataType));
+            logger.debug([&] { return tableName + ": " + std::to_string(plan.existing->size()) + " keys in the target"; });
+        } else logger.info([&] { return tableName + ": no single-column primary key, every row is loaded"; });
+    }
+    // With --compare only the key ranges where the target differs from
+    // the subset are read; the key pass has the keys of the others.
+    std::string compared;
+    if(target && options.compare) {
+        const std::string& tableName = graph.tableName(table);
+        const auto key = primaryKeyColumns(**target, tableName);
+        const auto field = key.size() == 1 ?
+            std::find(plan.quotedColumns.begin(), plan.quotedColumns.end(), key.front()) : plan.quotedColumns.end();
+        if(field != plan.quotedColumns.end() && KeySet::kindOf(graph.tableColumns(table)[
+            static_cast<std::size_t>(field - plan.quotedColumns.begin())].dataType) == KeySet::Kind::integer) {
+            KeySetStage keySets{conn, options.inlineKeys};
+            ChunkDiff diff{conn, **target,
+                "SELECT " + plan.selectList + " FROM " + tableName + ' ' + step.whereCondition(table, keySets, {}),
+                "SELECT " + plan.selectList + " FROM " + tableName, key.front()};
+            const auto ranges = diff.differing();
+            compared = ChunkDiff::condition(key.front(), ranges);
+            logger.info([&] {
+                return tableName + ": " + std::to_string(ranges.size()) + " key ranges differ of " +
+                    std::to_string(diff.sourceRows()) + " rows";
+            });
+        } else logger.info([&] { return tableName + ": no integer primary key, every row is loaded"; });
+    }
+    // Rolled back if the table fails, for the connection to go back to
+    // the pool clean.
+    std::optional<pgfe::Transaction_guard> targetTransaction;
+    if(freeze) {
+        targetTransaction.emplace(**target);
+        (*target)->execute("TRUNCATE " + graph.tableName(table));
+    }
+    // Whichever streams are free when the table starts; declared before
+    // the sink, which is destroyed on them.
+    std::vector<pgfe::Connection_pool::Handle> streams;
+    if(target && !plan.inserts && options.load == Load::copy) {
+        while(step.streamPool && streams.size() < options.loadStreams - 1) {
+            auto stream = step.streamPool->connection();
+            if(!stream.is_valid()) break;
+            streams.push_back(std::move(stream));
+        }
+    }
+    const auto sink = pass == Pass::keys ? std::make_unique<NullSink>() :
+        step.sinks.openSink(table, plan, target ? &**target : nullptr, &streams);
+    Output output;
+    const auto read = [&](pgfe::Connection& conn, Sink& sink, Output& output, const TablePart& part,
+        std::vector<KeySet>* keys) {
+        const auto narrow = [&](const std::string& where) {
+            return part.range.empty() ? where : (where.empty() ? "WHERE " : where + " AND ") + part.range;
+        };
+        // With --closure=server the statement carries the closure of its
+        // ancestors instead of their key sets, starting from the seeds.
+        if(options.closure == Closure::server && serverClosure(graph, step.components, table, step.rootTable, "")) {
+            std::string with;
+            step.extract(table, plan, conn, sink, output, [&](KeySetStage& keySets) {
+                const auto closure = *serverClosure(graph, step.components, table, step.rootTable,
+                    step.seeds.condition(keySets, options.rootTable));
+                with = closure.with;
+                return narrow(closure.where);
+            }, with, keys, part.relation);
+        } else {
+            step.extract(table, plan, conn, sink, output, [&](KeySetStage& keySets) {
+                return narrow(step.whereCondition(table, keySets, plan.scanned));
+            }, "", keys, part.relation);
+        }
+    };
+
+    // A table read in parts isn't cached.
+    const auto entry = step.cacheEntry(table, plan, pass);
+    std::shared_ptr<const std::string> cached;
+    if(entry && step.memoryCache) cached = step.memoryCache->find(*entry);
+    if(entry && !cached && step.cache) {
+        if(auto bytes = step.cache->find(*entry)) {
+            cached = std::make_shared<const std::string>(std::move(*bytes));
+            if(step.memoryCache) step.memoryCache->insert(*entry, cached);
+        }
+    }
+    std::optional<ExtractCache::Writer> cacheWriter;
+    std::optional<MemoryCache::Writer> memoryWriter;
+    std::vector<pgfe::Connection_pool::Handle> helpers;
+    const auto parts = cached || !compared.empty() ? std::vector<TablePart>{} : step.split(table, plan, conn, helpers);
+    if(cached) {
+        logger.info([&] { return graph.tableName(table) + ": from the cache"; });
+        const Stopwatch stopwatch;
+        step.replay(plan, *sink, output, *cached);
+        output.seconds += stopwatch.seconds();
+    } else if(parts.empty() && entry) {
+        Sink* into = sink.get();
+        if(step.cache) into = &cacheWriter.emplace(*step.cache, *entry, *into);
+        if(step.memoryCache) into = &memoryWriter.emplace(*step.memoryCache, *entry, *into);
+        read(conn, *into, output, TablePart{}, nullptr);
+    } else if(parts.empty()) read(conn, *sink, output, TablePart{"", compared}, nullptr);
+    else {
+        // Worker 0 is the scheduler's connection, the others the helpers;
+        // each takes the next part until none is left.
+        const std::size_t workers = helpers.size() + 1;
+        std::mutex sinkMutex;
+        std::atomic<std::size_t> next = 0;
+        std::atomic<bool> failed = false;
+        std::vector<Output> outputs(workers);
+        std::vector<std::vector<KeySet>> keys(workers);
+        std::vector<std::exception_ptr> errors(workers);
+        const auto work = [&](std::size_t w, pgfe::Connection& conn) {
+            step.placement.pinWorker();
+            try {
+                keys[w] = makeKeySets(graph);
+                SinkBatch batch{*sink, sinkMutex, options.bufferSize};
+                for(auto i = next++; i < parts.size() && !failed; i = next++) read(conn, batch, outputs[w], parts[i], &keys[w]);
+                batch.close();
+            } catch(...) {
+                errors[w] = std::current_exception();
+                failed = true;
+            }
+        };
+        std::vector<std::thread> threads;
+        for(std::size_t w = 1; w < workers; w++) {
+            threads.emplace_back(withTracer([&, w] {
+                try {
+                    SnapshotTransaction helper{*helpers[w - 1], step.snapshotId};
+                    work(w, *helpers[w - 1]);
+                    helper.commit();
+                } catch(...) {
+                    if(!errors[w]) errors[w] = std::current_exception();
+                    failed = true;
+                }
+            }));
+        }
+        work(0, conn);
+        for(auto& thread : threads) thread.join();
+        for(const auto& error : errors) {
+            if(error) std::rethrow_exception(error);
+        }
+        const auto [first, last] = graph.needs(table);
+        mergeKeySets(keys, first, last);
+        for(auto need = first; need < last; need++) step.mergeKeys(need, keys.front()[need]);
+        for(std::size_t w = 0; w < workers; w++) {
+            output.rows += outputs[w].rows;
+            output.bytes += outputs[w].bytes;
+            output.seconds = std::max(output.seconds, outputs[w].seconds);
+            output.cpuSeconds += outputs[w].cpuSeconds;
+            output.skipped += outputs[w].skipped;
+        }
+    }
+    // Once the load is closed its rows may be in the target for good,
+    // and what fails after that isn't retried.
+    const auto complete = [&] {
+        const Stopwatch load;
+        const TraceSpan loading{"load", graph.tableName(table)};
+        sink->close();
+        if(freeze) targetTransaction->commit();
+        output.loadSeconds = load.seconds();
+        transaction.commit();
+        if(cacheWriter) cacheWriter->commit();
+        if(memoryWriter) memoryWriter->commit();
+        if(output.skipped) {
+            logger.info([&] {
+                return graph.tableName(table) + ": " + std::to_string(output.skipped) + " rows in the target already";
+            });
+        }
+        if(pass != Pass::keys) step.finish(table, plan, output);
+    };
+    if(target) runFinal(complete);
+    else complete();
+}
+
+} // namespace subset
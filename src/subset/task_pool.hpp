@@ -0,0 +1,74 @@
+#pragma once
+
+#include "../include/src/util/thread_pool.hpp"
+#include "trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace util = dmitigr::util;
+
+// The jobs of one feature on the process's shared thread pool, run at the
+// feature's priority. Used for the work taken off the COPY receive loop:
+// compression and file writes.
+class TaskPool {
+public:
+    TaskPool(util::Thread_pool& pool, util::Task_priority priority) : pool_{pool}, priority_{priority} {}
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    template<typename F>
+    std::future<std::invoke_result_t<F>> submit(F job) {
+        return pool_.submit(withTracer(std::move(job)), priority_);
+    }
+
+private:
+    util::Thread_pool& pool_;
+    util::Task_priority priority_;
+};
+
+// The cores of --pin-cpus, handed out in order: the first to the threads
+// running the COPY receive loops, one each as they start, and the rest to
+// the shared pool's compressors, writers and maskers. A thread pinned to a
+// core first touches its buffers there, on that core's NUMA node.
+class CpuPlacement {
+public:
+    CpuPlacement(std::vector<unsigned> cpus, std::size_t workers)
+        : cpus_{std::move(cpus)}, workers_{std::min(std::max<std::size_t>(workers, 1), cpus_.size())} {}
+
+    bool pinning() const { return !cpus_.empty(); }
+
+    // Pins the calling thread to the next of the workers' cores, unless
+    // it has been pinned by this placement already.
+    void pinWorker() {
+        thread_local std::uint64_t pinnedFor = 0;
+        if(cpus_.empty() || pinnedFor == id_) return;
+        pinnedFor = id_;
+        util::pin_current_thread(cpus_[next_.fetch_add(1, std::memory_order_relaxed) % workers_]);
+    }
+
+    // The shared pool's cores: all of them when the workers took them all.
+    std::vector<unsigned> poolCpus() const {
+        if(workers_ == cpus_.size()) return cpus_;
+        return {cpus_.begin() + static_cast<std::ptrdiff_t>(workers_), cpus_.end()};
+    }
+
+private:
+    static inline std::atomic<std::uint64_t> placements_ = 0;
+
+    std::vector<unsigned> cpus_;
+    std::size_t workers_;
+    std::uint64_t id_ = ++placements_;
+    std::atomic<std::size_t> next_ = 0;
+};
+
+} // namespace subset
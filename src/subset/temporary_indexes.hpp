@@ -0,0 +1,73 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+#include "checkpoint.hpp"
+#include "log.hpp"
+#include "sql.hpp"
+
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Indexes on the source built for one run, CONCURRENTLY so the source stays
+// writable, and dropped the same way when the run ends however it ends. For
+// a writable copy of the source: a replica can't take them. Each waits for
+// the transactions using its table, so they're built before the snapshot is
+// exported and dropped after it's released.
+class TemporaryIndexes {
+public:
+    TemporaryIndexes(pgfe::Connection& conn, std::string schema, Logger& logger)
+        : conn_{conn}, schema_{std::move(schema)}, logger_{logger} {}
+
+    TemporaryIndexes(const TemporaryIndexes&) = delete;
+    TemporaryIndexes& operator=(const TemporaryIndexes&) = delete;
+
+    ~TemporaryIndexes() {
+        for(const auto& name : names_) {
+            try {
+                conn_.execute("DROP INDEX CONCURRENTLY IF EXISTS " + name);
+            } catch(const std::exception& e) {
+                logger_.warn([&] { return "cannot drop the temporary index " + name + ": " + e.what(); });
+            }
+        }
+    }
+
+    // Returns whether the index was built; one the server refuses, as on a
+    // partitioned table, is left out with a warning.
+    bool create(const std::string& table, const std::string& column) {
+        // Named after what it's on, so the one of a run that died is found
+        // and replaced.
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(fnv1a(table + '.' + column)));
+        const std::string name = quoteIdentifier(schema_) + '.' + quoteIdentifier(std::string{"subset_fk_"} + hash);
+        try {
+            conn_.execute("DROP INDEX CONCURRENTLY IF EXISTS " + name);
+            conn_.execute("CREATE INDEX CONCURRENTLY " + name.substr(name.find('.') + 1) + " ON " + table + " (" +
+                quoteIdentifier(column) + ')');
+        } catch(const pgfe::Server_exception& e) {
+            logger_.warn([&] { return "cannot index " + table + '.' + column + ": " + e.what(); });
+            // A build that failed half way leaves an invalid index behind.
+            try {
+                conn_.execute("DROP INDEX CONCURRENTLY IF EXISTS " + name);
+            } catch(...) {}
+            return false;
+        }
+        names_.push_back(name);
+        return true;
+    }
+
+    std::size_t size() const { return names_.size(); }
+
+private:
+    pgfe::Connection& conn_;
+    std::string schema_;
+    Logger& logger_;
+    std::vector<std::string> names_;
+};
+
+} // namespace subset
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "metrics.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+// The spans of a run, for a timeline of which thread did what and waited on
+// what: written as Chrome Trace Event JSON, which chrome://tracing and
+// Perfetto open. Every thread records into a buffer of its own, taking the
+// lock only the first time; json() is read once the traced work is over.
+// The tracer active is a thread's own, see TraceScope: a job traces into
+// its tracer alone, and its work handed to other threads takes the tracer
+// along with withTracer().
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Tracer() : id_{nextId_++}, origin_{Clock::now()} {}
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    static Tracer* active() { return active_; }
+
+    void record(std::string name, const char* category, Clock::time_point start, Clock::time_point end) {
+        buffer().events.push_back({std::move(name), category, start - origin_, end - start});
+    }
+
+    std::string json() const {
+        std::lock_guard lock{mutex_};
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for(const auto& buffer : buffers_) {
+            for(const auto& event : buffer.events) {
+                out += first ? "\n" : ",\n";
+                first = false;
+                out += "{\"name\":";
+                appendJsonString(out, event.name);
+                out += ",\"cat\":\"" + std::string{event.category} + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" +
+                    std::to_string(buffer.thread) + ",\"ts\":" + micros(event.start) + ",\"dur\":" + micros(event.duration) + '}';
+            }
+        }
+        return out + "\n]}\n";
+    }
+
+private:
+    friend class TraceScope;
+
+    struct Event {
+        std::string name;
+        const char* category;
+        Clock::duration start;
+        Clock::duration duration;
+    };
+    struct Buffer {
+        std::uint32_t thread;
+        std::vector<Event> events;
+    };
+
+    // The calling thread's buffer, found again by the tracer's id, which
+    // unlike its address is never reused.
+    Buffer& buffer() {
+        thread_local std::uint64_t owner = 0;
+        thread_local Buffer* cached = nullptr;
+        if(owner != id_) {
+            std::lock_guard lock{mutex_};
+            buffers_.push_back({static_cast<std::uint32_t>(buffers_.size() + 1), {}});
+            owner = id_;
+            cached = &buffers_.back();
+        }
+        return *cached;
+    }
+
+    static std::string micros(Clock::duration d) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        return std::to_string(ns / 1000) + '.' + std::to_string(ns % 1000 / 100);
+    }
+
+    inline static thread_local Tracer* active_ = nullptr;
+    inline static std::atomic<std::uint64_t> nextId_ = 1;
+    std::uint64_t id_;
+    Clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::deque<Buffer> buffers_; // stable addresses
+};
+
+// Makes tracer, which may be null, the calling thread's active one while
+// it lives; the jobs of a daemon, or of --sources, running side by side
+// aren't traced into each other.
+class TraceScope {
+public:
+    explicit TraceScope(Tracer* tracer) : previous_{std::exchange(Tracer::active_, tracer)} {}
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope() { Tracer::active_ = previous_; }
+
+private:
+    Tracer* previous_;
+};
+
+// f, run on another thread, traced into the calling thread's tracer.
+template<typename F>
+auto withTracer(F f) {
+    return [tracer = Tracer::active(), f = std::move(f)](auto&&... args) mutable -> decltype(auto) {
+        const TraceScope scope{tracer};
+        return f(std::forward<decltype(args)>(args)...);
+    };
+}
+
+// One span on the active tracer, from construction to destruction: a
+// relaxed load and nothing else when none is active. The name is name,
+// followed by detail if given, put together only when traced.
+class TraceSpan {
+public:
+    TraceSpan(const char* category, std::string_view name, std::string_view detail = {}) : tracer_{Tracer::active()} {
+        if(!tracer_) return;
+        category_ = category;
+        name_ = name;
+        if(!detail.empty()) (name_ += ' ') += detail;
+        start_ = Tracer::Clock::now();
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() {
+        if(tracer_) tracer_->record(std::move(name_), category_, start_, Tracer::Clock::now());
+    }
+
+private:
+    Tracer* tracer_;
+    const char* category_ = nullptr;
+    std::string name_;
+    Tracer::Clock::time_point start_;
+};
+
+// The trace of one job into a file: written by write() once the job's work
+// is done, or by the destructor when it ends early, a failed run being the
+// one most worth looking at.
+class TraceFile {
+public:
+    explicit TraceFile(std::filesystem::path path) : path_{std::move(path)}, scope_{&tracer_} {}
+
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    ~TraceFile() {
+        try {
+            write();
+        } catch(...) {}
+    }
+
+    void write() {
+        if(written_) return;
+        written_ = true;
+        std::ofstream out{path_};
+        out << tracer_.json();
+        if(!out) throw std::runtime_error{"cannot write " + path_.string()};
+    }
+
+private:
+    std::filesystem::path path_;
+    Tracer tracer_;
+    TraceScope scope_;
+    bool written_ = false;
+};
+
+} // namespace subset
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "../include/src/pgfe/pgfe.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace subset {
+
+namespace pgfe = dmitigr::pgfe;
+
+// Cancels the queries still running on their connections past a deadline,
+// from one thread of the process's, started with the first deadline. The
+// cancel is sent outside the lock, so a slow server doesn't hold up the
+// other deadlines, but disarm() waits for one in flight: once it returns no
+// cancel meant for the query can reach the next one.
+class Watchdog {
+    struct Entry {
+        pgfe::Cancel_handle handle;
+        std::chrono::steady_clock::time_point at;
+        bool armed = true;
+        bool fired = false;
+        bool cancelling = false;
+    };
+
+public:
+    // Armed until disarmed or destroyed.
+    class Deadline {
+    public:
+        Deadline(Watchdog& watchdog, std::shared_ptr<Entry> entry) : watchdog_{&watchdog}, entry_{std::move(entry)} {}
+
+        Deadline(Deadline&& rhs) noexcept : watchdog_{rhs.watchdog_}, entry_{std::move(rhs.entry_)} {}
+        Deadline& operator=(const Deadline&) = delete;
+
+        ~Deadline() { disarm(); }
+
+        // Returns whether the query was cancelled.
+        bool disarm() {
+            if(!entry_) return false;
+            std::unique_lock lock{watchdog_->mutex_};
+            entry_->armed = false;
+            watchdog_->cancelled_.wait(lock, [this] { return !entry_->cancelling; });
+            return entry_->fired;
+        }
+
+    private:
+        Watchdog* watchdog_;
+        std::shared_ptr<Entry> entry_;
+    };
+
+    Watchdog() = default;
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+
+    ~Watchdog() {
+        {
+            const std::lock_guard lock{mutex_};
+            stopping_ = true;
+        }
+        changed_.notify_one();
+        if(thread_.joinable()) thread_.join();
+    }
+
+    // Cancels the query conn runs next if it's still running after timeout.
+    Deadline arm(const pgfe::Connection& conn, std::chrono::milliseconds timeout) {
+        auto entry = std::make_shared<Entry>(Entry{conn.cancel_handle(), std::chrono::steady_clock::now() + timeout});
+        {
+            const std::lock_guard lock{mutex_};
+            entries_.push_back(entry);
+            if(!thread_.joinable()) thread_ = std::thread{[this] { run(); }};
+        }
+        changed_.notify_one();
+        return Deadline{*this, std::move(entry)};
+    }
+
+private:
+    void run() {
+        std::unique_lock lock{mutex_};
+        while(!stopping_) {
+            std::erase_if(entries_, [](const auto& entry) { return !entry->armed; });
+            if(entries_.empty()) {
+                changed_.wait(lock);
+                continue;
+            }
+            const auto next = std::min_element(entries_.begin(), entries_.end(),
+                [](const auto& a, const auto& b) { return a->at < b->at; });
+            if(std::chrono::steady_clock::now() < (*next)->at) {
+                changed_.wait_until(lock, (*next)->at);
+                continue;
+            }
+            const auto entry = *next;
+            entry->fired = true;
+            entry->armed = false;
+            entry->cancelling = true;
+            lock.unlock();
+            entry->handle.cancel();
+            lock.lock();
+            entry->cancelling = false;
+            cancelled_.notify_all();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::condition_variable cancelled_;
+    std::vector<std::shared_ptr<Entry>> entries_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+// The process's watchdog.
+inline Watchdog& watchdog() {
+    static Watchdog instance;
+    return instance;
+}
+
+} // namespace subset